@@ -0,0 +1,352 @@
+//
+//  archive_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/archive.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/document_preloader.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/zip_archive.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "../ePub3/utilities/byte_stream.h"
+#include <libzip/zip.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+using namespace ePub3;
+
+// reads a whole archive entry through ZipFileByteStream
+static size_t ReadEntry(const Archive* archive, const std::string& path)
+{
+    auto stream = archive->ByteStreamAtPath(path);
+    bench::Require(bool(stream), "Unable to open the archive entry");
+
+    uint8_t buf[64*1024];
+    size_t total = 0, num = 0;
+    while ( (num = stream->ReadBytes(buf, sizeof(buf))) > 0 )
+        total += num;
+    return total;
+}
+
+// reads 4KB at random offsets, seeking before each read
+static void RandomReads(bench::State& state, const std::string& path, size_t size, size_t reads)
+{
+    auto archive = Archive::Open(bench::LargeBook().path);
+    bench::Require(bool(archive), "Unable to open the synthetic book");
+
+    auto stream = archive->ByteStreamAtPath(path);
+    SeekableByteStream* seekable = dynamic_cast<SeekableByteStream*>(stream.get());
+    bench::Require(seekable != nullptr, "Archive streams should be seekable");
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<size_t> offset(0, size - 4096);
+    uint8_t buf[4096];
+
+    state.SetBytesPerIteration(reads * sizeof(buf));
+    state.SetItemsPerIteration(reads);
+    state.Measure([&] {
+        for ( size_t i = 0; i < reads; i++ )
+        {
+            seekable->Seek(offset(random), std::ios::beg);
+            bench::Require(seekable->ReadBytes(buf, sizeof(buf)) == sizeof(buf), "Short read");
+        }
+    });
+}
+
+BENCHMARK("zip/read/deflated")
+{
+    const bench::SyntheticBook& book = bench::LargeBook();
+    auto archive = Archive::Open(book.path);
+    bench::Require(bool(archive), "Unable to open the synthetic book");
+
+    state.SetBytesPerIteration(book.largeChapterSize);
+    state.Measure([&] {
+        bench::Require(ReadEntry(archive.get(), book.largeChapter) == book.largeChapterSize, "Short read");
+    });
+}
+
+BENCHMARK("zip/read/stored")
+{
+    const bench::SyntheticBook& book = bench::LargeBook();
+    auto archive = Archive::Open(book.path);
+    bench::Require(bool(archive), "Unable to open the synthetic book");
+
+    state.SetBytesPerIteration(book.mediaSize);
+    state.Measure([&] {
+        bench::Require(ReadEntry(archive.get(), book.media) == book.mediaSize, "Short read");
+    });
+}
+
+BENCHMARK("zip/seek/deflated")
+{
+    RandomReads(state, bench::LargeBook().largeChapter, bench::LargeBook().largeChapterSize, 8);
+}
+
+BENCHMARK("zip/seek/stored")
+{
+    RandomReads(state, bench::LargeBook().media, bench::LargeBook().mediaSize, 64);
+}
+
+BENCHMARK("zip/open_entry")
+{
+    const bench::SyntheticBook& book = bench::LargeBook();
+    auto archive = Archive::Open(book.path);
+    bench::Require(bool(archive), "Unable to open the synthetic book");
+
+    std::vector<std::string> paths;
+    for ( size_t i = 0; i < book.chapterCount; i++ )
+        paths.push_back("EPUB/c" + std::to_string(i) + ".xhtml");
+
+    state.SetItemsPerIteration(paths.size());
+    state.Measure([&] {
+        for ( auto& path : paths )
+            bench::Require(bool(archive->ByteStreamAtPath(path)), "Missing entry");
+    });
+}
+
+static const int kLookupEntryCount = 50000;
+static const int kLookupCount = 2000;
+
+// an archive with a very large central directory of one-byte entries
+static const std::string& LookupArchive()
+{
+    static std::unique_ptr<std::string> path;
+    if ( path )
+        return *path;
+
+    path.reset(new std::string(bench::ScratchPath("lookup.zip")));
+    ZipStreamWriter writer(*path);
+    for ( int i = 0; i < kLookupEntryCount; i++ )
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "OPS/content/item-%05d.xhtml", i);
+        writer.AddEntry(name, "x", 1, false);
+    }
+    bench::Require(writer.Close(), "Unable to write the lookup archive");
+    return *path;
+}
+
+// spread over the whole directory, so a linear scan isn't flattered
+static std::vector<std::string> LookupNames()
+{
+    std::vector<std::string> names;
+    for ( int i = 0; i < kLookupCount; i++ )
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "OPS/content/item-%05d.xhtml", (i * 7919) % kLookupEntryCount);
+        names.push_back(name);
+    }
+    return names;
+}
+
+BENCHMARK("zip/lookup/open")
+{
+    const std::string& path = LookupArchive();
+    state.SetCounter("entries", kLookupEntryCount);
+    state.Measure([&] {
+        ZipArchive archive(path);
+    });
+}
+
+BENCHMARK("zip/lookup/zip_name_locate")
+{
+    std::vector<std::string> names = LookupNames();
+    int zerr = 0;
+    struct zip* zip = zip_open(LookupArchive().c_str(), 0, &zerr);
+    bench::Require(zip != nullptr, "Unable to open the lookup archive");
+
+    state.SetItemsPerIteration(names.size());
+    state.Measure([&] {
+        for ( auto& name : names )
+            bench::Require(zip_name_locate(zip, name.c_str(), 0) >= 0, "Missing entry");
+    });
+    zip_close(zip);
+}
+
+BENCHMARK("zip/lookup/index")
+{
+    std::vector<std::string> names = LookupNames();
+    ZipArchive archive(LookupArchive());
+
+    state.SetItemsPerIteration(names.size());
+    state.Measure([&] {
+        for ( auto& name : names )
+            bench::Require(archive.IndexOfItem(name) >= 0, "Missing entry");
+    });
+}
+
+BENCHMARK("zip/lookup/byte_stream")
+{
+    std::vector<std::string> names = LookupNames();
+    ZipArchive archive(LookupArchive());
+
+    state.SetItemsPerIteration(names.size());
+    state.Measure([&] {
+        for ( auto& name : names )
+            bench::Require(archive.ByteStreamAtPath(name)->IsOpen(), "Missing entry");
+    });
+}
+
+// Container::OpenContainer on each TestData book, and on the synthetic one
+static void OpenContainer(bench::State& state, const std::string& path)
+{
+    if ( ::access(path.c_str(), R_OK) != 0 )
+    {
+        state.Skip("missing " + path);
+        return;
+    }
+
+    state.Measure([&] {
+        ContainerPtr container = Container::OpenContainer(path);
+        bench::Require(bool(container) && bool(container->DefaultPackage()), "Unable to open the container");
+    });
+}
+
+// the same, with the parse-ahead of the package's documents turned off
+static void OpenContainerSequentially(bench::State& state, const std::string& path)
+{
+    bool enabled = DocumentPreloader::Enabled();
+    DocumentPreloader::SetEnabled(false);
+    try
+    {
+        OpenContainer(state, path);
+    }
+    catch (...)
+    {
+        DocumentPreloader::SetEnabled(enabled);
+        throw;
+    }
+    DocumentPreloader::SetEnabled(enabled);
+}
+
+// Container::ProbeMetadata on the same books
+static void ProbeContainer(bench::State& state, const std::string& path)
+{
+    if ( ::access(path.c_str(), R_OK) != 0 )
+    {
+        state.Skip("missing " + path);
+        return;
+    }
+
+    state.Measure([&] {
+        PublicationSummary summary = Container::ProbeMetadata(path);
+        bench::Require(!summary.packagePath.empty(), "Unable to probe the container");
+    });
+}
+
+static struct ContainerBenchmarks
+{
+    ContainerBenchmarks()
+    {
+        for ( auto& book : bench::TestBooks() )
+        {
+            std::string name = book.substr(0, book.rfind('.'));
+            static_cast<void>(bench::Registration("container/open/" + name, [book](bench::State& state) {
+                OpenContainer(state, bench::TestDataPath(book));
+            }));
+            static_cast<void>(bench::Registration("container/open_sequential/" + name, [book](bench::State& state) {
+                OpenContainerSequentially(state, bench::TestDataPath(book));
+            }));
+            static_cast<void>(bench::Registration("container/probe/" + name, [book](bench::State& state) {
+                ProbeContainer(state, bench::TestDataPath(book));
+            }));
+        }
+    }
+} gContainerBenchmarks;
+
+BENCHMARK("container/open/synthetic")
+{
+    OpenContainer(state, bench::LargeBook().path);
+    state.SetCounter("spine_items", bench::LargeBook().chapterCount + 1);
+}
+
+BENCHMARK("container/open_sequential/synthetic")
+{
+    OpenContainerSequentially(state, bench::LargeBook().path);
+}
+
+BENCHMARK("container/probe/synthetic")
+{
+    ProbeContainer(state, bench::LargeBook().path);
+}
+
+// indexing a library: every TestData book and both synthetic ones
+static std::vector<std::string> LibraryCorpus()
+{
+    std::vector<std::string> paths;
+    for ( auto& book : bench::TestBooks() )
+    {
+        std::string path = bench::TestDataPath(book);
+        if ( ::access(path.c_str(), R_OK) == 0 )
+            paths.push_back(path);
+    }
+    paths.push_back(bench::LargeBook().path);
+    paths.push_back(bench::ManyItemsBook().path);
+    return paths;
+}
+
+BENCHMARK("library/scan/open")
+{
+    std::vector<std::string> corpus = LibraryCorpus();
+    size_t titled = 0;
+
+    state.SetItemsPerIteration(corpus.size());
+    state.Measure([&] {
+        titled = 0;
+        for ( auto& path : corpus )
+            titled += !Container::OpenContainer(path)->DefaultPackage()->Title(false).empty();
+    });
+    state.SetCounter("titled", titled);
+}
+
+BENCHMARK("library/scan/probe")
+{
+    std::vector<std::string> corpus = LibraryCorpus();
+    size_t titled = 0;
+
+    state.SetItemsPerIteration(corpus.size());
+    state.Measure([&] {
+        titled = 0;
+        for ( auto& path : corpus )
+            titled += !Container::ProbeMetadata(path).title.empty();
+    });
+    state.SetCounter("titled", titled);
+}
+
+BENCHMARK("library/scan/probe_4_threads")
+{
+    std::vector<std::string> corpus = LibraryCorpus();
+    const size_t kThreads = 4;
+    std::atomic<size_t> titled(0);
+
+    state.SetItemsPerIteration(corpus.size() * kThreads);
+    state.Measure([&] {
+        titled = 0;
+        std::vector<std::thread> threads;
+        for ( size_t t = 0; t < kThreads; t++ )
+        {
+            threads.emplace_back([&] {
+                for ( auto& path : corpus )
+                    titled += !Container::ProbeMetadata(path).title.empty();
+            });
+        }
+        for ( auto& thread : threads )
+            thread.join();
+    });
+    state.SetCounter("titled", titled.load());
+}
@@ -0,0 +1,369 @@
+//
+//  benchmark.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "../ePub3/ePub/initialization.h"
+#include "../ePub3/ePub/filter_manager_impl.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <dirent.h>
+#include <unistd.h>
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation counting
+
+static std::atomic<uint64_t> gAllocationCount(0);
+static std::atomic<uint64_t> gAllocatedBytes(0);
+
+static void* CountedAllocate(std::size_t size)
+{
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if ( p == nullptr )
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size)                                    { return CountedAllocate(size); }
+void* operator new[](std::size_t size)                                  { return CountedAllocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return CountedAllocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    try { return CountedAllocate(size); } catch (...) { return nullptr; }
+}
+void operator delete(void* p) noexcept                                  { std::free(p); }
+void operator delete[](void* p) noexcept                                { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept                     { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept                   { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept           { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept         { std::free(p); }
+
+namespace bench {
+
+AllocationCounts AllocationCounts::Current()
+{
+    AllocationCounts result;
+    result.count = gAllocationCount.load(std::memory_order_relaxed);
+    result.bytes = gAllocatedBytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// State
+
+State::State(const std::string& name, bool quick)
+  : _name(name), _quick(quick), _samples(), _totalNanoseconds(0), _bytesPerIteration(0), _itemsPerIteration(0),
+    _allocations(), _counters(), _skipReason()
+{
+    _allocations.count = _allocations.bytes = 0;
+}
+void State::Measure(std::function<void()> fn)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    // quick runs only check that every benchmark still works
+    const nanoseconds budget(_quick ? 20000000 : 500000000);
+    const size_t minIterations = (_quick ? 2 : 10);
+    const size_t maxIterations = (_quick ? 20 : 100000);
+
+    fn();
+
+    AllocationCounts before = AllocationCounts::Current();
+    Clock::time_point start = Clock::now();
+    do
+    {
+        Clock::time_point iterationStart = Clock::now();
+        fn();
+        _samples.push_back(duration_cast<nanoseconds>(Clock::now() - iterationStart).count());
+
+    } while ( _samples.size() < maxIterations && (_samples.size() < minIterations || Clock::now() - start < budget) );
+
+    _totalNanoseconds = duration_cast<nanoseconds>(Clock::now() - start).count();
+
+    AllocationCounts after = AllocationCounts::Current();
+    _allocations.count = after.count - before.count;
+    _allocations.bytes = after.bytes - before.bytes;
+}
+void State::SetCounter(const std::string& name, double value)
+{
+    for ( auto& counter : _counters )
+    {
+        if ( counter.first == name )
+        {
+            counter.second = value;
+            return;
+        }
+    }
+    _counters.emplace_back(name, value);
+}
+uint64_t State::Percentile(double p) const
+{
+    if ( _samples.empty() )
+        return 0;
+
+    std::vector<uint64_t> sorted(_samples);
+    std::sort(sorted.begin(), sorted.end());
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static std::string JSONString(const std::string& str)
+{
+    std::ostringstream ss;
+    ss << '"';
+    for ( char ch : str )
+    {
+        switch ( ch )
+        {
+            case '"':   ss << "\\\""; break;
+            case '\\':  ss << "\\\\"; break;
+            case '\n':  ss << "\\n"; break;
+            default:
+                if ( static_cast<unsigned char>(ch) < 0x20 )
+                    ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(ch) << std::dec;
+                else
+                    ss << ch;
+                break;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+std::string State::ToJSON() const
+{
+    std::ostringstream ss;
+    ss << "{\"name\":" << JSONString(_name);
+    if ( Skipped() )
+    {
+        ss << ",\"skipped\":" << JSONString(_skipReason) << '}';
+        return ss.str();
+    }
+
+    size_t iterations = _samples.size();
+    double meanNanoseconds = (iterations == 0 ? 0.0 : double(_totalNanoseconds) / iterations);
+    double seconds = double(_totalNanoseconds) / 1e9;
+
+    ss << std::fixed << std::setprecision(1)
+       << ",\"iterations\":" << iterations
+       << ",\"mean_ns\":" << meanNanoseconds
+       << ",\"min_ns\":" << Percentile(0.0)
+       << ",\"p50_ns\":" << Percentile(0.5)
+       << ",\"p90_ns\":" << Percentile(0.9)
+       << ",\"p99_ns\":" << Percentile(0.99)
+       << ",\"max_ns\":" << Percentile(1.0);
+    if ( _bytesPerIteration != 0 )
+    {
+        ss << ",\"bytes_per_iteration\":" << _bytesPerIteration
+           << ",\"throughput_mb_s\":" << (seconds > 0 ? (double(_bytesPerIteration) * iterations) / (1024.0 * 1024.0) / seconds : 0.0);
+    }
+    if ( _itemsPerIteration != 0 )
+    {
+        ss << ",\"items_per_iteration\":" << _itemsPerIteration
+           << ",\"items_per_second\":" << (seconds > 0 ? (double(_itemsPerIteration) * iterations) / seconds : 0.0);
+    }
+    ss << ",\"allocations_per_iteration\":" << (iterations == 0 ? 0.0 : double(_allocations.count) / iterations)
+       << ",\"allocated_bytes_per_iteration\":" << (iterations == 0 ? 0.0 : double(_allocations.bytes) / iterations);
+    if ( !_counters.empty() )
+    {
+        ss << ",\"counters\":{";
+        for ( size_t i = 0; i < _counters.size(); i++ )
+            ss << (i == 0 ? "" : ",") << JSONString(_counters[i].first) << ':' << _counters[i].second;
+        ss << '}';
+    }
+    ss << '}';
+    return ss.str();
+}
+std::string State::ToText() const
+{
+    std::ostringstream ss;
+    ss << std::left << std::setw(40) << _name;
+    if ( Skipped() )
+    {
+        ss << "skipped: " << _skipReason;
+        return ss.str();
+    }
+
+    size_t iterations = _samples.size();
+    double seconds = double(_totalNanoseconds) / 1e9;
+    ss << std::right << std::fixed << std::setprecision(1)
+       << std::setw(8) << iterations << " it"
+       << std::setw(12) << Percentile(0.5) / 1000.0 << " us p50"
+       << std::setw(12) << Percentile(0.99) / 1000.0 << " us p99";
+    if ( _bytesPerIteration != 0 && seconds > 0 )
+        ss << std::setw(10) << (double(_bytesPerIteration) * iterations) / (1024.0 * 1024.0) / seconds << " MB/s";
+    ss << std::setw(10) << (iterations == 0 ? 0.0 : double(_allocations.count) / iterations) << " allocs";
+    return ss.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Registration and fixtures
+
+static std::vector<std::pair<std::string, BenchmarkFn>>& Registry()
+{
+    static std::vector<std::pair<std::string, BenchmarkFn>> registry;
+    return registry;
+}
+
+Registration::Registration(const std::string& name, BenchmarkFn fn)
+{
+    Registry().emplace_back(name, fn);
+}
+
+static std::string gTestDataDir("TestData");
+static std::string gScratchDir;
+
+std::string TestDataPath(const std::string& name)
+{
+    return gTestDataDir + "/" + name;
+}
+std::string ScratchPath(const std::string& name)
+{
+    if ( gScratchDir.empty() )
+    {
+        const char* tmp = std::getenv("TMPDIR");
+        std::string pattern = std::string(tmp != nullptr ? tmp : "/tmp") + "/epub3-bench-XXXXXX";
+        std::vector<char> buf(pattern.begin(), pattern.end());
+        buf.push_back('\0');
+        if ( ::mkdtemp(buf.data()) == nullptr )
+            throw std::runtime_error("Unable to create a scratch directory");
+        gScratchDir = buf.data();
+    }
+    return gScratchDir + "/" + name;
+}
+
+static void RemoveScratch()
+{
+    if ( gScratchDir.empty() )
+        return;
+
+    DIR* dir = ::opendir(gScratchDir.c_str());
+    if ( dir != nullptr )
+    {
+        struct dirent* entry;
+        while ( (entry = ::readdir(dir)) != nullptr )
+        {
+            if ( std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0 )
+                ::unlink((gScratchDir + "/" + entry->d_name).c_str());
+        }
+        ::closedir(dir);
+    }
+    ::rmdir(gScratchDir.c_str());
+}
+
+}   // namespace bench
+
+///////////////////////////////////////////////////////////////////////////////
+// Driver
+
+static void Usage(const char* argv0)
+{
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --filter <text>     Run only benchmarks whose names contain <text>\n"
+              << "  --output <file>     Write JSON results to <file> rather than stdout\n"
+              << "  --data-dir <dir>    Location of the TestData folder (default: ./TestData)\n"
+              << "  --quick             Run each benchmark only a few times, as a smoke test\n"
+              << "  --list              List the benchmarks and exit\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> filters;
+    std::string outputPath;
+    bool quick = false, list = false;
+
+    for ( int i = 1; i < argc; i++ )
+    {
+        std::string arg(argv[i]);
+        if ( arg == "--quick" )
+            quick = true;
+        else if ( arg == "--list" )
+            list = true;
+        else if ( arg == "--filter" && i + 1 < argc )
+            filters.push_back(argv[++i]);
+        else if ( arg == "--output" && i + 1 < argc )
+            outputPath = argv[++i];
+        else if ( arg == "--data-dir" && i + 1 < argc )
+            bench::gTestDataDir = argv[++i];
+        else
+        {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+
+    auto& registry = bench::Registry();
+    std::stable_sort(registry.begin(), registry.end(), [](const std::pair<std::string, bench::BenchmarkFn>& a, const std::pair<std::string, bench::BenchmarkFn>& b) {
+        return a.first < b.first;
+    });
+
+    if ( list )
+    {
+        for ( auto& entry : registry )
+            std::cout << entry.first << std::endl;
+        return 0;
+    }
+
+    ePub3::InitializeSdk();
+    ePub3::PopulateFilterManager();
+
+    std::ofstream file;
+    if ( !outputPath.empty() )
+    {
+        file.open(outputPath.c_str(), std::ios::out | std::ios::trunc);
+        if ( !file )
+        {
+            std::cerr << "Unable to write to " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& output = (outputPath.empty() ? std::cout : file);
+
+    int failures = 0;
+    for ( auto& entry : registry )
+    {
+        if ( !filters.empty() && std::none_of(filters.begin(), filters.end(), [&](const std::string& f) { return entry.first.find(f) != std::string::npos; }) )
+            continue;
+
+        bench::State state(entry.first, quick);
+        try
+        {
+            entry.second(state);
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << entry.first << " failed: " << e.what() << std::endl;
+            failures++;
+            continue;
+        }
+
+        output << state.ToJSON() << std::endl;
+        std::cerr << state.ToText() << std::endl;
+    }
+
+    bench::RemoveScratch();
+    return (failures == 0 ? 0 : 1);
+}
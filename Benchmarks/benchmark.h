@@ -0,0 +1,136 @@
+//
+//  benchmark.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#ifndef __ePub3__benchmark__
+#define __ePub3__benchmark__
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+/**
+ Counts the C++ heap allocations made by the benchmark process.
+
+ The global `operator new` and `operator delete` are replaced in benchmark.cpp to
+ keep these totals; allocations made through `malloc()` (by libxml2 or zlib, for
+ instance) aren't seen.
+ */
+struct AllocationCounts
+{
+    uint64_t    count;      ///< The number of allocations.
+    uint64_t    bytes;      ///< The total number of bytes requested.
+
+    static AllocationCounts Current();
+};
+
+/**
+ Runs the body of one benchmark and records its measurements.
+
+ A benchmark calls Measure() with the operation to time; it's run repeatedly
+ until enough samples have been taken, each iteration being timed on its own so
+ that latency percentiles can be reported alongside the mean. Setup which
+ shouldn't be timed goes before the call to Measure().
+ */
+class State
+{
+public:
+    typedef std::chrono::steady_clock   Clock;
+
+    State(const std::string& name, bool quick);
+
+    ///
+    /// Runs `fn` once to warm up, and then repeatedly, timing each iteration.
+    void                Measure(std::function<void()> fn);
+
+    ///
+    /// The number of bytes each iteration processes, for throughput figures.
+    void                SetBytesPerIteration(uint64_t bytes)        { _bytesPerIteration = bytes; }
+    ///
+    /// The number of items (documents, CFIs, strings) each iteration processes.
+    void                SetItemsPerIteration(uint64_t items)        { _itemsPerIteration = items; }
+    ///
+    /// Reports an additional named figure with the results.
+    void                SetCounter(const std::string& name, double value);
+    ///
+    /// Marks the benchmark as skipped, for instance when a fixture is missing.
+    void                Skip(const std::string& reason)             { _skipReason = reason; }
+
+    ///
+    /// Writes the results as a single line of JSON.
+    std::string         ToJSON()                                    const;
+    ///
+    /// Writes the results as a line of readable text.
+    std::string         ToText()                                    const;
+
+    const std::string&  Name()                                      const   { return _name; }
+    bool                Skipped()                                   const   { return !_skipReason.empty(); }
+
+private:
+    std::string                 _name;
+    bool                        _quick;
+    std::vector<uint64_t>       _samples;           ///< Nanoseconds per iteration.
+    uint64_t                    _totalNanoseconds;
+    uint64_t                    _bytesPerIteration;
+    uint64_t                    _itemsPerIteration;
+    AllocationCounts            _allocations;       ///< Totals over all timed iterations.
+    std::vector<std::pair<std::string, double>> _counters;
+    std::string                 _skipReason;
+
+    uint64_t                    Percentile(double p)                const;
+};
+
+typedef std::function<void(State&)>  BenchmarkFn;
+
+/**
+ Adds a benchmark to the suite, usually through the BENCHMARK() macro.
+
+ Benchmarks over a set of fixtures may create Registrations directly, one per
+ fixture, during static initialization.
+ */
+struct Registration
+{
+    Registration(const std::string& name, BenchmarkFn fn);
+};
+
+///
+/// The path of a file in the repository's TestData folder.
+std::string TestDataPath(const std::string& name);
+
+///
+/// A directory for generated fixtures, removed when the suite exits.
+std::string ScratchPath(const std::string& name);
+
+}   // namespace bench
+
+#define BENCHMARK_CONCAT2(a, b) a ## b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+
+/**
+ Defines and registers a benchmark:
+
+     BENCHMARK("string/find")
+     {
+         ...
+         state.Measure([&]{ ... });
+     }
+ */
+#define BENCHMARK(name) \
+    static void BENCHMARK_CONCAT(__benchmark_, __LINE__)(bench::State& state); \
+    static bench::Registration BENCHMARK_CONCAT(__benchmark_reg_, __LINE__)(name, BENCHMARK_CONCAT(__benchmark_, __LINE__)); \
+    static void BENCHMARK_CONCAT(__benchmark_, __LINE__)(bench::State& state)
+
+#endif /* defined(__ePub3__benchmark__) */
@@ -0,0 +1,98 @@
+//
+//  byte_buffer_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/utilities/buffer_pool.h"
+#include "../ePub3/utilities/byte_buffer.h"
+#include <vector>
+
+using namespace ePub3;
+
+static const size_t kChunkSize = 16 * 1024;
+
+// raw wipe bandwidth, as paid once per secure allocation when it's released
+BENCHMARK("byte_buffer/erase/4m")
+{
+    std::vector<unsigned char> bytes(4 * 1024 * 1024, 0x5a);
+
+    state.SetBytesPerIteration(bytes.size());
+    state.Measure([&] {
+        BufferPool::SecureErase(bytes.data(), bytes.size());
+    });
+}
+
+// reading a decrypted resource out of a read cache, a chunk at a time; `legacy` re-erases the
+// unused tail after every removal, as secure buffers used to
+static void DrainInChunks(bench::State& state, bool secure, bool legacy)
+{
+    const size_t size = 1024 * 1024;
+    std::vector<unsigned char> content(size, 0x5a);
+    unsigned char chunk[kChunkSize];
+
+    state.SetBytesPerIteration(size);
+    state.Measure([&] {
+        ByteBuffer buf;
+        buf.SetUsesSecureErasure(secure);
+        buf.AddBytes(content.data(), content.size());
+
+        while ( buf.GetBufferSize() > 0 )
+        {
+            size_t num = buf.MoveTo(chunk, sizeof(chunk));
+            if ( legacy )
+                BufferPool::SecureErase(buf.GetBytes() + buf.GetBufferSize(), size - buf.GetBufferSize());
+            bench::Require(num > 0, "Nothing moved");
+        }
+    });
+}
+
+BENCHMARK("byte_buffer/drain_16k/plain")
+{
+    DrainInChunks(state, false, false);
+}
+
+BENCHMARK("byte_buffer/drain_16k/secure")
+{
+    DrainInChunks(state, true, false);
+}
+
+BENCHMARK("byte_buffer/drain_16k/secure_legacy")
+{
+    DrainInChunks(state, true, true);
+}
+
+// building up a whole decrypted chapter, as the filter chain's cache does
+static void FillInChunks(bench::State& state, bool secure)
+{
+    const size_t size = 4 * 1024 * 1024;
+    std::vector<unsigned char> chunk(kChunkSize, 0x5a);
+
+    state.SetBytesPerIteration(size);
+    state.Measure([&] {
+        ByteBuffer buf;
+        buf.SetUsesSecureErasure(secure);
+        for ( size_t i = 0; i < size; i += kChunkSize )
+            buf.AddBytes(chunk.data(), chunk.size());
+        bench::Require(buf.GetBufferSize() == size, "Short fill");
+    });
+}
+
+BENCHMARK("byte_buffer/fill_4m/plain")
+{
+    FillInChunks(state, false);
+}
+
+BENCHMARK("byte_buffer/fill_4m/secure")
+{
+    FillInChunks(state, true);
+}
@@ -0,0 +1,263 @@
+//
+//  decryption_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/aes_cbc_decryption.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/filter_chain_byte_stream_range.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include <openssl/evp.h>
+#include <zlib.h>
+#include <cstring>
+#include <memory>
+#include <random>
+
+using namespace ePub3;
+
+static const size_t kEncryptedMediaSize = 16 * 1024 * 1024 + 5;     // not a whole number of blocks
+static const std::string kKey("0123456789abcdef");
+
+// raw deflate data, as OCF requires
+static std::string Deflate(const std::string& data)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+    std::string result(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+    stream.avail_out = static_cast<uInt>(result.size());
+    deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+// XML-ENC AES-128-CBC: the IV, then the padded ciphertext
+static std::string Encrypt(const std::string& data, std::mt19937& random)
+{
+    unsigned char iv[16];
+    for ( auto& ch : iv )
+        ch = static_cast<unsigned char>(random());
+    std::string encrypted(reinterpret_cast<char*>(iv), sizeof(iv));
+    encrypted.resize(sizeof(iv) + data.size() + 16);
+
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    unsigned char* out = reinterpret_cast<unsigned char*>(&encrypted[sizeof(iv)]);
+    int len = 0, finalLen = 0;
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr, reinterpret_cast<const unsigned char*>(kKey.data()), iv);
+    EVP_EncryptUpdate(ctx, out, &len, reinterpret_cast<const unsigned char*>(data.data()), static_cast<int>(data.size()));
+    EVP_EncryptFinal_ex(ctx, out + len, &finalLen);
+    EVP_CIPHER_CTX_free(ctx);
+    encrypted.resize(sizeof(iv) + len + finalLen);
+    return encrypted;
+}
+
+// a publication whose stored media file is encrypted; if `compressed`, it was deflated first
+static void WriteEncryptedBook(const std::string& path, const std::string& media, std::mt19937& random, bool compressed)
+{
+    ZipStreamWriter writer(path);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("META-INF/container.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles><rootfile full-path="EPUB/package.opf" media-type="application/oebps-package+xml"/></rootfiles>
+</container>
+)X"));
+    writer.AddEntry("META-INF/encryption.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<encryption xmlns="urn:oasis:names:tc:opendocument:xmlns:container" xmlns:enc="http://www.w3.org/2001/04/xmlenc#">
+  <enc:EncryptedData><enc:EncryptionMethod Algorithm="http://www.w3.org/2001/04/xmlenc#aes128-cbc"/><enc:CipherData><enc:CipherReference URI="EPUB/media.bin"/></enc:CipherData>)X") +
+    (compressed ? R"X(<enc:EncryptionProperties><enc:EncryptionProperty xmlns:comp="http://www.idpf.org/2016/encryption#compression"><comp:Compression Method="8" OriginalLength=")X" +
+                  std::to_string(media.size()) + R"X("/></enc:EncryptionProperty></enc:EncryptionProperties>)X" : std::string()) + R"X(</enc:EncryptedData>
+</encryption>
+)X");
+    writer.AddEntry("EPUB/package.opf", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:benchmark:encrypted</dc:identifier>
+    <dc:title>Encrypted</dc:title>
+    <dc:language>en</dc:language>
+    <meta property="dcterms:modified">2014-01-01T00:00:00Z</meta>
+  </metadata>
+  <manifest>
+    <item id="nav" href="nav.xhtml" media-type="application/xhtml+xml" properties="nav"/>
+    <item id="media" href="media.bin" media-type="video/mp4"/>
+  </manifest>
+  <spine><itemref idref="nav"/></spine>
+</package>
+)X"));
+    writer.AddEntry("EPUB/nav.xhtml", std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+                    "<head><title>Contents</title></head><body><nav epub:type=\"toc\"><ol><li><a href=\"nav.xhtml\">Contents</a></li></ol></nav></body></html>\n"));
+
+    writer.AddEntry("EPUB/media.bin", Encrypt(compressed ? Deflate(media) : media, random), false);
+    bench::Require(writer.Close(), "Unable to write the encrypted book");
+}
+
+static const std::string& EncryptedBook()
+{
+    static std::unique_ptr<std::string> path;
+    if ( path )
+        return *path;
+
+    std::mt19937 random(20140101);
+    std::string media(kEncryptedMediaSize, '\0');
+    for ( auto& ch : media )
+        ch = static_cast<char>(random());
+
+    path.reset(new std::string(bench::ScratchPath("encrypted.epub")));
+    WriteEncryptedBook(*path, media, random, false);
+    return *path;
+}
+
+// the same, but with text-like media deflated before encryption
+static const std::string& CompressedBook()
+{
+    static std::unique_ptr<std::string> path;
+    if ( path )
+        return *path;
+
+    static const char* words[] = { "call ", "me ", "Ishmael. ", "Some ", "years ", "ago, ", "never ", "mind ", "how ", "long. " };
+    std::mt19937 random(20140102);
+    std::string media;
+    media.reserve(kEncryptedMediaSize + 16);
+    while ( media.size() < kEncryptedMediaSize )
+        media += words[random() % 10];
+    media.resize(kEncryptedMediaSize);
+
+    path.reset(new std::string(bench::ScratchPath("compressed.epub")));
+    WriteEncryptedBook(*path, media, random, true);
+    return *path;
+}
+
+// opens the encrypted book with a key provider installed, and removes it again afterwards
+class EncryptedMedia
+{
+public:
+    EncryptedMedia(const std::string& book = EncryptedBook(), size_t numFilters = 1)
+    {
+        AESCBCDecryptor::SetKeyProvider([](ConstManifestItemPtr, ByteBuffer& key) {
+            key.AddBytes(reinterpret_cast<unsigned char*>(const_cast<char*>(kKey.data())), kKey.size());
+            return true;
+        });
+        container = Container::OpenContainer(book);
+        bench::Require(bool(container), "Unable to open the encrypted book");
+        package = container->DefaultPackage();
+        item = package->ManifestItemWithID("media");
+        bench::Require(package->GetFilterChainSize(item) == numFilters, "The decryption filters weren't installed");
+    }
+    ~EncryptedMedia()
+    {
+        AESCBCDecryptor::SetKeyProvider(nullptr);
+    }
+
+    std::shared_ptr<ByteStream> Open() const
+    {
+        return package->GetFilterChainByteStreamRange(item);
+    }
+
+    ContainerPtr        container;
+    PackagePtr          package;
+    ManifestItemPtr     item;
+};
+
+BENCHMARK("decryption/aes_cbc/whole_item")
+{
+    EncryptedMedia media;
+    std::vector<uint8_t> buf(kEncryptedMediaSize);
+
+    state.SetBytesPerIteration(kEncryptedMediaSize);
+    state.Measure([&] {
+        auto stream = media.Open();
+        bench::Require(stream->ReadBytes(buf.data(), buf.size()) == kEncryptedMediaSize, "Short read");
+    });
+}
+
+// range requests at random offsets, as a media player makes them; one iteration per request
+static void RangeRequests(bench::State& state, uint32_t length, const EncryptedMedia& media = EncryptedMedia())
+{
+    auto stream = media.Open();
+    FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+    bench::Require(ranged != nullptr, "Not a range stream");
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<uint32_t> offset(0, static_cast<uint32_t>(kEncryptedMediaSize - length));
+    std::vector<uint8_t> buf(length);
+
+    state.SetBytesPerIteration(length);
+    state.Measure([&] {
+        ByteRange range;
+        range.Location(offset(random));
+        range.Length(length);
+        bench::Require(ranged->ReadBytes(buf.data(), buf.size(), range) == length, "Short range read");
+    });
+}
+
+BENCHMARK("decryption/aes_cbc/range_1k")
+{
+    RangeRequests(state, 1024);
+}
+
+BENCHMARK("decryption/aes_cbc/range_64k")
+{
+    RangeRequests(state, 64*1024);
+}
+
+BENCHMARK("decryption/aes_cbc/range_1m")
+{
+    RangeRequests(state, 1024*1024);
+}
+
+// decryption followed by inflation, which reads through the decryptor's output in 16 KB pieces
+BENCHMARK("decryption/aes_cbc_inflate/whole_item")
+{
+    EncryptedMedia media(CompressedBook(), 2);
+    std::vector<uint8_t> buf(kEncryptedMediaSize);
+
+    state.SetBytesPerIteration(kEncryptedMediaSize);
+    state.Measure([&] {
+        auto stream = media.Open();
+        bench::Require(stream->ReadBytes(buf.data(), buf.size()) == kEncryptedMediaSize, "Short read");
+    });
+}
+
+// each request restarts inflation from the checkpoint before it, so costs up to a span of inflation
+BENCHMARK("decryption/aes_cbc_inflate/range_64k")
+{
+    RangeRequests(state, 64*1024, EncryptedMedia(CompressedBook(), 2));
+}
+
+// sequential requests continue from where the last one stopped
+BENCHMARK("decryption/aes_cbc_inflate/sequential_64k")
+{
+    EncryptedMedia media(CompressedBook(), 2);
+    auto stream = media.Open();
+    FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+    bench::Require(ranged != nullptr, "Not a range stream");
+
+    const uint32_t length = 64*1024;
+    uint32_t offset = 0;
+    std::vector<uint8_t> buf(length);
+
+    state.SetBytesPerIteration(length);
+    state.Measure([&] {
+        if ( offset + length > kEncryptedMediaSize )
+            offset = 0;
+        ByteRange range;
+        range.Location(offset);
+        range.Length(length);
+        bench::Require(ranged->ReadBytes(buf.data(), buf.size(), range) == length, "Short range read");
+        offset += length;
+    });
+}
@@ -0,0 +1,266 @@
+//
+//  filter_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/archive.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/filter.h"
+#include "../ePub3/ePub/filter_chain_byte_stream.h"
+#include "../ePub3/ePub/filter_chain_byte_stream_range.h"
+#include "../ePub3/utilities/byte_stream.h"
+#include "../ePub3/utilities/run_loop.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unistd.h>
+
+using namespace ePub3;
+
+// a cheap streaming filter, so the chain's own overhead dominates
+class XORFilter : public ContentFilter
+{
+public:
+    XORFilter() : ContentFilter([](ConstManifestItemPtr) { return true; }) {}
+
+    virtual void* FilterData(FilterContext* context, void* data, size_t len, size_t* outputLen) OVERRIDE
+    {
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(data);
+        for ( size_t i = 0; i < len; i++ )
+            bytes[i] ^= 0x5a;
+        *outputLen = len;
+        return data;
+    }
+};
+
+// the same, reading the requested range itself as decryption filters do
+class RangeXORFilter : public ContentFilter
+{
+public:
+    RangeXORFilter() : ContentFilter([](ConstManifestItemPtr) { return true; }) {}
+
+    virtual OperatingMode GetOperatingMode() const OVERRIDE { return OperatingMode::SupportsByteRanges; }
+
+    virtual void* FilterData(FilterContext* context, void* data, size_t len, size_t* outputLen) OVERRIDE
+    {
+        RangeFilterContext* range = dynamic_cast<RangeFilterContext*>(context);
+        SeekableByteStream* input = range->GetSeekableByteStream();
+        ByteRange& byteRange = range->GetByteRange();
+
+        input->Seek(byteRange.Location(), std::ios::beg);
+        uint8_t* output = range->GetOutputByteBuffer(byteRange.Length());
+        size_t num = input->ReadBytes(output, byteRange.Length());
+        for ( size_t i = 0; i < num; i++ )
+            output[i] ^= 0x5a;
+
+        *outputLen = num;
+        return output;
+    }
+
+protected:
+    virtual FilterContext* InnerMakeFilterContext(ConstManifestItemPtr) const OVERRIDE { return new RangeFilterContext; }
+    virtual bool ResetFilterContext(FilterContext* context) const OVERRIDE
+    {
+        dynamic_cast<RangeFilterContext*>(context)->ResetRangeState();
+        return true;
+    }
+};
+
+static std::unique_ptr<SeekableByteStream> OpenEntry(const Archive* archive, const std::string& path)
+{
+    auto stream = archive->ByteStreamAtPath(path);
+    SeekableByteStream* seekable = dynamic_cast<SeekableByteStream*>(stream.get());
+    bench::Require(seekable != nullptr, "Unable to open the archive entry");
+    stream.release();
+    return std::unique_ptr<SeekableByteStream>(seekable);
+}
+
+static size_t ReadAll(ByteStream* stream)
+{
+    uint8_t buf[64*1024];
+    size_t total = 0, num = 0;
+    while ( (num = stream->ReadBytes(buf, sizeof(buf))) > 0 )
+        total += num;
+    return total;
+}
+
+static void ReadThroughChain(bench::State& state, std::vector<ContentFilterPtr> filters)
+{
+    const bench::SyntheticBook& book = bench::LargeBook();
+    auto archive = Archive::Open(book.path);
+    bench::Require(bool(archive), "Unable to open the synthetic book");
+
+    state.SetBytesPerIteration(book.largeChapterSize);
+    state.Measure([&] {
+        FilterChainByteStream stream(OpenEntry(archive.get(), book.largeChapter), filters, nullptr);
+        bench::Require(ReadAll(&stream) == book.largeChapterSize, "Short read");
+    });
+}
+
+BENCHMARK("filter_chain/stream/no_filters")
+{
+    ReadThroughChain(state, {});
+}
+
+BENCHMARK("filter_chain/stream/one_filter")
+{
+    ReadThroughChain(state, { std::make_shared<XORFilter>() });
+}
+
+BENCHMARK("filter_chain/stream/three_filters")
+{
+    ReadThroughChain(state, { std::make_shared<XORFilter>(), std::make_shared<XORFilter>(), std::make_shared<XORFilter>() });
+}
+
+#ifdef SUPPORT_ASYNC
+// the same chain behind an async stream, built as FilterChain::GetFilteredOutputStreamForManifestItem()
+// does it, and drained on this thread's run loop as a reader would; reports the mean delay before
+// the first filtered bytes arrive
+static void ReadThroughAsyncChain(bench::State& state, std::vector<ContentFilterPtr> filters)
+{
+    const bench::SyntheticBook& book = bench::LargeBook();
+    auto archive = Archive::Open(book.path);
+    bench::Require(bool(archive), "Unable to open the synthetic book");
+
+    bool ranges = std::all_of(filters.begin(), filters.end(), [](const ContentFilterPtr& filter) {
+        return filter->GetOperatingMode() == ContentFilter::OperatingMode::SupportsByteRanges;
+    });
+    thread_pool pool(1);
+
+    RunLoopPtr runLoop = RunLoop::CurrentRunLoop();
+    std::chrono::nanoseconds firstBytes(0);
+    size_t iterations = 0;
+
+    state.SetBytesPerIteration(book.largeChapterSize);
+    state.Measure([&] {
+        std::shared_ptr<AsyncFilterChainByteStream> stream;
+        if ( ranges )
+        {
+            std::unique_ptr<SeekableByteStream> chain = OpenEntry(archive.get(), book.largeChapter);
+            for ( auto& filter : filters )
+                chain.reset(new RangeFilterByteStream(std::move(chain), filter, nullptr));
+            stream = std::make_shared<AsyncFilterChainByteStream>(std::move(chain), 16*1024);
+        }
+        else
+        {
+            std::unique_ptr<ByteStream> chain(new FilterChainByteStream(OpenEntry(archive.get(), book.largeChapter), filters, nullptr));
+            stream = std::make_shared<AsyncFilterChainByteStream>(std::move(chain), pool, 16*1024);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        size_t total = 0;
+        bool started = false;
+        stream->SetEventHandler([&](AsyncEvent evt, AsyncByteStream* s) {
+            uint8_t buf[16*1024];
+            switch ( evt )
+            {
+                case AsyncEvent::HasBytesAvailable:
+                    if ( !started )
+                        firstBytes += std::chrono::steady_clock::now() - start;
+                    started = true;
+                    total += s->ReadBytes(buf, sizeof(buf));
+                    break;
+                case AsyncEvent::ErrorOccurred:
+                case AsyncEvent::EndEncountered:
+                    runLoop->Stop();
+                    break;
+                default:
+                    break;
+            }
+        });
+        stream->SetTargetRunLoop(runLoop);
+        runLoop->Run();
+        stream->SetTargetRunLoop(nullptr);
+
+        bench::Require(total == book.largeChapterSize, "Short read");
+        iterations++;
+    });
+
+    state.SetCounter("first_bytes_us", std::chrono::duration<double, std::micro>(firstBytes).count() / iterations);
+}
+
+BENCHMARK("filter_chain/async/no_filters")
+{
+    ReadThroughAsyncChain(state, {});
+}
+
+BENCHMARK("filter_chain/async/three_filters")
+{
+    ReadThroughAsyncChain(state, { std::make_shared<XORFilter>(), std::make_shared<XORFilter>(), std::make_shared<XORFilter>() });
+}
+
+BENCHMARK("filter_chain/async/three_range_filters")
+{
+    ReadThroughAsyncChain(state, { std::make_shared<RangeXORFilter>(), std::make_shared<RangeXORFilter>(), std::make_shared<RangeXORFilter>() });
+}
+#endif /* SUPPORT_ASYNC */
+
+// 64KB range requests at random offsets, as a media player makes them
+static void RangeRequests(bench::State& state, ContentFilterPtr filter)
+{
+    static const size_t kRequests = 32, kLength = 64*1024;
+    const bench::SyntheticBook& book = bench::LargeBook();
+    auto archive = Archive::Open(book.path);
+    bench::Require(bool(archive), "Unable to open the synthetic book");
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<uint32_t> offset(0, static_cast<uint32_t>(book.mediaSize - kLength));
+    std::vector<uint8_t> buf(kLength);
+
+    state.SetBytesPerIteration(kRequests * kLength);
+    state.SetItemsPerIteration(kRequests);
+    state.Measure([&] {
+        FilterChainByteStreamRange stream(OpenEntry(archive.get(), book.media), filter, nullptr);
+        for ( size_t i = 0; i < kRequests; i++ )
+        {
+            ByteRange range;
+            range.Location(offset(random));
+            range.Length(kLength);
+            bench::Require(stream.ReadBytes(buf.data(), buf.size(), range) == kLength, "Short range read");
+        }
+    });
+}
+
+BENCHMARK("filter_chain/range/no_filter")
+{
+    RangeRequests(state, nullptr);
+}
+
+BENCHMARK("filter_chain/range/one_filter")
+{
+    RangeRequests(state, std::make_shared<RangeXORFilter>());
+}
+
+// the font de-obfuscation filter, as installed by the package
+BENCHMARK("filter_chain/package/font_obfuscation")
+{
+    std::string path = bench::TestDataPath("wasteland-otf-obf-20120118.epub");
+    if ( ::access(path.c_str(), R_OK) != 0 )
+    {
+        state.Skip("missing " + path);
+        return;
+    }
+
+    ContainerPtr container = Container::OpenContainer(path);
+    bench::Require(bool(container), "Unable to open the container");
+    PackagePtr package = container->DefaultPackage();
+    ManifestItemPtr font = package->ManifestItemWithID("font.OldStandard.regular");
+    bench::Require(bool(font), "Missing font");
+
+    size_t size = ReadAll(package->GetFilterChainByteStream(font).get());
+    state.SetBytesPerIteration(size);
+    state.Measure([&] {
+        bench::Require(ReadAll(package->GetFilterChainByteStream(font).get()) == size, "Short read");
+    });
+}
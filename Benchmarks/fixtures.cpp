@@ -0,0 +1,203 @@
+//
+//  fixtures.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "fixtures.h"
+#include "benchmark.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+using namespace ePub3;
+
+namespace bench {
+
+static const size_t kLargeChapterParagraphs = 40000;    // about 4MB of XHTML
+static const size_t kMediaSize = 16 * 1024 * 1024;
+static const size_t kChapterCount = 400;
+static const size_t kManifestItemCount = 10000;
+
+static const char* kWords[] = {
+    "the", "voyage", "of", "life", "river", "boat", "angel", "childhood", "youth",
+    "manhood", "old", "age", "landscape", "painting", "series", "allegory", "water",
+};
+
+static SyntheticBook MakeLargeBook()
+{
+    SyntheticBook book;
+    book.path = ScratchPath("large.epub");
+    book.largeChapter = "EPUB/large.xhtml";
+    book.media = "EPUB/media.bin";
+    book.mediaSize = kMediaSize;
+    book.chapterCount = kChapterCount;
+
+    ZipStreamWriter writer(book.path);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("META-INF/container.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles><rootfile full-path="EPUB/package.opf" media-type="application/oebps-package+xml"/></rootfiles>
+</container>
+)X"));
+
+    std::mt19937 random(20140101);
+    std::uniform_int_distribution<size_t> word(0, sizeof(kWords)/sizeof(kWords[0]) - 1);
+
+    std::ostringstream large;
+    large << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Large</title></head><body>\n";
+    for ( size_t i = 0; i < kLargeChapterParagraphs; i++ )
+    {
+        large << "<p id=\"p" << i << "\">";
+        for ( int j = 0; j < 14; j++ )
+            large << kWords[word(random)] << ' ';
+        large << "</p>\n";
+    }
+    large << "</body></html>\n";
+    std::string largeContent = large.str();
+    book.largeChapterSize = largeContent.size();
+    writer.AddEntry(book.largeChapter, std::move(largeContent));
+
+    std::string media(kMediaSize, '\0');
+    for ( auto& ch : media )
+        ch = static_cast<char>(random());
+    writer.AddEntry(book.media, std::move(media), false);
+
+    std::ostringstream manifest, spine, nav;
+    manifest << "    <item id=\"nav\" href=\"nav.xhtml\" media-type=\"application/xhtml+xml\" properties=\"nav\"/>\n"
+             << "    <item id=\"large\" href=\"large.xhtml\" media-type=\"application/xhtml+xml\"/>\n"
+             << "    <item id=\"media\" href=\"media.bin\" media-type=\"video/mp4\"/>\n";
+    spine << "    <itemref idref=\"large\"/>\n";
+    nav << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+        << "<head><title>Contents</title></head><body><nav epub:type=\"toc\"><ol><li><a href=\"large.xhtml\">Large</a></li>";
+
+    for ( size_t i = 0; i < kChapterCount; i++ )
+    {
+        manifest << "    <item id=\"c" << i << "\" href=\"c" << i << ".xhtml\" media-type=\"application/xhtml+xml\"/>\n";
+        spine << "    <itemref idref=\"c" << i << "\"/>\n";
+        nav << "<li><a href=\"c" << i << ".xhtml\">Chapter " << i << "</a><ol><li><a href=\"c" << i << ".xhtml#p5\">Part</a></li></ol></li>";
+
+        std::ostringstream chapter, name;
+        chapter << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Chapter " << i << "</title></head><body>";
+        for ( size_t j = 0; j < 20; j++ )
+            chapter << "<p id=\"p" << j << "\">" << kWords[word(random)] << ' ' << kWords[word(random)] << "</p>";
+        chapter << "</body></html>\n";
+        name << "EPUB/c" << i << ".xhtml";
+        writer.AddEntry(name.str(), chapter.str());
+    }
+    nav << "</ol></nav></body></html>\n";
+
+    std::ostringstream opf;
+    opf << R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:benchmark:large</dc:identifier>
+    <dc:title>Large</dc:title>
+    <dc:language>en</dc:language>
+    <meta property="dcterms:modified">2014-01-01T00:00:00Z</meta>
+  </metadata>
+  <manifest>
+)X" << manifest.str() << "  </manifest>\n  <spine>\n" << spine.str() << "  </spine>\n</package>\n";
+
+    writer.AddEntry("EPUB/package.opf", opf.str());
+    writer.AddEntry("EPUB/nav.xhtml", nav.str());
+    Require(writer.Close(), "Unable to write the synthetic book");
+    return book;
+}
+
+const SyntheticBook& LargeBook()
+{
+    static std::unique_ptr<SyntheticBook> book;
+    if ( !book )
+        book.reset(new SyntheticBook(MakeLargeBook()));
+    return *book;
+}
+
+static ManifestBook MakeManyItemsBook()
+{
+    ManifestBook book;
+    book.path = ScratchPath("manifest.epub");
+    book.itemCount = kManifestItemCount;
+
+    ZipStreamWriter writer(book.path);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("META-INF/container.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles><rootfile full-path="OEBPS/package.opf" media-type="application/oebps-package+xml"/></rootfiles>
+</container>
+)X"));
+
+    std::ostringstream manifest, encryption;
+    manifest << "    <item id=\"nav\" href=\"nav.xhtml\" media-type=\"application/xhtml+xml\" properties=\"nav\"/>\n";
+    encryption << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               << "<encryption xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\" xmlns:enc=\"http://www.w3.org/2001/04/xmlenc#\">\n";
+
+    for ( size_t i = 0; i < kManifestItemCount; i++ )
+    {
+        std::ostringstream name;
+        name << "images/i" << i << ".png";
+        manifest << "    <item id=\"i" << i << "\" href=\"" << name.str() << "\" media-type=\"image/png\"/>\n";
+        encryption << "  <enc:EncryptedData><enc:EncryptionMethod Algorithm=\"http://www.w3.org/2001/04/xmlenc#aes128-cbc\"/>"
+                   << "<enc:CipherData><enc:CipherReference URI=\"OEBPS/" << name.str() << "\"/></enc:CipherData></enc:EncryptedData>\n";
+        writer.AddEntry("OEBPS/" + name.str(), std::string(64, static_cast<char>(i)), false);
+    }
+    encryption << "</encryption>\n";
+
+    std::ostringstream opf;
+    opf << R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:benchmark:manifest</dc:identifier>
+    <dc:title>Manifest</dc:title>
+    <dc:language>en</dc:language>
+    <meta property="dcterms:modified">2014-01-01T00:00:00Z</meta>
+  </metadata>
+  <manifest>
+)X" << manifest.str() << "  </manifest>\n  <spine>\n    <itemref idref=\"nav\"/>\n  </spine>\n</package>\n";
+
+    writer.AddEntry("META-INF/encryption.xml", encryption.str());
+    writer.AddEntry("OEBPS/package.opf", opf.str());
+    writer.AddEntry("OEBPS/nav.xhtml", "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+                    "<head><title>Contents</title></head><body><nav epub:type=\"toc\"><ol><li><a href=\"nav.xhtml\">Contents</a></li></ol></nav></body></html>\n");
+    Require(writer.Close(), "Unable to write the large-manifest book");
+    return book;
+}
+
+const ManifestBook& ManyItemsBook()
+{
+    static std::unique_ptr<ManifestBook> book;
+    if ( !book )
+        book.reset(new ManifestBook(MakeManyItemsBook()));
+    return *book;
+}
+
+const std::vector<std::string>& TestBooks()
+{
+    static const std::vector<std::string> books = {
+        "childrens-literature-20120722.epub",
+        "cole-voyage-of-life-20120320.epub",
+        "dante-hell.epub",
+        "moby-dick-preview-collection.epub",
+        "page-blanche.epub",
+        "wasteland-otf-obf-20120118.epub",
+        "widget-figure-gallery-20121022.epub",
+    };
+    return books;
+}
+
+void Require(bool condition, const char* what)
+{
+    if ( !condition )
+        throw std::runtime_error(what);
+}
+
+}   // namespace bench
@@ -0,0 +1,68 @@
+//
+//  fixtures.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#ifndef __ePub3__benchmark_fixtures__
+#define __ePub3__benchmark_fixtures__
+
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/**
+ A generated publication, larger than anything in TestData.
+
+ It holds a single large XHTML chapter (deflated), a large media file (stored, as
+ audio and video usually are), and a spine of many small chapters with a
+ navigation document linking them all.
+ */
+struct SyntheticBook
+{
+    std::string     path;               ///< The filesystem path of the EPUB.
+    std::string     largeChapter;       ///< The archive path of the large chapter.
+    size_t          largeChapterSize;
+    std::string     media;              ///< The archive path of the stored media file.
+    size_t          mediaSize;
+    size_t          chapterCount;       ///< The number of small chapters in the spine.
+};
+
+///
+/// The synthetic book, generated in the scratch directory on first use.
+const SyntheticBook& LargeBook();
+
+/**
+ A generated publication with a very large manifest.
+
+ Every item is a small stored resource, and every one has a record in a
+ correspondingly large `META-INF/encryption.xml`.
+ */
+struct ManifestBook
+{
+    std::string     path;               ///< The filesystem path of the EPUB.
+    size_t          itemCount;          ///< The number of manifest items, besides the nav document.
+};
+
+///
+/// The large-manifest book, generated in the scratch directory on first use.
+const ManifestBook& ManyItemsBook();
+
+///
+/// The EPUBs in TestData, by file name.
+const std::vector<std::string>& TestBooks();
+
+///
+/// Throws if `condition` is false, failing the current benchmark.
+void Require(bool condition, const char* what);
+
+}   // namespace bench
+
+#endif /* defined(__ePub3__benchmark_fixtures__) */
@@ -0,0 +1,164 @@
+//
+//  future_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/utilities/future.h"
+
+using namespace ePub3;
+
+static const size_t kFutureCount = 10000;
+static const size_t kChainLength = 100;
+
+BENCHMARK("future/create/promise")
+{
+    int sum = 0;
+
+    state.SetItemsPerIteration(kFutureCount);
+    state.Measure([&] {
+        sum = 0;
+        for ( size_t i = 0; i < kFutureCount; i++ )
+        {
+            promise<int> p;
+            future<int> f = p.get_future();
+            p.set_value(1);
+            sum += f.get();
+        }
+    });
+    bench::Require(sum == int(kFutureCount), "Every future should deliver its value");
+}
+
+BENCHMARK("future/create/make_ready_future")
+{
+    int sum = 0;
+
+    state.SetItemsPerIteration(kFutureCount);
+    state.Measure([&] {
+        sum = 0;
+        for ( size_t i = 0; i < kFutureCount; i++ )
+            sum += make_ready_future(1).get();
+    });
+    bench::Require(sum == int(kFutureCount), "Every future should deliver its value");
+}
+
+// continuations attached before the value arrives, run as it's set
+BENCHMARK("future/then/chain_pending")
+{
+    inline_executor exec;
+    int result = 0;
+
+    state.SetItemsPerIteration(kChainLength);
+    state.Measure([&] {
+        promise<int> p;
+        future<int> f = p.get_future();
+        for ( size_t i = 0; i < kChainLength; i++ )
+            f = f.then(exec, [](future<int> prev) { return prev.get() + 1; });
+        p.set_value(0);
+        result = f.get();
+    });
+    bench::Require(result == int(kChainLength), "Every continuation should run");
+}
+
+// continuations attached to futures which are already ready
+BENCHMARK("future/then/chain_ready")
+{
+    inline_executor exec;
+    int result = 0;
+
+    state.SetItemsPerIteration(kChainLength);
+    state.Measure([&] {
+        future<int> f = make_ready_future(0);
+        for ( size_t i = 0; i < kChainLength; i++ )
+            f = f.then(exec, [](future<int> prev) { return prev.get() + 1; });
+        result = f.get();
+    });
+    bench::Require(result == int(kChainLength), "Every continuation should run");
+}
+
+// fan-in of futures whose values are set after when_all() is called
+BENCHMARK("future/when_all/10k")
+{
+    size_t count = 0;
+
+    state.SetItemsPerIteration(kFutureCount);
+    state.Measure([&] {
+        std::vector<promise<int>> promises(kFutureCount);
+        std::vector<future<int>> futures;
+        futures.reserve(kFutureCount);
+        for ( auto& p : promises )
+            futures.push_back(p.get_future());
+
+        auto all = when_all(futures.begin(), futures.end());
+        for ( auto& p : promises )
+            p.set_value(1);
+        count = all.get().size();
+    });
+    bench::Require(count == kFutureCount, "when_all() should return every future");
+}
+
+// the same, where the work was finished before anyone asked
+BENCHMARK("future/when_all/10k_ready")
+{
+    size_t count = 0;
+
+    state.SetItemsPerIteration(kFutureCount);
+    state.Measure([&] {
+        std::vector<future<int>> futures;
+        futures.reserve(kFutureCount);
+        for ( size_t i = 0; i < kFutureCount; i++ )
+            futures.push_back(make_ready_future(int(i)));
+        count = when_all(futures.begin(), futures.end()).get().size();
+    });
+    bench::Require(count == kFutureCount, "when_all() should return every future");
+}
+
+// the alternative without when_all(): waiting on each future in turn
+BENCHMARK("future/wait_each/10k")
+{
+    size_t count = 0;
+
+    state.SetItemsPerIteration(kFutureCount);
+    state.Measure([&] {
+        std::vector<promise<int>> promises(kFutureCount);
+        std::vector<future<int>> futures;
+        futures.reserve(kFutureCount);
+        for ( auto& p : promises )
+            futures.push_back(p.get_future());
+        for ( auto& p : promises )
+            p.set_value(1);
+
+        count = 0;
+        for ( auto& f : futures )
+            count += f.get();
+    });
+    bench::Require(count == kFutureCount, "Every future should deliver its value");
+}
+
+BENCHMARK("future/when_any/10k")
+{
+    size_t index = 0;
+
+    state.SetItemsPerIteration(kFutureCount);
+    state.Measure([&] {
+        std::vector<promise<int>> promises(kFutureCount);
+        std::vector<future<int>> futures;
+        futures.reserve(kFutureCount);
+        for ( auto& p : promises )
+            futures.push_back(p.get_future());
+
+        auto any = when_any(futures.begin(), futures.end());
+        promises.back().set_value(1);
+        index = any.get().index;
+    });
+    bench::Require(index == kFutureCount - 1, "when_any() should find the ready future");
+}
@@ -0,0 +1,116 @@
+//
+//  glossary_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/glossary_index.h"
+#include <cstdio>
+#include <memory>
+
+using namespace ePub3;
+
+static const size_t kTermCount = 500000;
+static const size_t kQueryCount = 1000;
+
+// synthetic, pronounceable terms with a realistic spread of prefixes
+static const std::vector<string>& Terms()
+{
+    static std::unique_ptr<std::vector<string>> terms;
+    if ( terms )
+        return *terms;
+
+    static const char* kSyllables[] = { "ka", "lo", "mi", "ne", "ru", "sa", "té", "vo", "zi", "ba", "co", "du", "fé", "gi", "ho", "ju" };
+    terms.reset(new std::vector<string>);
+    terms->reserve(kTermCount);
+    for ( size_t i = 0; i < kTermCount; i++ )
+    {
+        std::string term;
+        size_t n = i;
+        do
+        {
+            term += kSyllables[n % 16];
+            n /= 16;
+        } while ( n > 0 );
+        terms->push_back(term);
+    }
+    return *terms;
+}
+
+static GlossaryIndexPtr BuiltIndex()
+{
+    static GlossaryIndexPtr index;
+    if ( !index )
+        index = GlossaryIndex::Build(Terms());
+    return index;
+}
+
+BENCHMARK("glossary/build")
+{
+    const std::vector<string>& terms = Terms();
+    size_t bytes = 0;
+
+    state.SetItemsPerIteration(terms.size());
+    state.Measure([&] {
+        bytes = GlossaryIndex::Build(terms)->ByteCount();
+    });
+    state.SetCounter("bytes", bytes);
+}
+
+BENCHMARK("glossary/map")
+{
+    std::string path = bench::ScratchPath("glossary.idx");
+    bench::Require(BuiltIndex()->WriteToFile(path), "Unable to write the glossary index");
+
+    state.SetBytesPerIteration(BuiltIndex()->ByteCount());
+    state.Measure([&] {
+        bench::Require(GlossaryIndex::MapFile(path) != nullptr, "Unable to map the glossary index");
+    });
+    remove(path.c_str());
+}
+
+BENCHMARK("glossary/prefix")
+{
+    const std::vector<string>& terms = Terms();
+    GlossaryIndexPtr index = BuiltIndex();
+    size_t matches = 0;
+
+    state.SetItemsPerIteration(kQueryCount);
+    state.Measure([&] {
+        matches = 0;
+        for ( size_t i = 0; i < kQueryCount; i++ )
+            matches += index->WithPrefix(terms[(i * 7919) % kTermCount].stl_str().substr(0, 4), 10).size();
+    });
+    bench::Require(matches > 0, "No prefix matches");
+    state.SetCounter("matches", matches);
+}
+
+// a middle character replaced, found within an edit distance of two
+BENCHMARK("glossary/fuzzy")
+{
+    const std::vector<string>& terms = Terms();
+    GlossaryIndexPtr index = BuiltIndex();
+    const size_t kFuzzyCount = kQueryCount / 10;
+    size_t matches = 0;
+
+    state.SetItemsPerIteration(kFuzzyCount);
+    state.Measure([&] {
+        matches = 0;
+        for ( size_t i = 0; i < kFuzzyCount; i++ )
+        {
+            std::string query = terms[(i * 7919) % kTermCount].stl_str();
+            query[query.size() / 2] = 'x';
+            matches += index->WithinDistance(query, 2, 10).size();
+        }
+    });
+    bench::Require(matches > 0, "No fuzzy matches");
+    state.SetCounter("matches", matches);
+}
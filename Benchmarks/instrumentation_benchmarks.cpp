@@ -0,0 +1,88 @@
+//
+//  instrumentation_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/utilities/instrumentation.h"
+#include "../ePub3/ePub/container.h"
+
+using namespace ePub3;
+
+static const size_t kScopeCount = 1000;
+
+// what a measured scope costs, against the same loop with none
+static void MeasureScopes(bench::State& state, bool measured, bool enabled)
+{
+    Instrumentation::SetEnabled(enabled);
+    volatile uint64_t sink = 0;
+
+    state.SetItemsPerIteration(kScopeCount);
+    state.Measure([&] {
+        for ( size_t i = 0; i < kScopeCount; i++ )
+        {
+            if ( measured )
+            {
+                EPUB_MEASURE(measure, FilterData);
+                EPUB_MEASURE_BYTES(measure, i);
+                sink = sink + i;
+            }
+            else
+            {
+                sink = sink + i;
+            }
+        }
+    });
+
+    Instrumentation::SetEnabled(false);
+    Instrumentation::Reset();
+}
+
+BENCHMARK("instrumentation/scope/none")
+{
+    MeasureScopes(state, false, false);
+}
+
+BENCHMARK("instrumentation/scope/disabled")
+{
+    MeasureScopes(state, true, false);
+}
+
+BENCHMARK("instrumentation/scope/enabled")
+{
+    MeasureScopes(state, true, true);
+}
+
+// the overhead on a real operation, which measures several phases and many reads and lookups
+static void OpenContainers(bench::State& state, bool enabled)
+{
+    const std::string path = bench::TestDataPath(bench::TestBooks().front());
+    Instrumentation::SetEnabled(enabled);
+
+    state.Measure([&] {
+        ContainerPtr container = Container::OpenContainer(path);
+        bench::Require(bool(container), "Unable to open the test book");
+    });
+
+    Instrumentation::SetEnabled(false);
+    Instrumentation::Reset();
+}
+
+BENCHMARK("instrumentation/container_open/disabled")
+{
+    OpenContainers(state, false);
+}
+
+BENCHMARK("instrumentation/container_open/enabled")
+{
+    OpenContainers(state, true);
+}
@@ -0,0 +1,131 @@
+//
+//  integrity_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/integrity_verifier.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "../ePub3/xml/tree/document.h"
+#include "../ePub3/xml/tree/element.h"
+#include <openssl/evp.h>
+#include <cstring>
+#include <memory>
+#include <random>
+
+using namespace ePub3;
+
+static const size_t kEntryCount = 32;
+static const size_t kEntrySize = 1024 * 1024;
+
+struct SignedArchive
+{
+    std::string                         path;
+    std::shared_ptr<DigitalSignature>   signature;
+    size_t                              totalSize;
+};
+
+static std::string Base64SHA256(const std::string& data)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int mdLen = 0;
+    EVP_Digest(data.data(), data.size(), md, &mdLen, EVP_sha256(), nullptr);
+
+    unsigned char encoded[4 * ((EVP_MAX_MD_SIZE + 2) / 3) + 1];
+    int len = EVP_EncodeBlock(encoded, md, static_cast<int>(mdLen));
+    return std::string(reinterpret_cast<char*>(encoded), len);
+}
+
+// many deflated, text-like entries, each with a SHA-256 reference in one signature
+static const SignedArchive& SignedZip()
+{
+    static std::unique_ptr<SignedArchive> archive;
+    if ( archive )
+        return *archive;
+
+    static const char* words[] = { "call ", "me ", "Ishmael. ", "Some ", "years ", "ago, ", "never ", "mind ", "how ", "long. " };
+    std::mt19937 random(20140103);
+
+    archive.reset(new SignedArchive);
+    archive->path = bench::ScratchPath("signed.zip");
+    archive->totalSize = 0;
+
+    std::string references;
+    ZipStreamWriter writer(archive->path);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    for ( size_t i = 0; i < kEntryCount; i++ )
+    {
+        std::string data;
+        data.reserve(kEntrySize + 16);
+        while ( data.size() < kEntrySize )
+            data += words[random() % 10];
+        data.resize(kEntrySize);
+
+        std::string name = "EPUB/chapter" + std::to_string(i) + ".xhtml";
+        references += "<Reference URI=\"/" + name + "\"><DigestMethod Algorithm=\"http://www.w3.org/2001/04/xmlenc#sha256\"/><DigestValue>"
+                    + Base64SHA256(data) + "</DigestValue></Reference>\n";
+        archive->totalSize += data.size();
+        writer.AddEntry(name, std::move(data));
+    }
+    bench::Require(writer.Close(), "Unable to write the signed archive");
+
+    std::string xml = std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<signatures xmlns="urn:oasis:names:tc:opendocument:xmlns:container">
+  <Signature Id="sig" xmlns="http://www.w3.org/2000/09/xmldsig#">
+    <SignedInfo>
+      <CanonicalizationMethod Algorithm="http://www.w3.org/TR/2001/REC-xml-c14n-20010315"/>
+      <SignatureMethod Algorithm="http://www.w3.org/2000/09/xmldsig#dsa-sha1"/>
+    </SignedInfo>
+    <SignatureValue>AAAA</SignatureValue>
+    <Object><Manifest Id="Manifest1">
+)X") + references + R"X(    </Manifest></Object>
+  </Signature>
+</signatures>
+)X";
+    auto doc = xml::Wrapped<xml::Document>(xmlParseMemory(xml.data(), static_cast<int>(xml.size())));
+    bench::Require(bool(doc), "Unable to parse the generated signatures");
+    archive->signature = std::make_shared<DigitalSignature>(doc->Root()->FirstElementChild());
+    return *archive;
+}
+
+// checks every CRC and SHA-256 reference on `threads` workers
+static void VerifyArchive(bench::State& state, int threads)
+{
+    const SignedArchive& archive = SignedZip();
+    IntegrityVerifier verifier(archive.path);
+    verifier.AddSignature(*archive.signature);
+
+    state.SetBytesPerIteration(archive.totalSize);
+    state.SetItemsPerIteration(kEntryCount);
+    state.Measure([&] {
+        bench::Require(IntegrityVerifier::AllValid(verifier.Verify(threads)), "Verification failed");
+    });
+}
+
+BENCHMARK("integrity/verify/threads_1")
+{
+    VerifyArchive(state, 1);
+}
+
+BENCHMARK("integrity/verify/threads_2")
+{
+    VerifyArchive(state, 2);
+}
+
+BENCHMARK("integrity/verify/threads_4")
+{
+    VerifyArchive(state, 4);
+}
+
+BENCHMARK("integrity/verify/threads_8")
+{
+    VerifyArchive(state, 8);
+}
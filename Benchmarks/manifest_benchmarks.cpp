@@ -0,0 +1,138 @@
+//
+//  manifest_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/manifest.h"
+#include "../ePub3/ePub/package_snapshot.h"
+#include "../ePub3/utilities/byte_stream.h"
+
+using namespace ePub3;
+
+static std::vector<ManifestItemPtr> ManifestItems(const PackagePtr& package)
+{
+    std::vector<ManifestItemPtr> items;
+    for ( auto& entry : package->Manifest() )
+        items.push_back(entry.second);
+    return items;
+}
+
+// resolving every item of a freshly opened package, as the first pass of a server does
+BENCHMARK("manifest/resolve/first_use")
+{
+    const bench::ManifestBook& book = bench::ManyItemsBook();
+    size_t count = 0;
+
+    state.SetItemsPerIteration(book.itemCount + 1);
+    state.Measure([&] {
+        ContainerPtr container = Container::OpenContainer(book.path);
+        count = 0;
+        for ( auto& entry : container->DefaultPackage()->Manifest() )
+            count += bool(entry.second->GetEncryptionInfo());
+    });
+    bench::Require(count == book.itemCount, "Every image should be encrypted");
+}
+
+BENCHMARK("manifest/resolve/reader")
+{
+    const bench::ManifestBook& book = bench::ManyItemsBook();
+    ContainerPtr container = Container::OpenContainer(book.path);
+    std::vector<ManifestItemPtr> items = ManifestItems(container->DefaultPackage());
+
+    uint8_t buf[64];
+    state.SetItemsPerIteration(items.size());
+    state.Measure([&] {
+        for ( auto& item : items )
+        {
+            unique_ptr<ByteStream> stream = item->Reader();
+            bench::Require(bool(stream) && stream->ReadBytes(buf, sizeof(buf)) > 0, "Unable to read an item");
+        }
+    });
+}
+
+BENCHMARK("manifest/resolve/encryption_info")
+{
+    const bench::ManifestBook& book = bench::ManyItemsBook();
+    ContainerPtr container = Container::OpenContainer(book.path);
+    std::vector<ManifestItemPtr> items = ManifestItems(container->DefaultPackage());
+
+    state.SetItemsPerIteration(items.size());
+    state.Measure([&] {
+        size_t encrypted = 0;
+        for ( auto& item : items )
+            encrypted += bool(item->GetEncryptionInfo());
+        bench::Require(encrypted == book.itemCount, "Every image should be encrypted");
+    });
+}
+
+BENCHMARK("manifest/resolve/can_load_document")
+{
+    const bench::ManifestBook& book = bench::ManyItemsBook();
+    ContainerPtr container = Container::OpenContainer(book.path);
+    std::vector<ManifestItemPtr> items = ManifestItems(container->DefaultPackage());
+
+    state.SetItemsPerIteration(items.size());
+    state.Measure([&] {
+        for ( auto& item : items )
+            bench::Require(item->CanLoadDocument(), "Missing item");
+    });
+}
+
+// Package::ManifestItemAtRelativePath() compares every item's absolute path
+BENCHMARK("manifest/resolve/item_at_path")
+{
+    const bench::ManifestBook& book = bench::ManyItemsBook();
+    ContainerPtr container = Container::OpenContainer(book.path);
+    PackagePtr package = container->DefaultPackage();
+
+    state.SetItemsPerIteration(10);
+    state.Measure([&] {
+        for ( size_t i = 0; i < 10; i++ )
+        {
+            string path = _Str("images/i", (i * 997) % book.itemCount, ".png");
+            bench::Require(bool(package->ManifestItemAtRelativePath(path)), "Missing item");
+        }
+    });
+}
+
+// the same lookups through a snapshot, which hashes the paths when it's taken
+BENCHMARK("manifest/snapshot/item_at_path")
+{
+    const bench::ManifestBook& book = bench::ManyItemsBook();
+    ContainerPtr container = Container::OpenContainer(book.path);
+    ConstPackageSnapshotPtr snapshot = container->DefaultPackage()->GetSnapshot();
+
+    state.SetItemsPerIteration(10);
+    state.Measure([&] {
+        for ( size_t i = 0; i < 10; i++ )
+        {
+            string path = _Str("images/i", (i * 997) % book.itemCount, ".png");
+            bench::Require(snapshot->ItemAtRelativePath(path) != nullptr, "Missing item");
+        }
+    });
+}
+
+// taking a snapshot resolves and copies every manifest item
+BENCHMARK("manifest/snapshot/create")
+{
+    const bench::ManifestBook& book = bench::ManyItemsBook();
+    ContainerPtr container = Container::OpenContainer(book.path);
+    PackagePtr package = container->DefaultPackage();
+
+    state.SetItemsPerIteration(book.itemCount + 1);
+    state.Measure([&] {
+        bench::Require(PackageSnapshot::Create(package)->Items().size() == book.itemCount + 1, "Missing items");
+    });
+}
@@ -0,0 +1,260 @@
+//
+//  media_overlays_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/media-overlays_smil_model.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "../ePub3/utilities/error_handler.h"
+#include <memory>
+#include <sstream>
+
+using namespace ePub3;
+
+// a book with one SMIL file per chapter, each with a one-second clip per paragraph
+static void WriteNarratedBook(const std::string& path, size_t chapters, size_t paragraphs)
+{
+    ZipStreamWriter writer(path);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("META-INF/container.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles><rootfile full-path="EPUB/package.opf" media-type="application/oebps-package+xml"/></rootfiles>
+</container>
+)X"));
+
+    std::ostringstream opf, manifest, spine;
+    opf << R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:narrated</dc:identifier>
+    <dc:title>Narrated</dc:title>
+    <dc:language>en</dc:language>
+    <meta property="dcterms:modified">2014-01-01T00:00:00Z</meta>
+    <meta property="media:active-class">-epub-media-overlay-active</meta>
+)X";
+    opf << "    <meta property=\"media:duration\">" << chapters * paragraphs << "s</meta>\n";
+
+    manifest << "    <item id=\"nav\" href=\"nav.xhtml\" media-type=\"application/xhtml+xml\" properties=\"nav\"/>\n"
+             << "    <item id=\"audio\" href=\"audio.mp4\" media-type=\"audio/mp4\"/>\n";
+    std::ostringstream nav;
+    nav << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+        << "<head><title>Contents</title></head><body><nav epub:type=\"toc\"><ol>";
+
+    for ( size_t i = 0; i < chapters; i++ )
+    {
+        opf << "    <meta property=\"media:duration\" refines=\"#s" << i << "\">" << paragraphs << "s</meta>\n";
+        manifest << "    <item id=\"c" << i << "\" href=\"c" << i << ".xhtml\" media-type=\"application/xhtml+xml\" media-overlay=\"s" << i << "\"/>\n"
+                 << "    <item id=\"s" << i << "\" href=\"smil/s" << i << ".smil\" media-type=\"application/smil+xml\"/>\n";
+        spine << "    <itemref idref=\"c" << i << "\"/>\n";
+        nav << "<li><a href=\"c" << i << ".xhtml\">Chapter " << i << "</a></li>";
+
+        std::ostringstream chapter, smil;
+        chapter << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Chapter " << i << "</title></head><body>";
+        smil << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<smil xmlns=\"http://www.w3.org/ns/SMIL\" xmlns:epub=\"http://www.idpf.org/2007/ops\" version=\"3.0\"><body>"
+             << "<seq epub:textref=\"../c" << i << ".xhtml\" epub:type=\"chapter\">";
+        for ( size_t j = 0; j < paragraphs; j++ )
+        {
+            chapter << "<p id=\"p" << j << "\">Paragraph " << j << "</p>";
+            smil << "<par id=\"par" << j << "\"><text src=\"../c" << i << ".xhtml#p" << j << "\"/>"
+                 << "<audio src=\"../audio.mp4\" clipBegin=\"" << j << "s\" clipEnd=\"" << j + 1 << "s\"/></par>";
+        }
+        chapter << "</body></html>\n";
+        smil << "</seq></body></smil>\n";
+
+        writer.AddEntry("EPUB/c" + std::to_string(i) + ".xhtml", chapter.str());
+        writer.AddEntry("EPUB/smil/s" + std::to_string(i) + ".smil", smil.str());
+    }
+    nav << "</ol></nav></body></html>\n";
+
+    opf << "  </metadata>\n  <manifest>\n" << manifest.str() << "  </manifest>\n  <spine>\n" << spine.str() << "  </spine>\n</package>\n";
+    writer.AddEntry("EPUB/package.opf", opf.str());
+    writer.AddEntry("EPUB/nav.xhtml", nav.str());
+    writer.AddEntry("EPUB/audio.mp4", std::string(1024, '\0'), false);
+    bench::Require(writer.Close(), "Unable to write the narrated book");
+}
+
+struct NarratedBook
+{
+    std::string     path;
+    size_t          chapters;
+    size_t          paragraphs;
+};
+
+// many short SMIL files, as in a narrated novel
+static const NarratedBook& ManySmilsBook()
+{
+    static std::unique_ptr<NarratedBook> book;
+    if ( !book )
+    {
+        book.reset(new NarratedBook{bench::ScratchPath("narrated.epub"), 200, 100});
+        WriteNarratedBook(book->path, book->chapters, book->paragraphs);
+    }
+    return *book;
+}
+
+// a few very long SMIL files, for the timing tree itself
+static const NarratedBook& LongSmilsBook()
+{
+    static std::unique_ptr<NarratedBook> book;
+    if ( !book )
+    {
+        book.reset(new NarratedBook{bench::ScratchPath("narrated_long.epub"), 50, 2000});
+        WriteNarratedBook(book->path, book->chapters, book->paragraphs);
+    }
+    return *book;
+}
+
+// the books have no audio worth validating, which isn't what's being measured
+class IgnoreErrors
+{
+public:
+    IgnoreErrors()  { SetErrorHandler([](const error_details&) { return true; }); }
+    ~IgnoreErrors() { SetErrorHandler(DefaultErrorHandler); }
+};
+
+static std::shared_ptr<MediaOverlaysSmilModel> OpenModel(const NarratedBook& book, ContainerPtr& container)
+{
+    container = Container::OpenContainer(book.path);
+    bench::Require(bool(container), "Unable to open the narrated book");
+    return container->DefaultPackage()->MediaOverlaysSmilModel();
+}
+
+// visits every node through the handle API, as the platform bridges do
+static size_t WalkHandles(shared_ptr<const SMILData::Sequence> seq)
+{
+    size_t count = 1;
+    for ( size_t i = 0; i < seq->GetChildrenCount(); i++ )
+    {
+        auto child = seq->GetChild(i);
+        if ( child->IsSequence() )
+        {
+            count += WalkHandles(std::dynamic_pointer_cast<const SMILData::Sequence>(child));
+        }
+        else
+        {
+            auto par = std::dynamic_pointer_cast<const SMILData::Parallel>(child);
+            count += 1 + (par->Text() != nullptr) + (par->Audio() != nullptr);
+        }
+    }
+    return count;
+}
+
+// SMIL files are loaded on first use, so opening only reads the package
+BENCHMARK("media_overlays/open")
+{
+    const NarratedBook& book = ManySmilsBook();
+    IgnoreErrors ignore;
+
+    state.SetCounter("smils", book.chapters);
+    state.Measure([&] {
+        ContainerPtr container;
+        OpenModel(book, container);
+    });
+}
+
+BENCHMARK("media_overlays/open_first_smil")
+{
+    const NarratedBook& book = ManySmilsBook();
+    IgnoreErrors ignore;
+
+    state.Measure([&] {
+        ContainerPtr container;
+        bench::Require(bool(OpenModel(book, container)->GetSmil(0)->Body()), "Missing SMIL body");
+    });
+}
+
+// the cost of the former eager load
+BENCHMARK("media_overlays/open_all_smils")
+{
+    const NarratedBook& book = ManySmilsBook();
+    IgnoreErrors ignore;
+
+    state.SetItemsPerIteration(book.chapters);
+    state.Measure([&] {
+        ContainerPtr container;
+        OpenModel(book, container)->DurationMilliseconds_Calculated();
+    });
+}
+
+BENCHMARK("media_overlays/tree/build")
+{
+    const NarratedBook& book = LongSmilsBook();
+    IgnoreErrors ignore;
+    size_t nodes = 0, arenaBytes = 0;
+
+    state.SetItemsPerIteration(book.chapters * book.paragraphs);
+    state.Measure([&] {
+        ContainerPtr container;
+        auto model = OpenModel(book, container);
+        model->DurationMilliseconds_Calculated();
+
+        nodes = arenaBytes = 0;
+        for ( std::vector<SMILDataPtr>::size_type i = 0; i < model->GetSmilCount(); i++ )
+        {
+            nodes += model->GetSmil(i)->NodeCount();
+            arenaBytes += model->GetSmil(i)->ArenaSizeInBytes();
+        }
+    });
+    state.SetCounter("nodes", nodes);
+    state.SetCounter("arena_bytes_per_node", double(arenaBytes) / nodes);
+    state.SetCounter("handle_bytes_per_node", sizeof(SMILData::Parallel));
+}
+
+// durations and positions walk the arena
+BENCHMARK("media_overlays/tree/traverse")
+{
+    const NarratedBook& book = LongSmilsBook();
+    IgnoreErrors ignore;
+    ContainerPtr container;
+    auto model = OpenModel(book, container);
+    model->DurationMilliseconds_Calculated();
+
+    const uint32_t expected = static_cast<uint32_t>(book.chapters * book.paragraphs * 1000);
+    size_t iteration = 0;
+    state.Measure([&] {
+        bench::Require(model->DurationMilliseconds_Calculated() == expected, "Wrong duration");
+        SMILDataPtr smilData;
+        uint32_t smilIndex = 0, parIndex = 0, milliseconds = 0;
+        shared_ptr<const SMILData::Parallel> par;
+        model->PercentToPosition(double(iteration++ % 100), smilData, smilIndex, par, parIndex, milliseconds);
+    });
+}
+
+// the first walk creates the handles, and the measured ones reuse them
+BENCHMARK("media_overlays/tree/handles")
+{
+    const NarratedBook& book = LongSmilsBook();
+    IgnoreErrors ignore;
+    ContainerPtr container;
+    auto model = OpenModel(book, container);
+    model->DurationMilliseconds_Calculated();
+
+    size_t nodes = 0;
+    for ( std::vector<SMILDataPtr>::size_type i = 0; i < model->GetSmilCount(); i++ )
+        nodes += model->GetSmil(i)->NodeCount();
+
+    auto start = bench::State::Clock::now();
+    size_t handles = 0;
+    for ( std::vector<SMILDataPtr>::size_type i = 0; i < model->GetSmilCount(); i++ )
+        handles += WalkHandles(model->GetSmil(i)->Body());
+    auto firstWalk = std::chrono::duration_cast<std::chrono::microseconds>(bench::State::Clock::now() - start).count();
+    bench::Require(handles == nodes, "The handles don't cover the tree");
+
+    state.SetItemsPerIteration(nodes);
+    state.Measure([&] {
+        for ( std::vector<SMILDataPtr>::size_type i = 0; i < model->GetSmilCount(); i++ )
+            WalkHandles(model->GetSmil(i)->Body());
+    });
+    state.SetCounter("first_walk_us", firstWalk);
+}
@@ -0,0 +1,210 @@
+//
+//  search_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/search_index.h"
+#include <memory>
+
+using namespace ePub3;
+
+// common words and phrases, so every book has hits to turn into CFIs
+static const char* kQueries[] = { "the", "and", "of the", "in a", "said", "light" };
+
+// as many hits as a results page shows
+static const size_t kHitLimit = 100;
+
+// packages only hold their container weakly, so the caller keeps it open
+static ContainerPtr OpenBook(const std::string& path)
+{
+    ContainerPtr container = Container::OpenContainer(path);
+    bench::Require(bool(container) && bool(container->DefaultPackage()), "Unable to open the book");
+    return container;
+}
+
+// builds an index of every spine document, read through the package's filter chain
+static void IndexBook(bench::State& state, const std::string& path)
+{
+    ContainerPtr container = OpenBook(path);
+    PackagePtr package = container->DefaultPackage();
+    size_t words = 0, documents = 0;
+
+    state.Measure([&] {
+        SearchIndexPtr index = SearchIndex::Build(package);
+        bench::Require(index->DocumentCount() > 0, "Unable to index the book");
+        words = index->WordCount();
+        documents = index->DocumentCount();
+    });
+    state.SetItemsPerIteration(words);
+    state.SetCounter("documents", documents);
+}
+
+// runs each query against a finished index, building a CFI for each hit returned
+static void QueryBook(bench::State& state, const std::string& path)
+{
+    ContainerPtr container = OpenBook(path);
+    SearchIndexPtr index = SearchIndex::Build(container->DefaultPackage());
+    bench::Require(index->DocumentCount() > 0, "Unable to index the book");
+    size_t hits = 0;
+
+    state.SetItemsPerIteration(sizeof(kQueries) / sizeof(kQueries[0]));
+    state.Measure([&] {
+        hits = 0;
+        for ( auto query : kQueries )
+            hits += index->Search(query, kHitLimit).size();
+    });
+    state.SetCounter("hits", hits);
+}
+
+static struct SearchBenchmarks
+{
+    SearchBenchmarks()
+    {
+        for ( auto& book : bench::TestBooks() )
+        {
+            std::string name = book.substr(0, book.rfind('.'));
+            static_cast<void>(bench::Registration("search/index/" + name, [book](bench::State& state) {
+                IndexBook(state, bench::TestDataPath(book));
+            }));
+            static_cast<void>(bench::Registration("search/query/" + name, [book](bench::State& state) {
+                QueryBook(state, bench::TestDataPath(book));
+            }));
+        }
+    }
+} gSearchBenchmarks;
+
+BENCHMARK("search/index/synthetic")
+{
+    IndexBook(state, bench::LargeBook().path);
+}
+
+BENCHMARK("search/query/synthetic")
+{
+    QueryBook(state, bench::LargeBook().path);
+}
+
+// a synthetic corpus: a 4000-word vocabulary, ~3M words of text in 200 documents
+struct SyntheticCorpus
+{
+    std::vector<std::string>    vocabulary;
+    std::vector<std::string>    documents;
+    size_t                      bytes;
+};
+
+static const SyntheticCorpus& Corpus()
+{
+    static std::unique_ptr<SyntheticCorpus> corpus;
+    if ( corpus )
+        return *corpus;
+
+    static const size_t kDocumentCount = 200;
+    static const size_t kParagraphs = 200;
+
+    corpus.reset(new SyntheticCorpus);
+    for ( size_t i = 0; i < 4000; i++ )
+    {
+        std::string word;
+        for ( size_t n = i + 1; n > 0; n /= 20 )
+            word += static_cast<char>('a' + (n % 20));
+        corpus->vocabulary.push_back(word);
+    }
+
+    size_t seed = 1;
+    corpus->bytes = 0;
+    for ( size_t d = 0; d < kDocumentCount; d++ )
+    {
+        std::string doc = "<html xmlns=\"http://www.w3.org/1999/xhtml\"><body>";
+        for ( size_t p = 0; p < kParagraphs; p++ )
+        {
+            doc += "<p>";
+            for ( size_t w = 0; w < 75; w++ )
+            {
+                seed = seed * 1103515245 + 12345;
+                doc += corpus->vocabulary[(seed >> 8) % corpus->vocabulary.size()];
+                doc += ' ';
+            }
+            doc += "</p>";
+        }
+        doc += "</body></html>";
+        corpus->bytes += doc.size();
+        corpus->documents.push_back(doc);
+    }
+    return *corpus;
+}
+
+static SearchIndexPtr IndexCorpus(const SyntheticCorpus& corpus)
+{
+    auto index = std::make_shared<SearchIndex>();
+    for ( size_t d = 0; d < corpus.documents.size(); d++ )
+    {
+        CFI spineCFI(_Str("/6/", d * 2 + 2, "!"));
+        bench::Require(index->AddDocument(d, spineCFI, corpus.documents[d].data(), corpus.documents[d].size()), "Unable to index a document");
+    }
+    index->Finish();
+    return index;
+}
+
+static const size_t kCorpusQueries = 1000;
+
+BENCHMARK("search/index/corpus")
+{
+    const SyntheticCorpus& corpus = Corpus();
+    SearchIndexPtr index;
+
+    state.SetBytesPerIteration(corpus.bytes);
+    state.Measure([&] {
+        index = IndexCorpus(corpus);
+    });
+    state.SetItemsPerIteration(index->WordCount());
+    state.SetCounter("terms", index->TermCount());
+    state.SetCounter("posting_bytes", index->PostingBytes());
+}
+
+BENCHMARK("search/query/corpus_words")
+{
+    const SyntheticCorpus& corpus = Corpus();
+    SearchIndexPtr index = IndexCorpus(corpus);
+    size_t hits = 0;
+
+    state.SetItemsPerIteration(kCorpusQueries);
+    state.Measure([&] {
+        hits = 0;
+        for ( size_t i = 0; i < kCorpusQueries; i++ )
+            hits += index->Search(corpus.vocabulary[(i * 7919) % corpus.vocabulary.size()], 20).size();
+    });
+    bench::Require(hits > 0, "No word hits");
+    state.SetCounter("hits", hits);
+}
+
+BENCHMARK("search/query/corpus_phrases")
+{
+    const SyntheticCorpus& corpus = Corpus();
+    SearchIndexPtr index = IndexCorpus(corpus);
+    std::vector<std::string> phrases;
+    for ( size_t i = 0; i < kCorpusQueries; i++ )
+    {
+        std::string phrase = corpus.vocabulary[(i * 7919) % corpus.vocabulary.size()];
+        phrase.append(" ").append(corpus.vocabulary[(i * 104729) % corpus.vocabulary.size()]);
+        phrases.push_back(phrase);
+    }
+    size_t hits = 0;
+
+    state.SetItemsPerIteration(phrases.size());
+    state.Measure([&] {
+        hits = 0;
+        for ( auto& phrase : phrases )
+            hits += index->Search(phrase).size();
+    });
+    state.SetCounter("hits", hits);
+}
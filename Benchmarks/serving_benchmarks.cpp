@@ -0,0 +1,189 @@
+//
+//  serving_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/filter_chain_byte_stream_range.h"
+#include "../ePub3/utilities/byte_stream.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#if EPUB_OS(LINUX)
+# include <sys/sendfile.h>
+#endif
+
+using namespace ePub3;
+
+// A TCP connection over the loopback interface, as between the HTTP bridge and
+// a web view. A thread drains the receiving end, counting what arrives.
+class LoopbackConnection
+{
+public:
+    LoopbackConnection() : _sender(-1), _receiver(-1), _received(0)
+    {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        bench::Require(listener != -1, "Unable to create a socket");
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLen = sizeof(addr);
+        bench::Require(bind(listener, reinterpret_cast<sockaddr*>(&addr), addrLen) == 0 && listen(listener, 1) == 0 &&
+                       getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addrLen) == 0, "Unable to listen on the loopback interface");
+
+        _sender = socket(AF_INET, SOCK_STREAM, 0);
+        bench::Require(connect(_sender, reinterpret_cast<sockaddr*>(&addr), addrLen) == 0, "Unable to connect over the loopback interface");
+        _receiver = accept(listener, nullptr, nullptr);
+        close(listener);
+        bench::Require(_receiver != -1, "Unable to accept the loopback connection");
+
+        _drain = std::thread([this] {
+            std::vector<char> buf(256*1024);
+            ssize_t num = 0;
+            while ( (num = recv(_receiver, buf.data(), buf.size(), 0)) > 0 )
+            {
+                std::lock_guard<std::mutex> _(_lock);
+                _received += uint64_t(num);
+                _arrived.notify_all();
+            }
+        });
+    }
+    ~LoopbackConnection()
+    {
+        shutdown(_sender, SHUT_WR);
+        _drain.join();
+        close(_sender);
+        close(_receiver);
+    }
+
+    int Socket() const { return _sender; }
+
+    // waits until everything sent so far has been received
+    void Wait(uint64_t sent)
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _arrived.wait(lock, [&] { return _received >= sent; });
+    }
+
+private:
+    int                     _sender;
+    int                     _receiver;
+    std::thread             _drain;
+    std::mutex              _lock;
+    std::condition_variable _arrived;
+    uint64_t                _received;
+};
+
+static double ThreadCPUSeconds()
+{
+    rusage usage;
+#if EPUB_OS(LINUX)
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// serves the synthetic book's stored media file, once per iteration, reporting
+// the sending thread's CPU time per gigabyte sent
+static void ServeMedia(bench::State& state, std::function<uint64_t(const Package&, ManifestItemPtr, int)> send)
+{
+    const bench::SyntheticBook& book = bench::LargeBook();
+    ContainerPtr container = Container::OpenContainer(book.path);
+    bench::Require(bool(container), "Unable to open the synthetic book");
+    PackagePtr package = container->DefaultPackage();
+    ManifestItemPtr item = package->ManifestItemWithID("media");
+
+    LoopbackConnection connection;
+    uint64_t sent = 0;
+
+    double cpu = ThreadCPUSeconds();
+    state.SetBytesPerIteration(book.mediaSize);
+    state.Measure([&] {
+        uint64_t num = send(*package, item, connection.Socket());
+        bench::Require(num == book.mediaSize, "Short send");
+        sent += num;
+        connection.Wait(sent);
+    });
+    cpu = ThreadCPUSeconds() - cpu;
+
+    state.SetCounter("cpu_ms_per_gb", cpu * 1e3 / (double(sent) / 1e9));
+}
+
+static bool SendAll(int socket, const uint8_t* bytes, size_t len)
+{
+    while ( len > 0 )
+    {
+        ssize_t num = send(socket, bytes, len, 0);
+        if ( num <= 0 )
+            return false;
+        bytes += num;
+        len -= size_t(num);
+    }
+    return true;
+}
+
+// read in 64 KB ranges through the stream the bridge uses, each then written to the socket
+BENCHMARK("serving/loopback/copy")
+{
+    std::vector<uint8_t> buf(64*1024);
+    ServeMedia(state, [&](const Package& package, ManifestItemPtr item, int socket) {
+        auto stream = package.GetFilterChainByteStreamRange(item);
+        FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+        bench::Require(ranged != nullptr, "Not a range stream");
+
+        uint64_t total = 0;
+        ByteStream::size_type num = 0;
+        do
+        {
+            ByteRange range;
+            range.Location(uint32_t(total));
+            range.Length(uint32_t(buf.size()));
+            num = ranged->ReadBytes(buf.data(), buf.size(), range);
+            bench::Require(SendAll(socket, buf.data(), num), "Unable to send");
+            total += num;
+        } while ( num == buf.size() );
+        return total;
+    });
+}
+
+// handed to the kernel as a range of the archive file
+BENCHMARK("serving/loopback/sendfile")
+{
+#if EPUB_OS(LINUX)
+    ServeMedia(state, [](const Package& package, ManifestItemPtr item, int socket) {
+        FileRange range;
+        bench::Require(package.GetFileRange(item, range), "The media file can't be served from the archive");
+
+        off_t offset = off_t(range.offset);
+        uint64_t total = 0;
+        while ( total < range.length )
+        {
+            ssize_t num = sendfile(socket, range.fd, &offset, size_t(range.length - total));
+            bench::Require(num > 0, "Unable to send");
+            total += uint64_t(num);
+        }
+        return total;
+    });
+#else
+    state.Skip("sendfile() is Linux-only");
+#endif
+}
@@ -0,0 +1,238 @@
+//
+//  text_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/cfi.h"
+#include "../ePub3/utilities/utfstring.h"
+#include "../ePub3/utilities/ring_buffer.h"
+#include <random>
+#include <sstream>
+
+using namespace ePub3;
+
+///////////////////////////////////////////////////////////////////////////////
+// CFI
+
+// a spread of location and range CFIs, with and without assertions and offsets
+static std::vector<std::string> MakeCFIs(size_t count)
+{
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> step(1, 40);
+    std::vector<std::string> result;
+    result.reserve(count);
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        std::ostringstream ss;
+        ss << "epubcfi(/6/" << 2 * step(random) << "[chap" << i % 100 << "]!";
+        int depth = 2 + static_cast<int>(i % 5);
+        for ( int d = 0; d < depth; d++ )
+            ss << '/' << 2 * step(random);
+        if ( i % 3 == 0 )
+            ss << "[para" << i << "]";
+        if ( i % 4 == 0 )
+            ss << ",/1:" << step(random) << ",/3:" << 40 + step(random);
+        else
+            ss << "/1:" << step(random);
+        ss << ')';
+        result.push_back(ss.str());
+    }
+    return result;
+}
+
+BENCHMARK("cfi/parse")
+{
+    std::vector<std::string> strings = MakeCFIs(5000);
+    std::vector<string> cfis(strings.begin(), strings.end());
+
+    state.SetItemsPerIteration(cfis.size());
+    state.Measure([&] {
+        for ( auto& str : cfis )
+            CFI cfi(str);
+    });
+}
+
+BENCHMARK("cfi/compare")
+{
+    std::vector<std::string> strings = MakeCFIs(5000);
+    std::vector<CFI> cfis(strings.begin(), strings.end());
+    std::vector<CFI> copies(cfis);
+
+    size_t matches = 0;
+    state.SetItemsPerIteration(2 * cfis.size());
+    state.Measure([&] {
+        matches = 0;
+        for ( size_t i = 0; i < cfis.size(); i++ )
+        {
+            matches += (cfis[i] == copies[i]);
+            matches += (cfis[i] == cfis[(i + 1) % cfis.size()]);
+        }
+    });
+    bench::Require(matches >= cfis.size(), "CFIs should equal their copies");
+}
+
+BENCHMARK("cfi/stringify")
+{
+    std::vector<std::string> strings = MakeCFIs(5000);
+    std::vector<CFI> cfis(strings.begin(), strings.end());
+
+    state.SetItemsPerIteration(cfis.size());
+    state.Measure([&] {
+        for ( auto& cfi : cfis )
+            bench::Require(!cfi.String().empty(), "Empty CFI string");
+    });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ePub3::string
+
+// mixed ASCII and multi-byte UTF-8, as in most non-English content
+static std::string MakeText(size_t bytes)
+{
+    static const char* kPieces[] = { "The voyage of life ", u8"夏目漱石 ", u8"Éléphant ", "river and boat ", u8"Ωμέγα " };
+    std::string result;
+    result.reserve(bytes + 32);
+    for ( size_t i = 0; result.size() < bytes; i++ )
+        result += kPieces[i % (sizeof(kPieces)/sizeof(kPieces[0]))];
+    return result;
+}
+
+BENCHMARK("string/construct")
+{
+    std::string text = MakeText(256*1024);
+    state.SetBytesPerIteration(text.size());
+    state.Measure([&] {
+        string str(text);
+        bench::Require(!str.empty(), "Empty string");
+    });
+}
+
+BENCHMARK("string/size")
+{
+    string str(MakeText(256*1024));
+    state.SetBytesPerIteration(str.stl_str().size());
+    state.Measure([&] {
+        bench::Require(str.size() > 0, "Empty string");
+    });
+}
+
+BENCHMARK("string/iterate")
+{
+    string str(MakeText(256*1024));
+    state.SetBytesPerIteration(str.stl_str().size());
+    state.Measure([&] {
+        uint32_t sum = 0;
+        for ( auto ch : str )
+            sum += ch;
+        bench::Require(sum != 0, "Nothing iterated");
+    });
+}
+
+BENCHMARK("string/find")
+{
+    string str(MakeText(256*1024) + "needle");
+    string needle("needle");
+    state.SetBytesPerIteration(str.stl_str().size());
+    state.Measure([&] {
+        bench::Require(str.find(needle) != string::npos, "Needle not found");
+    });
+}
+
+BENCHMARK("string/substr")
+{
+    string str(MakeText(64*1024));
+    string::size_type length = str.size();
+    state.SetItemsPerIteration(100);
+    state.Measure([&] {
+        for ( string::size_type i = 0; i < 100; i++ )
+            bench::Require(str.substr(i * (length / 100), 64).size() == 64, "Short substring");
+    });
+}
+
+BENCHMARK("string/utf16")
+{
+    string str(MakeText(256*1024));
+    state.SetBytesPerIteration(str.stl_str().size());
+    state.Measure([&] {
+        bench::Require(!str.utf16string().empty(), "Empty conversion");
+    });
+}
+
+BENCHMARK("string/concatenate")
+{
+    std::vector<string> pieces;
+    for ( int i = 0; i < 1000; i++ )
+        pieces.emplace_back(MakeText(64));
+
+    state.SetItemsPerIteration(pieces.size());
+    state.Measure([&] {
+        string result;
+        for ( auto& piece : pieces )
+            result += piece;
+        bench::Require(!result.empty(), "Empty result");
+    });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// RingBuffer
+
+// ReadBytes() only copies; consumers call RemoveBytes() once the data's been used
+static void RingBufferThroughput(bench::State& state, size_t chunk)
+{
+    static const size_t kTotal = 4*1024*1024;
+    RingBuffer ring(64*1024);
+    std::vector<uint8_t> in(chunk, 0x5a), out(chunk);
+
+    state.SetBytesPerIteration(kTotal);
+    state.Measure([&] {
+        size_t moved = 0;
+        while ( moved < kTotal )
+        {
+            ring.WriteBytes(in.data(), chunk);
+            size_t num = ring.ReadBytes(out.data(), chunk);
+            ring.RemoveBytes(num);
+            moved += num;
+        }
+    });
+}
+
+BENCHMARK("ring_buffer/small_chunks")
+{
+    RingBufferThroughput(state, 100);
+}
+
+BENCHMARK("ring_buffer/large_chunks")
+{
+    RingBufferThroughput(state, 48*1024);
+}
+
+BENCHMARK("ring_buffer/wrapping")
+{
+    // writes which never line up with the capacity wrap around constantly
+    static const size_t kTotal = 4*1024*1024;
+    RingBuffer ring(4096);
+    std::vector<uint8_t> in(3000, 0x5a), out(3000);
+
+    state.SetBytesPerIteration(kTotal);
+    state.Measure([&] {
+        size_t moved = 0;
+        while ( moved < kTotal )
+        {
+            ring.WriteBytes(in.data(), in.size());
+            size_t num = ring.ReadBytes(out.data(), out.size());
+            ring.RemoveBytes(num);
+            moved += num;
+        }
+    });
+}
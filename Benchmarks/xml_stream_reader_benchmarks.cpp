@@ -0,0 +1,179 @@
+//
+//  xml_stream_reader_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/nav_table.h"
+#include "../ePub3/ePub/xml_stream_reader.h"
+#include "../ePub3/utilities/error_handler.h"
+#include "../ePub3/xml/tree/document.h"
+#include "../ePub3/xml/tree/element.h"
+#include <memory>
+#include <sstream>
+#include <unistd.h>
+
+using namespace ePub3;
+
+static const size_t kItemCount = 20000;
+
+// a package with a manifest, spine and NCX of kItemCount items
+struct SyntheticPackage
+{
+    std::string     opf;
+    std::string     ncx;
+};
+
+static const SyntheticPackage& LargePackage()
+{
+    static std::unique_ptr<SyntheticPackage> package;
+    if ( package )
+        return *package;
+
+    std::ostringstream o;
+    o << R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="2.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:synthetic</dc:identifier>
+    <dc:title>Synthetic</dc:title>
+    <dc:language>en</dc:language>
+  </metadata>
+  <manifest>
+    <item href="toc.ncx" id="ncx" media-type="application/x-dtbncx+xml"/>
+)X";
+    for ( size_t i = 0; i < kItemCount; i++ )
+        o << "    <item href=\"text/chapter" << i << ".xhtml\" id=\"c" << i << "\" media-type=\"application/xhtml+xml\"/>\n";
+    o << "  </manifest>\n  <spine toc=\"ncx\">\n";
+    for ( size_t i = 0; i < kItemCount; i++ )
+        o << "    <itemref idref=\"c" << i << "\"/>\n";
+    o << "  </spine>\n</package>\n";
+
+    std::ostringstream n;
+    n << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\">\n"
+      << "<docTitle><text>Synthetic</text></docTitle>\n<navMap>\n";
+    for ( size_t i = 0; i < kItemCount; i++ )
+    {
+        n << "<navPoint id=\"n" << i << "\" playOrder=\"" << i + 1 << "\"><navLabel><text>Chapter " << i << "</text></navLabel>"
+          << "<content src=\"text/chapter" << i << ".xhtml\"/>";
+        for ( size_t j = 0; j < 4; j++ )
+            n << "<navPoint id=\"n" << i << '_' << j << "\"><navLabel><text>Section " << j << "</text></navLabel><content src=\"text/chapter" << i << ".xhtml#s" << j << "\"/></navPoint>";
+        n << "</navPoint>\n";
+    }
+    n << "</navMap>\n</ncx>\n";
+
+    package.reset(new SyntheticPackage);
+    package->opf = o.str();
+    package->ncx = n.str();
+    return *package;
+}
+
+// packages are created in a real container, which they only hold weakly
+static ContainerPtr HostContainer(bench::State& state)
+{
+    std::string path = bench::TestDataPath("childrens-literature-20120722.epub");
+    if ( ::access(path.c_str(), R_OK) != 0 )
+    {
+        state.Skip("missing " + path);
+        return nullptr;
+    }
+    ContainerPtr container = Container::OpenContainer(path);
+    bench::Require(bool(container), "Unable to open the host container");
+    return container;
+}
+
+// the synthetic package references files it doesn't have, which isn't what's being measured
+class IgnoreErrors
+{
+public:
+    IgnoreErrors()  { SetErrorHandler([](const error_details&) { return true; }); }
+    ~IgnoreErrors() { SetErrorHandler(DefaultErrorHandler); }
+};
+
+// the package document, manifest and spine; the navigation is loaded from the archive, so isn't included here
+BENCHMARK("package/opf/dom")
+{
+    const SyntheticPackage& synthetic = LargePackage();
+    ContainerPtr container = HostContainer(state);
+    if ( !container )
+        return;
+
+    IgnoreErrors ignore;
+    PackagePtr package;
+    state.SetBytesPerIteration(synthetic.opf.size());
+    state.Measure([&] {
+        package = Package::New(container, "application/oebps-package+xml");
+        package->_OpenForTest(xml::Wrapped<xml::Document>(xmlReadMemory(synthetic.opf.data(), (int)synthetic.opf.size(), "package.opf", nullptr, XMLStreamReader::DefaultOptions)), "OPS/");
+    });
+    bench::Require(package->Manifest().size() == kItemCount + 1, "Incomplete manifest");
+}
+
+BENCHMARK("package/opf/stream")
+{
+    const SyntheticPackage& synthetic = LargePackage();
+    ContainerPtr container = HostContainer(state);
+    if ( !container )
+        return;
+
+    IgnoreErrors ignore;
+    PackagePtr package;
+    state.SetBytesPerIteration(synthetic.opf.size());
+    state.Measure([&] {
+        package = Package::New(container, "application/oebps-package+xml");
+        package->_OpenStreamForTest(synthetic.opf.data(), synthetic.opf.size(), "OPS/");
+    });
+    bench::Require(package->Manifest().size() == kItemCount + 1, "Incomplete manifest");
+}
+
+BENCHMARK("package/ncx/dom")
+{
+    const SyntheticPackage& synthetic = LargePackage();
+    ContainerPtr container = HostContainer(state);
+    if ( !container )
+        return;
+
+    IgnoreErrors ignore;
+    PackagePtr package = Package::New(container, "application/oebps-package+xml");
+    package->_OpenStreamForTest(synthetic.opf.data(), synthetic.opf.size(), "OPS/");
+
+    NavigationTablePtr table;
+    state.SetBytesPerIteration(synthetic.ncx.size());
+    state.Measure([&] {
+        auto ncxDoc = xml::Wrapped<xml::Document>(xmlReadMemory(synthetic.ncx.data(), (int)synthetic.ncx.size(), "toc.ncx", nullptr, XMLStreamReader::DefaultOptions));
+        table = NavigationTable::New(package, "toc.ncx");
+        table->ParseNCXNavMap(ncxDoc->Root()->FirstElementChild()->NextElementSibling(), "Synthetic");
+    });
+    bench::Require(table->Children().size() == kItemCount, "Incomplete navigation table");
+}
+
+BENCHMARK("package/ncx/stream")
+{
+    const SyntheticPackage& synthetic = LargePackage();
+    ContainerPtr container = HostContainer(state);
+    if ( !container )
+        return;
+
+    IgnoreErrors ignore;
+    PackagePtr package = Package::New(container, "application/oebps-package+xml");
+    package->_OpenStreamForTest(synthetic.opf.data(), synthetic.opf.size(), "OPS/");
+
+    NavigationTablePtr table;
+    state.SetBytesPerIteration(synthetic.ncx.size());
+    state.Measure([&] {
+        XMLStreamReader reader(synthetic.ncx.data(), synthetic.ncx.size(), "toc.ncx");
+        table = NavigationTable::New(package, "toc.ncx");
+        while ( reader.Next() && !reader.Is("navMap") )
+            continue;
+        table->ParseNCXNavMap(reader, "Synthetic");
+    });
+    bench::Require(table->Children().size() == kItemCount, "Incomplete navigation table");
+}
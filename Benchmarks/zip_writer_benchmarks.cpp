@@ -0,0 +1,207 @@
+//
+//  zip_writer_benchmarks.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "benchmark.h"
+#include "fixtures.h"
+#include "../ePub3/ePub/zip_archive.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+
+using namespace ePub3;
+
+static const int kRepackEntryCount = 64;
+static const size_t kRepackEntrySize = 1024*1024;
+
+// compressible, but not trivially so
+static std::string MakeText(size_t length, unsigned seed)
+{
+    static const char* words[] = { "the ", "whale ", "sea ", "Ishmael ", "ship ", "harpoon ", "<p>", "</p>\n", "captain ", "white " };
+    std::string result;
+    result.reserve(length + 16);
+    while ( result.size() < length )
+    {
+        seed = seed * 1103515245 + 12345;
+        result.append(words[(seed >> 16) % 10]);
+    }
+    result.resize(length);
+    return result;
+}
+
+static std::string MakeNoise(size_t length, unsigned seed)
+{
+    std::string result(length, '\0');
+    for ( auto& ch : result )
+    {
+        seed = seed * 1103515245 + 12345;
+        ch = static_cast<char>(seed >> 16);
+    }
+    return result;
+}
+
+static std::string RepackEntryName(int i)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "OPS/chapter-%03d.xhtml", i);
+    return name;
+}
+
+// an uncompressed source, so every entry is deflated by the repack
+static const std::string& RepackSource()
+{
+    static std::unique_ptr<std::string> path;
+    if ( path )
+        return *path;
+
+    path.reset(new std::string(bench::ScratchPath("repack_source.zip")));
+    ZipStreamWriter::Options options;
+    options.compressionLevel = Archive::Uncompressed;
+    ZipStreamWriter writer(*path, options);
+    writer.AddEntry("mimetype", "application/epub+zip", 20);
+    for ( int i = 0; i < kRepackEntryCount; i++ )
+        writer.AddEntry(RepackEntryName(i), MakeText(kRepackEntrySize, i), false);
+    bench::Require(writer.Close(), "Unable to write the repack source");
+    return *path;
+}
+
+static void CopyFile(const std::string& from, const std::string& to)
+{
+    std::ifstream in(from, std::ios::in|std::ios::binary);
+    std::ofstream out(to, std::ios::out|std::ios::binary|std::ios::trunc);
+    out << in.rdbuf();
+    bench::Require(bool(out), "Unable to copy the archive");
+}
+
+static void Repack(bench::State& state, int threads)
+{
+    const std::string& source = RepackSource();
+    std::string output = bench::ScratchPath("repack_output.zip");
+    ZipStreamWriter::Options options;
+    options.threadCount = threads;
+    auto all = [](const string&) { return true; };
+
+    state.SetBytesPerIteration(uint64_t(kRepackEntryCount) * kRepackEntrySize);
+    state.SetItemsPerIteration(kRepackEntryCount);
+    state.Measure([&] {
+        bench::Require(ZipStreamWriter::Repack(source, output, all, nullptr, options), "Unable to repack the archive");
+    });
+    remove(output.c_str());
+}
+
+// the same work through ZipArchive, which rewrites entries in place through libzip
+BENCHMARK("zip_writer/repack/zip_archive")
+{
+    std::string path = bench::ScratchPath("repack_rewrite.zip");
+    CopyFile(RepackSource(), path);
+
+    std::vector<std::pair<std::string, std::string>> entries;
+    entries.emplace_back("mimetype", "application/epub+zip");
+    for ( int i = 0; i < kRepackEntryCount; i++ )
+        entries.emplace_back(RepackEntryName(i), MakeText(kRepackEntrySize, i));
+
+    state.SetBytesPerIteration(uint64_t(kRepackEntryCount) * kRepackEntrySize);
+    state.SetItemsPerIteration(kRepackEntryCount);
+    state.Measure([&] {
+        ZipArchive archive(path);
+        for ( auto& entry : entries )
+        {
+            auto writer = archive.WriterAtPath(entry.first, entry.first != "mimetype");
+            bench::Require(bool(writer), "Unable to write an entry");
+            writer->write(entry.second.data(), entry.second.size());
+            writer.release();       // owned by libzip once added
+        }
+    });
+    remove(path.c_str());
+}
+
+static const std::string kMetadata("<package version=\"3.0\"><metadata>updated</metadata></package>");
+
+// a small package and chapter alongside a large stored media file
+static std::string UpdateArchive(size_t megabytes)
+{
+    std::string path = bench::ScratchPath("update_" + std::to_string(megabytes) + "mb.zip");
+    remove(path.c_str());
+    ZipStreamWriter writer(path);
+    writer.AddEntry("mimetype", "application/epub+zip", 20);
+    writer.AddEntry("OEBPS/content.opf", std::string("<package version=\"3.0\"/>"));
+    writer.AddEntry("OEBPS/chapter.xhtml", MakeText(20000, 4));
+    writer.AddEntry("OEBPS/audio.mp3", MakeNoise(megabytes * 1024 * 1024, 5), false);
+    writer.AddEntry("OEBPS/old.xhtml", std::string("old"));
+    bench::Require(writer.Close(), "Unable to write the update archive");
+    return path;
+}
+
+// replacing the package document, which leaves the old entry's data in place
+static void UpdateInPlace(bench::State& state, size_t megabytes)
+{
+    std::string path = UpdateArchive(megabytes);
+    state.Measure([&] {
+        auto writer = ZipStreamWriter::OpenForUpdate(path);
+        bench::Require(bool(writer) && writer->AddEntry("OEBPS/content.opf", std::string(kMetadata)), "Unable to update the archive");
+        bench::Require(writer->Close(), "Unable to update the archive");
+    });
+    remove(path.c_str());
+}
+
+// the same update, followed by the compaction which reclaims the replaced entry
+static void UpdateAndCompact(bench::State& state, size_t megabytes)
+{
+    std::string path = UpdateArchive(megabytes);
+    state.Measure([&] {
+        auto writer = ZipStreamWriter::OpenForUpdate(path);
+        bench::Require(bool(writer) && writer->AddEntry("OEBPS/content.opf", std::string(kMetadata)), "Unable to update the archive");
+        bench::Require(writer->Close(), "Unable to update the archive");
+        bench::Require(ZipStreamWriter::Compact(path), "Unable to compact the archive");
+    });
+    remove(path.c_str());
+}
+
+// the same change through ZipArchive, which rewrites the whole archive
+static void UpdateThroughZipArchive(bench::State& state, size_t megabytes)
+{
+    std::string path = UpdateArchive(megabytes);
+    state.Measure([&] {
+        ZipArchive archive(path);
+        auto writer = archive.WriterAtPath("OEBPS/content.opf");
+        bench::Require(bool(writer), "Unable to write the entry");
+        writer->write(kMetadata.data(), kMetadata.size());
+        writer.release();       // owned by libzip once added
+    });
+    remove(path.c_str());
+}
+
+static struct ZipWriterBenchmarks
+{
+    ZipWriterBenchmarks()
+    {
+        for ( int threads : { 1, 2, 4, 8 } )
+        {
+            static_cast<void>(bench::Registration("zip_writer/repack/" + std::to_string(threads) + "_threads", [threads](bench::State& state) {
+                Repack(state, threads);
+            }));
+        }
+        for ( size_t megabytes : { 8, 32, 128 } )
+        {
+            std::string size = std::to_string(megabytes) + "mb";
+            static_cast<void>(bench::Registration("zip_writer/update/" + size, [megabytes](bench::State& state) {
+                UpdateInPlace(state, megabytes);
+            }));
+            static_cast<void>(bench::Registration("zip_writer/update_compact/" + size, [megabytes](bench::State& state) {
+                UpdateAndCompact(state, megabytes);
+            }));
+            static_cast<void>(bench::Registration("zip_writer/update_zip_archive/" + size, [megabytes](bench::State& state) {
+                UpdateThroughZipArchive(state, megabytes);
+            }));
+        }
+    }
+} gZipWriterBenchmarks;
@@ -247,6 +247,7 @@ LOCAL_SRC_FILES := \
 		ePub3/xml/tree/element.cpp \
 		ePub3/xml/tree/node.cpp \
 		ePub3/xml/tree/xpath.cpp \
+		ePub3/utilities/buffer_pool.cpp \
 		ePub3/utilities/byte_buffer.cpp \
 		ePub3/utilities/byte_stream.cpp \
 		ePub3/utilities/CPUCacheUtils_arm.S \
@@ -257,19 +258,24 @@ LOCAL_SRC_FILES := \
 		ePub3/utilities/error_handler.cpp \
 		ePub3/utilities/executor.cpp \
 		ePub3/utilities/future.cpp \
+		ePub3/utilities/instrumentation.cpp \
 		ePub3/utilities/iri.cpp \
 		ePub3/utilities/optional.cpp \
 		ePub3/utilities/path_help.cpp \
 		ePub3/utilities/ring_buffer.cpp \
 		ePub3/utilities/run_loop_android.cpp \
 		ePub3/utilities/utfstring.cpp \
+		ePub3/ePub/aes_cbc_decryption.cpp \
 		ePub3/ePub/archive_xml.cpp \
 		ePub3/ePub/archive.cpp \
 		ePub3/ePub/cfi.cpp \
+		ePub3/ePub/cfi_step_index.cpp \
 		ePub3/ePub/container.cpp \
 		ePub3/ePub/content_handler.cpp \
 		ePub3/ePub/content_module_manager.cpp \
 		ePub3/ePub/credential_request.cpp \
+		ePub3/ePub/deflate_decompression.cpp \
+		ePub3/ePub/document_preloader.cpp \
 		ePub3/ePub/encryption.cpp \
 		ePub3/ePub/epub_collection.cpp \
 		ePub3/ePub/filter_chain.cpp \
@@ -280,7 +286,9 @@ LOCAL_SRC_FILES := \
 		ePub3/ePub/PassThroughFilter.cpp \
 		ePub3/ePub/font_obfuscation.cpp \
 		ePub3/ePub/glossary.cpp \
+		ePub3/ePub/glossary_index.cpp \
 		ePub3/ePub/initialization.cpp \
+		ePub3/ePub/integrity_verifier.cpp \
 		ePub3/ePub/library.cpp \
 		ePub3/ePub/link.cpp \
 		ePub3/ePub/manifest.cpp \
@@ -291,14 +299,20 @@ LOCAL_SRC_FILES := \
 		ePub3/ePub/nav_table.cpp \
 		ePub3/ePub/object_preprocessor.cpp \
 		ePub3/ePub/package.cpp \
+		ePub3/ePub/package_snapshot.cpp \
 		ePub3/ePub/property_extension.cpp \
 		ePub3/ePub/property_holder.cpp \
 		ePub3/ePub/property.cpp \
+		ePub3/ePub/resource_cache.cpp \
+		ePub3/ePub/resource_prefetcher.cpp \
+		ePub3/ePub/search_index.cpp \
 		ePub3/ePub/signatures.cpp \
 		ePub3/ePub/spine.cpp \
 		ePub3/ePub/switch_preprocessor.cpp \
+		ePub3/ePub/xml_stream_reader.cpp \
 		ePub3/ePub/xpath_wrangler.cpp \
 		ePub3/ePub/zip_archive.cpp \
+		ePub3/ePub/zip_stream_writer.cpp \
 		ePub3/ThirdParty/google-url/base/string16.cc \
 		ePub3/ThirdParty/google-url/src/gurl.cc \
 		ePub3/ThirdParty/google-url/src/url_canon_etc.cc \
@@ -0,0 +1,243 @@
+//
+//  aes_cbc_decryption_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "../ePub3/ePub/aes_cbc_decryption.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/filter_chain_byte_stream_range.h"
+#include "../ePub3/ePub/resource_cache.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "filter_fixtures.h"
+#include "catch.hpp"
+#include <openssl/evp.h>
+#include <cstdio>
+#include <random>
+
+using namespace ePub3;
+
+#define ARCHIVE_PATH    "aes_cbc_test.epub"
+
+static const std::string k128("0123456789abcdef");
+static const std::string k256("0123456789abcdef0123456789ABCDEF");
+
+// XML-ENC ciphertext: a random IV, then the data padded to a whole number of blocks
+static std::string Encrypt(const std::string& plaintext, const std::string& key)
+{
+    std::mt19937 random(static_cast<unsigned>(plaintext.size()));
+    unsigned char iv[16];
+    for ( auto& ch : iv )
+        ch = static_cast<unsigned char>(random());
+
+    std::string result(reinterpret_cast<char*>(iv), sizeof(iv));
+    result.resize(sizeof(iv) + plaintext.size() + 16);
+
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, key.size() == 16 ? EVP_aes_128_cbc() : EVP_aes_256_cbc(), nullptr,
+                       reinterpret_cast<const unsigned char*>(key.data()), iv);
+    unsigned char* out = reinterpret_cast<unsigned char*>(&result[sizeof(iv)]);
+    int len = 0, finalLen = 0;
+    EVP_EncryptUpdate(ctx, out, &len, reinterpret_cast<const unsigned char*>(plaintext.data()), static_cast<int>(plaintext.size()));
+    EVP_EncryptFinal_ex(ctx, out + len, &finalLen);
+    EVP_CIPHER_CTX_free(ctx);
+
+    result.resize(sizeof(iv) + len + finalLen);
+    return result;
+}
+
+static std::string Media()
+{
+    std::mt19937 random(44);
+    std::string media(100003, '\0');
+    for ( auto& ch : media )
+        ch = static_cast<char>(random());
+    return media;
+}
+
+static std::string Chapter()
+{
+    return FixtureChapter("Secret");
+}
+
+static void MakeArchive()
+{
+    ZipStreamWriter writer(ARCHIVE_PATH);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("META-INF/container.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles><rootfile full-path="EPUB/package.opf" media-type="application/oebps-package+xml"/></rootfiles>
+</container>
+)X"));
+    writer.AddEntry("META-INF/encryption.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<encryption xmlns="urn:oasis:names:tc:opendocument:xmlns:container" xmlns:enc="http://www.w3.org/2001/04/xmlenc#">
+  <enc:EncryptedData><enc:EncryptionMethod Algorithm="http://www.w3.org/2001/04/xmlenc#aes128-cbc"/><enc:CipherData><enc:CipherReference URI="EPUB/media.bin"/></enc:CipherData></enc:EncryptedData>
+  <enc:EncryptedData><enc:EncryptionMethod Algorithm="http://www.w3.org/2001/04/xmlenc#aes256-cbc"/><enc:CipherData><enc:CipherReference URI="EPUB/chapter.xhtml"/></enc:CipherData></enc:EncryptedData>
+</encryption>
+)X"));
+    writer.AddEntry("EPUB/package.opf", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:test:aes-cbc</dc:identifier>
+    <dc:title>Encrypted</dc:title>
+    <dc:language>en</dc:language>
+    <meta property="dcterms:modified">2014-01-01T00:00:00Z</meta>
+  </metadata>
+  <manifest>
+    <item id="nav" href="nav.xhtml" media-type="application/xhtml+xml" properties="nav"/>
+    <item id="chapter" href="chapter.xhtml" media-type="application/xhtml+xml"/>
+    <item id="media" href="media.bin" media-type="video/mp4"/>
+  </manifest>
+  <spine><itemref idref="chapter"/></spine>
+</package>
+)X"));
+    writer.AddEntry("EPUB/nav.xhtml", std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+                    "<head><title>Contents</title></head><body><nav epub:type=\"toc\"><ol><li><a href=\"chapter.xhtml\">Chapter</a></li></ol></nav></body></html>\n"));
+    writer.AddEntry("EPUB/chapter.xhtml", Encrypt(Chapter(), k256));
+    writer.AddEntry("EPUB/media.bin", Encrypt(Media(), k128), false);
+    writer.Close();
+}
+
+static bool ProvideKey(ConstManifestItemPtr item, ByteBuffer& key)
+{
+    const std::string& value = (item->Identifier() == "media" ? k128 : k256);
+    key.AddBytes(reinterpret_cast<unsigned char*>(const_cast<char*>(value.data())), value.size());
+    return true;
+}
+
+// installs a key provider for the duration of a test, even one which fails
+struct KeyProviderScope
+{
+    KeyProviderScope(AESCBCDecryptor::KeyProviderFn provider, AESCBCDecryptor::KeyIdentityFn identity = nullptr)
+                                                                { AESCBCDecryptor::SetKeyProvider(provider, identity); }
+    ~KeyProviderScope()                                         { AESCBCDecryptor::SetKeyProvider(nullptr); }
+};
+
+TEST_CASE("AES-CBC items are decrypted by range", "")
+{
+    MakeArchive();
+    {
+        KeyProviderScope keys(ProvideKey);
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+        ManifestItemPtr item = pkg->ManifestItemWithID("media");
+        REQUIRE(pkg->GetFilterChainSize(item) == 1);
+        REQUIRE(pkg->GetFilterChainSize(pkg->ManifestItemWithID("nav")) == 0);
+
+        // filtered items can't be sent straight from the file, and nor can deflated ones
+        FileRange fileRange;
+        REQUIRE_FALSE(pkg->GetFileRange(item, fileRange));
+        REQUIRE_FALSE(pkg->GetFileRange(pkg->ManifestItemWithID("nav"), fileRange));
+
+        std::string media = Media();
+        auto stream = pkg->GetFilterChainByteStreamRange(item);
+        FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+        REQUIRE(ranged != nullptr);
+        REQUIRE(ranged->BytesAvailable() == media.size());
+
+        // block-aligned, straddling blocks, and at or past the padded end
+        uint32_t size = static_cast<uint32_t>(media.size());
+        for ( auto& r : std::vector<std::pair<uint32_t, uint32_t>>{ {0, 1}, {15, 2}, {16, 16}, {1000, 5000}, {4096, 65536}, {size-1, 1}, {size-20, 20}, {size-5, 100} } )
+        {
+            REQUIRE(ReadRange(ranged, r.first, r.second) == media.substr(r.first, r.second));
+        }
+        REQUIRE(ReadRange(ranged, size, 10).empty());
+
+        std::string whole(media.size(), '\0');
+        REQUIRE(ranged->ReadBytes(&whole[0], whole.size()) == media.size());
+        REQUIRE(whole == media);
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("AES-CBC items are decrypted through the filter chain", "")
+{
+    MakeArchive();
+    {
+        KeyProviderScope keys(ProvideKey);
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+
+        REQUIRE(ReadAll(pkg->GetFilterChainByteStream(pkg->ManifestItemWithID("chapter")).get()) == Chapter());
+        REQUIRE(ReadAll(pkg->GetFilterChainByteStream(pkg->ManifestItemWithID("media")).get()) == Media());
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("AES-CBC decryption needs a key", "")
+{
+    MakeArchive();
+    {
+        // no provider: the filter isn't installed at all
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+        REQUIRE(pkg->GetFilterChainSize(pkg->ManifestItemWithID("media")) == 0);
+
+        // so the stored bytes are served as they are
+        FileRange fileRange;
+        REQUIRE(pkg->GetFileRange(pkg->ManifestItemWithID("media"), fileRange));
+        REQUIRE(fileRange.length == Encrypt(Media(), k128).size());
+    }
+
+    // a missing key, and one of the wrong length
+    {
+        KeyProviderScope keys([](ConstManifestItemPtr item, ByteBuffer& key) {
+            if ( item->Identifier() == "media" )
+                return false;
+            key.AddBytes(reinterpret_cast<unsigned char*>(const_cast<char*>(k128.data())), k128.size());
+            return true;
+        });
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+        for ( const char* id : { "media", "chapter" } )
+        {
+            auto stream = pkg->GetFilterChainByteStreamRange(pkg->ManifestItemWithID(id));
+            FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+            REQUIRE(ranged != nullptr);
+            REQUIRE(ranged->BytesAvailable() == 0);
+            REQUIRE(ReadRange(ranged, 0, 100).empty());
+        }
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("AES-CBC plaintext is cached only for identified keys", "")
+{
+    MakeArchive();
+    auto cache = std::make_shared<ResourceCache>();
+    ResourceCache::SetShared(cache);
+    {
+        // two readers of the same title, holding the same license
+        KeyProviderScope keys(ProvideKey, [](ConstManifestItemPtr item) { return _Str("license-1#", item->Identifier()); });
+        ContainerPtr first = Container::OpenContainer(ARCHIVE_PATH);
+        ContainerPtr second = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr a = first->DefaultPackage();
+        PackagePtr b = second->DefaultPackage();
+
+        REQUIRE(ReadAll(a->GetFilterChainByteStream(a->ManifestItemWithID("chapter")).get()) == Chapter());
+        REQUIRE(ReadAll(b->GetFilterChainByteStream(b->ManifestItemWithID("chapter")).get()) == Chapter());
+
+        auto stats = cache->GetStatistics();
+        REQUIRE(stats.entries == 1);
+        REQUIRE(stats.insertions == 1);
+        REQUIRE(stats.hits == 1);
+    }
+    cache->Clear();
+    {
+        // without an identity the plaintext stays with its reader
+        KeyProviderScope keys(ProvideKey);
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+        REQUIRE(ReadAll(pkg->GetFilterChainByteStream(pkg->ManifestItemWithID("chapter")).get()) == Chapter());
+        REQUIRE(cache->GetStatistics().entries == 0);
+    }
+    ResourceCache::SetShared(nullptr);
+    std::remove(ARCHIVE_PATH);
+}
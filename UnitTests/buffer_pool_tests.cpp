@@ -0,0 +1,191 @@
+//
+//  buffer_pool_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/utilities/buffer_pool.h"
+#include "../ePub3/utilities/byte_buffer.h"
+#include "../ePub3/ePub/filter.h"
+#include "catch.hpp"
+#include <cstring>
+#include <vector>
+
+using namespace ePub3;
+
+TEST_CASE("Buffer pool rounds requests up to size classes", "")
+{
+    auto pool = std::make_shared<BufferPool>();
+
+    auto small = pool->Acquire(10);
+    REQUIRE(small.GetCapacity() == BufferPool::MinimumClassSize);
+
+    auto medium = pool->Acquire(BufferPool::MinimumClassSize + 1);
+    REQUIRE(medium.GetCapacity() == BufferPool::MinimumClassSize * 2);
+
+    auto large = pool->Acquire(BufferPool::MaximumClassSize + 1);
+    REQUIRE(large.GetCapacity() == BufferPool::MaximumClassSize + 1);
+
+    REQUIRE_FALSE(bool(pool->Acquire(0)));
+}
+
+TEST_CASE("Buffer pool reuses and erases released buffers", "")
+{
+    auto pool = std::make_shared<BufferPool>();
+
+    uint8_t* first = nullptr;
+    {
+        auto buf = pool->Acquire(100);
+        first = buf.GetBytes();
+        memset(buf.GetBytes(), 0xAB, buf.GetCapacity());
+    }
+
+    REQUIRE(pool->GetStatistics().idleBytes == BufferPool::MinimumClassSize);
+
+    auto buf = pool->Acquire(200);
+    REQUIRE(buf.GetBytes() == first);
+    for ( size_t i = 0; i < buf.GetCapacity(); i++ )
+    {
+        if ( buf.GetBytes()[i] != 0 )
+            FAIL("Recycled buffer was not erased");
+    }
+
+    auto stats = pool->GetStatistics();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.idleBytes == 0);
+}
+
+TEST_CASE("Buffer pool respects its idle limit", "")
+{
+    auto pool = std::make_shared<BufferPool>(BufferPool::MinimumClassSize);
+    {
+        auto a = pool->Acquire(1);
+        auto b = pool->Acquire(1);
+    }
+    REQUIRE(pool->GetStatistics().idleBytes == BufferPool::MinimumClassSize);
+
+    pool->Purge();
+    REQUIRE(pool->GetStatistics().idleBytes == 0);
+}
+
+static bool IsPageAligned(const void* bytes)
+{
+    return reinterpret_cast<uintptr_t>(bytes) % BufferPool::MinimumClassSize == 0;
+}
+
+TEST_CASE("Buffer pool buffers are whole pages", "")
+{
+    auto pool = std::make_shared<BufferPool>();
+    auto small = pool->Acquire(1);
+    auto large = pool->Acquire(BufferPool::MaximumClassSize + 1);
+    REQUIRE(IsPageAligned(small.GetBytes()));
+    REQUIRE(IsPageAligned(large.GetBytes()));
+
+    // locking is best-effort, but the buffer is usable either way
+    pool->SetLocksPages(true);
+    REQUIRE(pool->LocksPages());
+    auto locked = pool->Acquire(BufferPool::MinimumClassSize * 4);
+    REQUIRE(bool(locked));
+    memset(locked.GetBytes(), 0xAB, locked.GetCapacity());
+}
+
+TEST_CASE("Secure byte buffers keep their content in pooled storage", "")
+{
+    std::vector<unsigned char> content(100000);
+    for ( size_t i = 0; i < content.size(); i++ )
+        content[i] = static_cast<unsigned char>(i * 7);
+
+    // content added before the switch moves into secure storage
+    ByteBuffer buf;
+    buf.AddBytes(content.data(), 1000);
+    buf.SetUsesSecureErasure();
+    REQUIRE(buf.UsesSecureErasure());
+    REQUIRE(buf.GetBufferSize() == 1000);
+    REQUIRE(memcmp(buf.GetBytes(), content.data(), 1000) == 0);
+    REQUIRE(IsPageAligned(buf.GetBytes()));
+
+    // growing, removing and compacting keep it there
+    buf.AddBytes(content.data() + 1000, content.size() - 1000);
+    REQUIRE(buf.GetBufferSize() == content.size());
+    REQUIRE(memcmp(buf.GetBytes(), content.data(), content.size()) == 0);
+
+    buf.RemoveBytes(50000);
+    REQUIRE(memcmp(buf.GetBytes(), content.data() + 50000, 50000) == 0);
+    buf.Compact();
+    REQUIRE(buf.GetBufferSize() == 50000);
+    REQUIRE(memcmp(buf.GetBytes(), content.data() + 50000, 50000) == 0);
+    REQUIRE(IsPageAligned(buf.GetBytes()));
+
+    // copies are just as secure, moves take the storage with them
+    ByteBuffer copy(buf);
+    REQUIRE(copy.UsesSecureErasure());
+    REQUIRE(copy == buf);
+
+    ByteBuffer moved(std::move(copy));
+    REQUIRE(moved.UsesSecureErasure());
+    REQUIRE(moved == buf);
+    REQUIRE(copy.GetBufferSize() == 0);
+
+    // and content survives a switch back
+    moved.SetUsesSecureErasure(false);
+    REQUIRE_FALSE(moved.UsesSecureErasure());
+    REQUIRE(moved == buf);
+}
+
+class RecyclingFilter : public ContentFilter
+{
+public:
+    class Context : public RangeFilterContext {};
+
+    RecyclingFilter() : ContentFilter([](ConstManifestItemPtr) { return true; }) {}
+
+    virtual OperatingMode GetOperatingMode() const OVERRIDE { return OperatingMode::SupportsByteRanges; }
+    virtual void* FilterData(FilterContext* context, void* data, size_t len, size_t* outputLen) OVERRIDE
+    {
+        *outputLen = len;
+        return data;
+    }
+
+protected:
+    virtual FilterContext* InnerMakeFilterContext(ConstManifestItemPtr item) const OVERRIDE { return new Context; }
+    virtual bool ResetFilterContext(FilterContext* context) const OVERRIDE
+    {
+        dynamic_cast<Context*>(context)->ResetRangeState();
+        return true;
+    }
+};
+
+TEST_CASE("Range filter contexts are recycled and write into the caller's buffer", "")
+{
+    RecyclingFilter filter;
+
+    auto context = dynamic_cast<RangeFilterContext*>(filter.MakeFilterContext(nullptr));
+    REQUIRE(context != nullptr);
+
+    uint8_t output[64];
+    context->SetOutputBuffer(output, sizeof(output));
+    REQUIRE(context->GetOutputByteBuffer(32) == output);
+    REQUIRE(context->OwnsByteBuffer(output));
+
+    // too large for the caller's buffer: a temporary buffer is used instead
+    uint8_t* temp = context->GetOutputByteBuffer(128);
+    REQUIRE(temp != output);
+    REQUIRE(temp == context->GetCurrentTemporaryByteBuffer());
+    REQUIRE(context->OwnsByteBuffer(temp));
+
+    filter.RecycleFilterContext(context);
+    auto reused = dynamic_cast<RangeFilterContext*>(filter.MakeFilterContext(nullptr));
+    REQUIRE(reused == context);
+    REQUIRE(reused->GetOutputBuffer() == nullptr);
+    REQUIRE(reused->GetCurrentTemporaryByteBuffer() == nullptr);
+
+    filter.RecycleFilterContext(reused);
+}
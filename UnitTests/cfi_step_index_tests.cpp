@@ -0,0 +1,144 @@
+//
+//  cfi_step_index_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/cfi_step_index.h"
+#include "../ePub3/utilities/error_handler.h"
+#include "../ePub3/xml/tree/document.h"
+#include "catch.hpp"
+#include <cstring>
+
+using namespace ePub3;
+
+// the example document from epub-cfi §3.6
+static const char* kContentDoc = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<html xmlns="http://www.w3.org/1999/xhtml">
+<head><title>CFI Test</title></head>
+<body id="body01">
+<p>xxx</p>
+<p>xxx</p>
+<p>xxx</p>
+<p>xxx</p>
+<p id="para05">xxx<em>yyy</em>0123456789</p>
+<p>xxx</p>
+<p>xxx</p>
+<p><img id="svgimg" src="foo.svg" alt="an image"/></p>
+<p>xxx</p>
+<p>xxx</p>
+</body>
+</html>)X";
+
+static std::shared_ptr<xml::Document> ContentDocument()
+{
+    return xml::Wrapped<xml::Document>(xmlParseMemory(kContentDoc, (int)strlen(kContentDoc)));
+}
+
+TEST_CASE("CFI step index resolves element and character steps", "")
+{
+    auto doc = ContentDocument();
+    auto index = std::make_shared<CFIStepIndex>(doc);
+
+    auto range = index->Resolve(CFI("/4[body01]/10[para05]/3:10"));
+    REQUIRE(range.Valid());
+    REQUIRE(range.IsCollapsed());
+    REQUIRE(range.start.node->IsTextNode());
+    REQUIRE(range.start.node->Content() == "0123456789");
+    REQUIRE(range.start.characterOffset == 10);
+
+    range = index->Resolve(CFI("/4[body01]/16/2[svgimg]"));
+    REQUIRE(range.Valid());
+    REQUIRE(range.start.node->Name() == "img");
+
+    // publication-level CFIs are accepted too
+    range = index->Resolve(CFI("/6/4[chap01ref]!/4[body01]/10[para05]/2/1:1"));
+    REQUIRE(range.Valid());
+    REQUIRE(range.start.node->Content() == "yyy");
+    REQUIRE(range.start.characterOffset == 1);
+}
+
+TEST_CASE("CFI step index corrects mismatched id assertions", "")
+{
+    auto index = std::make_shared<CFIStepIndex>(ContentDocument());
+
+    // step 8 is the fourth paragraph, but the assertion identifies the fifth
+    auto range = index->Resolve(CFI("/4[body01]/8[para05]/1:0"));
+    REQUIRE(range.Valid());
+    REQUIRE(range.start.node->Content() == "xxx");
+    REQUIRE(index->CFIForLocation(range.start) == CFI("/4[body01]/10[para05]/1:0"));
+}
+
+TEST_CASE("CFI step index resolves ranges and batches", "")
+{
+    auto index = std::make_shared<CFIStepIndex>(ContentDocument());
+
+    CFIStepIndex::CFIList cfis;
+    cfis.emplace_back("/4[body01]/10[para05],/3:2,/3:5");
+    cfis.emplace_back("/4[body01]/2/1:1");
+    cfis.emplace_back("/4[body01]/10[para05]/1:0");
+
+    auto results = index->Resolve(cfis);
+    REQUIRE(results.size() == 3);
+    REQUIRE(results[0].Valid());
+    REQUIRE_FALSE(results[0].IsCollapsed());
+    REQUIRE(results[0].start.characterOffset == 2);
+    REQUIRE(results[0].end.characterOffset == 5);
+    REQUIRE(results[1].start.characterOffset == 1);
+    REQUIRE(results[2].start.node->Content() == "xxx");
+
+    // each result should match resolving the CFI on its own
+    for ( size_t i = 0; i < cfis.size(); i++ )
+    {
+        auto single = index->Resolve(cfis[i]);
+        REQUIRE(single.start.node == results[i].start.node);
+        REQUIRE(single.end.characterOffset == results[i].end.characterOffset);
+    }
+}
+
+TEST_CASE("CFI step index generates CFIs for DOM locations", "")
+{
+    auto index = std::make_shared<CFIStepIndex>(ContentDocument());
+
+    auto location = index->Resolve(CFI("/4[body01]/10[para05]/3:4")).start;
+    REQUIRE(location.Valid());
+    REQUIRE(index->CFIForLocation(location) == "epubcfi(/4[body01]/10[para05]/3:4)");
+
+    auto end = index->Resolve(CFI("/4[body01]/12/1:2")).start;
+    CFI range = index->CFIForRange(location, end);
+    REQUIRE(range.IsRangeTriplet());
+    REQUIRE(range == "epubcfi(/4[body01],/10[para05]/3:4,/12/1:2)");
+
+    auto check = index->Resolve(range);
+    REQUIRE(check.start.node == location.node);
+    REQUIRE(check.end.node == end.node);
+}
+
+TEST_CASE("CFI step index reports out-of-bounds steps", "")
+{
+    auto index = std::make_shared<CFIStepIndex>(ContentDocument());
+    REQUIRE_THROWS_AS(index->Resolve(CFI("/4[body01]/40")), epub_spec_error);
+
+    REQUIRE_THROWS_AS(index->Resolve(CFI("/4[body01]/10[para05]/41:0")), epub_spec_error);
+
+    // in a batch, only the stale CFI fails
+    CFIStepIndex::CFIList cfis;
+    cfis.emplace_back("/4[body01]/10[para05]/3:2");
+    cfis.emplace_back("/4[body01]/10[para05]/41:0");
+    cfis.emplace_back("/4[body01]/10[para05]/1:0");
+
+    CFIStepIndex::RangeList results;
+    REQUIRE_NOTHROW(results = index->Resolve(cfis));
+    REQUIRE(results.size() == 3);
+    REQUIRE(results[0].Valid());
+    REQUIRE_FALSE(results[1].Valid());
+    REQUIRE_FALSE(results[1].start.Valid());
+    REQUIRE(results[2].start.node->Content() == "xxx");
+}
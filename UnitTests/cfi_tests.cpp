@@ -27,6 +27,8 @@ TEST_CASE("CFIs should be constructable from valid strings", "")
     REQUIRE_NOTHROW(CFI("/6/4[chap01]!/4/52/3:22"));
     REQUIRE_NOTHROW(CFI("/6/4[chap01]!/4/52,/3:22,/5:12"));
     REQUIRE_NOTHROW(CFI("epubcfi(/6/4[chap01]!/4/52,/3:22,/5:12)"));
+    REQUIRE_NOTHROW(CFI("epubcfi(/6/4[chap01]!/4,/2/5:0,/4/1:3)"));     // only the first differing step is ordered
+    REQUIRE_NOTHROW(CFI("epubcfi(/6/4[chap01]!/4,/2/5:0,/4:3)"));
     REQUIRE_NOTHROW(CFI(u8"epubcfi(/6/16[夏目漱石]!)"));        // utf-8
     REQUIRE_NOTHROW(CFI(u"epubcfi(/6/16[夏目漱石]!)"));         // utf-16
     REQUIRE_NOTHROW(CFI(U"epubcfi(/6/16[夏目漱石]!)"));         // utf-32
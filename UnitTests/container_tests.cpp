@@ -14,7 +14,9 @@
 
 
 #include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
 #include "catch.hpp"
+#include <thread>
 
 using namespace ePub3;
 
@@ -43,3 +45,67 @@ TEST_CASE("", "Version should be 1.0")
     ContainerPtr container = Container::OpenContainer(EPUB_PATH);
     REQUIRE(container->Version() == "1.0");
 }
+
+TEST_CASE("Probing a container reads its metadata without opening it", "")
+{
+    PublicationSummary summary = Container::ProbeMetadata(EPUB_PATH);
+    REQUIRE(summary.packagePath == "EPUB/package.opf");
+    REQUIRE(summary.version == "3.0");
+    REQUIRE(summary.title == "Children's Literature");
+    REQUIRE(summary.authors.size() == 2);
+    REQUIRE(summary.authors[0] == "Charles Madison Curry");
+    REQUIRE(summary.language == "en");
+    REQUIRE(summary.modificationDate == "2010-02-17T04:39:13Z");
+    REQUIRE(summary.coverImagePath == "EPUB/images/cover.png");
+    
+    // an EPUB 2 cover
+    summary = Container::ProbeMetadata("TestData/dante-hell.epub");
+    REQUIRE(summary.version == "2.0");
+    REQUIRE(summary.coverImagePath.find("cover.jpg") != string::npos);
+    
+    REQUIRE_THROWS_AS(Container::ProbeMetadata("TestData/no-such-book.epub"), std::invalid_argument);
+}
+
+TEST_CASE("Probed metadata matches the opened package", "")
+{
+    for ( const char* path : { EPUB_PATH, "TestData/cole-voyage-of-life-20120320.epub", "TestData/moby-dick-preview-collection.epub",
+                               "TestData/page-blanche.epub", "TestData/wasteland-otf-obf-20120118.epub" } )
+    {
+        CAPTURE(path);
+        PublicationSummary summary = Container::ProbeMetadata(path);
+        PackagePtr pkg = Container::OpenContainer(path)->DefaultPackage();
+        
+        REQUIRE(summary.title == pkg->Title(false));
+        REQUIRE(summary.authors == pkg->AuthorNames(false));
+        REQUIRE(summary.language == pkg->Language());
+        REQUIRE(summary.modificationDate == pkg->ModificationDate());
+        REQUIRE(summary.UniqueID() == pkg->UniqueID());
+        
+        ManifestItemPtr cover;
+        for ( auto& entry : pkg->Manifest() )
+        {
+            if ( entry.second->HasProperty(ItemProperties::CoverImage) )
+                cover = entry.second;
+        }
+        if ( bool(cover) )
+            REQUIRE(summary.coverImagePath == cover->AbsolutePath());
+    }
+}
+
+TEST_CASE("Containers can be probed on several threads at once", "")
+{
+    std::vector<std::thread> threads;
+    std::vector<string> titles(4);
+    for ( size_t i = 0; i < titles.size(); i++ )
+    {
+        threads.emplace_back([&titles, i]() {
+            for ( int n = 0; n < 8; n++ )
+                titles[i] = Container::ProbeMetadata(EPUB_PATH).title;
+        });
+    }
+    for ( auto& thread : threads )
+        thread.join();
+    
+    for ( auto& title : titles )
+        REQUIRE(title == "Children's Literature");
+}
@@ -0,0 +1,240 @@
+//
+//  deflate_decompression_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#include "../ePub3/ePub/aes_cbc_decryption.h"
+#include "../ePub3/ePub/deflate_decompression.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/filter_chain_byte_stream_range.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "filter_fixtures.h"
+#include "catch.hpp"
+#include <openssl/evp.h>
+#include <zlib.h>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace ePub3;
+
+#define ARCHIVE_PATH    "deflate_test.epub"
+
+static const std::string kKey("0123456789abcdef0123456789ABCDEF");
+
+// raw deflate data, as OCF requires
+static std::string Deflate(const std::string& data)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    
+    std::string result(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+    stream.avail_out = static_cast<uInt>(result.size());
+    deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result;
+}
+
+static std::string Encrypt(const std::string& plaintext)
+{
+    unsigned char iv[16] = { 4, 5 };
+    std::string result(reinterpret_cast<char*>(iv), sizeof(iv));
+    result.resize(sizeof(iv) + plaintext.size() + 16);
+
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, reinterpret_cast<const unsigned char*>(kKey.data()), iv);
+    unsigned char* out = reinterpret_cast<unsigned char*>(&result[sizeof(iv)]);
+    int len = 0, finalLen = 0;
+    EVP_EncryptUpdate(ctx, out, &len, reinterpret_cast<const unsigned char*>(plaintext.data()), static_cast<int>(plaintext.size()));
+    EVP_EncryptFinal_ex(ctx, out + len, &finalLen);
+    EVP_CIPHER_CTX_free(ctx);
+
+    result.resize(sizeof(iv) + len + finalLen);
+    return result;
+}
+
+// compressible, but not trivially so, and long enough for several checkpoints
+static std::string Media()
+{
+    static const char* words[] = { "lorem ", "ipsum ", "dolor ", "sit ", "amet, ", "consectetur ", "adipiscing ", "elit. " };
+    std::mt19937 random(45);
+    std::string media;
+    while ( media.size() < 3*DeflateDecompressor::CheckpointSpacing + 1234 )
+    {
+        media += words[random() % 8];
+        if ( random() % 16 == 0 )
+            media += char(random());
+    }
+    return media;
+}
+
+static std::string Chapter()
+{
+    return FixtureChapter("Squeezed");
+}
+
+static void MakeArchive()
+{
+    ZipStreamWriter writer(ARCHIVE_PATH);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("META-INF/container.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles><rootfile full-path="EPUB/package.opf" media-type="application/oebps-package+xml"/></rootfiles>
+</container>
+)X"));
+    // the chapter doesn't give its original length
+    writer.AddEntry("META-INF/encryption.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<encryption xmlns="urn:oasis:names:tc:opendocument:xmlns:container" xmlns:enc="http://www.w3.org/2001/04/xmlenc#" xmlns:comp="http://www.idpf.org/2016/encryption#compression">
+  <enc:EncryptedData><enc:EncryptionMethod Algorithm="http://www.w3.org/2001/04/xmlenc#aes256-cbc"/><enc:CipherData><enc:CipherReference URI="EPUB/media.txt"/></enc:CipherData>
+    <enc:EncryptionProperties><enc:EncryptionProperty><comp:Compression Method="8" OriginalLength=")X") + std::to_string(Media().size()) + R"X("/></enc:EncryptionProperty></enc:EncryptionProperties></enc:EncryptedData>
+  <enc:EncryptedData><enc:EncryptionMethod Algorithm="http://www.w3.org/2001/04/xmlenc#aes256-cbc"/><enc:CipherData><enc:CipherReference URI="EPUB/chapter.xhtml"/></enc:CipherData>
+    <enc:EncryptionProperties><enc:EncryptionProperty><comp:Compression Method="8"/></enc:EncryptionProperty></enc:EncryptionProperties></enc:EncryptedData>
+</encryption>
+)X");
+    writer.AddEntry("EPUB/package.opf", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:test:deflate</dc:identifier>
+    <dc:title>Compressed</dc:title>
+    <dc:language>en</dc:language>
+    <meta property="dcterms:modified">2014-01-01T00:00:00Z</meta>
+  </metadata>
+  <manifest>
+    <item id="nav" href="nav.xhtml" media-type="application/xhtml+xml" properties="nav"/>
+    <item id="chapter" href="chapter.xhtml" media-type="application/xhtml+xml"/>
+    <item id="media" href="media.txt" media-type="text/plain"/>
+  </manifest>
+  <spine><itemref idref="chapter"/></spine>
+</package>
+)X"));
+    writer.AddEntry("EPUB/nav.xhtml", std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+                    "<head><title>Contents</title></head><body><nav epub:type=\"toc\"><ol><li><a href=\"chapter.xhtml\">Chapter</a></li></ol></nav></body></html>\n"));
+    writer.AddEntry("EPUB/chapter.xhtml", Encrypt(Deflate(Chapter())), false);
+    writer.AddEntry("EPUB/media.txt", Encrypt(Deflate(Media())), false);
+    writer.Close();
+}
+
+// installs a key provider for the duration of a test, even one which fails
+struct KeyProviderScope
+{
+    KeyProviderScope()
+    {
+        AESCBCDecryptor::SetKeyProvider([](ConstManifestItemPtr, ByteBuffer& key) {
+            key.AddBytes(reinterpret_cast<unsigned char*>(const_cast<char*>(kKey.data())), kKey.size());
+            return true;
+        });
+    }
+    ~KeyProviderScope()
+    {
+        AESCBCDecryptor::SetKeyProvider(nullptr);
+    }
+};
+
+TEST_CASE("Encryption info includes compression properties", "")
+{
+    MakeArchive();
+    {
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+        
+        EncryptionInfoPtr media = pkg->ManifestItemWithID("media")->GetEncryptionInfo();
+        REQUIRE(media != nullptr);
+        REQUIRE(media->CompressionMethod() == EncryptionInfo::DeflateCompression);
+        REQUIRE(media->OriginalLength() == Media().size());
+        
+        EncryptionInfoPtr chapter = pkg->ManifestItemWithID("chapter")->GetEncryptionInfo();
+        REQUIRE(chapter != nullptr);
+        REQUIRE(chapter->CompressionMethod() == EncryptionInfo::DeflateCompression);
+        REQUIRE(chapter->OriginalLength() == 0);
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Compressed items are inflated by range after decryption", "")
+{
+    MakeArchive();
+    {
+        KeyProviderScope keys;
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+        ManifestItemPtr item = pkg->ManifestItemWithID("media");
+        REQUIRE(pkg->GetFilterChainSize(item) == 2);
+
+        std::string media = Media();
+        auto stream = pkg->GetFilterChainByteStreamRange(item);
+        FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+        REQUIRE(ranged != nullptr);
+        REQUIRE(ranged->BytesAvailable() == media.size());
+
+        // forwards past several checkpoints, then back again
+        uint32_t size = static_cast<uint32_t>(media.size());
+        for ( auto& r : std::vector<std::pair<uint32_t, uint32_t>>{ {0, 1}, {1000, 5000}, {3000000, 65536}, {size-20, 20}, {1500000, 100}, {10, 10}, {size-5, 100} } )
+        {
+            REQUIRE(ReadRange(ranged, r.first, r.second) == media.substr(r.first, r.second));
+        }
+        REQUIRE(ReadRange(ranged, size, 10).empty());
+
+        std::string whole(media.size(), '\0');
+        REQUIRE(ranged->ReadBytes(&whole[0], whole.size()) == media.size());
+        REQUIRE(whole == media);
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Compressed items are inflated through the filter chain", "")
+{
+    MakeArchive();
+    {
+        KeyProviderScope keys;
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+
+        REQUIRE(ReadAll(pkg->GetFilterChainByteStream(pkg->ManifestItemWithID("chapter")).get()) == Chapter());
+        REQUIRE(ReadAll(pkg->GetFilterChainByteStream(pkg->ManifestItemWithID("media")).get()) == Media());
+
+        // without an original length, inflating once finds it
+        auto stream = pkg->GetFilterChainByteStreamRange(pkg->ManifestItemWithID("chapter"));
+        FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+        REQUIRE(ranged != nullptr);
+        REQUIRE(ranged->BytesAvailable() == Chapter().size());
+        REQUIRE(ReadRange(ranged, 100, 50) == Chapter().substr(100, 50));
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Malformed compressed data produces nothing", "")
+{
+    MakeArchive();
+    {
+        // the wrong key decrypts to garbage, which won't inflate
+        KeyProviderScope keys;
+        AESCBCDecryptor::SetKeyProvider([](ConstManifestItemPtr, ByteBuffer& key) {
+            std::string wrong(kKey.rbegin(), kKey.rend());
+            key.AddBytes(reinterpret_cast<unsigned char*>(&wrong[0]), wrong.size());
+            return true;
+        });
+        ContainerPtr c = Container::OpenContainer(ARCHIVE_PATH);
+        PackagePtr pkg = c->DefaultPackage();
+
+        auto stream = pkg->GetFilterChainByteStreamRange(pkg->ManifestItemWithID("chapter"));
+        FilterChainByteStreamRange* ranged = dynamic_cast<FilterChainByteStreamRange*>(stream.get());
+        REQUIRE(ranged != nullptr);
+        REQUIRE(ranged->BytesAvailable() == 0);
+        REQUIRE(ReadRange(ranged, 0, 100).empty());
+        REQUIRE(ReadAll(pkg->GetFilterChainByteStream(pkg->ManifestItemWithID("media")).get()).empty());
+    }
+    std::remove(ARCHIVE_PATH);
+}
@@ -0,0 +1,174 @@
+//
+//  document_preloader_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/document_preloader.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/nav_table.h"
+#include "../ePub3/ePub/nav_point.h"
+#include "../ePub3/xml/tree/element.h"
+#include "catch.hpp"
+#include <cstdio>
+#include <sstream>
+
+using namespace ePub3;
+
+#define ARCHIVE_PATH    "document_preloader_test.zip"
+
+static const char* kSMIL = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<smil xmlns="http://www.w3.org/ns/SMIL" version="3.0">
+  <body>
+    <par id="p1"><text src="chapter.xhtml#s1"/><audio src="audio.mp4" clipBegin="0s" clipEnd="2s"/></par>
+  </body>
+</smil>
+)X";
+
+static void MakeArchive()
+{
+    ZipStreamWriter writer(ARCHIVE_PATH);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("text.txt", std::string(100000, 'x'));
+    writer.AddEntry("overlay.smil", kSMIL, strlen(kSMIL));
+    writer.AddEntry("broken.xml", std::string("not xml at all"));
+    writer.Close();
+}
+
+static std::string ReadAll(ArchiveReader* reader)
+{
+    std::string result;
+    char buf[4096];
+    ssize_t num = 0;
+    while ( (num = reader->read(buf, sizeof(buf))) > 0 )
+        result.append(buf, static_cast<size_t>(num));
+    return result;
+}
+
+TEST_CASE("Preloaded entries can be taken once", "")
+{
+    MakeArchive();
+    {
+        DocumentPreloader preloader(ARCHIVE_PATH);
+        preloader.Preload("text.txt");
+        preloader.Preload("text.txt");
+        preloader.Preload("missing.txt");
+        REQUIRE(preloader.ScheduledCount() == 2);
+
+        auto reader = preloader.TakeReader("text.txt");
+        REQUIRE(bool(reader));
+        REQUIRE(reader->total_size() == 100000);
+        REQUIRE(ReadAll(reader.get()) == std::string(100000, 'x'));
+
+        REQUIRE_FALSE(bool(preloader.TakeReader("text.txt")));
+        REQUIRE_FALSE(bool(preloader.TakeReader("missing.txt")));
+        REQUIRE_FALSE(bool(preloader.TakeReader("mimetype")));
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Preloaded documents are parsed in the background", "")
+{
+    MakeArchive();
+    {
+        DocumentPreloader::Options options;
+        options.threadCount = 2;
+        DocumentPreloader preloader(ARCHIVE_PATH, options);
+        preloader.PreloadDocument("overlay.smil");
+        preloader.PreloadDocument("broken.xml");
+
+        auto doc = preloader.TakeDocument("overlay.smil");
+        REQUIRE(bool(doc));
+        REQUIRE(doc->Root()->Name() == "smil");
+        REQUIRE_FALSE(bool(preloader.TakeDocument("overlay.smil")));
+
+        // parsed in recovery mode, as ReferencedDocument() would; never available as bytes
+        preloader.TakeDocument("broken.xml");
+        REQUIRE_FALSE(bool(preloader.TakeReader("broken.xml")));
+        REQUIRE_FALSE(bool(preloader.TakeReader("overlay.smil")));
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Preloaders can be destroyed with work outstanding", "")
+{
+    MakeArchive();
+    for ( int i = 0; i < 20; i++ )
+    {
+        DocumentPreloader preloader(ARCHIVE_PATH);
+        preloader.Preload("text.txt");
+        preloader.PreloadDocument("overlay.smil");
+        preloader.PreloadDocument("broken.xml");
+    }
+    {
+        DocumentPreloader preloader("no such archive.zip");
+        preloader.Preload("text.txt");
+        preloader.PreloadDocument("overlay.smil");
+        REQUIRE_FALSE(bool(preloader.TakeReader("text.txt")));
+        REQUIRE_FALSE(bool(preloader.TakeDocument("overlay.smil")));
+    }
+    std::remove(ARCHIVE_PATH);
+}
+
+// the parts of a publication loaded from preloaded documents
+static std::string Summary(ContainerPtr container)
+{
+    std::ostringstream ss;
+    for ( auto& enc : container->EncryptionData() )
+        ss << "enc " << enc->Path() << ' ' << enc->Algorithm() << '\n';
+
+    for ( auto& package : container->Packages() )
+    {
+        ss << "package " << package->PackageID() << ' ' << package->UniqueID() << ' ' << package->Manifest().size() << '\n';
+        for ( auto item = package->FirstSpineItem(); bool(item); item = item->Next() )
+            ss << "spine " << item->Idref() << ' ' << item->Title() << '\n';
+        for ( auto& pair : package->NavigationTables() )
+        {
+            ss << "nav " << pair.first << ' ' << pair.second->Title() << '\n';
+            std::function<void(const NavigationList&, int)> dump = [&](const NavigationList& list, int level) {
+                for ( auto& elem : list )
+                {
+                    auto point = std::dynamic_pointer_cast<NavigationPoint>(elem);
+                    ss << std::string(level, ' ') << elem->Title() << " -> " << (point ? point->Content() : string()) << '\n';
+                    dump(elem->Children(), level + 1);
+                }
+            };
+            dump(pair.second->Children(), 1);
+        }
+    }
+    return ss.str();
+}
+
+static const char* kTestBooks[] = {
+    "TestData/childrens-literature-20120722.epub",
+    "TestData/cole-voyage-of-life-20120320.epub",
+    "TestData/dante-hell.epub",
+    "TestData/moby-dick-preview-collection.epub",
+    "TestData/page-blanche.epub",
+    "TestData/wasteland-otf-obf-20120118.epub",
+    "TestData/widget-figure-gallery-20121022.epub",
+};
+
+TEST_CASE("Preloading opens the same publications", "")
+{
+    for ( auto path : kTestBooks )
+    {
+        DocumentPreloader::SetEnabled(false);
+        std::string sequential = Summary(Container::OpenContainer(path));
+        DocumentPreloader::SetEnabled(true);
+        std::string preloaded = Summary(Container::OpenContainer(path));
+
+        INFO(path);
+        REQUIRE(preloaded.size() > 0);
+        REQUIRE(preloaded == sequential);
+    }
+}
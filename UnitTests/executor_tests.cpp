@@ -16,8 +16,10 @@
 #include <vector>
 #include <set>
 #include <future>
-#include <CoreFoundation/CFRunLoop.h>
 #include "../ePub3/utilities/executor.h"
+#if EPUB_PLATFORM(MAC)
+#include <CoreFoundation/CFRunLoop.h>
+#endif
 #include "catch.hpp"
 
 using namespace EPUB3_NAMESPACE;
@@ -321,6 +323,7 @@ TEST_CASE("thread_executor reaping", "thread_executor should reap all in-flight
     REQUIRE(itRan == true);
 }
 
+#if EPUB_PLATFORM(MAC)
 TEST_CASE("main_thread_executor", "main_thread_executor should run code exclusively on the application's main thread")
 {
     std::shared_ptr<executor> main_exec = main_thread_executor();
@@ -378,3 +381,4 @@ TEST_CASE("main_thread_executor", "main_thread_executor should run code exclusiv
     REQUIRE(one_ref == CFRunLoopGetMain());
     REQUIRE(two_ref == CFRunLoopGetMain());
 }
+#endif
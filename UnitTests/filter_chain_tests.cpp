@@ -311,4 +311,47 @@ TEST_CASE("Font de-obfuscation happens automatically", "")
     REQUIRE(filteredBuffer == rawBuf);
 }
 */
+
+TEST_CASE("Async filtered streams match the synchronous filter chain", "")
+{
+    ContainerPtr c = Container::OpenContainer(FONT_EPUB_PATH);
+    PackagePtr pkg = c->DefaultPackage();
+    ManifestItemPtr item = pkg->ManifestItemWithID(FONT_MANIFEST_ID);
+    REQUIRE(pkg->GetFilterChainSize(item) == 1);
+    
+    ByteBuffer expected;
+    auto syncStream = pkg->GetFilterChainByteStream(item);
+    uint8_t buf[4096];
+    ByteStream::size_type numRead = 0;
+    while ( (numRead = syncStream->ReadBytes(buf, sizeof(buf))) > 0 )
+        expected.AddBytes(buf, numRead);
+    
+    // read a little at a time, so the stream's buffer is never empty when its input ends
+    ByteBuffer output;
+    auto asyncStream = pkg->ContentStreamForItem(item);
+    REQUIRE(bool(asyncStream));
+    RunLoopPtr runloop = RunLoop::CurrentRunLoop();
+    asyncStream->SetEventHandler([&](AsyncEvent evt, AsyncByteStream* stream) {
+        switch ( evt )
+        {
+            case AsyncEvent::HasBytesAvailable:
+            {
+                uint8_t chunk[1000];
+                output.AddBytes(chunk, stream->ReadBytes(chunk, sizeof(chunk)));
+                break;
+            }
+            case AsyncEvent::ErrorOccurred:
+            case AsyncEvent::EndEncountered:
+                runloop->Stop();
+                break;
+            default:
+                break;
+        }
+    });
+    asyncStream->SetTargetRunLoop(runloop);
+    runloop->Run();
+    
+    REQUIRE(output.GetBufferSize() == expected.GetBufferSize());
+    REQUIRE(output == expected);
+}
 #endif /* SUPPORT_ASYNC */
@@ -0,0 +1,56 @@
+//
+//  filter_fixtures.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+#ifndef __ePub3__filter_fixtures__
+#define __ePub3__filter_fixtures__
+
+#include "../ePub3/ePub/filter_chain_byte_stream_range.h"
+#include "../ePub3/utilities/byte_stream.h"
+#include <string>
+
+///
+/// A compressible XHTML chapter, for the encrypted or compressed items of a test book.
+inline std::string FixtureChapter(const std::string& title)
+{
+    std::string chapter("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>");
+    chapter.append(title).append("</title></head><body>");
+    for ( int i = 0; i < 500; i++ )
+        chapter.append("<p>The voyage of life.</p>");
+    chapter.append("</body></html>\n");
+    return chapter;
+}
+
+///
+/// Reads a stream to its end, through whatever filters it applies.
+inline std::string ReadAll(ePub3::ByteStream* stream)
+{
+    std::string result;
+    char buf[4096];
+    ePub3::ByteStream::size_type num = 0;
+    while ( (num = stream->ReadBytes(buf, sizeof(buf))) > 0 )
+        result.append(buf, num);
+    return result;
+}
+
+///
+/// Reads `length` bytes of a filtered item from `location`.
+inline std::string ReadRange(ePub3::FilterChainByteStreamRange* stream, uint32_t location, uint32_t length)
+{
+    std::string result(length, '\0');
+    ePub3::ByteRange range;
+    range.Location(location);
+    range.Length(length);
+    result.resize(stream->ReadBytes(&result[0], length, range));
+    return result;
+}
+
+#endif /* defined(__ePub3__filter_fixtures__) */
@@ -325,3 +325,122 @@ TEST_CASE("future::then(async) chain", "[future][async]")
     REQUIRE(output == true);
     REQUIRE(firstExit < secondEnter);
 }
+
+TEST_CASE("future::then(executor) on a ready future", "A continuation on a ready future should go straight to the executor")
+{
+    inline_executor exec;
+    bool ran = false;
+    
+    auto endFuture = make_ready_future(21).then(exec, [&](future<int> f) -> int {
+        ran = true;
+        return f.get() * 2;
+    });
+    
+    REQUIRE(ran == true);
+    REQUIRE(endFuture.is_ready());
+    REQUIRE(endFuture.get() == 42);
+}
+
+TEST_CASE("shared_future continuations", "Every continuation attached to a shared_future should run")
+{
+    inline_executor exec;
+    promise<int> aPromise;
+    shared_future<int> shared(aPromise.get_future());
+    
+    auto first = shared.then(exec, [](shared_future<int> f) { return f.get() + 1; });
+    auto second = shared.then(exec, [](shared_future<int> f) { return f.get() + 2; });
+    
+    aPromise.set_value(1);
+    
+    REQUIRE(first.get() == 2);
+    REQUIRE(second.get() == 3);
+}
+
+TEST_CASE("deferred shared_future continuations", "Running a deferred continuation should leave the others attached")
+{
+    inline_executor exec;
+    promise<int> aPromise;
+    shared_future<int> shared(aPromise.get_future());
+    
+    auto first = shared.then(exec, [](shared_future<int> f) { return f.get() + 1; });
+    std::atomic<int> deferredRuns(0);
+    auto second = shared.then(launch::deferred, [&](shared_future<int> f) { deferredRuns++; return f.get() + 2; });
+    
+    std::thread setter([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        aPromise.set_value(1);
+    });
+    
+    // runs the deferred continuation here, which waits for the value
+    REQUIRE(second.get() == 3);
+    setter.join();
+    
+    REQUIRE(first.wait_for(std::chrono::seconds(2)) == future_status::ready);
+    REQUIRE(first.get() == 2);
+    REQUIRE(deferredRuns == 1);
+}
+
+TEST_CASE("when_all over a range", "when_all() should become ready once every future in a range has")
+{
+    std::vector<promise<int>> promises(16);
+    std::vector<future<int>> futures;
+    for (auto& p : promises)
+        futures.push_back(p.get_future());
+    
+    auto all = when_all(futures.begin(), futures.end());
+    REQUIRE(all.is_ready() == false);
+    
+    std::thread setter([&]() {
+        for (size_t i = 0; i < promises.size(); i++)
+            promises[i].set_value(int(i));
+    });
+    
+    std::vector<future<int>> results = all.get();
+    setter.join();
+    REQUIRE(results.size() == promises.size());
+    for (size_t i = 0; i < results.size(); i++)
+        REQUIRE(results[i].get() == int(i));
+    
+    std::vector<future<int>> none;
+    REQUIRE(when_all(none.begin(), none.end()).get().empty());
+}
+
+TEST_CASE("when_all with arguments", "when_all() should accept futures and shared_futures of different types")
+{
+    promise<std::string> stringPromise;
+    shared_future<std::string> shared(stringPromise.get_future());
+    
+    auto all = when_all(make_ready_future(1), shared, make_ready_future<int>(std::make_exception_ptr(std::runtime_error("oops"))));
+    stringPromise.set_value("Hello");
+    
+    auto results = all.get();
+    REQUIRE(std::get<0>(results).get() == 1);
+    REQUIRE(std::get<1>(results).get() == "Hello");
+    REQUIRE(std::get<2>(results).has_exception());
+    REQUIRE_THROWS_AS(std::get<2>(results).get(), std::runtime_error);
+}
+
+TEST_CASE("when_any", "when_any() should become ready with the index of the first future to do so")
+{
+    promise<int> first, second;
+    std::vector<future<int>> futures;
+    futures.push_back(first.get_future());
+    futures.push_back(second.get_future());
+    
+    auto any = when_any(futures.begin(), futures.end());
+    REQUIRE(any.is_ready() == false);
+    
+    second.set_value(2);
+    
+    auto result = any.get();
+    REQUIRE(result.index == 1);
+    REQUIRE(result.futures[1].get() == 2);
+    
+    // the other future still works
+    first.set_value(1);
+    REQUIRE(result.futures[0].get() == 1);
+    
+    auto tupled = when_any(async(launch::deferred, []() { return 3; }), make_ready_future(std::string("four"))).get();
+    REQUIRE(tupled.index == 0);
+    REQUIRE(std::get<0>(tupled.futures).get() == 3);
+}
@@ -0,0 +1,165 @@
+//
+//  glossary_index_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/glossary.h"
+#include "../ePub3/ePub/glossary_index.h"
+#include "catch.hpp"
+#include <cstdio>
+#include <thread>
+
+using namespace ePub3;
+
+#define INDEX_PATH      "glossary_index_test.idx"
+
+static std::vector<string> TermsOf(const GlossaryIndex::MatchList& matches)
+{
+    std::vector<string> result;
+    for ( auto& match : matches )
+        result.push_back(match.term);
+    return result;
+}
+
+static GlossaryIndexPtr TestIndex()
+{
+    std::vector<string> terms = { "apple", "Apply", "application", "banana", "Résumé", "resume", "Straße", "ΣΟΦΙΑ", "zebra", "apple" };
+    return GlossaryIndex::Build(terms);
+}
+
+TEST_CASE("Glossary keys ignore case and accents", "")
+{
+    REQUIRE(GlossaryIndex::FoldedKey("Élan") == "elan");
+    REQUIRE(GlossaryIndex::FoldedKey("STRASSE") == GlossaryIndex::FoldedKey("Straße"));
+    REQUIRE(GlossaryIndex::FoldedKey("Æsop") == "aesop");
+    REQUIRE(GlossaryIndex::FoldedKey("Łódź") == "lodz");
+    // decomposed: e + combining acute
+    REQUIRE(GlossaryIndex::FoldedKey("e\xCC\x81t\xC3\xA9") == "ete");
+    REQUIRE(GlossaryIndex::FoldedKey("ΣΟΦΊΑ") == "σοφια");
+    REQUIRE(GlossaryIndex::FoldedKey("σοφίας") == "σοφιασ");
+    REQUIRE(GlossaryIndex::FoldedKey("МОСКВА") == "москва");
+    REQUIRE(GlossaryIndex::FoldedKey("日本") == "日本");
+}
+
+TEST_CASE("Glossary index finds terms by prefix", "")
+{
+    auto index = TestIndex();
+    REQUIRE(index->Count() == 9);
+
+    auto terms = TermsOf(index->WithPrefix("APP"));
+    REQUIRE(terms.size() == 3);
+    REQUIRE(terms[0] == "apple");
+    REQUIRE(terms[1] == "application");
+    REQUIRE(terms[2] == "Apply");
+
+    REQUIRE(index->WithPrefix("app", 2).size() == 2);
+    REQUIRE(index->WithPrefix("resu").size() == 2);
+    REQUIRE(index->WithPrefix("σοφ").size() == 1);
+    REQUIRE(index->WithPrefix("q").empty());
+    REQUIRE(index->WithPrefix("").size() == 9);
+
+    auto exact = TermsOf(index->Find("RESUME"));
+    REQUIRE(exact.size() == 2);
+    REQUIRE(exact[0] == "Résumé");
+    REQUIRE(exact[1] == "resume");
+}
+
+TEST_CASE("Glossary index finds terms within an edit distance", "")
+{
+    auto index = TestIndex();
+
+    auto matches = index->WithinDistance("aple", 1);
+    REQUIRE(matches.size() == 1);
+    REQUIRE(matches[0].term == "apple");
+    REQUIRE(matches[0].distance == 1);
+
+    matches = index->WithinDistance("aple", 2);
+    REQUIRE(matches.size() == 2);
+    REQUIRE(matches[1].term == "Apply");
+    REQUIRE(matches[1].distance == 2);
+
+    matches = index->WithinDistance("bananna", 1);
+    REQUIRE(matches.size() == 1);
+    REQUIRE(matches[0].term == "banana");
+
+    // closest first
+    matches = index->WithinDistance("applx", 2);
+    REQUIRE(matches.size() == 2);
+    REQUIRE(matches[0].distance == 1);
+    REQUIRE(matches[1].distance == 1);
+
+    REQUIRE(index->WithinDistance("apple", 0).size() == 1);
+    REQUIRE(index->WithinDistance("xylophone", 2).empty());
+    REQUIRE(index->WithinDistance("strase", 1).size() == 1);
+    REQUIRE(index->WithinDistance("aple", 1, 1).size() == 1);
+}
+
+TEST_CASE("Glossary index survives serialization", "")
+{
+    auto index = TestIndex();
+    REQUIRE(index->WriteToFile(INDEX_PATH));
+
+    auto mapped = GlossaryIndex::MapFile(INDEX_PATH);
+    REQUIRE(mapped != nullptr);
+    REQUIRE(mapped->ByteCount() == index->ByteCount());
+    REQUIRE(mapped->Count() == index->Count());
+    REQUIRE(TermsOf(mapped->WithPrefix("app")) == TermsOf(index->WithPrefix("app")));
+    REQUIRE(mapped->WithinDistance("bananna", 1).size() == 1);
+    remove(INDEX_PATH);
+
+    std::vector<uint8_t> bytes(index->Bytes(), index->Bytes() + index->ByteCount());
+    bytes.resize(bytes.size() - 1);
+    REQUIRE(GlossaryIndex::FromBytes(std::move(bytes)) == nullptr);
+    REQUIRE(GlossaryIndex::FromBytes(std::vector<uint8_t>(64, 0)) == nullptr);
+    REQUIRE(GlossaryIndex::MapFile("no-such-index.idx") == nullptr);
+}
+
+TEST_CASE("Glossary completions and suggestions", "")
+{
+    Glossary glossary("Terms", nullptr);
+    glossary.AddDefinition("Éclair", "A pastry.");
+    glossary.AddDefinition("eclipse", "An obscuring of light.");
+    glossary.AddDefinition("ΣΟΦΙΑ", "Wisdom.");
+
+    REQUIRE(glossary.CompletionsForString("ECL").size() == 2);
+    REQUIRE(glossary.FirstCompletionForString("ecl") == "Éclair");
+    REQUIRE(glossary.FirstCompletionForString("x").empty());
+
+    auto suggestions = glossary.SuggestionsForString("eclips", 1);
+    REQUIRE(suggestions.size() == 1);
+    REQUIRE(suggestions[0] == "eclipse");
+
+    // the index is rebuilt when the glossary changes
+    glossary.AddDefinition("ecliptic", "The path of the sun.");
+    REQUIRE(glossary.CompletionsForString("ecl").size() == 3);
+
+    // exact lookups fold case beyond ASCII
+    REQUIRE(glossary.Lookup("σοφια").second == "Wisdom.");
+    REQUIRE(glossary.Lookup("eclair").second == "A pastry.");
+}
+
+TEST_CASE("Glossary index is built once for concurrent readers", "")
+{
+    Glossary glossary("Terms", nullptr);
+    for ( int i = 0; i < 1000; i++ )
+        glossary.AddDefinition(_Str("term", i), "A term.");
+
+    std::vector<GlossaryIndexPtr> indices(8);
+    std::vector<std::thread> readers;
+    for ( size_t i = 0; i < indices.size(); i++ )
+        readers.emplace_back([&glossary, &indices, i]() { indices[i] = glossary.LookupIndex(); });
+    for ( auto& reader : readers )
+        reader.join();
+
+    for ( auto& index : indices )
+        REQUIRE(index == indices[0]);
+    REQUIRE(glossary.CompletionsForString("term99").size() == 11);
+}
@@ -0,0 +1,126 @@
+//
+//  instrumentation_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/utilities/instrumentation.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "catch.hpp"
+#include <thread>
+
+using namespace ePub3;
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+// counts operations for the duration of a test, even one which fails
+struct InstrumentationScope
+{
+    InstrumentationScope()  { Instrumentation::Reset(); Instrumentation::SetEnabled(true); }
+    ~InstrumentationScope() { Instrumentation::SetEnabled(false); Instrumentation::Reset(); }
+};
+
+#if EPUB_ENABLE(INSTRUMENTATION)
+
+TEST_CASE("Opening a container records its phases", "")
+{
+    InstrumentationScope scope;
+    ContainerPtr container = Container::OpenContainer(EPUB_PATH);
+    REQUIRE(bool(container));
+
+    MetricsSnapshot snapshot = Instrumentation::Snapshot();
+    REQUIRE(snapshot[Metric::ContainerOpen].count == 1);
+    REQUIRE(snapshot[Metric::ContainerParseOCF].count == 1);
+    REQUIRE(snapshot[Metric::ContainerLoadPackages].count == 1);
+    REQUIRE(snapshot[Metric::ArchiveOpen].count >= 1);
+    REQUIRE(snapshot[Metric::ArchiveLookup].count > 0);
+    REQUIRE(snapshot[Metric::ArchiveRead].bytes > 0);
+    REQUIRE(snapshot[Metric::XPathEvaluate].count > 0);
+
+    // the phases lie within the whole
+    const MetricStatistics& open = snapshot[Metric::ContainerOpen];
+    REQUIRE(open.totalNanoseconds >= snapshot[Metric::ContainerParseOCF].totalNanoseconds + snapshot[Metric::ContainerLoadPackages].totalNanoseconds);
+    REQUIRE(open.maxNanoseconds == open.totalNanoseconds);
+}
+
+TEST_CASE("Nothing is recorded while instrumentation is disabled", "")
+{
+    Instrumentation::Reset();
+    REQUIRE_FALSE(Instrumentation::Enabled());
+
+    ContainerPtr container = Container::OpenContainer(EPUB_PATH);
+    REQUIRE(bool(container));
+
+    MetricsSnapshot snapshot = Instrumentation::Snapshot();
+    for ( size_t i = 0; i < size_t(Metric::Count); i++ )
+    {
+        REQUIRE(snapshot[Metric(i)].count == 0);
+    }
+    REQUIRE(snapshot.ToJSON() == "{}");
+}
+
+TEST_CASE("Metric statistics are summarized by percentile", "")
+{
+    InstrumentationScope scope;
+
+    // 98 fast operations and two slow ones
+    for ( int i = 0; i < 98; i++ )
+        Instrumentation::Record(Metric::FilterData, std::chrono::nanoseconds(1000), 10);
+    Instrumentation::Record(Metric::FilterData, std::chrono::microseconds(500), 10);
+    Instrumentation::Record(Metric::FilterData, std::chrono::milliseconds(2), 10);
+
+    MetricsSnapshot snapshot = Instrumentation::Snapshot();
+    const MetricStatistics& stats = snapshot[Metric::FilterData];
+    REQUIRE(stats.count == 100);
+    REQUIRE(stats.bytes == 1000);
+    REQUIRE(stats.totalNanoseconds == 98*1000 + 500000 + 2000000);
+    REQUIRE(stats.maxNanoseconds == 2000000);
+    REQUIRE(stats.MeanNanoseconds() == Approx(25980.0));
+
+    // bucket upper bounds: 1000ns lies in [512, 1024), 500us in [2^18, 2^19)
+    REQUIRE(stats.PercentileNanoseconds(50) == 1023);
+    REQUIRE(stats.PercentileNanoseconds(99) == 524287);
+    REQUIRE(stats.PercentileNanoseconds(100) == 2000000);
+
+    std::string json = snapshot.ToJSON();
+    REQUIRE(json.find("\"filter.filter_data\"") != std::string::npos);
+    REQUIRE(json.find("\"count\":100") != std::string::npos);
+    REQUIRE(json.find("\"bytes\":1000") != std::string::npos);
+    REQUIRE(json.find("archive.open") == std::string::npos);
+
+    Instrumentation::Reset();
+    REQUIRE(Instrumentation::Snapshot()[Metric::FilterData].count == 0);
+}
+
+TEST_CASE("Metrics recorded by exited threads are kept", "")
+{
+    InstrumentationScope scope;
+
+    std::vector<std::thread> threads;
+    for ( int i = 0; i < 4; i++ )
+    {
+        threads.emplace_back([] {
+            for ( int j = 0; j < 250; j++ )
+            {
+                EPUB_MEASURE(measure, RunLoopSource);
+                EPUB_MEASURE_BYTES(measure, 2);
+            }
+        });
+    }
+    for ( auto& thread : threads )
+        thread.join();
+
+    MetricsSnapshot snapshot = Instrumentation::Snapshot();
+    REQUIRE(snapshot[Metric::RunLoopSource].count == 1000);
+    REQUIRE(snapshot[Metric::RunLoopSource].bytes == 2000);
+}
+
+#endif
@@ -0,0 +1,200 @@
+//
+//  integrity_verifier_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/integrity_verifier.h"
+#include "../ePub3/xml/tree/document.h"
+#include "../ePub3/xml/tree/element.h"
+#include <libzip/zip.h>
+#include "catch.hpp"
+#include <cstdio>
+#include <cstring>
+
+using namespace ePub3;
+
+#define ARCHIVE_PATH "integrity_verifier_test.zip"
+
+static const char* kSignaturesXML = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<signatures xmlns="urn:oasis:names:tc:opendocument:xmlns:container">
+  <Signature Id="sig" xmlns="http://www.w3.org/2000/09/xmldsig#">
+    <SignedInfo>
+      <CanonicalizationMethod Algorithm="http://www.w3.org/TR/2001/REC-xml-c14n-20010315"/>
+      <SignatureMethod Algorithm="http://www.w3.org/2000/09/xmldsig#dsa-sha1"/>
+      <Reference URI="#Manifest1">
+        <DigestMethod Algorithm="http://www.w3.org/2000/09/xmldsig#sha1"/>
+        <DigestValue>j6lwx3rvEPO0vKtMup4NbeVu8nk=</DigestValue>
+      </Reference>
+    </SignedInfo>
+    <SignatureValue>AAAA</SignatureValue>
+    <Object>
+      <Manifest Id="Manifest1">
+        <Reference URI="/a.txt">
+          <DigestMethod Algorithm="http://www.w3.org/2000/09/xmldsig#sha1"/>
+          <DigestValue>qZk+NkcGgWq6PiVxeFDCbJzQ2J0=</DigestValue>
+        </Reference>
+        <Reference URI="a%20b.txt">
+          <DigestMethod Algorithm="http://www.w3.org/2001/04/xmlenc#sha256"/>
+          <DigestValue>ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=</DigestValue>
+        </Reference>
+        <Reference URI="missing.txt">
+          <DigestMethod Algorithm="http://www.w3.org/2000/09/xmldsig#sha1"/>
+          <DigestValue>qZk+NkcGgWq6PiVxeFDCbJzQ2J0=</DigestValue>
+        </Reference>
+      </Manifest>
+    </Object>
+  </Signature>
+</signatures>)X";
+
+static shared_ptr<DigitalSignature> TestSignature()
+{
+    auto doc = xml::Wrapped<xml::Document>(xmlParseMemory(kSignaturesXML, (int)strlen(kSignaturesXML)));
+    auto signatureNode = doc->Root()->FirstElementChild();
+    return std::make_shared<DigitalSignature>(signatureNode);
+}
+
+static void AddBuffer(struct zip* zip, const char* name, const char* data)
+{
+    struct zip_source* src = zip_source_buffer(zip, data, strlen(data), 0);
+    REQUIRE(src != nullptr);
+    REQUIRE(zip_add(zip, name, src) >= 0);
+}
+
+static void CreateTestArchive()
+{
+    remove(ARCHIVE_PATH);
+    int zerr = 0;
+    struct zip* zip = zip_open(ARCHIVE_PATH, ZIP_CREATE, &zerr);
+    REQUIRE(zip != nullptr);
+    AddBuffer(zip, "mimetype", "application/epub+zip");
+    AddBuffer(zip, "a.txt", "abc");
+    // the signature expects the SHA-256 of "abc"
+    AddBuffer(zip, "a b.txt", "abd");
+    REQUIRE(zip_close(zip) == 0);
+}
+
+TEST_CASE("XML-DSig digest values are decoded from base64", "")
+{
+    DigestValue value = DigestValue::FromBase64("qZk+NkcG\ngWq6PiVxeFDCbJzQ2J0=");
+    REQUIRE(value.Size() == 20);
+    REQUIRE(value.Bytes()[0] == 0xa9);
+    REQUIRE(value.Bytes()[19] == 0x9d);
+
+    REQUIRE(DigestValue::FromBase64("not*base64").Empty());
+}
+
+TEST_CASE("Signature references are read from SignedInfo and Manifest", "")
+{
+    auto signature = TestSignature();
+    REQUIRE(signature->SignedInfo() != nullptr);
+    REQUIRE(signature->SignedInfo()->References().size() == 1);
+    REQUIRE(signature->SignedInfo()->References()[0].ContainerPath().empty());
+
+    auto refs = signature->AllReferences();
+    REQUIRE(refs.size() == 4);
+    REQUIRE(refs[1].ContainerPath() == "a.txt");
+    REQUIRE(refs[2].ContainerPath() == "a b.txt");
+    REQUIRE(refs[2].DigestMethod() == "http://www.w3.org/2001/04/xmlenc#sha256");
+    REQUIRE(refs[2].Digest().Size() == 32);
+}
+
+TEST_CASE("Integrity verifier checks CRCs and referenced digests", "")
+{
+    CreateTestArchive();
+
+    IntegrityVerifier verifier(ARCHIVE_PATH);
+    verifier.AddSignature(*TestSignature());
+    REQUIRE(verifier.ReferenceCount() == 3);
+
+    auto results = verifier.Verify(1);
+    REQUIRE(results.size() == 4);
+    REQUIRE_FALSE(IntegrityVerifier::AllValid(results));
+
+    REQUIRE(results[0].path == "mimetype");
+    REQUIRE(results[0].crc == IntegrityVerifier::CRCStatus::Valid);
+    REQUIRE(results[0].digest == IntegrityVerifier::DigestStatus::NotSigned);
+
+    REQUIRE(results[1].path == "a.txt");
+    REQUIRE(results[1].crc == IntegrityVerifier::CRCStatus::Valid);
+    REQUIRE(results[1].digest == IntegrityVerifier::DigestStatus::Valid);
+
+    REQUIRE(results[2].path == "a b.txt");
+    REQUIRE(results[2].crc == IntegrityVerifier::CRCStatus::Valid);
+    REQUIRE(results[2].digest == IntegrityVerifier::DigestStatus::Mismatch);
+
+    REQUIRE(results[3].path == "missing.txt");
+    REQUIRE(results[3].digest == IntegrityVerifier::DigestStatus::Missing);
+
+    // spreading the work over several threads must not change anything
+    auto parallel = verifier.Verify(4);
+    REQUIRE(parallel.size() == results.size());
+    for ( size_t i = 0; i < results.size(); i++ )
+    {
+        REQUIRE(parallel[i].path == results[i].path);
+        REQUIRE(parallel[i].crc == results[i].crc);
+        REQUIRE(parallel[i].digest == results[i].digest);
+    }
+
+    // only referenced entries are read when requested
+    verifier.SetChecksAllEntries(false);
+    REQUIRE(verifier.Verify(2).size() == 3);
+
+    remove(ARCHIVE_PATH);
+}
+
+// runs each worker after the archive has gone, so none of them can open it
+class VanishingArchiveExecutor : public inline_executor
+{
+public:
+    virtual void add(closure_type closure) OVERRIDE
+    {
+        remove(ARCHIVE_PATH);
+        inline_executor::add(closure);
+    }
+};
+
+TEST_CASE("Integrity verifier never reports unread entries as valid", "")
+{
+    REQUIRE_FALSE(IntegrityVerifier::ItemResult().Valid());
+
+    CreateTestArchive();
+
+    IntegrityVerifier verifier(ARCHIVE_PATH);
+    verifier.AddSignature(*TestSignature());
+
+    VanishingArchiveExecutor exec;
+    auto results = verifier.Verify(exec, 2);
+    REQUIRE(results.size() == 4);
+    REQUIRE_FALSE(IntegrityVerifier::AllValid(results));
+    for ( size_t i = 0; i < 3; i++ )
+    {
+        REQUIRE(results[i].crc == IntegrityVerifier::CRCStatus::ReadError);
+        REQUIRE_FALSE(results[i].Valid());
+    }
+    REQUIRE(results[0].digest == IntegrityVerifier::DigestStatus::NotSigned);
+    REQUIRE(results[1].digest == IntegrityVerifier::DigestStatus::Mismatch);
+}
+
+TEST_CASE("Integrity verifier reports libzip's reason for failing to open an archive", "")
+{
+    IntegrityVerifier verifier("integrity_verifier_missing.zip");
+    try
+    {
+        verifier.Verify(1);
+        FAIL("Verify() should throw for a missing archive");
+    }
+    catch (const std::runtime_error& e)
+    {
+        char expected[128];
+        zip_error_to_str(expected, sizeof(expected), ZIP_ER_NOENT, 0);
+        REQUIRE(std::strstr(e.what(), expected) != nullptr);
+    }
+}
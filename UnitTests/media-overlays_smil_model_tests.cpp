@@ -0,0 +1,223 @@
+//
+//  media-overlays_smil_model_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/media-overlays_smil_model.h"
+#include "../ePub3/ePub/document_preloader.h"
+#include "../ePub3/utilities/error_handler.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "catch.hpp"
+#include <cstdio>
+#include <sstream>
+
+using namespace ePub3;
+
+#define NARRATED_PATH   "media_overlays_test.epub"
+
+// a book with one SMIL file per chapter, each with a one-second clip per paragraph
+static void MakeNarratedBook(const char* path, size_t chapters, size_t paragraphs)
+{
+    ZipStreamWriter writer(path);
+    writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+    writer.AddEntry("META-INF/container.xml", std::string(R"X(<?xml version="1.0" encoding="UTF-8"?>
+<container xmlns="urn:oasis:names:tc:opendocument:xmlns:container" version="1.0">
+  <rootfiles><rootfile full-path="EPUB/package.opf" media-type="application/oebps-package+xml"/></rootfiles>
+</container>
+)X"));
+
+    std::ostringstream opf, manifest, spine;
+    opf << R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:narrated</dc:identifier>
+    <dc:title>Narrated</dc:title>
+    <dc:language>en</dc:language>
+    <meta property="dcterms:modified">2014-01-01T00:00:00Z</meta>
+    <meta property="media:active-class">-epub-media-overlay-active</meta>
+)X";
+    opf << "    <meta property=\"media:duration\">" << chapters * paragraphs << "s</meta>\n";
+
+    manifest << "    <item id=\"nav\" href=\"nav.xhtml\" media-type=\"application/xhtml+xml\" properties=\"nav\"/>\n"
+             << "    <item id=\"audio\" href=\"audio.mp4\" media-type=\"audio/mp4\"/>\n";
+    std::ostringstream nav;
+    nav << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+        << "<head><title>Contents</title></head><body><nav epub:type=\"toc\"><ol>";
+
+    for ( size_t i = 0; i < chapters; i++ )
+    {
+        opf << "    <meta property=\"media:duration\" refines=\"#s" << i << "\">" << paragraphs << "s</meta>\n";
+        manifest << "    <item id=\"c" << i << "\" href=\"c" << i << ".xhtml\" media-type=\"application/xhtml+xml\" media-overlay=\"s" << i << "\"/>\n"
+                 << "    <item id=\"s" << i << "\" href=\"smil/s" << i << ".smil\" media-type=\"application/smil+xml\"/>\n";
+        spine << "    <itemref idref=\"c" << i << "\"/>\n";
+        nav << "<li><a href=\"c" << i << ".xhtml\">Chapter " << i << "</a></li>";
+
+        std::ostringstream chapter, smil;
+        chapter << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Chapter " << i << "</title></head><body>";
+        smil << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<smil xmlns=\"http://www.w3.org/ns/SMIL\" xmlns:epub=\"http://www.idpf.org/2007/ops\" version=\"3.0\"><body>"
+             << "<seq epub:textref=\"../c" << i << ".xhtml\" epub:type=\"chapter\">";
+        for ( size_t j = 0; j < paragraphs; j++ )
+        {
+            chapter << "<p id=\"p" << j << "\">Paragraph " << j << "</p>";
+            smil << "<par id=\"par" << j << "\"><text src=\"../c" << i << ".xhtml#p" << j << "\"/>"
+                 << "<audio src=\"../audio.mp4\" clipBegin=\"" << j << "s\" clipEnd=\"" << j + 1 << "s\"/></par>";
+        }
+        chapter << "</body></html>\n";
+        smil << "</seq></body></smil>\n";
+
+        std::ostringstream name;
+        name << "EPUB/c" << i << ".xhtml";
+        writer.AddEntry(name.str(), chapter.str());
+        name.str("");
+        name << "EPUB/smil/s" << i << ".smil";
+        writer.AddEntry(name.str(), smil.str());
+    }
+    nav << "</ol></nav></body></html>\n";
+
+    opf << "  </metadata>\n  <manifest>\n" << manifest.str() << "  </manifest>\n  <spine>\n" << spine.str() << "  </spine>\n</package>\n";
+    writer.AddEntry("EPUB/package.opf", opf.str());
+    writer.AddEntry("EPUB/nav.xhtml", nav.str());
+    writer.AddEntry("EPUB/audio.mp4", std::string(1024, '\0'), false);
+    writer.Close();
+}
+
+// the whole Media Overlays model, loading every SMIL file
+static std::string Summary(std::shared_ptr<MediaOverlaysSmilModel> model)
+{
+    std::ostringstream ss;
+    ss << "total " << model->DurationMilliseconds_Metadata() << ' ' << model->DurationMilliseconds_Calculated() << '\n';
+    for ( std::vector<SMILDataPtr>::size_type i = 0; i < model->GetSmilCount(); i++ )
+    {
+        SMILDataPtr data = model->GetSmil(i);
+        ss << "smil " << data->SmilManifestItem()->Identifier() << ' ' << data->DurationMilliseconds_Metadata() << ' ' << data->DurationMilliseconds_Calculated() << '\n';
+
+        auto body = data->Body();
+        REQUIRE(bool(body));
+        for ( auto child = body->GetChildrenCount(); child > 0; child-- )
+        {
+            auto seq = std::dynamic_pointer_cast<const SMILData::Sequence>(body->GetChild(body->GetChildrenCount() - child));
+            REQUIRE(bool(seq));
+            ss << " seq " << seq->TextRefFile() << ' ' << seq->GetChildrenCount() << '\n';
+            for ( size_t j = 0; j < seq->GetChildrenCount(); j++ )
+            {
+                auto par = std::dynamic_pointer_cast<const SMILData::Parallel>(seq->GetChild(j));
+                REQUIRE(bool(par));
+                ss << "  par " << par->Text()->SrcFile() << '#' << par->Text()->SrcFragmentId() << ' ' << par->Text()->SrcManifestItem()->Identifier()
+                   << ' ' << par->Audio()->ClipBeginMilliseconds() << '-' << par->Audio()->ClipEndMilliseconds() << '\n';
+            }
+        }
+    }
+    return ss.str();
+}
+
+TEST_CASE("Media Overlays are loaded on first use", "")
+{
+    MakeNarratedBook(NARRATED_PATH, 5, 10);
+
+    int errors = 0;
+    SetErrorHandler([&](const error_details&) {
+        errors++;
+        return true;
+    });
+
+    ContainerPtr container = Container::OpenContainer(NARRATED_PATH);
+    REQUIRE(bool(container));
+    auto model = container->DefaultPackage()->MediaOverlaysSmilModel();
+    REQUIRE(model->GetSmilCount() == 5);
+
+    // known from the package metadata alone
+    REQUIRE(model->DurationMilliseconds_Metadata() == 50000);
+    REQUIRE(model->GetSmil(2)->DurationMilliseconds_Metadata() == 10000);
+
+    // loads the third SMIL file, then the rest in the background
+    auto body = model->GetSmil(2)->Body();
+    REQUIRE(bool(body));
+    REQUIRE(body->GetChildrenCount() == 1);
+    REQUIRE(model->GetSmil(2)->DurationMilliseconds_Calculated() == 10000);
+
+    REQUIRE(model->DurationMilliseconds_Calculated() == 50000);
+
+    SMILDataPtr smilData;
+    uint32_t smilIndex = 0, parIndex = 0, milliseconds = 0;
+    shared_ptr<const SMILData::Parallel> par;
+    model->PercentToPosition(55.0, smilData, smilIndex, par, parIndex, milliseconds);
+    REQUIRE(bool(par));
+    REQUIRE(smilData == model->GetSmil(2));
+    REQUIRE(par->Text()->SrcFragmentId() == "p7");
+
+    SetErrorHandler(DefaultErrorHandler);
+    REQUIRE(errors == 0);
+
+    std::remove(NARRATED_PATH);
+}
+
+TEST_CASE("Lazily-loaded Media Overlays match a sequential load", "")
+{
+    MakeNarratedBook(NARRATED_PATH, 8, 6);
+
+    DocumentPreloader::SetEnabled(false);
+    std::string sequential = Summary(Container::OpenContainer(NARRATED_PATH)->DefaultPackage()->MediaOverlaysSmilModel());
+    DocumentPreloader::SetEnabled(true);
+    std::string preloaded = Summary(Container::OpenContainer(NARRATED_PATH)->DefaultPackage()->MediaOverlaysSmilModel());
+
+    REQUIRE(sequential.size() > 0);
+    REQUIRE(preloaded == sequential);
+
+    std::remove(NARRATED_PATH);
+}
+
+TEST_CASE("SMIL timing trees are navigated through handles", "")
+{
+    MakeNarratedBook(NARRATED_PATH, 3, 4);
+    {
+        ContainerPtr container = Container::OpenContainer(NARRATED_PATH);
+        SMILDataPtr data = container->DefaultPackage()->MediaOverlaysSmilModel()->GetSmil(1);
+
+        // body, seq, and a par, text and audio per paragraph
+        REQUIRE(data->NodeCount() == 14);
+        REQUIRE(data->ArenaSizeInBytes() > 0);
+
+        auto body = data->Body();
+        REQUIRE(body == data->Body());
+        REQUIRE(body->Parent() == nullptr);
+        REQUIRE(body->GetChildrenCount() == 1);
+        REQUIRE(body->GetChild(0) == body->GetChild(0));
+        REQUIRE(body->GetChild(1) == nullptr);
+
+        auto seq = std::dynamic_pointer_cast<const SMILData::Sequence>(body->GetChild(0));
+        REQUIRE(bool(seq));
+        REQUIRE(seq->ParentSequence() == body);
+        REQUIRE(body->ParentSequence() == nullptr);
+        REQUIRE(seq->Type() == "chapter");
+        REQUIRE(seq->TextRefFile() == "../c1.xhtml");
+        REQUIRE(seq->TextRefManifestItem()->Identifier() == "c1");
+        REQUIRE(seq->GetChildrenCount() == 4);
+        REQUIRE(seq->DurationMilliseconds() == 4000);
+
+        auto par = std::dynamic_pointer_cast<const SMILData::Parallel>(seq->GetChild(2));
+        REQUIRE(bool(par));
+        REQUIRE(par->IsParallel());
+        REQUIRE(par->Parent() == seq);
+        REQUIRE(par->Type().empty());
+        REQUIRE(par->ParentSequence() == seq);
+        REQUIRE(par->Text()->ParentParallel() == par);
+        REQUIRE(par->Audio()->ParentParallel() == par);
+        REQUIRE(par->Text()->SrcFile() == "../c1.xhtml");
+        REQUIRE(par->Text()->SrcFragmentId() == "p2");
+        REQUIRE(par->Audio()->SrcManifestItem()->Identifier() == "audio");
+        REQUIRE(par->Audio()->ClipBeginMilliseconds() == 2000);
+        REQUIRE(par->Audio()->ClipEndMilliseconds() == 3000);
+        REQUIRE(par->Audio()->ClipDurationMilliseconds() == 1000);
+    }
+    std::remove(NARRATED_PATH);
+}
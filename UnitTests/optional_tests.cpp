@@ -13,7 +13,7 @@
 //
 
 
-#include "../ePUb3/utilities/optional.h"
+#include "../ePub3/utilities/optional.h"
 #include <string>
 #include <vector>
 #include "catch.hpp"
@@ -0,0 +1,106 @@
+//
+//  package_snapshot_tests.cpp
+//  ePub3
+//
+//  Created by Jim Dovey on 2013-01-02.
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/package_snapshot.h"
+#include "../ePub3/ePub/spine.h"
+#include "catch.hpp"
+#include <thread>
+#include <vector>
+
+#define EPUB_PATH "TestData/childrens-literature-20120722.epub"
+
+using namespace ePub3;
+
+static size_t SpineIndex(const SpineItemPtr& item)
+{
+    return (bool(item) ? item->Index() : PackageSnapshot::npos);
+}
+
+TEST_CASE("Package snapshots match the package they were taken from", "")
+{
+    ContainerPtr container = Container::OpenContainer(EPUB_PATH);
+    PackagePtr pkg = container->DefaultPackage();
+    ConstPackageSnapshotPtr snapshot = pkg->GetSnapshot();
+    REQUIRE(bool(snapshot));
+    REQUIRE(pkg->GetSnapshot() == snapshot);
+    
+    REQUIRE(snapshot->Title() == pkg->Title());
+    REQUIRE(snapshot->Authors() == pkg->Authors());
+    REQUIRE(snapshot->Language() == pkg->Language());
+    REQUIRE(snapshot->UniqueID() == pkg->UniqueID());
+    REQUIRE(snapshot->BasePath() == pkg->BasePath());
+    
+    REQUIRE(snapshot->Items().size() == pkg->Manifest().size());
+    for ( auto& entry : pkg->Manifest() )
+    {
+        const PackageSnapshot::Item* item = snapshot->ItemWithID(entry.first);
+        REQUIRE(item != nullptr);
+        REQUIRE(item->manifestItem == entry.second);
+        REQUIRE(item->href == entry.second->Href());
+        REQUIRE(item->absolutePath == entry.second->AbsolutePath());
+        REQUIRE(item->mediaType == entry.second->MediaType());
+        REQUIRE(item->properties.HasProperty(ItemProperties::CoverImage) == entry.second->HasProperty(ItemProperties::CoverImage));
+        REQUIRE(item->properties.HasProperty(ItemProperties::Navigation) == entry.second->HasProperty(ItemProperties::Navigation));
+        REQUIRE(item->encryption == entry.second->GetEncryptionInfo());
+        REQUIRE(snapshot->ItemAtRelativePath(entry.second->Href()) == item);
+    }
+    REQUIRE(snapshot->ItemWithID("no-such-item") == nullptr);
+    REQUIRE(snapshot->ItemAtRelativePath("no/such/item.xhtml") == nullptr);
+    
+    size_t idx = 0;
+    for ( SpineItemPtr spineItem = pkg->FirstSpineItem(); bool(spineItem); spineItem = spineItem->Next(), idx++ )
+    {
+        REQUIRE(idx < snapshot->Spine().size());
+        const PackageSnapshot::SpineEntry& entry = snapshot->Spine()[idx];
+        REQUIRE(entry.idref == spineItem->Idref());
+        REQUIRE(entry.title == spineItem->Title());
+        REQUIRE(entry.linear == spineItem->Linear());
+        REQUIRE(entry.nextStep == SpineIndex(spineItem->NextStep()));
+        REQUIRE(entry.priorStep == SpineIndex(spineItem->PriorStep()));
+        REQUIRE(entry.cfi.String() == pkg->CFIForSpineItem(spineItem).String());
+        REQUIRE(snapshot->ItemForSpineEntry(entry)->manifestItem == spineItem->ManifestItem());
+        REQUIRE(snapshot->IndexOfSpineItemWithIDRef(entry.idref) == idx);
+        REQUIRE(snapshot->ItemForSpineEntry(entry)->spineIndex == idx);
+    }
+    REQUIRE(idx == snapshot->Spine().size());
+}
+
+TEST_CASE("Package snapshots can be read on several threads at once", "")
+{
+    ContainerPtr container = Container::OpenContainer(EPUB_PATH);
+    ConstPackageSnapshotPtr snapshot = container->DefaultPackage()->GetSnapshot();
+    
+    std::vector<std::thread> threads;
+    std::vector<size_t> found(8, 0);
+    for ( size_t i = 0; i < found.size(); i++ )
+    {
+        threads.emplace_back([&snapshot, &found, i]() {
+            for ( int n = 0; n < 100; n++ )
+            {
+                for ( auto& entry : snapshot->Spine() )
+                {
+                    const PackageSnapshot::Item* item = snapshot->ItemForSpineEntry(entry);
+                    if ( item != nullptr && snapshot->ItemAtRelativePath(item->href) == item && snapshot->ItemWithID(item->identifier) == item )
+                        found[i]++;
+                }
+            }
+        });
+    }
+    for ( auto& thread : threads )
+        thread.join();
+    
+    for ( size_t count : found )
+        REQUIRE(count == 100 * snapshot->Spine().size());
+}
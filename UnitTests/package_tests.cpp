@@ -16,6 +16,8 @@
 #include "../ePub3/ePub/container.h"
 #include "../ePub3/ePub/package.h"
 #include "../ePub3/ePub/content_handler.h"
+#include "../ePub3/ePub/archive.h"
+#include "../ePub3/utilities/byte_stream.h"
 #include "../ePub3/utilities/error_handler.h"
 #include "catch.hpp"
 #include <cstdlib>
@@ -965,6 +967,39 @@ TEST_CASE("Package should have multiple manifest items, and they should be index
     REQUIRE(fetched == randomItem);
 }
 
+TEST_CASE("Manifest items locate their archive entries and encryption details once", "")
+{
+    ContainerPtr c = Container::OpenContainer("TestData/wasteland-otf-obf-20120118.epub");
+    PackagePtr pkg = c->DefaultPackage();
+    
+    ManifestItemPtr font = pkg->ManifestItemWithID("font.OldStandard.regular");
+    REQUIRE(bool(font));
+    
+    const ResourceDescriptor& resource = font->Descriptor();
+    REQUIRE(&font->Descriptor() == &resource);
+    REQUIRE(resource.Path() == "EPUB/OldStandard-Regular.obf.otf");
+    REQUIRE(font->AbsolutePath() == resource.Path());
+    REQUIRE(resource.IsInArchive());
+    REQUIRE(resource.ArchiveIndex() == c->GetArchive()->IndexOfItem(resource.Path()));
+    REQUIRE(resource.UncompressedSize() == c->GetArchive()->InfoAtPath(resource.Path()).UncompressedSize());
+    REQUIRE(bool(resource.Encryption()));
+    REQUIRE(font->GetEncryptionInfo() == c->EncryptionInfoForPath(resource.Path()));
+    REQUIRE(font->CanLoadDocument());
+    
+    auto stream = font->Reader();
+    REQUIRE(bool(stream));
+    std::vector<uint8_t> buf(resource.UncompressedSize() + 1);
+    size_t total = 0, num = 0;
+    while ( (num = stream->ReadBytes(buf.data() + total, buf.size() - total)) > 0 )
+        total += num;
+    REQUIRE(total == resource.UncompressedSize());
+    
+    ManifestItemPtr nav = pkg->ManifestItemWithID("nav");
+    REQUIRE(bool(nav));
+    REQUIRE(nav->Descriptor().IsInArchive());
+    REQUIRE_FALSE(bool(nav->GetEncryptionInfo()));
+}
+
 TEST_CASE("Package should have multiple spine items", "")
 {
     ContainerPtr c = Container::OpenContainer(EPUB_PATH);
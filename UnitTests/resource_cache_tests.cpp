@@ -0,0 +1,147 @@
+//
+//  resource_cache_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/resource_cache.h"
+#include "../ePub3/ePub/deflate_decompression.h"
+#include "catch.hpp"
+#include <cstring>
+#include <thread>
+
+using namespace ePub3;
+
+static std::shared_ptr<ByteBuffer> MakeBuffer(size_t size, unsigned char fill)
+{
+    std::vector<unsigned char> bytes(size, fill);
+    return std::make_shared<ByteBuffer>(bytes.data(), bytes.size());
+}
+
+TEST_CASE("Resource cache keys distinguish container, item and filter chain", "")
+{
+    auto key = ResourceCache::KeyFor("/books/a.epub", "OPS/ch1.xhtml", "FontObfuscator;");
+    REQUIRE(key != ResourceCache::KeyFor("/books/b.epub", "OPS/ch1.xhtml", "FontObfuscator;"));
+    REQUIRE(key != ResourceCache::KeyFor("/books/a.epub", "OPS/ch2.xhtml", "FontObfuscator;"));
+    REQUIRE(key != ResourceCache::KeyFor("/books/a.epub", "OPS/ch1.xhtml", ""));
+    REQUIRE(key == ResourceCache::KeyFor("/books/a.epub", "OPS/ch1.xhtml", "FontObfuscator;"));
+
+    REQUIRE(ResourceCache::KeyFor(nullptr, std::vector<ContentFilterPtr>()).empty());
+}
+
+class OpaqueFilter : public ContentFilter
+{
+public:
+    OpaqueFilter() : ContentFilter([](ConstManifestItemPtr) { return true; }) {}
+    virtual void* FilterData(FilterContext*, void* data, size_t len, size_t* outputLen) OVERRIDE { *outputLen = len; return data; }
+};
+
+TEST_CASE("Filters must opt in to having their output cached", "")
+{
+    REQUIRE(OpaqueFilter().CacheIdentity().empty());
+    REQUIRE_FALSE(DeflateDecompressor().CacheIdentity().empty());
+}
+
+TEST_CASE("Resource cache gives recently used entries a second chance", "")
+{
+    // a single shard, so the eviction order is predictable
+    ResourceCache cache(30, 1);
+
+    REQUIRE(cache.Insert("a", MakeBuffer(10, 'a')));
+    REQUIRE(cache.Insert("b", MakeBuffer(10, 'b')));
+    REQUIRE(cache.Insert("c", MakeBuffer(10, 'c')));
+
+    // 'a' has its reference bit set, so 'b' goes first
+    REQUIRE(cache.Lookup("a") != nullptr);
+    REQUIRE(cache.Insert("d", MakeBuffer(10, 'd')));
+
+    REQUIRE(cache.Lookup("a") != nullptr);
+    REQUIRE(cache.Lookup("b") == nullptr);
+    REQUIRE(cache.Lookup("c") != nullptr);
+    REQUIRE(cache.Lookup("d") != nullptr);
+
+    auto stats = cache.GetStatistics();
+    REQUIRE(stats.entries == 3);
+    REQUIRE(stats.bytes == 30);
+    REQUIRE(stats.insertions == 4);
+    REQUIRE(stats.evictions == 1);
+    REQUIRE(stats.hits == 4);
+    REQUIRE(stats.misses == 1);
+}
+
+TEST_CASE("Resource cache rejects entries larger than a shard", "")
+{
+    ResourceCache cache(64, 4);
+    REQUIRE(cache.MaximumEntrySize() == 16);
+
+    REQUIRE(cache.Insert("small", MakeBuffer(16, 's')));
+    REQUIRE_FALSE(cache.Insert("large", MakeBuffer(17, 'l')));
+
+    auto stats = cache.GetStatistics();
+    REQUIRE(stats.rejections == 1);
+    REQUIRE(stats.entries == 1);
+}
+
+TEST_CASE("Resource cache views outlive eviction", "")
+{
+    ResourceCache cache(10, 1);
+    REQUIRE(cache.Insert("a", MakeBuffer(10, 'a')));
+
+    ResourceCache::BufferPtr view = cache.Lookup("a");
+    REQUIRE(view->UsesSecureErasure());
+
+    REQUIRE(cache.Insert("b", MakeBuffer(10, 'b')));
+    REQUIRE(cache.Lookup("a") == nullptr);
+
+    REQUIRE(view->GetBufferSize() == 10);
+    REQUIRE(view->GetBytes()[9] == 'a');
+
+    cache.Clear();
+    REQUIRE(cache.GetStatistics().bytes == 0);
+}
+
+TEST_CASE("Resource cache is safe to use from several threads", "")
+{
+    ResourceCache cache(64 * 1024, 8);
+
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < 4; t++ )
+    {
+        threads.emplace_back([&cache, t]() {
+            for ( int i = 0; i < 500; i++ )
+            {
+                std::string key = std::to_string((i * 7 + t) % 64);
+                if ( !cache.Lookup(key) )
+                    cache.Insert(key, MakeBuffer(1024, 'x'));
+            }
+        });
+    }
+    for ( auto& thread : threads )
+        thread.join();
+
+    auto stats = cache.GetStatistics();
+    size_t lookups = stats.hits + stats.misses;
+    REQUIRE(lookups == 2000);
+    REQUIRE(stats.bytes <= cache.ByteLimit());
+    size_t expectedBytes = stats.entries * 1024;
+    REQUIRE(stats.bytes == expectedBytes);
+}
+
+TEST_CASE("The shared resource cache is opt-in", "")
+{
+    REQUIRE(ResourceCache::Shared() == nullptr);
+
+    auto cache = std::make_shared<ResourceCache>();
+    ResourceCache::SetShared(cache);
+    REQUIRE(ResourceCache::Shared() == cache);
+
+    ResourceCache::SetShared(nullptr);
+    REQUIRE(ResourceCache::Shared() == nullptr);
+}
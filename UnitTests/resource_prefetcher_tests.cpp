@@ -0,0 +1,114 @@
+//
+//  resource_prefetcher_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/resource_prefetcher.h"
+#include "catch.hpp"
+#include <cstring>
+
+using namespace ePub3;
+
+static PrefetchCache::BufferPtr MakeBuffer(const char* content)
+{
+    return std::make_shared<ByteBuffer>(reinterpret_cast<const unsigned char*>(content), strlen(content));
+}
+
+TEST_CASE("Prefetch cache evicts least recently used entries to stay within its limit", "")
+{
+    PrefetchCache cache(10);
+
+    REQUIRE(cache.Insert("a.xhtml", MakeBuffer("aaaa")));
+    REQUIRE(cache.Insert("b.xhtml", MakeBuffer("bbbb")));
+
+    // touch 'a' so that 'b' is evicted first
+    REQUIRE(cache.Get("a.xhtml") != nullptr);
+    REQUIRE(cache.Insert("c.xhtml", MakeBuffer("cccc")));
+
+    REQUIRE(cache.Contains("a.xhtml"));
+    REQUIRE_FALSE(cache.Contains("b.xhtml"));
+    REQUIRE(cache.Contains("c.xhtml"));
+
+    auto stats = cache.GetStatistics();
+    REQUIRE(stats.entries == 2);
+    REQUIRE(stats.bytes == 8);
+    REQUIRE(stats.insertions == 3);
+    REQUIRE(stats.evictions == 1);
+
+    // larger than the whole cache: rejected without disturbing anything
+    REQUIRE_FALSE(cache.Insert("big.xhtml", MakeBuffer("0123456789A")));
+    REQUIRE(cache.GetStatistics().entries == 2);
+
+    // replacing an entry accounts for the old size
+    REQUIRE(cache.Insert("a.xhtml", MakeBuffer("aa")));
+    REQUIRE(cache.GetStatistics().bytes == 6);
+
+    cache.Clear();
+    REQUIRE(cache.GetStatistics().bytes == 0);
+    REQUIRE(cache.Get("c.xhtml") == nullptr);
+}
+
+TEST_CASE("Prefetched streams outlive eviction of their data", "")
+{
+    PrefetchCache cache(8);
+    REQUIRE(cache.Insert("a.xhtml", MakeBuffer("abcdef")));
+
+    PrefetchedByteStream stream(cache.Get("a.xhtml"));
+    cache.Remove("a.xhtml");
+
+    char buf[4] = {0};
+    REQUIRE(stream.BytesAvailable() == 6);
+    REQUIRE(stream.ReadBytes(buf, 4) == 4);
+    REQUIRE(memcmp(buf, "abcd", 4) == 0);
+    REQUIRE(stream.ReadBytes(buf, 4) == 2);
+    REQUIRE(memcmp(buf, "ef", 2) == 0);
+    REQUIRE(stream.AtEnd());
+    REQUIRE(stream.ReadBytes(buf, 4) == 0);
+}
+
+TEST_CASE("Linked resources are found in documents and stylesheets", "")
+{
+    const char* xhtml = R"X(<html xmlns="http://www.w3.org/1999/xhtml"><head>
+<link rel="stylesheet" type="text/css" href = "../styles/main.css"/>
+<link rel="stylesheet" href="../styles/main.css#dup"/>
+</head><body>
+<img src='images/cover.jpg?size=1' alt="x"/>
+<a href="#note1">1</a><a href="http://example.com/">web</a>
+<svg><image xlink:href="./images/./figure.png"/></svg>
+<div data-src="ignored.png"></div>
+<a href="../../outside.xhtml">out</a>
+</body></html>)X";
+
+    auto paths = ResourcePrefetcher::LinkedResourcePaths(reinterpret_cast<const uint8_t*>(xhtml), strlen(xhtml), "text/chapter1.xhtml");
+    REQUIRE(paths.size() == 3);
+    REQUIRE(paths[0] == "styles/main.css");
+    REQUIRE(paths[1] == "text/images/cover.jpg");
+    REQUIRE(paths[2] == "text/images/figure.png");
+
+    const char* css = "@font-face { src: url(\"../fonts/serif.otf\") format('opentype'), URL( ../fonts/serif.woff ); }\n"
+                      "body { background: url(data:image/png;base64,AAAA); }";
+    paths = ResourcePrefetcher::LinkedResourcePaths(reinterpret_cast<const uint8_t*>(css), strlen(css), "styles/main.css");
+    REQUIRE(paths.size() == 2);
+    REQUIRE(paths[0] == "fonts/serif.otf");
+    REQUIRE(paths[1] == "fonts/serif.woff");
+}
+
+TEST_CASE("Audio and video are never prefetched", "")
+{
+    REQUIRE(ResourcePrefetcher::IsPrefetchableType("application/xhtml+xml"));
+    REQUIRE(ResourcePrefetcher::IsPrefetchableType("text/css"));
+    REQUIRE(ResourcePrefetcher::IsPrefetchableType("image/jpeg"));
+    REQUIRE(ResourcePrefetcher::IsPrefetchableType("application/vnd.ms-opentype"));
+    REQUIRE(ResourcePrefetcher::IsPrefetchableType("font/woff2"));
+    REQUIRE_FALSE(ResourcePrefetcher::IsPrefetchableType("audio/mpeg"));
+    REQUIRE_FALSE(ResourcePrefetcher::IsPrefetchableType("video/mp4"));
+    REQUIRE_FALSE(ResourcePrefetcher::IsPrefetchableType("application/smil+xml"));
+}
@@ -0,0 +1,176 @@
+//
+//  search_index_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/search_index.h"
+#include "../ePub3/ePub/cfi_step_index.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/xml/tree/document.h"
+#include "../ePub3/xml/tree/node.h"
+#include "catch.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace ePub3;
+
+#define EPUB_PATH       "TestData/childrens-literature-20120722.epub"
+#define INDEX_PATH      "search_index_test.search"
+
+static const char* kChapter = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<html xmlns="http://www.w3.org/1999/xhtml">
+<head><title>Not indexed</title><style>p { color: red; }</style></head>
+<body id="body01">
+<h1>The Voyage</h1>
+<p id="para01">It was the best of times, it was the <!-- comment --> worst of times.</p>
+<p>A <em>caf&#233;</em> in Zürich sold 東京 maps.</p>
+<script>var ignored = "times";</script>
+</body>
+</html>)X";
+
+static CFI SpineCFI(int step)
+{
+    return CFI(_Str("/6/", step, "!"));
+}
+
+static SearchIndexPtr TestIndex()
+{
+    auto index = std::make_shared<SearchIndex>("urn:test");
+    REQUIRE(index->AddDocument(1, SpineCFI(4), kChapter, strlen(kChapter)));
+    const char* cover = "<html><body><p>Times past.</p></body></html>";
+    REQUIRE(index->AddDocument(0, SpineCFI(2), cover, strlen(cover)));
+    index->Finish();
+    return index;
+}
+
+// the text covered by a ranged CFI, found with the CFI step index
+static std::string TextAt(const CFI& cfi, const char* content)
+{
+    auto doc = xml::Wrapped<xml::Document>(xmlParseMemory(content, (int)strlen(content)));
+    CFIStepIndex stepIndex(doc);
+    auto range = stepIndex.Resolve(cfi);
+    REQUIRE(range.Valid());
+    REQUIRE(range.start.node == range.end.node);
+
+    // offsets are UTF-16; the test text is all in the BMP
+    std::u16string text = string(range.start.node->Content()).utf16string();
+    std::u16string part = text.substr(range.start.characterOffset, range.end.characterOffset - range.start.characterOffset);
+    return string(part).stl_str();
+}
+
+TEST_CASE("Search words are folded and split", "")
+{
+    auto words = SearchIndex::Words("Ça va? Très-BIEN, 東京!");
+    REQUIRE(words.size() == 6);
+    REQUIRE(words[0] == "ca");
+    REQUIRE(words[1] == "va");
+    REQUIRE(words[2] == "tres");
+    REQUIRE(words[3] == "bien");
+    REQUIRE(words[4] == "東");
+    REQUIRE(words[5] == "京");
+}
+
+TEST_CASE("Search index finds phrases as ranged CFIs", "")
+{
+    auto index = TestIndex();
+    REQUIRE(index->DocumentCount() == 2);
+    REQUIRE(index->WordCount() == 24);
+
+    auto hits = index->Search("times");
+    REQUIRE(hits.size() == 3);
+    // spine order, regardless of the order the documents were added
+    REQUIRE(hits[0].spineIndex == 0);
+    REQUIRE(hits[1].spineIndex == 1);
+    REQUIRE(hits[1].cfi.String() == "epubcfi(/6/4!/4[body01]/4[para01],/1:19,/1:24)");
+    REQUIRE(TextAt(hits[1].cfi, kChapter) == "times");
+
+    // character offsets continue across the comment
+    hits = index->Search("WORST of Times");
+    REQUIRE(hits.size() == 1);
+    REQUIRE(TextAt(hits[0].cfi, kChapter) == "worst of times");
+
+    // the head and scripts aren't indexed
+    REQUIRE(index->Search("indexed").empty());
+    REQUIRE(index->Search("ignored").empty());
+    REQUIRE(index->Search("of the").empty());
+
+    hits = index->Search("cafe");
+    REQUIRE(hits.size() == 1);
+    REQUIRE(hits[0].cfi.String() == "epubcfi(/6/4!/4[body01]/6/2,/1:0,/1:4)");
+
+    REQUIRE(index->Search("zurich sold").size() == 1);
+    REQUIRE(index->Search("東京").size() == 1);
+    REQUIRE(index->Search("京東").empty());
+
+    // a phrase crossing an element boundary spans two text steps
+    hits = index->Search("a cafe");
+    REQUIRE(hits.size() == 1);
+    REQUIRE(hits[0].cfi.String() == "epubcfi(/6/4!/4[body01]/6,/1:0,/2/1:4)");
+}
+
+TEST_CASE("Search index matches prefixes", "")
+{
+    auto index = TestIndex();
+    REQUIRE(index->Search("tim*").size() == 3);
+    REQUIRE(index->Search("the wor*").size() == 1);
+    REQUIRE(index->Search("tim").empty());
+    REQUIRE(index->Search("*").empty());
+    REQUIRE(index->Search("tim*", 2).size() == 2);
+}
+
+TEST_CASE("Search index survives saving and loading", "")
+{
+    auto index = TestIndex();
+    REQUIRE(index->Save(INDEX_PATH));
+
+    REQUIRE(SearchIndex::Load(INDEX_PATH, "urn:other") == nullptr);
+    auto loaded = SearchIndex::Load(INDEX_PATH, "urn:test");
+    REQUIRE(loaded != nullptr);
+    REQUIRE(loaded->TermCount() == index->TermCount());
+    REQUIRE(loaded->WordCount() == index->WordCount());
+
+    auto hits = loaded->Search("worst of times");
+    REQUIRE(hits.size() == 1);
+    REQUIRE(hits[0].cfi == index->Search("worst of times")[0].cfi);
+
+    // truncated files are rejected
+    {
+        std::ifstream in(INDEX_PATH, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        std::ofstream out(INDEX_PATH, std::ios::binary|std::ios::trunc);
+        out.write(bytes.data(), bytes.size() - 3);
+    }
+    REQUIRE(SearchIndex::Load(INDEX_PATH) == nullptr);
+    remove(INDEX_PATH);
+}
+
+TEST_CASE("Search index covers a package's spine", "")
+{
+    ContainerPtr container = Container::OpenContainer(EPUB_PATH);
+    PackagePtr package = container->DefaultPackage();
+
+    auto index = package->GetSearchIndex(false);
+    REQUIRE(index != nullptr);
+    REQUIRE(index->Identity() == package->UniqueID());
+    REQUIRE(index->DocumentCount() > 0);
+    REQUIRE(package->GetSearchIndex(false) == index);
+
+    auto hits = index->Search("Mother Goose");
+    REQUIRE(hits.size() > 0);
+    auto spineItem = package->SpineItemAt(hits[0].spineIndex);
+    REQUIRE(spineItem != nullptr);
+    CFI cfi(hits[0].cfi);
+    REQUIRE(package->ManifestItemForCFI(cfi, nullptr) == spineItem->ManifestItem());
+}
@@ -0,0 +1,302 @@
+//
+//  xml_stream_reader_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/xml_stream_reader.h"
+#include "../ePub3/ePub/container.h"
+#include "../ePub3/ePub/package.h"
+#include "../ePub3/ePub/nav_table.h"
+#include "../ePub3/ePub/nav_point.h"
+#include "../ePub3/ePub/encryption.h"
+#include "../ePub3/utilities/error_handler.h"
+#include "../ePub3/xml/tree/document.h"
+#include "../ePub3/xml/tree/element.h"
+#include "catch.hpp"
+#include <cstring>
+#include <sstream>
+
+using namespace ePub3;
+
+static const char* kDocument = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<root xmlns="urn:a" xmlns:b="urn:b" xml:lang="en">
+  <first id="one" b:attr="namespaced"/>
+  <second attr="plain">Some <i>mixed</i> text<deep><deeper/></deep></second>
+  <b:third xml:lang="fr"><child>un</child><child>deux</child></b:third>
+</root>)X";
+
+static std::string Events(XMLStreamReader& reader)
+{
+    std::string result;
+    while ( reader.Next() )
+    {
+        result += (reader.IsStartElement() ? "<" : "</");
+        result += reader.Name().stl_str();
+        result += ">";
+    }
+    return result;
+}
+
+TEST_CASE("Stream reader reports start and end tags", "")
+{
+    XMLStreamReader reader(kDocument, strlen(kDocument), "test.xml");
+    REQUIRE(reader.IsOpen());
+    REQUIRE(Events(reader) == "<root><first></first><second><i></i><deep><deeper></deeper></deep></second><third><child></child><child></child></third></root>");
+    REQUIRE_FALSE(reader.Failed());
+}
+
+TEST_CASE("Stream reader reads attributes, language and content", "")
+{
+    XMLStreamReader reader(kDocument, strlen(kDocument), "test.xml");
+    REQUIRE(reader.Next());
+    REQUIRE(reader.Is("root", "urn:a"));
+    REQUIRE(reader.Depth() == 0);
+
+    REQUIRE(reader.NextChild(0));
+    REQUIRE(reader.Is("first"));
+    REQUIRE(reader.Attribute("id") == "one");
+    REQUIRE(reader.Attribute("attr", "urn:b") == "namespaced");
+    // falls back to any attribute with the same local name, as _getProp() does
+    REQUIRE(reader.Attribute("id", "urn:b") == "one");
+    REQUIRE(reader.Language() == "en");
+
+    REQUIRE(reader.NextChild(0));
+    REQUIRE(reader.Is("second", "urn:a"));
+    REQUIRE(reader.Attribute("missing").empty());
+    REQUIRE(reader.FirstText() == "Some ");
+    REQUIRE(reader.Content() == "Some mixed text");
+
+    // children which weren't read are skipped
+    REQUIRE(reader.NextChild(0));
+    REQUIRE(reader.Is("third", "urn:b"));
+    REQUIRE(reader.Language() == "fr");
+
+    int depth = reader.Depth();
+    REQUIRE(reader.NextChild(depth));
+    REQUIRE(reader.Content() == "un");
+    REQUIRE(reader.NextChild(depth));
+    REQUIRE(reader.Language() == "fr");
+    REQUIRE_FALSE(reader.NextChild(depth));
+    REQUIRE_FALSE(reader.NextChild(depth));
+
+    REQUIRE_FALSE(reader.NextChild(0));
+    REQUIRE_FALSE(reader.Next());
+    REQUIRE_FALSE(reader.Failed());
+}
+
+TEST_CASE("Stream reader skips elements", "")
+{
+    XMLStreamReader reader(kDocument, strlen(kDocument), "test.xml");
+    REQUIRE(reader.Next());
+    REQUIRE(reader.NextChild(0));
+    reader.Skip();
+    REQUIRE(reader.Is("first"));
+    REQUIRE_FALSE(reader.IsStartElement());
+
+    REQUIRE(reader.Next());
+    REQUIRE(reader.Is("second"));
+    reader.Skip();
+    REQUIRE(reader.Is("second"));
+    REQUIRE_FALSE(reader.IsStartElement());
+
+    REQUIRE(reader.Next());
+    REQUIRE(reader.Is("third"));
+    REQUIRE(reader.IsStartElement());
+}
+
+TEST_CASE("Stream reader copies out elements with their namespaces and language", "")
+{
+    XMLStreamReader reader(kDocument, strlen(kDocument), "test.xml");
+    REQUIRE(reader.Next());
+    REQUIRE(reader.NextChild(0));
+    REQUIRE(reader.NextChild(0));
+
+    auto doc = reader.ExpandedDocument();
+    REQUIRE(bool(doc));
+    auto root = doc->Root();
+    REQUIRE(root->Name() == "second");
+    REQUIRE(root->Namespace()->URI() == "urn:a");
+    REQUIRE(root->Language() == "en");
+    REQUIRE(root->Content() == "Some mixed text");
+    REQUIRE(xmlSearchNs(root->Document()->xml(), root->xml(), BAD_CAST "b") != nullptr);
+
+    // the reader is left on the copied element's end tag
+    REQUIRE(reader.Is("second"));
+    REQUIRE_FALSE(reader.IsStartElement());
+    REQUIRE(reader.NextChild(0));
+    REQUIRE(reader.Is("third"));
+}
+
+TEST_CASE("Stream reader stops at well-formedness errors", "")
+{
+    static const char* kBroken = "<root><a></b><c/></root>";
+    XMLStreamReader reader(kBroken, strlen(kBroken), "broken.xml");
+    Events(reader);
+    REQUIRE(reader.Failed());
+    REQUIRE_FALSE(reader.ErrorMessage().empty());
+
+    XMLStreamReader empty("", 0, "empty.xml");
+    REQUIRE_FALSE(empty.Next());
+}
+
+// everything loaded from the package, navigation and encryption documents
+static std::string Summary(ContainerPtr container)
+{
+    std::ostringstream ss;
+    for ( auto& enc : container->EncryptionData() )
+        ss << "enc " << enc->Path() << ' ' << enc->Algorithm() << '\n';
+
+    for ( auto& package : container->Packages() )
+    {
+        ss << "package " << package->PackageID() << ' ' << package->Version() << ' ' << package->UniqueID() << ' ' << package->SpineCFIIndex() << '\n';
+        for ( auto& pair : package->Manifest() )
+        {
+            auto& item = pair.second;
+            ss << "item " << item->Identifier() << ' ' << item->Href() << ' ' << item->MediaType() << ' '
+               << item->FallbackID() << ' ' << item->MediaOverlayID() << ' ' << item->HasProperty(ItemProperties::Navigation) << '\n';
+        }
+        for ( auto item = package->FirstSpineItem(); bool(item); item = item->Next() )
+            ss << "spine " << item->Identifier() << ' ' << item->Idref() << ' ' << item->Linear() << ' ' << item->NumberOfProperties() << ' ' << item->Title() << '\n';
+        for ( size_t i = 0; i < package->NumberOfProperties(); i++ )
+        {
+            auto prop = package->PropertyAt(i);
+            ss << "meta " << prop->PropertyIdentifier().IRIString() << " = " << prop->Value() << " [" << prop->Language() << "] "
+               << prop->XMLIdentifier() << ' ' << prop->Extensions().size() << '\n';
+        }
+        for ( auto& pair : package->NavigationTables() )
+        {
+            ss << "nav " << pair.first << ' ' << pair.second->Title() << '\n';
+            std::function<void(const NavigationList&, int)> dump = [&](const NavigationList& list, int level) {
+                for ( auto& elem : list )
+                {
+                    auto point = std::dynamic_pointer_cast<NavigationPoint>(elem);
+                    ss << std::string(level, ' ') << elem->Title() << " -> " << (point ? point->Content() : string()) << '\n';
+                    dump(elem->Children(), level + 1);
+                }
+            };
+            dump(pair.second->Children(), 1);
+        }
+        ss << "collections " << package->Collections().size() << '\n';
+    }
+    return ss.str();
+}
+
+static const char* kTestBooks[] = {
+    "TestData/childrens-literature-20120722.epub",
+    "TestData/cole-voyage-of-life-20120320.epub",
+    "TestData/dante-hell.epub",
+    "TestData/moby-dick-preview-collection.epub",
+    "TestData/page-blanche.epub",
+    "TestData/wasteland-otf-obf-20120118.epub",
+    "TestData/widget-figure-gallery-20121022.epub",
+};
+
+TEST_CASE("Streaming loads the same publications as the DOM", "")
+{
+    for ( auto path : kTestBooks )
+    {
+        XMLStreamReader::SetEnabled(false);
+        std::string dom = Summary(Container::OpenContainer(path));
+        XMLStreamReader::SetEnabled(true);
+        std::string streamed = Summary(Container::OpenContainer(path));
+
+        INFO(path);
+        REQUIRE(streamed.size() > 0);
+        REQUIRE(streamed == dom);
+    }
+}
+
+static const char* kMissingLanguage = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:test</dc:identifier>
+    <meta property="dcterms:modified">2010-02-17T04:39:13Z</meta>
+    <dc:title id="t1">Title</dc:title>
+    <meta refines="#t1" property="title-type">main</meta>
+  </metadata>
+  <manifest>
+    <item href="cover.xhtml" id="cover" media-type="application/xhtml+xml"/>
+    <item href="nav.xhtml" id="nav" media-type="application/xhtml+xml" properties="nav"/>
+  </manifest>
+  <spine page-progression-direction="rtl">
+    <itemref idref="cover"/>
+    <itemref idref="nav" linear="no"/>
+  </spine>
+</package>
+)X";
+
+TEST_CASE("Streamed packages raise the same spec errors", "")
+{
+    EPUBError triggeredError = EPUBError::NoError;
+    SetErrorHandler([&](const error_details& err){
+        if (err.is_spec_error())
+            triggeredError = err.epub_error_code();
+        return true;
+    });
+
+    ContainerPtr c = Container::OpenContainer("TestData/childrens-literature-20120722.epub");
+    PackagePtr pkg = Package::New(c, "application/oebps-package+xml");
+    bool opened = pkg->_OpenStreamForTest(kMissingLanguage, strlen(kMissingLanguage), "EPUB/");
+
+    SetErrorHandler(DefaultErrorHandler);
+    REQUIRE(opened);
+    REQUIRE(int(triggeredError) == int(EPUBError::OPFMissingLanguageMetadata));
+
+    REQUIRE(pkg->PackageID() == "urn:test");
+    REQUIRE(pkg->Version() == "3.0");
+    REQUIRE(pkg->SpineCFIIndex() == 6);
+    REQUIRE(pkg->Manifest().size() == 2);
+    REQUIRE(pkg->SpineItemAt(1)->Linear() == false);
+    REQUIRE(pkg->PageProgressionDirection() == PageProgression::RightToLeft);
+    auto titles = pkg->PropertiesMatching(DCType::Title);
+    REQUIRE(titles.size() == 1);
+    REQUIRE(titles[0]->Extensions().size() == 1);
+}
+
+// the manifest comes first, and the spine isn't well-formed
+static const char* kMalformedOutOfOrder = R"X(<?xml version="1.0" encoding="UTF-8"?>
+<package xmlns="http://www.idpf.org/2007/opf" version="3.0" unique-identifier="id">
+  <manifest>
+    <item href="cover.xhtml" id="cover" media-type="application/xhtml+xml"/>
+    <item href="nav.xhtml" id="nav" media-type="application/xhtml+xml" properties="nav"/>
+  </manifest>
+  <metadata xmlns:dc="http://purl.org/dc/elements/1.1/">
+    <dc:identifier id="id">urn:test</dc:identifier>
+    <meta property="dcterms:modified">2010-02-17T04:39:13Z</meta>
+    <dc:title>Title</dc:title>
+    <dc:language>en</dc:language>
+  </metadata>
+  <spine>
+    <itemref idref="cover"/>
+    <itemref idref="nav" linear="no">
+  </spine>
+</package>
+)X";
+
+TEST_CASE("Spec errors are reported once when streaming falls back to the DOM", "")
+{
+    int outOfOrder = 0;
+    SetErrorHandler([&](const error_details& err){
+        if (err.is_spec_error() && err.epub_error_code() == EPUBError::OPFManifestOutOfOrder)
+            outOfOrder++;
+        return true;
+    });
+
+    ContainerPtr c = Container::OpenContainer("TestData/childrens-literature-20120722.epub");
+    PackagePtr pkg = Package::New(c, "application/oebps-package+xml");
+    bool opened = pkg->_OpenStreamForTest(kMalformedOutOfOrder, strlen(kMalformedOutOfOrder), "EPUB/");
+
+    SetErrorHandler(DefaultErrorHandler);
+    REQUIRE(opened);
+    REQUIRE(outOfOrder == 1);
+    REQUIRE(pkg->PackageID() == "urn:test");
+    REQUIRE(pkg->Manifest().size() == 2);
+}
@@ -0,0 +1,196 @@
+//
+//  zip_archive_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/zip_archive.h"
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "../ePub3/utilities/byte_stream.h"
+#include <libzip/zip.h>
+#include "catch.hpp"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+using namespace ePub3;
+
+#define ARCHIVE_PATH        "zip_archive_test.zip"
+
+static void AddBuffer(struct zip* zip, const char* name, const char* data)
+{
+    struct zip_source* src = zip_source_buffer(zip, data, strlen(data), 0);
+    REQUIRE(src != nullptr);
+    REQUIRE(zip_add(zip, name, src) >= 0);
+}
+
+static void CreateTestArchive()
+{
+    remove(ARCHIVE_PATH);
+    int zerr = 0;
+    struct zip* zip = zip_open(ARCHIVE_PATH, ZIP_CREATE, &zerr);
+    REQUIRE(zip != nullptr);
+    AddBuffer(zip, "mimetype", "application/epub+zip");
+    AddBuffer(zip, "OPS/Chapter 1.xhtml", "one");
+    AddBuffer(zip, "OPS/Images/Cover.JPG", "cover");
+    REQUIRE(zip_close(zip) == 0);
+}
+
+static std::string ReadAll(ByteStream* stream)
+{
+    std::string result;
+    char buf[64];
+    ByteStream::size_type n = 0;
+    while ( (n = stream->ReadBytes(buf, sizeof(buf))) > 0 )
+        result.append(buf, n);
+    return result;
+}
+
+TEST_CASE("Zip archive lookups normalize paths once", "")
+{
+    CreateTestArchive();
+    {
+        ZipArchive archive(ARCHIVE_PATH);
+
+        REQUIRE(archive.IndexOfItem("mimetype") >= 0);
+        REQUIRE(archive.IndexOfItem("/mimetype") == archive.IndexOfItem("mimetype"));
+        REQUIRE(archive.IndexOfItem("OPS/Chapter%201.xhtml") == archive.IndexOfItem("OPS/Chapter 1.xhtml"));
+        REQUIRE(archive.IndexOfItem("OPS/missing.xhtml") == -1);
+
+        REQUIRE(archive.ContainsItem("/OPS/Chapter%201.xhtml"));
+        REQUIRE_FALSE(archive.ContainsItem("ops/chapter 1.xhtml"));
+
+        auto stream = archive.ByteStreamAtPath("OPS/Chapter%201.xhtml");
+        REQUIRE(stream->IsOpen());
+        REQUIRE(ReadAll(stream.get()) == "one");
+
+        REQUIRE(archive.InfoAtPath("mimetype").UncompressedSize() == 20);
+        REQUIRE_THROWS(archive.InfoAtPath("missing"));
+        REQUIRE_FALSE(archive.ByteStreamAtPath("missing")->IsOpen());
+        REQUIRE(archive.ReaderAtPath("missing") == nullptr);
+    }
+    remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Zip archive lookups can ignore case", "")
+{
+    CreateTestArchive();
+    {
+        ZipArchive archive(ARCHIVE_PATH);
+        REQUIRE_FALSE(archive.UsesCaseInsensitiveLookup());
+        REQUIRE_FALSE(archive.ContainsItem("OPS/images/cover.jpg"));
+
+        archive.SetCaseInsensitiveLookup(true);
+        REQUIRE(archive.ContainsItem("OPS/images/cover.jpg"));
+        REQUIRE(archive.IndexOfItem("ops/IMAGES/cover.jpg") == archive.IndexOfItem("OPS/Images/Cover.JPG"));
+
+        auto stream = archive.ByteStreamAtPath("ops/images/cover.jpg");
+        REQUIRE(ReadAll(stream.get()) == "cover");
+
+        archive.SetCaseInsensitiveLookup(false);
+        REQUIRE_FALSE(archive.ContainsItem("OPS/images/cover.jpg"));
+    }
+    remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Zip archive name index follows deletions and new folders", "")
+{
+    CreateTestArchive();
+    {
+        ZipArchive archive(ARCHIVE_PATH);
+        archive.SetCaseInsensitiveLookup(true);
+
+        REQUIRE(archive.DeleteItem("OPS/Chapter 1.xhtml"));
+        REQUIRE_FALSE(archive.ContainsItem("OPS/Chapter 1.xhtml"));
+        REQUIRE_FALSE(archive.ContainsItem("ops/chapter 1.xhtml"));
+        REQUIRE_FALSE(archive.DeleteItem("OPS/Chapter 1.xhtml"));
+
+        REQUIRE(archive.CreateFolder("OPS/Fonts/"));
+        REQUIRE(archive.ContainsItem("OPS/Fonts/"));
+        REQUIRE(archive.ContainsItem("ops/fonts/"));
+    }
+    remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Zip streams seek within stored and deflated entries", "")
+{
+    std::string content;
+    for ( int i = 0; i < 20000; i++ )
+        content += static_cast<char>('a' + (i * 7) % 26);
+    {
+        ZipStreamWriter writer(ARCHIVE_PATH);
+        writer.AddEntry("stored.bin", content.data(), content.size(), false);
+        writer.AddEntry("deflated.bin", content.data(), content.size(), true);
+        REQUIRE(writer.Close());
+    }
+    {
+        ZipArchive archive(ARCHIVE_PATH);
+        for ( const char* path : { "stored.bin", "deflated.bin" } )
+        {
+            auto stream = archive.ByteStreamAtPath(path);
+            SeekableByteStream* seekable = dynamic_cast<SeekableByteStream*>(stream.get());
+            REQUIRE(seekable != nullptr);
+
+            // forwards, backwards, and back to the start, reading to the end each time
+            for ( size_t offset : { 12345, 100, 19999, 0 } )
+            {
+                REQUIRE(seekable->Seek(offset, std::ios::beg) == offset);
+                REQUIRE(seekable->BytesAvailable() == content.size() - offset);
+                REQUIRE(ReadAll(seekable) == content.substr(offset));
+                REQUIRE(seekable->IsOpen());
+            }
+        }
+    }
+    remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("Stored zip entries are located within the archive file", "")
+{
+    std::string content(70000, '\0');
+    for ( size_t i = 0; i < content.size(); i++ )
+        content[i] = static_cast<char>(i * 31);
+    {
+        ZipStreamWriter writer(ARCHIVE_PATH);
+        writer.AddEntry("mimetype", "application/epub+zip", 20, false);
+        writer.AddEntry("EPUB/images/a long name for the stored entry.bin", content.data(), content.size(), false);
+        writer.AddEntry("deflated.bin", content.data(), content.size(), true);
+        REQUIRE(writer.Close());
+    }
+    {
+        ZipArchive archive(ARCHIVE_PATH);
+        int stored = archive.IndexOfItem("EPUB/images/a long name for the stored entry.bin");
+        REQUIRE(stored >= 0);
+
+        FileRange range;
+        REQUIRE(archive.FileRangeAtIndex(stored, range));
+        REQUIRE(range.length == content.size());
+        REQUIRE(range.offset > 0);
+
+        std::string bytes(content.size(), '\0');
+        REQUIRE(pread(range.fd, &bytes[0], bytes.size(), off_t(range.offset)) == ssize_t(bytes.size()));
+        REQUIRE(bytes == content);
+
+        // the stream reports the same place, wherever it's read to, and reads on afterwards
+        auto stream = archive.ByteStreamAtIndex(stored);
+        char buf[100];
+        REQUIRE(stream->ReadBytes(buf, sizeof(buf)) == sizeof(buf));
+        FileRange streamRange;
+        REQUIRE(stream->GetFileRange(streamRange));
+        REQUIRE(streamRange.fd == range.fd);
+        REQUIRE(streamRange.offset == range.offset);
+        REQUIRE(streamRange.length == range.length);
+        REQUIRE(ReadAll(stream.get()) == content.substr(sizeof(buf)));
+
+        REQUIRE_FALSE(archive.FileRangeAtIndex(archive.IndexOfItem("deflated.bin"), range));
+        REQUIRE_FALSE(archive.ByteStreamAtPath("deflated.bin")->GetFileRange(range));
+        REQUIRE_FALSE(archive.FileRangeAtIndex(-1, range));
+    }
+    remove(ARCHIVE_PATH);
+}
@@ -0,0 +1,306 @@
+//
+//  zip_stream_writer_tests.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+//  1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//  3. Neither the name of the organization nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+//
+
+
+#include "../ePub3/ePub/zip_stream_writer.h"
+#include "../ePub3/ePub/zip_archive.h"
+#include "../ePub3/utilities/byte_stream.h"
+#include <libzip/zip.h>
+#include "catch.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace ePub3;
+
+#define EPUB_PATH           "TestData/childrens-literature-20120722.epub"
+#define ARCHIVE_PATH        "zip_stream_writer_test.zip"
+#define REPACKED_PATH       "zip_stream_writer_repacked.epub"
+
+static bool ReadEntry(struct zip* zip, const char* name, std::string& out)
+{
+    struct zip_stat info;
+    if ( zip_stat(zip, name, 0, &info) < 0 )
+        return false;
+
+    struct zip_file* file = zip_fopen(zip, name, 0);
+    if ( file == nullptr )
+        return false;
+
+    out.resize(static_cast<size_t>(info.size));
+    ssize_t num = (info.size == 0 ? 0 : zip_fread(file, &out[0], out.size()));
+
+    // zip_fclose() checks the CRC
+    return zip_fclose(file) == 0 && num == static_cast<ssize_t>(out.size());
+}
+
+// compressible, but not trivially so
+static std::string MakeText(size_t length, unsigned seed)
+{
+    static const char* words[] = { "the ", "whale ", "sea ", "Ishmael ", "ship ", "harpoon ", "<p>", "</p>\n", "captain ", "white " };
+    std::string result;
+    result.reserve(length + 16);
+    while ( result.size() < length )
+    {
+        seed = seed * 1103515245 + 12345;
+        result.append(words[(seed >> 16) % 10]);
+    }
+    result.resize(length);
+    return result;
+}
+
+static std::string MakeNoise(size_t length, unsigned seed)
+{
+    std::string result(length, '\0');
+    for ( auto& ch : result )
+    {
+        seed = seed * 1103515245 + 12345;
+        ch = static_cast<char>(seed >> 16);
+    }
+    return result;
+}
+
+TEST_CASE("ZipStreamWriter writes archives libzip can read", "")
+{
+    std::string chapter = MakeText(100000, 1);
+    std::string noise = MakeNoise(50000, 2);
+
+    ZipStreamWriter::Options options;
+    options.threadCount = 4;
+    options.chunkSize = 64*1024;            // split the large entry into several chunks
+    std::string large = MakeText(1000000, 3);
+
+    remove(ARCHIVE_PATH);
+    {
+        ZipStreamWriter writer(ARCHIVE_PATH, options);
+        REQUIRE(writer.AddEntry("mimetype", "application/epub+zip", 20));
+        REQUIRE(writer.CreateFolder("OPS"));
+        REQUIRE(writer.AddEntry("/OPS/chapter.xhtml", chapter.data(), chapter.size()));
+        REQUIRE(writer.AddEntry("OPS/noise.bin", std::string(noise)));
+        REQUIRE(writer.AddEntry("OPS/large.xhtml", std::string(large)));
+        REQUIRE(writer.AddEntry("OPS/empty.txt", std::string()));
+        REQUIRE(writer.AddEntry("OPS/stored.txt", std::string("stored"), false));
+
+        // the mimetype must come first
+        REQUIRE_FALSE(writer.AddEntry("mimetype", "application/epub+zip", 20));
+
+        REQUIRE(writer.EntryCount() == 7);
+        REQUIRE(writer.Close());
+        REQUIRE_FALSE(writer.AddEntry("OPS/late.txt", std::string("late")));
+    }
+
+    int zerr = 0;
+    struct zip* zip = zip_open(ARCHIVE_PATH, ZIP_CHECKCONS, &zerr);
+    REQUIRE(zip != nullptr);
+    REQUIRE(zip_get_num_files(zip) == 7);
+
+    struct zip_stat info;
+    REQUIRE(zip_stat_index(zip, 0, 0, &info) == 0);
+    REQUIRE(std::string(info.name) == "mimetype");
+    REQUIRE(info.comp_method == ZIP_CM_STORE);
+
+    REQUIRE(zip_name_locate(zip, "OPS/", 0) >= 0);
+
+    std::string content;
+    REQUIRE(ReadEntry(zip, "mimetype", content));
+    REQUIRE(content == "application/epub+zip");
+    REQUIRE(ReadEntry(zip, "OPS/chapter.xhtml", content));
+    REQUIRE(content == chapter);
+    REQUIRE(ReadEntry(zip, "OPS/noise.bin", content));
+    REQUIRE(content == noise);
+    REQUIRE(ReadEntry(zip, "OPS/large.xhtml", content));
+    REQUIRE(content == large);
+    REQUIRE(ReadEntry(zip, "OPS/empty.txt", content));
+    REQUIRE(content.empty());
+    REQUIRE(ReadEntry(zip, "OPS/stored.txt", content));
+    REQUIRE(content == "stored");
+
+    // text is deflated, noise is stored rather than grown
+    REQUIRE(zip_stat(zip, "OPS/large.xhtml", 0, &info) == 0);
+    REQUIRE(info.comp_method == ZIP_CM_DEFLATE);
+    REQUIRE(info.comp_size < info.size / 2);
+    REQUIRE(zip_stat(zip, "OPS/noise.bin", 0, &info) == 0);
+    REQUIRE(info.comp_method == ZIP_CM_STORE);
+
+    zip_close(zip);
+    remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("ZipStreamWriter entry writers add their content when destroyed", "")
+{
+    remove(ARCHIVE_PATH);
+    {
+        ZipStreamWriter writer(ARCHIVE_PATH);
+        {
+            auto entry = writer.WriterForEntry("OPS/written.xhtml");
+            REQUIRE(bool(entry));
+            REQUIRE_FALSE(!(*entry));
+            REQUIRE(entry->write("<html>", 6) == 6);
+            REQUIRE(entry->write("</html>", 7) == 7);
+            REQUIRE(entry->total_size() == 13);
+        }
+        REQUIRE(writer.EntryCount() == 1);
+        REQUIRE(writer.WriterForEntry("mimetype") == nullptr);
+        REQUIRE(writer.Close());
+    }
+
+    ZipArchive archive(ARCHIVE_PATH);
+    auto stream = archive.ByteStreamAtPath("OPS/written.xhtml");
+    REQUIRE(stream->IsOpen());
+    char buf[32] = {0};
+    REQUIRE(stream->ReadBytes(buf, sizeof(buf)) == 13);
+    REQUIRE(std::string(buf) == "<html></html>");
+    remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("ZipStreamWriter repacks an EPUB, changing selected entries", "")
+{
+    static const std::string kWatermark("<!-- watermark -->");
+    auto select = [](const string& path) { return path.find(".xhtml") != string::npos; };
+    auto transform = [](const string& path, std::string& content) { content.append(kWatermark); };
+
+    remove(REPACKED_PATH);
+    REQUIRE(ZipStreamWriter::Repack(EPUB_PATH, REPACKED_PATH, select, transform));
+
+    int zerr = 0;
+    struct zip* source = zip_open(EPUB_PATH, 0, &zerr);
+    struct zip* repacked = zip_open(REPACKED_PATH, ZIP_CHECKCONS, &zerr);
+    REQUIRE(source != nullptr);
+    REQUIRE(repacked != nullptr);
+    REQUIRE(zip_get_num_files(repacked) == zip_get_num_files(source));
+
+    struct zip_stat info;
+    REQUIRE(zip_stat_index(repacked, 0, 0, &info) == 0);
+    REQUIRE(std::string(info.name) == "mimetype");
+    REQUIRE(info.comp_method == ZIP_CM_STORE);
+
+    int numChanged = 0;
+    for ( int i = 0; i < zip_get_num_files(source); i++ )
+    {
+        const char* name = zip_get_name(source, i, 0);
+        REQUIRE(name != nullptr);
+
+        std::string original, copy;
+        REQUIRE(ReadEntry(source, name, original));
+        REQUIRE(ReadEntry(repacked, name, copy));
+        if ( select(name) )
+        {
+            REQUIRE(copy == std::string(original).append(kWatermark));
+            numChanged++;
+        }
+        else
+        {
+            REQUIRE(copy == original);
+        }
+    }
+    REQUIRE(numChanged > 0);
+
+    zip_close(source);
+    zip_close(repacked);
+
+    REQUIRE_FALSE(ZipStreamWriter::Repack("missing.epub", REPACKED_PATH, select, transform));
+    remove(REPACKED_PATH);
+}
+
+static std::string ReadFile(const char* path)
+{
+    std::ifstream file(path, std::ios::in|std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void CreateUpdateArchive(const char* path, size_t payloadSize)
+{
+    remove(path);
+    ZipStreamWriter writer(path);
+    REQUIRE(writer.AddEntry("mimetype", "application/epub+zip", 20));
+    REQUIRE(writer.AddEntry("OEBPS/content.opf", std::string("<package version=\"3.0\"/>")));
+    REQUIRE(writer.AddEntry("OEBPS/chapter.xhtml", MakeText(20000, 4)));
+    REQUIRE(writer.AddEntry("OEBPS/audio.mp3", MakeNoise(payloadSize, 5), false));
+    REQUIRE(writer.AddEntry("OEBPS/old.xhtml", std::string("old")));
+    REQUIRE(writer.Close());
+}
+
+TEST_CASE("ZipStreamWriter updates archives in place", "")
+{
+    CreateUpdateArchive(ARCHIVE_PATH, 100000);
+    std::string original = ReadFile(ARCHIVE_PATH);
+
+    {
+        auto writer = ZipStreamWriter::OpenForUpdate(ARCHIVE_PATH);
+        REQUIRE(writer->EntryCount() == 5);
+        REQUIRE(writer->BytesWritten() == original.size());
+
+        REQUIRE(writer->AddEntry("OEBPS/content.opf", std::string("<package version=\"3.0\" unique-identifier=\"id\"/>")));
+        REQUIRE(writer->AddEntry("OEBPS/added.xhtml", std::string("added")));
+        REQUIRE(writer->RemoveEntry("OEBPS/old.xhtml"));
+        REQUIRE_FALSE(writer->RemoveEntry("OEBPS/missing.xhtml"));
+        REQUIRE_FALSE(writer->AddEntry("mimetype", "application/epub+zip", 20));
+        REQUIRE(writer->Close());
+    }
+
+    // nothing before the appended data has changed, except the old end record's signature
+    std::string updated = ReadFile(ARCHIVE_PATH);
+    REQUIRE(updated.size() > original.size());
+    size_t endRecord = original.size() - 22;
+    REQUIRE(updated.compare(0, endRecord, original, 0, endRecord) == 0);
+    REQUIRE(updated.compare(endRecord, 4, std::string(4, '\0')) == 0);
+
+    int zerr = 0;
+    struct zip* zip = zip_open(ARCHIVE_PATH, ZIP_CHECKCONS, &zerr);
+    REQUIRE(zip != nullptr);
+    REQUIRE(zip_get_num_files(zip) == 5);
+    REQUIRE(std::string(zip_get_name(zip, 0, 0)) == "mimetype");
+    REQUIRE(zip_name_locate(zip, "OEBPS/old.xhtml", 0) < 0);
+
+    std::string content;
+    REQUIRE(ReadEntry(zip, "OEBPS/content.opf", content));
+    REQUIRE(content == "<package version=\"3.0\" unique-identifier=\"id\"/>");
+    REQUIRE(ReadEntry(zip, "OEBPS/added.xhtml", content));
+    REQUIRE(content == "added");
+    REQUIRE(ReadEntry(zip, "OEBPS/chapter.xhtml", content));
+    REQUIRE(content == MakeText(20000, 4));
+    REQUIRE(ReadEntry(zip, "OEBPS/audio.mp3", content));
+    REQUIRE(content == MakeNoise(100000, 5));
+    zip_close(zip);
+
+    // compaction drops the superseded data
+    REQUIRE(ZipStreamWriter::Compact(ARCHIVE_PATH));
+    std::string compacted = ReadFile(ARCHIVE_PATH);
+    REQUIRE(compacted.size() < updated.size());
+
+    zip = zip_open(ARCHIVE_PATH, ZIP_CHECKCONS, &zerr);
+    REQUIRE(zip != nullptr);
+    REQUIRE(zip_get_num_files(zip) == 5);
+    REQUIRE(ReadEntry(zip, "OEBPS/content.opf", content));
+    REQUIRE(content == "<package version=\"3.0\" unique-identifier=\"id\"/>");
+    REQUIRE(ReadEntry(zip, "OEBPS/audio.mp3", content));
+    REQUIRE(content == MakeNoise(100000, 5));
+    zip_close(zip);
+
+    remove(ARCHIVE_PATH);
+}
+
+TEST_CASE("ZipStreamWriter only updates ZIP archives", "")
+{
+    remove(ARCHIVE_PATH);
+    REQUIRE_THROWS(ZipStreamWriter::OpenForUpdate(ARCHIVE_PATH));
+
+    {
+        std::ofstream file(ARCHIVE_PATH, std::ios::out|std::ios::binary);
+        file << "This is not a ZIP archive, although it is long enough to look like one.";
+    }
+    REQUIRE_THROWS(ZipStreamWriter::OpenForUpdate(ARCHIVE_PATH));
+    REQUIRE_FALSE(ZipStreamWriter::Compact(ARCHIVE_PATH));
+    REQUIRE(ReadFile(ARCHIVE_PATH) == "This is not a ZIP archive, although it is long enough to look like one.");
+    remove(ARCHIVE_PATH);
+}
@@ -46,6 +46,26 @@
 #if EPUB_OS(WINDOWS)
 # define strlcat(dst,src,sz) strcat_s(dst,sz,src)
 # define strlcpy(dst,src,sz) strcpy_s(dst,sz,src)
+#elif defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+// glibc only gained these in 2.38
+static size_t strlcpy(char* dst, const char* src, size_t sz)
+{
+    size_t len = strlen(src);
+    if ( sz != 0 )
+    {
+        size_t n = (len >= sz ? sz - 1 : len);
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+static size_t strlcat(char* dst, const char* src, size_t sz)
+{
+    size_t used = strnlen(dst, sz);
+    if ( used == sz )
+        return sz + strlen(src);
+    return used + strlcpy(dst + used, src, sz - used);
+}
 #endif
 
 #if USING_ICU
@@ -116,6 +116,17 @@ int _zip_fseek_bytes(struct zip_file* zf, off_t abspos, off_t flen)
         zf->flags &= ~ZIP_ZF_EOF;
         zf->bytes_left = flen - abspos;
     }
+    
+    /* the data is stored, so the archive offset moves with the file offset */
+    zf->fpos += abspos - zf->file_fpos;
+    zf->cbytes_left = (abspos < flen ? flen - abspos : 0);
+    
+    /* the checksum can only be verified by reading everything from the start */
+    if (abspos == 0)
+        zf->crc = crc32(0L, Z_NULL, 0);
+    else
+        zf->flags &= ~ZIP_ZF_CRC;
+    
     zf->file_fpos = abspos;
     return 0;
 }
@@ -156,12 +167,16 @@ int _zip_fseek_to_start(struct zip_file* zf)
     
     zf->flags &= ~ZIP_ZF_EOF;
     zf->file_fpos = 0;
+    zf->crc = crc32(0L, Z_NULL, 0);
     zf->bytes_left = zf->za->cdir->entry[zf->file_index].uncomp_size;
     zf->cbytes_left = zf->za->cdir->entry[zf->file_index].comp_size;
     zf->fpos = _zip_file_get_offset_safe(zf->za, zf->file_index);
     
     len = _zip_file_fillbuf(zf->buffer, BUFSIZE, zf);
     
+    /* discard the old state while its allocators are still set, or zlib refuses to free it */
+    inflateEnd(zf->zstr);
+    
     zf->zstr->zalloc = Z_NULL;
     zf->zstr->zfree = Z_NULL;
 	zf->zstr->opaque = NULL;
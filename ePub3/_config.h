@@ -192,6 +192,11 @@ typedef signed long ssize_t;
 # define EPUB_ENABLE_XML_C14N 0
 #endif
 
+// timing and probes on the hot paths; see ePub3/utilities/instrumentation.h
+#ifndef EPUB_ENABLE_INSTRUMENTATION
+# define EPUB_ENABLE_INSTRUMENTATION 1
+#endif
+
 #if EPUB_COMPILER_SUPPORTS(CXX_DELETED_FUNCTIONS)
 # define _DELETED_ = delete
 #else
@@ -68,6 +68,19 @@ FilterContext *PassThroughFilter::InnerMakeFilterContext(ConstManifestItemPtr it
     return new PassThroughContext;
 }
 
+bool PassThroughFilter::ResetFilterContext(FilterContext *context) const
+{
+    PassThroughContext *ptContext = dynamic_cast<PassThroughContext *>(context);
+    if (ptContext == nullptr)
+    {
+        return false;
+    }
+
+    // the context holds nothing specific to a single manifest item
+    ptContext->ResetRangeState();
+    return true;
+}
+
 ByteStream::size_type PassThroughFilter::BytesAvailable(SeekableByteStream *byteStream) const
 {
     return byteStream->BytesAvailable();
@@ -121,7 +134,8 @@ void *PassThroughFilter::FilterData(FilterContext *context, void *data, size_t l
         return nullptr;
     }
 
-    uint8_t *buffer = ptContext->GetAllocateTemporaryByteBuffer(bytesToRead);
+    // this writes straight into the caller's buffer whenever it is large enough
+    uint8_t *buffer = ptContext->GetOutputByteBuffer(bytesToRead);
 
     ByteStream::size_type readBytes = byteStream->ReadBytes(buffer, bytesToRead);
     *outputLen = readBytes;
@@ -42,11 +42,13 @@ public:
     virtual OperatingMode GetOperatingMode() const OVERRIDE { return OperatingMode::SupportsByteRanges; }
 
     virtual ByteStream::size_type BytesAvailable(SeekableByteStream *byteStream) const OVERRIDE;
+    virtual string CacheIdentity() const OVERRIDE { return "PassThroughFilter"; }
 
     static void Register();
 
 protected:
     virtual FilterContext *InnerMakeFilterContext(ConstManifestItemPtr item) const OVERRIDE;
+    virtual bool ResetFilterContext(FilterContext *context) const OVERRIDE;
 
 private:
     static bool SniffPassThroughContent(ConstManifestItemPtr item);
@@ -0,0 +1,369 @@
+//
+//  aes_cbc_decryption.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <ePub3/base.h>
+
+// OpenSSL APIs are deprecated on OS X and iOS
+#if EPUB_OS(DARWIN)
+#include <CommonCrypto/CommonCryptor.h>
+#elif !EPUB_PLATFORM(WIN) && !EPUB_PLATFORM(WINRT)
+#include <openssl/evp.h>
+#endif
+
+#include "aes_cbc_decryption.h"
+#include "container.h"
+#include "package.h"
+#include "filter_manager.h"
+#include <cstring>
+#include <mutex>
+
+EPUB3_BEGIN_NAMESPACE
+
+static std::mutex                       gKeyProviderLock;
+static AESCBCDecryptor::KeyProviderFn   gKeyProvider;
+static AESCBCDecryptor::KeyIdentityFn   gKeyIdentity;
+
+/**
+ Everything needed to read one item: its key, the lengths of its ciphertext and
+ plaintext once known, and the cipher state.
+ 
+ The key belongs to a single item, so these contexts are never recycled.
+ */
+class AESCBCDecryptor::AESCBCContext : public RangeFilterContext
+{
+public:
+    AESCBCContext() : RangeFilterContext(), _key(), _cipherLength(0), _plainLength(0)
+#if !EPUB_OS(DARWIN) && !EPUB_PLATFORM(WIN) && !EPUB_PLATFORM(WINRT)
+        , _cipher(nullptr)
+#endif
+    {
+        _key.SetUsesSecureErasure();
+    }
+    virtual ~AESCBCContext()
+    {
+#if !EPUB_OS(DARWIN) && !EPUB_PLATFORM(WIN) && !EPUB_PLATFORM(WINRT)
+        if ( _cipher != nullptr )
+            EVP_CIPHER_CTX_free(_cipher);
+#endif
+    }
+    
+    ByteBuffer& Key()                                       { return _key; }
+    bool HasKey()                                   const   { return _key.GetBufferSize() != 0; }
+    
+    ///
+    /// The length of the raw data, IV included, or zero if not yet known.
+    ByteStream::size_type CipherLength()            const   { return _cipherLength; }
+    void SetCipherLength(ByteStream::size_type len)         { _cipherLength = len; }
+    ///
+    /// The length of the data once decrypted and unpadded, or zero if not yet known.
+    ByteStream::size_type PlainLength()             const   { return _plainLength; }
+    void SetPlainLength(ByteStream::size_type len)          { _plainLength = len; }
+    
+    /**
+     Decrypts whole blocks.
+     @param iv The ciphertext block preceding `in`.
+     @param in The ciphertext.
+     @param out Storage for the plaintext; may be the same as `in`.
+     @param len The number of bytes to decrypt, a multiple of BlockSize.
+     */
+    bool Decrypt(const uint8_t* iv, const uint8_t* in, uint8_t* out, size_t len);
+    
+private:
+    ByteBuffer              _key;
+    ByteStream::size_type   _cipherLength;
+    ByteStream::size_type   _plainLength;
+#if !EPUB_OS(DARWIN) && !EPUB_PLATFORM(WIN) && !EPUB_PLATFORM(WINRT)
+    EVP_CIPHER_CTX*         _cipher;
+#endif
+};
+
+bool AESCBCDecryptor::AESCBCContext::Decrypt(const uint8_t *iv, const uint8_t *in, uint8_t *out, size_t len)
+{
+    if ( len == 0 )
+        return true;
+    
+#if EPUB_OS(DARWIN)
+    size_t moved = 0;
+    CCCryptorStatus status = CCCrypt(kCCDecrypt, kCCAlgorithmAES, 0, _key.GetBytes(), _key.GetBufferSize(),
+                                     iv, in, len, out, len, &moved);
+    return status == kCCSuccess && moved == len;
+#elif EPUB_PLATFORM(WIN) || EPUB_PLATFORM(WINRT)
+    // no CNG implementation yet; Register() doesn't install the filter here
+    return false;
+#else
+    const EVP_CIPHER* algorithm = nullptr;
+    switch ( _key.GetBufferSize() )
+    {
+        case 16:
+            algorithm = EVP_aes_128_cbc();
+            break;
+        case 24:
+            algorithm = EVP_aes_192_cbc();
+            break;
+        case 32:
+            algorithm = EVP_aes_256_cbc();
+            break;
+        default:
+            return false;
+    }
+    
+    if ( _cipher == nullptr && (_cipher = EVP_CIPHER_CTX_new()) == nullptr )
+        return false;
+    
+    // XML-ENC padding isn't quite PKCS#7, so we remove it ourselves
+    if ( EVP_DecryptInit_ex(_cipher, algorithm, nullptr, _key.GetBytes(), iv) != 1 )
+        return false;
+    EVP_CIPHER_CTX_set_padding(_cipher, 0);
+    
+    int outLen = 0;
+    if ( EVP_DecryptUpdate(_cipher, out, &outLen, in, static_cast<int>(len)) != 1 )
+        return false;
+    return static_cast<size_t>(outLen) == len;
+#endif
+}
+
+// reads exactly `len` bytes at `offset`, or fails
+static bool ReadFully(SeekableByteStream *byteStream, ByteStream::size_type offset, uint8_t *buf, ByteStream::size_type len)
+{
+    byteStream->Seek(offset, std::ios::beg);
+    while ( len > 0 )
+    {
+        ByteStream::size_type num = byteStream->ReadBytes(buf, len);
+        if ( num == 0 )
+            return false;
+        buf += num;
+        len -= num;
+    }
+    return true;
+}
+
+// the number of padding bytes at the end of a decrypted final block, or zero if it's malformed
+static size_t PaddingLength(const uint8_t *lastBlock)
+{
+    size_t padding = lastBlock[AESCBCDecryptor::BlockSize-1];
+    if ( padding == 0 || padding > AESCBCDecryptor::BlockSize )
+        return 0;
+    return padding;
+}
+
+size_t AESCBCDecryptor::KeySizeForAlgorithm(const string &algorithm)
+{
+    if ( algorithm == "http://www.w3.org/2001/04/xmlenc#aes128-cbc" )
+        return 16;
+    if ( algorithm == "http://www.w3.org/2001/04/xmlenc#aes192-cbc" )
+        return 24;
+    if ( algorithm == "http://www.w3.org/2001/04/xmlenc#aes256-cbc" )
+        return 32;
+    return 0;
+}
+
+bool AESCBCDecryptor::AESCBCTypeSniffer(ConstManifestItemPtr item)
+{
+    EncryptionInfoPtr encInfo = item->GetEncryptionInfo();
+    return encInfo != nullptr && KeySizeForAlgorithm(encInfo->Algorithm()) != 0;
+}
+
+FilterContext *AESCBCDecryptor::InnerMakeFilterContext(ConstManifestItemPtr item) const
+{
+    AESCBCContext* context = new AESCBCContext;
+    if ( !_keyProvider || !item )
+        return context;
+    
+    EncryptionInfoPtr encInfo = item->GetEncryptionInfo();
+    size_t keySize = (encInfo ? KeySizeForAlgorithm(encInfo->Algorithm()) : 0);
+    
+    // a context with no key produces no data
+    if ( keySize == 0 || !_keyProvider(item, context->Key()) || context->Key().GetBufferSize() != keySize )
+        context->Key().RemoveBytes(context->Key().GetBufferSize());
+    
+    return context;
+}
+
+bool AESCBCDecryptor::MeasureContent(AESCBCContext *context, SeekableByteStream *byteStream) const
+{
+    if ( context->CipherLength() == 0 )
+    {
+        ByteStream::size_type length = byteStream->Position() + byteStream->BytesAvailable();
+        if ( length < 2*BlockSize || length % BlockSize != 0 )
+            return false;
+        context->SetCipherLength(length);
+    }
+    return true;
+}
+
+ByteStream::size_type AESCBCDecryptor::BytesAvailable(SeekableByteStream *byteStream) const
+{
+    ByteStream::size_type length = byteStream->Position() + byteStream->BytesAvailable();
+    return (length > BlockSize ? length - BlockSize : 0);
+}
+
+ByteStream::size_type AESCBCDecryptor::BytesAvailable(FilterContext *context, SeekableByteStream *byteStream) const
+{
+    AESCBCContext* p = dynamic_cast<AESCBCContext*>(context);
+    if ( p == nullptr || !p->HasKey() )
+        return 0;
+    
+    if ( p->PlainLength() != 0 )
+        return p->PlainLength();
+    
+    ByteStream::size_type position = byteStream->Position();
+    if ( !MeasureContent(p, byteStream) )
+        return 0;
+    
+    // decrypt the final block, using the one before it as its IV
+    uint8_t blocks[2*BlockSize];
+    ByteStream::size_type length = p->CipherLength();
+    bool ok = ReadFully(byteStream, length - 2*BlockSize, blocks, sizeof(blocks)) &&
+              p->Decrypt(blocks, blocks + BlockSize, blocks + BlockSize, BlockSize);
+    size_t padding = (ok ? PaddingLength(blocks + BlockSize) : 0);
+    BufferPool::SecureErase(blocks, sizeof(blocks));
+    byteStream->Seek(position, std::ios::beg);
+    
+    if ( padding == 0 )
+        return 0;
+    
+    p->SetPlainLength(length - BlockSize - padding);
+    return p->PlainLength();
+}
+
+void * AESCBCDecryptor::FilterData(FilterContext *context, void *data, size_t len, size_t *outputLen)
+{
+    *outputLen = 0;
+    
+    AESCBCContext* p = dynamic_cast<AESCBCContext*>(context);
+    if ( p == nullptr || !p->HasKey() )
+        return nullptr;
+    
+    // the raw bytes are needed, so this filter always reads them itself
+    SeekableByteStream* byteStream = p->GetSeekableByteStream();
+    if ( byteStream == nullptr || !byteStream->IsOpen() || !MeasureContent(p, byteStream) )
+        return nullptr;
+    
+    // the plaintext range [begin, end), with blocks numbered from the end of the IV
+    ByteStream::size_type blockCount = p->CipherLength()/BlockSize - 1;
+    ByteStream::size_type begin = 0, end = blockCount * BlockSize;
+    ByteRange& range = p->GetByteRange();
+    if ( !range.IsFullRange() )
+    {
+        begin = range.Location();
+        end = std::min(end, begin + range.Length());
+    }
+    if ( p->PlainLength() != 0 )
+        end = std::min(end, p->PlainLength());
+    if ( begin >= end )
+        return nullptr;
+    
+    ByteStream::size_type firstBlock = begin / BlockSize;
+    ByteStream::size_type lastBlock = (end - 1) / BlockSize;
+    ByteStream::size_type numBytes = (lastBlock - firstBlock + 1) * BlockSize;
+    
+    // read the covering blocks together with the one before them, which is the IV
+    // for the first; each block then decrypts in place, one block further along
+    uint8_t* buf = p->GetAllocateTemporaryByteBuffer(numBytes + BlockSize);
+    if ( !ReadFully(byteStream, firstBlock * BlockSize, buf, numBytes + BlockSize) ||
+         !p->Decrypt(buf, buf + BlockSize, buf + BlockSize, numBytes) )
+        return nullptr;
+    
+    if ( lastBlock == blockCount - 1 )
+    {
+        size_t padding = PaddingLength(buf + numBytes);
+        if ( padding == 0 )
+            return nullptr;
+        
+        p->SetPlainLength(blockCount * BlockSize - padding);
+        end = std::min(end, p->PlainLength());
+        if ( begin >= end )
+            return nullptr;
+    }
+    
+    const uint8_t* plaintext = buf + BlockSize + (begin - firstBlock * BlockSize);
+    ByteStream::size_type resultLen = end - begin;
+    
+    // write straight into the caller's buffer where we can, else return the start of our own
+    uint8_t* output = buf;
+    if ( p->GetOutputBuffer() != nullptr && p->GetOutputBufferSize() >= resultLen )
+        output = p->GetOutputBuffer();
+    std::memmove(output, plaintext, resultLen);
+    
+    *outputLen = resultLen;
+    return output;
+}
+
+ContentFilterPtr AESCBCDecryptor::AESCBCDecryptorFactory(ConstPackagePtr package)
+{
+    KeyProviderFn provider;
+    KeyIdentityFn identity;
+    {
+        std::lock_guard<std::mutex> _(gKeyProviderLock);
+        provider = gKeyProvider;
+        identity = gKeyIdentity;
+    }
+    if ( !provider )
+        return nullptr;
+    
+    ConstContainerPtr container = package->GetContainer();
+    for ( auto& encInfo : container->EncryptionData() )
+    {
+        if ( KeySizeForAlgorithm(encInfo->Algorithm()) != 0 )
+            return New(provider, identity);
+    }
+    
+    // nothing here we can decrypt
+    return nullptr;
+}
+
+void AESCBCDecryptor::SetKeyProvider(KeyProviderFn provider, KeyIdentityFn identity)
+{
+    std::lock_guard<std::mutex> _(gKeyProviderLock);
+    gKeyProvider = provider;
+    gKeyIdentity = (provider ? identity : nullptr);
+}
+
+AESCBCDecryptor::KeyProviderFn AESCBCDecryptor::KeyProvider()
+{
+    std::lock_guard<std::mutex> _(gKeyProviderLock);
+    return gKeyProvider;
+}
+
+AESCBCDecryptor::KeyIdentityFn AESCBCDecryptor::KeyIdentity()
+{
+    std::lock_guard<std::mutex> _(gKeyProviderLock);
+    return gKeyIdentity;
+}
+
+string AESCBCDecryptor::CacheIdentityForItem(ConstManifestItemPtr item) const
+{
+    if ( !_keyIdentity || !item )
+        return string();
+    
+    string identity = _keyIdentity(item);
+    if ( identity.empty() )
+        return string();
+    return _Str("AESCBCDecryptor:", identity);
+}
+
+void AESCBCDecryptor::Register()
+{
+#if !EPUB_PLATFORM(WIN) && !EPUB_PLATFORM(WINRT)
+    FilterManager::Instance()->RegisterFilter("AESCBCDecryptor", EPUBDecryption, AESCBCDecryptorFactory);
+#endif
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,194 @@
+//
+//  aes_cbc_decryption.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef __ePub3__aes_cbc_decryption__
+#define __ePub3__aes_cbc_decryption__
+
+#include <ePub3/filter.h>
+#include <ePub3/encryption.h>
+#include <ePub3/utilities/byte_buffer.h>
+#include <functional>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ The AESCBCDecryptor class decrypts resources encrypted using the XML-ENC block
+ encryption algorithms AES-128-CBC, AES-192-CBC and AES-256-CBC.
+ 
+ Each resource's data consists of a 16-byte initialization vector followed by the
+ ciphertext, the last block of which is padded as described by XML-ENC: its final
+ byte holds the number of padding bytes. Since every CBC block can be decrypted
+ given only the ciphertext block which precedes it, this filter supports byte
+ ranges, reading only the blocks covering the requested range plus the one before
+ them; a request for the start of a 1 GB video won't decrypt the rest of it.
+ 
+ The SDK has no way to obtain content keys itself, so the filter is only installed
+ once a key provider has been supplied through SetKeyProvider(). The provider is
+ asked for the key of each encrypted item when a stream is opened on it.
+ 
+ The cipher itself is OpenSSL's EVP interface, which uses the processor's AES
+ instructions where they're available (CommonCrypto on OS X and iOS).
+ @see http://www.w3.org/TR/xmlenc-core1/#sec-Block-Encryption
+ */
+class AESCBCDecryptor : public ContentFilter, public PointerType<AESCBCDecryptor>
+{
+public:
+    ///
+    /// The AES block size, which is also the size of the initialization vector.
+    static const size_t         BlockSize = 16;
+    
+    /**
+     Supplies the key for an encrypted manifest item.
+     @param item The item about to be read.
+     @param key Storage for the key, which must be the length required by the item's
+     algorithm (16, 24 or 32 bytes).
+     @result Return `false` if no key is available for the item; it will then
+     produce no data.
+     */
+    typedef std::function<bool(ConstManifestItemPtr item, ByteBuffer& key)> KeyProviderFn;
+    
+    /**
+     Identifies the key a KeyProviderFn supplies for an item, so that its decrypted
+     content may be shared through the ResourceCache.
+     
+     Items given the same identity must be given the same key, so it should name the
+     key's source as well as the key itself: a license identifier followed by the
+     item's key name, for example.
+     @param item The item about to be read.
+     @result The key's identity, or an empty string to keep the item's plaintext out
+     of the cache.
+     */
+    typedef std::function<string(ConstManifestItemPtr item)>                KeyIdentityFn;
+    
+protected:
+    /**
+     The type-sniffer for AES-CBC decryption.
+     
+     Matches any item whose encryption information names one of the supported
+     algorithms.
+     */
+    static bool AESCBCTypeSniffer(ConstManifestItemPtr item);
+    
+    static ContentFilterPtr AESCBCDecryptorFactory(ConstPackagePtr package);
+    
+private:
+    ///
+    /// There is no default constructor.
+    AESCBCDecryptor() _DELETED_;
+    
+    class AESCBCContext;
+    
+public:
+    /**
+     Create a decryption filter.
+     @param provider The source of item keys. Most clients won't create the filter
+     themselves, but will call SetKeyProvider() and let each Package install it.
+     @param identity Identifies the keys supplied by `provider`; without one,
+     decrypted content is never cached.
+     */
+    AESCBCDecryptor(KeyProviderFn provider, KeyIdentityFn identity = nullptr) : ContentFilter(AESCBCTypeSniffer), _keyProvider(provider), _keyIdentity(identity) {}
+    ///
+    /// Copy constructor.
+    AESCBCDecryptor(const AESCBCDecryptor& o) : ContentFilter(o), _keyProvider(o._keyProvider), _keyIdentity(o._keyIdentity) {}
+    ///
+    /// Move constructor.
+    AESCBCDecryptor(AESCBCDecryptor&& o) : ContentFilter(std::move(o)), _keyProvider(std::move(o._keyProvider)), _keyIdentity(std::move(o._keyIdentity)) {}
+    
+    virtual OperatingMode GetOperatingMode() const OVERRIDE { return OperatingMode::SupportsByteRanges; }
+    
+    /**
+     Without a context the padding can't be decrypted, so this returns the length
+     of the ciphertext less the initialization vector: at most one block more than
+     the plaintext.
+     */
+    virtual ByteStream::size_type BytesAvailable(SeekableByteStream *byteStream) const OVERRIDE;
+    
+    ///
+    /// Returns the exact length of the plaintext, decrypting the final block to find it.
+    virtual ByteStream::size_type BytesAvailable(FilterContext *context, SeekableByteStream *byteStream) const OVERRIDE;
+    
+    /**
+     Decrypted content is placed in the shared ResourceCache only when the key
+     provider came with a KeyIdentityFn, since its keys belong to the provider rather
+     than the publication. The identity it returns for the item is part of the key.
+     */
+    virtual string CacheIdentityForItem(ConstManifestItemPtr item) const OVERRIDE;
+    
+    /**
+     Decrypts the range of the resource given by the RangeFilterContext, reading
+     the ciphertext from its SeekableByteStream.
+     @param context The context created for the item being read.
+     @param data Ignored; the ciphertext is read from the context's stream.
+     @param len Ignored.
+     @param outputLen Storage for the count of bytes being returned.
+     @result The decrypted bytes, or `nullptr` if the item has no key or its data is
+     malformed.
+     */
+    virtual void * FilterData(FilterContext* context, void * data, size_t len, size_t *outputLen) OVERRIDE;
+    
+    /**
+     Returns the key length required by an algorithm.
+     @param algorithm An XML-ENC algorithm URI.
+     @result The key length in bytes, or zero if the algorithm isn't supported.
+     */
+    static size_t KeySizeForAlgorithm(const string& algorithm);
+    
+    /**
+     Sets the source of content keys for packages opened from now on.
+     
+     Packages already open keep the provider they were created with. Passing
+     `nullptr` prevents the filter from being installed in new packages.
+     @param provider The source of item keys.
+     @param identity Identifies the keys `provider` supplies, allowing decrypted
+     content to be shared through the ResourceCache; `nullptr` keeps it out.
+     */
+    EPUB3_EXPORT
+    static void SetKeyProvider(KeyProviderFn provider, KeyIdentityFn identity = nullptr);
+    
+    ///
+    /// Returns the current key provider, which may be `nullptr`.
+    EPUB3_EXPORT
+    static KeyProviderFn KeyProvider();
+    
+    ///
+    /// Returns the identity function installed with the current key provider, which may be `nullptr`.
+    EPUB3_EXPORT
+    static KeyIdentityFn KeyIdentity();
+    
+    static void Register();
+    
+protected:
+    KeyProviderFn       _keyProvider;
+    KeyIdentityFn       _keyIdentity;
+    
+    virtual FilterContext *InnerMakeFilterContext(ConstManifestItemPtr item) const OVERRIDE;
+    
+    /**
+     Finds the length of the resource's ciphertext and, unless it's already known,
+     of its plaintext.
+     @result `false` if the ciphertext isn't a whole number of blocks, or its
+     padding is invalid.
+     */
+    bool MeasureContent(AESCBCContext* context, SeekableByteStream *byteStream) const;
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__aes_cbc_decryption__) */
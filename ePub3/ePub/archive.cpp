@@ -20,6 +20,7 @@
 
 #include "archive.h"
 #include "zip_archive.h"
+#include "byte_stream.h"
 #include <map>
 
 EPUB3_BEGIN_NAMESPACE
@@ -69,5 +70,13 @@ ArchiveItemInfo Archive::InfoAtPath(const string &path) const
     info.SetPath(path);
     return std::move(info);
 }
+unique_ptr<ByteStream> Archive::ByteStreamAtIndex(int index) const
+{
+    return nullptr;
+}
+ArchiveItemInfo Archive::InfoAtIndex(int index) const
+{
+    return ArchiveItemInfo();
+}
 
 EPUB3_END_NAMESPACE
@@ -42,6 +42,7 @@ class ArchiveItemInfo;
 class ArchiveReader;
 class ArchiveWriter;
 class ByteStream;
+struct FileRange;
 
 #ifdef SUPPORT_ASYNC
 class AsyncByteStream;
@@ -256,6 +257,51 @@ public:
      */
     virtual ArchiveItemInfo InfoAtPath(const string & path) const;
     
+    /**
+     Locates an item for use with the index-based accessors below, which don't need
+     to look up its path again.
+     
+     Indices remain valid for as long as the archive is open, unless the item is
+     deleted. The default implementation returns `-1`.
+     @param path The path of an item within the archive.
+     @result An archive-specific index for the item, or `-1` if there is no such item
+     or the archive doesn't support index-based access.
+     */
+    virtual int IndexOfItem(const string & path) const { return -1; }
+    
+    /**
+     Obtains a stream to read an item located using IndexOfItem().
+     
+     The default implementation returns `nullptr`.
+     @param index An index returned by IndexOfItem().
+     @result Returns a (managed) pointer to the resulting byte stream, or `nullptr`.
+     */
+    virtual unique_ptr<ByteStream> ByteStreamAtIndex(int index) const;
+    
+    /**
+     Returns detailed information on an item located using IndexOfItem().
+     
+     The default implementation returns an empty ArchiveItemInfo.
+     @param index An index returned by IndexOfItem().
+     @result An object containing detailed information on the requested item.
+     */
+    virtual ArchiveItemInfo InfoAtIndex(int index) const;
+    
+    /**
+     Locates the data of an item located using IndexOfItem() within the archive's
+     own file, so that it can be sent from there without being copied.
+     
+     This is only possible for items which are stored without compression. The
+     default implementation returns `false`.
+     @param index An index returned by IndexOfItem().
+     @param range Filled in with the location of the item's data. The descriptor
+     is the archive's, and remains valid only while the archive is open.
+     @result Returns `true` if the item's bytes are in the file verbatim, `false`
+     otherwise.
+     @see FileRange
+     */
+    virtual bool FileRangeAtIndex(int index, FileRange& range) const { return false; }
+    
     // scary Ghostbusters Zuul voice: "there is no copy, only move"
     ///
     /// Archive objects cannot be copied.
@@ -346,16 +346,17 @@ bool CFI::CompileCFI(const string &str)
             // can safely ignore this one
         }
         
-        // where the delimiters' component ranges overlap, start must be <= end
-        auto maxsz = std::max(_rangeStart.size(), _rangeEnd.size());
+        // where the delimiters' component ranges overlap, start must be <= end; only
+        // the first differing step counts, as later ones lie in different subtrees
+        auto minsz = std::min(_rangeStart.size(), _rangeEnd.size());
         bool inequalNodeIndexFound = false;
-        for ( decltype(maxsz) i = 0; i < maxsz; i++ )
+        for ( decltype(minsz) i = 0; i < minsz && !inequalNodeIndexFound; i++ )
         {
             if ( _rangeStart[i].nodeIndex > _rangeEnd[i].nodeIndex )
             {
                 HandleError(EPUBError::CFIRangeInvalid, "Range components appear to be out of order.");
             }
-            else if ( !inequalNodeIndexFound && _rangeStart[i].nodeIndex < _rangeEnd[i].nodeIndex )
+            else if ( _rangeStart[i].nodeIndex < _rangeEnd[i].nodeIndex )
             {
                 inequalNodeIndexFound = true;
             }
@@ -0,0 +1,455 @@
+//
+//  cfi_step_index.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "cfi_step_index.h"
+#include <ePub3/utilities/error_handler.h>
+#include <libxml/tree.h>
+#include <algorithm>
+#include <numeric>
+
+#if EPUB_USE(LIBXML2)
+
+EPUB3_BEGIN_NAMESPACE
+
+CONSTEXPR uint32_t CFIStepIndex::NoIndex;
+
+// CFI character offsets count UTF-16 code units, libxml2 gives us UTF-8
+static uint32_t UTF16Length(const xmlChar* str)
+{
+    uint32_t result = 0;
+    if ( str == nullptr )
+        return result;
+
+    for ( ; *str != 0; ++str )
+    {
+        uint8_t ch = *str;
+        if ( (ch & 0xC0) == 0x80 )
+            continue;           // continuation byte
+        result += (ch >= 0xF0 ? 2 : 1);
+    }
+    return result;
+}
+
+static std::string IdentifierOf(xmlNodePtr node)
+{
+    std::string result;
+    xmlChar* value = xmlGetNoNsProp(node, BAD_CAST "id");
+    if ( value == nullptr )
+        value = xmlGetNsProp(node, BAD_CAST "id", XML_XML_NAMESPACE);
+    if ( value != nullptr )
+    {
+        result = reinterpret_cast<const char*>(value);
+        xmlFree(value);
+    }
+    return result;
+}
+
+CFIStepIndex::CFIStepIndex(shared_ptr<xml::Document> document) : _document(document), _elements(), _steps(), _text(), _identifiers(), _elementLookup(), _textLookup()
+{
+    if ( !bool(_document) )
+        throw std::invalid_argument("CFIStepIndex requires a document");
+    Build();
+}
+void CFIStepIndex::Build()
+{
+    xmlNodePtr root = xmlDocGetRootElement(_document->xml());
+    if ( root == nullptr )
+        return;
+
+    _elements.push_back(ElementRecord{root, NoIndex, 0, 0, 0, IdentifierOf(root)});
+
+    // breadth-first, so _elements doubles as the work queue
+    for ( uint32_t i = 0; i < _elements.size(); i++ )
+    {
+        // NB: _elements grows as we go, so don't hold references into it
+        xmlNodePtr node = _elements[i].node;
+        uint32_t firstStep = static_cast<uint32_t>(_steps.size());
+        uint32_t stepNum = 1;
+        StepRecord run = {static_cast<uint32_t>(_text.size()), 0, 0};
+
+        for ( xmlNodePtr child = node->children; child != nullptr; child = child->next )
+        {
+            switch ( child->type )
+            {
+                case XML_ELEMENT_NODE:
+                {
+                    // close off the preceding (possibly empty) character data step
+                    _steps.push_back(run);
+                    ++stepNum;
+
+                    uint32_t idx = static_cast<uint32_t>(_elements.size());
+                    _elements.push_back(ElementRecord{child, i, stepNum, 0, 0, IdentifierOf(child)});
+                    _steps.push_back(StepRecord{idx, 0, 0});
+                    ++stepNum;
+
+                    run = StepRecord{static_cast<uint32_t>(_text.size()), 0, 0};
+                    break;
+                }
+
+                case XML_TEXT_NODE:
+                case XML_CDATA_SECTION_NODE:
+                {
+                    uint32_t len = UTF16Length(child->content);
+                    _text.push_back(TextSegment{child, i, stepNum, run.length, len});
+                    run.count++;
+                    run.length += len;
+                    break;
+                }
+
+                default:
+                    // comments & processing instructions don't affect step numbering
+                    break;
+            }
+        }
+
+        _steps.push_back(run);
+        _elements[i].firstStep = firstStep;
+        _elements[i].stepCount = static_cast<uint32_t>(_steps.size()) - firstStep;
+    }
+
+    _elementLookup.reserve(_elements.size());
+    for ( uint32_t i = 0; i < _elements.size(); i++ )
+    {
+        _elementLookup.emplace_back(_elements[i].node, i);
+        if ( !_elements[i].identifier.empty() )
+            _identifiers.emplace(_elements[i].identifier, i);
+    }
+    std::sort(_elementLookup.begin(), _elementLookup.end());
+
+    _textLookup.reserve(_text.size());
+    for ( uint32_t i = 0; i < _text.size(); i++ )
+    {
+        _textLookup.emplace_back(_text[i].node, i);
+    }
+    std::sort(_textLookup.begin(), _textLookup.end());
+}
+uint32_t CFIStepIndex::Lookup(const std::vector<std::pair<NativeNode, uint32_t>>& table, NativeNode node)
+{
+    auto pos = std::lower_bound(table.begin(), table.end(), std::make_pair(node, uint32_t(0)));
+    if ( pos == table.end() || pos->first != node )
+        return NoIndex;
+    return pos->second;
+}
+size_t CFIStepIndex::FirstDocumentStep(const ComponentList& components)
+{
+    for ( size_t i = 0; i < components.size(); i++ )
+    {
+        if ( components[i].IsIndirector() )
+            return i + 1;
+    }
+    return 0;
+}
+
+#if 0
+#pragma mark - Resolution
+#endif
+
+CFIStepIndex::Location CFIStepIndex::ElementLocation(uint32_t element) const
+{
+    return Location(xml::Wrapped<xml::Node, _xmlNode>(_elements[element].node));
+}
+uint32_t CFIStepIndex::ConfirmOrCorrectQualifier(uint32_t element, const Component& component) const
+{
+    if ( !component.HasQualifier() || _elements[element].identifier == component.qualifier.stl_str() )
+        return element;
+
+    // the id assertion takes precedence over the step index
+    auto found = _identifiers.find(component.qualifier.stl_str());
+    if ( found != _identifiers.end() )
+        return found->second;
+
+    HandleError(EPUBError::CFINonAssertedXMLID, _Str("CFI step ", component.nodeIndex, " asserts id '", component.qualifier, "', which doesn't exist in the document"));
+    return element;
+}
+uint32_t CFIStepIndex::ResolveChildElement(uint32_t parent, const Component& component) const
+{
+    const ElementRecord& record = _elements[parent];
+    uint32_t step = component.nodeIndex;
+    if ( step == 0 || step > record.stepCount )
+    {
+        HandleError(EPUBError::CFIStepOutOfBounds, _Str("CFI step ", step, " is out of bounds [1..", record.stepCount, "]"));
+        return NoIndex;
+    }
+    if ( (step & 1) == 1 )
+    {
+        HandleError(EPUBError::CFIStepOutOfBounds, _Str("CFI step ", step, " identifies character data, but is not the terminating step"));
+        return NoIndex;
+    }
+
+    return ConfirmOrCorrectQualifier(_steps[record.firstStep + step - 1].target, component);
+}
+uint32_t CFIStepIndex::ResolveElementPath(uint32_t from, const ComponentList& components, size_t first, size_t last, Cursor* cursor) const
+{
+    uint32_t current = from;
+    size_t i = first;
+
+    if ( cursor != nullptr )
+    {
+        // skip any steps shared with the previously-resolved path
+        auto sameStep = [](const Component& a, const Component& b) {
+            return a.nodeIndex == b.nodeIndex && a.HasQualifier() == b.HasQualifier() && (!a.HasQualifier() || a.qualifier == b.qualifier);
+        };
+        size_t shared = 0;
+        if ( cursor->steps != nullptr )
+        {
+            const ComponentList& prior = *cursor->steps;
+            while ( shared < cursor->path.size() && i + shared < last && cursor->first + shared < prior.size() &&
+                    sameStep(prior[cursor->first + shared], components[i + shared]) )
+            {
+                ++shared;
+            }
+        }
+
+        if ( shared > 0 )
+            current = cursor->path[shared-1];
+        cursor->path.resize(shared);
+        cursor->steps = &components;
+        cursor->first = first;
+        i += shared;
+    }
+
+    for ( ; i < last; i++ )
+    {
+        current = ResolveChildElement(current, components[i]);
+        if ( current == NoIndex )
+        {
+            if ( cursor != nullptr )
+            {
+                cursor->path.clear();
+                cursor->steps = nullptr;
+            }
+            return NoIndex;
+        }
+
+        if ( cursor != nullptr )
+            cursor->path.push_back(current);
+    }
+
+    return current;
+}
+CFIStepIndex::Location CFIStepIndex::ResolveTerminalStep(uint32_t parent, const Component& component) const
+{
+    const ElementRecord& record = _elements[parent];
+    uint32_t step = component.nodeIndex;
+    if ( step == 0 || step > record.stepCount )
+    {
+        HandleError(EPUBError::CFIStepOutOfBounds, _Str("CFI step ", step, " is out of bounds [1..", record.stepCount, "]"));
+        return Location();
+    }
+
+    const StepRecord& target = _steps[record.firstStep + step - 1];
+    if ( (step & 1) == 0 )
+    {
+        if ( component.HasCharacterOffset() )
+            HandleError(EPUBError::CFICharOffsetOnIllegalElement);
+        return ElementLocation(ConfirmOrCorrectQualifier(target.target, component));
+    }
+
+    // character data: find the text node containing the offset
+    uint32_t offset = (component.HasCharacterOffset() ? component.characterOffset : 0);
+    if ( offset > target.length )
+    {
+        HandleError(EPUBError::CFICharOffsetOutOfBounds, _Str("Character offset ", offset, " exceeds length ", target.length));
+        offset = target.length;
+    }
+
+    if ( target.count == 0 )
+    {
+        // an empty position between two elements (or at the start/end of the parent)
+        return ElementLocation(parent);
+    }
+
+    auto begin = _text.begin() + target.target;
+    auto end = begin + target.count;
+    auto pos = std::upper_bound(begin, end, offset, [](uint32_t off, const TextSegment& seg) {
+        return off < seg.offset;
+    });
+    if ( pos != begin )
+        --pos;
+
+    return Location(xml::Wrapped<xml::Node, _xmlNode>(pos->node), offset - pos->offset, component.HasCharacterOffset());
+}
+CFIStepIndex::Location CFIStepIndex::ResolveFrom(uint32_t element, const ComponentList& components) const
+{
+    if ( components.empty() )
+        return ElementLocation(element);
+
+    uint32_t parent = ResolveElementPath(element, components, 0, components.size()-1, nullptr);
+    if ( parent == NoIndex )
+        return Location();
+
+    return ResolveTerminalStep(parent, components.back());
+}
+CFIStepIndex::Range CFIStepIndex::ResolveOne(const CFI& cfi, Cursor* cursor) const
+{
+    Range result;
+    if ( _elements.empty() )
+        return result;
+
+    const ComponentList& base = cfi._components;
+    size_t first = FirstDocumentStep(base);
+
+    if ( !cfi.IsRangeTriplet() )
+    {
+        if ( first >= base.size() )
+        {
+            result.start = result.end = ElementLocation(0);
+            return result;
+        }
+
+        uint32_t parent = ResolveElementPath(0, base, first, base.size()-1, cursor);
+        if ( parent == NoIndex )
+            return result;
+
+        result.start = ResolveTerminalStep(parent, base.back());
+        result.end = result.start;
+        return result;
+    }
+
+    uint32_t element = ResolveElementPath(0, base, first, base.size(), cursor);
+    if ( element == NoIndex )
+        return result;
+
+    result.start = ResolveFrom(element, cfi._rangeStart);
+    result.end = ResolveFrom(element, cfi._rangeEnd);
+    if ( !result.Valid() )
+        return Range();
+
+    return result;
+}
+CFIStepIndex::Range CFIStepIndex::Resolve(const CFI& cfi) const
+{
+    return ResolveOne(cfi, nullptr);
+}
+CFIStepIndex::RangeList CFIStepIndex::Resolve(const CFIList& cfis) const
+{
+    RangeList result(cfis.size());
+
+    // visit the CFIs in document order so that common prefixes are adjacent
+    std::vector<size_t> order(cfis.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&cfis](size_t a, size_t b) {
+        const ComponentList& lhs = cfis[a]._components;
+        const ComponentList& rhs = cfis[b]._components;
+        return std::lexicographical_compare(lhs.begin()+FirstDocumentStep(lhs), lhs.end(),
+                                            rhs.begin()+FirstDocumentStep(rhs), rhs.end(),
+                                            [](const Component& l, const Component& r) {
+                                                return l.nodeIndex < r.nodeIndex;
+                                            });
+    });
+
+    Cursor cursor;
+    for ( size_t idx : order )
+    {
+        try
+        {
+            result[idx] = ResolveOne(cfis[idx], &cursor);
+        }
+        catch (const epub_spec_error&)
+        {
+            // one stale CFI shouldn't cost the rest of the batch; its range stays invalid
+            cursor = Cursor();
+        }
+    }
+
+    return result;
+}
+
+#if 0
+#pragma mark - CFI Generation
+#endif
+
+void CFIStepIndex::AppendElementPath(uint32_t element, ComponentList& components) const
+{
+    size_t insertAt = components.size();
+    for ( uint32_t idx = element; idx != NoIndex && _elements[idx].parent != NoIndex; idx = _elements[idx].parent )
+    {
+        const ElementRecord& record = _elements[idx];
+        Component component(record.step);
+        if ( !record.identifier.empty() )
+        {
+            component.qualifier = record.identifier;
+            component.flags |= Component::Qualifier;
+        }
+        components.insert(components.begin()+insertAt, std::move(component));
+    }
+}
+bool CFIStepIndex::ComponentsForLocation(const Location& location, ComponentList& components) const
+{
+    if ( !location.Valid() )
+        return false;
+
+    NativeNode node = location.node->xml();
+    uint32_t idx = Lookup(_elementLookup, node);
+    if ( idx != NoIndex )
+    {
+        AppendElementPath(idx, components);
+        return true;
+    }
+
+    idx = Lookup(_textLookup, node);
+    if ( idx == NoIndex )
+        return false;
+
+    const TextSegment& segment = _text[idx];
+    AppendElementPath(segment.parent, components);
+
+    Component component(segment.step);
+    component.characterOffset = segment.offset + std::min(location.characterOffset, segment.length);
+    component.flags |= Component::CharacterOffset;
+    components.push_back(std::move(component));
+    return true;
+}
+CFI CFIStepIndex::CFIForLocation(const Location& location) const
+{
+    CFI result;
+    if ( !ComponentsForLocation(location, result._components) )
+        result.Clear();
+    return result;
+}
+CFI CFIStepIndex::CFIForLocation(shared_ptr<xml::Node> node, uint32_t characterOffset) const
+{
+    return CFIForLocation(Location(node, characterOffset, node && node->IsTextNode()));
+}
+CFI CFIStepIndex::CFIForRange(const Location& start, const Location& end) const
+{
+    ComponentList startPath, endPath;
+    if ( !ComponentsForLocation(start, startPath) || !ComponentsForLocation(end, endPath) )
+        return CFI();
+
+    // the start & end components must each retain at least one step
+    size_t limit = std::min(startPath.size(), endPath.size());
+    if ( limit > 0 )
+        --limit;
+
+    size_t common = 0;
+    while ( common < limit && startPath[common] == endPath[common] )
+        ++common;
+
+    CFI result;
+    result._components.assign(startPath.begin(), startPath.begin()+common);
+    result._rangeStart.assign(startPath.begin()+common, startPath.end());
+    result._rangeEnd.assign(endPath.begin()+common, endPath.end());
+    result._options |= CFI::RangeTriplet;
+    return result;
+}
+
+EPUB3_END_NAMESPACE
+
+#endif  // EPUB_USE(LIBXML2)
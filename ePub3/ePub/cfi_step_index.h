@@ -0,0 +1,284 @@
+//
+//  cfi_step_index.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__cfi_step_index__
+#define __ePub3__cfi_step_index__
+
+#include <ePub3/epub3.h>
+#include <ePub3/cfi.h>
+#include <ePub3/xml/document.h>
+#include <map>
+#include <vector>
+
+#if EPUB_USE(LIBXML2)
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A pre-computed CFI step table for a single content document.
+
+ Resolving the document part of a CFI (everything after the spine indirection) by
+ walking the DOM means visiting each child list along the path, for every CFI. When
+ a large number of CFIs need to be resolved against the same document (for example
+ when rendering all the highlights in a chapter) this class walks the document
+ exactly once, recording for every element the CFI step number of each of its
+ children, its `id` attribute, and the character offsets of the text nodes making
+ up each odd-numbered (character data) step.
+
+ Once built, the index is never modified. It can resolve CFIs to DOM locations and
+ generate CFIs for DOM locations in time proportional to the depth of the target
+ node only. Note that handing out xml::Node wrappers touches the underlying libxml2
+ nodes, so resolving against one document from several threads at once must be
+ serialized by the caller.
+
+ Character offsets are measured in UTF-16 code units, as required by the CFI
+ specification, and are relative to the complete character data step (which may
+ span several text or CDATA nodes separated by comments or processing
+ instructions). The Location structure converts these back into an offset within a
+ single text node.
+
+ CFIs supplied to this class should be relative to the content document, i.e. the
+ `pRemainingCFI` value returned from Package::ManifestItemForCFI(). As a
+ convenience, a publication-level CFI is also accepted: any steps up to and including
+ the first indirection step are skipped.
+
+ @ingroup epub-model
+ */
+class CFIStepIndex : public PointerType<CFIStepIndex>
+#if EPUB_PLATFORM(WINRT)
+	, public NativeBridge
+#endif
+{
+public:
+    ///
+    /// A resolved position within a content document.
+    struct Location
+    {
+        ///
+        /// The element or text node identified by the CFI.
+        shared_ptr<xml::Node>   node;
+        ///
+        /// For text nodes, the offset in UTF-16 code units within `node`.
+        uint32_t                characterOffset;
+        ///
+        /// `true` if the location carried a character offset.
+        bool                    hasCharacterOffset;
+
+                    Location() : node(), characterOffset(0), hasCharacterOffset(false) {}
+                    Location(shared_ptr<xml::Node> n, uint32_t offset=0, bool hasOffset=false)
+                        : node(n), characterOffset(offset), hasCharacterOffset(hasOffset) {}
+
+        ///
+        /// Returns `true` if the location references a node.
+        bool        Valid()                 const   { return bool(node); }
+    };
+
+    ///
+    /// The result of resolving a CFI. Location CFIs return identical start and end.
+    struct Range
+    {
+        Location    start;
+        Location    end;
+
+        bool        Valid()                 const   { return start.Valid() && end.Valid(); }
+        bool        IsCollapsed()           const   { return start.node == end.node && start.characterOffset == end.characterOffset; }
+    };
+
+    typedef std::vector<CFI>        CFIList;
+    typedef std::vector<Range>      RangeList;
+
+private:
+                    CFIStepIndex()                                  _DELETED_;
+                    CFIStepIndex(const CFIStepIndex&)               _DELETED_;
+    CFIStepIndex&   operator=(const CFIStepIndex&)                  _DELETED_;
+
+public:
+    /**
+     Builds a step index for the given content document.
+     @param document The parsed content document. The index retains a reference to it.
+     */
+    EPUB3_EXPORT    CFIStepIndex(shared_ptr<xml::Document> document);
+    virtual         ~CFIStepIndex() {}
+
+    ///
+    /// The document this index describes.
+    shared_ptr<xml::Document>   Document()          const   { return _document; }
+
+    ///
+    /// The number of elements recorded in the index.
+    size_t                      ElementCount()      const   { return _elements.size(); }
+
+    /**
+     Resolves a single CFI against the document.
+
+     If the CFI contains an `[id]` assertion which doesn't match the element found at
+     the given step, but that `id` does exist in the document, the element with the
+     asserted `id` is used instead, per epub-cfi §3.5.
+     @param cfi The CFI to resolve.
+     @result The range identified by the CFI; both locations are invalid if the CFI
+     could not be resolved.
+     */
+    EPUB3_EXPORT
+    Range           Resolve(const CFI& cfi)                         const;
+
+    /**
+     Resolves a list of CFIs in one pass over the index.
+
+     The input is visited in document order, so steps shared between successive CFIs
+     (for instance all the highlights within a single section) are only resolved once.
+     Unlike Resolve(const CFI&), errors in individual CFIs are not raised: each CFI
+     which can't be resolved, including any with out-of-bounds steps, yields a Range
+     whose locations are both invalid.
+     @param cfis The CFIs to resolve.
+     @result One Range for each input CFI, in the same order as the input.
+     */
+    EPUB3_EXPORT
+    RangeList       Resolve(const CFIList& cfis)                    const;
+
+    /**
+     Generates a document-relative CFI for a DOM location.
+
+     Prepend the result of Package::CFIForSpineItem() to obtain a publication-level CFI.
+     @param node An element or text node within the indexed document.
+     @param characterOffset For text nodes, an offset in UTF-16 code units within `node`.
+     @result A new CFI, or an empty CFI if `node` is not part of the indexed document.
+     */
+    EPUB3_EXPORT
+    CFI             CFIForLocation(shared_ptr<xml::Node> node, uint32_t characterOffset=0)  const;
+    EPUB3_EXPORT
+    CFI             CFIForLocation(const Location& location)        const;
+
+    /**
+     Generates a document-relative ranged CFI spanning two DOM locations.
+     @param start The start of the range.
+     @param end The end of the range.
+     @result A ranged CFI, or an empty CFI if either location is not part of the
+     indexed document.
+     */
+    EPUB3_EXPORT
+    CFI             CFIForRange(const Location& start, const Location& end)     const;
+
+protected:
+    typedef _xmlNode*               NativeNode;
+    typedef CFI::Component          Component;
+    typedef CFI::ComponentList      ComponentList;
+
+    static CONSTEXPR uint32_t       NoIndex = UINT32_MAX;
+
+    ///
+    /// One element of the document, in breadth-first order.
+    struct ElementRecord
+    {
+        NativeNode      node;           ///< The libxml2 element node.
+        uint32_t        parent;         ///< Index of the parent element, or NoIndex for the root.
+        uint32_t        step;           ///< The (even) CFI step of this element within its parent.
+        uint32_t        firstStep;      ///< Index into _steps of this element's step 1.
+        uint32_t        stepCount;      ///< Number of child steps (always odd).
+        std::string     identifier;     ///< The value of any `id` attribute.
+    };
+
+    ///
+    /// A single child step: either an element or a run of character data.
+    struct StepRecord
+    {
+        uint32_t        target;         ///< Element index (even steps) or first text segment (odd steps).
+        uint32_t        count;          ///< Number of text segments (odd steps only).
+        uint32_t        length;         ///< Total UTF-16 length of the run (odd steps only).
+    };
+
+    ///
+    /// A text or CDATA node contributing to an odd-numbered step.
+    struct TextSegment
+    {
+        NativeNode      node;           ///< The libxml2 text node.
+        uint32_t        parent;         ///< Index of the containing element.
+        uint32_t        step;           ///< The (odd) CFI step containing this text.
+        uint32_t        offset;         ///< UTF-16 offset of this node within the step.
+        uint32_t        length;         ///< UTF-16 length of this node.
+    };
+
+    ///
+    /// Intermediate state used when resolving successive CFIs with common prefixes.
+    struct Cursor
+    {
+        std::vector<uint32_t>   path;   ///< Element index reached after each step.
+        const ComponentList*    steps;  ///< The steps which produced `path`.
+        size_t                  first;  ///< Index of the first document step in `steps`.
+
+        Cursor() : path(), steps(nullptr), first(0) {}
+    };
+
+    shared_ptr<xml::Document>       _document;
+    std::vector<ElementRecord>      _elements;
+    std::vector<StepRecord>         _steps;
+    std::vector<TextSegment>        _text;
+    std::map<std::string, uint32_t> _identifiers;
+
+    // sorted by node pointer, for the reverse mappings
+    std::vector<std::pair<NativeNode, uint32_t>>    _elementLookup;
+    std::vector<std::pair<NativeNode, uint32_t>>    _textLookup;
+
+    ///
+    /// Walks the document, filling in the tables above.
+    void            Build();
+
+    ///
+    /// Index of the first step which lies within the content document.
+    static size_t   FirstDocumentStep(const ComponentList& components);
+
+    ///
+    /// Resolves the element step `component` below the element at index `parent`.
+    uint32_t        ResolveChildElement(uint32_t parent, const Component& component)  const;
+    ///
+    /// Applies any `[id]` assertion in `component` to the element at index `element`.
+    uint32_t        ConfirmOrCorrectQualifier(uint32_t element, const Component& component)   const;
+    ///
+    /// Resolves the element steps [first, last), possibly re-using the steps cached in a cursor.
+    uint32_t        ResolveElementPath(uint32_t from, const ComponentList& components, size_t first, size_t last, Cursor* cursor) const;
+    ///
+    /// Resolves the final step of a path from the given parent element.
+    Location        ResolveTerminalStep(uint32_t parent, const Component& component)   const;
+    ///
+    /// Resolves a complete (range) list of steps from a given element.
+    Location        ResolveFrom(uint32_t element, const ComponentList& components)    const;
+    ///
+    /// Creates a Location for an element record.
+    Location        ElementLocation(uint32_t element)                                   const;
+    ///
+    /// Resolves one CFI, re-using the cursor state where possible.
+    Range           ResolveOne(const CFI& cfi, Cursor* cursor) const;
+
+    ///
+    /// Creates the step components leading to a given element.
+    void            AppendElementPath(uint32_t element, ComponentList& components)     const;
+    ///
+    /// Creates the components for a location, returning false if it isn't indexed.
+    bool            ComponentsForLocation(const Location& location, ComponentList& components) const;
+
+    ///
+    /// Looks up a record index in one of the sorted lookup tables.
+    static uint32_t Lookup(const std::vector<std::pair<NativeNode, uint32_t>>& table, NativeNode node);
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif  // EPUB_USE(LIBXML2)
+
+#endif /* defined(__ePub3__cfi_step_index__) */
@@ -25,31 +25,39 @@
 #include "xpath_wrangler.h"
 #include "byte_stream.h"
 #include "filter_manager.h"
+#include "xml_stream_reader.h"
+#include "document_preloader.h"
+#include "instrumentation.h"
 #include <ePub3/xml/document.h>
 #include <ePub3/xml/io.h>
 #include <ePub3/content_module_manager.h>
+#include <ePub3/utilities/error_handler.h>
+#include <sstream>
 
 EPUB3_BEGIN_NAMESPACE
 
 static const char * gContainerFilePath = "META-INF/container.xml";
 static const char * gEncryptionFilePath = "META-INF/encryption.xml";
+static const char * gSignaturesFilePath = "META-INF/signatures.xml";
 static const char * gAppleiBooksDisplayOptionsFilePath = "META-INF/com.apple.ibooks.display-options.xml";
 static const char * gRootfilesXPath = "/ocf:container/ocf:rootfiles/ocf:rootfile";
 static const char * gRootfilePathsXPath = "/ocf:container/ocf:rootfiles/ocf:rootfile/@full-path";
 static const char * gVersionXPath = "/ocf:container/@version";
+static const char * gOPFNamespaceURI = "http://www.idpf.org/2007/opf";
+static const char * gDCNamespaceURI = "http://purl.org/dc/elements/1.1/";
 
 Container::Container() :
 #if EPUB_PLATFORM(WINRT)
 	NativeBridge(),
 #endif
-	_archive(nullptr), _ocf(nullptr), _packages(), _encryption(), _path()
+	_archive(nullptr), _ocf(nullptr), _packages(), _encryption(), _encryptionByPath(), _signatures(), _path(), _preloader()
 {
 }
 Container::Container(Container&& o) :
 #if EPUB_PLATFORM(WINRT)
 NativeBridge(),
 #endif
-_archive(std::move(o._archive)), _ocf(o._ocf), _packages(std::move(o._packages)), _path(std::move(o._path))
+_archive(std::move(o._archive)), _ocf(o._ocf), _packages(std::move(o._packages)), _encryption(std::move(o._encryption)), _encryptionByPath(std::move(o._encryptionByPath)), _signatures(std::move(o._signatures)), _path(std::move(o._path))
 {
     o._ocf = nullptr;
 }
@@ -58,6 +66,8 @@ Container::~Container()
 }
 bool Container::Open(const string& path)
 {
+	EPUB_MEASURE(measureOpen, ContainerOpen);
+
 	_archive = Archive::Open(path.stl_str());
 	if (_archive == nullptr)
 		throw std::invalid_argument(_Str("Path does not point to a recognised archive file: '", path, "'"));
@@ -65,48 +75,88 @@ bool Container::Open(const string& path)
 
 	// TODO: Initialize lazily? Doing so would make initialization faster, but require
 	// PackageLocations() to become non-const, like Packages().
-	ArchiveXmlReader reader(_archive->ReaderAtPath(gContainerFilePath));
-	if (!reader) {
-		throw std::invalid_argument(_Str("Path does not point to a recognised archive file: '", path, "'"));
-	}
+	xml::NodeSet nodes;
+	{
+		EPUB_MEASURE(measureOCF, ContainerParseOCF);
+		ArchiveXmlReader reader(_archive->ReaderAtPath(gContainerFilePath));
+		if (!reader) {
+			throw std::invalid_argument(_Str("Path does not point to a recognised archive file: '", path, "'"));
+		}
 #if EPUB_USE(LIBXML2)
-	_ocf = reader.xmlReadDocument(gContainerFilePath, nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+		_ocf = reader.xmlReadDocument(gContainerFilePath, nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
 #else
-	decltype(_ocf) __tmp(reader.ReadDocument(gContainerFilePath, nullptr, /*RESOLVE_EXTERNALS*/ 1));
-	_ocf = __tmp;
+		decltype(_ocf) __tmp(reader.ReadDocument(gContainerFilePath, nullptr, /*RESOLVE_EXTERNALS*/ 1));
+		_ocf = __tmp;
 #endif
-	if (!((bool)_ocf))
-		return false;
+		if (!((bool)_ocf))
+			return false;
 
 #if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
-	XPathWrangler xpath(_ocf, { { "ocf", "urn:oasis:names:tc:opendocument:xmlns:container" } });
+		XPathWrangler xpath(_ocf, { { "ocf", "urn:oasis:names:tc:opendocument:xmlns:container" } });
 #else
-	XPathWrangler::NamespaceList __ns;
-	__ns["ocf"] = OCFNamespaceURI;
-	XPathWrangler xpath(_ocf, __ns);
+		XPathWrangler::NamespaceList __ns;
+		__ns["ocf"] = OCFNamespaceURI;
+		XPathWrangler xpath(_ocf, __ns);
 #endif
-	xml::NodeSet nodes = xpath.Nodes(gRootfilesXPath);
+		nodes = xpath.Nodes(gRootfilesXPath);
+	}
 
 	if (nodes.empty())
 		return false;
 
-	LoadEncryption();
-
-    ParseVendorMetadata();
+	if (DocumentPreloader::Enabled())
+	{
+		// read everything needed below in the background, while it's parsed in order here;
+		// packages add their navigation and Media Overlay documents once their manifests are known
+		_preloader = std::make_shared<DocumentPreloader>(path);
+		for (const char* metaFile : { gEncryptionFilePath, gSignaturesFilePath, gAppleiBooksDisplayOptionsFilePath })
+		{
+			if (_archive->ContainsItem(metaFile))
+				_preloader->Preload(metaFile);
+		}
+		for (auto n : nodes)
+		{
+			string rootfile = _getProp(n, "full-path");
+			if (!rootfile.empty())
+				_preloader->Preload(rootfile);
+		}
+	}
 
-	for (auto n : nodes)
+	try
 	{
-		string type = _getProp(n, "media-type");
+		{
+			EPUB_MEASURE(measureMetadata, ContainerLoadMetadata);
+			LoadEncryption();
+			IndexEncryption();
+			LoadSignatures();
+
+			ParseVendorMetadata();
+		}
 
-		string path = _getProp(n, "full-path");
-		if (path.empty())
-			continue;
+		EPUB_MEASURE(measurePackages, ContainerLoadPackages);
+		for (auto n : nodes)
+		{
+			string type = _getProp(n, "media-type");
 
-		auto pkg = Package::New(Ptr(), type);
-		if (pkg->Open(path))
-			_packages.push_back(pkg);
+			string path = _getProp(n, "full-path");
+			if (path.empty())
+				continue;
+
+			auto pkg = Package::New(Ptr(), type);
+			if (pkg->Open(path))
+				_packages.push_back(pkg);
+		}
 	}
+	catch (...)
+	{
+		_preloader.reset();
+		throw;
+	}
+
+	// anything not used by now is discarded
+	_preloader.reset();
 
+    EPUB_MEASURE(measureFilters, ContainerBuildFilters);
     auto fm = FilterManager::Instance();
 	for (auto& pkg : _packages)
 	{
@@ -180,6 +230,211 @@ ContainerPtr Container::OpenContainerForContentModule(const string& path)
 		return nullptr;
 	return container;
 }
+static bool HasPropertyToken(const string& properties, const char* token)
+{
+    std::stringstream ss(properties.stl_str());
+    std::string word;
+    while ( ss >> word )
+    {
+        if ( word == token )
+            return true;
+    }
+    return false;
+}
+static void SummarizePackage(const PackagePtr& pkg, PublicationSummary& summary)
+{
+    summary.version = pkg->Version();
+    summary.title = pkg->Title(false);
+    summary.authors = pkg->AuthorNames(false);
+    for ( auto& item : pkg->PropertiesMatching(DCType::Identifier) )
+        summary.identifiers.push_back(item->Value());
+    summary.packageID = pkg->PackageID();
+    summary.language = pkg->Language();
+    summary.modificationDate = pkg->ModificationDate();
+    
+    for ( auto& entry : pkg->Manifest() )
+    {
+        if ( entry.second->HasProperty(ItemProperties::CoverImage) )
+        {
+            summary.coverImagePath = entry.second->AbsolutePath();
+            break;
+        }
+    }
+}
+#if EPUB_USE(LIBXML2)
+static bool ProbeContainerDocument(XMLStreamReader& reader, PublicationSummary& summary)
+{
+    // /ocf:container/ocf:rootfiles/ocf:rootfile/@full-path, preferring an OPF
+    string firstPath;
+    while ( reader.Next() )
+    {
+        if ( !reader.IsStartElement() || !reader.Is("rootfile", OCFNamespaceURI) )
+            continue;
+        
+        string path = reader.Attribute("full-path");
+        if ( path.empty() )
+            continue;
+        if ( reader.Attribute("media-type") == "application/oebps-package+xml" )
+        {
+            summary.packagePath = path;
+            return true;
+        }
+        if ( firstPath.empty() )
+            firstPath = path;
+    }
+    
+    summary.packagePath = firstPath;
+    return !reader.Failed();
+}
+static bool ProbePackageDocument(XMLStreamReader& reader, PublicationSummary& summary)
+{
+    if ( !reader.Next() )
+        return false;
+    if ( !reader.Is("package", gOPFNamespaceURI) )
+        return true;
+    
+    summary.version = reader.Attribute("version");
+    string uniqueIDRef = reader.Attribute("unique-identifier");
+    bool isEPUB3 = strtol(summary.version.c_str(), nullptr, 10) >= 3;
+    
+    string basePath;
+    auto slash = summary.packagePath.find_last_of('/');
+    if ( slash != string::npos )
+        basePath = summary.packagePath.substr(0, slash+1);
+    
+    string mainTitleID, coverID;
+    std::vector<std::pair<string, string>> titles;     // id, value
+    bool sawMetadata = false;
+    
+    while ( reader.NextChild(0) )
+    {
+        const string& name = reader.Name();
+        int depth = reader.Depth();
+        if ( reader.NamespaceURI() != gOPFNamespaceURI )
+            continue;
+        
+        if ( name == "metadata" )
+        {
+            sawMetadata = true;
+            while ( reader.NextChild(depth) )
+            {
+                string id = reader.Attribute("id");
+                if ( summary.packageID.empty() && !uniqueIDRef.empty() && id == uniqueIDRef )
+                    summary.packageID = reader.FirstText();
+                
+                const string& elementName = reader.Name();
+                if ( reader.NamespaceURI() == gDCNamespaceURI )
+                {
+                    if ( elementName == "title" )
+                        titles.emplace_back(id, reader.Content());
+                    else if ( elementName == "creator" )
+                        summary.authors.push_back(reader.Content());
+                    else if ( elementName == "identifier" )
+                        summary.identifiers.push_back(reader.Content());
+                    else if ( elementName == "language" && summary.language.empty() )
+                        summary.language = reader.Content();
+                }
+                else if ( elementName == "meta" )
+                {
+                    string property = reader.Attribute("property");
+                    if ( property == "dcterms:modified" && summary.modificationDate.empty() )
+                        summary.modificationDate = reader.Content();
+                    else if ( property == "title-type" && mainTitleID.empty() && reader.Content() == "main" )
+                    {
+                        string refines = reader.Attribute("refines");
+                        if ( refines.size() > 1 && refines[0] == '#' )
+                            mainTitleID = refines.substr(1);
+                    }
+                    else if ( property.empty() && reader.Attribute("name") == "cover" )
+                        coverID = reader.Attribute("content");
+                }
+            }
+        }
+        else if ( name == "manifest" )
+        {
+            // only as far as the cover: an EPUB 3 cover-image item wins over an EPUB 2 cover meta
+            while ( reader.NextChild(depth) )
+            {
+                if ( !reader.Is("item", gOPFNamespaceURI) )
+                    continue;
+                
+                bool coverImage = isEPUB3 && HasPropertyToken(reader.Attribute("properties"), "cover-image");
+                if ( coverImage || (!coverID.empty() && reader.Attribute("id") == coverID) )
+                {
+                    string href = reader.Attribute("href");
+                    summary.coverImagePath = basePath + href.substr(0, href.find('#'));
+                    if ( coverImage || !isEPUB3 )
+                        break;
+                }
+            }
+            
+            if ( sawMetadata )
+                break;
+        }
+        else if ( name == "spine" && sawMetadata )
+        {
+            break;
+        }
+    }
+    
+    if ( !titles.empty() )
+    {
+        summary.title = titles[0].second;
+        for ( auto& title : titles )
+        {
+            if ( !mainTitleID.empty() && title.first == mainTitleID )
+            {
+                summary.title = title.second;
+                break;
+            }
+        }
+    }
+    
+    return !reader.Failed();
+}
+#endif
+PublicationSummary Container::ProbeMetadata(const string& path)
+{
+    PublicationSummary summary;
+    
+#if EPUB_USE(LIBXML2)
+    if ( XMLStreamReader::Enabled() )
+    {
+        unique_ptr<Archive> archive = Archive::Open(path.stl_str());
+        if ( !bool(archive) )
+            throw std::invalid_argument(_Str("Path does not point to a recognised archive file: '", path, "'"));
+        
+        XMLStreamReader ocf(archive->ReaderAtPath(gContainerFilePath), gContainerFilePath);
+        if ( !ocf.IsOpen() )
+            throw std::invalid_argument(_Str("Path does not point to a recognised archive file: '", path, "'"));
+        
+        if ( ProbeContainerDocument(ocf, summary) )
+        {
+            if ( summary.packagePath.empty() )
+                return summary;
+            
+            XMLStreamReader opf(archive->ReaderAtPath(summary.packagePath.stl_str()), summary.packagePath);
+            if ( ProbePackageDocument(opf, summary) )
+                return summary;
+        }
+        
+        // not well-formed: let a full open recover what it can
+        summary = PublicationSummary();
+    }
+#endif
+    
+    ContainerPtr container = OpenContainerForContentModule(path);
+    if ( !bool(container) )
+        return summary;
+    
+    PackagePtr pkg = container->DefaultPackage();
+    if ( bool(pkg) )
+    {
+        summary.packagePath = container->PackageLocations()[0];
+        SummarizePackage(pkg, summary);
+    }
+    return summary;
+}
 Container::PathList Container::PackageLocations() const
 {
 #if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
@@ -223,7 +478,7 @@ string Container::Version() const
 
 void Container::ParseVendorMetadata()
 {
-    unique_ptr<ArchiveReader> pZipReader = _archive->ReaderAtPath(gAppleiBooksDisplayOptionsFilePath);
+    unique_ptr<ArchiveReader> pZipReader = ReaderAtPath(gAppleiBooksDisplayOptionsFilePath);
     if ( !pZipReader )
         return;
 
@@ -268,12 +523,43 @@ void Container::ParseVendorMetadata()
     }
 }
 
+unique_ptr<ArchiveReader> Container::ReaderAtPath(const string& path) const
+{
+    if ( bool(_preloader) )
+    {
+        unique_ptr<ArchiveReader> reader = _preloader->TakeReader(path);
+        if ( bool(reader) )
+            return reader;
+    }
+    return _archive->ReaderAtPath(path.stl_str());
+}
 void Container::LoadEncryption()
 {
-    unique_ptr<ArchiveReader> pZipReader = _archive->ReaderAtPath(gEncryptionFilePath);
+    unique_ptr<ArchiveReader> pZipReader = ReaderAtPath(gEncryptionFilePath);
     if ( !pZipReader )
         return;
     
+#if EPUB_USE(LIBXML2)
+    if ( XMLStreamReader::Enabled() )
+    {
+        DeferredErrors deferred;
+        XMLStreamReader stream(std::move(pZipReader), gEncryptionFilePath);
+        if ( LoadEncryption(stream) )
+        {
+            deferred.Release();
+            return;
+        }
+        
+        // not well-formed: let the DOM parser recover what it can, and report
+        // what it finds
+        deferred.Discard();
+        _encryption.clear();
+        pZipReader = _archive->ReaderAtPath(gEncryptionFilePath);
+        if ( !pZipReader )
+            return;
+    }
+#endif
+    
     ArchiveXmlReader reader(std::move(pZipReader));
 #if EPUB_USE(LIBXML2)
     shared_ptr<xml::Document> enc = reader.xmlReadDocument(gEncryptionFilePath, nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
@@ -305,15 +591,81 @@ void Container::LoadEncryption()
             _encryption.push_back(encPtr);
     }
 }
-shared_ptr<EncryptionInfo> Container::EncryptionInfoForPath(const string &path) const
+void Container::IndexEncryption()
 {
-    for ( auto item : _encryption )
+    _encryptionByPath.clear();
+    _encryptionByPath.reserve(_encryption.size());
+    
+    // the first record for a path wins, as it did when the list was searched in order
+    for ( auto& item : _encryption )
     {
-        if ( item->Path() == path )
-            return item;
+        _encryptionByPath.emplace(item->Path().stl_str(), item);
     }
+}
+#if EPUB_USE(LIBXML2)
+bool Container::LoadEncryption(XMLStreamReader& reader)
+{
+    // /ocf:encryption/enc:EncryptedData
+    if ( !reader.Next() )
+        return !reader.Failed() && reader.IsOpen();
+    if ( !reader.Is("encryption", OCFNamespaceURI) )
+        return true;
     
-    return nullptr;
+    while ( reader.NextChild(0) )
+    {
+        if ( !reader.Is("EncryptedData", XMLENCNamespaceURI) )
+            continue;
+        
+        auto encPtr = EncryptionInfo::New(Ptr());
+        if ( encPtr->ParseXML(reader) )
+            _encryption.push_back(encPtr);
+    }
+    
+    return !reader.Failed();
+}
+#endif
+void Container::LoadSignatures()
+{
+    unique_ptr<ArchiveReader> pZipReader = ReaderAtPath(gSignaturesFilePath);
+    if ( !pZipReader )
+        return;
+    
+    ArchiveXmlReader reader(std::move(pZipReader));
+#if EPUB_USE(LIBXML2)
+    shared_ptr<xml::Document> sig = reader.xmlReadDocument(gSignaturesFilePath, nullptr, XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+#elif EPUB_USE(WIN_XML)
+	auto sig = reader.ReadDocument(gSignaturesFilePath, nullptr, 0);
+#endif
+    if ( !bool(sig) )
+        return;
+#if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
+    XPathWrangler xpath(sig, {{"dsig", XMLDSigNamespaceURI}, {"ocf", OCFNamespaceURI}});
+#else
+    XPathWrangler::NamespaceList __ns;
+    __ns["ocf"] = OCFNamespaceURI;
+    __ns["dsig"] = XMLDSigNamespaceURI;
+    XPathWrangler xpath(sig, __ns);
+#endif
+    for ( auto node : xpath.Nodes("/ocf:signatures/dsig:Signature") )
+    {
+        _signatures.push_back(std::make_shared<DigitalSignature>(node));
+    }
+}
+IntegrityVerifier::ResultList Container::VerifyIntegrity(int threadCount) const
+{
+    IntegrityVerifier verifier(_path);
+    for ( auto& signature : _signatures )
+    {
+        verifier.AddSignature(*signature);
+    }
+    return verifier.Verify(threadCount);
+}
+shared_ptr<EncryptionInfo> Container::EncryptionInfoForPath(const string &path) const
+{
+    auto found = _encryptionByPath.find(path.stl_str());
+    if ( found == _encryptionByPath.end() )
+        return nullptr;
+    return found->second;
 }
 bool Container::FileExistsAtPath(const string& path) const
 {
@@ -23,12 +23,15 @@
 
 #include <ePub3/epub3.h>
 #include <ePub3/encryption.h>
+#include <ePub3/signatures.h>
+#include <ePub3/integrity_verifier.h>
 #include <ePub3/package.h>
 #include <ePub3/utilities/utfstring.h>
 #include <ePub3/utilities/owned_by.h>
 #include <ePub3/content_module.h>
 #include <ePub3/xml/node.h>
 #include <vector>
+#include <unordered_map>
 #include <ePub3/utilities/future.h>
 
 ///////////////////////////////////////////////////////////////////////////////////
@@ -47,7 +50,39 @@ namespace Readium
 EPUB3_BEGIN_NAMESPACE
 
 class Archive;
+class ArchiveReader;
 class ByteStream;
+class XMLStreamReader;
+class DocumentPreloader;
+
+/**
+ The bibliographic details of a publication, as read by Container::ProbeMetadata().
+ 
+ Values are taken from the default package document as written, without
+ localization; all paths are container-relative.
+ @ingroup epub-model
+ */
+struct PublicationSummary
+{
+    string                  packagePath;        ///< The package document, or empty if there is none.
+    string                  version;            ///< The package document's `version` attribute.
+    string                  title;              ///< The main title, or else the first `dc:title`.
+    std::vector<string>     authors;            ///< Every `dc:creator`, in document order.
+    std::vector<string>     identifiers;        ///< Every `dc:identifier`, in document order.
+    string                  packageID;          ///< The identifier named by the package's `unique-identifier`.
+    string                  language;           ///< The first `dc:language`.
+    string                  modificationDate;   ///< The `dcterms:modified` date.
+    string                  coverImagePath;     ///< The `cover-image` item (or EPUB 2 `cover` meta item), if any.
+    
+    ///
+    /// The same value as Package::UniqueID(): the package ID and modification date.
+    string                  UniqueID()          const
+        {
+            if ( packageID.empty() || modificationDate.empty() )
+                return packageID;
+            return _Str(packageID, "@", modificationDate);
+        }
+};
 
 /**
  The Container class provides an interface for interacting with an EPUB container,
@@ -79,6 +114,9 @@ public:
     ///
     /// A list of encryption information.
     typedef shared_vector<EncryptionInfo>       EncryptionList;
+    ///
+    /// A list of digital signatures.
+    typedef shared_vector<DigitalSignature>     SignatureList;
 
 private:
     ///
@@ -117,6 +155,21 @@ public:
 	static ContainerPtr
 		OpenContainerForContentModule(const string& path);
     
+    /**
+     Reads the bibliographic details of a publication without opening it.
+     
+     Only `META-INF/container.xml` and the `<metadata>` of the default package
+     document are parsed; the manifest is read only as far as the cover image,
+     and no Package is created. ContentModules are not consulted. This may be
+     called on any number of threads at once.
+     @param path The path of the EPUB file.
+     @result The publication's details.
+     @throws std::invalid_argument if the path isn't a recognised archive.
+     */
+    EPUB3_EXPORT
+    static PublicationSummary
+        ProbeMetadata(const string& path);
+    
     virtual         ~Container();
     
     ///
@@ -152,6 +205,22 @@ public:
      */
     virtual EncryptionInfoPtr       EncryptionInfoForPath(const string& path)   const;
 
+    ///
+    /// Retrieves the digital signatures from META-INF/signatures.xml, if any.
+    virtual const SignatureList&    Signatures()            const   { return _signatures; }
+    
+    /**
+     Checks the integrity of every item in the container.
+     
+     Each item's ZIP CRC32 is verified, along with the digest of every resource
+     referenced by the container's signatures. The work is spread across several
+     threads; see IntegrityVerifier for details.
+     @param threadCount The number of threads to use.
+     @result The per-item results.
+     */
+    EPUB3_EXPORT
+    IntegrityVerifier::ResultList   VerifyIntegrity(int threadCount = thread_pool::Automatic) const;
+
 	/**
 	 Determines whether a given file is present in the container.
 	 @param path The absolute path of the item.
@@ -171,6 +240,10 @@ public:
     /// The underlying archive.
     ArchivePtr                      GetArchive()            const   { return _archive; }
 
+    ///
+    /// The DocumentPreloader used while the container is being opened, if any.
+    shared_ptr<DocumentPreloader>   Preloader()             const   { return _preloader; }
+
 	///
 	/// Returns the ContentModule which created this container, if any.
 	std::shared_ptr<ContentModule>	Creator()				const	{ return _creator; }
@@ -203,12 +276,30 @@ protected:
     shared_ptr<xml::Document>		_ocf;
     PackageList						_packages;
     EncryptionList					_encryption;
+    std::unordered_map<std::string, EncryptionInfoPtr>  _encryptionByPath;  ///< `_encryption`, keyed by item path.
+    SignatureList					_signatures;
 	std::shared_ptr<ContentModule>	_creator;
 	string							_path;
+    shared_ptr<DocumentPreloader>   _preloader;
+    
+    ///
+    /// Returns a reader for an archive entry, taking it from the preloader if possible.
+    unique_ptr<ArchiveReader>       ReaderAtPath(const string& path)            const;
     
     ///
     /// Parses the file META-INF/encryption.xml into an EncryptionList.
     void							LoadEncryption();
+    ///
+    /// Indexes the EncryptionList by path, for EncryptionInfoForPath().
+    void                            IndexEncryption();
+#if EPUB_USE(LIBXML2)
+    ///
+    /// Streams META-INF/encryption.xml into an EncryptionList; `false` if it isn't well-formed.
+    bool							LoadEncryption(XMLStreamReader& reader);
+#endif
+    ///
+    /// Parses the file META-INF/signatures.xml into a SignatureList.
+    void							LoadSignatures();
 
 	//////////////////////////////////////////////////////////////////////////////
 	// BLATANT HACK!
@@ -0,0 +1,356 @@
+//
+//  deflate_decompression.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "deflate_decompression.h"
+#include "container.h"
+#include "package.h"
+#include "filter_manager.h"
+#include "byte_buffer.h"
+#include <zlib.h>
+#include <cstring>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+// the size of a deflate window, and so of the history a checkpoint must keep
+#define WINDOW_SIZE     32768
+#define INPUT_BUF_SIZE  16*1024
+
+/**
+ The inflation state for one item: the zlib stream, how far it has got through
+ the compressed and inflated data, and the checkpoints recorded on the way.
+ 
+ Checkpoints are specific to an item's data, so these contexts are never recycled.
+ */
+class DeflateDecompressor::InflateContext : public RangeFilterContext
+{
+public:
+    ///
+    /// A point at which inflation can be restarted.
+    struct Checkpoint
+    {
+        ByteStream::size_type   out;        ///< The offset in the inflated data.
+        ByteStream::size_type   in;         ///< The offset of the first compressed byte wholly after this point.
+        int                     bits;       ///< The number of bits of the previous byte still to be used.
+        ByteBuffer              window;     ///< The inflated data preceding this point, up to WINDOW_SIZE bytes.
+    };
+    
+    InflateContext(ByteStream::size_type originalLength);
+    virtual ~InflateContext();
+    
+    ///
+    /// The length of the inflated data, or zero if it isn't yet known.
+    ByteStream::size_type Length()                  const   { return _length; }
+    bool Failed()                                   const   { return _failed; }
+    
+    /**
+     Prepares to produce inflated data from the given offset, restarting from the
+     nearest checkpoint if that's before the current position or well ahead of it.
+     @result `false` if the data is malformed or ends before `offset`.
+     */
+    bool SeekTo(ByteStream::size_type offset, SeekableByteStream *input);
+    
+    /**
+     Inflates data from the current position.
+     @result The number of bytes produced, which is zero at the end of the data or
+     if the data is malformed.
+     */
+    size_t Inflate(uint8_t *out, size_t len, SeekableByteStream *input);
+    
+    /**
+     Inflates everything from the current position to the end of the data, and so
+     finds its length.
+     @result `false` if the data is malformed.
+     */
+    bool InflateToEnd(SeekableByteStream *input);
+    
+private:
+    bool Restart(const Checkpoint& point, SeekableByteStream *input);
+    bool FillInput(SeekableByteStream *input);
+    void AddCheckpoint();
+    
+    z_stream                    _zstream;
+    bool                        _active;
+    bool                        _ended;
+    bool                        _failed;
+    ByteStream::size_type       _out;           ///< The offset in the inflated data of the next byte to be produced.
+    ByteStream::size_type       _in;            ///< The offset in the compressed data of the next byte to be read.
+    ByteStream::size_type       _length;
+    std::vector<Checkpoint>     _checkpoints;
+    uint8_t                     _input[INPUT_BUF_SIZE];
+    uint8_t                     _scratch[INPUT_BUF_SIZE];
+};
+
+DeflateDecompressor::InflateContext::InflateContext(ByteStream::size_type originalLength)
+  : RangeFilterContext(), _active(false), _ended(false), _failed(false), _out(0), _in(0), _length(originalLength), _checkpoints()
+{
+    std::memset(&_zstream, 0, sizeof(_zstream));
+    
+    // inflation can always restart from the beginning
+    _checkpoints.push_back(Checkpoint());
+    _checkpoints.back().out = _checkpoints.back().in = 0;
+    _checkpoints.back().bits = 0;
+}
+
+DeflateDecompressor::InflateContext::~InflateContext()
+{
+    if ( _active )
+        inflateEnd(&_zstream);
+    
+    // both buffers may hold decrypted content
+    BufferPool::SecureErase(_input, sizeof(_input));
+    BufferPool::SecureErase(_scratch, sizeof(_scratch));
+}
+
+bool DeflateDecompressor::InflateContext::FillInput(SeekableByteStream *input)
+{
+    input->Seek(_in, std::ios::beg);
+    ByteStream::size_type num = input->ReadBytes(_input, sizeof(_input));
+    if ( num == 0 )
+        return false;
+    
+    _in += num;
+    _zstream.next_in = _input;
+    _zstream.avail_in = static_cast<uInt>(num);
+    return true;
+}
+
+bool DeflateDecompressor::InflateContext::Restart(const Checkpoint &point, SeekableByteStream *input)
+{
+    if ( !_active )
+    {
+        // raw deflate data, with no zlib or gzip header
+        if ( inflateInit2(&_zstream, -MAX_WBITS) != Z_OK )
+            return false;
+        _active = true;
+    }
+    else if ( inflateReset(&_zstream) != Z_OK )
+    {
+        return false;
+    }
+    
+    _zstream.next_in = _input;
+    _zstream.avail_in = 0;
+    _ended = false;
+    _out = point.out;
+    
+    // a block may begin part-way through a byte, whose remaining bits are primed first
+    _in = point.in - (point.bits != 0 ? 1 : 0);
+    if ( point.bits != 0 )
+    {
+        if ( !FillInput(input) )
+            return false;
+        inflatePrime(&_zstream, point.bits, _zstream.next_in[0] >> (8 - point.bits));
+        _zstream.next_in++;
+        _zstream.avail_in--;
+    }
+    
+    if ( point.window.GetBufferSize() != 0 )
+        inflateSetDictionary(&_zstream, point.window.GetBytes(), static_cast<uInt>(point.window.GetBufferSize()));
+    return true;
+}
+
+void DeflateDecompressor::InflateContext::AddCheckpoint()
+{
+    uint8_t window[WINDOW_SIZE];
+    uInt windowLen = sizeof(window);
+    if ( inflateGetDictionary(&_zstream, window, &windowLen) != Z_OK )
+        return;
+    
+    _checkpoints.push_back(Checkpoint());
+    Checkpoint& point = _checkpoints.back();
+    point.out = _out;
+    point.in = _in - _zstream.avail_in;
+    point.bits = _zstream.data_type & 7;
+    point.window.SetUsesSecureErasure();
+    point.window.AddBytes(window, windowLen);
+    BufferPool::SecureErase(window, windowLen);
+}
+
+size_t DeflateDecompressor::InflateContext::Inflate(uint8_t *out, size_t len, SeekableByteStream *input)
+{
+    if ( _failed || _ended || !_active || len == 0 )
+        return 0;
+    
+    _zstream.next_out = out;
+    _zstream.avail_out = static_cast<uInt>(std::min(len, size_t(UINT32_MAX)));
+    uInt requested = _zstream.avail_out;
+    
+    while ( _zstream.avail_out != 0 )
+    {
+        // having read all the input, inflate may yet have to finish the final block
+        if ( _zstream.avail_in == 0 )
+            FillInput(input);
+        
+        // stop at each block boundary, where a checkpoint might be taken
+        uInt before = _zstream.avail_out;
+        int ret = inflate(&_zstream, Z_BLOCK);
+        _out += before - _zstream.avail_out;
+        
+        if ( ret == Z_STREAM_END )
+        {
+            _ended = true;
+            _length = _out;
+            break;
+        }
+        if ( ret != Z_OK )
+        {
+            // malformed, or (Z_BUF_ERROR) stopping short of the final block
+            _failed = true;
+            break;
+        }
+        
+        // bit 7 marks a block boundary, bit 6 the end of the final block
+        if ( (_zstream.data_type & 128) != 0 && (_zstream.data_type & 64) == 0 &&
+             _out >= _checkpoints.back().out + CheckpointSpacing )
+        {
+            AddCheckpoint();
+        }
+    }
+    
+    return requested - _zstream.avail_out;
+}
+
+bool DeflateDecompressor::InflateContext::SeekTo(ByteStream::size_type offset, SeekableByteStream *input)
+{
+    if ( _failed )
+        return false;
+    
+    auto pos = _checkpoints.rbegin();
+    while ( pos->out > offset )
+        ++pos;
+    
+    if ( !_active || offset < _out || pos->out > _out )
+    {
+        if ( !Restart(*pos, input) )
+        {
+            _failed = true;
+            return false;
+        }
+    }
+    
+    // inflate and discard up to the offset
+    while ( _out < offset )
+    {
+        size_t toSkip = static_cast<size_t>(std::min(offset - _out, ByteStream::size_type(sizeof(_scratch))));
+        if ( Inflate(_scratch, toSkip, input) == 0 )
+            return false;
+    }
+    return true;
+}
+
+bool DeflateDecompressor::InflateContext::InflateToEnd(SeekableByteStream *input)
+{
+    if ( !SeekTo(std::max(_out, _checkpoints.back().out), input) )
+        return false;
+    
+    while ( Inflate(_scratch, sizeof(_scratch), input) != 0 )
+        ;
+    return !_failed;
+}
+
+bool DeflateDecompressor::DeflateTypeSniffer(ConstManifestItemPtr item)
+{
+    EncryptionInfoPtr encInfo = item->GetEncryptionInfo();
+    return encInfo != nullptr && encInfo->CompressionMethod() == EncryptionInfo::DeflateCompression;
+}
+
+FilterContext *DeflateDecompressor::InnerMakeFilterContext(ConstManifestItemPtr item) const
+{
+    EncryptionInfoPtr encInfo = (item ? item->GetEncryptionInfo() : nullptr);
+    return new InflateContext(encInfo ? encInfo->OriginalLength() : 0);
+}
+
+ByteStream::size_type DeflateDecompressor::BytesAvailable(FilterContext *context, SeekableByteStream *byteStream) const
+{
+    InflateContext* p = dynamic_cast<InflateContext*>(context);
+    if ( p == nullptr )
+        return 0;
+    
+    if ( p->Length() == 0 && !p->InflateToEnd(byteStream) )
+        return 0;
+    return p->Length();
+}
+
+void * DeflateDecompressor::FilterData(FilterContext *context, void *data, size_t len, size_t *outputLen)
+{
+    *outputLen = 0;
+    
+    InflateContext* p = dynamic_cast<InflateContext*>(context);
+    if ( p == nullptr )
+        return nullptr;
+    
+    // the compressed data is read from the previous filter's output
+    SeekableByteStream* byteStream = p->GetSeekableByteStream();
+    if ( byteStream == nullptr || !byteStream->IsOpen() )
+        return nullptr;
+    
+    // the whole resource can only be returned at once if its length is known
+    ByteRange& range = p->GetByteRange();
+    if ( range.IsFullRange() && p->Length() == 0 && !p->InflateToEnd(byteStream) )
+        return nullptr;
+    
+    ByteStream::size_type begin = 0, end = p->Length();
+    if ( !range.IsFullRange() )
+    {
+        begin = range.Location();
+        end = begin + range.Length();
+        if ( p->Length() != 0 )
+            end = std::min(end, p->Length());
+    }
+    if ( begin >= end || !p->SeekTo(begin, byteStream) )
+        return nullptr;
+    
+    uint8_t* output = p->GetOutputByteBuffer(end - begin);
+    ByteStream::size_type total = 0;
+    while ( total < end - begin )
+    {
+        size_t num = p->Inflate(output + total, static_cast<size_t>(end - begin - total), byteStream);
+        if ( num == 0 )
+            break;
+        total += num;
+    }
+    
+    if ( total == 0 )
+        return nullptr;
+    
+    *outputLen = total;
+    return output;
+}
+
+ContentFilterPtr DeflateDecompressor::DeflateDecompressorFactory(ConstPackagePtr package)
+{
+    ConstContainerPtr container = package->GetContainer();
+    for ( auto& encInfo : container->EncryptionData() )
+    {
+        if ( encInfo->CompressionMethod() == EncryptionInfo::DeflateCompression )
+            return New();
+    }
+    
+    // nothing here was compressed before encryption
+    return nullptr;
+}
+
+void DeflateDecompressor::Register()
+{
+    FilterManager::Instance()->RegisterFilter("DeflateDecompressor", EPUBDecompression, DeflateDecompressorFactory);
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,113 @@
+//
+//  deflate_decompression.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef __ePub3__deflate_decompression__
+#define __ePub3__deflate_decompression__
+
+#include <ePub3/filter.h>
+#include <ePub3/encryption.h>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ The DeflateDecompressor class inflates resources which were compressed before
+ being encrypted, as described by the `Compression` encryption property of OCF.
+ 
+ Such resources are stored in the container without ZIP compression, since the
+ ciphertext doesn't compress, so the inflation has to happen after decryption.
+ This filter runs at the EPUBDecompression priority, immediately after any
+ decryption filter, and reads its input from the decryption filter's output.
+ Content modules therefore receive the original bytes and needn't inflate them
+ themselves.
+ 
+ The filter supports byte ranges. Data is inflated incrementally using a fixed
+ amount of memory, and as it goes the filter records a checkpoint roughly every
+ CheckpointSpacing bytes of output: the compressed position, the bit offset
+ within it, and the preceding 32 KB window. A range request restarts inflation
+ from the nearest checkpoint before it, rather than from the start of the data,
+ so seeking into a large compressed video costs at most one span of inflation.
+ @see http://www.idpf.org/epub/301/spec/epub-ocf.html#sec-enc-compression
+ @see zran.c in the zlib distribution, on which the checkpointing is based.
+ */
+class DeflateDecompressor : public ContentFilter, public PointerType<DeflateDecompressor>
+{
+public:
+    ///
+    /// The approximate number of output bytes between two checkpoints.
+    static const size_t         CheckpointSpacing = 1024*1024;
+    
+protected:
+    /**
+     The type-sniffer for decompression.
+     
+     Matches any item whose encryption information says it was deflated.
+     */
+    static bool DeflateTypeSniffer(ConstManifestItemPtr item);
+    
+    static ContentFilterPtr DeflateDecompressorFactory(ConstPackagePtr package);
+    
+private:
+    class InflateContext;
+    
+public:
+    ///
+    /// Create a decompression filter.
+    DeflateDecompressor() : ContentFilter(DeflateTypeSniffer) {}
+    ///
+    /// Copy constructor.
+    DeflateDecompressor(const DeflateDecompressor& o) : ContentFilter(o) {}
+    ///
+    /// Move constructor.
+    DeflateDecompressor(DeflateDecompressor&& o) : ContentFilter(std::move(o)) {}
+    
+    virtual OperatingMode GetOperatingMode() const OVERRIDE { return OperatingMode::SupportsByteRanges; }
+    
+    /**
+     Returns the length of the inflated data: the `OriginalLength` given in the
+     encryption information or, failing that, the length found by inflating the
+     data to its end once.
+     */
+    virtual ByteStream::size_type BytesAvailable(FilterContext *context, SeekableByteStream *byteStream) const OVERRIDE;
+    
+    ///
+    /// Inflated data depends on nothing but its input, so it may be cached.
+    virtual string CacheIdentity() const OVERRIDE { return "DeflateDecompressor"; }
+    
+    /**
+     Inflates the range of the resource given by the RangeFilterContext, reading
+     compressed data from its SeekableByteStream.
+     @param context The context created for the item being read.
+     @param data Ignored; the compressed data is read from the context's stream.
+     @param len Ignored.
+     @param outputLen Storage for the count of bytes being returned.
+     @result The inflated bytes, or `nullptr` at the end of the data or if the
+     compressed data is malformed.
+     */
+    virtual void * FilterData(FilterContext* context, void * data, size_t len, size_t *outputLen) OVERRIDE;
+    
+    static void Register();
+    
+protected:
+    virtual FilterContext *InnerMakeFilterContext(ConstManifestItemPtr item) const OVERRIDE;
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__deflate_decompression__) */
@@ -0,0 +1,259 @@
+//
+//  document_preloader.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "document_preloader.h"
+#include <algorithm>
+#include <cstring>
+
+EPUB3_BEGIN_NAMESPACE
+
+static std::atomic<bool> gPreloadingEnabled(true);
+
+/**
+ Reads a preloaded entry from memory.
+ */
+class PreloadedReader : public ArchiveReader
+{
+public:
+    PreloadedReader(DocumentPreloader::BytesPtr data) : _data(data), _position(0) {}
+    virtual ~PreloadedReader() {}
+
+    virtual bool operator !() const { return !bool(_data) || _position >= _data->size(); }
+    virtual ssize_t read(void* p, size_t len) const
+        {
+            size_t num = std::min(len, _data->size() - _position);
+            if ( num != 0 )
+                std::memcpy(p, _data->data() + _position, num);
+            _position += num;
+            return static_cast<ssize_t>(num);
+        }
+
+	virtual size_t total_size() const { return _data->size(); }
+	virtual size_t position() const { return _position; }
+
+private:
+    DocumentPreloader::BytesPtr _data;
+    mutable size_t              _position;
+};
+
+DocumentPreloader::DocumentPreloader(const string& archivePath, const Options& options)
+  : _archivePath(archivePath.stl_str()), _cancelled(false), _lock(), _idleArchives(), _bytes(), _documents(),
+    _scheduled(0), _pool(new thread_pool(options.threadCount))
+{
+}
+DocumentPreloader::~DocumentPreloader()
+{
+    _cancelled = true;
+
+    // jobs which haven't started finish at once; the pool drops queued jobs, which
+    // would break their promises (and run continuations on a dying pool), so wait.
+    // Workers take the lock to return their archives, so it can't be held here.
+    std::map<string, shared_future<BytesPtr>> bytes;
+    std::map<string, shared_future<shared_ptr<xml::Document>>> documents;
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        bytes.swap(_bytes);
+        documents.swap(_documents);
+    }
+    for ( auto& pair : bytes )
+    {
+        if ( pair.second.valid() )
+            pair.second.wait();
+    }
+    for ( auto& pair : documents )
+    {
+        if ( pair.second.valid() )
+            pair.second.wait();
+    }
+
+    _pool.reset();
+}
+bool DocumentPreloader::Enabled()
+{
+    return gPreloadingEnabled;
+}
+void DocumentPreloader::SetEnabled(bool enabled)
+{
+    gPreloadingEnabled = enabled;
+}
+void DocumentPreloader::Preload(const string& path)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    if ( _bytes.find(path) != _bytes.end() )
+        return;
+
+    _bytes[path] = ReadEntry(path).share();
+    _scheduled++;
+}
+void DocumentPreloader::PreloadDocument(const string& path)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    if ( _documents.find(path) != _documents.end() )
+        return;
+
+    // parsing depends on reading, and runs on the pool once the content arrives
+    std::string url = path.stl_str();
+    future<shared_ptr<xml::Document>> parsed = ReadEntry(path).then(*_pool, [url](future<BytesPtr> content) -> shared_ptr<xml::Document> {
+        BytesPtr bytes = content.get();
+        if ( !bool(bytes) )
+            return nullptr;
+
+#if EPUB_USE(LIBXML2)
+        // the same options as ManifestItem::ReferencedDocument()
+        xmlDocPtr doc = xmlReadMemory(bytes->data(), static_cast<int>(bytes->size()), url.c_str(), nullptr,
+                                      XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR);
+        if ( doc == nullptr )
+            return nullptr;
+        return xml::Wrapped<xml::Document>(doc);
+#else
+        return nullptr;
+#endif
+    });
+
+    _documents[path] = parsed.share();
+    _scheduled++;
+}
+unique_ptr<ArchiveReader> DocumentPreloader::TakeReader(const string& path)
+{
+    shared_future<BytesPtr> pending;
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        auto found = _bytes.find(path);
+        if ( found == _bytes.end() || !found->second.valid() )
+            return nullptr;
+
+        // leave an empty future behind, so the entry isn't scheduled again
+        pending = found->second;
+        found->second = shared_future<BytesPtr>();
+    }
+
+    BytesPtr bytes;
+    try
+    {
+        bytes = pending.get();
+    }
+    catch (std::exception&)
+    {
+        return nullptr;
+    }
+
+    if ( !bool(bytes) )
+        return nullptr;
+    return unique_ptr<ArchiveReader>(new PreloadedReader(bytes));
+}
+shared_ptr<xml::Document> DocumentPreloader::TakeDocument(const string& path)
+{
+    shared_future<shared_ptr<xml::Document>> pending;
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        auto found = _documents.find(path);
+        if ( found == _documents.end() || !found->second.valid() )
+            return nullptr;
+
+        pending = found->second;
+        found->second = shared_future<shared_ptr<xml::Document>>();
+    }
+
+    try
+    {
+        return pending.get();
+    }
+    catch (std::exception&)
+    {
+        return nullptr;
+    }
+}
+size_t DocumentPreloader::ScheduledCount() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _scheduled;
+}
+future<DocumentPreloader::BytesPtr> DocumentPreloader::ReadEntry(const string& path)
+{
+    std::shared_ptr<promise<BytesPtr>> result = std::make_shared<promise<BytesPtr>>();
+    future<BytesPtr> content = result->get_future();
+
+    _pool->add([this, result, path]() {
+        // an exception escaping a thread_pool job terminates the process
+        try
+        {
+            result->set_value(_cancelled ? nullptr : ReadEntryContent(path));
+        }
+        catch (...)
+        {
+            result->set_exception(std::current_exception());
+        }
+    });
+
+    return content;
+}
+DocumentPreloader::BytesPtr DocumentPreloader::ReadEntryContent(const string& path)
+{
+    ArchiveHandle archive = AcquireArchive();
+    if ( !bool(archive) )
+        return nullptr;
+
+    BytesPtr result;
+    unique_ptr<ArchiveReader> reader = archive->ReaderAtPath(path.stl_str());
+    if ( bool(reader) )
+    {
+        std::shared_ptr<std::string> bytes = std::make_shared<std::string>();
+        bytes->reserve(reader->total_size());
+
+        char buf[16*1024];
+        ssize_t num = 0;
+        while ( (num = reader->read(buf, sizeof(buf))) > 0 )
+            bytes->append(buf, static_cast<size_t>(num));
+
+        if ( num == 0 )
+            result = bytes;
+    }
+
+    reader.reset();
+    ReleaseArchive(std::move(archive));
+    return result;
+}
+DocumentPreloader::ArchiveHandle DocumentPreloader::AcquireArchive()
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( !_idleArchives.empty() )
+        {
+            ArchiveHandle archive = std::move(_idleArchives.back());
+            _idleArchives.pop_back();
+            return archive;
+        }
+    }
+
+    try
+    {
+        return Archive::Open(_archivePath);
+    }
+    catch (std::exception&)
+    {
+        return nullptr;
+    }
+}
+void DocumentPreloader::ReleaseArchive(ArchiveHandle archive)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    _idleArchives.push_back(std::move(archive));
+}
+
+EPUB3_END_NAMESPACE
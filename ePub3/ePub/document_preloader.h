@@ -0,0 +1,168 @@
+//
+//  document_preloader.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__document_preloader__
+#define __ePub3__document_preloader__
+
+#include <ePub3/epub3.h>
+#include <ePub3/archive.h>
+#include <ePub3/utilities/executor.h>
+#include <ePub3/utilities/future.h>
+#include <ePub3/utilities/utfstring.h>
+#include <ePub3/xml/document.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Reads and parses the documents needed to open a container ahead of time, on a
+ thread_pool.
+
+ Opening a container reads `encryption.xml`, the package documents and the
+ navigation documents or NCX files one after the other, each of which must be
+ inflated before it is used. Most of these are independent of one another, so
+ while a Container is being opened it schedules each one here as soon as its path
+ is known, and the loading code then takes the results in its usual order. Since
+ documents are still *interpreted* in that order, on the calling thread, the
+ resulting object model is identical to a sequential open.
+
+ MediaOverlaysSmilModel uses a preloader in the same way to read and parse the
+ SMIL files of a publication once playback begins.
+
+ Each worker reads through its own Archive instance, as archives can't be read
+ from several threads at once. Documents which are never taken are discarded
+ when the preloader is destroyed.
+ @ingroup epub-model
+ */
+class DocumentPreloader
+{
+public:
+    typedef std::shared_ptr<const std::string>  BytesPtr;
+
+    ///
+    /// Controls the background work.
+    struct Options
+    {
+        int         threadCount;        ///< Worker threads; thread_pool::Automatic uses one per CPU.
+
+        Options() : threadCount(thread_pool::Automatic) {}
+    };
+
+private:
+                        DocumentPreloader()                             _DELETED_;
+                        DocumentPreloader(const DocumentPreloader&)     _DELETED_;
+    DocumentPreloader&  operator=(const DocumentPreloader&)             _DELETED_;
+
+public:
+    /**
+     Creates a preloader for an archive.
+     @param archivePath The filesystem path of the archive, which each worker opens
+     for itself.
+     @param options Controls the background work.
+     */
+    EPUB3_EXPORT        DocumentPreloader(const string& archivePath, const Options& options=Options());
+    ///
+    /// Abandons any work not yet started, and waits for the rest.
+    EPUB3_EXPORT        ~DocumentPreloader();
+
+    /**
+     Whether containers are opened with a preloader.
+
+     This defaults to `true`. Turning it off opens every container sequentially,
+     as before.
+     */
+    EPUB3_EXPORT
+    static bool         Enabled();
+    ///
+    /// Turns preloading on or off for all subsequently-opened containers.
+    EPUB3_EXPORT
+    static void         SetEnabled(bool enabled);
+
+    /**
+     Schedules an archive entry to be read into memory.
+
+     Does nothing if the entry has already been scheduled.
+     @param path The path of the entry within the archive.
+     */
+    EPUB3_EXPORT
+    void                Preload(const string& path);
+
+    /**
+     Schedules an archive entry to be read and then parsed as an XML document, with
+     the same options ManifestItem::ReferencedDocument() uses.
+     @param path The path of the entry within the archive.
+     */
+    EPUB3_EXPORT
+    void                PreloadDocument(const string& path);
+
+    /**
+     Takes the content of an entry scheduled with Preload(), waiting for it if
+     necessary.
+     @result A reader over the entry's content, or `nullptr` if the entry wasn't
+     scheduled, has already been taken, or couldn't be read.
+     */
+    EPUB3_EXPORT
+    unique_ptr<ArchiveReader>   TakeReader(const string& path);
+
+    /**
+     Takes a document scheduled with PreloadDocument(), waiting for it if necessary.
+     @result The parsed document, or `nullptr` if it wasn't scheduled, has already
+     been taken, or couldn't be read or parsed.
+     */
+    EPUB3_EXPORT
+    shared_ptr<xml::Document>   TakeDocument(const string& path);
+
+    ///
+    /// The number of entries scheduled so far.
+    EPUB3_EXPORT
+    size_t              ScheduledCount()                        const;
+
+protected:
+    typedef std::unique_ptr<Archive>    ArchiveHandle;
+
+    std::string                         _archivePath;
+    std::atomic<bool>                   _cancelled;
+
+    mutable std::mutex                  _lock;
+    std::vector<ArchiveHandle>          _idleArchives;
+    std::map<string, shared_future<BytesPtr>>                   _bytes;
+    std::map<string, shared_future<shared_ptr<xml::Document>>>  _documents;
+    size_t                              _scheduled;
+
+    std::unique_ptr<thread_pool>        _pool;
+
+    ///
+    /// Reads an entry on the pool; the future holds `nullptr` if it can't be read.
+    future<BytesPtr>    ReadEntry(const string& path);
+    ///
+    /// Reads an entry in its entirety, on a worker thread.
+    BytesPtr            ReadEntryContent(const string& path);
+
+    ArchiveHandle       AcquireArchive();
+    void                ReleaseArchive(ArchiveHandle archive);
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__document_preloader__) */
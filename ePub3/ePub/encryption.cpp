@@ -20,17 +20,22 @@
 
 #include "encryption.h"
 #include "xpath_wrangler.h"
+#include "xml_stream_reader.h"
 
 EPUB3_BEGIN_NAMESPACE
 
+const int EncryptionInfo::NoCompression;
+const int EncryptionInfo::DeflateCompression;
+
 bool EncryptionInfo::ParseXML(shared_ptr<xml::Node> node)
 {
 #if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
-    XPathWrangler xpath(node->Document(), {{"enc", XMLENCNamespaceURI}, {"dsig", XMLDSigNamespaceURI}});
+    XPathWrangler xpath(node->Document(), {{"enc", XMLENCNamespaceURI}, {"dsig", XMLDSigNamespaceURI}, {"comp", EPUBCompressionNamespaceURI}});
 #else
     XPathWrangler::NamespaceList nsList;
     nsList["enc"] = XMLENCNamespaceURI;
     nsList["dsig"] = XMLDSigNamespaceURI;
+    nsList["comp"] = EPUBCompressionNamespaceURI;
     XPathWrangler xpath(node->doc, nsList);
 #endif
     
@@ -45,7 +50,69 @@ bool EncryptionInfo::ParseXML(shared_ptr<xml::Node> node)
         return false;
     
     _path = strings[0];
+    
+    strings = xpath.Strings("./enc:EncryptionProperties/enc:EncryptionProperty/comp:Compression/@Method", node);
+    if ( !strings.empty() )
+    {
+        _compressionMethod = atoi(strings[0].c_str());
+        strings = xpath.Strings("./enc:EncryptionProperties/enc:EncryptionProperty/comp:Compression/@OriginalLength", node);
+        if ( !strings.empty() )
+            _originalLength = strtoul(strings[0].c_str(), nullptr, 10);
+    }
     return true;
 }
+#if EPUB_USE(LIBXML2)
+bool EncryptionInfo::ParseXML(XMLStreamReader& reader)
+{
+    // the first ./enc:EncryptionMethod/@Algorithm and ./enc:CipherData/enc:CipherReference/@URI,
+    // plus any compression property
+    bool foundAlgorithm = false, foundPath = false;
+    int depth = reader.Depth();
+    while ( reader.NextChild(depth) )
+    {
+        if ( reader.Is("EncryptionMethod", XMLENCNamespaceURI) )
+        {
+            if ( !foundAlgorithm )
+            {
+                _algorithm = reader.Attribute("Algorithm");
+                foundAlgorithm = !_algorithm.empty();
+            }
+        }
+        else if ( reader.Is("CipherData", XMLENCNamespaceURI) )
+        {
+            int dataDepth = reader.Depth();
+            while ( reader.NextChild(dataDepth) )
+            {
+                if ( !foundPath && reader.Is("CipherReference", XMLENCNamespaceURI) )
+                {
+                    _path = reader.Attribute("URI");
+                    foundPath = !_path.empty();
+                }
+            }
+        }
+        else if ( reader.Is("EncryptionProperties", XMLENCNamespaceURI) )
+        {
+            int propsDepth = reader.Depth();
+            while ( reader.NextChild(propsDepth) )
+            {
+                if ( !reader.Is("EncryptionProperty", XMLENCNamespaceURI) )
+                    continue;
+                
+                int propDepth = reader.Depth();
+                while ( reader.NextChild(propDepth) )
+                {
+                    if ( reader.Is("Compression", EPUBCompressionNamespaceURI) )
+                    {
+                        _compressionMethod = atoi(reader.Attribute("Method").c_str());
+                        _originalLength = strtoul(reader.Attribute("OriginalLength").c_str(), nullptr, 10);
+                    }
+                }
+            }
+        }
+    }
+    
+    return foundAlgorithm && foundPath;
+}
+#endif
 
 EPUB3_END_NAMESPACE
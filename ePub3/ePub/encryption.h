@@ -27,13 +27,15 @@
 EPUB3_BEGIN_NAMESPACE
 
 class Container;
+class XMLStreamReader;
 
 /**
  Contains details on the encryption of a single resource.
  
- At present this class holds only two pieces of information: A resource path and an
- encyption algorithm identifier (a URI string). This is all that's needed to support
- EPUB font obfuscation.
+ At present this class holds a resource path, an encyption algorithm identifier (a
+ URI string), and the compression applied to the resource before it was encrypted,
+ if any. This is all that's needed to support EPUB font obfuscation and the
+ decryption filters.
  
  In future, this class will grow to encapsulate all information from the XML-ENC
  specification.
@@ -52,16 +54,23 @@ public:
     /// Encryption algorithms are URIs compared as strings.
     typedef string                  algorithm_type;
     
+    ///
+    /// The ZIP compression method of a resource which wasn't compressed before encryption.
+    static const int                NoCompression       = 0;
+    ///
+    /// The ZIP compression method of a resource deflated before encryption.
+    static const int                DeflateCompression  = 8;
+    
 public:
     ///
     /// Creates a new EncryptionInfo with no details filled in.
-                    EncryptionInfo(ContainerPtr owner) : OwnedBy(owner), _algorithm(), _path() {}
+                    EncryptionInfo(ContainerPtr owner) : OwnedBy(owner), _algorithm(), _path(), _compressionMethod(NoCompression), _originalLength(0) {}
     ///
     /// Copy constructor.
-                    EncryptionInfo(const EncryptionInfo& o) : OwnedBy(o), _algorithm(o._algorithm), _path(o._path) {}
+                    EncryptionInfo(const EncryptionInfo& o) : OwnedBy(o), _algorithm(o._algorithm), _path(o._path), _compressionMethod(o._compressionMethod), _originalLength(o._originalLength) {}
     ///
     /// Move constructor.
-                    EncryptionInfo(EncryptionInfo&& o) : OwnedBy(std::move(o)), _algorithm(std::move(o._algorithm)), _path(std::move(o._path)) {}
+                    EncryptionInfo(EncryptionInfo&& o) : OwnedBy(std::move(o)), _algorithm(std::move(o._algorithm)), _path(std::move(o._path)), _compressionMethod(o._compressionMethod), _originalLength(o._originalLength) {}
     virtual         ~EncryptionInfo() {}
     
     
@@ -73,6 +82,15 @@ public:
      */
     EPUB3_EXPORT
     bool            ParseXML(shared_ptr<xml::Node> node);
+#if EPUB_USE(LIBXML2)
+    /**
+     Reads an `EncryptedData` element with a stream reader.
+     @param reader A reader positioned on an `EncryptedData` start tag. On return it
+     is on the matching end tag.
+     */
+    EPUB3_EXPORT
+    bool            ParseXML(XMLStreamReader& reader);
+#endif
     
     ///
     /// Returns an algorithm URI as defined in XML-ENC or OCF.
@@ -93,9 +111,24 @@ public:
     virtual void                    SetPath(const string& path)                     { _path = path; }
     virtual void                    SetPath(string&& path)                          { _path = path; }
     
+    /**
+     Returns the compression method applied to the resource before it was encrypted,
+     using the ZIP method numbers: NoCompression or DeflateCompression.
+     @see http://www.idpf.org/epub/301/spec/epub-ocf.html#sec-enc-compression
+     */
+    virtual int                     CompressionMethod()                     const   { return _compressionMethod; }
+    virtual void                    SetCompressionMethod(int method)                { _compressionMethod = method; }
+    
+    ///
+    /// Returns the length of the resource before compression, or zero if not given.
+    virtual size_t                  OriginalLength()                        const   { return _originalLength; }
+    virtual void                    SetOriginalLength(size_t length)                { _originalLength = length; }
+    
 protected:
-    algorithm_type  _algorithm;     ///< The algorithm identifier, as per XML-ENC or OCF.
-    string          _path;          ///< The Container-relative path to an encrypted resource.
+    algorithm_type  _algorithm;         ///< The algorithm identifier, as per XML-ENC or OCF.
+    string          _path;              ///< The Container-relative path to an encrypted resource.
+    int             _compressionMethod; ///< The compression applied before encryption.
+    size_t          _originalLength;    ///< The length of the resource before compression.
 
 };
 
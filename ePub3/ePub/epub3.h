@@ -45,6 +45,7 @@
 #define OCFNamespaceURI "urn:oasis:names:tc:opendocument:xmlns:container"
 #define XMLENCNamespaceURI "http://www.w3.org/2001/04/xmlenc#"
 #define XMLDSigNamespaceURI "http://www.w3.org/2000/09/xmldsig#"
+#define EPUBCompressionNamespaceURI "http://www.idpf.org/2016/encryption#compression"
 #define XHTMLNamespaceURI "http://www.w3.org/1999/xhtml"
 #define NCXNamespaceURI "http://www.daisy.org/z3986/2005/ncx/"
 
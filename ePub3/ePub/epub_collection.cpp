@@ -71,7 +71,7 @@ bool Collection::ParseXML(shared_ptr<xml::Node> node)
 #if EPUB_HAVE(CXX_MAP_EMPLACE)
                     _childCollections.emplace(sub->Role(), sub);
 #else
-                    _childCollections[sub->Role()] == sub;
+                    _childCollections[sub->Role()] = sub;
 #endif
                 }
             }
@@ -29,6 +29,9 @@
 #include <functional>
 #include <memory>
 #include <ePub3/utilities/byte_stream.h>
+#include <ePub3/utilities/buffer_pool.h>
+#include <mutex>
+#include <vector>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -125,31 +128,26 @@ class SeekableByteStream;
 class RangeFilterContext : public FilterContext
 {
 public:
-    RangeFilterContext() : FilterContext(), m_byteStream(nullptr) { }
+    RangeFilterContext() : FilterContext(), m_byteStream(nullptr), m_outputBuffer(nullptr), m_outputBufferSize(0) { }
 
     virtual ~RangeFilterContext() {
-        if (m_buffer != nullptr)
-        {
-            this->DestroyCurrentTemporaryByteBuffer();
-        }
+        this->DestroyCurrentTemporaryByteBuffer();
     }
 private:
-    uint8_t *m_buffer = nullptr;
+    // temporary buffers come from a pool, and are securely erased when returned to it
+    BufferPool::Buffer m_buffer;
     ByteStream::size_type m_buffer_size = 0;
-    ByteStream::size_type m_allocated_buffer_size = 0;
 
+public:
     void DestroyCurrentTemporaryByteBuffer()
     {
-        delete[] m_buffer; //reinterpret_cast<uint8_t *>(m_buffer);
-        m_buffer = nullptr;
+        m_buffer.Reset();
         m_buffer_size = 0;
-        m_allocated_buffer_size = 0;
     }
 
-public:
     uint8_t * GetCurrentTemporaryByteBuffer()
     {
-        return m_buffer;
+        return m_buffer.GetBytes();
     }
 
     ByteStream::size_type GetCurrentTemporaryByteBufferSize()
@@ -160,30 +158,49 @@ public:
 
     ByteStream::size_type GetCurrentTemporaryByteBufferAllocatedSize()
     {
-        return m_allocated_buffer_size;
+        return m_buffer.GetCapacity();
     }
 
+    /**
+     Returns a scratch buffer of at least the given size.
+     
+     The buffer is owned by the context and is reused by later calls where possible;
+     it is taken from the calling thread's BufferPool.
+     */
     uint8_t * GetAllocateTemporaryByteBuffer(ByteStream::size_type bytesToRead)
     {
-        if (m_buffer == nullptr || m_buffer_size < bytesToRead)
+        if (!m_buffer || m_buffer.GetCapacity() < bytesToRead)
         {
-            if (m_buffer != nullptr)
-            {
-                this->DestroyCurrentTemporaryByteBuffer();
-            }
-
-            m_buffer = new uint8_t[bytesToRead];
-            m_allocated_buffer_size = bytesToRead;
-        }
-
-        for (int i = 0; i < m_allocated_buffer_size; i++)
-        {
-            m_buffer[i] = 0;
+            // release the old buffer first, so the pool may hand it straight back
+            m_buffer.Reset();
+            m_buffer = BufferPool::ForCurrentThread()->Acquire(bytesToRead);
         }
 
         m_buffer_size = bytesToRead;
 
-        return m_buffer;
+        return m_buffer.GetBytes();
+    }
+
+    /**
+     Returns a buffer into which a filter should write its output.
+     
+     When the caller has supplied its own output buffer (see SetOutputBuffer()) and
+     it is large enough, it is returned, allowing the filter to write the result
+     directly into its final destination. Otherwise a temporary buffer is returned.
+     @param bytesNeeded The number of bytes the filter will produce.
+     */
+    uint8_t * GetOutputByteBuffer(ByteStream::size_type bytesNeeded)
+    {
+        if (m_outputBuffer != nullptr && m_outputBufferSize >= bytesNeeded)
+            return m_outputBuffer;
+        return GetAllocateTemporaryByteBuffer(bytesNeeded);
+    }
+
+    ///
+    /// Returns `true` if `bytes` is either the caller's output buffer or the temporary buffer, neither of which may be deleted.
+    bool OwnsByteBuffer(const void *bytes) const
+    {
+        return bytes != nullptr && (bytes == m_outputBuffer || bytes == m_buffer.GetBytes());
     }
 
     ByteRange &GetByteRange() { return m_byteRange; }
@@ -191,9 +208,28 @@ public:
     SeekableByteStream *GetSeekableByteStream() const { return m_byteStream; }
     void ResetSeekableByteStream() { m_byteStream = nullptr; }
     
+    ///
+    /// Supplies the caller's destination buffer for the current request.
+    void SetOutputBuffer(void *bytes, ByteStream::size_type len) { m_outputBuffer = reinterpret_cast<uint8_t*>(bytes); m_outputBufferSize = len; }
+    uint8_t *GetOutputBuffer() const { return m_outputBuffer; }
+    ByteStream::size_type GetOutputBufferSize() const { return m_outputBufferSize; }
+    void ResetOutputBuffer() { m_outputBuffer = nullptr; m_outputBufferSize = 0; }
+    
+    ///
+    /// Clears all per-request state and releases the temporary buffer, ready for reuse.
+    void ResetRangeState()
+    {
+        m_byteRange.Reset();
+        ResetSeekableByteStream();
+        ResetOutputBuffer();
+        DestroyCurrentTemporaryByteBuffer();
+    }
+    
 private:
     ByteRange m_byteRange;
     SeekableByteStream *m_byteStream;
+    uint8_t *m_outputBuffer;
+    ByteStream::size_type m_outputBufferSize;
 };
 
 // -------------------------------------------------------------------------------------------
@@ -244,7 +280,11 @@ public:
     ///
     /// This is the priority at which XML-ENC and XML-DSig filters take place.
     static const FilterPriority EPUBDecryption          = 750;
-    
+
+    ///
+    /// This is the priority at which resources compressed before encryption are inflated.
+    static const FilterPriority EPUBDecompression       = 700;
+
     ///
     /// This is the priority at which HTML content is modified to process `<switch>` elements and similar.
     static const FilterPriority SwitchStaticHandling    = 500;
@@ -290,10 +330,10 @@ private:
 public:
     ///
     /// Copy constructor.
-    ContentFilter(const ContentFilter& o) : _sniffer(o._sniffer) {}
+    ContentFilter(const ContentFilter& o) : _sniffer(o._sniffer), _contextPoolLock(), _contextPool() {}
     ///
     /// C++11 move constructor.
-    ContentFilter(ContentFilter&& o) : _sniffer(std::move(o._sniffer)) {}
+    ContentFilter(ContentFilter&& o) : _sniffer(std::move(o._sniffer)), _contextPoolLock(), _contextPool() {}
     
     /**
      Allocate and return a new FilterContext subclass. The default returns `nullptr`.
@@ -304,12 +344,25 @@ public:
      object that belongs to a subclass of RangeFilterContext, given that the RangeFilterContext
      subclass contains data that is needed when processing a byte range request. Not doing so
      will result in an exception being thrown.
+     
+     If a context was previously handed back through RecycleFilterContext(), that
+     context is returned instead of a new one.
 
      @param item The Manifest Item being processed, and for which the context is created.
      @result An object containing per-item data, or nullptr.
      */
     FilterContext *MakeFilterContext(ConstManifestItemPtr item) const
     {
+        {
+            std::lock_guard<std::mutex> _(_contextPoolLock);
+            if (!_contextPool.empty())
+            {
+                FilterContext *recycled = _contextPool.back();
+                _contextPool.pop_back();
+                return recycled;
+            }
+        }
+        
         FilterContext *filterContext = InnerMakeFilterContext(item);
         if (filterContext != nullptr &&
             GetOperatingMode() == OperatingMode::SupportsByteRanges &&
@@ -321,13 +374,44 @@ public:
         return filterContext;
     }
     
+    /**
+     Hands a context obtained from MakeFilterContext() back to the filter once its
+     stream is finished with it.
+     
+     If the filter can reset the context (see ResetFilterContext()) it is kept for
+     reuse by the next stream; otherwise it is deleted. Either way, the caller must
+     not use the context again.
+     @param context The context to recycle. May be `nullptr`.
+     */
+    void RecycleFilterContext(FilterContext *context) const
+    {
+        if (context == nullptr)
+            return;
+        
+        if (ResetFilterContext(context))
+        {
+            std::lock_guard<std::mutex> _(_contextPoolLock);
+            if (_contextPool.size() < MaxPooledContexts)
+            {
+                _contextPool.push_back(context);
+                return;
+            }
+        }
+        
+        delete context;
+    }
+    
     /**
      Create a new content filter with a (required) type sniffer.
      @param sniffer The TypeSnifferFn used to determine whether to pass certain data
      through this filter.
      */
-    ContentFilter(TypeSnifferFn sniffer) : _sniffer(sniffer) {}
-    virtual ~ContentFilter() {}
+    ContentFilter(TypeSnifferFn sniffer) : _sniffer(sniffer), _contextPoolLock(), _contextPool() {}
+    virtual ~ContentFilter()
+    {
+        for (FilterContext *context : _contextPool)
+            delete context;
+    }
         
     /// Subclasses should override this method if they want to specify different
     /// modes of operation.
@@ -335,6 +419,15 @@ public:
 
     virtual ByteStream::size_type BytesAvailable(SeekableByteStream *byteStream) const { return byteStream->BytesAvailable(); };
 
+    /**
+     Returns the number of bytes this filter will produce from a stream, given the
+     context created for its item.
+
+     Filters whose output length depends on per-item state (a decryption key, for
+     instance) override this. The default calls BytesAvailable(SeekableByteStream*).
+     */
+    virtual ByteStream::size_type BytesAvailable(FilterContext *context, SeekableByteStream *byteStream) const { return BytesAvailable(byteStream); }
+
     ///
     /// Obtains the type-sniffer for this filter.
     virtual TypeSnifferFn TypeSniffer() const { return _sniffer; }
@@ -343,6 +436,32 @@ public:
     /// Assigns a new type-sniffer to this filter.
     virtual void SetTypeSniffer(TypeSnifferFn fn) { _sniffer = fn; }
     
+    /**
+     Identifies this filter's output for the purposes of the shared ResourceCache.
+     
+     Two filter chains whose filters return the same identities are assumed to
+     produce identical output for the same resource. Caching is opt-in: the default
+     returns an empty string, which keeps any chain including the filter out of the
+     cache. A filter whose output depends only on the resource and its publication
+     may return a fixed name; if it also depends on other state, such as
+     configuration, that state must be part of the identity.
+     */
+    virtual string CacheIdentity() const { return string(); }
+    
+    /**
+     Identifies this filter's output for a particular item.
+     
+     The cache uses this rather than CacheIdentity(), which the default returns.
+     Filters whose output depends on per-item state which the publication doesn't
+     record, such as a decryption key, override this instead. A decryptor opts in
+     by returning something which identifies the key it will use for the item (the
+     license it comes from and the item's key identifier, for instance), so that
+     readers holding the same key share one copy of the plaintext and nobody else
+     sees it. An empty result keeps the item out of the cache.
+     @param item The item being filtered.
+     */
+    virtual string CacheIdentityForItem(ConstManifestItemPtr item) const { return CacheIdentity(); }
+    
     /**
      The core processing function.
      
@@ -361,12 +480,40 @@ public:
      piecemeal fashion.
      @see ePub3::SwitchPreprocessor or ePub3::ObjectPreprocessor for full-data
      examples.
+     
+     Filters operating on byte ranges receive no input data; they read from the
+     RangeFilterContext's SeekableByteStream instead. Such filters should obtain
+     their output storage from RangeFilterContext::GetOutputByteBuffer(), which
+     allows the result to be written straight into the caller's buffer. Returned
+     memory which is neither `data` nor owned by the context (see
+     RangeFilterContext::OwnsByteBuffer()) must be allocated with `new uint8_t[]`,
+     and will be deleted by the caller.
      */
     virtual void *FilterData(FilterContext* context, void *data, size_t len, size_t *outputLen) = 0;
     
 protected:
+    ///
+    /// The maximum number of idle contexts kept by RecycleFilterContext().
+    static const size_t MaxPooledContexts = 8;
+    
     TypeSnifferFn       _sniffer;
     
+    mutable std::mutex                  _contextPoolLock;
+    mutable std::vector<FilterContext*> _contextPool;
+    
+    /**
+     Prepares a used FilterContext to be handed out again by MakeFilterContext().
+     
+     Since a recycled context may be used for a different ManifestItem, filters must
+     only return `true` for contexts which carry no item-specific state, having
+     cleared any state (and securely erased any sensitive data) left over from the
+     previous stream. The default implementation returns `false`, so contexts are
+     never reused unless a filter opts in.
+     @param context A context previously created by this filter.
+     @result `true` if the context may be reused.
+     */
+    virtual bool ResetFilterContext(FilterContext *context) const { return false; }
+    
     /**
      Allocate and return a new FilterContext subclass. The default returns `nullptr`.
      
@@ -19,10 +19,13 @@
 //  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "filter_chain_byte_stream.h"
+#include "filter_chain_byte_stream_range.h"
 #include "../ePub/manifest.h"
 #include "filter.h"
+#include "resource_cache.h"
 #include "byte_buffer.h"
 #include "make_unique.h"
+#include "instrumentation.h"
 #include <iostream>
 
 #if !EPUB_OS(WINDOWS)
@@ -33,6 +36,13 @@ EPUB3_BEGIN_NAMESPACE
 
 FilterChainByteStream::~FilterChainByteStream()
 {
+    // the stacked streams read from _input, so they go first
+    _rangeInput.reset();
+    
+    for (size_t i = 0; i < m_filters.size(); i++)
+    {
+        m_filters[i]->RecycleFilterContext(m_filterContexts[i].release());
+    }
 }
 
 //FilterChainByteStream::FilterChainByteStream(std::vector<ContentFilterPtr>& filters, ConstManifestItemPtr &manifestItem)
@@ -53,15 +63,30 @@ FilterChainByteStream::~FilterChainByteStream()
 //}
 
 FilterChainByteStream::FilterChainByteStream(std::unique_ptr<SeekableByteStream>&& input, std::vector<ContentFilterPtr>& filters, ConstManifestItemPtr manifestItem)
-: _input(std::move(input)), m_filters(), m_filterContexts(), _needs_cache(false), _cache(), _read_cache(), _cacheHasBeenFilledUp(false)
+: _input(std::move(input)), m_filters(), m_filterContexts(), _rangeInput(), _stackedFilters(0), _needs_cache(false), _cache(), _read_cache(), _manifestItem(manifestItem), _view(), _viewOffset(0), _cacheHasBeenFilledUp(false)
 {
     _cache.SetUsesSecureErasure();
     _read_cache.SetUsesSecureErasure();
 
-    for (ContentFilterPtr filter : filters)
+    // a leading run of range filters is stacked, each reading the previous one's output
+    size_t rangeFilters = 0;
+    while (rangeFilters < filters.size() && filters[rangeFilters]->GetOperatingMode() == ContentFilter::OperatingMode::SupportsByteRanges)
+        rangeFilters++;
+    if (rangeFilters > 1)
     {
-        m_filters.push_back(filter);
-        m_filterContexts.push_back(std::unique_ptr<FilterContext>(filter->MakeFilterContext(manifestItem)));
+        _stackedFilters = rangeFilters - 1;
+        _rangeInput.reset(new RangeFilterByteStream(_input.get(), filters[0], manifestItem));
+        for (size_t i = 1; i < _stackedFilters; i++)
+            _rangeInput.reset(new RangeFilterByteStream(std::move(_rangeInput), filters[i], manifestItem));
+    }
+    
+    for (size_t i = 0; i < filters.size(); i++)
+    {
+        m_filters.push_back(filters[i]);
+        if (i < _stackedFilters)
+            m_filterContexts.push_back(nullptr);
+        else
+            m_filterContexts.push_back(std::unique_ptr<FilterContext>(filters[i]->MakeFilterContext(manifestItem)));
     }
 	
 	// We are currently hardcoding _needs_cache to true, because we realized that this is the only way to realiably compute
@@ -77,7 +102,7 @@ ByteStream::size_type FilterChainByteStream::ReadBytes(void* bytes, size_type le
 
     if (_needs_cache)
     {
-        if (_cache.GetBufferSize() == 0 && !_cacheHasBeenFilledUp)
+        if (!_cacheHasBeenFilledUp)
             CacheBytes();
 
         return ReadBytesFromCache(bytes, len);
@@ -124,10 +149,11 @@ ByteStream::size_type FilterChainByteStream::FilterBytes(void* bytes, size_type
     if (len == 0) return 0;
 
     size_type result = len;
-    ByteBuffer buf(reinterpret_cast<uint8_t*>(bytes), len);
+    ByteBuffer buf;
     buf.SetUsesSecureErasure();
+    buf.AddBytes(reinterpret_cast<uint8_t*>(bytes), len);
 
-    for (int i = 0; i < m_filters.size(); i++)
+    for (size_t i = _stackedFilters; i < m_filters.size(); i++)
     {
         ContentFilterPtr filter = m_filters.at(i);
         FilterContext * filterContext = m_filterContexts.at(i).get();
@@ -156,19 +182,23 @@ ByteStream::size_type FilterChainByteStream::FilterBytes(void* bytes, size_type
                 byteRange.Length((uint32_t)result);
             }
             filterContextRange->GetByteRange() = byteRange;
-            filterContextRange->SetSeekableByteStream(_input.get());
+            filterContextRange->SetSeekableByteStream(_rangeInput ? _rangeInput.get() : _input.get());
         }
 
         size_type filteredLen = 0;
         void *filteredData = nullptr;
 
-        if (filterContextRange != nullptr)
-        {
-            filteredData = filter->FilterData(filterContext, nullptr, 0, &filteredLen);
-        }
-        else
         {
-            filteredData = filter->FilterData(filterContext, buf.GetBytes(), buf.GetBufferSize(), &filteredLen);
+            EPUB_MEASURE(measure, FilterData);
+            if (filterContextRange != nullptr)
+            {
+                filteredData = filter->FilterData(filterContext, nullptr, 0, &filteredLen);
+            }
+            else
+            {
+                filteredData = filter->FilterData(filterContext, buf.GetBytes(), buf.GetBufferSize(), &filteredLen);
+            }
+            EPUB_MEASURE_BYTES(measure, filteredLen);
         }
 
         if (filterContextRange != nullptr)
@@ -189,7 +219,7 @@ ByteStream::size_type FilterChainByteStream::FilterBytes(void* bytes, size_type
         {
             if (filteredData != nullptr && filteredData != buf.GetBytes())
             {
-                if (filterContextRange == nullptr || reinterpret_cast<uint8_t*>(filteredData) != filterContextRange->GetCurrentTemporaryByteBuffer())
+                if (filterContextRange == nullptr || !filterContextRange->OwnsByteBuffer(filteredData))
                 {
                     delete[] reinterpret_cast<uint8_t*>(filteredData);
                 }
@@ -202,10 +232,11 @@ ByteStream::size_type FilterChainByteStream::FilterBytes(void* bytes, size_type
 
         if (filteredData != buf.GetBytes())
         {
-            // NOTE: destroys previous buffer, allocates new memory block! (memcpy)
-            buf = ByteBuffer(reinterpret_cast<uint8_t*>(filteredData), result);
+            // copied into the same secure storage, growing it if need be
+            buf.RemoveBytes(buf.GetBufferSize());
+            buf.AddBytes(reinterpret_cast<uint8_t*>(filteredData), result);
 
-            if (filterContextRange == nullptr || reinterpret_cast<uint8_t*>(filteredData) != filterContextRange->GetCurrentTemporaryByteBuffer())
+            if (filterContextRange == nullptr || !filterContextRange->OwnsByteBuffer(filteredData))
             {
                 delete[] reinterpret_cast<uint8_t*>(filteredData);
             }
@@ -220,9 +251,10 @@ ByteStream::size_type FilterChainByteStream::FilterBytes(void* bytes, size_type
         else if (result > buf.GetBufferSize())
         {
             // This should never happen! (returned more bytes than could fit!)
-
-            // NOTE: destroys previous buffer, allocates new memory block! (memcpy)
-            buf = ByteBuffer(reinterpret_cast<uint8_t*>(filteredData), result);
+            ByteBuffer grown;
+            grown.SetUsesSecureErasure();
+            grown.AddBytes(reinterpret_cast<uint8_t*>(filteredData), result);
+            buf = std::move(grown);
         }
     }
     
@@ -236,14 +268,36 @@ ByteStream::size_type FilterChainByteStream::ReadBytesFromCache(void* bytes, siz
 {
     if (len == 0) return 0;
 
-    size_type numToRead = std::min(len, size_type(_cache.GetBufferSize()));
-    ::memcpy_s(bytes, len, _cache.GetBytes(), numToRead);
-    _cache.RemoveBytes(numToRead);
+    size_type numToRead = std::min(len, CachedBytesRemaining());
+    if (numToRead == 0) return 0;
+
+    ::memcpy_s(bytes, len, _view->GetBytes() + _viewOffset, numToRead);
+    _viewOffset += numToRead;
     return numToRead;
 }
 
 void FilterChainByteStream::CacheBytes()
 {
+    EPUB_MEASURE(measure, FilterCacheFill);
+    
+    // another stream may already have filtered this resource
+    std::shared_ptr<ResourceCache> sharedCache = ResourceCache::Shared();
+    std::string cacheKey;
+    if (sharedCache)
+    {
+        cacheKey = ResourceCache::KeyFor(_manifestItem, m_filters);
+        if (!cacheKey.empty())
+        {
+            _view = sharedCache->Lookup(cacheKey);
+            if (_view)
+            {
+                _viewOffset = 0;
+                _cacheHasBeenFilledUp = true;
+                return;
+            }
+        }
+    }
+
     // read everything from the input stream
 #define _TMP_BUF_LEN 16*1024
     uint8_t buf[_TMP_BUF_LEN] = {};
@@ -256,22 +310,92 @@ void FilterChainByteStream::CacheBytes()
             _cache.AddBytes(buf, numRead);
     }
 
+    _cacheHasBeenFilledUp = true;
     if (_cache.GetBufferSize() == 0) return;
 
     // filter everything completely
     size_type filtered = FilterBytes(_cache.GetBytes(), _cache.GetBufferSize());
+    _cache.RemoveBytes(_cache.GetBufferSize());
 
-    if (filtered > 0)
-    {
-        // ASSERT filtered == _read_cache.GetBufferSize()
+    if (filtered == 0)
+        return;
 
-        _cache = std::move(_read_cache);
-        _read_cache.RemoveBytes(_read_cache.GetBufferSize());
-        _cacheHasBeenFilledUp = true;
-    }
+    // ASSERT filtered == _read_cache.GetBufferSize()
 
     // this potentially contains decrypted data, so use secure erasure
-    _cache.SetUsesSecureErasure();
+    std::shared_ptr<ByteBuffer> result = std::make_shared<ByteBuffer>();
+    *result = std::move(_read_cache);
+    result->SetUsesSecureErasure();
+
+    _view = result;
+    _viewOffset = 0;
+
+    if (sharedCache && !cacheKey.empty())
+        sharedCache->Insert(cacheKey, result);
+}
+
+#ifdef SUPPORT_ASYNC
+AsyncFilterChainByteStream::AsyncFilterChainByteStream(std::unique_ptr<ByteStream>&& filtered, size_type bufsize)
+  : AsyncByteStream(bufsize), _filtered(std::move(filtered)), _fill()
+{
+    AsyncByteStream::Open(std::ios::in|std::ios::out);
+}
+
+AsyncFilterChainByteStream::AsyncFilterChainByteStream(std::unique_ptr<ByteStream>&& filtered, executor& exec, size_type bufsize)
+  : AsyncByteStream(bufsize), _filtered(), _fill(std::make_shared<Fill>())
+{
+    _fill->filtered = std::move(filtered);
+    _fill->owner = this;
+    
+    std::shared_ptr<Fill> fill = _fill;
+    exec.add([fill]() {
+        // this produces the whole output, which is then only copied out chunk by chunk
+        fill->filtered->BytesAvailable();
+        
+        std::lock_guard<std::mutex> _(fill->lock);
+        AsyncFilterChainByteStream* owner = fill->owner;
+        if ( owner == nullptr )
+            return;
+        
+        owner->_filtered = std::move(fill->filtered);
+        owner->AsyncByteStream::Open(std::ios::in|std::ios::out);
+    });
+}
+
+AsyncFilterChainByteStream::~AsyncFilterChainByteStream()
+{
+    Close();
+}
+
+void AsyncFilterChainByteStream::Close()
+{
+    // a pending fill no longer opens the stream, and releases its filters itself
+    if ( _fill )
+    {
+        std::lock_guard<std::mutex> _(_fill->lock);
+        _fill->owner = nullptr;
+    }
+    
+    // stop the I/O thread's reads before releasing the filters
+    AsyncByteStream::Close();
+    _filtered.reset();
+}
+
+void AsyncFilterChainByteStream::SetTargetRunLoop(RunLoopPtr rl) _NOEXCEPT
+{
+    // whichever of this and the fill comes second starts the reads
+    std::unique_lock<std::mutex> lock;
+    if ( _fill )
+        lock = std::unique_lock<std::mutex>(_fill->lock);
+    AsyncByteStream::SetTargetRunLoop(rl);
+}
+
+ByteStream::size_type AsyncFilterChainByteStream::read_for_async(void* buf, size_type len)
+{
+    if ( !_filtered || len == 0 )
+        return 0;
+    return _filtered->ReadBytes(buf, len);
 }
+#endif /* SUPPORT_ASYNC */
 
 EPUB3_END_NAMESPACE
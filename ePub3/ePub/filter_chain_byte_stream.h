@@ -28,6 +28,7 @@
 #include <ePub3/utilities/byte_buffer.h>
 #include <memory>
 #include <thread>
+#include <mutex>
 #include <condition_variable>
 #include <algorithm>
 #include <utility>
@@ -47,9 +48,20 @@ private:
     std::vector<ContentFilterPtr> m_filters;
     std::vector<std::unique_ptr<FilterContext>> m_filterContexts;
     
+    // when the chain begins with several range filters, all but the last of them read
+    // through this stack of RangeFilterByteStreams over _input, and have no context here
+    std::unique_ptr<SeekableByteStream> _rangeInput;
+    size_t                          _stackedFilters;
+    
     bool                            _needs_cache;
     ByteBuffer                        _cache;
     ByteBuffer                        _read_cache;
+    
+    ConstManifestItemPtr            _manifestItem;
+    
+    // the fully-filtered resource, possibly shared with other streams via the ResourceCache
+    std::shared_ptr<const ByteBuffer>   _view;
+    size_type                       _viewOffset;
 
 private:
     FilterChainByteStream(const FilterChainByteStream& o)             _DELETED_;
@@ -58,7 +70,7 @@ private:
     FilterChainByteStream&         operator=(FilterChainByteStream&&)                         _DELETED_;
 
 public:
-    FilterChainByteStream() : ByteStream(), _cacheHasBeenFilledUp(false) {}
+    FilterChainByteStream() : ByteStream(), _stackedFilters(0), _viewOffset(0), _cacheHasBeenFilledUp(false) {}
     //EPUB3_EXPORT FilterChainByteStream(std::vector<ContentFilterPtr>& filters, ConstManifestItemPtr &manifestItem);
     EPUB3_EXPORT FilterChainByteStream(std::unique_ptr<SeekableByteStream>&& input, std::vector<ContentFilterPtr>& filters, ConstManifestItemPtr manifestItem);
     virtual ~FilterChainByteStream();
@@ -67,11 +79,11 @@ public:
     {
         if (_needs_cache)
 		{
-			if (_cache.GetBufferSize() == 0 && !_cacheHasBeenFilledUp)
+			if (!_cacheHasBeenFilledUp)
 			{
 				CacheBytes();
 			}
-            return _cache.GetBufferSize();
+            return CachedBytesRemaining();
         } else {
             return _input->BytesAvailable();
         }
@@ -97,8 +109,8 @@ public:
     
     virtual bool AtEnd() const _NOEXCEPT OVERRIDE
     {
-        if (_needs_cache && _input->AtEnd()) {
-            return _cache.IsEmpty();
+        if (_needs_cache && _cacheHasBeenFilledUp) {
+            return CachedBytesRemaining() == 0;
         } else {
             return _input->AtEnd();
         }
@@ -110,6 +122,10 @@ public:
     
 private:
     size_type ReadBytesFromCache(void* bytes, size_type len);
+    size_type CachedBytesRemaining() const _NOEXCEPT
+    {
+        return (_view ? _view->GetBufferSize() - _viewOffset : 0);
+    }
     void CacheBytes();
     size_type FilterBytes(void* bytes, size_type len);
     //size_type FilterBytes(void* bytes, ByteRange &byteRange);
@@ -117,6 +133,66 @@ private:
     bool _cacheHasBeenFilledUp;
 };
 
+#ifdef SUPPORT_ASYNC
+/**
+ An asynchronous stream of a manifest item's filtered bytes.
+ 
+ Each chunk is read from the filtered stream in a single step on the shared async
+ I/O thread, whenever the stream's read buffer has room, and readers are notified
+ only once filtered output is waiting; there are no intermediate pipes, buffers or
+ run loops between the filters.
+ 
+ When every filter supports byte ranges, the filtered stream is a stack of
+ RangeFilterByteStreams, so each read filters just the chunk requested. Otherwise
+ it's a FilterChainByteStream, which filters the whole item on first use; that's
+ done on an executor before the stream opens, so the I/O thread never waits on it.
+ */
+class AsyncFilterChainByteStream : public AsyncByteStream
+{
+public:
+    /**
+     Creates a stream reading from a filter chain which can produce any chunk on demand.
+     @param filtered The stream producing the filtered bytes. It's only ever read
+     on the async I/O thread.
+     @param bufsize The size of the read buffer, and so the largest chunk.
+     */
+    EPUB3_EXPORT            AsyncFilterChainByteStream(std::unique_ptr<ByteStream>&& filtered, size_type bufsize=4096);
+    /**
+     Creates a stream reading from a filter chain which needs the item's complete data.
+     
+     The stream opens once `filtered` has produced its output, which it does on
+     `exec`; until then no events are posted.
+     @param filtered The stream producing the filtered bytes, usually a
+     FilterChainByteStream.
+     @param exec The executor on which `filtered` is first read.
+     @param bufsize The size of the read buffer, and so the largest chunk.
+     */
+    EPUB3_EXPORT            AsyncFilterChainByteStream(std::unique_ptr<ByteStream>&& filtered, executor& exec, size_type bufsize=4096);
+    virtual                 ~AsyncFilterChainByteStream();
+    
+    virtual bool            IsOpen()                                const _NOEXCEPT OVERRIDE    { return bool(_filtered); }
+    virtual void            Close()                                 OVERRIDE;
+    virtual void            SetTargetRunLoop(RunLoopPtr rl)         _NOEXCEPT OVERRIDE;
+    
+protected:
+    virtual size_type       read_for_async(void* buf, size_type len)        OVERRIDE;
+    virtual size_type       write_for_async(const void* buf, size_type len) OVERRIDE    { return 0; }
+    
+private:
+    ///
+    /// State shared with a pending fill, which may outlive the stream.
+    struct Fill
+    {
+        std::mutex                      lock;
+        std::unique_ptr<ByteStream>     filtered;
+        AsyncFilterChainByteStream*     owner;      ///< `nullptr` once the stream has closed.
+    };
+    
+    std::unique_ptr<ByteStream> _filtered;
+    std::shared_ptr<Fill>       _fill;
+};
+#endif /* SUPPORT_ASYNC */
+
 EPUB3_END_NAMESPACE
 
 #endif /* defined(__ePub3__filter_chain_byte_stream__) */
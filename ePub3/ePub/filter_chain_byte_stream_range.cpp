@@ -23,6 +23,7 @@
 #include "filter.h"
 #include "byte_buffer.h"
 #include "make_unique.h"
+#include "instrumentation.h"
 #include <iostream>
 
 #if !EPUB_OS(WINDOWS)
@@ -33,6 +34,9 @@ EPUB3_BEGIN_NAMESPACE
 
 FilterChainByteStreamRange::~FilterChainByteStreamRange()
 {
+    // hand the context back, so the next range request on this item doesn't allocate one
+    if (m_filter)
+        m_filter->RecycleFilterContext(m_filterContext.release());
 }
 
 FilterChainByteStreamRange::FilterChainByteStreamRange(std::unique_ptr<SeekableByteStream> &&input, ContentFilterPtr filter, ConstManifestItemPtr manifestItem)
@@ -48,7 +52,7 @@ ByteStream::size_type FilterChainByteStreamRange::BytesAvailable() _NOEXCEPT
 {
     if (m_filter)
     {
-        ByteStream::size_type size = m_filter->BytesAvailable(m_input.get());
+        ByteStream::size_type size = m_filter->BytesAvailable(m_filterContext.get(), m_input.get());
         return size;
     }
 
@@ -92,37 +96,42 @@ ByteStream::size_type FilterChainByteStreamRange::ReadBytes(void *bytes, size_ty
     {
         filterContext->GetByteRange() = byteRange;
         filterContext->SetSeekableByteStream(m_input.get());
+        filterContext->SetOutputBuffer(bytes, len);
     }
 
     size_type filteredLen = 0;
     void *filteredData = nullptr;
 
     if (filterContext != nullptr) {
+        EPUB_MEASURE(measure, FilterData);
         filteredData = m_filter->FilterData(m_filterContext.get(), nullptr, 0, &filteredLen);
+        EPUB_MEASURE_BYTES(measure, filteredLen);
     } else {
         size_type result = m_input->ReadBytes(bytes, len);
         if (result == 0) return 0;
 
-        ByteBuffer buf(reinterpret_cast<uint8_t*>(bytes), result);
-        buf.SetUsesSecureErasure();
-
-        filteredData = m_filter->FilterData(m_filterContext.get(), buf.GetBytes(), buf.GetBufferSize(), &filteredLen);
+        // the raw bytes are already in the caller's buffer, so filter them in place
+        EPUB_MEASURE(measure, FilterData);
+        filteredData = m_filter->FilterData(m_filterContext.get(), bytes, result, &filteredLen);
+        EPUB_MEASURE_BYTES(measure, filteredLen);
     }
 
     if (filterContext != nullptr)
     {
         filterContext->GetByteRange().Reset();
         filterContext->ResetSeekableByteStream();
+        filterContext->ResetOutputBuffer();
     }
+
+    // memory not owned by the caller or the context was allocated for us by the filter
+    bool deleteFilteredData = (filteredData != nullptr && filteredData != bytes &&
+                               (filterContext == nullptr || !filterContext->OwnsByteBuffer(filteredData)));
     
     if (filteredData == nullptr || filteredLen == 0)
     {
-        if (filteredData != nullptr && filteredData != bytes)
+        if (deleteFilteredData)
         {
-            if (filterContext == nullptr || reinterpret_cast<uint8_t*>(filteredData) != filterContext->GetCurrentTemporaryByteBuffer())
-            {
-                delete[] reinterpret_cast<uint8_t *>(filteredData);
-            }
+            delete[] reinterpret_cast<uint8_t *>(filteredData);
         }
 
         return 0;
@@ -141,13 +150,13 @@ ByteStream::size_type FilterChainByteStreamRange::ReadBytes(void *bytes, size_ty
             // (e.g. when decrypted bytes are greater than original request?)
         }
 
-        if (filterContext == nullptr || reinterpret_cast<uint8_t*>(filteredData) != filterContext->GetCurrentTemporaryByteBuffer())
+        if (deleteFilteredData)
         {
             delete[] reinterpret_cast<uint8_t *>(filteredData);
         }
     }
 
-    return filteredLen;
+    return std::min(len, filteredLen);
 }
 
 ByteStream::size_type FilterChainByteStreamRange::ReadRawBytes(void *bytes, size_type len, ePub3::ByteRange &byteRange)
@@ -175,4 +184,118 @@ ByteStream::size_type FilterChainByteStreamRange::ReadRawBytes(void *bytes, size
     return m_input->ReadBytes(bytes, bytesToRead);
 }
 
+RangeFilterByteStream::RangeFilterByteStream(std::unique_ptr<SeekableByteStream> &&input, ContentFilterPtr filter, ConstManifestItemPtr manifestItem)
+: m_ownedInput(std::move(input)), m_input(m_ownedInput.get()), m_filter(filter), m_filterContext(filter->MakeFilterContext(manifestItem)),
+  m_position(0), m_length(0), m_lengthKnown(false), m_atEnd(false)
+{
+}
+
+RangeFilterByteStream::RangeFilterByteStream(SeekableByteStream *input, ContentFilterPtr filter, ConstManifestItemPtr manifestItem)
+: m_ownedInput(), m_input(input), m_filter(filter), m_filterContext(filter->MakeFilterContext(manifestItem)),
+  m_position(0), m_length(0), m_lengthKnown(false), m_atEnd(false)
+{
+}
+
+RangeFilterByteStream::~RangeFilterByteStream()
+{
+    m_filter->RecycleFilterContext(m_filterContext.release());
+}
+
+ByteStream::size_type RangeFilterByteStream::Length()
+{
+    if (!m_lengthKnown)
+    {
+        size_type position = m_input->Position();
+        m_length = m_filter->BytesAvailable(m_filterContext.get(), m_input);
+        m_input->Seek(position, std::ios::beg);
+        m_lengthKnown = true;
+    }
+    return m_length;
+}
+
+ByteStream::size_type RangeFilterByteStream::BytesAvailable() _NOEXCEPT
+{
+    size_type length = Length();
+    return (m_position < length ? length - m_position : 0);
+}
+
+void RangeFilterByteStream::Close()
+{
+    // a borrowed stream is closed by its owner
+    if (m_ownedInput)
+        m_ownedInput->Close();
+}
+
+ByteStream::size_type RangeFilterByteStream::WriteBytes(const void *bytes, size_type len)
+{
+    throw std::system_error(std::make_error_code(std::errc::operation_not_supported));
+}
+
+ByteStream::size_type RangeFilterByteStream::Seek(size_type by, std::ios::seekdir dir)
+{
+    switch (dir)
+    {
+        case std::ios::beg:
+            m_position = by;
+            break;
+        case std::ios::cur:
+            m_position += by;
+            break;
+        case std::ios::end:
+            m_position = Length() + by;
+            break;
+        default:
+            break;
+    }
+    
+    m_atEnd = (m_lengthKnown && m_position >= m_length);
+    return m_position;
+}
+
+ByteStream::size_type RangeFilterByteStream::ReadBytes(void *bytes, size_type len)
+{
+    RangeFilterContext *filterContext = dynamic_cast<RangeFilterContext *>(m_filterContext.get());
+    if (len == 0 || filterContext == nullptr || m_atEnd)
+        return 0;
+    
+    // ranges are 32-bit
+    len = std::min(len, size_type(UINT32_MAX));
+    
+    filterContext->GetByteRange().Location((uint32_t)m_position);
+    filterContext->GetByteRange().Length((uint32_t)len);
+    filterContext->SetSeekableByteStream(m_input);
+    filterContext->SetOutputBuffer(bytes, len);
+    
+    size_t filteredLen = 0;
+    void *filteredData = nullptr;
+    {
+        EPUB_MEASURE(measure, FilterData);
+        filteredData = m_filter->FilterData(m_filterContext.get(), nullptr, 0, &filteredLen);
+        EPUB_MEASURE_BYTES(measure, filteredLen);
+    }
+    
+    filterContext->GetByteRange().Reset();
+    filterContext->ResetSeekableByteStream();
+    filterContext->ResetOutputBuffer();
+    
+    filteredLen = std::min(filteredLen, size_t(len));
+    if (filteredData != nullptr && filteredData != bytes)
+    {
+        if (filteredLen > 0)
+            ::memcpy_s(bytes, len, filteredData, filteredLen);
+        if (!filterContext->OwnsByteBuffer(filteredData))
+            delete[] reinterpret_cast<uint8_t *>(filteredData);
+    }
+    
+    if (filteredData == nullptr || filteredLen == 0)
+    {
+        // no more output, whether from the end of the data or an error
+        m_atEnd = true;
+        return 0;
+    }
+    
+    m_position += filteredLen;
+    return filteredLen;
+}
+
 EPUB3_END_NAMESPACE
@@ -75,6 +75,63 @@ private:
     ByteBuffer m_readCache;
 };
 
+/**
+ Presents the output of a filter which supports byte ranges as a SeekableByteStream.
+ 
+ Reads at the stream's position become range requests on the filter, so a filter
+ reading from one of these streams sees the previous filter's output, and can seek
+ within it, without that output ever being produced in full. This is how range
+ filters are stacked; decryption followed by decompression, for example.
+ */
+class RangeFilterByteStream : public SeekableByteStream
+{
+private:
+    RangeFilterByteStream(const RangeFilterByteStream& o)                   _DELETED_;
+    RangeFilterByteStream(RangeFilterByteStream&& o)                        _DELETED_;
+    RangeFilterByteStream&              operator=(RangeFilterByteStream&)                               _DELETED_;
+    RangeFilterByteStream&              operator=(RangeFilterByteStream&&)                              _DELETED_;
+    
+public:
+    ///
+    /// Filters the given stream, which is owned by the new object.
+    EPUB3_EXPORT RangeFilterByteStream(std::unique_ptr<SeekableByteStream> &&input, ContentFilterPtr filter, ConstManifestItemPtr manifestItem);
+    ///
+    /// Filters a stream owned by someone else, which must outlive the new object.
+    EPUB3_EXPORT RangeFilterByteStream(SeekableByteStream *input, ContentFilterPtr filter, ConstManifestItemPtr manifestItem);
+    virtual ~RangeFilterByteStream();
+    
+    virtual size_type BytesAvailable() _NOEXCEPT OVERRIDE;
+    virtual size_type SpaceAvailable() const _NOEXCEPT OVERRIDE { return 0; }
+    virtual bool IsOpen() const _NOEXCEPT OVERRIDE { return m_input->IsOpen(); }
+    virtual void Close() OVERRIDE;
+    virtual size_type ReadBytes(void *bytes, size_type len) OVERRIDE;
+    virtual size_type WriteBytes(const void *bytes, size_type len) OVERRIDE;
+    virtual bool AtEnd() const _NOEXCEPT OVERRIDE { return m_atEnd; }
+    virtual int Error() const _NOEXCEPT OVERRIDE { return m_input->Error(); }
+    virtual size_type Seek(size_type by, std::ios::seekdir dir) OVERRIDE;
+    virtual size_type Position() const OVERRIDE { return m_position; }
+    
+    ///
+    /// Filter contexts hold per-reader state, so these streams can't be cloned; returns `nullptr`.
+    virtual std::shared_ptr<SeekableByteStream> Clone() const OVERRIDE { return nullptr; }
+    
+private:
+    ///
+    /// The length of the filter's output, measured on first use.
+    size_type Length();
+    
+    std::unique_ptr<SeekableByteStream> m_ownedInput;
+    SeekableByteStream *m_input;
+    
+    ContentFilterPtr m_filter;
+    std::unique_ptr<FilterContext> m_filterContext;
+    
+    size_type m_position;
+    size_type m_length;
+    bool m_lengthKnown;
+    bool m_atEnd;
+};
+
 EPUB3_END_NAMESPACE
 
 #endif /* defined(__ePub3__filter_chain_byte_stream_range__) */
@@ -55,7 +55,10 @@ public:
         
         bool operator<(const Record& o) const
         {
-            return m_priority < o.m_priority;
+            // filters sharing a priority are distinct, and must all be kept
+            if ( m_priority != o.m_priority )
+                return m_priority < o.m_priority;
+            return o.m_name < m_name;
         }
         bool operator==(const Record& o) const
         {
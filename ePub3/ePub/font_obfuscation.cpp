@@ -66,6 +66,16 @@ void * FontObfuscator::FilterData(FilterContext* context, void *data, size_t len
     *outputLen = len;
     return buf;
 }
+bool FontObfuscator::ResetFilterContext(FilterContext* context) const
+{
+    // the key belongs to the filter, so only the running count needs clearing
+    FontObfuscationContext* p = dynamic_cast<FontObfuscationContext*>(context);
+    if ( p == nullptr )
+        return false;
+    
+    p->SetProcessedCount(0);
+    return true;
+}
 bool FontObfuscator::BuildKey(ConstContainerPtr container)
 {
     REGEX_NS::regex re("\\s+");
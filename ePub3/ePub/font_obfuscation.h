@@ -122,6 +122,10 @@ public:
      */
     virtual void * FilterData(FilterContext* context, void * data, size_t len, size_t *outputLen) OVERRIDE;
     
+    ///
+    /// The key is derived from the publication's identifier, so the output may be cached.
+    virtual string CacheIdentity() const OVERRIDE { return "FontObfuscator"; }
+    
     static void Register();
     
 protected:
@@ -138,6 +142,7 @@ protected:
     bool BuildKey(ConstContainerPtr container);
     
     virtual FilterContext *InnerMakeFilterContext(ConstManifestItemPtr) const OVERRIDE { return new FontObfuscationContext; }
+    virtual bool ResetFilterContext(FilterContext* context) const OVERRIDE;
 };
 
 EPUB3_END_NAMESPACE
@@ -31,20 +31,75 @@ Glossary::Glossary(shared_ptr<xml::Node> node, PackagePtr pkg) : OwnedBy(pkg), _
 const Glossary::Entry Glossary::Lookup(const Term &term) const
 {
     auto f = _lookup.find(term.tolower());
-    if ( f == _lookup.end() )
-        return Entry();
-    return f->second;
+    if ( f != _lookup.end() )
+        return f->second;
+    
+    // tolower() only handles ASCII: try again with the folded form
+    for ( auto& match : LookupIndex()->Find(term) )
+    {
+        f = _lookup.find(match.term.tolower());
+        if ( f != _lookup.end() )
+            return f->second;
+    }
+    return Entry();
 }
 bool Glossary::AddDefinition(const Term &term, const Definition &definition)
 {
     _lookup[term.tolower()] = std::make_pair(term, definition);
+    SetLookupIndex(nullptr);
     return true;
 }
 bool Glossary::AddDefinition(const Term &term, Definition &&definition)
 {
     _lookup[term.tolower()] = std::make_pair(term, definition);
+    SetLookupIndex(nullptr);
     return true;
 }
+GlossaryIndexPtr Glossary::LookupIndex() const
+{
+    std::lock_guard<std::mutex> _(_indexLock);
+    if ( !bool(_index) )
+    {
+        std::vector<Term> terms;
+        terms.reserve(_lookup.size());
+        for ( auto& item : _lookup )
+        {
+            terms.push_back(item.second.first);
+        }
+        _index = GlossaryIndex::Build(terms);
+    }
+    return _index;
+}
+void Glossary::SetLookupIndex(GlossaryIndexPtr index)
+{
+    std::lock_guard<std::mutex> _(_indexLock);
+    _index = index;
+}
+std::vector<Glossary::Term> Glossary::CompletionsForString(const string& str, size_t limit) const
+{
+    return TermsOf(LookupIndex()->WithPrefix(str, limit));
+}
+const Glossary::Term Glossary::FirstCompletionForString(const string& str) const
+{
+    auto matches = LookupIndex()->WithPrefix(str, 1);
+    if ( matches.empty() )
+        return Term();
+    return matches.front().term;
+}
+std::vector<Glossary::Term> Glossary::SuggestionsForString(const string& str, unsigned int maxDistance, size_t limit) const
+{
+    return TermsOf(LookupIndex()->WithinDistance(str, maxDistance, limit));
+}
+std::vector<Glossary::Term> Glossary::TermsOf(const GlossaryIndex::MatchList& matches)
+{
+    std::vector<Term> result;
+    result.reserve(matches.size());
+    for ( auto& match : matches )
+    {
+        result.push_back(match.term);
+    }
+    return result;
+}
 bool Glossary::Parse(shared_ptr<xml::Node> node)
 {
     // node names
@@ -80,6 +135,7 @@ bool Glossary::Parse(shared_ptr<xml::Node> node)
             {
                 _lookup[term.tolower()] = std::make_pair(term, def);
             }
+            SetLookupIndex(nullptr);
             
             // now clear the terms list
             terms.clear();
@@ -22,7 +22,10 @@
 #define __ePub3__glossary__
 
 #include <ePub3/nav_element.h>
+#include <ePub3/glossary_index.h>
 #include <map>
+#include <mutex>
+#include <vector>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -40,17 +43,14 @@ public:
     typedef std::pair<Term, Definition> Entry;          // lookup table uses lowercased terms as keys; value contains case-correct version
     
 protected:
-    // This should be a Trie-- and will be, when I write one.
-    // When that happens, the following public API will be added to the Glossary class:
-    //   const std::vector<const Term&> CompletionsForString(const std::string& str) const;
-    //   const Term FirstCompletionForString(const std::string& str) const;
+    // Prefix and approximate searches go through a GlossaryIndex built from this table.
     typedef std::map<Term, Entry>       LookupTable;
     
 public:
 	EPUB3_EXPORT    Glossary(shared_ptr<xml::Node> node, PackagePtr pkg);  // must be a <dl> node with epub:type="glossary"
 					Glossary(const string& identifier, PackagePtr pkg) : _ident(identifier), OwnedBy(pkg) {}
 					Glossary(string&& identifier, PackagePtr pkg) : _ident(identifier), OwnedBy(pkg) {}
-                    Glossary(Glossary&& o) : OwnedBy(std::move(o)), _ident(std::move(o._ident)), _lookup(std::move(o._lookup)) {}
+                    Glossary(Glossary&& o) : OwnedBy(std::move(o)), _ident(std::move(o._ident)), _lookup(std::move(o._lookup)), _index(std::move(o._index)), _indexLock() {}
     virtual         ~Glossary() {}
 
 private:
@@ -68,9 +68,46 @@ public:
     virtual bool            AddDefinition(const Term& term, const Definition& definition);
     virtual bool            AddDefinition(const Term& term, Definition&& definition);
     
+    /**
+     Returns the index used for prefix and approximate searches.
+     
+     The index is built from the glossary's terms on first use, and rebuilt after
+     a definition is added. Concurrent readers may call this safely; the first of
+     them builds the index while the others wait for it.
+     */
+    EPUB3_EXPORT
+    GlossaryIndexPtr        LookupIndex()               const;
+    
+    /**
+     Installs a prebuilt index, such as one saved with GlossaryIndex::WriteToFile()
+     and loaded with GlossaryIndex::MapFile(), so it needn't be built again.
+     @note The index must have been built from this glossary's terms.
+     */
+    EPUB3_EXPORT
+    void                    SetLookupIndex(GlossaryIndexPtr index);
+    
+    ///
+    /// Returns the terms beginning with a string, ignoring case and accents, for type-ahead.
+    EPUB3_EXPORT
+    std::vector<Term>       CompletionsForString(const string& str, size_t limit=0)   const;
+    
+    ///
+    /// Returns the first term beginning with a string, or an empty string.
+    EPUB3_EXPORT
+    const Term              FirstCompletionForString(const string& str)                 const;
+    
+    ///
+    /// Returns the terms within a given edit distance of a string, closest first.
+    EPUB3_EXPORT
+    std::vector<Term>       SuggestionsForString(const string& str, unsigned int maxDistance=2, size_t limit=0) const;
+    
 protected:
     string _ident;
     LookupTable _lookup;
+    mutable GlossaryIndexPtr _index;
+    mutable std::mutex      _indexLock;     ///< Guards _index, which const readers build on demand.
+    
+    static std::vector<Term>    TermsOf(const GlossaryIndex::MatchList& matches);
     
 	bool                    Parse(shared_ptr<xml::Node> node);
 };
@@ -0,0 +1,545 @@
+//
+//  glossary_index.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "glossary_index.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#if EPUB_OS(UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+EPUB3_BEGIN_NAMESPACE
+
+static const char       kIndexMagic[4]  = { 'E', 'G', 'I', 'X' };
+static const uint32_t   kIndexVersion   = 1;
+static const uint32_t   kByteOrderMark  = 0x01020304;
+
+struct GlossaryIndex::Header
+{
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    byteOrderMark;
+    uint32_t    count;
+    uint64_t    stringsOffset;
+    uint64_t    stringsLength;
+};
+
+struct GlossaryIndex::Record
+{
+    uint32_t    keyOffset;          ///< Offset of the key within the strings section.
+    uint32_t    keyLength;
+    uint32_t    termOffset;         ///< Offset of the term; the same as the key's if they're identical.
+    uint32_t    termLength;
+};
+
+#if 0
+#pragma mark - Folding
+#endif
+
+// base letters for U+00C0 to U+00FF; '\0' leaves the character alone, '*' is expanded below
+static const char kLatin1Folds[] =
+    "aaaaaa*ceeeeiiii"      // U+00C0
+    "dnooooo\0ouuuuy**"     // U+00D0
+    "aaaaaa*ceeeeiiii"      // U+00E0
+    "dnooooo\0ouuuuy*y";    // U+00F0
+
+// base letters for U+0100 to U+017F (Latin Extended-A)
+static const char kLatinExtendedAFolds[] =
+    "aaaaaaccccccccdd"      // U+0100
+    "ddeeeeeeeeeegggg"      // U+0110
+    "gggghhhhiiiiiiii"      // U+0120
+    "ii**jjkkklllllll"      // U+0130
+    "lllnnnnnnnnnoooo"      // U+0140
+    "oo**rrrrrrssssss"      // U+0150
+    "ssttttttuuuuuuuu"      // U+0160
+    "uuuuwwyyyzzzzzzs";     // U+0170
+
+static void AppendCodePoint(std::string& out, uint32_t cp)
+{
+    utf8::unchecked::append(cp, std::back_inserter(out));
+}
+static void AppendFolded(std::string& out, uint32_t cp)
+{
+    if ( cp < 0x80 )
+    {
+        if ( cp >= 'A' && cp <= 'Z' )
+            cp += 'a' - 'A';
+        out += static_cast<char>(cp);
+        return;
+    }
+
+    switch ( cp )
+    {
+        case 0x00C6: case 0x00E6:   out += "ae";    return;     // æ
+        case 0x00DE: case 0x00FE:   out += "th";    return;     // þ
+        case 0x00DF:                out += "ss";    return;     // ß
+        case 0x0132: case 0x0133:   out += "ij";    return;     // ĳ
+        case 0x0152: case 0x0153:   out += "oe";    return;     // œ
+        case 0x1E9E:                out += "ss";    return;     // capital ß
+        default:
+            break;
+    }
+
+    if ( cp >= 0x00C0 && cp <= 0x00FF && kLatin1Folds[cp - 0x00C0] != '\0' )
+    {
+        out += kLatin1Folds[cp - 0x00C0];
+        return;
+    }
+    if ( cp >= 0x0100 && cp <= 0x017F )
+    {
+        out += kLatinExtendedAFolds[cp - 0x0100];
+        return;
+    }
+
+    // combining diacritical marks, as found in decomposed text
+    if ( cp >= 0x0300 && cp <= 0x036F )
+        return;
+
+    // Greek
+    if ( cp >= 0x0386 && cp <= 0x03CE )
+    {
+        switch ( cp )
+        {
+            case 0x0386: case 0x03AC:                           cp = 0x03B1; break;     // alpha
+            case 0x0388: case 0x03AD:                           cp = 0x03B5; break;     // epsilon
+            case 0x0389: case 0x03AE:                           cp = 0x03B7; break;     // eta
+            case 0x038A: case 0x0390: case 0x03AA: case 0x03AF: case 0x03CA:
+                                                                cp = 0x03B9; break;     // iota
+            case 0x038C: case 0x03CC:                           cp = 0x03BF; break;     // omicron
+            case 0x038E: case 0x03AB: case 0x03B0: case 0x03CB: case 0x03CD:
+                                                                cp = 0x03C5; break;     // upsilon
+            case 0x038F: case 0x03CE:                           cp = 0x03C9; break;     // omega
+            case 0x03C2:                                        cp = 0x03C3; break;     // final sigma
+            default:
+                if ( cp >= 0x0391 && cp <= 0x03A9 )
+                    cp += 0x20;
+                break;
+        }
+    }
+    // Cyrillic
+    else if ( cp >= 0x0400 && cp <= 0x040F )
+    {
+        cp += 0x50;
+    }
+    else if ( cp >= 0x0410 && cp <= 0x042F )
+    {
+        cp += 0x20;
+    }
+
+    AppendCodePoint(out, cp);
+}
+
+// decodes a folded key, which is always valid UTF-8
+static void DecodeKey(const char* p, size_t len, std::vector<uint32_t>& out)
+{
+    out.clear();
+    const char* end = p + len;
+    while ( p < end )
+        out.push_back(utf8::unchecked::next(p));
+}
+
+string GlossaryIndex::FoldedKey(const string& text)
+{
+    const std::string& in = text.stl_str();
+    std::string out;
+    out.reserve(in.size());
+
+    auto pos = in.begin(), end = in.end();
+    while ( pos != end )
+    {
+        uint32_t cp = 0;
+        try
+        {
+            cp = utf8::next(pos, end);
+        }
+        catch (utf8::exception&)
+        {
+            // keep going with the next byte; invalid input still gets a stable key
+            cp = 0xFFFD;
+            ++pos;
+        }
+        AppendFolded(out, cp);
+    }
+
+    return string(out);
+}
+
+#if 0
+#pragma mark - Construction
+#endif
+
+GlossaryIndex::GlossaryIndex() : _storage(), _mapping(nullptr), _mappingSize(0), _data(nullptr), _size(0)
+{
+}
+GlossaryIndex::~GlossaryIndex()
+{
+#if EPUB_OS(UNIX)
+    if ( _mapping != nullptr )
+        ::munmap(_mapping, _mappingSize);
+#endif
+}
+GlossaryIndexPtr GlossaryIndex::Build(const std::vector<string>& terms)
+{
+    typedef std::pair<std::string, std::string> KeyedTerm;
+
+    std::vector<KeyedTerm> keyed;
+    keyed.reserve(terms.size());
+    for ( auto& term : terms )
+    {
+        keyed.emplace_back(FoldedKey(term).stl_str(), term.stl_str());
+    }
+
+    // byte-wise order of UTF-8 is code point order, which is what the prefix searches rely on
+    std::sort(keyed.begin(), keyed.end());
+    keyed.erase(std::unique(keyed.begin(), keyed.end()), keyed.end());
+
+    std::vector<Record> records;
+    records.reserve(keyed.size());
+    std::string strings;
+    for ( size_t i = 0; i < keyed.size(); i++ )
+    {
+        const std::string& key = keyed[i].first;
+        const std::string& term = keyed[i].second;
+
+        Record record;
+        // successive records often share a key, e.g. "Resume" and "résumé"
+        if ( i > 0 && keyed[i-1].first == key )
+        {
+            record.keyOffset = records.back().keyOffset;
+        }
+        else
+        {
+            record.keyOffset = static_cast<uint32_t>(strings.size());
+            strings += key;
+        }
+        record.keyLength = static_cast<uint32_t>(key.size());
+
+        if ( term == key )
+        {
+            record.termOffset = record.keyOffset;
+        }
+        else
+        {
+            record.termOffset = static_cast<uint32_t>(strings.size());
+            strings += term;
+        }
+        record.termLength = static_cast<uint32_t>(term.size());
+
+        records.push_back(record);
+    }
+
+    Header header;
+    ::memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+    header.version = kIndexVersion;
+    header.byteOrderMark = kByteOrderMark;
+    header.count = static_cast<uint32_t>(records.size());
+    header.stringsOffset = sizeof(Header) + records.size() * sizeof(Record);
+    header.stringsLength = strings.size();
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(header.stringsOffset + header.stringsLength));
+    ::memcpy(bytes.data(), &header, sizeof(Header));
+    if ( !records.empty() )
+        ::memcpy(bytes.data() + sizeof(Header), records.data(), records.size() * sizeof(Record));
+    if ( !strings.empty() )
+        ::memcpy(bytes.data() + header.stringsOffset, strings.data(), strings.size());
+
+    return FromBytes(std::move(bytes));
+}
+GlossaryIndexPtr GlossaryIndex::FromBytes(std::vector<uint8_t>&& bytes)
+{
+    std::shared_ptr<GlossaryIndex> result(new GlossaryIndex);
+    result->_storage = std::move(bytes);
+    result->_data = result->_storage.data();
+    result->_size = result->_storage.size();
+    if ( !result->Validate() )
+        return nullptr;
+    return result;
+}
+GlossaryIndexPtr GlossaryIndex::MapFile(const string& path)
+{
+#if EPUB_OS(UNIX)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if ( fd < 0 )
+        return nullptr;
+
+    struct stat sb;
+    if ( ::fstat(fd, &sb) != 0 || sb.st_size < static_cast<off_t>(sizeof(Header)) )
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t size = static_cast<size_t>(sb.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if ( mapping == MAP_FAILED )
+        return nullptr;
+
+    std::shared_ptr<GlossaryIndex> result(new GlossaryIndex);
+    result->_mapping = mapping;
+    result->_mappingSize = size;
+    result->_data = reinterpret_cast<const uint8_t*>(mapping);
+    result->_size = size;
+    if ( !result->Validate() )
+        return nullptr;
+    return result;
+#else
+    std::ifstream file(path.c_str(), std::ios::in|std::ios::binary);
+    if ( !file )
+        return nullptr;
+
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return FromBytes(std::move(bytes));
+#endif
+}
+bool GlossaryIndex::WriteToFile(const string& path) const
+{
+    std::ofstream file(path.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+    if ( !file )
+        return false;
+
+    file.write(reinterpret_cast<const char*>(_data), static_cast<std::streamsize>(_size));
+    file.close();
+    return !file.fail();
+}
+bool GlossaryIndex::Validate()
+{
+    if ( _data == nullptr || _size < sizeof(Header) )
+        return false;
+
+    const Header* header = reinterpret_cast<const Header*>(_data);
+    if ( ::memcmp(header->magic, kIndexMagic, sizeof(kIndexMagic)) != 0 )
+        return false;
+    if ( header->version != kIndexVersion || header->byteOrderMark != kByteOrderMark )
+        return false;
+
+    uint64_t recordsEnd = sizeof(Header) + uint64_t(header->count) * sizeof(Record);
+    if ( header->stringsOffset != recordsEnd || header->stringsOffset + header->stringsLength != _size )
+        return false;
+
+    // every string must lie within the strings section, so lookups never need to check again
+    for ( size_t i = 0; i < header->count; i++ )
+    {
+        const Record& record = RecordAt(i);
+        if ( uint64_t(record.keyOffset) + record.keyLength > header->stringsLength )
+            return false;
+        if ( uint64_t(record.termOffset) + record.termLength > header->stringsLength )
+            return false;
+    }
+
+    return true;
+}
+
+#if 0
+#pragma mark - Accessors
+#endif
+
+size_t GlossaryIndex::Count() const
+{
+    return reinterpret_cast<const Header*>(_data)->count;
+}
+const GlossaryIndex::Record& GlossaryIndex::RecordAt(size_t i) const
+{
+    return reinterpret_cast<const Record*>(_data + sizeof(Header))[i];
+}
+string_view GlossaryIndex::KeyAt(size_t i) const
+{
+    const Header* header = reinterpret_cast<const Header*>(_data);
+    const Record& record = RecordAt(i);
+    return string_view(reinterpret_cast<const char*>(_data + header->stringsOffset + record.keyOffset), record.keyLength);
+}
+string_view GlossaryIndex::TermAt(size_t i) const
+{
+    const Header* header = reinterpret_cast<const Header*>(_data);
+    const Record& record = RecordAt(i);
+    return string_view(reinterpret_cast<const char*>(_data + header->stringsOffset + record.termOffset), record.termLength);
+}
+GlossaryIndex::Match GlossaryIndex::MatchAt(size_t i, unsigned int distance) const
+{
+    string_view key = KeyAt(i), term = TermAt(i);
+    Match match;
+    match.term = string(term.data(), term.size());
+    match.key = string(key.data(), key.size());
+    match.distance = distance;
+    return match;
+}
+
+static int CompareBytes(const string_view& a, const string_view& b)
+{
+    size_t n = std::min(a.size(), b.size());
+    int result = (n == 0 ? 0 : ::memcmp(a.data(), b.data(), n));
+    if ( result != 0 )
+        return result;
+    return (a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0));
+}
+static bool HasPrefix(const string_view& str, const string_view& prefix)
+{
+    return str.size() >= prefix.size() && (prefix.size() == 0 || ::memcmp(str.data(), prefix.data(), prefix.size()) == 0);
+}
+
+size_t GlossaryIndex::LowerBound(const string_view& key, size_t first) const
+{
+    size_t count = Count() - first;
+    while ( count > 0 )
+    {
+        size_t step = count / 2;
+        size_t mid = first + step;
+        if ( CompareBytes(KeyAt(mid), key) < 0 )
+        {
+            first = mid + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    return first;
+}
+size_t GlossaryIndex::EndOfPrefix(const string_view& prefix, size_t first) const
+{
+    // keys beginning with the prefix are contiguous, so the first one which doesn't can be found by bisection
+    size_t count = Count() - first;
+    while ( count > 0 )
+    {
+        size_t step = count / 2;
+        size_t mid = first + step;
+        if ( HasPrefix(KeyAt(mid), prefix) )
+        {
+            first = mid + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    return first;
+}
+
+#if 0
+#pragma mark - Searches
+#endif
+
+GlossaryIndex::MatchList GlossaryIndex::Find(const string& text) const
+{
+    string folded = FoldedKey(text);
+    string_view key(folded.stl_str());
+
+    MatchList result;
+    for ( size_t i = LowerBound(key), n = Count(); i < n && CompareBytes(KeyAt(i), key) == 0; i++ )
+    {
+        result.push_back(MatchAt(i, 0));
+    }
+    return result;
+}
+GlossaryIndex::MatchList GlossaryIndex::WithPrefix(const string& prefix, size_t limit) const
+{
+    string folded = FoldedKey(prefix);
+    string_view key(folded.stl_str());
+
+    MatchList result;
+    for ( size_t i = LowerBound(key), n = Count(); i < n && HasPrefix(KeyAt(i), key); i++ )
+    {
+        result.push_back(MatchAt(i, 0));
+        if ( limit != 0 && result.size() == limit )
+            break;
+    }
+    return result;
+}
+GlossaryIndex::MatchList GlossaryIndex::WithinDistance(const string& query, unsigned int maxDistance, size_t limit) const
+{
+    std::vector<uint32_t> target;
+    string folded = FoldedKey(query);
+    DecodeKey(folded.c_str(), folded.utf8_size(), target);
+
+    // rows[d] is the row of the edit-distance table after the first d characters of
+    // the current key; rows up to validRows are shared with the previous key
+    const size_t width = target.size() + 1;
+    std::vector<std::vector<unsigned int>> rows(1, std::vector<unsigned int>(width));
+    for ( size_t j = 0; j < width; j++ )
+        rows[0][j] = static_cast<unsigned int>(j);
+
+    std::vector<uint32_t> previous, current;
+    size_t validRows = 1;
+
+    MatchList result;
+    for ( size_t i = 0, n = Count(); i < n; i++ )
+    {
+        string_view key = KeyAt(i);
+        DecodeKey(key.data(), key.size(), current);
+
+        size_t common = 0;
+        while ( common < current.size() && common < previous.size() && current[common] == previous[common] )
+            common++;
+
+        size_t depth = std::min(common, validRows - 1);
+        bool pruned = false;
+        for ( ; depth < current.size(); depth++ )
+        {
+            if ( rows.size() <= depth + 1 )
+                rows.emplace_back(width);
+
+            const std::vector<unsigned int>& above = rows[depth];
+            std::vector<unsigned int>& row = rows[depth + 1];
+            row[0] = above[0] + 1;
+            unsigned int best = row[0];
+            for ( size_t j = 1; j < width; j++ )
+            {
+                unsigned int substitution = above[j-1] + (target[j-1] == current[depth] ? 0 : 1);
+                row[j] = std::min(std::min(above[j] + 1, row[j-1] + 1), substitution);
+                best = std::min(best, row[j]);
+            }
+
+            if ( best > maxDistance )
+            {
+                // no key which starts this way can match: skip all of them
+                const char* start = key.data();
+                const char* pos = start;
+                for ( size_t c = 0; c <= depth; c++ )
+                    utf8::unchecked::next(pos);
+                i = EndOfPrefix(string_view(start, static_cast<size_t>(pos - start)), i + 1) - 1;
+                pruned = true;
+                break;
+            }
+        }
+
+        validRows = (pruned ? depth + 1 : current.size() + 1);
+        previous.swap(current);
+
+        if ( !pruned && rows[previous.size()][width-1] <= maxDistance )
+            result.push_back(MatchAt(i, rows[previous.size()][width-1]));
+    }
+
+    std::stable_sort(result.begin(), result.end(), [](const Match& a, const Match& b) {
+        return a.distance < b.distance;
+    });
+    if ( limit != 0 && result.size() > limit )
+        result.resize(limit);
+    return result;
+}
+
+EPUB3_END_NAMESPACE
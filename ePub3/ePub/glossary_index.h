@@ -0,0 +1,187 @@
+//
+//  glossary_index.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__glossary_index__
+#define __ePub3__glossary_index__
+
+#include <ePub3/epub3.h>
+#include <ePub3/utilities/utfstring.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+class GlossaryIndex;
+typedef std::shared_ptr<const GlossaryIndex>    GlossaryIndexPtr;
+
+/**
+ An immutable index over the terms of a glossary, supporting prefix (type-ahead)
+ and approximate ("did you mean") searches.
+
+ Terms are indexed under a folded key (see FoldedKey()), so searches ignore case
+ and accents. The index is a single contiguous block of memory: a header, an array
+ of fixed-size records sorted by key, and the key and term strings those records
+ refer to. The same bytes are the serialized form, so an index written with
+ WriteToFile() can be memory-mapped by MapFile() and used without being parsed or
+ copied, which keeps opening a dictionary with several hundred thousand entries
+ cheap.
+
+ Approximate searches walk the sorted keys as though they were a trie: the rows of
+ the edit-distance table are shared by keys with a common prefix, and as soon as a
+ prefix is further than the allowed distance from the query, every key beginning
+ with it is skipped with a binary search.
+
+ @note The serialized form uses the byte order of the machine which wrote it; an
+ index from a machine with a different byte order is rejected when it is loaded.
+ @ingroup navigation
+ */
+class GlossaryIndex
+{
+public:
+    ///
+    /// A term found by a search.
+    struct Match
+    {
+        string          term;           ///< The term, as it appears in the glossary.
+        string          key;            ///< The folded key under which the term is indexed.
+        unsigned int    distance;       ///< The edit distance from the query (zero for exact and prefix matches).
+    };
+    typedef std::vector<Match>      MatchList;
+
+private:
+                    GlossaryIndex(const GlossaryIndex&)     _DELETED_;
+    GlossaryIndex&  operator=(const GlossaryIndex&)         _DELETED_;
+
+protected:
+                    GlossaryIndex();
+
+public:
+    virtual         ~GlossaryIndex();
+
+    /**
+     Folds a term or query into the form used as a key.
+
+     Letters are lowercased and Latin accents are removed (so "Élan" and "elan"
+     match), `ß`, `æ`, `œ`, `þ` and `ĳ` are expanded to two letters, combining
+     marks are dropped, and Greek and Cyrillic letters are lowercased, with Greek
+     tonos and dialytika removed and final sigma folded to sigma. Everything else
+     is left unchanged.
+     */
+    EPUB3_EXPORT
+    static string           FoldedKey(const string& text);
+
+    /**
+     Builds an index over a set of terms. Duplicate terms are indexed once.
+     @result The new index.
+     */
+    EPUB3_EXPORT
+    static GlossaryIndexPtr Build(const std::vector<string>& terms);
+
+    /**
+     Adopts a serialized index.
+     @param bytes The serialized form, as returned by Bytes().
+     @result The index, or `nullptr` if the bytes are not a valid index.
+     */
+    EPUB3_EXPORT
+    static GlossaryIndexPtr FromBytes(std::vector<uint8_t>&& bytes);
+
+    /**
+     Maps a serialized index written by WriteToFile() into memory.
+
+     On systems without `mmap()` the file is read into memory instead.
+     @result The index, or `nullptr` if the file cannot be read or is not a valid index.
+     */
+    EPUB3_EXPORT
+    static GlossaryIndexPtr MapFile(const string& path);
+
+    ///
+    /// Writes the serialized form of the index to a file.
+    EPUB3_EXPORT
+    bool                    WriteToFile(const string& path)                         const;
+
+    ///
+    /// The serialized form of the index.
+    const uint8_t*          Bytes()                                                 const   { return _data; }
+    ///
+    /// The size of the serialized form, which is also the memory used by the index.
+    size_t                  ByteCount()                                             const   { return _size; }
+
+    ///
+    /// The number of terms in the index.
+    EPUB3_EXPORT
+    size_t                  Count()                                                 const;
+
+    ///
+    /// Returns the terms whose folded key matches that of `text`.
+    EPUB3_EXPORT
+    MatchList               Find(const string& text)                                const;
+
+    /**
+     Returns the terms whose folded key begins with the folded form of `prefix`.
+     @param prefix The text typed so far.
+     @param limit The maximum number of matches to return, or zero for all of them.
+     @result The matches, ordered by key.
+     */
+    EPUB3_EXPORT
+    MatchList               WithPrefix(const string& prefix, size_t limit=0)        const;
+
+    /**
+     Returns the terms whose folded key is within a given Levenshtein distance of
+     the folded form of `query`, counted in characters.
+     @param query The text to match.
+     @param maxDistance The largest number of single-character insertions,
+     deletions or substitutions allowed.
+     @param limit The maximum number of matches to return, or zero for all of them.
+     @result The matches, closest first, and ordered by key for equal distances.
+     */
+    EPUB3_EXPORT
+    MatchList               WithinDistance(const string& query, unsigned int maxDistance, size_t limit=0) const;
+
+protected:
+    struct Header;
+    struct Record;
+
+    std::vector<uint8_t>    _storage;       ///< Owned bytes, if the index isn't mapped.
+    void*                   _mapping;       ///< The `mmap()`ed region, if any.
+    size_t                  _mappingSize;
+    const uint8_t*          _data;
+    size_t                  _size;
+
+    ///
+    /// Checks that the bytes form a valid index, and sets up the accessors.
+    bool                    Validate();
+
+    const Record&           RecordAt(size_t i)                                      const;
+    string_view             KeyAt(size_t i)                                         const;
+    string_view             TermAt(size_t i)                                        const;
+    Match                   MatchAt(size_t i, unsigned int distance)                const;
+
+    ///
+    /// The index of the first record whose key is not less than `key`.
+    size_t                  LowerBound(const string_view& key, size_t first=0)      const;
+    ///
+    /// The index of the first record at or after `first` whose key does not begin with `prefix`.
+    size_t                  EndOfPrefix(const string_view& prefix, size_t first)    const;
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__glossary_index__) */
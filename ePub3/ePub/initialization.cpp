@@ -23,6 +23,8 @@
 #include <ePub3/archive.h>
 #include <ePub3/filter_manager_impl.h>
 #include <ePub3/font_obfuscation.h>
+#include <ePub3/aes_cbc_decryption.h>
+#include <ePub3/deflate_decompression.h>
 #include <ePub3/switch_preprocessor.h>
 #include <ePub3/object_preprocessor.h>
 #include <ePub3/PassThroughFilter.h>
@@ -43,6 +45,8 @@ void PopulateFilterManager()
     static std::once_flag __once;
     std::call_once(__once, []{
         FontObfuscator::Register();
+        AESCBCDecryptor::Register();
+        DeflateDecompressor::Register();
 		// If you want to activate the PassThroughFilter (to do testing or debugging),
 		// simply uncomment the line below. Also take a look at the file PassThroughFilter.cpp
 		// to see if the class is enabling itself.
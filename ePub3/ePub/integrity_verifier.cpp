@@ -0,0 +1,538 @@
+//
+//  integrity_verifier.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ePub3/base.h>
+
+// OpenSSL APIs are deprecated on OS X and iOS
+#if EPUB_OS(DARWIN)
+#define COMMON_DIGEST_FOR_OPENSSL
+#include <CommonCrypto/CommonDigest.h>
+#define EPUB_HAVE_SHA_DIGESTS 1
+#elif EPUB_PLATFORM(WIN) || EPUB_PLATFORM(WINRT)
+#define EPUB_HAVE_SHA_DIGESTS 0
+#else
+#include <openssl/evp.h>
+#define EPUB_HAVE_SHA_DIGESTS 1
+#endif
+
+#include "integrity_verifier.h"
+#include <libzip/zip.h>
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+
+EPUB3_BEGIN_NAMESPACE
+
+static const char * gSHA1DigestURI = "http://www.w3.org/2000/09/xmldsig#sha1";
+static const char * gSHA256DigestURI = "http://www.w3.org/2001/04/xmlenc#sha256";
+static const char * gSHA512DigestURI = "http://www.w3.org/2001/04/xmlenc#sha512";
+
+// each worker reads through a single buffer of this size
+static const size_t gVerifierBufferSize = 64 * 1024;
+
+namespace
+{
+    enum class DigestAlgorithm
+    {
+        Unsupported,
+        SHA1,
+        SHA256,
+        SHA512
+    };
+
+    DigestAlgorithm AlgorithmForURI(const string& uri)
+    {
+#if EPUB_HAVE(SHA_DIGESTS)
+        if ( uri == gSHA1DigestURI )
+            return DigestAlgorithm::SHA1;
+        if ( uri == gSHA256DigestURI )
+            return DigestAlgorithm::SHA256;
+        if ( uri == gSHA512DigestURI )
+            return DigestAlgorithm::SHA512;
+#endif
+        return DigestAlgorithm::Unsupported;
+    }
+
+    ///
+    /// Incrementally computes one digest of an entry's data.
+    class StreamingDigest
+    {
+    public:
+        StreamingDigest(DigestAlgorithm algorithm) : _algorithm(algorithm)
+#if !EPUB_OS(DARWIN) && EPUB_HAVE(SHA_DIGESTS)
+            , _ctx(nullptr)
+#endif
+            {
+#if EPUB_OS(DARWIN)
+                switch ( _algorithm )
+                {
+                    case DigestAlgorithm::SHA1:
+                        SHA1_Init(&_ctx.sha1);
+                        break;
+                    case DigestAlgorithm::SHA256:
+                        SHA256_Init(&_ctx.sha256);
+                        break;
+                    case DigestAlgorithm::SHA512:
+                        SHA512_Init(&_ctx.sha512);
+                        break;
+                    default:
+                        break;
+                }
+#elif EPUB_HAVE(SHA_DIGESTS)
+                const EVP_MD* md = MessageDigest(_algorithm);
+                if ( md != nullptr && (_ctx = EVP_MD_CTX_new()) != nullptr && EVP_DigestInit_ex(_ctx, md, nullptr) != 1 )
+                {
+                    EVP_MD_CTX_free(_ctx);
+                    _ctx = nullptr;
+                }
+#endif
+            }
+#if !EPUB_OS(DARWIN) && EPUB_HAVE(SHA_DIGESTS)
+        StreamingDigest(StreamingDigest&& o) _NOEXCEPT : _algorithm(o._algorithm), _ctx(o._ctx)
+            {
+                o._ctx = nullptr;
+            }
+        ~StreamingDigest()
+            {
+                if ( _ctx != nullptr )
+                    EVP_MD_CTX_free(_ctx);
+            }
+#endif
+
+        DigestAlgorithm Algorithm() const { return _algorithm; }
+
+        void Update(const void* data, size_t len)
+            {
+#if EPUB_OS(DARWIN)
+                switch ( _algorithm )
+                {
+                    case DigestAlgorithm::SHA1:
+                        SHA1_Update(&_ctx.sha1, data, len);
+                        break;
+                    case DigestAlgorithm::SHA256:
+                        SHA256_Update(&_ctx.sha256, data, len);
+                        break;
+                    case DigestAlgorithm::SHA512:
+                        SHA512_Update(&_ctx.sha512, data, len);
+                        break;
+                    default:
+                        break;
+                }
+#elif EPUB_HAVE(SHA_DIGESTS)
+                if ( _ctx != nullptr )
+                    EVP_DigestUpdate(_ctx, data, len);
+#endif
+            }
+
+        DigestValue Final()
+            {
+#if EPUB_OS(DARWIN)
+                uint8_t md[SHA512_DIGEST_LENGTH];
+                switch ( _algorithm )
+                {
+                    case DigestAlgorithm::SHA1:
+                        SHA1_Final(md, &_ctx.sha1);
+                        return DigestValue(md, SHA_DIGEST_LENGTH);
+                    case DigestAlgorithm::SHA256:
+                        SHA256_Final(md, &_ctx.sha256);
+                        return DigestValue(md, SHA256_DIGEST_LENGTH);
+                    case DigestAlgorithm::SHA512:
+                        SHA512_Final(md, &_ctx.sha512);
+                        return DigestValue(md, SHA512_DIGEST_LENGTH);
+                    default:
+                        break;
+                }
+#elif EPUB_HAVE(SHA_DIGESTS)
+                uint8_t md[EVP_MAX_MD_SIZE];
+                unsigned int len = 0;
+                if ( _ctx != nullptr && EVP_DigestFinal_ex(_ctx, md, &len) == 1 )
+                    return DigestValue(md, len);
+#endif
+                return DigestValue();
+            }
+
+    private:
+        DigestAlgorithm     _algorithm;
+#if EPUB_OS(DARWIN)
+        union
+        {
+            SHA_CTX         sha1;
+            SHA256_CTX      sha256;
+            SHA512_CTX      sha512;
+        }                   _ctx;
+#elif EPUB_HAVE(SHA_DIGESTS)
+        EVP_MD_CTX*         _ctx;
+
+        static const EVP_MD* MessageDigest(DigestAlgorithm algorithm)
+            {
+                switch ( algorithm )
+                {
+                    case DigestAlgorithm::SHA1:
+                        return EVP_sha1();
+                    case DigestAlgorithm::SHA256:
+                        return EVP_sha256();
+                    case DigestAlgorithm::SHA512:
+                        return EVP_sha512();
+                    default:
+                        return nullptr;
+                }
+            }
+
+        StreamingDigest(const StreamingDigest&) _DELETED_;
+        StreamingDigest& operator=(const StreamingDigest&) _DELETED_;
+#endif
+    };
+
+    ///
+    /// A single archive entry to be read by a worker.
+    struct VerificationJob
+    {
+        int                                         index;
+        size_t                                      size;
+        const std::vector<SignatureReference>*      references;
+        IntegrityVerifier::ItemResult*              result;
+    };
+
+    ///
+    /// Blocks the calling thread until a number of workers have finished.
+    class CompletionLatch
+    {
+    public:
+        CompletionLatch(size_t count) : _count(count), _lock(), _done() {}
+
+        void CountDown()
+            {
+                std::lock_guard<std::mutex> _(_lock);
+                if ( --_count == 0 )
+                    _done.notify_all();
+            }
+        void Wait()
+            {
+                std::unique_lock<std::mutex> lk(_lock);
+                _done.wait(lk, [this](){ return _count == 0; });
+            }
+
+    private:
+        size_t                  _count;
+        std::mutex              _lock;
+        std::condition_variable _done;
+    };
+
+    // orders statuses so that the most severe is reported for an entry with several references
+    int DigestSeverity(IntegrityVerifier::DigestStatus status)
+    {
+        switch ( status )
+        {
+            case IntegrityVerifier::DigestStatus::NotSigned:
+                return 0;
+            case IntegrityVerifier::DigestStatus::Valid:
+                return 1;
+            case IntegrityVerifier::DigestStatus::UnsupportedAlgorithm:
+                return 2;
+            case IntegrityVerifier::DigestStatus::UnsupportedTransform:
+                return 3;
+            case IntegrityVerifier::DigestStatus::Mismatch:
+            case IntegrityVerifier::DigestStatus::Missing:
+            default:
+                return 4;
+        }
+    }
+
+    void MergeDigestStatus(IntegrityVerifier::ItemResult* result, IntegrityVerifier::DigestStatus status)
+    {
+        if ( DigestSeverity(status) > DigestSeverity(result->digest) )
+            result->digest = status;
+    }
+
+    // for an entry which couldn't be read at all, so none of its references can be satisfied
+    void MarkUnreadable(const VerificationJob& job)
+    {
+        job.result->crc = IntegrityVerifier::CRCStatus::ReadError;
+        if ( job.references != nullptr && !job.references->empty() )
+            MergeDigestStatus(job.result, IntegrityVerifier::DigestStatus::Mismatch);
+    }
+
+    void VerifyEntry(struct zip* zip, const VerificationJob& job, uint8_t* buffer, size_t bufferSize)
+    {
+        typedef IntegrityVerifier::CRCStatus CRCStatus;
+        typedef IntegrityVerifier::DigestStatus DigestStatus;
+
+        // one digest per distinct algorithm, shared by all references using it
+        std::vector<StreamingDigest> digests;
+        if ( job.references != nullptr )
+        {
+            for ( auto& ref : *job.references )
+            {
+                if ( !ref.Transforms().empty() )
+                {
+                    MergeDigestStatus(job.result, DigestStatus::UnsupportedTransform);
+                    continue;
+                }
+
+                DigestAlgorithm algorithm = AlgorithmForURI(ref.DigestMethod());
+                if ( algorithm == DigestAlgorithm::Unsupported )
+                {
+                    MergeDigestStatus(job.result, DigestStatus::UnsupportedAlgorithm);
+                    continue;
+                }
+
+                auto pos = std::find_if(digests.begin(), digests.end(), [algorithm](const StreamingDigest& d) {
+                    return d.Algorithm() == algorithm;
+                });
+                if ( pos == digests.end() )
+                    digests.emplace_back(algorithm);
+            }
+        }
+
+        struct zip_file* file = zip_fopen_index(zip, job.index, 0);
+        if ( file == nullptr )
+        {
+            job.result->crc = CRCStatus::ReadError;
+            if ( !digests.empty() )
+                MergeDigestStatus(job.result, DigestStatus::Mismatch);
+            return;
+        }
+
+        // zip_fread() keeps a running CRC32 and checks it once the entry is exhausted
+        ssize_t numRead = 0;
+        while ( (numRead = zip_fread(file, buffer, bufferSize)) > 0 )
+        {
+            for ( auto& digest : digests )
+            {
+                digest.Update(buffer, static_cast<size_t>(numRead));
+            }
+        }
+
+        if ( numRead < 0 )
+        {
+            int zipErr = 0, sysErr = 0;
+            zip_file_error_get(file, &zipErr, &sysErr);
+            job.result->crc = (zipErr == ZIP_ER_CRC ? CRCStatus::Mismatch : CRCStatus::ReadError);
+        }
+        else
+        {
+            job.result->crc = CRCStatus::Valid;
+        }
+
+        zip_fclose(file);
+
+        if ( digests.empty() )
+            return;
+
+        if ( job.result->crc == CRCStatus::ReadError )
+        {
+            MergeDigestStatus(job.result, DigestStatus::Mismatch);
+            return;
+        }
+
+        std::vector<DigestValue> values;
+        values.reserve(digests.size());
+        for ( auto& digest : digests )
+        {
+            values.push_back(digest.Final());
+        }
+
+        for ( auto& ref : *job.references )
+        {
+            if ( !ref.Transforms().empty() )
+                continue;
+            DigestAlgorithm algorithm = AlgorithmForURI(ref.DigestMethod());
+            if ( algorithm == DigestAlgorithm::Unsupported )
+                continue;
+
+            for ( size_t i = 0; i < digests.size(); i++ )
+            {
+                if ( digests[i].Algorithm() != algorithm )
+                    continue;
+                MergeDigestStatus(job.result, (values[i] == ref.Digest() ? DigestStatus::Valid : DigestStatus::Mismatch));
+                break;
+            }
+        }
+    }
+
+    void RunVerificationWorker(const std::string& archivePath, const std::vector<VerificationJob>& jobs, std::atomic_size_t& nextJob)
+    {
+        int zerr = 0;
+        struct zip* zip = zip_open(archivePath.c_str(), 0, &zerr);
+        std::unique_ptr<uint8_t[]> buffer(new uint8_t[gVerifierBufferSize]);
+
+        size_t i = 0;
+        while ( (i = nextJob++) < jobs.size() )
+        {
+            const VerificationJob& job = jobs[i];
+            if ( zip == nullptr )
+            {
+                MarkUnreadable(job);
+                continue;
+            }
+
+            VerifyEntry(zip, job, buffer.get(), gVerifierBufferSize);
+        }
+
+        if ( zip != nullptr )
+            zip_close(zip);
+    }
+}
+
+IntegrityVerifier::IntegrityVerifier(const string& archivePath) : _archivePath(archivePath), _references(), _referenceCount(0), _checkAll(true)
+{
+}
+void IntegrityVerifier::AddReference(const SignatureReference& reference)
+{
+    // same-document and external references can't be checked against the archive
+    string path = reference.ContainerPath();
+    if ( path.empty() )
+        return;
+
+    _references[path.stl_str()].push_back(reference);
+    _referenceCount++;
+}
+void IntegrityVerifier::AddSignature(const DigitalSignature& signature)
+{
+    for ( auto& reference : signature.AllReferences() )
+    {
+        AddReference(reference);
+    }
+}
+IntegrityVerifier::ResultList IntegrityVerifier::Verify(int threadCount) const
+{
+    thread_pool pool(threadCount);
+
+    size_t workers = static_cast<size_t>(threadCount);
+    if ( threadCount == thread_pool::Automatic )
+        workers = std::max(std::thread::hardware_concurrency(), 1u);
+
+    return Verify(pool, workers);
+}
+IntegrityVerifier::ResultList IntegrityVerifier::Verify(executor& exec, size_t workers) const
+{
+    int zerr = 0;
+    struct zip* zip = zip_open(_archivePath.c_str(), 0, &zerr);
+    if ( zip == nullptr )
+    {
+        // zerr is a libzip error code, not a zlib one
+        char msg[128];
+        zip_error_to_str(msg, sizeof(msg), zerr, errno);
+        throw std::runtime_error(std::string("zip_open() failed: ") + msg);
+    }
+
+    int numEntries = std::max(zip_get_num_files(zip), 0);
+    ResultList results;
+    results.reserve(numEntries);
+
+    std::vector<VerificationJob> jobs;
+    jobs.reserve(numEntries);
+    std::set<std::string> found;
+
+    struct zip_stat zinfo;
+    for ( int i = 0; i < numEntries; i++ )
+    {
+        zip_stat_init(&zinfo);
+        if ( zip_stat_index(zip, i, 0, &zinfo) < 0 )
+            continue;
+
+        auto refs = _references.find(zinfo.name);
+        if ( refs == _references.end() && !_checkAll )
+            continue;
+
+        ItemResult result;
+        result.path = zinfo.name;
+        result.size = static_cast<size_t>(zinfo.size);
+        results.push_back(result);
+
+        VerificationJob job;
+        job.index = i;
+        job.size = result.size;
+        job.references = nullptr;
+        job.result = nullptr;
+        if ( refs != _references.end() )
+        {
+            job.references = &refs->second;
+            found.insert(refs->first);
+        }
+        jobs.push_back(job);
+    }
+
+    zip_close(zip);
+
+    // results can no longer be reallocated, so jobs may now point into it
+    for ( size_t i = 0; i < jobs.size(); i++ )
+    {
+        jobs[i].result = &results[i];
+    }
+
+    // largest entries first, so one large entry at the end doesn't serialize the tail
+    std::stable_sort(jobs.begin(), jobs.end(), [](const VerificationJob& a, const VerificationJob& b) {
+        return a.size > b.size;
+    });
+
+    workers = std::max<size_t>(std::min(workers, jobs.size()), 1);
+
+    std::atomic_size_t nextJob(0);
+    CompletionLatch latch(workers);
+    const std::string& archivePath = _archivePath.stl_str();
+    for ( size_t i = 0; i < workers; i++ )
+    {
+        exec.add([&archivePath, &jobs, &nextJob, &latch]() {
+            try
+            {
+                RunVerificationWorker(archivePath, jobs, nextJob);
+            }
+            catch (...)
+            {
+                // any entry this worker had claimed is reported as unreadable below
+            }
+            latch.CountDown();
+        });
+    }
+    latch.Wait();
+
+    // a worker which failed may have left entries unread, and they mustn't pass as valid
+    for ( auto& job : jobs )
+    {
+        if ( job.result->crc == CRCStatus::NotChecked )
+            MarkUnreadable(job);
+    }
+
+    for ( auto& item : _references )
+    {
+        if ( found.find(item.first) != found.end() )
+            continue;
+
+        ItemResult result;
+        result.path = item.first;
+        result.digest = DigestStatus::Missing;
+        results.push_back(result);
+    }
+
+    return results;
+}
+bool IntegrityVerifier::AllValid(const ResultList& results)
+{
+    return std::all_of(results.begin(), results.end(), [](const ItemResult& result) { return result.Valid(); });
+}
+bool IntegrityVerifier::SupportsDigestMethod(const string& algorithm)
+{
+    return AlgorithmForURI(algorithm) != DigestAlgorithm::Unsupported;
+}
+
+EPUB3_END_NAMESPACE
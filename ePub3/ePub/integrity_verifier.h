@@ -0,0 +1,178 @@
+//
+//  integrity_verifier.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__integrity_verifier__
+#define __ePub3__integrity_verifier__
+
+#include <ePub3/epub3.h>
+#include <ePub3/signatures.h>
+#include <ePub3/utilities/executor.h>
+#include <map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Checks the integrity of the items in a ZIP-based OCF container.
+
+ Every entry in the archive is read exactly once, in a single streaming pass: the
+ ZIP CRC32 is verified as the data is inflated, and any entry referenced by a
+ signature in `META-INF/signatures.xml` is fed through the reference's digest
+ algorithm at the same time. No entry is ever held in memory in its entirety.
+
+ Entries are distributed across a number of workers running on an executor (by
+ default a thread_pool). Since a single `libzip` handle cannot be shared between
+ threads, each worker opens the archive file independently.
+
+ Only the integrity of the referenced data is checked; the signature value itself
+ is not validated. References requiring transforms (for instance XML
+ canonicalization) are reported as DigestStatus::UnsupportedTransform.
+
+ @ingroup epub-model
+ */
+class IntegrityVerifier
+{
+public:
+    ///
+    /// The result of checking an entry's ZIP CRC32.
+    enum class CRCStatus : uint8_t
+    {
+        NotChecked,             ///< The entry was not read.
+        Valid,                  ///< The CRC matched.
+        Mismatch,               ///< The CRC did not match the central directory.
+        ReadError               ///< The entry could not be read or inflated.
+    };
+
+    ///
+    /// The result of checking an entry against its signature references.
+    enum class DigestStatus : uint8_t
+    {
+        NotSigned,              ///< No signature references this entry.
+        Valid,                  ///< All referenced digests matched.
+        Mismatch,               ///< At least one digest did not match.
+        UnsupportedAlgorithm,   ///< A reference uses a digest method which isn't available.
+        UnsupportedTransform,   ///< A reference requires a transform before digesting.
+        Missing                 ///< The referenced item is not present in the archive.
+    };
+
+    ///
+    /// The verification result for a single archive entry.
+    struct ItemResult
+    {
+        string          path;           ///< The container-relative path.
+        size_t          size;           ///< Uncompressed size in bytes.
+        CRCStatus       crc;
+        DigestStatus    digest;
+
+        ItemResult() : path(), size(0), crc(CRCStatus::NotChecked), digest(DigestStatus::NotSigned) {}
+
+        ///
+        /// Returns `false` if any check on this item failed or could not be performed.
+        bool            Valid()         const
+            {
+                return crc == CRCStatus::Valid &&
+                       (digest == DigestStatus::Valid || digest == DigestStatus::NotSigned);
+            }
+    };
+
+    typedef std::vector<ItemResult>     ResultList;
+
+private:
+                        IntegrityVerifier()                             _DELETED_;
+                        IntegrityVerifier(const IntegrityVerifier&)     _DELETED_;
+    IntegrityVerifier&  operator=(const IntegrityVerifier&)             _DELETED_;
+
+public:
+    /**
+     Creates a verifier for a ZIP archive.
+     @param archivePath The filesystem path of the archive to verify.
+     */
+    EPUB3_EXPORT        IntegrityVerifier(const string& archivePath);
+    virtual             ~IntegrityVerifier() {}
+
+    ///
+    /// Adds a single reference to be checked.
+    EPUB3_EXPORT
+    void                AddReference(const SignatureReference& reference);
+
+    ///
+    /// Adds all the references from a signature.
+    EPUB3_EXPORT
+    void                AddSignature(const DigitalSignature& signature);
+
+    ///
+    /// The number of references added so far.
+    size_t              ReferenceCount()                const   { return _referenceCount; }
+
+    ///
+    /// If `false`, only entries referenced by a signature are read. Defaults to `true`.
+    bool                ChecksAllEntries()              const   { return _checkAll; }
+    void                SetChecksAllEntries(bool check)         { _checkAll = check; }
+
+    /**
+     Verifies the archive using a temporary thread pool.
+     @param threadCount The number of threads to use. thread_pool::Automatic uses
+     one thread per available CPU.
+     @result One result for every archive entry checked, in archive order, followed
+     by a result with DigestStatus::Missing for every referenced path which is not
+     present in the archive.
+     @throws std::runtime_error if the archive cannot be opened.
+     */
+    EPUB3_EXPORT
+    ResultList          Verify(int threadCount = thread_pool::Automatic)    const;
+
+    /**
+     Verifies the archive using workers scheduled on an existing executor.
+
+     This method blocks until all workers have completed.
+     @param exec The executor on which to run the workers. It must be able to run
+     `workers` closures concurrently, or it must run them inline.
+     @param workers The number of workers to schedule, each of which opens its own
+     handle on the archive.
+     @see Verify(int)
+     */
+    EPUB3_EXPORT
+    ResultList          Verify(executor& exec, size_t workers)              const;
+
+    ///
+    /// Returns `true` if all items in a result list are valid.
+    EPUB3_EXPORT
+    static bool         AllValid(const ResultList& results);
+
+    ///
+    /// Returns `true` if the given digest method URI can be verified.
+    EPUB3_EXPORT
+    static bool         SupportsDigestMethod(const string& algorithm);
+
+protected:
+    ///
+    /// The references for a single container path.
+    typedef std::vector<SignatureReference>         ReferenceList;
+    typedef std::map<std::string, ReferenceList>    ReferenceMap;
+
+    string              _archivePath;
+    ReferenceMap        _references;
+    size_t              _referenceCount;
+    bool                _checkAll;
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__integrity_verifier__) */
@@ -22,6 +22,8 @@
 #include "package.h"
 #include "byte_stream.h"
 #include "container.h"
+#include "archive.h"
+#include "xml_stream_reader.h"
 #include REGEX_INCLUDE
 #include <sstream>
 
@@ -152,14 +154,50 @@ string ItemProperties::str() const
     return builder.str();
 }
 
-ManifestItem::ManifestItem(const shared_ptr<Package>& owner) : OwnedBy(owner), PropertyHolder(owner), _href(), _mediaType(), _mediaOverlayID(), _fallbackID(), _parsedProperties(0)
+ResourceDescriptor::ResourceDescriptor(const ManifestItem& item) : _path(), _archiveIndex(-1), _compressed(false), _compressedSize(0), _uncompressedSize(0), _encryption()
+{
+    auto package = item.GetPackage();
+    if ( !package )
+    {
+        _path = item.BaseHref();
+        return;
+    }
+    
+    _path = package->BasePath() + item.BaseHref();
+    
+    auto container = package->GetContainer();
+    if ( !container )
+        return;
+    
+    // encryption.xml paths never have a leading slash
+    if ( !_path.empty() && _path[0] == '/' )
+        _encryption = container->EncryptionInfoForPath(_path.substr(1));
+    else
+        _encryption = container->EncryptionInfoForPath(_path);
+    
+    auto archive = container->GetArchive();
+    if ( !archive )
+        return;
+    
+    _archiveIndex = archive->IndexOfItem(_path);
+    if ( _archiveIndex >= 0 )
+    {
+        ArchiveItemInfo info = archive->InfoAtIndex(_archiveIndex);
+        _compressed = info.IsCompressed();
+        _compressedSize = info.CompressedSize();
+        _uncompressedSize = info.UncompressedSize();
+    }
+}
+
+ManifestItem::ManifestItem(const shared_ptr<Package>& owner) : OwnedBy(owner), PropertyHolder(owner), _href(), _mediaType(), _mediaOverlayID(), _fallbackID(), _parsedProperties(0), _descriptor(nullptr)
 {
 }
-ManifestItem::ManifestItem(ManifestItem&& o) : OwnedBy(std::move(o)), PropertyHolder(std::move(o)), XMLIdentifiable(std::move(o)), _href(std::move(o._href)), _mediaType(std::move(o._mediaType)), _mediaOverlayID(std::move(o._mediaOverlayID)), _fallbackID(std::move(o._fallbackID)), _parsedProperties(std::move(o._parsedProperties))
+ManifestItem::ManifestItem(ManifestItem&& o) : OwnedBy(std::move(o)), PropertyHolder(std::move(o)), XMLIdentifiable(std::move(o)), _href(std::move(o._href)), _mediaType(std::move(o._mediaType)), _mediaOverlayID(std::move(o._mediaOverlayID)), _fallbackID(std::move(o._fallbackID)), _parsedProperties(std::move(o._parsedProperties)), _descriptor(o._descriptor.exchange(nullptr))
 {
 }
 ManifestItem::~ManifestItem()
 {
+    delete _descriptor.load();
 }
 bool ManifestItem::ParseXML(shared_ptr<xml::Node> node)
 {
@@ -180,9 +218,38 @@ bool ManifestItem::ParseXML(shared_ptr<xml::Node> node)
     _parsedProperties = ItemProperties(_getProp(node, "properties"));
     return true;
 }
-string ManifestItem::AbsolutePath() const
+#if EPUB_USE(LIBXML2)
+bool ManifestItem::ParseXML(const XMLStreamReader& reader)
 {
-    return _Str(GetPackage()->BasePath(), BaseHref());
+    SetXMLIdentifier(reader.Attribute("id"));
+    if ( XMLIdentifier().empty() )
+        return false;
+    
+    _href = reader.Attribute("href");
+    if ( _href.empty() )
+        return false;
+    
+    _mediaType = reader.Attribute("media-type");
+    if ( _mediaType.empty() )
+        return false;
+    
+    _mediaOverlayID = reader.Attribute("media-overlay");
+    _fallbackID = reader.Attribute("fallback");
+    _parsedProperties = ItemProperties(reader.Attribute("properties"));
+    return true;
+}
+#endif
+const ResourceDescriptor& ManifestItem::Descriptor() const
+{
+    const ResourceDescriptor* descriptor = _descriptor.load(std::memory_order_acquire);
+    if ( descriptor != nullptr )
+        return *descriptor;
+    
+    // threads racing to build it all produce the same thing; the first one stored wins
+    std::unique_ptr<ResourceDescriptor> built(new ResourceDescriptor(*this));
+    if ( _descriptor.compare_exchange_strong(descriptor, built.get(), std::memory_order_acq_rel) )
+        return *built.release();
+    return *descriptor;
 }
 shared_ptr<ManifestItem> ManifestItem::MediaOverlay() const
 {
@@ -208,7 +275,7 @@ string ManifestItem::BaseHref() const
     if ( s == string::npos )
         path = _href;
     else
-        path = path.substr(0, s);
+        path = _href.substr(0, s);
     return path;
 }
 bool ManifestItem::HasProperty(const std::vector<IRI>& properties) const
@@ -220,19 +287,12 @@ bool ManifestItem::HasProperty(const std::vector<IRI>& properties) const
     }
     return false;
 }
-EncryptionInfoPtr ManifestItem::GetEncryptionInfo() const
-{
-    ContainerPtr container = GetPackage()->GetContainer();
-    string abs = AbsolutePath();
-    if (abs.at(0) == '/')
-    {
-        abs = abs.substr(1, abs.length()-1);
-    }
-    return container->EncryptionInfoForPath(abs);
-}
 bool ManifestItem::CanLoadDocument() const
 {
-	return GetPackage()->GetContainer()->FileExistsAtPath(AbsolutePath());
+    const ResourceDescriptor& resource = Descriptor();
+    if ( resource.IsInArchive() )
+        return true;
+	return GetPackage()->GetContainer()->FileExistsAtPath(resource.Path());
 }
 shared_ptr<xml::Document> ManifestItem::ReferencedDocument() const
 {
@@ -243,6 +303,14 @@ shared_ptr<xml::Document> ManifestItem::ReferencedDocument() const
     if ( !package )
         return nullptr;
     
+    // parsed in the background while the package was being opened
+    if ( _mediaType != "text/html" )
+    {
+        shared_ptr<xml::Document> preloaded = package->PreloadedDocument(path);
+        if ( bool(preloaded) )
+            return preloaded;
+    }
+    
     unique_ptr<ArchiveXmlReader> reader = package->XmlReaderForRelativePath(path);
     if ( !reader )
         return nullptr;
@@ -276,7 +344,15 @@ unique_ptr<ByteStream> ManifestItem::Reader() const
     if ( !container )
         return nullptr;
     
-    return container->GetArchive()->ByteStreamAtPath(AbsolutePath());
+    const ResourceDescriptor& resource = Descriptor();
+    if ( resource.IsInArchive() )
+    {
+        unique_ptr<ByteStream> stream = container->GetArchive()->ByteStreamAtIndex(resource.ArchiveIndex());
+        if ( bool(stream) )
+            return stream;
+    }
+    
+    return container->GetArchive()->ByteStreamAtPath(resource.Path());
 }
 
 #ifdef SUPPORT_ASYNC
@@ -27,6 +27,7 @@
 #include <ePub3/property_holder.h>
 #include <ePub3/utilities/xml_identifiable.h>
 #include <map>
+#include <atomic>
 #include <ePub3/xml/node.h>
 
 EPUB3_BEGIN_NAMESPACE
@@ -35,6 +36,7 @@ class Package;
 class ManifestItem;
 class ArchiveReader;
 class ByteStream;
+class XMLStreamReader;
 
 #ifdef SUPPORT_ASYNC
 class AsyncByteStream;
@@ -228,6 +230,64 @@ private:
     
 };
 
+/**
+ Where a ManifestItem's data lives, resolved once.
+ 
+ Locating an item's data means building its absolute path, finding that path in
+ the container's archive, and finding its record in `META-INF/encryption.xml`.
+ A ManifestItem does this the first time it's asked, and keeps the result in one of
+ these for its lifetime; readers are then created directly from the archive entry.
+ 
+ Descriptors are immutable, so they can be shared freely between threads.
+ 
+ @ingroup epub-model
+ */
+class ResourceDescriptor
+{
+public:
+    ///
+    /// Resolves the location of an item within its package's container.
+    EPUB3_EXPORT                ResourceDescriptor(const ManifestItem& item);
+                                ~ResourceDescriptor()                               {}
+    
+    ///
+    /// The item's absolute path within the container, as returned by ManifestItem::AbsolutePath().
+    const string&               Path()                              const   { return _path; }
+    
+    ///
+    /// The item's index within the container's archive, or `-1` if it isn't known.
+    int                         ArchiveIndex()                      const   { return _archiveIndex; }
+    ///
+    /// Whether the item's archive entry has been located.
+    bool                        IsInArchive()                       const   { return _archiveIndex >= 0; }
+    ///
+    /// Whether the item's data is compressed within the archive.
+    bool                        IsCompressed()                      const   { return _compressed; }
+    ///
+    /// The number of bytes the item occupies within the archive.
+    size_t                      CompressedSize()                    const   { return _compressedSize; }
+    ///
+    /// The size of the item's data once extracted (but before any decryption).
+    size_t                      UncompressedSize()                  const   { return _uncompressedSize; }
+    
+    ///
+    /// The item's encryption details, or `nullptr` if it isn't encrypted.
+    EncryptionInfoPtr           Encryption()                        const   { return _encryption; }
+    
+private:
+                                ResourceDescriptor()                                _DELETED_;
+                                ResourceDescriptor(const ResourceDescriptor&)       _DELETED_;
+    ResourceDescriptor&         operator=(const ResourceDescriptor&)                _DELETED_;
+    
+    string                      _path;
+    int                         _archiveIndex;
+    bool                        _compressed;
+    size_t                      _compressedSize;
+    size_t                      _uncompressedSize;
+    EncryptionInfoPtr           _encryption;
+    
+};
+
 /**
  The ManifestItem class represents a single resource within a publication.
  
@@ -277,9 +337,24 @@ public:
     PackagePtr                  GetPackage()                        const   { return Owner(); }
     
 	virtual bool                ParseXML(shared_ptr<xml::Node> node);
+#if EPUB_USE(LIBXML2)
+    ///
+    /// Reads the item from the `<item>` start tag on which a stream reader is positioned.
+    EPUB3_EXPORT
+    bool                        ParseXML(const XMLStreamReader& reader);
+#endif
 
     EPUB3_EXPORT
-    string                      AbsolutePath()                      const;
+    const string&               AbsolutePath()                      const   { return Descriptor().Path(); }
+    
+    /**
+     Locates the item's data within the container.
+     
+     This is resolved the first time it's needed, once the package has been opened,
+     and shared by Reader(), CanLoadDocument() and GetEncryptionInfo() thereafter.
+     */
+    EPUB3_EXPORT
+    const ResourceDescriptor&   Descriptor()                        const;
     
     const string&               Identifier()                        const   { return XMLIdentifier(); }
     const string&               Href()                              const   { return _href; }
@@ -317,7 +392,7 @@ public:
     bool                        HasProperty(const std::vector<IRI>& properties)  const;
     
     // fetch any relevant encryption information
-    EncryptionInfoPtr           GetEncryptionInfo()                 const;
+    EncryptionInfoPtr           GetEncryptionInfo()                 const   { return Descriptor().Encryption(); }
 
 	bool						CanLoadDocument()					const;
     
@@ -340,6 +415,9 @@ protected:
     string                  _mediaOverlayID;
     string                  _fallbackID;
     ItemProperties          _parsedProperties;
+    
+private:
+    mutable std::atomic<const ResourceDescriptor*>  _descriptor;
 };
 
 EPUB3_END_NAMESPACE
@@ -19,6 +19,8 @@
 //  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "media-overlays_smil_data.h"
+#include "media-overlays_smil_model.h"
+#include <algorithm>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -29,6 +31,337 @@ SMILData::~SMILData()
     //
 }
 
+void SMILData::LoadFromModel() const
+{
+    std::shared_ptr<MediaOverlaysSmilModel> model = Owner(); // internally: std::weak_ptr<MediaOverlaysSmilModel>.lock()
+    if (model != nullptr)
+    {
+        model->loadSMIL(this);
+    }
+}
+
+void SMILData::ResetTree()
+{
+    _nodes.clear();
+    _children.clear();
+    _strings.assign(1, string::EmptyString);
+    _manifestItems.assign(1, nullptr);
+    _stringIndex.clear();
+
+    std::lock_guard<std::mutex> lock(_handleLock);
+    _handles.clear();
+}
+
+SMILData::NodeIndex SMILData::AddNode(NodeType nodeType, NodeIndex parent, const string & file, const string & fragmentID, const std::shared_ptr<ManifestItem> & manifestItem, const string & type, uint32_t clipBegin, uint32_t clipEnd)
+{
+    NodeIndex index = static_cast<NodeIndex>(_nodes.size());
+
+    Node node;
+    node.nodeType = nodeType;
+    node.flags = 0;
+    node.parent = parent;
+    node.firstChild = 0;
+    node.childCount = 0;
+    node.file = Intern(file);
+    node.fragmentID = Intern(fragmentID);
+    node.type = Intern(type);
+    node.clipBegin = clipBegin;
+    node.clipEnd = clipEnd;
+
+    // a SMIL file refers to very few distinct manifest items
+    node.manifestItem = 0;
+    if (manifestItem != nullptr)
+    {
+        auto found = std::find(_manifestItems.begin(), _manifestItems.end(), manifestItem);
+        node.manifestItem = static_cast<uint32_t>(found - _manifestItems.begin());
+        if (found == _manifestItems.end())
+        {
+            _manifestItems.push_back(manifestItem);
+        }
+    }
+
+    _nodes.push_back(node);
+
+    if (parent != NoNode)
+    {
+        Node & parentNode = _nodes[parent];
+        parentNode.childCount++;
+        if (nodeType == NodeType::Audio)
+        {
+            parentNode.flags |= HasAudio;
+        }
+        else if (nodeType == NodeType::Text)
+        {
+            parentNode.flags |= HasText;
+        }
+    }
+
+    return index;
+}
+
+void SMILData::FinishTree()
+{
+    // lay out each node's children contiguously; nodes were added in document order
+    uint32_t next = 0;
+    for (Node & node : _nodes)
+    {
+        node.firstChild = next;
+        next += node.childCount;
+        node.childCount = 0;
+    }
+
+    _children.resize(next);
+    for (NodeIndex i = 0; i < _nodes.size(); i++)
+    {
+        NodeIndex parent = _nodes[i].parent;
+        if (parent != NoNode)
+        {
+            Node & parentNode = _nodes[parent];
+            _children[parentNode.firstChild + parentNode.childCount++] = i;
+        }
+    }
+
+    _nodes.shrink_to_fit();
+    _strings.shrink_to_fit();
+    _manifestItems.shrink_to_fit();
+    std::unordered_map<std::string, uint32_t>().swap(_stringIndex);
+}
+
+uint32_t SMILData::Intern(const string & str)
+{
+    if (str.empty())
+    {
+        return 0;
+    }
+
+    auto inserted = _stringIndex.emplace(str.stl_str(), static_cast<uint32_t>(_strings.size()));
+    if (inserted.second)
+    {
+        _strings.push_back(str);
+    }
+
+    return inserted.first->second;
+}
+
+SMILData::NodeIndex SMILData::ChildOfType(NodeIndex container, NodeType nodeType) const
+{
+    const Node & node = _nodes[container];
+
+    // the last one wins, should there be more than one
+    for (uint32_t i = node.childCount; i > 0; i--)
+    {
+        NodeIndex child = _children[node.firstChild + i - 1];
+        if (_nodes[child].nodeType == nodeType)
+        {
+            return child;
+        }
+    }
+
+    return NoNode;
+}
+
+bool SMILData::IsTimedParallel(const Node & par, NodeIndex index, uint32_t & clipDuration) const
+{
+    if ((par.flags & HasAudio) == 0)
+    {
+        return false;
+    }
+
+    if ((par.flags & HasText) != 0)
+    {
+        // text from another document than this SMIL's XHTML spine item
+        const std::shared_ptr<ManifestItem> & textItem = _manifestItems[_nodes[ChildOfType(index, NodeType::Text)].manifestItem];
+        if (textItem != nullptr && textItem != _spineItem->ManifestItem())
+        {
+            return false;
+        }
+    }
+
+    clipDuration = ClipDuration(_nodes[ChildOfType(index, NodeType::Audio)]);
+    return true;
+}
+
+uint32_t SMILData::SequenceDuration(NodeIndex sequence) const
+{
+    uint32_t total = 0;
+
+    const Node & node = _nodes[sequence];
+    for (uint32_t i = 0; i < node.childCount; i++)
+    {
+        NodeIndex child = _children[node.firstChild + i];
+        const Node & childNode = _nodes[child];
+
+        if (childNode.nodeType == NodeType::Parallel)
+        {
+            uint32_t clipDur = 0;
+            if (IsTimedParallel(childNode, child, clipDur))
+            {
+                total += clipDur;
+            }
+        }
+        else if (childNode.nodeType == NodeType::Sequence)
+        {
+            total += SequenceDuration(child);
+        }
+    }
+
+    return total;
+}
+
+SMILData::NodeIndex SMILData::FindParallelAt(NodeIndex sequence, uint32_t timeMilliseconds) const
+{
+    uint32_t offset = 0;
+
+    const Node & node = _nodes[sequence];
+    for (uint32_t i = 0; i < node.childCount; i++)
+    {
+        uint32_t timeAdjusted = timeMilliseconds - offset;
+
+        NodeIndex child = _children[node.firstChild + i];
+        const Node & childNode = _nodes[child];
+
+        if (childNode.nodeType == NodeType::Parallel)
+        {
+            uint32_t clipDur = 0;
+            if (!IsTimedParallel(childNode, child, clipDur))
+            {
+                continue;
+            }
+
+            if (clipDur > 0 && timeAdjusted <= clipDur)
+            {
+                return child;
+            }
+
+            offset += clipDur;
+        }
+        else if (childNode.nodeType == NodeType::Sequence)
+        {
+            NodeIndex para = FindParallelAt(child, timeAdjusted);
+            if (para != NoNode)
+            {
+                return para;
+            }
+
+            offset += SequenceDuration(child);
+        }
+    }
+
+    return NoNode;
+}
+
+SMILData::NodeIndex SMILData::FindNthParallel(NodeIndex sequence, uint32_t index, uint32_t & count) const
+{
+    const Node & node = _nodes[sequence];
+    for (uint32_t i = 0; i < node.childCount; i++)
+    {
+        NodeIndex child = _children[node.firstChild + i];
+        const Node & childNode = _nodes[child];
+
+        if (childNode.nodeType == NodeType::Parallel)
+        {
+            count++;
+
+            if (count == index)
+            {
+                return child;
+            }
+        }
+        else if (childNode.nodeType == NodeType::Sequence)
+        {
+            NodeIndex para = FindNthParallel(child, index, count);
+            if (para != NoNode)
+            {
+                return para;
+            }
+        }
+    }
+
+    return NoNode;
+}
+
+bool SMILData::FindClipOffset(NodeIndex sequence, uint32_t & offset, NodeIndex par) const
+{
+    const Node & node = _nodes[sequence];
+    for (uint32_t i = 0; i < node.childCount; i++)
+    {
+        NodeIndex child = _children[node.firstChild + i];
+        const Node & childNode = _nodes[child];
+
+        if (childNode.nodeType == NodeType::Parallel)
+        {
+            if (child == par)
+            {
+                return true;
+            }
+
+            uint32_t clipDur = 0;
+            if (IsTimedParallel(childNode, child, clipDur))
+            {
+                offset += clipDur;
+            }
+        }
+        else if (childNode.nodeType == NodeType::Sequence)
+        {
+            if (FindClipOffset(child, offset, par))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+std::shared_ptr<SMILData::TimeNode> SMILData::HandleAt(NodeIndex index) const
+{
+    if (index == NoNode || index >= _nodes.size())
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_handleLock);
+
+    if (_handles.size() != _nodes.size())
+    {
+        _handles.resize(_nodes.size());
+    }
+
+    std::shared_ptr<TimeNode> & handle = _handles[index];
+    if (handle == nullptr)
+    {
+        SMILDataPtr self = std::const_pointer_cast<SMILData>(shared_from_this());
+        switch (_nodes[index].nodeType)
+        {
+            case NodeType::Sequence:
+                handle = std::make_shared<Sequence>(self, index);
+                break;
+            case NodeType::Parallel:
+                handle = std::make_shared<Parallel>(self, index);
+                break;
+            case NodeType::Audio:
+                handle = std::make_shared<Audio>(self, index);
+                break;
+            case NodeType::Text:
+                handle = std::make_shared<Text>(self, index);
+                break;
+        }
+    }
+
+    return handle;
+}
+
+size_t SMILData::ArenaSizeInBytes() const
+{
+    size_t result = _nodes.capacity() * sizeof(Node) + _children.capacity() * sizeof(NodeIndex)
+                  + _manifestItems.capacity() * sizeof(std::shared_ptr<ManifestItem>) + _strings.capacity() * sizeof(string);
+    for (const string & str : _strings)
+    {
+        result += str.stl_str().capacity();
+    }
+    return result;
+}
+
 const string & SMILData::TimeNode::Name() const
 {
     throw std::runtime_error("TimeNode Name()");
@@ -25,6 +25,11 @@
 #include <ePub3/utilities/owned_by.h>
 #include <ePub3/manifest.h>
 #include <ePub3/spine.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -33,12 +38,26 @@ EPUB3_BEGIN_NAMESPACE
         class SMILData;
         typedef std::shared_ptr<SMILData> SMILDataPtr;
 
-        class SMILData : public OwnedBy<MediaOverlaysSmilModel> //public std::enable_shared_from_this<SMILData>
+        /**
+The timing tree of a single SMIL file.
+
+The tree is stored in an arena: a vector of fixed-size nodes linked by index,
+whose strings are interned in a table shared by the whole tree, and whose type is
+given by a tag rather than by their C++ class. Durations and positions are
+computed by walking the arena directly.
+
+The Sequence, Parallel, Audio and Text objects returned by Body(), GetChild() and
+so on are handles onto the arena's nodes. Each is created the first time it is
+asked for, and the same object is returned from then on.
+
+@ingroup epub-model
+*/
+        class SMILData : public OwnedBy<MediaOverlaysSmilModel>, public std::enable_shared_from_this<SMILData>
 #if EPUB_PLATFORM(WINRT)
 			, public NativeBridge
 #endif
         {
-            friend class MediaOverlaysSmilModel; // _root
+            friend class MediaOverlaysSmilModel; // AddNode(), FinishTree()
 
         public:
 
@@ -52,7 +71,26 @@ EPUB3_BEGIN_NAMESPACE
 
             class Text;
 
-            class TimeNode : public OwnedBy<SMILData>, public std::enable_shared_from_this<TimeNode> 
+            ///
+            /// The index of a node in the arena.
+            typedef uint32_t NodeIndex;
+
+            enum : NodeIndex
+            {
+                NoNode = UINT32_MAX ///< No node; for example, the parent of the root.
+            };
+
+            ///
+            /// The kinds of node.
+            enum class NodeType : uint8_t
+            {
+                Sequence,
+                Parallel,
+                Audio,
+                Text
+            };
+
+            class TimeNode : public OwnedBy<SMILData>, public std::enable_shared_from_this<TimeNode>
 #if EPUB_PLATFORM(WINRT)
 				, public NativeBridge
 #endif
@@ -65,7 +103,7 @@ EPUB3_BEGIN_NAMESPACE
                 TimeNode(TimeNode &&) _DELETED_;
 
             protected:
-                shared_ptr<TimeContainer> _parent;
+                NodeIndex _node;
 
             public:
                 virtual const string & Name() const;
@@ -74,18 +112,32 @@ EPUB3_BEGIN_NAMESPACE
 
                 EPUB3_EXPORT
 
-                TimeNode(shared_ptr<TimeContainer> parent, const std::shared_ptr<SMILData> & smilData) : _parent(parent), OwnedBy(smilData)
+                TimeNode(const std::shared_ptr<SMILData> & smilData, NodeIndex node) : OwnedBy(smilData),
 #if EPUB_PLATFORM(WINRT)
-                    , NativeBridge()
+                    NativeBridge(),
 #endif
+                    _node(node)
+                {
+                }
+
+                EPUB3_EXPORT
+
+                NodeIndex Index() const
                 {
+                    return _node;
                 }
 
                 EPUB3_EXPORT
 
                 shared_ptr<const TimeContainer> Parent() const
                 {
-                    return _parent;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->Handle<TimeContainer>(smilData->_nodes[_node].parent);
                 }
             };
 
@@ -98,37 +150,39 @@ EPUB3_BEGIN_NAMESPACE
 
                 TimeContainer(TimeContainer &&) _DELETED_;
 
-            protected:
-                string _type; // space-separated
-
             public:
                 virtual ~TimeContainer();
 
                 EPUB3_EXPORT
 
-                TimeContainer(shared_ptr<Sequence> parent, string type, const SMILDataPtr smilData):TimeNode(parent, smilData), _type(type)
+                TimeContainer(const SMILDataPtr & smilData, NodeIndex node) : TimeNode(smilData, node)
                 {
-					// can't access shared_from_this() yet-- might work with MS' implementation, but not in libc++
-					/*
-                    if (parent != nullptr)
-                    {
-                        parent->_children.push_back(this);
-                    }
-					*/
                 }
 
                 EPUB3_EXPORT
 
                 shared_ptr<const Sequence> ParentSequence() const
                 {
-                    return std::dynamic_pointer_cast<const Sequence>(_parent);
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->HandleOfType<Sequence>(smilData->_nodes[_node].parent, NodeType::Sequence);
                 }
 
                 EPUB3_EXPORT
 
                 const string Type() const
                 {
-                    return _type;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return string::EmptyString;
+                    }
+
+                    return smilData->_strings[smilData->_nodes[_node].type]; // space-separated
                 }
 
                 EPUB3_EXPORT
@@ -142,10 +196,6 @@ EPUB3_BEGIN_NAMESPACE
 
             class Sequence : public TimeContainer
             {
-                friend class MediaOverlaysSmilModel; // _children
-
-                friend class SMILData; // ParallelAt, NthParallel, ClipOffset
-
             private:
                 Sequence() _DELETED_;
 
@@ -155,146 +205,6 @@ EPUB3_BEGIN_NAMESPACE
 
                 static const string _Name;
 
-            protected:
-                string _textref_file;
-                string _textref_fragmentID;
-
-                const std::shared_ptr<ManifestItem> _textrefManifestItem;
-
-                shared_vector<const TimeContainer> _children;
-
-                const bool ClipOffset(uint32_t & offset, shared_ptr<const Parallel> par) const
-                {
-                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
-                    if (smilData == nullptr)
-                    {
-                        return false;
-                    }
-                    
-                    for (shared_vector<const TimeContainer>::size_type i = 0; i < _children.size(); i++)
-                    {
-                        auto container = _children[i];
-                        if (container->IsParallel())
-                        {
-                            auto para = std::dynamic_pointer_cast<const Parallel>(container);
-                            if (para == par)
-                            {
-                                return true;
-                            }
-
-                            if (para->Audio() == nullptr)
-                            {
-                                continue;
-                            }
-
-                            if (para->Text() != nullptr && para->Text()->SrcManifestItem() != nullptr && para->Text()->SrcManifestItem() != smilData->XhtmlSpineItem()->ManifestItem())
-                            {
-                                continue;
-                            }
-
-                            uint32_t clipDur = para->Audio()->ClipDurationMilliseconds();
-                            offset += clipDur;
-                        }
-                        else if (container->IsSequence())
-                        {
-                            auto sequence = std::dynamic_pointer_cast<const Sequence>(container);
-
-                            bool found = sequence->ClipOffset(offset, par);
-                            if (found)
-                            {
-                                return true;
-                            }
-                        }
-                    }
-
-                    return false;
-                }
-
-                shared_ptr<const Parallel> ParallelAt(uint32_t timeMilliseconds) const
-                {
-                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
-                    if (smilData == nullptr)
-                    {
-                        return nullptr;
-                    }
-                    
-                    uint32_t offset = 0;
-
-                    for (shared_vector<const TimeContainer>::size_type i = 0; i < _children.size(); i++)
-                    {
-                        uint32_t timeAdjusted = timeMilliseconds - offset;
-
-                        auto container = _children[i];
-                        if (container->IsParallel())
-                        {
-                            auto para = std::dynamic_pointer_cast<const Parallel>(container);
-
-                            if (para->Audio() == nullptr)
-                            {
-                                continue;
-                            }
-
-                            if (para->Text() != nullptr && para->Text()->SrcManifestItem() != nullptr && para->Text()->SrcManifestItem() != smilData->XhtmlSpineItem()->ManifestItem())
-                            {
-                                continue;
-                            }
-
-                            uint32_t clipDur = para->Audio()->ClipDurationMilliseconds();
-
-                            if (clipDur > 0 && timeAdjusted <= clipDur)
-                            {
-                                return para;
-                            }
-
-                            offset += clipDur;
-                        }
-                        else if (container->IsSequence())
-                        {
-                            auto sequence = std::dynamic_pointer_cast<const Sequence>(container);
-
-                            auto para = sequence->ParallelAt(timeAdjusted);
-                            if (para != nullptr)
-                            {
-                                return para;
-                            }
-
-                            offset += sequence->DurationMilliseconds();
-                        }
-                    }
-
-                    return nullptr;
-                }
-
-                shared_ptr<const Parallel> NthParallel(uint32_t index, uint32_t & count) const
-                {
-                    for (shared_vector<const TimeContainer>::size_type i = 0; i < _children.size(); i++)
-                    {
-                        auto container = _children[i];
-                        if (container->IsParallel())
-                        {
-                            count++;
-
-                            if (count == index)
-                            {
-                                auto para = std::dynamic_pointer_cast<const Parallel>(container);
-                                return para;
-                            }
-                        }
-                        else if (container->IsSequence())
-                        {
-                            auto sequence = std::dynamic_pointer_cast<const Sequence>(container);
-
-                            auto para = sequence->NthParallel(index, count);
-                            if (para != nullptr)
-                            {
-                                return para;
-                            }
-                        }
-                    }
-
-                    return nullptr;
-                }
-
             public:
                 EPUB3_EXPORT
 
@@ -307,7 +217,7 @@ EPUB3_BEGIN_NAMESPACE
 
                 EPUB3_EXPORT
 
-					Sequence(shared_ptr<Sequence> parent, string textref_file, string textref_fragmentID, const ManifestItemPtr textrefManifestItem, string type, const SMILDataPtr smilData) :TimeContainer(parent, type, smilData), _textref_file(textref_file), _textref_fragmentID(textref_fragmentID), _textrefManifestItem(textrefManifestItem), _children()
+                Sequence(const SMILDataPtr & smilData, NodeIndex node) : TimeContainer(smilData, node)
                 {
                 }
 
@@ -315,40 +225,71 @@ EPUB3_BEGIN_NAMESPACE
 
                 const string TextRefFile() const
                 {
-                    return _textref_file;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return string::EmptyString;
+                    }
+
+                    return smilData->_strings[smilData->_nodes[_node].file];
                 }
 
                 EPUB3_EXPORT
 
                 const string TextRefFragmentId() const
                 {
-                    return _textref_fragmentID;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return string::EmptyString;
+                    }
+
+                    return smilData->_strings[smilData->_nodes[_node].fragmentID];
                 }
 
                 EPUB3_EXPORT
 
                 const std::shared_ptr<ManifestItem> TextRefManifestItem() const
                 {
-                    return _textrefManifestItem;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->_manifestItems[smilData->_nodes[_node].manifestItem];
                 }
 
                 EPUB3_EXPORT
 
                 const shared_vector<const TimeContainer>::size_type GetChildrenCount() const
                 {
-                    return _children.size();
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return 0;
+                    }
+
+                    return smilData->_nodes[_node].childCount;
                 }
 
                 EPUB3_EXPORT
 
 				shared_ptr<const TimeContainer> GetChild(shared_vector<const TimeContainer>::size_type i) const
                 {
-                    if (i >= _children.size())
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
                     {
                         return nullptr;
                     }
 
-                    return _children[i];
+                    const Node & node = smilData->_nodes[_node];
+                    if (i >= node.childCount)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->Handle<TimeContainer>(smilData->_children[node.firstChild + i]);
                 }
 
                 EPUB3_EXPORT
@@ -374,38 +315,8 @@ EPUB3_BEGIN_NAMESPACE
                     {
                         return 0;
                     }
-                    
-                    uint32_t total = 0;
-
-                    for (shared_vector<const TimeContainer>::size_type i = 0; i < _children.size(); i++)
-                    {
-                        auto container = _children[i];
-                        if (container->IsParallel())
-                        {
-                            auto para = std::dynamic_pointer_cast<const Parallel>(container);
-
-                            if (para->Audio() == nullptr)
-                            {
-                                continue;
-                            }
-
-                            if (para->Text() != nullptr && para->Text()->SrcManifestItem() != nullptr && para->Text()->SrcManifestItem() != smilData->XhtmlSpineItem()->ManifestItem())
-                            {
-                                continue;
-                            }
-
-                            uint32_t clipDur = para->Audio()->ClipDurationMilliseconds();
-                            total += clipDur;
-                        }
-                        else if (container->IsSequence())
-                        {
-                            auto sequence = std::dynamic_pointer_cast<const Sequence>(container);
-
-                            total += sequence->DurationMilliseconds();
-                        }
-                    }
 
-                    return total;
+                    return smilData->SequenceDuration(_node);
                 }
             };
 
@@ -418,17 +329,12 @@ EPUB3_BEGIN_NAMESPACE
 
                 Media(Media &&) _DELETED_;
 
-            protected:
-                string _src_file;
-                string _src_fragmentID;
-                const std::shared_ptr<ManifestItem> _srcManifestItem;
-
             public:
                 virtual ~Media();
 
                 EPUB3_EXPORT
 
-                Media(shared_ptr<Parallel> parent, string src_file, string src_fragmentID, const ManifestItemPtr srcManifestItem, const SMILDataPtr smilData):TimeNode(parent, smilData), _src_file(src_file), _src_fragmentID(src_fragmentID), _srcManifestItem(srcManifestItem)
+                Media(const SMILDataPtr & smilData, NodeIndex node) : TimeNode(smilData, node)
                 {
                 }
 
@@ -436,28 +342,52 @@ EPUB3_BEGIN_NAMESPACE
 
                 shared_ptr<const Parallel> ParentParallel() const
                 {
-                    return std::dynamic_pointer_cast<const Parallel>(_parent);
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->HandleOfType<Parallel>(smilData->_nodes[_node].parent, NodeType::Parallel);
                 }
 
                 EPUB3_EXPORT
 
                 const string SrcFile() const
                 {
-                    return _src_file;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return string::EmptyString;
+                    }
+
+                    return smilData->_strings[smilData->_nodes[_node].file];
                 }
 
                 EPUB3_EXPORT
 
                 const string SrcFragmentId() const
                 {
-                    return _src_fragmentID;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return string::EmptyString;
+                    }
+
+                    return smilData->_strings[smilData->_nodes[_node].fragmentID];
                 }
 
                 EPUB3_EXPORT
 
                 const std::shared_ptr<ManifestItem> SrcManifestItem() const
                 {
-                    return _srcManifestItem;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->_manifestItems[smilData->_nodes[_node].manifestItem];
                 }
 
                 EPUB3_EXPORT
@@ -480,10 +410,6 @@ EPUB3_BEGIN_NAMESPACE
 
                 static const string _Name;
 
-            protected:
-                uint32_t _clipBeginMilliseconds;
-                uint32_t _clipEndMilliseconds;
-
             public:
                 EPUB3_EXPORT
 
@@ -496,36 +422,32 @@ EPUB3_BEGIN_NAMESPACE
 
                 EPUB3_EXPORT
 
-                Audio(shared_ptr<Parallel> parent, string src, const ManifestItemPtr srcManifestItem, uint32_t clipBeginMilliseconds, uint32_t clipEndMilliseconds, const SMILDataPtr smilData):Media(parent, src, "", srcManifestItem, smilData), _clipBeginMilliseconds(clipBeginMilliseconds), _clipEndMilliseconds(clipEndMilliseconds)
+                Audio(const SMILDataPtr & smilData, NodeIndex node) : Media(smilData, node)
                 {
-					// can't use shared_from_this() yet, is hasn't been set up
-                    //parent->_audio = this;
                 }
 
                 EPUB3_EXPORT
 
                 const uint32_t ClipBeginMilliseconds() const
                 {
-                    return _clipBeginMilliseconds;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    return (smilData == nullptr ? 0 : smilData->_nodes[_node].clipBegin);
                 }
 
                 EPUB3_EXPORT
 
                 const uint32_t ClipEndMilliseconds() const
                 {
-                    return _clipEndMilliseconds;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    return (smilData == nullptr ? 0 : smilData->_nodes[_node].clipEnd);
                 }
 
                 EPUB3_EXPORT
 
                 const uint32_t ClipDurationMilliseconds() const
                 {
-                    if (_clipEndMilliseconds <= 0 || _clipEndMilliseconds <= _clipBeginMilliseconds)
-                    {
-                        return 0;
-                    }
-
-                    return _clipEndMilliseconds - _clipBeginMilliseconds;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    return (smilData == nullptr ? 0 : ClipDuration(smilData->_nodes[_node]));
                 }
 
                 EPUB3_EXPORT
@@ -566,10 +488,8 @@ EPUB3_BEGIN_NAMESPACE
 
                 EPUB3_EXPORT
 
-                Text(shared_ptr<Parallel> parent, string src_file, string src_fragmentID, const ManifestItemPtr srcManifestItem, const SMILDataPtr smilData):Media(parent, src_file, src_fragmentID, srcManifestItem, smilData)
+                Text(const SMILDataPtr & smilData, NodeIndex node) : Media(smilData, node)
                 {
-					// can't use shared_from_this() yet, it hasn't been assigned
-                    //parent->_text = this;
                 }
 
                 EPUB3_EXPORT
@@ -589,8 +509,6 @@ EPUB3_BEGIN_NAMESPACE
 
             class Parallel : public TimeContainer
             {
-				friend class MediaOverlaysSmilModel;	// _audio, _text
-
             private:
                 Parallel() _DELETED_;
 
@@ -600,10 +518,6 @@ EPUB3_BEGIN_NAMESPACE
 
                 static const string _Name;
 
-            protected:
-                shared_ptr<Audio> _audio;
-                shared_ptr<Text> _text;
-
             public:
 
                 EPUB3_EXPORT
@@ -617,7 +531,7 @@ EPUB3_BEGIN_NAMESPACE
 
                 EPUB3_EXPORT
 
-                Parallel(shared_ptr<Sequence> parent, string type, const SMILDataPtr smilData):TimeContainer(parent, type, smilData), _audio(nullptr), _text(nullptr)
+                Parallel(const SMILDataPtr & smilData, NodeIndex node) : TimeContainer(smilData, node)
                 {
                 }
 
@@ -625,14 +539,26 @@ EPUB3_BEGIN_NAMESPACE
 
                 shared_ptr<const Audio> Audio() const
                 {
-                    return _audio;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->Handle<SMILData::Audio>(smilData->ChildOfType(_node, NodeType::Audio));
                 }
 
                 EPUB3_EXPORT
 
                 shared_ptr<const Text> Text() const
                 {
-                    return _text;
+                    std::shared_ptr<SMILData> smilData = Owner(); // internally: std::weak_ptr<SMILData>.lock()
+                    if (smilData == nullptr)
+                    {
+                        return nullptr;
+                    }
+
+                    return smilData->Handle<SMILData::Text>(smilData->ChildOfType(_node, NodeType::Text));
                 }
 
                 EPUB3_EXPORT
@@ -658,44 +584,148 @@ EPUB3_BEGIN_NAMESPACE
             SMILData(SMILData &&) _DELETED_;
 
         protected:
+            ///
+            /// A node of the timing tree, as stored in the arena.
+            struct Node
+            {
+                NodeType    nodeType;
+                uint8_t     flags;          ///< For Parallel nodes: HasAudio, HasText.
+                NodeIndex   parent;
+                NodeIndex   firstChild;     ///< The node's first entry in _children.
+                uint32_t    childCount;
+                uint32_t    file;           ///< Interned: the textref file of a Sequence, or the src file of an Audio or Text.
+                uint32_t    fragmentID;     ///< Interned.
+                uint32_t    type;           ///< Interned: the epub:type of a Sequence or Parallel.
+                uint32_t    manifestItem;   ///< An index into _manifestItems.
+                uint32_t    clipBegin;      ///< Audio only, in milliseconds.
+                uint32_t    clipEnd;
+            };
+
+            enum : uint8_t
+            {
+                HasAudio = 1 << 0,
+                HasText  = 1 << 1
+            };
+
             uint32_t _duration; //whole milliseconds (resolution = 1ms)
 
             const std::shared_ptr<ManifestItem> _manifestItem;
 
             const std::shared_ptr<SpineItem> _spineItem;
 
-            shared_ptr<Sequence> _root;
+            std::vector<Node> _nodes; // the root Sequence (the SMIL body), if any, is the first node
+
+            std::vector<NodeIndex> _children; // each container's children, contiguous and in document order
+
+            std::vector<string> _strings; // interned; the first is always empty
+
+            std::vector<std::shared_ptr<ManifestItem>> _manifestItems; // the first is always nullptr
+
+            std::unordered_map<std::string, uint32_t> _stringIndex; // only while the tree is being built
+
+            mutable std::mutex _handleLock;
+
+            mutable std::vector<std::shared_ptr<TimeNode>> _handles; // created on demand, one per node
+
+            std::atomic<bool> _loaded; // whether the SMIL file has been parsed into the arena
+
+            // parses the SMIL file on first use
+            void Load() const
+            {
+                if (!_loaded)
+                {
+                    LoadFromModel();
+                }
+            }
+
+            void LoadFromModel() const;
+
+            void ResetTree();
+
+            NodeIndex AddNode(NodeType nodeType, NodeIndex parent, const string & file, const string & fragmentID, const std::shared_ptr<ManifestItem> & manifestItem, const string & type, uint32_t clipBegin = 0, uint32_t clipEnd = 0);
+
+            void FinishTree();
+
+            uint32_t Intern(const string & str);
+
+            NodeIndex ChildOfType(NodeIndex container, NodeType nodeType) const;
+
+            static uint32_t ClipDuration(const Node & audio)
+            {
+                if (audio.clipEnd <= 0 || audio.clipEnd <= audio.clipBegin)
+                {
+                    return 0;
+                }
+
+                return audio.clipEnd - audio.clipBegin;
+            }
+
+            // whether a Parallel contributes its audio clip to the timeline
+            bool IsTimedParallel(const Node & par, NodeIndex index, uint32_t & clipDuration) const;
+
+            uint32_t SequenceDuration(NodeIndex sequence) const;
+
+            NodeIndex FindParallelAt(NodeIndex sequence, uint32_t timeMilliseconds) const;
+
+            NodeIndex FindNthParallel(NodeIndex sequence, uint32_t index, uint32_t & count) const;
+
+            bool FindClipOffset(NodeIndex sequence, uint32_t & offset, NodeIndex par) const;
+
+            std::shared_ptr<TimeNode> HandleAt(NodeIndex index) const;
+
+            template <class _Tp>
+            shared_ptr<const _Tp> Handle(NodeIndex index) const
+            {
+                return std::static_pointer_cast<const _Tp>(HandleAt(index));
+            }
+
+            ///
+            /// The handle of a node, or nullptr if it isn't of the given type; the arena's
+            /// type tag is checked, so no dynamic cast is needed.
+            template <class _Tp>
+            shared_ptr<const _Tp> HandleOfType(NodeIndex index, NodeType nodeType) const
+            {
+                if (index == NoNode || index >= _nodes.size() || _nodes[index].nodeType != nodeType)
+                {
+                    return nullptr;
+                }
+
+                return Handle<_Tp>(index);
+            }
 
             shared_ptr<const Parallel> ParallelAt(uint32_t timeMilliseconds) const
             {
-                if (_root == nullptr)
+                Load();
+                if (_nodes.empty())
                 {
                     return nullptr;
                 }
 
-                return _root->ParallelAt(timeMilliseconds);
+                return Handle<Parallel>(FindParallelAt(0, timeMilliseconds));
             }
 
             shared_ptr<const Parallel> NthParallel(uint32_t index) const
             {
-                if (_root == nullptr)
+                Load();
+                if (_nodes.empty())
                 {
                     return nullptr;
                 }
 
                 uint32_t count = -1;
-                return _root->NthParallel(index, count);
+                return Handle<Parallel>(FindNthParallel(0, index, count));
             }
 
             const uint32_t ClipOffset(shared_ptr<const Parallel> par) const
             {
-                if (_root == nullptr)
+                Load();
+                if (_nodes.empty() || par == nullptr || par->Owner().get() != this)
                 {
                     return 0;
                 }
 
                 uint32_t offset = 0;
-                if (_root->ClipOffset(offset, par))
+                if (FindClipOffset(0, offset, par->Index()))
                 {
                     return offset;
                 }
@@ -710,7 +740,7 @@ EPUB3_BEGIN_NAMESPACE
 #if EPUB_PLATFORM(WINRT)
                 NativeBridge(),
 #endif
-                _manifestItem(manifestItem), _spineItem(spineItem), _duration(duration), _root(nullptr)
+                _duration(duration), _manifestItem(manifestItem), _spineItem(spineItem), _nodes(), _children(), _strings(1), _manifestItems(1), _stringIndex(), _handleLock(), _handles(), _loaded(false)
             {
                 //printf("SMILData(%s)\n", manifestItem->Href().c_str());
             }
@@ -735,13 +765,13 @@ EPUB3_BEGIN_NAMESPACE
 
             shared_ptr<const Sequence> Body() const
             {
-                if (_root == nullptr)
+                Load();
+                if (_nodes.empty())
                 {
                     return nullptr;
                 }
-                
-                //return _root.get();
-                return _root;
+
+                return Handle<Sequence>(0);
             }
 
             EPUB3_EXPORT
@@ -755,13 +785,30 @@ EPUB3_BEGIN_NAMESPACE
 
             const uint32_t DurationMilliseconds_Calculated() const
             {
-                if (_root == nullptr)
+                Load();
+                if (_nodes.empty())
                 {
                     return 0;
                 }
 
-                return _root->DurationMilliseconds();
+                return SequenceDuration(0);
             }
+
+            ///
+            /// The number of nodes in the timing tree, parsing the SMIL file if necessary.
+            EPUB3_EXPORT
+
+            size_t NodeCount() const
+            {
+                Load();
+                return _nodes.size();
+            }
+
+            ///
+            /// The memory used by the timing tree's arena, not counting any handles.
+            EPUB3_EXPORT
+
+            size_t ArenaSizeInBytes() const;
         };
 
         EPUB3_END_NAMESPACE
@@ -24,6 +24,8 @@
 #include <ePub3/media-overlays_smil_data.h>
 #include "error_handler.h"
 #include "xpath_wrangler.h"
+#include "container.h"
+#include "document_preloader.h"
 
 
 //#include <iostream>
@@ -156,7 +158,7 @@ public:
             //printf("~MediaOverlaysSmilModel()\n");
         }
 
-        MediaOverlaysSmilModel::MediaOverlaysSmilModel(const std::shared_ptr<Package> & package) : OwnedBy(package), _totalDuration(0), _smilDatas(std::vector<std::shared_ptr<SMILData>>())
+        MediaOverlaysSmilModel::MediaOverlaysSmilModel(const std::shared_ptr<Package> & package) : OwnedBy(package), _totalDuration(0), _smilDatas(std::vector<std::shared_ptr<SMILData>>()), _excludeAudioDuration(false), _loadLock(), _unloadedCount(0), _loadedDuration(0), _manifestItemsByPath(), _preloader(nullptr)
         {
         }
 
@@ -168,19 +170,47 @@ public:
 
         void MediaOverlaysSmilModel::resetData()
         {
+            std::lock_guard<std::mutex> lock(_loadLock);
+
             _totalDuration = 0;
 
             // std::vector automatically releases the contained smart shared pointers (reference count--)
 
             //_smilDatas.erase(_smilDatas.begin(), _smilDatas.end());
             _smilDatas.clear();
+
+            _unloadedCount = 0;
+            _loadedDuration = 0;
+            _manifestItemsByPath.clear();
+            _preloader.reset();
         }
 
         void MediaOverlaysSmilModel::populateData()
         {
             parseMetadata();
 
-            uint32_t totalDurationFromSMILs = parseSMILs();
+            // the SMIL files themselves are parsed on first use, see loadSMIL()
+            ForEachSmilData([this](const std::shared_ptr<SMILData> & data)
+            {
+                if (data->SmilManifestItem() == nullptr)
+                {
+                    data->_loaded = true;
+                }
+                else
+                {
+                    _unloadedCount++;
+                }
+            });
+
+            if (_unloadedCount == 0)
+            {
+                checkTotalDuration();
+            }
+        }
+
+        void MediaOverlaysSmilModel::checkTotalDuration()
+        {
+            uint32_t totalDurationFromSMILs = _loadedDuration;
 
             if (_totalDuration != totalDurationFromSMILs)
             {
@@ -354,173 +384,201 @@ public:
                     
                     printf("SMIL placeholder for 'blank' MO page: %s\n", data->XhtmlSpineItem()->ManifestItem()->Href().c_str());
 
-                    data->_root = std::make_shared<SMILData::Sequence>(nullptr, "", "", nullptr, "", data);
+                    data->ResetTree();
+
+                    SMILData::NodeIndex sequence = data->AddNode(SMILData::NodeType::Sequence, SMILData::NoNode, "", "", nullptr, "");
 
-                    shared_ptr<SMILData::Sequence> sequence = std::const_pointer_cast<SMILData::Sequence>(data->Body());
+                    SMILData::NodeIndex par = data->AddNode(SMILData::NodeType::Parallel, sequence, "", "", nullptr, "");
 
-                    shared_ptr<SMILData::Parallel> par = std::make_shared<SMILData::Parallel>(sequence, "", data);
-					sequence->_children.push_back(par);
+                    data->AddNode(SMILData::NodeType::Text, par, data->XhtmlSpineItem()->ManifestItem()->Href(), "", nullptr, "");
 
-                    par->_text = std::make_shared<SMILData::Text>(par, data->XhtmlSpineItem()->ManifestItem()->Href(), "", nullptr, data);
+                    data->FinishTree();
                 });
             }
         }
 
-        uint32_t MediaOverlaysSmilModel::parseSMILs()
-        {       
+        void MediaOverlaysSmilModel::loadSMIL(const SMILData * target)
+        {
+            std::lock_guard<std::mutex> lock(_loadLock);
+
+            if (target->_loaded)
+            {
+                return;
+            }
+
+            SMILDataPtr smilData = nullptr;
+            for (shared_vector<SMILData>::size_type i = 0; i < _smilDatas.size(); i++)
+            {
+                if (_smilDatas.at(i).get() == target)
+                {
+                    smilData = _smilDatas.at(i);
+                    break;
+                }
+            }
+
             std::shared_ptr<Package> package = Owner(); // internally: std::weak_ptr<Package>.lock()
-            if (package == nullptr)
+            if (smilData == nullptr || package == nullptr)
             {
-                return 0;
+                return;
+            }
+
+            // playback has begun: read the other SMIL files ahead of time
+            if (_preloader == nullptr && _unloadedCount > 1 && DocumentPreloader::Enabled())
+            {
+                startBackgroundLoading(target);
             }
 
-//Timer timer;
-            //uint counter = 0;
+            ManifestItemPtr item = smilData->SmilManifestItem();
 
-            std::map<std::shared_ptr<ManifestItem>, string> cache_manifestItemToAbsolutePath;
+            //printf("Media Overlays SMIL PARSING: %s\n", item->Href().c_str());
 
-            uint32_t accumulatedDurationMilliseconds = 0;
+            shared_ptr<xml::Document> doc = nullptr;
+            if (_preloader != nullptr)
+            {
+                doc = _preloader->TakeDocument(_Str(package->BasePath(), item->BaseHref()));
+            }
+            if (!bool(doc))
+            {
+                doc = item->ReferencedDocument();
+            }
 
+            uint32_t smilDur = parseSMILDocument(smilData, doc);
 
-            shared_ptr<SpineItem> spineItem = package->FirstSpineItem();
-            while (spineItem != nullptr)
+            smilData->_loaded = true;
+            _loadedDuration += smilDur;
+
+            if (--_unloadedCount == 0)
             {
-                ManifestItemPtr item = spineItem->ManifestItem();
+                _preloader.reset();
+                checkTotalDuration();
+            }
+        }
 
-                //string
-                //const ManifestItem::MimeType & mediaType = item->MediaType();
-                //if (mediaType != "application/smil+xml")
+        void MediaOverlaysSmilModel::startBackgroundLoading(const SMILData * first)
+        {
+            std::shared_ptr<Package> package = Owner(); // internally: std::weak_ptr<Package>.lock()
+            if (package == nullptr || package->GetContainer() == nullptr)
+            {
+                return;
+            }
 
-                //const string & mediaOverlayID = item->MediaOverlayID();
-                //printf("--- Media Overlays ID: %s\n", mediaOverlayID.c_str());
-                item = item->MediaOverlay();
-                if (item == nullptr)
+            DocumentPreloader::Options options;
+            options.threadCount = 1;
+            _preloader = std::make_shared<DocumentPreloader>(package->GetContainer()->Path(), options);
+
+            shared_vector<SMILData>::size_type firstIndex = 0;
+            while (firstIndex < _smilDatas.size() && _smilDatas.at(firstIndex).get() != first)
+            {
+                firstIndex++;
+            }
+
+            // in playback order, starting with the SMIL following the one being played
+            for (shared_vector<SMILData>::size_type n = 1; n < _smilDatas.size(); n++)
+            {
+                const std::shared_ptr<SMILData> data = _smilDatas.at((firstIndex + n) % _smilDatas.size()); // does not make a copy of the smart pointer (NO reference count++)
+                if (data->_loaded || data->SmilManifestItem() == nullptr)
                 {
-                    spineItem = spineItem->Next();
                     continue;
                 }
 
-//                counter++;
-//                if (counter > 10)
-//                {
-//                    break;
-//                }
+                // keyed the same way as Package::PreloadedDocument()
+                _preloader->PreloadDocument(_Str(package->BasePath(), data->SmilManifestItem()->BaseHref()));
+            }
+        }
 
-                //printf("Media Overlays SMIL PARSING: %s\n", item->Href().c_str());
+        uint32_t MediaOverlaysSmilModel::parseSMILDocument(SMILDataPtr smilData, shared_ptr<xml::Document> doc)
+        {
+            ManifestItemPtr item = smilData->SmilManifestItem();
 
-                //unique_ptr<ArchiveXmlReader> xmlReader = package->XmlReaderForRelativePath(item->Href());
-                shared_ptr<xml::Document> doc = item->ReferencedDocument();
-                if (!bool(doc))
-                {
-                    HandleError(EPUBError::MediaOverlayCannotParseSMILXML, _Str("Cannot parse XML: ", item->Href().c_str()));
-                }
+            smilData->ResetTree();
+
+            if (!bool(doc))
+            {
+                HandleError(EPUBError::MediaOverlayCannotParseSMILXML, _Str("Cannot parse XML: ", item->Href().c_str()));
+                return 0;
+            }
 
 #if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
-                XPathWrangler xpath(doc, {{"epub", ePub3NamespaceURI}, {"smil", SMILNamespaceURI}});
+            XPathWrangler xpath(doc, {{"epub", ePub3NamespaceURI}, {"smil", SMILNamespaceURI}});
 #else
-                XPathWrangler::NamespaceList __ns;
-                __ns["epub"] = ePub3NamespaceURI;
-                __ns["smil"] = SMILNamespaceURI;
-                XPathWrangler xpath(doc, __ns);
+            XPathWrangler::NamespaceList __ns;
+            __ns["epub"] = ePub3NamespaceURI;
+            __ns["smil"] = SMILNamespaceURI;
+            XPathWrangler xpath(doc, __ns);
 #endif
-                xpath.NameDefaultNamespace("smil");
+            xpath.NameDefaultNamespace("smil");
 
-                xml::NodeSet nodes = xpath.Nodes("/smil:smil");
-
-                if (nodes.empty())
-                {
-                    HandleError(EPUBError::MediaOverlayInvalidRootElement, _Str("'smil' root element not found: ", item->Href().c_str()));
-                }
-                else if (nodes.size() > 1)
-                {
-                    HandleError(EPUBError::MediaOverlayInvalidRootElement, _Str("Multiple 'smil' root elements found: ", item->Href().c_str()));
-                }
+            xml::NodeSet nodes = xpath.Nodes("/smil:smil");
 
-                if (nodes.size() != 1)
-                    return 0;
-
-                shared_ptr<xml::Node> smil = nodes[0];
+            if (nodes.empty())
+            {
+                HandleError(EPUBError::MediaOverlayInvalidRootElement, _Str("'smil' root element not found: ", item->Href().c_str()));
+            }
+            else if (nodes.size() > 1)
+            {
+                HandleError(EPUBError::MediaOverlayInvalidRootElement, _Str("Multiple 'smil' root elements found: ", item->Href().c_str()));
+            }
 
-                string version = _getProp(smil, "version", SMILNamespaceURI);
-                if (version.empty())
-                {
-                    HandleError(EPUBError::MediaOverlayVersionMissing, _Str("SMIL version not found: ", item->Href().c_str()));
-                }
-                else if (version != "3.0")
-                {
-                    HandleError(EPUBError::MediaOverlayInvalidVersion, _Str("Invalid SMIL version (", version, "): ", item->Href().c_str()));
-                }
+            if (nodes.size() != 1)
+                return 0;
 
-                nodes = xpath.Nodes("./smil:head", smil);
+            shared_ptr<xml::Node> smil = nodes[0];
 
-                if (nodes.empty())
-                {
-                    // OKAY
-                }
-                else if (nodes.size() == 1)
-                {
-                    //TODO: check head placement
-                    //HandleError(EPUBError::MediaOverlayHeadIncorrectlyPlaced, _Str("'head' element incorrectly placed: ", item->Href().c_str()));
-                }
-                else if (nodes.size() > 1)
-                {
-                    HandleError(EPUBError::MediaOverlayHeadIncorrectlyPlaced, _Str("multiple 'head' elements found: ", item->Href().c_str()));
-                    return 0;
-                }
+            string version = _getProp(smil, "version", SMILNamespaceURI);
+            if (version.empty())
+            {
+                HandleError(EPUBError::MediaOverlayVersionMissing, _Str("SMIL version not found: ", item->Href().c_str()));
+            }
+            else if (version != "3.0")
+            {
+                HandleError(EPUBError::MediaOverlayInvalidVersion, _Str("Invalid SMIL version (", version, "): ", item->Href().c_str()));
+            }
 
-                nodes = xpath.Nodes("./smil:body", smil);
+            nodes = xpath.Nodes("./smil:head", smil);
 
-                if (nodes.empty())
-                {
-                    HandleError(EPUBError::MediaOverlayNoBody, _Str("'body' element not found: ", item->Href().c_str()));
-                }
-                else if (nodes.size() > 1)
-                {
-                    HandleError(EPUBError::MediaOverlayMultipleBodies, _Str("multiple 'body' elements found: ", item->Href().c_str()));
-                }
+            if (nodes.empty())
+            {
+                // OKAY
+            }
+            else if (nodes.size() == 1)
+            {
+                //TODO: check head placement
+                //HandleError(EPUBError::MediaOverlayHeadIncorrectlyPlaced, _Str("'head' element incorrectly placed: ", item->Href().c_str()));
+            }
+            else if (nodes.size() > 1)
+            {
+                HandleError(EPUBError::MediaOverlayHeadIncorrectlyPlaced, _Str("multiple 'head' elements found: ", item->Href().c_str()));
+                return 0;
+            }
 
-                if (nodes.size() != 1)
-                {
-                    return 0;
-                }
+            nodes = xpath.Nodes("./smil:body", smil);
 
-                shared_ptr<SMILData> smilData = nullptr;
-                string id = item->Identifier();
-                for (shared_vector<SMILData>::size_type i = 0; i < _smilDatas.size(); i++)
-                {
-                    const std::shared_ptr<SMILData> data = _smilDatas.at(i); // does not make a copy of the smart pointer (NO reference count++)
+            if (nodes.empty())
+            {
+                HandleError(EPUBError::MediaOverlayNoBody, _Str("'body' element not found: ", item->Href().c_str()));
+            }
+            else if (nodes.size() > 1)
+            {
+                HandleError(EPUBError::MediaOverlayMultipleBodies, _Str("multiple 'body' elements found: ", item->Href().c_str()));
+            }
 
-                    if (data->SmilManifestItem() == nullptr)
-                    {
-                        continue;
-                    }
+            if (nodes.size() != 1)
+            {
+                return 0;
+            }
 
-                    if (data->SmilManifestItem()->Identifier() == id)
-                    {
-                        auto seq = data->Body();
-                        if (seq != nullptr)
-                        {
-                            continue;
-                        }
-
-                        if (data->XhtmlSpineItem()->ManifestItem()->Identifier() != spineItem->ManifestItem()->Identifier())
-                        {
-                            printf("XHTML spine item's manifest item ID mismatch?!\n");
-                        }
-                        smilData = data;
-                        break;
-                    }
-                }
+            shared_ptr<xml::Node> body = nodes[0];
 
-                shared_ptr<xml::Node> body = nodes[0];
+            std::map<string, std::shared_ptr<ManifestItem>> cache_smilRelativePathToManifestItem;
 
-                std::map<string, std::shared_ptr<ManifestItem>> cache_smilRelativePathToManifestItem;
+            string smilOPFPath = item->AbsolutePath();
 
 //// TIMER START
 //timer.reset();
 
-                uint32_t smilDur = parseSMIL(smilData, nullptr, nullptr, item, body, cache_manifestItemToAbsolutePath, cache_smilRelativePathToManifestItem);
-                //printf("Media Overlays SMIL DURATION (milliseconds): %ld\n", (long) smilDur);
+            uint32_t smilDur = parseSMIL(smilData, SMILData::NoNode, SMILData::NoNode, item, body, smilOPFPath, cache_smilRelativePathToManifestItem);
+            smilData->FinishTree();
+            //printf("Media Overlays SMIL DURATION (milliseconds): %ld\n", (long) smilDur);
 
 //// TIMER END
 //double seconds = timer.elapsed();
@@ -530,29 +588,22 @@ public:
 //printf("%s\n", str.c_str());
 ////std::cout << t << std::endl;
 
-                uint32_t metaDur = smilData->DurationMilliseconds_Metadata();
-                if (metaDur != smilDur)
-                {
-                    std::stringstream s;
-                    s << "Media Overlays SMIL duration mismatch (milliseconds): METADATA " << (long) metaDur << " != SMIL " << (long) smilDur << " (" << item->Href().c_str() << ")";
-                    const std::string & str = _Str(s.str());
-                    //printf("%s\n", str.c_str());
-
-                    //smilData->_duration = smilDur;
-
-                    HandleError(EPUBError::MediaOverlayMismatchDurationMetadata, str);
-                }
+            uint32_t metaDur = smilData->DurationMilliseconds_Metadata();
+            if (metaDur != smilDur)
+            {
+                std::stringstream s;
+                s << "Media Overlays SMIL duration mismatch (milliseconds): METADATA " << (long) metaDur << " != SMIL " << (long) smilDur << " (" << item->Href().c_str() << ")";
+                const std::string & str = _Str(s.str());
+                //printf("%s\n", str.c_str());
 
-                accumulatedDurationMilliseconds += smilDur;
+                //smilData->_duration = smilDur;
 
-                spineItem = spineItem->Next();
+                HandleError(EPUBError::MediaOverlayMismatchDurationMetadata, str);
             }
 
-            return accumulatedDurationMilliseconds;
+            return smilDur;
         }
 
-        static std::vector<string> splitFileFragmentId; // = std::vector<string>(2);
-
         void splitIriFileFragmentID(const string & iri, std::vector<string> &splitFileFragmentId)
         {
             //printf("=========== IRI: %s\n", iri.c_str());
@@ -613,33 +664,13 @@ public:
 //            //return split;
         }
 
-        std::shared_ptr<ManifestItem> getReferencedManifestItem(const std::shared_ptr<Package> & package, string filepathInSmil, const std::shared_ptr<ManifestItem> & smilItem, std::map<std::shared_ptr<ManifestItem>, string> & cache_manifestItemToAbsolutePath)
+        std::shared_ptr<ManifestItem> MediaOverlaysSmilModel::getReferencedManifestItem(const string & filepathInSmil, const string & smilOPFPath)
         {
             if (filepathInSmil.empty())
             {
                 return nullptr;
             }
 
-            std::map<std::shared_ptr<ManifestItem>, string>::iterator iterator = cache_manifestItemToAbsolutePath.find(smilItem);
-            string smilOPFPath;
-            if (iterator != cache_manifestItemToAbsolutePath.end()
-                //cache_manifestItemToAbsolutePath.count(smilItem)
-            )
-            {
-                //smilOPFPath = cache_manifestItemToAbsolutePath[smilItem];
-                smilOPFPath = iterator->second;
-
-                //printf("=========== smilOPFPath FROM CACHE: %s\n", smilOPFPath.c_str());
-            }
-            else
-            {
-                smilOPFPath = smilItem->AbsolutePath();
-                cache_manifestItemToAbsolutePath[smilItem] = smilOPFPath;
-
-                //printf("=========== smilOPFPath CACHING: %s\n", smilOPFPath.c_str());
-            }
-
-
             //printf("=========== smilOPFPath: %s\n", smilOPFPath.c_str());
 
             string::size_type i = smilOPFPath.find_last_of('/');
@@ -700,43 +731,36 @@ public:
                 refOPFPath.insert(0, "/");
             }
 
-            const ManifestTable & manifestTable = package->Manifest();
-            for (ManifestTable::const_iterator iter = manifestTable.begin(); iter != manifestTable.end(); iter++)
+            // built once, rather than comparing against each manifest item's path for every reference
+            if (_manifestItemsByPath.empty())
             {
-                std::shared_ptr<ManifestItem> manItem = iter->second;
-
-                string abs;
-                iterator = cache_manifestItemToAbsolutePath.find(manItem);
-                if (iterator != cache_manifestItemToAbsolutePath.end()
-                        //cache_manifestItemToAbsolutePath.count(manItem)
-                        )
+                std::shared_ptr<Package> package = Owner(); // internally: std::weak_ptr<Package>.lock()
+                if (package == nullptr)
                 {
-                    //abs = cache_manifestItemToAbsolutePath[manItem];
-                    abs = iterator->second;
-
-                    //printf("=========== abs FROM CACHE: %s\n", abs.c_str());
+                    return nullptr;
                 }
-                else
-                {
-                    abs = manItem->AbsolutePath();
-                    cache_manifestItemToAbsolutePath[manItem] = abs;
 
-                    //printf("=========== abs CACHING: %s\n", abs.c_str());
-                }
-
-                if (abs.compare(refOPFPath) == 0)
+                const ManifestTable & manifestTable = package->Manifest();
+                for (ManifestTable::const_iterator iter = manifestTable.begin(); iter != manifestTable.end(); iter++)
                 {
-                    //printf("------> manifest item path: %s\n", abs.c_str());
-                    
-                    return manItem; //unless RVO (Return Value Optimization), creates a copy of the smart pointer (reference count++), and deallocates the local variable (reference count--)
+                    // the first item with a given path wins, as it did when searching the manifest in order
+                    _manifestItemsByPath.emplace(iter->second->AbsolutePath().stl_str(), iter->second);
                 }
             }
 
+            auto found = _manifestItemsByPath.find(refOPFPath);
+            if (found != _manifestItemsByPath.end())
+            {
+                //printf("------> manifest item path: %s\n", found->first.c_str());
+
+                return found->second;
+            }
+
             //printf("------> manifest item path NOT FOUND??!: [%s] %s\n", smilOPFPath.c_str(), filepathInSmil.c_str());
             return nullptr;
         }
 
-        uint32_t MediaOverlaysSmilModel::parseSMIL(SMILDataPtr smilData, shared_ptr<SMILData::Sequence> sequence, shared_ptr<SMILData::Parallel> parallel, const ManifestItemPtr item, shared_ptr<xml::Node> element, std::map<std::shared_ptr<ManifestItem>, string> & cache_manifestItemToAbsolutePath, std::map<string, std::shared_ptr<ManifestItem>> & cache_smilRelativePathToManifestItem)
+        uint32_t MediaOverlaysSmilModel::parseSMIL(SMILDataPtr smilData, SMILData::NodeIndex sequence, SMILData::NodeIndex parallel, const ManifestItemPtr item, shared_ptr<xml::Node> element, const string & smilOPFPath, std::map<string, std::shared_ptr<ManifestItem>> & cache_smilRelativePathToManifestItem)
         {
             if (!bool(element) || !element->IsElementNode())
             {
@@ -745,6 +769,8 @@ public:
 
             uint32_t accumulatedDurationMilliseconds = 0;
 
+            std::vector<string> splitFileFragmentId;
+
             string elementName = element->Name();
 
             string textref_ = string(_getProp(element, "textref", ePub3NamespaceURI));
@@ -779,12 +805,6 @@ public:
 //                printf("=========== SRC FRAGID: %s\n", src_fragmentID.c_str());
             }
 
-            std::shared_ptr<Package> package = Owner(); // internally: std::weak_ptr<Package>.lock()
-            if (package == nullptr)
-            {
-                return 0;
-            }
-
             std::map<string, std::shared_ptr<ManifestItem>>::iterator iterator = cache_smilRelativePathToManifestItem.find(src_file);
             std::shared_ptr<ManifestItem> srcManifestItem;
             if (iterator != cache_smilRelativePathToManifestItem.end()
@@ -798,7 +818,7 @@ public:
             }
             else
             {
-                srcManifestItem = getReferencedManifestItem(package, src_file, item, cache_manifestItemToAbsolutePath);
+                srcManifestItem = getReferencedManifestItem(src_file, smilOPFPath);
                 cache_smilRelativePathToManifestItem[src_file] = srcManifestItem;
 
                 //printf("=========== srcManifestItem CACHING: %s\n", src_file.c_str());
@@ -817,7 +837,7 @@ public:
             }
             else
             {
-                textrefManifestItem = getReferencedManifestItem(package, textref_file, item, cache_manifestItemToAbsolutePath);
+                textrefManifestItem = getReferencedManifestItem(textref_file, smilOPFPath);
                 cache_smilRelativePathToManifestItem[textref_file] = textrefManifestItem;
 
                 //printf("=========== textrefManifestItem CACHING: %s\n", textref_file.c_str());
@@ -833,11 +853,9 @@ public:
                     HandleError(EPUBError::MediaOverlayInvalidTextRefSource, _Str(item->Href().c_str(), " [", textref_file.c_str(), "] => text ref manifest cannot be found"));
                 }
 
-                smilData->_root = std::make_shared<SMILData::Sequence>(nullptr, textref_file, textref_fragmentID, textrefManifestItem, type, smilData);
+                sequence = smilData->AddNode(SMILData::NodeType::Sequence, SMILData::NoNode, textref_file, textref_fragmentID, textrefManifestItem, type);
 
-                sequence = std::const_pointer_cast<SMILData::Sequence>(smilData->Body());
-
-                parallel = nullptr;
+                parallel = SMILData::NoNode;
             }
             else if (elementName == "seq")
             {
@@ -847,16 +865,13 @@ public:
                     HandleError(EPUBError::MediaOverlayInvalidTextRefSource, _Str(item->Href().c_str(), " [", textref_file.c_str(), "] => text ref manifest cannot be found"));
                 }
 
-                if (sequence == nullptr)
+                if (sequence == SMILData::NoNode)
                 {
                     HandleError(EPUBError::MediaOverlaySMILSequenceSequenceParent, _Str(item->Href().c_str(), " => parent of sequence time container must be sequence"));
                 }
 
-                shared_ptr<SMILData::Sequence> seq = std::make_shared<SMILData::Sequence>(sequence, textref_file, textref_fragmentID, textrefManifestItem, type, smilData);
-				sequence->_children.push_back(seq);
-
-                sequence = seq;
-                parallel = nullptr;
+                sequence = smilData->AddNode(SMILData::NodeType::Sequence, sequence, textref_file, textref_fragmentID, textrefManifestItem, type);
+                parallel = SMILData::NoNode;
             }
             else if (elementName == "par")
             {
@@ -866,20 +881,17 @@ public:
                     HandleError(EPUBError::MediaOverlayInvalidTextRefSource, _Str(item->Href().c_str(), " [", textref_file.c_str(), "] => text ref manifest cannot be found"));
                 }
 
-                if (sequence == nullptr)
+                if (sequence == SMILData::NoNode)
                 {
                     HandleError(EPUBError::MediaOverlaySMILParallelSequenceParent, _Str(item->Href().c_str(), " => parent of parallel time container must be sequence"));
                 }
 
-                shared_ptr<SMILData::Parallel> par = std::make_shared<SMILData::Parallel>(sequence, type, smilData);
-				sequence->_children.push_back(par);
-
-                sequence = nullptr;
-                parallel = par;
+                parallel = smilData->AddNode(SMILData::NodeType::Parallel, sequence, "", "", nullptr, type);
+                sequence = SMILData::NoNode;
             }
             else if (elementName == "audio")
             {
-                if (parallel == nullptr)
+                if (parallel == SMILData::NoNode)
                 {
                     HandleError(EPUBError::MediaOverlaySMILAudioParallelParent, _Str(item->Href().c_str(), " => parent of audio must be parallel time container"));
                 }
@@ -951,14 +963,17 @@ public:
                     accumulatedDurationMilliseconds += clipDuration;
                 }
 
-                parallel->_audio = std::make_shared<SMILData::Audio>(parallel, src_file, srcManifestItem, clipBeginMilliseconds, clipEndMilliseconds, smilData);
+                if (parallel != SMILData::NoNode)
+                {
+                    smilData->AddNode(SMILData::NodeType::Audio, parallel, src_file, "", srcManifestItem, "", clipBeginMilliseconds, clipEndMilliseconds);
+                }
 
-                sequence = nullptr;
-                parallel = nullptr;
+                sequence = SMILData::NoNode;
+                parallel = SMILData::NoNode;
             }
             else if (elementName == "text")
             {
-                if (parallel == nullptr)
+                if (parallel == SMILData::NoNode)
                 {
                     HandleError(EPUBError::MediaOverlaySMILTextParallelParent, _Str(item->Href().c_str(), " => parent of text must be parallel time container"));
                 }
@@ -983,10 +998,13 @@ public:
                     _excludeAudioDuration = true;
                 }
 
-                parallel->_text = std::make_shared<SMILData::Text>(parallel, src_file, src_fragmentID, srcManifestItem, smilData);
+                if (parallel != SMILData::NoNode)
+                {
+                    smilData->AddNode(SMILData::NodeType::Text, parallel, src_file, src_fragmentID, srcManifestItem, "");
+                }
 
-                sequence = nullptr;
-                parallel = nullptr;
+                sequence = SMILData::NoNode;
+                parallel = SMILData::NoNode;
             }
             else
             {
@@ -1000,7 +1018,7 @@ public:
 
                 for (; bool(childNode); childNode = childNode->NextElementSibling())
                 {
-                    uint32_t time = parseSMIL(smilData, sequence, parallel, item, childNode, cache_manifestItemToAbsolutePath, cache_smilRelativePathToManifestItem);
+                    uint32_t time = parseSMIL(smilData, sequence, parallel, item, childNode, smilOPFPath, cache_smilRelativePathToManifestItem);
 
                     if (elementName != "par" || !_excludeAudioDuration)
                     {
@@ -1011,21 +1029,21 @@ public:
 
             if (elementName == "body")
             {
-                if (sequence->GetChildrenCount() == 0)
+                if (smilData->_nodes[sequence].childCount == 0)
                 {
                     HandleError(EPUBError::MediaOverlayEmptyBody, _Str(item->Href().c_str(), " => SMIL body has no sequence or parallel time container children"));
                 }
             }
             else if (elementName == "seq")
             {
-                if (sequence->GetChildrenCount() == 0)
+                if (sequence != SMILData::NoNode && smilData->_nodes[sequence].childCount == 0)
                 {
                     HandleError(EPUBError::MediaOverlayEmptySeq, _Str(item->Href().c_str(), " => SMIL sequence time container has no sequence or parallel time container children"));
                 }
             }
             else if (elementName == "par")
             {
-                if (parallel->Text() == nullptr)
+                if (parallel != SMILData::NoNode && (smilData->_nodes[parallel].flags & SMILData::HasText) == 0)
                 {
                     HandleError(EPUBError::MediaOverlayEmptyPar, _Str(item->Href().c_str(), " => SMIL parallel time container has no text child"));
                 }
@@ -27,6 +27,8 @@
 #include <ePub3/xml/node.h>
 #include "media-overlays_smil_data.h"
 #include "package.h"
+#include <mutex>
+#include <unordered_map>
 
 //#include <ePub3/utilities/make_unique.h>
 //std::unique_ptr<KLASS> obj = make_unique<KLASS>(constructor_params);
@@ -37,9 +39,17 @@ EPUB3_BEGIN_NAMESPACE
 
         class MediaOverlaysSmilModel;
 
+        class DocumentPreloader;
+
         /**
 Parser that reads SMIL XML files into an in-memory data model
 
+Only the durations given by the package's `media:duration` metadata are read
+when the model is initialized. Each SMIL file is parsed the first time its
+SMILData is used (through Body(), DurationMilliseconds_Calculated() and so on);
+at that point the remaining SMIL files are read and parsed into XML documents on
+a background thread, so that playback doesn't wait for each of them in turn.
+
 See:
 http://www.idpf.org/epub/30/spec/epub30-mediaoverlays.html
 
@@ -180,15 +190,35 @@ http://www.idpf.org/epub/30/spec/epub30-mediaoverlays.html
 
             bool _excludeAudioDuration;
 
+            std::mutex _loadLock; // guards the SMIL parsing state below, and each SMILData's tree
+
+            std::vector<std::shared_ptr<SMILData>>::size_type _unloadedCount; // SMILs not yet parsed
+
+            uint32_t _loadedDuration; // sum of the parsed SMILs' durations
+
+            std::unordered_map<std::string, std::shared_ptr<ManifestItem>> _manifestItemsByPath; // absolute path => manifest item
+
+            std::shared_ptr<DocumentPreloader> _preloader; // parses the remaining SMIL files in the background
+
             void resetData();
 
             void populateData();
 
             void parseMetadata();
 
-            uint32_t parseSMILs();
+            void checkTotalDuration();
+
+            friend class SMILData; // loadSMIL
+
+            void loadSMIL(const SMILData * smilData);
+
+            void startBackgroundLoading(const SMILData * first);
+
+            uint32_t parseSMILDocument(SMILDataPtr smilData, shared_ptr<xml::Document> doc);
+
+            uint32_t parseSMIL(SMILDataPtr smilData, SMILData::NodeIndex sequence, SMILData::NodeIndex parallel, const ManifestItemPtr item, shared_ptr<xml::Node> element, const string & smilOPFPath, std::map<string, std::shared_ptr<ManifestItem>> & cache_smilRelativePathToManifestItem); // recursive
 
-            uint32_t parseSMIL(SMILDataPtr smilData, shared_ptr<SMILData::Sequence> sequence, shared_ptr<SMILData::Parallel> parallel, const ManifestItemPtr item, shared_ptr<xml::Node> element, std::map<std::shared_ptr<ManifestItem>, string> & cache_manifestItemToAbsolutePath, std::map<string, std::shared_ptr<ManifestItem>> & cache_smilRelativePathToManifestItem); // recursive
+            std::shared_ptr<ManifestItem> getReferencedManifestItem(const string & filepathInSmil, const string & smilOPFPath);
 
         protected:
             shared_ptr<const SMILData::Parallel> ParallelAt(uint32_t timeMilliseconds) const;
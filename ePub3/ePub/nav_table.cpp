@@ -22,6 +22,7 @@
 #include "xpath_wrangler.h"
 #include "package.h"
 #include "error_handler.h"
+#include "xml_stream_reader.h"
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -60,6 +61,18 @@ static void NCXContentHref(shared_ptr<xml::Node> content, string& outString)
 
 	outString = val;
 }
+#if EPUB_USE(LIBXML2)
+static void NCXNavLabelText(XMLStreamReader& reader, string& outString)
+{
+	// as above: only a <text> element which is the label's first child counts
+	int depth = reader.Depth();
+	outString.clear();
+	if (reader.NextChild(depth) && reader.Name() == "text")
+		outString = reader.Content();
+	while (reader.NextChild(depth))
+		continue;
+}
+#endif
 
 NavigationTable::NavigationTable(shared_ptr<Package>& owner, const string& sourceHref)
     : OwnedBy(owner), _type(), _title(), _sourceHref(sourceHref)
@@ -291,4 +304,225 @@ shared_ptr<NavigationElement> NavigationTable::BuildNCXNavigationPoint(shared_pt
 	return point;
 }
 
+#if EPUB_USE(LIBXML2)
+bool NavigationTable::ParseXML(XMLStreamReader& reader)
+{
+    if ( !reader.IsStartElement() )
+        return false;
+    
+    if ( AllowedRootNodeNames.find(reader.Name()) == AllowedRootNodeNames.end() )
+    {
+        reader.Skip();
+        return false;
+    }
+    
+    _type = reader.Attribute("type", ePub3NamespaceURI);
+    if ( _type.empty() )
+    {
+        reader.Skip();
+        return false;
+    }
+    
+    // the title is the first text of the first <h2>, and there must be exactly one <ol>
+    bool foundHeading = false;
+    size_t numLists = 0;
+    int depth = reader.Depth();
+    while ( reader.NextChild(depth) )
+    {
+        if ( reader.Is("h2", XHTMLNamespaceURI) )
+        {
+            if ( !foundHeading )
+            {
+                foundHeading = true;
+                _title = reader.FirstText();
+            }
+        }
+        else if ( reader.Is("ol", XHTMLNamespaceURI) )
+        {
+            if ( ++numLists == 1 )
+                LoadChildElements(Ptr(), reader);
+        }
+    }
+    
+    return numLists == 1;
+}
+bool NavigationTable::ParseNCXNavMap(XMLStreamReader& reader, const string& title)
+{
+	_type = "toc";
+	_title = title;
+
+	int depth = reader.Depth();
+	while (reader.NextChild(depth))
+	{
+		if (reader.Name() != "navPoint")
+		{
+			HandleError(EPUBError::NavElementUnexpectedType, "Found a non-navPoint element inside an NCX navMap");
+			continue;
+		}
+
+		LoadChildNavPoint(Ptr(), reader);
+	}
+
+	return true;
+}
+bool NavigationTable::ParseNCXPageList(XMLStreamReader& reader)
+{
+	_type = "page-list";
+	_title = "Page List";	// TODO: localization
+
+	int depth = reader.Depth();
+	while (reader.NextChild(depth))
+	{
+		if (reader.Name() != "pageTarget")
+		{
+			HandleError(EPUBError::NavElementUnexpectedType, "Found a non-pageTarget element inside an NCX pageList");
+			continue;
+		}
+
+		LoadChildNavPoint(Ptr(), reader);
+	}
+
+	return true;
+}
+bool NavigationTable::ParseNCXNavList(XMLStreamReader& reader)
+{
+	int depth = reader.Depth();
+	while (reader.NextChild(depth))
+	{
+		if (reader.Name() == "navLabel")
+		{
+			if (_title.empty())
+			{
+				NCXNavLabelText(reader, _title);
+				if (_title == "List of Illustrations")
+					_type = "loi";
+				else if (_title == "List of Tables")
+					_type = "lot";
+				else if (_title == "List of Figures")
+					_type = "lof";
+			}
+			else
+			{
+				HandleError(EPUBError::NavListElementInvalidChild, "Multiple navLabel elements within an NCX navList");
+			}
+
+			continue;
+		}
+
+		if (reader.Name() != "navTarget")
+		{
+			HandleError(EPUBError::NavElementUnexpectedType, "Found a non-pageTarget element inside an NCX pageList");
+			continue;
+		}
+
+		LoadChildNavPoint(Ptr(), reader);
+	}
+
+	return true;
+}
+void NavigationTable::LoadChildElements(shared_ptr<NavigationElement> pElement, XMLStreamReader& reader)
+{
+    // the <li> children; if there are none, those of the first nested <ol> (an erroneous NavDoc)
+    std::vector<shared_ptr<NavigationElement>> nestedElements;
+    bool foundItem = false, foundNestedList = false;
+    
+    int depth = reader.Depth();
+    while ( reader.NextChild(depth) )
+    {
+        if ( reader.Is("li", XHTMLNamespaceURI) )
+        {
+            foundItem = true;
+            auto childElement = BuildNavigationPoint(reader);
+            if ( childElement )
+                pElement->AppendChild(childElement);
+        }
+        else if ( !foundItem && !foundNestedList && reader.Is("ol", XHTMLNamespaceURI) )
+        {
+            foundNestedList = true;
+            int nestedDepth = reader.Depth();
+            while ( reader.NextChild(nestedDepth) )
+            {
+                if ( !reader.Is("li", XHTMLNamespaceURI) )
+                    continue;
+                auto childElement = BuildNavigationPoint(reader);
+                if ( childElement )
+                    nestedElements.push_back(childElement);
+            }
+        }
+    }
+    
+    if ( !foundItem )
+    {
+        for ( auto& childElement : nestedElements )
+            pElement->AppendChild(childElement);
+    }
+}
+void NavigationTable::LoadChildNavPoint(shared_ptr<NavigationElement> pElement, XMLStreamReader& reader)
+{
+	auto childElement = BuildNCXNavigationPoint(reader);
+	if (childElement)
+		pElement->AppendChild(childElement);
+}
+shared_ptr<NavigationElement> NavigationTable::BuildNavigationPoint(XMLStreamReader& reader)
+{
+    int depth = reader.Depth();
+    if ( !reader.NextChild(depth) )
+        return nullptr;
+    
+    auto elementPtr = CastPtr<NavigationElement>();
+    auto point = NavigationPoint::New(elementPtr);
+    
+    do
+    {
+        if ( reader.Name() == "a" )
+        {
+            point->SetTitle(reader.Content());
+            point->SetContent(reader.Attribute("href"));
+        }
+        else if ( reader.Name() == "span" )
+        {
+            point->SetTitle(reader.Content());
+        }
+        else if ( reader.Name() == "ol" )
+        {
+            LoadChildElements(point, reader);
+            
+            // anything after the nested list is ignored
+            while ( reader.NextChild(depth) )
+                continue;
+            break;
+        }
+    } while ( reader.NextChild(depth) );
+    
+    return point;
+}
+shared_ptr<NavigationElement> NavigationTable::BuildNCXNavigationPoint(XMLStreamReader& reader)
+{
+	auto elementPtr = CastPtr<NavigationElement>();
+	auto point = NavigationPoint::New(elementPtr);
+
+	int depth = reader.Depth();
+	while (reader.NextChild(depth))
+	{
+		string tmp;
+
+		if (reader.Name() == "navLabel")
+		{
+			NCXNavLabelText(reader, tmp);
+			point->SetTitle(tmp);
+		}
+		else if (reader.Name() == "content")
+		{
+			point->SetContent(reader.Attribute("src", NCXNamespaceURI));
+		}
+		else if (reader.Name() == "navPoint")
+		{
+			LoadChildNavPoint(point, reader);
+		}
+	}
+
+	return point;
+}
+#endif
+
 EPUB3_END_NAMESPACE
@@ -30,6 +30,7 @@ EPUB3_BEGIN_NAMESPACE
 
 class Package;
 class NavigationTable;
+class XMLStreamReader;
 
 typedef shared_ptr<NavigationTable> NavigationTablePtr;
 
@@ -61,6 +62,26 @@ public:
 	bool					ParseNCXPageList(shared_ptr<xml::Node> node);
 	EPUB3_EXPORT
 	bool					ParseNCXNavList(shared_ptr<xml::Node> node);
+
+#if EPUB_USE(LIBXML2)
+    /// @{
+    /// @name Streaming
+    /// These read the same elements as the methods above, from a stream reader
+    /// positioned on the element's start tag. On return, the reader is on the
+    /// matching end tag.
+
+    EPUB3_EXPORT
+	bool                    ParseXML(XMLStreamReader& reader);
+
+	EPUB3_EXPORT
+	bool					ParseNCXNavMap(XMLStreamReader& reader, const string& title);
+	EPUB3_EXPORT
+	bool					ParseNCXPageList(XMLStreamReader& reader);
+	EPUB3_EXPORT
+	bool					ParseNCXNavList(XMLStreamReader& reader);
+
+    /// @}
+#endif
     
     const string&           Type()                      const   { return _type; }
     void                    SetType(const string& str)          { _type = str; }
@@ -84,6 +105,14 @@ protected:
 
 	void                    LoadChildElements(shared_ptr<NavigationElement> pElement, shared_ptr<xml::Node> pXmlNode);
 	void					LoadChildNavPoint(shared_ptr<NavigationElement> pElement, shared_ptr<xml::Node> navPoint);
+
+#if EPUB_USE(LIBXML2)
+	shared_ptr<NavigationElement>   BuildNavigationPoint(XMLStreamReader& reader);
+	shared_ptr<NavigationElement>	BuildNCXNavigationPoint(XMLStreamReader& reader);
+
+	void                    LoadChildElements(shared_ptr<NavigationElement> pElement, XMLStreamReader& reader);
+	void					LoadChildNavPoint(shared_ptr<NavigationElement> pElement, XMLStreamReader& reader);
+#endif
 };
 
 EPUB3_END_NAMESPACE
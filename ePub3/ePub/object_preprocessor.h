@@ -101,6 +101,10 @@ public:
      */
     virtual void*   FilterData(FilterContext* context, void* data, size_t len, size_t* outputLen) OVERRIDE;
     
+    ///
+    /// The handlers come from the package, but the button title is part of the identity.
+    virtual string  CacheIdentity() const OVERRIDE { return _Str("ObjectPreprocessor:", _button); }
+    
     // register with the filter manager
     static void Register();
     
@@ -31,9 +31,15 @@
 #include "filter_chain.h"
 #include "filter_manager.h"
 #include "media-overlays_smil_model.h"
+#include "resource_prefetcher.h"
+#include "search_index.h"
+#include "package_snapshot.h"
+#include "xml_stream_reader.h"
+#include "document_preloader.h"
 #include <ePub3/utilities/error_handler.h>
 #include <sstream>
 #include <list>
+#include <algorithm>
 #include REGEX_INCLUDE
 #include <ePub3/xml/document.h>
 #include <ePub3/xml/element.h>
@@ -98,6 +104,14 @@ PackageBase::~PackageBase()
 {
     // our Container owns the archive
 }
+// the directory containing a package document, with a trailing slash
+static string _PathBaseForDocument(const string& path)
+{
+    size_t loc = path.rfind("/");
+    if ( loc == std::string::npos )
+        return string(1, '/');
+    return path.substr(0, loc+1);
+}
 bool PackageBase::Open(const string& path)
 {
     ArchiveXmlReader reader(_archive->ReaderAtPath(path.stl_str()));
@@ -112,16 +126,7 @@ bool PackageBase::Open(const string& path)
         return false;
     }
     
-    size_t loc = path.rfind("/");
-    if ( loc == std::string::npos )
-    {
-        _pathBase = '/';
-    }
-    else
-    {
-        _pathBase = path.substr(0, loc+1);
-    }
-    
+    _pathBase = _PathBaseForDocument(path);
     return true;
 }
 shared_ptr<SpineItem> PackageBase::SpineItemAt(size_t idx) const
@@ -286,6 +291,37 @@ NavigationList PackageBase::NavTablesFromManifestItem(shared_ptr<PackageBase> ow
     if ( pItem == nullptr )
         return NavigationList();
     
+#if EPUB_USE(LIBXML2)
+    if ( XMLStreamReader::Enabled() && pItem->MediaType() != "text/html" )
+    {
+        NavigationList navList;
+        DeferredErrors deferred;
+        bool ncx = (pItem->MediaType() == NCXContentType);
+        XMLStreamReader reader(sharedPkg->ReaderForRelativePath(pItem->BaseHref()), pItem->BaseHref());
+        if ( ncx )
+            navList = _StreamNCXNavTablesFromManifestItem(sharedPkg, pItem, reader);
+        else
+            navList = _StreamEPUB3NavTablesFromManifestItem(sharedPkg, pItem, reader);
+        
+        bool failed = reader.Failed() || !reader.IsOpen();
+        if ( !failed && !ncx && navList.empty() && pItem->Href().rfind(".ncx") == pItem->Href().size()-4 )
+        {
+            XMLStreamReader ncxReader(sharedPkg->ReaderForRelativePath(pItem->BaseHref()), pItem->BaseHref());
+            navList = _StreamNCXNavTablesFromManifestItem(sharedPkg, pItem, ncxReader);
+            failed = ncxReader.Failed() || !ncxReader.IsOpen();
+        }
+        
+        // if the document isn't well-formed, load it in recovery mode below, which
+        // reports its errors again
+        if ( !failed )
+        {
+            deferred.Release();
+            return navList;
+        }
+        deferred.Discard();
+    }
+#endif
+    
     auto doc = pItem->ReferencedDocument();
     if ( !bool(doc) )
         return NavigationList();
@@ -380,6 +416,96 @@ NavigationList PackageBase::_LoadNCXNavTablesFromManifestItem(PackagePtr sharedP
 
 	return tables;
 }
+#if EPUB_USE(LIBXML2)
+NavigationList PackageBase::_StreamEPUB3NavTablesFromManifestItem(PackagePtr sharedPkg, ManifestItemPtr pItem, XMLStreamReader& reader)
+{
+	// the same elements as the XPaths "//html:nav" and "//html:dl[epub:type='glossary']"
+	NavigationList tables;
+	while (reader.Next())
+	{
+		if (!reader.IsStartElement() || reader.NamespaceURI() != XHTMLNamespaceURI)
+			continue;
+
+		if (reader.Name() == "nav")
+		{
+			auto navTablePtr = NavigationTable::New(sharedPkg, pItem->Href());
+			if (navTablePtr->ParseXML(reader))
+				tables.push_back(navTablePtr);
+		}
+		else if (reader.Name() == "dl" && reader.Attribute("type", ePub3NamespaceURI) == "glossary")
+		{
+			auto doc = reader.ExpandedDocument();
+			if (bool(doc))
+				tables.push_back(Glossary::New(doc->Root(), sharedPkg));
+		}
+	}
+
+	// navigation tables come before glossaries, as with the DOM loader
+	std::stable_partition(tables.begin(), tables.end(), [](const NavigationElementPtr& elem) {
+		return bool(std::dynamic_pointer_cast<class NavigationTable>(elem));
+	});
+	return tables;
+}
+NavigationList PackageBase::_StreamNCXNavTablesFromManifestItem(PackagePtr sharedPkg, ManifestItemPtr pItem, XMLStreamReader& reader)
+{
+	if (!reader.Next() || !reader.Is("ncx", NCXNamespaceURI))
+		return NavigationList();
+
+	string title;
+	bool foundTitle = false;
+	NavigationTablePtr navMap, pageList;
+	NavigationList navLists;
+	while (reader.NextChild(0))
+	{
+		if (reader.NamespaceURI() != NCXNamespaceURI)
+			continue;
+
+		if (reader.Name() == "docTitle" && !foundTitle)
+		{
+			int depth = reader.Depth();
+			while (reader.NextChild(depth))
+			{
+				if (reader.Is("text", NCXNamespaceURI))
+				{
+					title = reader.FirstText();
+					foundTitle = true;
+					break;
+				}
+			}
+		}
+		else if (reader.Name() == "navMap" && !navMap)
+		{
+			navMap = NavigationTable::New(sharedPkg, pItem->Href());
+			if (!navMap->ParseNCXNavMap(reader, string::EmptyString))
+				navMap.reset();
+		}
+		else if (reader.Name() == "pageList" && !pageList)
+		{
+			pageList = NavigationTable::New(sharedPkg, pItem->Href());
+			if (!pageList->ParseNCXPageList(reader))
+				pageList.reset();
+		}
+		else if (reader.Name() == "navList")
+		{
+			auto navTablePtr = NavigationTable::New(sharedPkg, pItem->Href());
+			if (navTablePtr->ParseNCXNavList(reader))
+				navLists.push_back(navTablePtr);
+		}
+	}
+
+	// the title may follow the navMap in the document
+	NavigationList tables;
+	if (navMap)
+	{
+		navMap->SetTitle(title);
+		tables.push_back(navMap);
+	}
+	if (pageList)
+		tables.push_back(pageList);
+	tables.insert(tables.end(), navLists.begin(), navLists.end());
+	return tables;
+}
+#endif
 
 #if 0
 #pragma mark - Package High-Level API
@@ -388,12 +514,54 @@ NavigationList PackageBase::_LoadNCXNavTablesFromManifestItem(PackagePtr sharedP
 Package::Package(const shared_ptr<Container>& owner, const string& type) : PropertyHolder(), OwnedBy(owner), PackageBase(owner, type)
 {
 }
+// the container's preloader, while it's being opened
+static shared_ptr<DocumentPreloader> _PreloaderForPackage(const Package* package)
+{
+    ContainerPtr container = package->GetContainer();
+    return (bool(container) ? container->Preloader() : nullptr);
+}
+
 bool Package::Open(const string& path)
 {
 #if _XML_OVERRIDE_SWITCHES
     __setupLibXML();
 #endif
-    auto status = PackageBase::Open(path) && Unpack();
+    bool status = false;
+#if EPUB_USE(LIBXML2)
+    unique_ptr<ArchiveReader> opfReader;
+    if ( XMLStreamReader::Enabled() )
+    {
+        shared_ptr<DocumentPreloader> preloader = _PreloaderForPackage(this);
+        if ( bool(preloader) )
+            opfReader = preloader->TakeReader(path);
+        if ( !bool(opfReader) )
+            opfReader = _archive->ReaderAtPath(path.stl_str());
+    }
+    XMLStreamReader reader(std::move(opfReader), path);
+    if ( reader.IsOpen() )
+    {
+        _pathBase = _PathBaseForDocument(path);
+        DeferredErrors deferred;
+        status = UnpackStream(reader);
+        
+        if ( reader.Failed() )
+        {
+            // not well-formed: load it again in recovery mode, through the DOM,
+            // which reports anything the streaming pass found again
+            deferred.Discard();
+            ResetUnpackedState();
+            status = PackageBase::Open(path) && Unpack();
+        }
+        else
+        {
+            deferred.Release();
+        }
+    }
+    else
+#endif
+    {
+        status = PackageBase::Open(path) && Unpack();
+    }
 
     if (status)
     {
@@ -455,11 +623,83 @@ bool Package::_OpenForTest(shared_ptr<xml::Document> doc, const string& basePath
 #endif
     return status;
 }
+#if EPUB_USE(LIBXML2)
+bool Package::_OpenStreamForTest(const void* bytes, size_t length, const string& basePath)
+{
+#if _XML_OVERRIDE_SWITCHES
+    __setupLibXML();
+#endif
+    XMLStreamReader reader(bytes, length, basePath);
+    _pathBase = basePath;
+    DeferredErrors deferred;
+    auto status = UnpackStream(reader);
+    if ( reader.Failed() )
+    {
+        // as Open() does
+        deferred.Discard();
+        ResetUnpackedState();
+        _opf = xml::Wrapped<xml::Document>(xmlReadMemory(reinterpret_cast<const char*>(bytes), static_cast<int>(length), basePath.c_str(), nullptr, XMLStreamReader::DefaultOptions));
+        _pathBase = basePath;
+        status = bool(_opf) && Unpack();
+    }
+    else
+    {
+        deferred.Release();
+    }
+#if _XML_OVERRIDE_SWITCHES
+    __resetLibXMLOverrides();
+#endif
+    return status;
+}
+#endif
+void Package::ResetUnpackedState()
+{
+    _opf.reset();
+    _manifest.clear();
+    _navigation.clear();
+    _contentHandlers.clear();
+    _spine.reset();
+    _xmlIDLookup.clear();
+    _collections.clear();
+    while ( NumberOfProperties() > 0 )
+        ErasePropertyAt(NumberOfProperties() - 1);
+    _spineCFIIndex = 0;
+    _version.clear();
+    _packageID.clear();
+}
 
 unique_ptr<ArchiveReader> Package::ReaderForRelativePath(const string& path)       const
 {
+    shared_ptr<DocumentPreloader> preloader = _PreloaderForPackage(this);
+    if ( bool(preloader) )
+    {
+        unique_ptr<ArchiveReader> reader = preloader->TakeReader(_pathBase + path);
+        if ( bool(reader) )
+            return reader;
+    }
     return _archive->ReaderAtPath((_pathBase + path).stl_str());
 }
+shared_ptr<xml::Document> Package::PreloadedDocument(const string& path) const
+{
+    shared_ptr<DocumentPreloader> preloader = _PreloaderForPackage(this);
+    if ( !bool(preloader) )
+        return nullptr;
+    return preloader->TakeDocument(_pathBase + path);
+}
+void Package::PreloadReferencedDocuments()
+{
+    shared_ptr<DocumentPreloader> preloader = _PreloaderForPackage(this);
+    if ( !bool(preloader) )
+        return;
+    
+    // keyed the same way as ReaderForRelativePath() and ManifestItem::ReferencedDocument() read them
+    for ( auto& pair : _manifest )
+    {
+        const ManifestItemPtr& item = pair.second;
+        if ( item->MediaType() == NCXContentType || item->HasProperty(ItemProperties::Navigation) )
+            preloader->Preload(_pathBase + item->BaseHref());
+    }
+}
 
 bool Package::Unpack()
 {
@@ -581,29 +821,8 @@ bool Package::Unpack()
             }
         }
         
-        // check fallback chains
-        typedef std::map<string, bool> IdentSet;
-        IdentSet idents;
-        for ( auto &pair : _manifest )
-        {
-            ManifestItemPtr item = pair.second;
-            if ( item->FallbackID().empty() )
-                continue;
-            
-            idents[item->XMLIdentifier()] = true;
-            while ( item != nullptr && !item->FallbackID().empty() )
-            {
-                if ( idents[item->FallbackID()] )
-                {
-                    HandleError(EPUBError::OPFFallbackChainCircularReference);
-                    break;
-                }
-                
-                item = item->Fallback();
-            }
-            
-            idents.clear();
-        }
+        PreloadReferencedDocuments();
+        CheckFallbackChains();
         
         SpineItemPtr cur;
         for ( auto node : spineNodes )
@@ -615,43 +834,7 @@ bool Package::Unpack()
                 continue;
             }
             
-            // validation of idref
-            auto manifestFound = _manifest.find(next->Idref());
-            if ( manifestFound == _manifest.end() )
-            {
-                HandleError(EPUBError::OPFInvalidSpineIdref, _Str(next->Idref(), " does not correspond to a manifest item"));
-                continue;
-            }
-            
-            // validation of spine resource type w/fallbacks
-            ManifestItemPtr manifestItem = next->ManifestItem();
-            bool isContentDoc = false;
-            do
-            {
-                if ( manifestItem->MediaType() == "application/xhtml+xml" ||
-                     manifestItem->MediaType() == "image/svg" )
-                {
-                    isContentDoc = true;
-                    break;
-                }
-                
-            } while ( (manifestItem = manifestItem->Fallback()) );
-            
-            if ( !isContentDoc )
-                HandleError(EPUBError::OPFFallbackChainHasNoContentDocument);
-            
-            StoreXMLIdentifiable(next);
-            
-            if ( cur != nullptr )
-            {
-                cur->SetNextItem(next);
-            }
-            else
-            {
-                _spine = next;
-            }
-            
-            cur = next;
+            AppendSpineItem(next, cur);
         }
     }
     catch (const std::system_error& exc)
@@ -810,58 +993,7 @@ bool Package::Unpack()
         
         for ( auto node : refineNodes )
         {
-            string ident = _getProp(node, "refines");
-            if ( ident.empty() )
-            {
-                HandleError(EPUBError::OPFInvalidRefinementAttribute, "Empty IRI for 'refines' attribute");
-                continue;
-            }
-            
-            if ( ident[0] == '#' )
-            {
-                ident = ident.substr(1);
-            }
-            else
-            {
-                // validation only right now
-                IRI iri(ident);
-                if ( iri.IsEmpty() )
-                {
-                    HandleError(EPUBError::OPFInvalidRefinementAttribute, _Str("#", ident, " is not a valid IRI"));
-                }
-                else if ( iri.IsRelative() == false )
-                {
-                    HandleError(EPUBError::OPFInvalidRefinementAttribute, _Str(iri.IRIString(), " is not a relative IRI"));
-                }
-                continue;
-            }
-            
-            auto found = _xmlIDLookup.find(ident);
-            if ( found == _xmlIDLookup.end() )
-            {
-                HandleError(EPUBError::OPFInvalidRefinementTarget, _Str("#", ident, " does not reference an item in this document"));
-                continue;
-            }
-            
-            PropertyPtr prop = std::dynamic_pointer_cast<Property>(found->second);
-            if ( prop )
-            {
-                // it's a property, so this is an extension
-                PropertyExtensionPtr extPtr = PropertyExtension::New(prop);
-                if ( extPtr->ParseMetaElement(node) )
-                    prop->AddExtension(extPtr);
-            }
-            else
-            {
-                // not a property, so treat this as a plain property
-                PropertyHolderPtr ptr = std::dynamic_pointer_cast<PropertyHolder>(found->second);
-                if ( ptr )
-                {
-                    prop = Property::New(ptr);
-                    if ( prop->ParseMetaElement(node) )
-                        ptr->AddProperty(prop);
-                }
-            }
+            ApplyRefinement(node);
         }
         
         // now look at the <spine> element for properties
@@ -903,70 +1035,340 @@ bool Package::Unpack()
                 if ( node->Name() != mediaTypeElementName )
                     continue;
                 
-                ////////////////////////////////////////////////////////////
-                // ePub Publications 3.0 ??3.4.16: The `mediaType` Element
-                
-                // The media-type attribute is required.
-                string mediaType = _getProp(node, "media-type");
-                if ( mediaType.empty() )
-                {
-                    HandleError(EPUBError::OPFBindingHandlerNoMediaType);
-                    throw false;
-                }
-                
-                // Each child mediaType of a bindings element must define a unique
-                // content type in its media-type attribute, and the media type
-                // specified must not be a Core Media Type.
-                if ( _contentHandlers[mediaType].empty() == false )
+                InstallMediaTypeBinding(_getProp(node, "media-type"), _getProp(node, "handler"));
+            }
+        }
+    }
+    catch (std::exception& exc)
+    {
+        std::cerr << "Exception processing OPF file: " << exc.what() << std::endl;
+        throw;
+    }
+    catch (...)
+    {
+		return false;
+    }
+    
+    return FinishUnpacking(isEPUB3, xpath.Strings("/opf:package/opf:spine/@toc"));
+}
+#if EPUB_USE(LIBXML2)
+bool Package::UnpackStream(XMLStreamReader& reader)
+{
+    PackagePtr sharedMe = shared_from_this();
+    PropertyHolderPtr holderPtr = CastPtr<PropertyHolder>();
+    const char* opfNamespace = reinterpret_cast<const char*>(OPFNamespace);
+    const char* dcNamespace = reinterpret_cast<const char*>(DCNamespace);
+    
+    // an empty or unreadable document: the DOM loader will report it
+    if ( !reader.Next() )
+        return false;
+    
+    // very basic sanity check
+    string rootName(reader.Name());
+    rootName.tolower();
+	bool isEPUB3 = true;
+	int version = 0;
+    
+    if ( rootName != "package" )
+    {
+        HandleError(EPUBError::OPFInvalidPackageDocument);
+        return false;       // not an OPF file, innit?
+    }
+	_version = reader.Attribute("version");
+    if ( _version.empty() )
+    {
+        HandleError(EPUBError::OPFPackageHasNoVersion);
+    }
+	else
+	{
+        // GNU libstdc++ seems to not want to let us use these C++11 routines...
+#ifndef _LIBCPP_VERSION
+        version = (int)strtol(_version.c_str(), nullptr, 10);
+#else
+		version = std::stoi(_version.stl_str());
+#endif
+
+		if (version < 3)
+			isEPUB3 = false;
+	}
+    
+    InstallPrefixesFromAttributeValue(reader.Attribute("prefix", ePub3NamespaceURI));
+    string uniqueIDRef = reader.Attribute("unique-identifier");
+    
+    // everything is read in one pass over the children of <package>, then
+    // validated and linked in the same order as Unpack() does it
+    size_t manifestNodeCount = 0, spineNodeCount = 0, metadataNodeCount = 0;
+    std::vector<SpineItemPtr> spineItems;
+    std::vector<string> tocNames;
+    string progressionDirection;
+    std::vector<shared_ptr<xml::Document>> collectionDocs, refineDocs;
+    std::vector<std::pair<string, string>> bindings;
+    
+    bool foundIdentifier = false, foundTitle = false, foundLanguage = false, foundModDate = false;
+    std::vector<string> uidRefIds;
+    
+    _spineCFIIndex = 0;
+    uint32_t idx = 0;
+    
+    try
+    {
+        while ( reader.NextChild(0) )
+        {
+            idx += 2;
+            const string& name = reader.Name();
+            int depth = reader.Depth();
+            
+            if ( name == "spine" )
+            {
+                _spineCFIIndex = idx;
+                if ( _spineCFIIndex != 6 )
+                    HandleError(EPUBError::OPFSpineOutOfOrder);
+                progressionDirection = reader.Attribute("page-progression-direction");
+            }
+            else if ( name == "manifest" && idx != 4 )
+            {
+                HandleError(EPUBError::OPFManifestOutOfOrder);
+            }
+            else if ( name == "metadata" && idx != 2 )
+            {
+                HandleError(EPUBError::OPFMetadataOutOfOrder);
+            }
+            
+            if ( reader.NamespaceURI() != opfNamespace )
+                continue;
+            
+            if ( name == "manifest" )
+            {
+                while ( reader.NextChild(depth) )
                 {
-                    // user shouldn't have added manual things yet, but for safety we'll look anyway
-                    for ( auto ptr : _contentHandlers[mediaType] )
+                    if ( !reader.Is("item", opfNamespace) )
+                        continue;
+                    
+                    manifestNodeCount++;
+                    auto p = ManifestItem::New(sharedMe);
+                    if ( p->ParseXML(reader) )
                     {
-                        if ( typeid(*ptr) == typeid(MediaHandler) )
-                        {
-                            HandleError(EPUBError::OPFMultipleBindingsForMediaType);
-                        }
+#if EPUB_HAVE(CXX_MAP_EMPLACE)
+                        _manifest.emplace(p->Identifier(), p);
+#else
+                        _manifest[p->Identifier()] = p;
+#endif
+                        StoreXMLIdentifiable(p);
                     }
                 }
-                if ( CoreMediaTypes.find(mediaType) != CoreMediaTypes.end() )
-                {
-                    HandleError(EPUBError::OPFCoreMediaTypeBindingEncountered);
-                }
                 
-                // The handler attribute is required
-                string handlerID = _getProp(node, "handler");
-                if ( handlerID.empty() )
-                {
-                    HandleError(EPUBError::OPFBindingHandlerNotFound);
-                }
+                // the rest of the package is read while these load
+                PreloadReferencedDocuments();
+            }
+            else if ( name == "spine" )
+            {
+                string toc = reader.Attribute("toc");
+                if ( !toc.empty() )
+                    tocNames.push_back(toc);
                 
-                // The required handler attribute must reference the ID [XML] of an
-                // item in the manifest of the default implementation for this media
-                // type. The referenced item must be an XHTML Content Document.
-                ManifestItemPtr handlerItem = ManifestItemWithID(handlerID);
-                if ( !handlerItem )
+                while ( reader.NextChild(depth) )
                 {
-                    HandleError(EPUBError::OPFBindingHandlerNotFound);
+                    if ( !reader.Is("itemref", opfNamespace) )
+                        continue;
+                    
+                    spineNodeCount++;
+                    auto next = SpineItem::New(sharedMe);
+                    if ( next->ParseXML(reader) )
+                        spineItems.push_back(next);
                 }
-                if ( handlerItem->MediaType() != "application/xhtml+xml" )
+            }
+            else if ( name == "collection" )
+            {
+                auto doc = reader.ExpandedDocument();
+                if ( bool(doc) )
+                    collectionDocs.push_back(doc);
+            }
+            else if ( name == "metadata" )
+            {
+                while ( reader.NextChild(depth) )
                 {
+                    metadataNodeCount++;
+                    
+                    // the text of the element named by the unique-identifier attribute
+                    if ( _packageID.empty() && !uniqueIDRef.empty() && reader.Attribute("id") == uniqueIDRef )
+                        _packageID = reader.FirstText();
+                    
+                    PropertyPtr p;
+                    if ( reader.NamespaceURI() == dcNamespace )
+                    {
+                        // definitely a main node
+                        p = Property::New(holderPtr);
+                    }
+                    else if ( reader.Attribute("name").size() > 0 )
+                    {
+                        // it's an ePub2 item-- ignore it
+                        continue;
+                    }
+                    else if ( reader.Attribute("refines").empty() )
+                    {
+                        // not refining anything, so it's a main node
+                        p = Property::New(holderPtr);
+                    }
+                    else
+                    {
+                        // refinements are applied once all the main nodes are in
+                        auto doc = reader.ExpandedDocument();
+                        if ( bool(doc) )
+                            refineDocs.push_back(doc);
+                        continue;
+                    }
                     
-                    HandleError(EPUBError::OPFBindingHandlerInvalidType, _Str("Media handlers must be XHTML content documents, but referenced item has type '", handlerItem->MediaType(), "'."));
+                    if ( p->ParseMetaElement(reader) )
+                    {
+                        switch ( p->Type() )
+                        {
+                            case DCType::Identifier:
+                            {
+                                foundIdentifier = true;
+                                uidRefIds.push_back(p->XMLIdentifier());
+                                break;
+                            }
+                            case DCType::Title:
+                            {
+                                foundTitle = true;
+                                break;
+                            }
+                            case DCType::Language:
+                            {
+                                foundLanguage = true;
+                                break;
+                            }
+                            case DCType::Custom:
+                            {
+                                if ( p->PropertyIdentifier() == MakePropertyIRI("modified", "dcterms") )
+                                    foundModDate = true;
+                                break;
+                            }
+                                
+                            default:
+                                break;
+                        }
+                        
+                        AddProperty(p);
+                        StoreXMLIdentifiable(p);
+                    }
                 }
-                
-                // All XHTML Content Documents designated as handlers must have the
-                // `scripted` property set in their manifest item's `properties`
-                // attribute.
-                if ( handlerItem->HasProperty(ItemProperties::HasScriptedContent) == false )
+            }
+            else if ( name == "bindings" )
+            {
+                while ( reader.NextChild(depth) )
                 {
-                    HandleError(EPUBError::OPFBindingHandlerNotScripted);
+                    if ( reader.Name() == string(MediaTypeElementName) )
+                        bindings.emplace_back(reader.Attribute("media-type"), reader.Attribute("handler"));
                 }
-                
-                // all good-- install it now
-                _contentHandlers[mediaType].push_back(MediaHandler::New<MediaHandler>(sharedMe, mediaType, handlerItem->AbsolutePath()));
             }
         }
     }
+    catch (const std::system_error& exc)
+    {
+        if ( exc.code().category() == epub_spec_category() )
+            throw;
+        return false;
+    }
+    catch (...)
+    {
+        return false;
+    }
+    
+    // the caller reloads the document through the DOM
+    if ( reader.Failed() )
+        return false;
+    
+    if ( _spineCFIIndex == 0 )
+    {
+        HandleError(EPUBError::OPFNoSpine);
+        return false;       // spineless!
+    }
+    
+    try
+    {
+        if ( manifestNodeCount == 0 )
+        {
+            HandleError(EPUBError::OPFNoManifestItems);
+        }
+        
+        if ( spineNodeCount == 0 )
+        {
+            HandleError(EPUBError::OPFNoSpineItems);
+        }
+        
+        CheckFallbackChains();
+        
+        SpineItemPtr cur;
+        for ( auto& next : spineItems )
+        {
+            AppendSpineItem(next, cur);
+        }
+        
+        for ( auto& doc : collectionDocs )
+        {
+            CollectionPtr collection = Collection::New(Ptr(), nullptr);
+            if ( collection->ParseXML(doc->Root()) )
+            {
+#if EPUB_HAVE(CXX_MAP_EMPLACE)
+                _collections.emplace(collection->Role(), collection);
+#else
+                _collections[collection->Role()] = collection;
+#endif
+            }
+        }
+        
+        if ( metadataNodeCount == 0 )
+            HandleError(EPUBError::OPFNoMetadata);
+        if ( uniqueIDRef.empty() )
+            HandleError(EPUBError::OPFPackageUniqueIDInvalid);
+        
+        if ( foundIdentifier && !uniqueIDRef.empty() &&
+             std::find(uidRefIds.begin(), uidRefIds.end(), uniqueIDRef) == uidRefIds.end() )
+        {
+            HandleError(EPUBError::OPFPackageUniqueIDInvalid);
+        }
+        
+        if ( !foundIdentifier )
+            HandleError(EPUBError::OPFMissingIdentifierMetadata);
+        if ( !foundTitle )
+            HandleError(EPUBError::OPFMissingTitleMetadata);
+        if ( !foundLanguage )
+            HandleError(EPUBError::OPFMissingLanguageMetadata);
+        if ( !foundModDate && isEPUB3 )
+            HandleError(EPUBError::OPFMissingModificationDateMetadata);
+        
+        for ( auto& doc : refineDocs )
+        {
+            ApplyRefinement(doc->Root());
+        }
+        
+        if ( !progressionDirection.empty() )
+        {
+            PropertyPtr prop = Property::New(holderPtr);
+            prop->SetPropertyIdentifier(MakePropertyIRI("page-progression-direction"));
+            prop->SetValue(progressionDirection);
+            AddProperty(prop);
+        }
+    }
+    catch (const std::system_error& exc)
+    {
+        if ( exc.code().category() == epub_spec_category() )
+            throw;
+        return false;
+    }
+    catch (...)
+    {
+        return false;
+    }
+    
+    try
+    {
+        for ( auto& binding : bindings )
+        {
+            InstallMediaTypeBinding(binding.first, binding.second);
+        }
+    }
     catch (std::exception& exc)
     {
         std::cerr << "Exception processing OPF file: " << exc.what() << std::endl;
@@ -977,6 +1379,197 @@ bool Package::Unpack()
 		return false;
     }
     
+    return FinishUnpacking(isEPUB3, tocNames);
+}
+#endif
+void Package::CheckFallbackChains()
+{
+    typedef std::map<string, bool> IdentSet;
+    IdentSet idents;
+    for ( auto &pair : _manifest )
+    {
+        ManifestItemPtr item = pair.second;
+        if ( item->FallbackID().empty() )
+            continue;
+        
+        idents[item->XMLIdentifier()] = true;
+        while ( item != nullptr && !item->FallbackID().empty() )
+        {
+            if ( idents[item->FallbackID()] )
+            {
+                HandleError(EPUBError::OPFFallbackChainCircularReference);
+                break;
+            }
+            
+            item = item->Fallback();
+        }
+        
+        idents.clear();
+    }
+}
+void Package::AppendSpineItem(SpineItemPtr next, SpineItemPtr& cur)
+{
+    // validation of idref
+    auto manifestFound = _manifest.find(next->Idref());
+    if ( manifestFound == _manifest.end() )
+    {
+        HandleError(EPUBError::OPFInvalidSpineIdref, _Str(next->Idref(), " does not correspond to a manifest item"));
+        return;
+    }
+    
+    // validation of spine resource type w/fallbacks
+    ManifestItemPtr manifestItem = next->ManifestItem();
+    bool isContentDoc = false;
+    do
+    {
+        if ( manifestItem->MediaType() == "application/xhtml+xml" ||
+             manifestItem->MediaType() == "image/svg" )
+        {
+            isContentDoc = true;
+            break;
+        }
+        
+    } while ( (manifestItem = manifestItem->Fallback()) );
+    
+    if ( !isContentDoc )
+        HandleError(EPUBError::OPFFallbackChainHasNoContentDocument);
+    
+    StoreXMLIdentifiable(next);
+    
+    if ( cur != nullptr )
+    {
+        cur->SetNextItem(next);
+    }
+    else
+    {
+        _spine = next;
+    }
+    
+    cur = next;
+}
+void Package::ApplyRefinement(shared_ptr<xml::Node> node)
+{
+    string ident = _getProp(node, "refines");
+    if ( ident.empty() )
+    {
+        HandleError(EPUBError::OPFInvalidRefinementAttribute, "Empty IRI for 'refines' attribute");
+        return;
+    }
+    
+    if ( ident[0] == '#' )
+    {
+        ident = ident.substr(1);
+    }
+    else
+    {
+        // validation only right now
+        IRI iri(ident);
+        if ( iri.IsEmpty() )
+        {
+            HandleError(EPUBError::OPFInvalidRefinementAttribute, _Str("#", ident, " is not a valid IRI"));
+        }
+        else if ( iri.IsRelative() == false )
+        {
+            HandleError(EPUBError::OPFInvalidRefinementAttribute, _Str(iri.IRIString(), " is not a relative IRI"));
+        }
+        return;
+    }
+    
+    auto found = _xmlIDLookup.find(ident);
+    if ( found == _xmlIDLookup.end() )
+    {
+        HandleError(EPUBError::OPFInvalidRefinementTarget, _Str("#", ident, " does not reference an item in this document"));
+        return;
+    }
+    
+    PropertyPtr prop = std::dynamic_pointer_cast<Property>(found->second);
+    if ( prop )
+    {
+        // it's a property, so this is an extension
+        PropertyExtensionPtr extPtr = PropertyExtension::New(prop);
+        if ( extPtr->ParseMetaElement(node) )
+            prop->AddExtension(extPtr);
+    }
+    else
+    {
+        // not a property, so treat this as a plain property
+        PropertyHolderPtr ptr = std::dynamic_pointer_cast<PropertyHolder>(found->second);
+        if ( ptr )
+        {
+            prop = Property::New(ptr);
+            if ( prop->ParseMetaElement(node) )
+                ptr->AddProperty(prop);
+        }
+    }
+}
+void Package::InstallMediaTypeBinding(const string& mediaType, const string& handlerID)
+{
+    PackagePtr sharedMe = shared_from_this();
+    
+    ////////////////////////////////////////////////////////////
+    // ePub Publications 3.0 ??3.4.16: The `mediaType` Element
+    
+    // The media-type attribute is required.
+    if ( mediaType.empty() )
+    {
+        HandleError(EPUBError::OPFBindingHandlerNoMediaType);
+        throw false;
+    }
+    
+    // Each child mediaType of a bindings element must define a unique
+    // content type in its media-type attribute, and the media type
+    // specified must not be a Core Media Type.
+    if ( _contentHandlers[mediaType].empty() == false )
+    {
+        // user shouldn't have added manual things yet, but for safety we'll look anyway
+        for ( auto ptr : _contentHandlers[mediaType] )
+        {
+            if ( typeid(*ptr) == typeid(MediaHandler) )
+            {
+                HandleError(EPUBError::OPFMultipleBindingsForMediaType);
+            }
+        }
+    }
+    if ( CoreMediaTypes.find(mediaType) != CoreMediaTypes.end() )
+    {
+        HandleError(EPUBError::OPFCoreMediaTypeBindingEncountered);
+    }
+    
+    // The handler attribute is required
+    if ( handlerID.empty() )
+    {
+        HandleError(EPUBError::OPFBindingHandlerNotFound);
+    }
+    
+    // The required handler attribute must reference the ID [XML] of an
+    // item in the manifest of the default implementation for this media
+    // type. The referenced item must be an XHTML Content Document.
+    ManifestItemPtr handlerItem = ManifestItemWithID(handlerID);
+    if ( !handlerItem )
+    {
+        HandleError(EPUBError::OPFBindingHandlerNotFound);
+    }
+    if ( handlerItem->MediaType() != "application/xhtml+xml" )
+    {
+        
+        HandleError(EPUBError::OPFBindingHandlerInvalidType, _Str("Media handlers must be XHTML content documents, but referenced item has type '", handlerItem->MediaType(), "'."));
+    }
+    
+    // All XHTML Content Documents designated as handlers must have the
+    // `scripted` property set in their manifest item's `properties`
+    // attribute.
+    if ( handlerItem->HasProperty(ItemProperties::HasScriptedContent) == false )
+    {
+        HandleError(EPUBError::OPFBindingHandlerNotScripted);
+    }
+    
+    // all good-- install it now
+    _contentHandlers[mediaType].push_back(MediaHandler::New<MediaHandler>(sharedMe, mediaType, handlerItem->AbsolutePath()));
+}
+bool Package::FinishUnpacking(bool isEPUB3, const std::vector<string>& tocNames)
+{
+    PackagePtr sharedMe = shared_from_this();
+    
     // now the navigation tables
 	if (isEPUB3)
 	{
@@ -1003,15 +1596,6 @@ bool Package::Unpack()
 	if (_navigation.empty() || _navigation["toc"]->Children().empty())
 	{
 		// look for EPUB2 NCX file
-#if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
-		XPathWrangler xpath(_opf, { { "opf", OPFNamespace } });
-#else
-		XPathWrangler::NamespaceList __m;
-		__m["opf"] = OPFNamespace;
-		XPathWrangler xpath(_opf, __m);
-#endif
-		auto tocNames = xpath.Strings("/opf:package/opf:spine/@toc");
-
 		if (tocNames.empty() && _navigation.empty())
 		{
             // no NCX, and no other nav document
@@ -1140,6 +1724,9 @@ string Package::URLSafeUniqueID() const
 }
 string Package::PackageID() const
 {
+    if ( !bool(_opf) )
+        return _packageID;      // loaded from a stream
+    
 #if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
     XPathWrangler xpath(_opf, {{"opf", OPFNamespace}, {"dc", DCNamespace}});
 #else
@@ -1155,6 +1742,8 @@ string Package::PackageID() const
 }
 string Package::Version() const
 {
+    if ( !bool(_opf) )
+        return _version;
     return _getProp(_opf->Root(), "version");
 }
 void Package::FireLoadEvent(const IRI &url) const
@@ -1272,6 +1861,10 @@ shared_ptr<AsyncByteStream> Package::ContentStreamForItem(ManifestItemPtr manife
 
 shared_ptr<ByteStream> Package::GetFilterChainByteStream(ManifestItemPtr manifestItem) const
 {
+    auto prefetcher = _prefetcher.lock();
+    if ( bool(prefetcher) )
+        return prefetcher->GetFilteredStream(manifestItem);
+    
 	return _filterChain->GetFilterChainByteStream(manifestItem);
 }
 
@@ -1295,6 +1888,53 @@ size_t Package::GetFilterChainSize(ManifestItemPtr manifestItem) const
     return _filterChain->GetFilterChainSize(manifestItem);
 }
 
+bool Package::GetFileRange(ManifestItemPtr manifestItem, FileRange& range) const
+{
+    if ( !bool(manifestItem) || GetFilterChainSize(manifestItem) != 0 )
+        return false;
+    
+    const ResourceDescriptor& resource = manifestItem->Descriptor();
+    if ( !resource.IsInArchive() || resource.IsCompressed() )
+        return false;
+    
+    auto container = GetContainer();
+    if ( !bool(container) )
+        return false;
+    
+    return container->GetArchive()->FileRangeAtIndex(resource.ArchiveIndex(), range);
+}
+
+#if EPUB_USE(LIBXML2)
+shared_ptr<const SearchIndex> Package::GetSearchIndex(bool persist)
+{
+    std::lock_guard<std::mutex> _(_searchIndexLock);
+    if ( bool(_searchIndex) )
+        return _searchIndex;
+    
+    auto self = Ptr();
+    string path = (persist ? SearchIndex::DefaultPathFor(self) : string());
+    if ( !path.empty() )
+        _searchIndex = SearchIndex::Load(path, UniqueID());
+    
+    if ( !bool(_searchIndex) )
+    {
+        auto built = SearchIndex::Build(self);
+        if ( !path.empty() )
+            built->Save(path);      // a read-only location just means rebuilding next time
+        _searchIndex = built;
+    }
+    
+    return _searchIndex;
+}
+#endif
+shared_ptr<const PackageSnapshot> Package::GetSnapshot()
+{
+    std::lock_guard<std::mutex> _(_snapshotLock);
+    if ( !bool(_snapshot) )
+        _snapshot = PackageSnapshot::Create(Ptr());
+    return _snapshot;
+}
+
 const string& Package::Title(bool localized) const
 {
     IRI titleTypeIRI(MakePropertyIRI("title-type"));      // http://idpf.org/epub/vocab/package/#title-type
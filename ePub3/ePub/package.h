@@ -26,6 +26,7 @@
 #include <vector>
 #include <map>
 #include <list>
+#include <mutex>
 #include <ePub3/xml/node.h>
 #include <ePub3/utilities/owned_by.h>
 #include <ePub3/encryption.h>
@@ -51,10 +52,15 @@ class Metadata;
 class NavigationTable;
 class ByteStream;
 class SeekableByteStream;
+struct FileRange;
 class Container;
 class PackageBase;
 class Package;
 class MediaOverlaysSmilModel;
+class ResourcePrefetcher;
+class SearchIndex;
+class PackageSnapshot;
+class XMLStreamReader;
 
 /**
  The PackageBase class implements the low-level components and all storage of an OPF
@@ -285,6 +291,10 @@ private:
 	// these are only called by NavTablesFromManifestItem()
 	static NavigationList	_LoadEPUB3NavTablesFromManifestItem(shared_ptr<Package> owner, shared_ptr<ManifestItem> pItem, shared_ptr<xml::Document> doc);
 	static NavigationList	_LoadNCXNavTablesFromManifestItem(shared_ptr<Package> owner, shared_ptr<ManifestItem> pItem, shared_ptr<xml::Document> doc);
+#if EPUB_USE(LIBXML2)
+	static NavigationList	_StreamEPUB3NavTablesFromManifestItem(shared_ptr<Package> owner, shared_ptr<ManifestItem> pItem, XMLStreamReader& reader);
+	static NavigationList	_StreamNCXNavTablesFromManifestItem(shared_ptr<Package> owner, shared_ptr<ManifestItem> pItem, XMLStreamReader& reader);
+#endif
 
 protected:
 #if EPUB_COMPILER_SUPPORTS(CXX_DEFAULT_TEMPLATE_ARGS)
@@ -365,6 +375,9 @@ public:
     
     virtual bool            Open(const string& path);
     bool                    _OpenForTest(shared_ptr<xml::Document> doc, const string& basePath);
+#if EPUB_USE(LIBXML2)
+    bool                    _OpenStreamForTest(const void* bytes, size_t length, const string& basePath);
+#endif
     
     ///
     /// The full Unique Identifier, built from the package unique-id and the modification date.
@@ -493,6 +506,14 @@ public:
     
     unique_ptr<ArchiveReader>   ReaderForRelativePath(const string& path)       const;
 
+    /**
+     Takes a document parsed in the background while the package was being opened.
+     @param path The path of the document, relative to the package directory.
+     @result The document, or `nullptr` if it wasn't preloaded (in which case it
+     should be read as usual).
+     */
+    shared_ptr<xml::Document>   PreloadedDocument(const string& path)           const;
+
     unique_ptr<ArchiveXmlReader>    XmlReaderForRelativePath(const string& path)    const {
         try { return unique_ptr<ArchiveXmlReader>(new ArchiveXmlReader(ReaderForRelativePath(path))); }
         catch (std::invalid_argument&) { return nullptr; }
@@ -534,6 +555,23 @@ public:
     
     EPUB3_EXPORT
     size_t GetFilterChainSize(ManifestItemPtr manifestItem) const;
+    
+    /**
+     Locates a manifest item's bytes within the container's file, so that they can
+     be sent to a socket or pipe with `sendfile()` or `splice()` instead of being
+     read through a stream.
+     
+     This succeeds only for items which no filter applies to, and which are stored
+     in the archive without compression, such as most images, audio and video.
+     Otherwise, read the item using GetFilterChainByteStream() or
+     GetFilterChainByteStreamRange().
+     @param manifestItem The item to locate.
+     @param range Filled in with the location of the item's bytes. The descriptor
+     belongs to the container's archive, and is valid only while it remains open.
+     @result Returns `true` if the item's bytes can be sent straight from the file.
+     */
+    EPUB3_EXPORT
+    bool GetFileRange(ManifestItemPtr manifestItem, FileRange& range) const;
 
     /// @}
     
@@ -886,12 +924,84 @@ public:
         _filterChain = chain;
     }
     
+    /**
+     Attaches a prefetcher whose cache is consulted by GetFilterChainByteStream().
+     
+     The package holds only a weak reference to the prefetcher, which itself keeps
+     the package alive; the caller is responsible for keeping the prefetcher around.
+     Pass `nullptr` to detach the current prefetcher.
+     @param prefetcher The prefetcher for the receiving Package instance.
+     */
+    virtual void            SetResourcePrefetcher(shared_ptr<ResourcePrefetcher> prefetcher) _NOEXCEPT {
+        _prefetcher = prefetcher;
+    }
+    
+    ///
+    /// The attached prefetcher, if any.
+    shared_ptr<ResourcePrefetcher>  GetResourcePrefetcher() const   { return _prefetcher.lock(); }
+    
+#if EPUB_USE(LIBXML2)
+    /**
+     Returns the full-text search index for the publication's spine documents.
+     
+     The first call loads the index saved at SearchIndex::DefaultPathFor() if it was
+     built from this version of the publication; otherwise the index is built (which
+     reads every spine document) and saved there for next time, if possible. Later
+     calls return the same index.
+     @param persist Whether to look for and save the index next to the publication.
+     */
+    EPUB3_EXPORT
+    shared_ptr<const SearchIndex>   GetSearchIndex(bool persist=true);
+#endif
+    
+    /**
+     Returns a read-only snapshot of the package's manifest, spine and core metadata.
+     
+     The snapshot is taken on the first call, and later calls return the same one.
+     Unlike the package itself, it can be read from any number of threads without
+     locking; a server should take it once, after opening the package, and hand it
+     to each request thread.
+     @see PackageSnapshot
+     */
+    EPUB3_EXPORT
+    shared_ptr<const PackageSnapshot>   GetSnapshot();
+    
     /// @}
     
 protected:
     ///
     /// Extracts information from the OPF XML document.
     virtual bool            Unpack();
+#if EPUB_USE(LIBXML2)
+    /**
+     Extracts information from the OPF document in a single pass over a stream
+     reader positioned before its root element, without building a DOM.
+     @result `false` if the package is invalid or the reader failed; in the latter
+     case the caller should reload the package with Unpack().
+     */
+    bool                    UnpackStream(XMLStreamReader& reader);
+#endif
+    ///
+    /// Checks the manifest's fallback chains for circular references.
+    void                    CheckFallbackChains();
+    ///
+    /// Schedules the navigation documents with the container's DocumentPreloader, if any.
+    void                    PreloadReferencedDocuments();
+    ///
+    /// Validates a parsed spine item and links it after `cur`, which is updated.
+    void                    AppendSpineItem(shared_ptr<SpineItem> next, shared_ptr<SpineItem>& cur);
+    ///
+    /// Applies a `<meta refines="...">` element to the item it refines.
+    void                    ApplyRefinement(shared_ptr<xml::Node> node);
+    ///
+    /// Installs the handler for a `<bindings>` `<mediaType>` element; throws `false` if it is invalid.
+    void                    InstallMediaTypeBinding(const string& mediaType, const string& handlerID);
+    ///
+    /// Loads the navigation tables and media information once the OPF has been read.
+    bool                    FinishUnpacking(bool isEPUB3, const std::vector<string>& tocNames);
+    ///
+    /// Forgets everything read from the OPF, before reloading it.
+    void                    ResetUnpackedState();
     ///
     /// Used to handle the `prefix` attribute of the OPF `<package>` element.
     void                    InstallPrefixesFromAttributeValue(const string& attrValue);
@@ -916,11 +1026,20 @@ public:
     
 protected:
     LoadEventHandler        _loadEventHandler;      ///< The current handler for load events.
+    string                  _version;               ///< The package's `version` attribute, when loaded without a DOM.
+    string                  _packageID;             ///< The package's unique identifier, when loaded without a DOM.
     MediaSupportList        _mediaSupport;          ///< A list of media types with their support details.
     
     void                    InitMediaSupport();
     
     FilterChainPtr          _filterChain;           ///< The filter chain for this package.
+    std::weak_ptr<ResourcePrefetcher>   _prefetcher;    ///< Serves prefetched filtered content, if attached.
+    
+    std::mutex                          _searchIndexLock;
+    shared_ptr<const SearchIndex>       _searchIndex;   ///< Built or loaded on first use.
+    
+    std::mutex                          _snapshotLock;
+    shared_ptr<const PackageSnapshot>   _snapshot;      ///< Taken on first use.
 };
 
 EPUB3_END_NAMESPACE
@@ -0,0 +1,181 @@
+//
+//  package_snapshot.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "package_snapshot.h"
+#include "package.h"
+#include "spine.h"
+#include <google-url/url_canon.h>
+#include <google-url/url_util.h>
+
+EPUB3_BEGIN_NAMESPACE
+
+CONSTEXPR size_t PackageSnapshot::npos;
+
+// as PackageBase::ManifestItemAtRelativePath() compares them
+static string DecodedPath(const string& path)
+{
+    url_canon::RawCanonOutputW<256> output;
+    url_util::DecodeURLEscapeSequences(path.c_str(), static_cast<int>(path.utf8_size()), &output);
+    return string(output.data(), output.length());
+}
+
+static size_t Lookup(const std::unordered_map<std::string, size_t>& table, const string& key)
+{
+    auto found = table.find(key.stl_str());
+    return (found == table.end() ? PackageSnapshot::npos : found->second);
+}
+
+// as Package::MediaOverlays_DurationItem() finds it
+static string MediaOverlayDuration(const ManifestItemPtr& item, const IRI& iri)
+{
+    PropertyPtr prop = item->PropertyMatching(iri, false);
+    if ( !bool(prop) )
+    {
+        ManifestItemPtr mediaOverlay = item->MediaOverlay();
+        if ( bool(mediaOverlay) )
+            prop = mediaOverlay->PropertyMatching(iri, false);
+    }
+    return (bool(prop) ? prop->Value() : string::EmptyString);
+}
+
+PackageSnapshot::PackageSnapshot(ConstPackagePtr package) : _items(), _spine(), _itemsByID(), _itemsByPath(), _itemsByDecodedPath(), _spineByIDRef(),
+    _spineCFIIndex(package->SpineCFIIndex()), _basePath(package->BasePath()), _uniqueID(package->UniqueID()), _packageID(package->PackageID()),
+    _version(package->Version()), _title(package->Title()), _authors(package->Authors()), _language(package->Language()),
+    _modificationDate(package->ModificationDate()), _pageProgression(package->PageProgressionDirection()),
+    _mediaOverlaysDuration(package->MediaOverlays_DurationTotal())
+{
+    const IRI durationIRI = package->MakePropertyIRI("duration", "media");
+    const ManifestTable& manifest = package->Manifest();
+    _items.reserve(manifest.size());
+    _itemsByID.reserve(manifest.size());
+    _itemsByPath.reserve(manifest.size());
+    _itemsByDecodedPath.reserve(manifest.size());
+
+    for ( auto& entry : manifest )
+    {
+        const ManifestItemPtr& source = entry.second;
+
+        // resolving this now means nothing in the live item is filled in lazily later
+        const ResourceDescriptor& resource = source->Descriptor();
+
+        Item item;
+        item.identifier = source->Identifier();
+        item.href = source->Href();
+        item.absolutePath = resource.Path();
+        item.mediaType = source->MediaType();
+        for ( ItemProperties::value_type bit = 1; bit <= ItemProperties::AllPropertiesMask; bit <<= 1 )
+        {
+            if ( source->HasProperty(bit) )
+                item.properties |= bit;
+        }
+        item.fallback = npos;
+        item.mediaOverlay = npos;
+        item.spineIndex = npos;
+        item.mediaOverlayDuration = MediaOverlayDuration(source, durationIRI);
+        item.archiveIndex = resource.ArchiveIndex();
+        item.compressed = resource.IsCompressed();
+        item.compressedSize = resource.CompressedSize();
+        item.uncompressedSize = resource.UncompressedSize();
+        item.encryption = resource.Encryption();
+        item.manifestItem = source;
+
+        size_t idx = _items.size();
+        _itemsByID.emplace(item.identifier.stl_str(), idx);
+        _itemsByPath.emplace(item.absolutePath.stl_str(), idx);
+        _itemsByDecodedPath.emplace(DecodedPath(item.absolutePath).stl_str(), idx);
+        _items.push_back(std::move(item));
+    }
+
+    // links between items can only be made once they all have indices
+    for ( auto& item : _items )
+    {
+        if ( !item.manifestItem->FallbackID().empty() )
+            item.fallback = Lookup(_itemsByID, item.manifestItem->FallbackID());
+        if ( !item.manifestItem->MediaOverlayID().empty() )
+            item.mediaOverlay = Lookup(_itemsByID, item.manifestItem->MediaOverlayID());
+    }
+
+    for ( SpineItemPtr source = package->FirstSpineItem(); bool(source); source = source->Next() )
+    {
+        SpineEntry entry;
+        entry.identifier = source->Identifier();
+        entry.idref = source->Idref();
+        entry.title = source->Title();
+        entry.item = Lookup(_itemsByID, entry.idref);
+        entry.linear = source->Linear();
+        entry.spread = source->Spread();
+        entry.nextStep = npos;
+        entry.priorStep = npos;
+        entry.cfi = package->CFIForSpineItem(source);
+
+        size_t idx = _spine.size();
+        _spineByIDRef.emplace(entry.idref.stl_str(), idx);
+        if ( entry.item != npos && _items[entry.item].spineIndex == npos )
+            _items[entry.item].spineIndex = idx;
+        _spine.push_back(std::move(entry));
+    }
+
+    // NextStep() and PriorStep() skip non-linear items
+    size_t priorLinear = npos;
+    for ( size_t i = 0; i < _spine.size(); i++ )
+    {
+        _spine[i].priorStep = priorLinear;
+        if ( _spine[i].linear )
+            priorLinear = i;
+    }
+    size_t nextLinear = npos;
+    for ( size_t i = _spine.size(); i-- > 0; )
+    {
+        _spine[i].nextStep = nextLinear;
+        if ( _spine[i].linear )
+            nextLinear = i;
+    }
+}
+ConstPackageSnapshotPtr PackageSnapshot::Create(ConstPackagePtr package)
+{
+    if ( !bool(package) )
+        return nullptr;
+    return ConstPackageSnapshotPtr(new PackageSnapshot(package));
+}
+size_t PackageSnapshot::IndexOfItemWithID(const string& ident) const
+{
+    return Lookup(_itemsByID, ident);
+}
+const PackageSnapshot::Item* PackageSnapshot::ItemAtRelativePath(const string& path) const
+{
+    if ( path.empty() )
+        return nullptr;
+
+    string absPath = _basePath + (path[0] == '/' ? path.substr(1) : path);
+    size_t idx = Lookup(_itemsByPath, absPath);
+    if ( idx != npos )
+        return &_items[idx];
+
+    // percent-escapes may differ between the manifest and the referring document
+    string decoded = DecodedPath(path);
+    if ( decoded.empty() )
+        return nullptr;
+    return ItemAt(Lookup(_itemsByDecodedPath, _basePath + (decoded[0] == '/' ? decoded.substr(1) : decoded)));
+}
+size_t PackageSnapshot::IndexOfSpineItemWithIDRef(const string& idref) const
+{
+    return Lookup(_spineByIDRef, idref);
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,227 @@
+//
+//  package_snapshot.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__package_snapshot__
+#define __ePub3__package_snapshot__
+
+#include <ePub3/epub3.h>
+#include <ePub3/cfi.h>
+#include <ePub3/manifest.h>
+#include <ePub3/property.h>
+#include <ePub3/utilities/utfstring.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+class PackageSnapshot;
+typedef std::shared_ptr<const PackageSnapshot>  ConstPackageSnapshotPtr;
+
+/**
+ A frozen, read-only copy of a package's manifest, spine and core metadata.
+
+ The live model links Package, ManifestItem and SpineItem objects through shared and
+ weak pointers, and fills some of its state in lazily, so reading it from several
+ threads at once needs outside synchronization. A snapshot instead copies everything
+ a request needs into flat arrays when it's created: manifest items and spine entries
+ refer to one another by index, and lookups by identifier or path go through hash
+ tables built at the same time.
+
+ Nothing in a snapshot changes once Create() returns, and every method is `const`,
+ so any number of threads may read the same snapshot without locking. A snapshot
+ does not follow later changes to its package; take a new one if the package is
+ modified.
+
+ Each item keeps a pointer to its live ManifestItem, which may be passed to the
+ package's stream APIs (e.g. Package::GetFilterChainByteStream()); the location of
+ its data is resolved before the snapshot is built, so doing so is also safe.
+
+ @see Package::GetSnapshot()
+ @ingroup epub-model
+ */
+class PackageSnapshot
+{
+public:
+    ///
+    /// The value of an index which refers to nothing.
+    static CONSTEXPR size_t npos = size_t(-1);
+
+    ///
+    /// A manifest item, as it was when the snapshot was taken.
+    struct Item
+    {
+        string              identifier;         ///< The item's `id`.
+        string              href;               ///< The item's `href`, relative to the package document.
+        string              absolutePath;       ///< The item's path within the container.
+        string              mediaType;          ///< The item's media type.
+        ItemProperties      properties;         ///< The item's EPUB 3 properties.
+        size_t              fallback;           ///< The index of the item's fallback, or `npos`.
+        size_t              mediaOverlay;       ///< The index of the item's media overlay, or `npos`.
+        size_t              spineIndex;         ///< The index of the first spine entry referring to the item, or `npos`.
+        string              mediaOverlayDuration;   ///< The item's `media:duration`, or that of its overlay.
+
+        int                 archiveIndex;       ///< The item's index within the container's archive, or `-1`.
+        bool                compressed;         ///< Whether the item's data is compressed within the archive.
+        size_t              compressedSize;     ///< The number of bytes the item occupies within the archive.
+        size_t              uncompressedSize;   ///< The size of the item's data once extracted.
+        EncryptionInfoPtr   encryption;         ///< The item's encryption details, or `nullptr`.
+
+        ManifestItemPtr     manifestItem;       ///< The live item, for use with the package's stream APIs.
+    };
+    typedef std::vector<Item>   ItemList;
+
+    ///
+    /// A spine `itemref`, as it was when the snapshot was taken.
+    struct SpineEntry
+    {
+        string              identifier;         ///< The itemref's `id`, if any.
+        string              idref;              ///< The identifier of the item referenced.
+        string              title;              ///< The entry's title, from the table of contents.
+        size_t              item;               ///< The index of the item referenced, or `npos` if it's missing.
+        bool                linear;             ///< Whether the entry is part of the linear reading order.
+        PageSpread          spread;             ///< The page-spread property of the entry.
+        size_t              nextStep;           ///< The index of the next linear entry, or `npos`.
+        size_t              priorStep;          ///< The index of the previous linear entry, or `npos`.
+        CFI                 cfi;                ///< The entry's CFI, as from Package::CFIForSpineItem().
+    };
+    typedef std::vector<SpineEntry> SpineList;
+
+private:
+                            PackageSnapshot()                               _DELETED_;
+                            PackageSnapshot(const PackageSnapshot&)         _DELETED_;
+    PackageSnapshot&        operator=(const PackageSnapshot&)               _DELETED_;
+
+    explicit                PackageSnapshot(ConstPackagePtr package);
+
+public:
+                            ~PackageSnapshot()                              {}
+
+    /**
+     Takes a snapshot of an opened package.
+
+     This reads every manifest item and spine entry once, on the calling thread;
+     nothing else should modify the package while it runs.
+     @param package The package to copy.
+     @result The snapshot, or `nullptr` if `package` is `nullptr`.
+     */
+    EPUB3_EXPORT
+    static ConstPackageSnapshotPtr  Create(ConstPackagePtr package);
+
+    /// @{
+    /// @name Manifest
+
+    ///
+    /// All manifest items, ordered by identifier.
+    const ItemList&         Items()                                 const   { return _items; }
+
+    ///
+    /// Returns the index of the item with a given identifier, or `npos`.
+    EPUB3_EXPORT
+    size_t                  IndexOfItemWithID(const string& ident)  const;
+
+    ///
+    /// Returns the item with a given identifier, or `nullptr`.
+    const Item*             ItemWithID(const string& ident)         const   { return ItemAt(IndexOfItemWithID(ident)); }
+
+    /**
+     Returns the item at a path relative to the package document, or `nullptr`.
+
+     As with PackageBase::ManifestItemAtRelativePath(), a path which doesn't match
+     exactly is compared again with any percent-escapes in both paths decoded.
+     */
+    EPUB3_EXPORT
+    const Item*             ItemAtRelativePath(const string& path)  const;
+
+    ///
+    /// Returns the item at an index, or `nullptr` if it is out of range (e.g. `npos`).
+    const Item*             ItemAt(size_t idx)                      const   { return (idx < _items.size() ? &_items[idx] : nullptr); }
+
+    /// @}
+
+    /// @{
+    /// @name Spine
+
+    ///
+    /// All spine entries, in reading order.
+    const SpineList&        Spine()                                 const   { return _spine; }
+
+    ///
+    /// Returns the index of the first spine entry referring to a given item, or `npos`.
+    EPUB3_EXPORT
+    size_t                  IndexOfSpineItemWithIDRef(const string& idref)  const;
+
+    ///
+    /// Returns the spine entry at an index, or `nullptr` if it is out of range.
+    const SpineEntry*       SpineEntryAt(size_t idx)                const   { return (idx < _spine.size() ? &_spine[idx] : nullptr); }
+
+    ///
+    /// Returns the item referenced by a spine entry, or `nullptr` if it's missing.
+    const Item*             ItemForSpineEntry(const SpineEntry& entry)  const   { return ItemAt(entry.item); }
+
+    ///
+    /// Returns the CFI step of the spine element within the package document.
+    uint32_t                SpineCFIIndex()                         const   { return _spineCFIIndex; }
+
+    /// @}
+
+    /// @{
+    /// @name Metadata
+
+    const string&           BasePath()                              const   { return _basePath; }
+    const string&           UniqueID()                              const   { return _uniqueID; }
+    const string&           PackageID()                             const   { return _packageID; }
+    const string&           Version()                               const   { return _version; }
+    const string&           Title()                                 const   { return _title; }
+    const string&           Authors()                               const   { return _authors; }
+    const string&           Language()                              const   { return _language; }
+    const string&           ModificationDate()                      const   { return _modificationDate; }
+    PageProgression         PageProgressionDirection()              const   { return _pageProgression; }
+    const string&           MediaOverlaysDurationTotal()            const   { return _mediaOverlaysDuration; }
+
+    /// @}
+
+private:
+    typedef std::unordered_map<std::string, size_t> IndexTable;
+
+    ItemList                _items;
+    SpineList               _spine;
+
+    IndexTable              _itemsByID;
+    IndexTable              _itemsByPath;           ///< Keyed by absolute path.
+    IndexTable              _itemsByDecodedPath;    ///< Keyed by absolute path with percent-escapes decoded.
+    IndexTable              _spineByIDRef;          ///< The first entry referring to each item.
+
+    uint32_t                _spineCFIIndex;
+    string                  _basePath;
+    string                  _uniqueID;
+    string                  _packageID;
+    string                  _version;
+    string                  _title;
+    string                  _authors;
+    string                  _language;
+    string                  _modificationDate;
+    PageProgression         _pageProgression;
+    string                  _mediaOverlaysDuration;
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__package_snapshot__) */
@@ -21,6 +21,7 @@
 #include <ePub3/property.h>
 #include <ePub3/utilities/iri.h>
 #include <ePub3/property_holder.h>
+#include <ePub3/xml_stream_reader.h>
 
 EPUB3_BEGIN_NAMESPACE
 #if EPUB_USE(LIBXML2)
@@ -252,6 +253,47 @@ bool Property::ParseMetaElement(shared_ptr<xml::Node> node)
     
     return false;
 }
+#if EPUB_USE(LIBXML2)
+bool Property::ParseMetaElement(XMLStreamReader& reader)
+{
+    if ( !reader.IsStartElement() )
+        return false;
+    
+    const string& nsURI = reader.NamespaceURI();
+    if ( nsURI == string(DCMES_uri) )
+    {
+        auto found = NameToIDMap.find(reader.Name());
+        if ( found == NameToIDMap.end() )
+            return false;
+        
+        _type = found->second;
+        _identifier = IRI(string(DCMES_uri) + reader.Name());
+    }
+    else if ( reader.Name() == string(MetaTagName) )
+    {
+        string property = reader.Attribute("property");
+        if ( property.empty() )
+            return false;
+        
+        _type = DCType::Custom;
+        _identifier = OwnedBy::Owner()->PropertyIRIFromString(property);
+    }
+    else if ( !nsURI.empty() )
+    {
+        _type = DCType::Custom;
+        _identifier = IRI(nsURI + reader.Name());
+    }
+    else
+    {
+        return false;
+    }
+    
+    _value = reader.Content();
+    _language = reader.Language();
+    SetXMLIdentifier(reader.Attribute("id"));
+    return true;
+}
+#endif
 void Property::SetDCType(DCType type)
 {
     _type = type;
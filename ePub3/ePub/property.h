@@ -37,6 +37,7 @@ EPUB3_BEGIN_NAMESPACE
 
 class Package;
 class PropertyHolder;
+class XMLStreamReader;
 
 class Property;
 typedef shared_ptr<Property>        PropertyPtr;
@@ -171,6 +172,12 @@ public:
     
     EPUB3_EXPORT
     bool                    ParseMetaElement(shared_ptr<xml::Node> node);
+#if EPUB_USE(LIBXML2)
+    ///
+    /// Reads the property from the metadata start tag on which a stream reader is positioned.
+    EPUB3_EXPORT
+    bool                    ParseMetaElement(XMLStreamReader& reader);
+#endif
     
     
     /// @{
@@ -0,0 +1,210 @@
+//
+//  resource_cache.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "resource_cache.h"
+#include "filter.h"
+#include "manifest.h"
+#include "package.h"
+#include "container.h"
+#include <functional>
+
+EPUB3_BEGIN_NAMESPACE
+
+CONSTEXPR size_t ResourceCache::DefaultByteLimit;
+CONSTEXPR size_t ResourceCache::DefaultShardCount;
+
+static std::mutex                       gSharedCacheLock;
+static std::shared_ptr<ResourceCache>   gSharedCache;
+
+ResourceCache::ResourceCache(size_t byteLimit, size_t shardCount)
+  : _shards(), _shardCount(shardCount == 0 ? 1 : shardCount), _byteLimit(byteLimit), _shardLimit(0)
+{
+    _shards.reset(new Shard[_shardCount]);
+    _shardLimit = _byteLimit / _shardCount;
+}
+ResourceCache::~ResourceCache()
+{
+}
+std::string ResourceCache::KeyFor(const string& containerIdentity, const string& itemPath, const string& chainIdentity)
+{
+    // NUL can't appear in a path or identifier, so it can't produce ambiguous keys
+    std::string key(containerIdentity.stl_str());
+    key += '\0';
+    key += itemPath.stl_str();
+    key += '\0';
+    key += chainIdentity.stl_str();
+    return key;
+}
+std::string ResourceCache::KeyFor(ConstManifestItemPtr item, const std::vector<ContentFilterPtr>& filters)
+{
+    if ( !bool(item) )
+        return std::string();
+
+    auto package = item->GetPackage();
+    if ( !bool(package) )
+        return std::string();
+
+    auto container = package->GetContainer();
+    if ( !bool(container) )
+        return std::string();
+
+    string chain;
+    for ( auto& filter : filters )
+    {
+        string identity = filter->CacheIdentityForItem(item);
+        if ( identity.empty() )
+            return std::string();
+
+        chain += identity;
+        chain += ";";
+    }
+
+    // the unique identifier includes the modification date, so an updated file at the same path doesn't match
+    return KeyFor(_Str(container->Path(), "#", package->UniqueID()), item->AbsolutePath(), chain);
+}
+ResourceCache::BufferPtr ResourceCache::Lookup(const std::string& key)
+{
+    Shard& shard = ShardFor(key);
+    std::lock_guard<std::mutex> _(shard.lock);
+
+    auto pos = shard.index.find(key);
+    if ( pos == shard.index.end() )
+    {
+        shard.misses++;
+        return nullptr;
+    }
+
+    shard.hits++;
+    pos->second->referenced = true;
+    return pos->second->data;
+}
+bool ResourceCache::Insert(const std::string& key, std::shared_ptr<ByteBuffer> data)
+{
+    if ( !bool(data) )
+        return false;
+
+    data->SetUsesSecureErasure();
+
+    size_t size = data->GetBufferSize();
+    Shard& shard = ShardFor(key);
+    std::lock_guard<std::mutex> _(shard.lock);
+
+    if ( size > _shardLimit )
+    {
+        shard.rejections++;
+        return false;
+    }
+
+    auto pos = shard.index.find(key);
+    if ( pos != shard.index.end() )
+        Erase(shard, pos->second);
+
+    EvictToFit(shard, size);
+
+    // new entries go behind the hand, so they're the last to be considered for eviction
+    Entry entry = { key, data, false };
+    auto inserted = shard.ring.insert(shard.hand, std::move(entry));
+    shard.index[key] = inserted;
+    shard.bytes += size;
+    shard.insertions++;
+    return true;
+}
+void ResourceCache::Remove(const std::string& key)
+{
+    Shard& shard = ShardFor(key);
+    std::lock_guard<std::mutex> _(shard.lock);
+
+    auto pos = shard.index.find(key);
+    if ( pos != shard.index.end() )
+        Erase(shard, pos->second);
+}
+void ResourceCache::Clear()
+{
+    for ( size_t i = 0; i < _shardCount; i++ )
+    {
+        Shard& shard = _shards[i];
+        std::lock_guard<std::mutex> _(shard.lock);
+        shard.index.clear();
+        shard.ring.clear();
+        shard.hand = shard.ring.end();
+        shard.bytes = 0;
+    }
+}
+ResourceCache::Statistics ResourceCache::GetStatistics() const
+{
+    Statistics stats = {};
+    for ( size_t i = 0; i < _shardCount; i++ )
+    {
+        Shard& shard = _shards[i];
+        std::lock_guard<std::mutex> _(shard.lock);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.insertions += shard.insertions;
+        stats.evictions += shard.evictions;
+        stats.rejections += shard.rejections;
+        stats.entries += shard.index.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+std::shared_ptr<ResourceCache> ResourceCache::Shared()
+{
+    std::lock_guard<std::mutex> _(gSharedCacheLock);
+    return gSharedCache;
+}
+void ResourceCache::SetShared(std::shared_ptr<ResourceCache> cache)
+{
+    std::lock_guard<std::mutex> _(gSharedCacheLock);
+    gSharedCache = cache;
+}
+ResourceCache::Shard& ResourceCache::ShardFor(const std::string& key) const
+{
+    return _shards[std::hash<std::string>()(key) % _shardCount];
+}
+void ResourceCache::EvictToFit(Shard& shard, size_t incoming)
+{
+    while ( !shard.ring.empty() && shard.bytes + incoming > _shardLimit )
+    {
+        if ( shard.hand == shard.ring.end() )
+            shard.hand = shard.ring.begin();
+
+        if ( shard.hand->referenced )
+        {
+            // second chance
+            shard.hand->referenced = false;
+            ++shard.hand;
+            continue;
+        }
+
+        Erase(shard, shard.hand);
+        shard.evictions++;
+    }
+}
+void ResourceCache::Erase(Shard& shard, Ring::iterator pos)
+{
+    shard.bytes -= pos->data->GetBufferSize();
+    shard.index.erase(pos->key);
+
+    bool atHand = (shard.hand == pos);
+    Ring::iterator next = shard.ring.erase(pos);
+    if ( atHand )
+        shard.hand = next;
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,225 @@
+//
+//  resource_cache.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__resource_cache__
+#define __ePub3__resource_cache__
+
+#include <ePub3/epub3.h>
+#include <ePub3/utilities/byte_buffer.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+class ContentFilter;
+typedef std::shared_ptr<ContentFilter> ContentFilterPtr;
+
+/**
+ A process-wide, byte-budgeted cache of filtered resource content.
+
+ Filtering a resource (decrypting it, for instance) is expensive, and without a
+ shared cache every FilterChainByteStream repeats that work and holds its own copy
+ of the result. When a cache is installed with SetShared(), each
+ FilterChainByteStream looks up the filtered content of its resource before doing
+ any work, and publishes its result afterwards. Entries are keyed by the identity
+ of the container, the manifest item, and the filters applied to it (see
+ ContentFilter::CacheIdentityForItem()), so readers of the same publication share
+ one copy, even when they opened it independently. Decrypted content is shared
+ only between readers using the same key; see AESCBCDecryptor::KeyIdentityFn.
+
+ Lookups don't wait for content which is still being filtered: if two streams miss
+ on the same resource at once, each filters it in full and the second insertion
+ replaces the first. Only later readers benefit.
+
+ Cached content is handed out as reference-counted, read-only buffers: streams read
+ directly from the cached bytes without copying them, and an entry evicted while
+ still being read stays alive until its last reader is finished with it. All
+ buffers use secure erasure, so their content is wiped when they are freed.
+
+ The cache is split into shards, each with its own lock and an equal share of the
+ byte budget, to keep contention low when many threads read at once. Each shard
+ uses the CLOCK algorithm for eviction: a hit only sets an entry's reference bit,
+ and a sweeping hand evicts the first entry found without one, clearing bits as it
+ goes. This approximates LRU without reordering anything on a hit, and an entry
+ which is read only once is evicted ahead of those which are read repeatedly.
+ @ingroup epub-model
+ */
+class ResourceCache
+{
+public:
+    typedef std::shared_ptr<const ByteBuffer>   BufferPtr;
+
+    ///
+    /// The default upper limit on the number of bytes held by a cache.
+    static CONSTEXPR size_t DefaultByteLimit    = 64 * 1024 * 1024;
+    ///
+    /// The default number of independently-locked shards.
+    static CONSTEXPR size_t DefaultShardCount   = 8;
+
+    ///
+    /// Usage counts for a cache.
+    struct Statistics
+    {
+        size_t      hits;           ///< Lookups which found an entry.
+        size_t      misses;         ///< Lookups which found nothing.
+        size_t      insertions;     ///< Entries added.
+        size_t      evictions;      ///< Entries evicted to make room for others.
+        size_t      rejections;     ///< Insertions refused because the content was too large.
+        size_t      entries;        ///< Entries currently cached.
+        size_t      bytes;          ///< Bytes currently cached.
+
+        ///
+        /// The fraction of lookups which found an entry.
+        double      HitRate()                   const
+            { return (hits + misses == 0 ? 0.0 : double(hits) / double(hits + misses)); }
+    };
+
+private:
+                    ResourceCache(const ResourceCache&)     _DELETED_;
+    ResourceCache&  operator=(const ResourceCache&)         _DELETED_;
+
+public:
+    /**
+     Creates a new cache.
+     @param byteLimit The maximum number of bytes to hold across all shards.
+     @param shardCount The number of shards. Each shard holds at most
+     `byteLimit / shardCount` bytes, which is therefore the largest resource which
+     can be cached.
+     */
+    EPUB3_EXPORT    ResourceCache(size_t byteLimit = DefaultByteLimit, size_t shardCount = DefaultShardCount);
+    virtual         ~ResourceCache();
+
+    /**
+     Builds a cache key.
+     @param containerIdentity Identifies the container, e.g. its path and the
+     package's unique identifier.
+     @param itemPath The container-relative path of the resource.
+     @param chainIdentity Identifies the filters applied to the resource.
+     */
+    EPUB3_EXPORT
+    static std::string  KeyFor(const string& containerIdentity, const string& itemPath, const string& chainIdentity);
+
+    /**
+     Builds the cache key for a manifest item read through a set of filters.
+     @result A key, or an empty string if the item's content must not be cached
+     (because the item has no container or a filter opts out of caching).
+     */
+    EPUB3_EXPORT
+    static std::string  KeyFor(ConstManifestItemPtr item, const std::vector<ContentFilterPtr>& filters);
+
+    ///
+    /// Returns the content for a key, or `nullptr`.
+    EPUB3_EXPORT
+    BufferPtr       Lookup(const std::string& key);
+
+    /**
+     Adds or replaces the content for a key.
+
+     The buffer is switched to secure erasure, and must not be modified once
+     inserted.
+     @param key The cache key, from KeyFor().
+     @param data The filtered content.
+     @result `false` if the content is too large to cache, in which case nothing is
+     inserted.
+     */
+    EPUB3_EXPORT
+    bool            Insert(const std::string& key, std::shared_ptr<ByteBuffer> data);
+
+    ///
+    /// Removes the content for a key, if present.
+    EPUB3_EXPORT
+    void            Remove(const std::string& key);
+
+    ///
+    /// Removes all entries.
+    EPUB3_EXPORT
+    void            Clear();
+
+    ///
+    /// The maximum number of bytes held by the cache.
+    size_t          ByteLimit()                 const   { return _byteLimit; }
+
+    ///
+    /// The largest resource which can be cached.
+    size_t          MaximumEntrySize()          const   { return _shardLimit; }
+
+    ///
+    /// Returns the cache's current usage counts, totalled across all shards.
+    EPUB3_EXPORT
+    Statistics      GetStatistics()             const;
+
+    ///
+    /// The cache used by all filter chains, or `nullptr` if none is installed (the default).
+    EPUB3_EXPORT
+    static std::shared_ptr<ResourceCache>   Shared();
+
+    ///
+    /// Installs (or, with `nullptr`, removes) the cache used by all filter chains.
+    EPUB3_EXPORT
+    static void     SetShared(std::shared_ptr<ResourceCache> cache);
+
+protected:
+    struct Entry
+    {
+        std::string         key;
+        BufferPtr           data;
+        bool                referenced;
+    };
+
+    typedef std::list<Entry>    Ring;
+
+    struct Shard
+    {
+        std::mutex          lock;
+        Ring                ring;
+        Ring::iterator      hand;               ///< The next entry considered for eviction.
+        std::unordered_map<std::string, Ring::iterator> index;
+        size_t              bytes;
+        size_t              hits;
+        size_t              misses;
+        size_t              insertions;
+        size_t              evictions;
+        size_t              rejections;
+
+        Shard() : lock(), ring(), hand(ring.end()), index(), bytes(0), hits(0), misses(0), insertions(0), evictions(0), rejections(0) {}
+    };
+
+    std::unique_ptr<Shard[]>    _shards;
+    size_t                      _shardCount;
+    size_t                      _byteLimit;
+    size_t                      _shardLimit;
+
+    Shard&          ShardFor(const std::string& key)    const;
+
+    ///
+    /// Evicts entries until `incoming` more bytes will fit. The shard's lock must be held.
+    void            EvictToFit(Shard& shard, size_t incoming);
+    ///
+    /// Removes an entry, keeping the clock hand valid. The shard's lock must be held.
+    void            Erase(Shard& shard, Ring::iterator pos);
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__resource_cache__) */
@@ -0,0 +1,616 @@
+//
+//  resource_prefetcher.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "resource_prefetcher.h"
+#include "package.h"
+#include "container.h"
+#include "archive.h"
+#include <ePub3/utilities/buffer_pool.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <system_error>
+
+EPUB3_BEGIN_NAMESPACE
+
+CONSTEXPR size_t PrefetchCache::DefaultByteLimit;
+
+// bytes read from the filter chain at a time
+static const size_t kDecodeChunkSize = 16 * 1024;
+
+static inline bool IsSpace(char c)
+{
+    return isspace(static_cast<unsigned char>(c)) != 0;
+}
+static bool StartsWithNoCase(const char* p, const char* end, const char* token)
+{
+    for ( ; *token != '\0'; p++, token++ )
+    {
+        if ( p == end || tolower(static_cast<unsigned char>(*p)) != *token )
+            return false;
+    }
+    return true;
+}
+
+#if 0
+#pragma mark - PrefetchCache
+#endif
+
+PrefetchCache::PrefetchCache(size_t byteLimit) : _lock(), _entries(), _recency(), _byteLimit(byteLimit), _bytes(0), _insertions(0), _evictions(0)
+{
+}
+PrefetchCache::BufferPtr PrefetchCache::Get(const string& path)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    auto pos = _entries.find(path);
+    if ( pos == _entries.end() )
+        return nullptr;
+
+    _recency.splice(_recency.begin(), _recency, pos->second.position);
+    return pos->second.data;
+}
+bool PrefetchCache::Contains(const string& path) const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    return _entries.find(path) != _entries.end();
+}
+bool PrefetchCache::Insert(const string& path, BufferPtr data)
+{
+    if ( !bool(data) )
+        return false;
+
+    size_t size = data->GetBufferSize();
+    if ( size > _byteLimit )
+        return false;
+
+    std::lock_guard<std::mutex> _(_lock);
+    auto pos = _entries.find(path);
+    if ( pos != _entries.end() )
+        Erase(pos);
+
+    EvictToFit(size);
+
+    _recency.push_front(path);
+    Entry& entry = _entries[path];
+    entry.data = data;
+    entry.position = _recency.begin();
+
+    _bytes += size;
+    _insertions++;
+    return true;
+}
+void PrefetchCache::Remove(const string& path)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    auto pos = _entries.find(path);
+    if ( pos != _entries.end() )
+        Erase(pos);
+}
+void PrefetchCache::Clear()
+{
+    std::lock_guard<std::mutex> _(_lock);
+    _entries.clear();
+    _recency.clear();
+    _bytes = 0;
+}
+PrefetchCache::Statistics PrefetchCache::GetStatistics() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    Statistics stats;
+    stats.entries = _entries.size();
+    stats.bytes = _bytes;
+    stats.insertions = _insertions;
+    stats.evictions = _evictions;
+    return stats;
+}
+void PrefetchCache::EvictToFit(size_t incoming)
+{
+    while ( !_recency.empty() && _bytes + incoming > _byteLimit )
+    {
+        Erase(_entries.find(_recency.back()));
+        _evictions++;
+    }
+}
+void PrefetchCache::Erase(std::map<string, Entry>::iterator pos)
+{
+    _bytes -= pos->second.data->GetBufferSize();
+    _recency.erase(pos->second.position);
+    _entries.erase(pos);
+}
+
+#if 0
+#pragma mark - PrefetchedByteStream
+#endif
+
+ByteStream::size_type PrefetchedByteStream::BytesAvailable() _NOEXCEPT
+{
+    if ( !bool(_data) )
+        return 0;
+    return _data->GetBufferSize() - _position;
+}
+ByteStream::size_type PrefetchedByteStream::ReadBytes(void* buf, size_type len)
+{
+    size_type toMove = std::min(len, BytesAvailable());
+    if ( toMove == 0 )
+        return 0;
+
+    ::memcpy(buf, _data->GetBytes() + _position, toMove);
+    _position += toMove;
+    return toMove;
+}
+ByteStream::size_type PrefetchedByteStream::WriteBytes(const void* buf, size_type len)
+{
+    throw std::system_error(std::make_error_code(std::errc::operation_not_supported));
+}
+bool PrefetchedByteStream::AtEnd() const _NOEXCEPT
+{
+    return !bool(_data) || _position >= _data->GetBufferSize();
+}
+
+#if 0
+#pragma mark - ResourcePrefetcher
+#endif
+
+ResourcePrefetcher::ResourcePrefetcher(PackagePtr package, const Options& options)
+  : _package(package), _options(options), _cache(options.byteLimit), _lock(), _pendingChanged(), _idle(),
+    _wanted(), _scheduled(), _pending(), _idleArchives(), _outstanding(0), _shuttingDown(false),
+    _hits(0), _misses(0), _bypassed(0), _prefetched(0), _hitTime(0), _missTime(0),
+    _pool(new thread_pool(options.threadCount))
+{
+    if ( !bool(_package) )
+        throw std::invalid_argument("ResourcePrefetcher requires a package");
+}
+ResourcePrefetcher::~ResourcePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        _shuttingDown = true;
+        _wanted.clear();
+    }
+    _pendingChanged.notify_all();
+
+    // joins the workers: running jobs see _shuttingDown and finish early, queued ones are dropped
+    _pool.reset();
+}
+void ResourcePrefetcher::PrefetchAround(SpineItemPtr current)
+{
+    if ( !bool(current) )
+        return;
+
+    // nearest items first, alternating forwards and backwards
+    std::vector<ManifestItemPtr> window;
+    window.push_back(current->ManifestItem());
+
+    SpineItemPtr next = current, prior = current;
+    for ( size_t i = 0; i < _options.neighbourCount; i++ )
+    {
+        if ( bool(next) && bool(next = next->NextStep()) )
+            window.push_back(next->ManifestItem());
+        if ( bool(prior) && bool(prior = prior->PriorStep()) )
+            window.push_back(prior->ManifestItem());
+    }
+
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( _shuttingDown )
+            return;
+
+        _wanted.clear();
+        for ( auto& item : window )
+        {
+            if ( bool(item) )
+                _wanted.insert(item->AbsolutePath());
+        }
+    }
+
+    for ( auto& item : window )
+    {
+        if ( bool(item) )
+            Schedule(item);
+    }
+}
+shared_ptr<ByteStream> ResourcePrefetcher::GetFilteredStream(ManifestItemPtr item)
+{
+    if ( !bool(item) )
+        return nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto container = _package->GetContainer();
+    if ( !bool(container) )
+        return nullptr;
+
+    // the calling thread reads through the package's own archive, as it would without a prefetcher
+    Archive* archive = container->GetArchive().get();
+
+    bool decoded = false;
+    PrefetchCache::BufferPtr data = Fill(item, archive, &decoded);
+    Duration elapsed = std::chrono::duration_cast<Duration>(std::chrono::steady_clock::now() - start);
+
+    if ( !bool(data) )
+    {
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            _bypassed++;
+        }
+        return UncachedStream(item, archive);
+    }
+
+    std::lock_guard<std::mutex> _(_lock);
+    if ( decoded )
+    {
+        _misses++;
+        _missTime += elapsed;
+    }
+    else
+    {
+        _hits++;
+        _hitTime += elapsed;
+    }
+
+    return std::make_shared<PrefetchedByteStream>(data);
+}
+bool ResourcePrefetcher::IsCached(ConstManifestItemPtr item) const
+{
+    return bool(item) && _cache.Contains(item->AbsolutePath());
+}
+void ResourcePrefetcher::WaitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _idle.wait(lock, [this]() { return _outstanding == 0; });
+}
+ResourcePrefetcher::Statistics ResourcePrefetcher::GetStatistics() const
+{
+    Statistics stats;
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        stats.hits = _hits;
+        stats.misses = _misses;
+        stats.bypassed = _bypassed;
+        stats.prefetched = _prefetched;
+        stats.hitTime = _hitTime;
+        stats.missTime = _missTime;
+    }
+    stats.cache = _cache.GetStatistics();
+    return stats;
+}
+void ResourcePrefetcher::Schedule(ManifestItemPtr item)
+{
+    string path = item->AbsolutePath();
+    if ( _cache.Contains(path) )
+        return;
+
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( _shuttingDown || !_scheduled.insert(path).second )
+            return;
+        _outstanding++;
+    }
+
+    _pool->add([this, item, path]() {
+        // an exception escaping a thread_pool job terminates the process
+        try
+        {
+            RunPrefetch(item);
+        }
+        catch (...)
+        {
+        }
+
+        std::lock_guard<std::mutex> _(_lock);
+        _scheduled.erase(path);
+        if ( --_outstanding == 0 )
+            _idle.notify_all();
+    });
+}
+void ResourcePrefetcher::RunPrefetch(ManifestItemPtr item)
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( _shuttingDown || _wanted.find(item->AbsolutePath()) == _wanted.end() )
+            return;
+    }
+
+    ArchiveHandle archive = AcquireArchive();
+    if ( !bool(archive) )
+        return;
+
+    std::vector<ManifestItemPtr> queue(1, item);
+    std::set<string> visited;
+    visited.insert(item->AbsolutePath());
+    while ( !queue.empty() )
+    {
+        ManifestItemPtr next = queue.back();
+        queue.pop_back();
+
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            if ( _shuttingDown )
+                break;
+        }
+
+        bool decoded = false;
+        PrefetchCache::BufferPtr data = Fill(next, archive.get(), &decoded);
+        if ( decoded )
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            _prefetched++;
+        }
+
+        // documents link to stylesheets and images, stylesheets to fonts and images
+        const string& mediaType = next->MediaType();
+        if ( !bool(data) || !_options.linkedResources )
+            continue;
+        if ( mediaType != "application/xhtml+xml" && mediaType != "text/html" && mediaType != "image/svg+xml" && mediaType != "text/css" )
+            continue;
+
+        for ( auto& path : LinkedResourcePaths(data->GetBytes(), data->GetBufferSize(), next->BaseHref()) )
+        {
+            auto linked = std::const_pointer_cast<ManifestItem>(_package->ManifestItemAtRelativePath(path));
+            if ( !bool(linked) || !IsPrefetchableType(linked->MediaType()) )
+                continue;
+            if ( visited.insert(linked->AbsolutePath()).second )
+                queue.push_back(linked);
+        }
+    }
+
+    ReleaseArchive(std::move(archive));
+}
+PrefetchCache::BufferPtr ResourcePrefetcher::Fill(ManifestItemPtr item, Archive* archive, bool* decoded)
+{
+    *decoded = false;
+    if ( archive == nullptr )
+        return nullptr;
+
+    string path = item->AbsolutePath();
+    if ( !IsPrefetchableType(item->MediaType()) )
+        return nullptr;
+
+    size_t size = 0;
+    try
+    {
+        size = archive->InfoAtPath(path).UncompressedSize();
+    }
+    catch (std::exception&)
+    {
+        return nullptr;
+    }
+    if ( size > _options.maxItemSize || size > _cache.ByteLimit() )
+        return nullptr;
+
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        _pendingChanged.wait(lock, [&]() { return _pending.find(path) == _pending.end(); });
+
+        PrefetchCache::BufferPtr cached = _cache.Get(path);
+        if ( bool(cached) )
+            return cached;
+
+        _pending.insert(path);
+    }
+
+    PrefetchCache::BufferPtr data;
+    try
+    {
+        data = Decode(item, archive, size);
+    }
+    catch (std::exception&)
+    {
+    }
+
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        _pending.erase(path);
+        if ( bool(data) )
+            _cache.Insert(path, data);
+    }
+    _pendingChanged.notify_all();
+
+    *decoded = bool(data);
+    return data;
+}
+PrefetchCache::BufferPtr ResourcePrefetcher::Decode(ManifestItemPtr item, Archive* archive, size_t sizeHint) const
+{
+    unique_ptr<ByteStream> raw = archive->ByteStreamAtPath(item->AbsolutePath());
+    SeekableByteStream* seekable = dynamic_cast<SeekableByteStream*>(raw.get());
+    if ( seekable == nullptr || !seekable->IsOpen() )
+        return nullptr;
+
+    raw.release();
+    unique_ptr<ByteStream> filtered = _package->GetFilterChainByteStream(item, seekable);
+    if ( !bool(filtered) )
+        return nullptr;
+
+    auto result = std::make_shared<ByteBuffer>(std::max(sizeHint, size_t(1)), prealloc_buf);
+    result->SetUsesSecureErasure();
+
+    uint8_t chunk[kDecodeChunkSize];
+    ByteStream::size_type count = 0;
+    while ( (count = filtered->ReadBytes(chunk, sizeof(chunk))) > 0 )
+    {
+        result->AddBytes(chunk, count);
+    }
+    BufferPool::SecureErase(chunk, sizeof(chunk));
+
+    return result;
+}
+shared_ptr<ByteStream> ResourcePrefetcher::UncachedStream(ManifestItemPtr item, Archive* archive) const
+{
+    unique_ptr<ByteStream> raw = archive->ByteStreamAtPath(item->AbsolutePath());
+    SeekableByteStream* seekable = dynamic_cast<SeekableByteStream*>(raw.get());
+    if ( seekable == nullptr || !seekable->IsOpen() )
+        return nullptr;
+
+    raw.release();
+    return shared_ptr<ByteStream>(_package->GetFilterChainByteStream(item, seekable).release());
+}
+ResourcePrefetcher::ArchiveHandle ResourcePrefetcher::AcquireArchive()
+{
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( !_idleArchives.empty() )
+        {
+            ArchiveHandle archive = std::move(_idleArchives.back());
+            _idleArchives.pop_back();
+            return archive;
+        }
+    }
+
+    auto container = _package->GetContainer();
+    if ( !bool(container) )
+        return nullptr;
+    return Archive::Open(container->Path());
+}
+void ResourcePrefetcher::ReleaseArchive(ArchiveHandle archive)
+{
+    std::lock_guard<std::mutex> _(_lock);
+    _idleArchives.push_back(std::move(archive));
+}
+std::vector<string> ResourcePrefetcher::LinkedResourcePaths(const uint8_t* bytes, size_t len, const string& documentHref)
+{
+    std::vector<string> result;
+    if ( bytes == nullptr || len == 0 )
+        return result;
+
+    const char* begin = reinterpret_cast<const char*>(bytes);
+    const char* end = begin + len;
+
+    string::size_type slash = documentHref.rfind('/');
+    std::string directory = (slash == string::npos ? std::string() : documentHref.substr(0, slash+1).stl_str());
+
+    auto addReference = [&](const char* refStart, const char* refEnd) {
+        while ( refStart < refEnd && IsSpace(*refStart) )
+            refStart++;
+        while ( refEnd > refStart && IsSpace(*(refEnd-1)) )
+            refEnd--;
+
+        std::string ref(refStart, refEnd);
+        ref = ref.substr(0, ref.find_first_of("#?"));
+        if ( ref.empty() || ref[0] == '/' )
+            return;
+
+        // ignore anything with a scheme: http:, data:, mailto: and so on
+        std::string::size_type colon = ref.find(':');
+        if ( colon != std::string::npos && colon < ref.find('/') )
+            return;
+
+        // resolve the reference against the document's directory, collapsing dot segments
+        std::vector<std::string> segments;
+        std::string joined(directory);
+        joined.append(ref);
+        std::string::size_type pos = 0;
+        while ( pos <= joined.size() )
+        {
+            std::string::size_type next = joined.find('/', pos);
+            if ( next == std::string::npos )
+                next = joined.size();
+
+            std::string segment = joined.substr(pos, next - pos);
+            if ( segment == ".." )
+            {
+                if ( segments.empty() )
+                    return;         // escapes the package directory
+                segments.pop_back();
+            }
+            else if ( !segment.empty() && segment != "." )
+            {
+                segments.push_back(segment);
+            }
+            pos = next + 1;
+        }
+
+        std::string path;
+        for ( auto& segment : segments )
+        {
+            if ( !path.empty() )
+                path += '/';
+            path += segment;
+        }
+
+        if ( !path.empty() && std::find(result.begin(), result.end(), string(path)) == result.end() )
+            result.emplace_back(path);
+    };
+
+    for ( const char* p = begin; p < end; p++ )
+    {
+        // CSS url() tokens, quoted or not
+        if ( StartsWithNoCase(p, end, "url(") )
+        {
+            const char* value = p + 4;
+            while ( value < end && IsSpace(*value) )
+                value++;
+
+            char quote = (value < end && (*value == '"' || *value == '\'') ? *value : 0);
+            if ( quote != 0 )
+                value++;
+
+            const char* valueEnd = value;
+            while ( valueEnd < end && (quote != 0 ? *valueEnd != quote : *valueEnd != ')') )
+                valueEnd++;
+
+            if ( valueEnd < end )
+                addReference(value, valueEnd);
+            p = valueEnd;
+            continue;
+        }
+
+        // href="..." and src="...", including namespaced forms such as xlink:href
+        size_t nameLen = 0;
+        if ( end - p > 4 && strncmp(p, "href", 4) == 0 )
+            nameLen = 4;
+        else if ( end - p > 3 && strncmp(p, "src", 3) == 0 )
+            nameLen = 3;
+        if ( nameLen == 0 || p == begin || !(IsSpace(*(p-1)) || *(p-1) == ':') )
+            continue;
+
+        const char* value = p + nameLen;
+        while ( value < end && IsSpace(*value) )
+            value++;
+        if ( value >= end || *value != '=' )
+            continue;
+        value++;
+        while ( value < end && IsSpace(*value) )
+            value++;
+        if ( value >= end || (*value != '"' && *value != '\'') )
+            continue;
+
+        char quote = *value++;
+        const char* valueEnd = static_cast<const char*>(memchr(value, quote, end - value));
+        if ( valueEnd == nullptr )
+            break;
+
+        addReference(value, valueEnd);
+        p = valueEnd;
+    }
+
+    return result;
+}
+bool ResourcePrefetcher::IsPrefetchableType(const string& mediaType)
+{
+    // audio and video are streamed with range requests, and are generally too large to hold in memory
+    if ( mediaType.find("audio/", 0, 6) == 0 || mediaType.find("video/", 0, 6) == 0 )
+        return false;
+
+    return mediaType == "application/xhtml+xml" || mediaType == "text/html" || mediaType == "text/css"
+        || mediaType.find("image/", 0, 6) == 0 || mediaType.find("font/", 0, 5) == 0
+        || mediaType.find("application/font-", 0, 17) == 0 || mediaType.find("application/x-font-", 0, 19) == 0
+        || mediaType == "application/vnd.ms-opentype";
+}
+
+EPUB3_END_NAMESPACE
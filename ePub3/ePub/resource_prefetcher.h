@@ -0,0 +1,371 @@
+//
+//  resource_prefetcher.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__resource_prefetcher__
+#define __ePub3__resource_prefetcher__
+
+#include <ePub3/epub3.h>
+#include <ePub3/utilities/byte_stream.h>
+#include <ePub3/utilities/byte_buffer.h>
+#include <ePub3/utilities/executor.h>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A bounded, least-recently-used cache of filtered resource data.
+
+ Entries are keyed by container-relative path. The cache holds no more than
+ ByteLimit() bytes in total; inserting an entry evicts the least recently used
+ entries until it fits. An evicted buffer is released once the last stream reading
+ it goes away, and since cached data is frequently decrypted content, all buffers
+ are securely erased when freed.
+
+ All methods are internally synchronized.
+ @ingroup epub-model
+ */
+class PrefetchCache
+{
+public:
+    typedef std::shared_ptr<const ByteBuffer>   BufferPtr;
+
+    ///
+    /// The default upper limit on the number of bytes held by a cache.
+    static CONSTEXPR size_t DefaultByteLimit    = 32 * 1024 * 1024;
+
+    ///
+    /// Usage counts for a cache.
+    struct Statistics
+    {
+        size_t      entries;        ///< The number of entries currently cached.
+        size_t      bytes;          ///< The number of bytes currently cached.
+        size_t      insertions;     ///< The number of entries ever inserted.
+        size_t      evictions;      ///< The number of entries evicted to make room for others.
+    };
+
+private:
+                    PrefetchCache(const PrefetchCache&)         _DELETED_;
+    PrefetchCache&  operator=(const PrefetchCache&)             _DELETED_;
+
+public:
+    EPUB3_EXPORT    PrefetchCache(size_t byteLimit = DefaultByteLimit);
+    virtual         ~PrefetchCache() {}
+
+    ///
+    /// Returns the data for a path, marking it as most recently used, or `nullptr`.
+    EPUB3_EXPORT
+    BufferPtr       Get(const string& path);
+
+    ///
+    /// Whether data for a path is cached. This does not affect the entry's recency.
+    EPUB3_EXPORT
+    bool            Contains(const string& path)            const;
+
+    /**
+     Adds or replaces the data for a path.
+     @param path The container-relative path of the resource.
+     @param data The filtered content of the resource.
+     @result `false` if the data is larger than the cache itself, in which case
+     nothing is inserted.
+     */
+    EPUB3_EXPORT
+    bool            Insert(const string& path, BufferPtr data);
+
+    ///
+    /// Removes the data for a path, if present.
+    EPUB3_EXPORT
+    void            Remove(const string& path);
+
+    ///
+    /// Removes all entries.
+    EPUB3_EXPORT
+    void            Clear();
+
+    ///
+    /// The maximum number of bytes held by the cache.
+    size_t          ByteLimit()                             const   { return _byteLimit; }
+
+    ///
+    /// Returns the cache's current usage counts.
+    EPUB3_EXPORT
+    Statistics      GetStatistics()                         const;
+
+protected:
+    typedef std::list<string>   RecencyList;
+
+    struct Entry
+    {
+        BufferPtr               data;
+        RecencyList::iterator   position;
+    };
+
+    mutable std::mutex          _lock;
+    std::map<string, Entry>     _entries;
+    RecencyList                 _recency;           ///< Most recently used at the front.
+    size_t                      _byteLimit;
+    size_t                      _bytes;
+    size_t                      _insertions;
+    size_t                      _evictions;
+
+    ///
+    /// Evicts entries until `incoming` more bytes will fit. The lock must be held.
+    void            EvictToFit(size_t incoming);
+    ///
+    /// Removes an entry. The lock must be held.
+    void            Erase(std::map<string, Entry>::iterator pos);
+
+};
+
+/**
+ A read-only stream over a buffer held by a PrefetchCache.
+
+ The stream keeps its buffer alive, so it remains valid if the entry is evicted
+ while it is being read.
+ */
+class PrefetchedByteStream : public ByteStream
+{
+private:
+                            PrefetchedByteStream(const PrefetchedByteStream&)   _DELETED_;
+    PrefetchedByteStream&   operator=(const PrefetchedByteStream&)              _DELETED_;
+
+public:
+                            PrefetchedByteStream(PrefetchCache::BufferPtr data) : ByteStream(), _data(data), _position(0) {}
+    virtual                 ~PrefetchedByteStream() {}
+
+    virtual size_type       BytesAvailable()                _NOEXCEPT OVERRIDE;
+    virtual size_type       SpaceAvailable()        const   _NOEXCEPT OVERRIDE  { return 0; }
+    virtual bool            IsOpen()                const   _NOEXCEPT OVERRIDE  { return bool(_data); }
+    virtual void            Close()                                   OVERRIDE  { _data.reset(); }
+    virtual size_type       ReadBytes(void* buf, size_type len)       OVERRIDE;
+    virtual size_type       WriteBytes(const void* buf, size_type len) OVERRIDE;
+    virtual bool            AtEnd()                 const   _NOEXCEPT OVERRIDE;
+    virtual int             Error()                 const   _NOEXCEPT OVERRIDE  { return 0; }
+
+protected:
+    PrefetchCache::BufferPtr    _data;
+    size_type                   _position;
+
+};
+
+/**
+ Decodes and filters the spine items around the reading position ahead of time.
+
+ Given the spine item currently being displayed, the prefetcher schedules the
+ items up to Options::neighbourCount steps either side of it (following
+ SpineItem::NextStep() and SpineItem::PriorStep(), so non-linear items are
+ skipped), along with the stylesheets, fonts and images they link to, to be read,
+ inflated and passed through the package's filter chain on a background
+ thread_pool. The filtered bytes are held in a PrefetchCache.
+
+ Once attached to its package with Package::SetResourcePrefetcher(), calls to
+ Package::GetFilterChainByteStream(ManifestItemPtr) consult the cache first. A
+ request for an item which is being prefetched waits for that work to complete
+ rather than decoding the item a second time.
+
+ Since a `libzip` handle cannot be shared between threads, background workers read
+ from their own instances of the package's archive.
+
+ The prefetcher holds a strong reference to its package, while the package refers
+ to the prefetcher only weakly: the prefetcher should be owned by the reading
+ system, alongside the package.
+ @ingroup epub-model
+ */
+class ResourcePrefetcher
+{
+public:
+    typedef std::chrono::microseconds   Duration;
+
+    ///
+    /// Tuning parameters for a prefetcher.
+    struct Options
+    {
+        size_t      neighbourCount;     ///< Spine items to prefetch on each side of the current one.
+        size_t      byteLimit;          ///< Limit on the total size of cached data.
+        size_t      maxItemSize;        ///< Resources larger than this (uncompressed) are never cached.
+        bool        linkedResources;    ///< Whether to prefetch stylesheets, fonts and images.
+        int         threadCount;        ///< Background threads; thread_pool::Automatic uses one per core.
+
+        Options() : neighbourCount(2), byteLimit(PrefetchCache::DefaultByteLimit),
+                    maxItemSize(PrefetchCache::DefaultByteLimit / 4), linkedResources(true), threadCount(1) {}
+    };
+
+    ///
+    /// Usage counts and timings for a prefetcher.
+    struct Statistics
+    {
+        size_t      hits;               ///< Reads served from the cache.
+        size_t      misses;             ///< Reads which decoded the item on the calling thread.
+        size_t      bypassed;           ///< Reads of items which are never cached.
+        size_t      prefetched;         ///< Items decoded in the background.
+        Duration    hitTime;            ///< Total time spent serving hits, including waits on in-flight prefetches.
+        Duration    missTime;           ///< Total time spent decoding on the calling thread.
+        PrefetchCache::Statistics   cache;
+
+        ///
+        /// The fraction of cacheable reads served from the cache.
+        double      HitRate()                           const
+            { return (hits + misses == 0 ? 0.0 : double(hits) / double(hits + misses)); }
+        ///
+        /// The mean time taken to serve a hit.
+        Duration    AverageHitLatency()                 const
+            { return (hits == 0 ? Duration(0) : Duration(hitTime.count() / hits)); }
+        ///
+        /// The mean time taken to serve a miss.
+        Duration    AverageMissLatency()                const
+            { return (misses == 0 ? Duration(0) : Duration(missTime.count() / misses)); }
+    };
+
+private:
+                        ResourcePrefetcher(const ResourcePrefetcher&)   _DELETED_;
+    ResourcePrefetcher& operator=(const ResourcePrefetcher&)            _DELETED_;
+
+public:
+    EPUB3_EXPORT        ResourcePrefetcher(PackagePtr package, const Options& options = Options());
+    virtual             ~ResourcePrefetcher();
+
+    ///
+    /// The package whose resources are prefetched.
+    PackagePtr          GetPackage()                    const   { return _package; }
+
+    /**
+     Schedules the items around a spine item for prefetching.
+
+     Any previously scheduled items which are not within the new window and have
+     not yet been started are abandoned.
+     @param current The spine item currently being read.
+     */
+    EPUB3_EXPORT
+    void                PrefetchAround(SpineItemPtr current);
+
+    /**
+     Returns a stream of an item's filtered content.
+
+     If the item is cached, or is being prefetched, the cached bytes are returned.
+     Otherwise the item is decoded on the calling thread and (if small enough)
+     cached before being returned.
+     @param item The manifest item to read.
+     @result A stream, or `nullptr` if the item could not be read.
+     */
+    EPUB3_EXPORT
+    shared_ptr<ByteStream>  GetFilteredStream(ManifestItemPtr item);
+
+    ///
+    /// Whether an item's filtered content is currently cached.
+    EPUB3_EXPORT
+    bool                IsCached(ConstManifestItemPtr item) const;
+
+    ///
+    /// Blocks until all scheduled prefetching has completed.
+    EPUB3_EXPORT
+    void                WaitUntilIdle();
+
+    ///
+    /// Discards all cached data.
+    EPUB3_EXPORT
+    void                Clear()                                 { _cache.Clear(); }
+
+    ///
+    /// Returns the prefetcher's usage counts and timings.
+    EPUB3_EXPORT
+    Statistics          GetStatistics()                 const;
+
+    /**
+     Finds the resources referenced by a document or stylesheet.
+
+     This is a lightweight scan for `href` and `src` attribute values and CSS `url()`
+     tokens, not a full parse. Fragment-only, absolute and scheme-qualified
+     references are ignored.
+     @param bytes The content of the document.
+     @param len The length of the content.
+     @param documentHref The document's href, relative to the package directory.
+     @result The referenced paths, relative to the package directory, without
+     duplicates.
+     */
+    EPUB3_EXPORT
+    static std::vector<string>  LinkedResourcePaths(const uint8_t* bytes, size_t len, const string& documentHref);
+
+    ///
+    /// Whether resources of a media type are worth prefetching.
+    EPUB3_EXPORT
+    static bool         IsPrefetchableType(const string& mediaType);
+
+protected:
+    typedef std::unique_ptr<Archive>    ArchiveHandle;
+
+    PackagePtr                  _package;
+    Options                     _options;
+    PrefetchCache               _cache;
+
+    mutable std::mutex          _lock;
+    std::condition_variable     _pendingChanged;
+    std::condition_variable     _idle;
+    std::set<string>            _wanted;            ///< Spine items in the current window.
+    std::set<string>            _scheduled;         ///< Items queued or running in the background.
+    std::set<string>            _pending;           ///< Items currently being decoded.
+    std::vector<ArchiveHandle>  _idleArchives;
+    size_t                      _outstanding;
+    bool                        _shuttingDown;
+
+    size_t                      _hits;
+    size_t                      _misses;
+    size_t                      _bypassed;
+    size_t                      _prefetched;
+    Duration                    _hitTime;
+    Duration                    _missTime;
+
+    std::unique_ptr<thread_pool>    _pool;
+
+    ///
+    /// Queues a spine item and its linked resources for background decoding.
+    void                Schedule(ManifestItemPtr item);
+    ///
+    /// Runs on a worker thread.
+    void                RunPrefetch(ManifestItemPtr item);
+
+    /**
+     Returns the cached data for an item, decoding and caching it if necessary.
+     @param item The item to read.
+     @param archive The archive to read from, which must not be in use elsewhere.
+     @param decoded Set to `true` if the item was decoded by this call.
+     @result The filtered content, or `nullptr` if the item isn't cacheable or
+     couldn't be read.
+     */
+    PrefetchCache::BufferPtr    Fill(ManifestItemPtr item, Archive* archive, bool* decoded);
+    ///
+    /// Reads an item in its entirety through the filter chain.
+    PrefetchCache::BufferPtr    Decode(ManifestItemPtr item, Archive* archive, size_t sizeHint)  const;
+    ///
+    /// Returns a filtered stream which bypasses the cache.
+    shared_ptr<ByteStream>      UncachedStream(ManifestItemPtr item, Archive* archive)  const;
+
+    ArchiveHandle       AcquireArchive();
+    void                ReleaseArchive(ArchiveHandle archive);
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__resource_prefetcher__) */
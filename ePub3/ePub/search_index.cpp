@@ -0,0 +1,802 @@
+//
+//  search_index.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "search_index.h"
+#include "glossary_index.h"
+#include "package.h"
+#include "container.h"
+#include "archive.h"
+#include <ePub3/utilities/byte_buffer.h>
+#include <ePub3/utilities/byte_stream.h>
+#include <ePub3/utilities/executor.h>
+#include <ePub3/utilities/buffer_pool.h>
+#include <libxml/parser.h>
+#include <libxml/HTMLparser.h>
+#include <libxml/tree.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if EPUB_USE(LIBXML2)
+
+EPUB3_BEGIN_NAMESPACE
+
+static const char       kSearchIndexMagic[4]    = { 'E', 'P', 'F', 'T' };
+static const uint64_t   kSearchIndexVersion     = 1;
+static const size_t     kReadChunkSize          = 16 * 1024;
+
+#if 0
+#pragma mark - Words
+#endif
+
+// decodes one code point, treating malformed input as single U+FFFD bytes
+static uint32_t NextCodePoint(const uint8_t*& p, const uint8_t* end)
+{
+    uint8_t lead = *p++;
+    if ( lead < 0x80 )
+        return lead;
+
+    int extra = 0;
+    uint32_t cp = 0;
+    if ( (lead & 0xE0) == 0xC0 )        { extra = 1; cp = lead & 0x1F; }
+    else if ( (lead & 0xF0) == 0xE0 )   { extra = 2; cp = lead & 0x0F; }
+    else if ( (lead & 0xF8) == 0xF0 )   { extra = 3; cp = lead & 0x07; }
+    else                                return 0xFFFD;
+
+    if ( end - p < extra )
+        return 0xFFFD;
+    for ( int i = 0; i < extra; i++ )
+    {
+        if ( (p[i] & 0xC0) != 0x80 )
+            return 0xFFFD;
+    }
+    for ( int i = 0; i < extra; i++ )
+        cp = (cp << 6) | (*p++ & 0x3F);
+    return cp;
+}
+
+// scripts without spaces between words: each character is indexed as a word
+static bool IsIdeographic(uint32_t cp)
+{
+    return (cp >= 0x3040 && cp <= 0x30FF)       // kana
+        || (cp >= 0x3400 && cp <= 0x4DBF)       // CJK extension A
+        || (cp >= 0x4E00 && cp <= 0x9FFF)       // CJK unified ideographs
+        || (cp >= 0xAC00 && cp <= 0xD7AF)       // Hangul syllables
+        || (cp >= 0xF900 && cp <= 0xFAFF)       // CJK compatibility ideographs
+        || (cp >= 0x20000 && cp <= 0x2FFFF);    // supplementary ideographs
+}
+static bool IsWordCharacter(uint32_t cp)
+{
+    if ( cp < 0x80 )
+        return (cp >= '0' && cp <= '9') || (cp >= 'A' && cp <= 'Z') || (cp >= 'a' && cp <= 'z');
+    if ( cp < 0xC0 )
+        return cp == 0xAA || cp == 0xB5 || cp == 0xBA;
+    if ( cp == 0xD7 || cp == 0xF7 || cp == 0xFFFD || cp == 0xFEFF )
+        return false;
+    if ( (cp >= 0x2000 && cp <= 0x2BFF)         // punctuation, symbols, arrows, etc.
+      || (cp >= 0x3000 && cp <= 0x303F)         // CJK punctuation
+      || (cp >= 0xFE30 && cp <= 0xFE4F)         // CJK compatibility forms
+      || (cp >= 0xFF00 && cp <= 0xFF0F)         // fullwidth punctuation
+      || (cp >= 0xFF1A && cp <= 0xFF20) )
+        return false;
+    return true;
+}
+
+// calls fn(start, end, utf16Start, utf16End) for each word; returns the UTF-16 length of the text
+template <typename Fn>
+static uint32_t ForEachWord(const uint8_t* p, const uint8_t* end, Fn fn)
+{
+    uint32_t offset = 0;
+    const uint8_t* wordStart = nullptr;
+    uint32_t wordOffset = 0;
+
+    while ( p < end )
+    {
+        const uint8_t* charStart = p;
+        uint32_t cp = NextCodePoint(p, end);
+        uint32_t width = (cp >= 0x10000 ? 2 : 1);
+
+        bool ideographic = IsIdeographic(cp);
+        if ( wordStart != nullptr && (ideographic || !IsWordCharacter(cp)) )
+        {
+            fn(wordStart, charStart, wordOffset, offset);
+            wordStart = nullptr;
+        }
+
+        if ( ideographic )
+            fn(charStart, p, offset, offset + width);
+        else if ( wordStart == nullptr && IsWordCharacter(cp) )
+        {
+            wordStart = charStart;
+            wordOffset = offset;
+        }
+
+        offset += width;
+    }
+
+    if ( wordStart != nullptr )
+        fn(wordStart, end, wordOffset, offset);
+    return offset;
+}
+
+static std::string FoldedWord(const uint8_t* start, const uint8_t* end)
+{
+    return GlossaryIndex::FoldedKey(string(reinterpret_cast<const char*>(start), static_cast<size_t>(end - start))).stl_str();
+}
+
+std::vector<string> SearchIndex::Words(const string& text)
+{
+    std::vector<string> result;
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(text.c_str());
+    ForEachWord(p, p + text.utf8_size(), [&result](const uint8_t* start, const uint8_t* end, uint32_t, uint32_t) {
+        result.emplace_back(FoldedWord(start, end));
+    });
+    return result;
+}
+
+#if 0
+#pragma mark - Encoding
+#endif
+
+static void PutVarint(std::string& out, uint64_t value)
+{
+    while ( value >= 0x80 )
+    {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+static bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+{
+    value = 0;
+    for ( int shift = 0; p < end && shift < 64; shift += 7 )
+    {
+        uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if ( (byte & 0x80) == 0 )
+            return true;
+    }
+    return false;
+}
+static void PutString(std::string& out, const std::string& str)
+{
+    PutVarint(out, str.size());
+    out += str;
+}
+static bool GetString(const uint8_t*& p, const uint8_t* end, std::string& str)
+{
+    uint64_t len = 0;
+    if ( !GetVarint(p, end, len) || len > uint64_t(end - p) )
+        return false;
+    str.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(len));
+    p += len;
+    return true;
+}
+
+#if 0
+#pragma mark - Construction
+#endif
+
+SearchIndex::SearchIndex(const string& identity) : _identity(identity), _documents(), _terms(), _offsets(), _postings(), _finished(false), _lock(), _pending()
+{
+}
+SearchIndex::~SearchIndex()
+{
+}
+string SearchIndex::DefaultPathFor(ConstPackagePtr package)
+{
+    auto container = package->GetContainer();
+    if ( !bool(container) )
+        return string();
+    return _Str(container->Path(), ".search");
+}
+SearchIndexPtr SearchIndex::Build(ConstPackagePtr package, const Options& options)
+{
+    auto container = package->GetContainer();
+    auto result = std::make_shared<SearchIndex>(package->UniqueID());
+    if ( !bool(container) )
+    {
+        result->Finish();
+        return result;
+    }
+
+    struct Work
+    {
+        size_t          spineIndex;
+        ManifestItemPtr item;
+        CFI             cfi;
+        bool            isHTML;
+    };
+
+    std::vector<Work> work;
+    size_t spineIndex = 0;
+    for ( auto spineItem = package->FirstSpineItem(); bool(spineItem); spineItem = spineItem->Next(), spineIndex++ )
+    {
+        auto item = spineItem->ManifestItem();
+        if ( !bool(item) || (!spineItem->Linear() && !options.includeNonLinear) )
+            continue;
+
+        const string& mediaType = item->MediaType();
+        if ( mediaType != "application/xhtml+xml" && mediaType != "text/html" )
+            continue;
+
+        work.push_back(Work{spineIndex, item, package->CFIForSpineItem(spineItem), mediaType == "text/html"});
+    }
+
+    int threadCount = options.threadCount;
+    if ( threadCount <= 0 )
+        threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    threadCount = std::min(threadCount, static_cast<int>(std::max(work.size(), size_t(1))));
+
+    std::atomic<size_t> next(0);
+    std::mutex doneLock;
+    std::condition_variable doneCondition;
+    int running = threadCount;
+
+    {
+        thread_pool pool(threadCount);
+        for ( int t = 0; t < threadCount; t++ )
+        {
+            pool.add([&]() {
+                // an exception escaping a thread_pool job terminates the process
+                try
+                {
+                    // libzip handles can't be shared between threads
+                    std::unique_ptr<Archive> archive = Archive::Open(container->Path());
+                    for ( size_t i = next++; i < work.size() && bool(archive); i = next++ )
+                    {
+                        const Work& job = work[i];
+                        unique_ptr<ByteStream> raw = archive->ByteStreamAtPath(job.item->AbsolutePath());
+                        SeekableByteStream* seekable = dynamic_cast<SeekableByteStream*>(raw.get());
+                        if ( seekable == nullptr || !seekable->IsOpen() )
+                            continue;
+
+                        raw.release();
+                        unique_ptr<ByteStream> filtered = package->GetFilterChainByteStream(job.item, seekable);
+                        if ( !bool(filtered) )
+                            continue;
+
+                        ByteBuffer content(kReadChunkSize, prealloc_buf);
+                        content.SetUsesSecureErasure();
+                        uint8_t chunk[kReadChunkSize];
+                        ByteStream::size_type count = 0;
+                        while ( (count = filtered->ReadBytes(chunk, sizeof(chunk))) > 0 )
+                        {
+                            content.AddBytes(chunk, count);
+                        }
+                        BufferPool::SecureErase(chunk, sizeof(chunk));
+
+                        result->AddDocument(job.spineIndex, job.cfi, content.GetBytes(), content.GetBufferSize(), job.isHTML);
+                    }
+                }
+                catch (...)
+                {
+                }
+
+                std::lock_guard<std::mutex> _(doneLock);
+                if ( --running == 0 )
+                    doneCondition.notify_all();
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(doneLock);
+        doneCondition.wait(lock, [&running]() { return running == 0; });
+    }
+
+    result->Finish();
+    return result;
+}
+
+#if 0
+#pragma mark - Extraction
+#endif
+
+static bool IsSkippedElement(xmlNodePtr node)
+{
+    static const char* kSkipped[] = { "head", "script", "style", "template" };
+    for ( auto name : kSkipped )
+    {
+        if ( xmlStrcasecmp(node->name, BAD_CAST name) == 0 )
+            return true;
+    }
+    return false;
+}
+
+// an id is used as a step qualifier only if it needs no CFI escaping
+static void AppendElementStep(std::string& path, xmlNodePtr node, uint32_t step)
+{
+    path += '/';
+    path += std::to_string(step);
+
+    xmlChar* value = xmlGetNoNsProp(node, BAD_CAST "id");
+    if ( value == nullptr )
+        value = xmlGetNsProp(node, BAD_CAST "id", XML_XML_NAMESPACE);
+    if ( value == nullptr )
+        return;
+
+    std::string ident(reinterpret_cast<const char*>(value));
+    xmlFree(value);
+    if ( !ident.empty() && ident.find_first_of("[](),;=^/!: ") == std::string::npos )
+    {
+        path += '[';
+        path += ident;
+        path += ']';
+    }
+}
+
+struct SearchIndex_Extraction
+{
+    std::vector<std::string>    runs;
+    std::vector<uint32_t>       runOf;          // per word
+    std::vector<uint32_t>       starts;
+    std::vector<uint32_t>       ends;
+    std::vector<std::string>    words;
+    std::string                 path;
+
+    void Walk(xmlNodePtr element)
+    {
+        // as in CFIStepIndex: elements are even steps, the character data around them odd steps
+        uint32_t step = 1;
+        uint32_t runOffset = 0;
+        int64_t run = -1;
+
+        for ( xmlNodePtr child = element->children; child != nullptr; child = child->next )
+        {
+            switch ( child->type )
+            {
+                case XML_ELEMENT_NODE:
+                {
+                    uint32_t elementStep = step + 1;
+                    step += 2;
+                    runOffset = 0;
+                    run = -1;
+
+                    if ( IsSkippedElement(child) )
+                        break;
+
+                    size_t mark = path.size();
+                    AppendElementStep(path, child, elementStep);
+                    Walk(child);
+                    path.resize(mark);
+                    break;
+                }
+
+                case XML_TEXT_NODE:
+                case XML_CDATA_SECTION_NODE:
+                {
+                    if ( child->content == nullptr )
+                        break;
+
+                    const uint8_t* p = child->content;
+                    const uint8_t* end = p + xmlStrlen(child->content);
+                    const uint32_t base = runOffset;
+                    runOffset = base + ForEachWord(p, end, [&](const uint8_t* start, const uint8_t* stop, uint32_t s, uint32_t e) {
+                        if ( run < 0 )
+                        {
+                            run = static_cast<int64_t>(runs.size());
+                            runs.push_back(path);
+                            runs.back().append(1, '/').append(std::to_string(step));
+                        }
+                        runOf.push_back(static_cast<uint32_t>(run));
+                        starts.push_back(base + s);
+                        ends.push_back(base + e);
+                        words.push_back(FoldedWord(start, stop));
+                    });
+                    break;
+                }
+
+                default:
+                    break;
+            }
+        }
+    }
+};
+
+bool SearchIndex::AddDocument(size_t spineIndex, const CFI& spineCFI, const void* bytes, size_t length, bool isHTML)
+{
+    if ( _finished )
+        throw std::logic_error("SearchIndex::AddDocument() called on a finished index");
+
+    static const int kXMLFlags = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_NONET|XML_PARSE_NOERROR|XML_PARSE_NOWARNING;
+    static const int kHTMLFlags = HTML_PARSE_RECOVER|HTML_PARSE_NONET|HTML_PARSE_NOERROR|HTML_PARSE_NOWARNING;
+
+    xmlDocPtr doc = nullptr;
+    if ( isHTML )
+        doc = htmlReadMemory(reinterpret_cast<const char*>(bytes), static_cast<int>(length), nullptr, nullptr, kHTMLFlags);
+    else
+        doc = xmlReadMemory(reinterpret_cast<const char*>(bytes), static_cast<int>(length), nullptr, nullptr, kXMLFlags);
+    if ( doc == nullptr )
+        return false;
+
+    SearchIndex_Extraction extraction;
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    if ( root != nullptr )
+        extraction.Walk(root);
+    xmlFreeDoc(doc);
+
+    // strip the epubcfi() wrapper; document paths follow the indirection step
+    std::string prefix = spineCFI.String().stl_str();
+    if ( prefix.compare(0, 8, "epubcfi(") == 0 && prefix.back() == ')' )
+        prefix = prefix.substr(8, prefix.size() - 9);
+    if ( prefix.empty() || prefix.back() != '!' )
+        prefix += '!';
+
+    Document document;
+    document.spineIndex = static_cast<uint32_t>(spineIndex);
+    document.spineCFI = std::move(prefix);
+    document.runs = std::move(extraction.runs);
+    document.words.reserve(extraction.words.size());
+    for ( size_t i = 0; i < extraction.words.size(); i++ )
+    {
+        document.words.push_back(WordLocation{extraction.runOf[i], extraction.starts[i], extraction.ends[i]});
+    }
+
+    std::lock_guard<std::mutex> _(_lock);
+    uint32_t docIndex = static_cast<uint32_t>(_documents.size());
+    _documents.push_back(std::move(document));
+    for ( size_t i = 0; i < extraction.words.size(); i++ )
+    {
+        _pending[extraction.words[i]].emplace_back(docIndex, static_cast<uint32_t>(i));
+    }
+    return true;
+}
+void SearchIndex::Finish()
+{
+    std::lock_guard<std::mutex> _(_lock);
+    if ( _finished )
+        return;
+
+    // documents go into spine order, so postings (and therefore hits) are in reading order
+    std::vector<uint32_t> order(_documents.size());
+    for ( uint32_t i = 0; i < order.size(); i++ )
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return _documents[a].spineIndex < _documents[b].spineIndex;
+    });
+
+    std::vector<uint32_t> remap(order.size());
+    std::vector<Document> documents;
+    documents.reserve(order.size());
+    for ( uint32_t i = 0; i < order.size(); i++ )
+    {
+        remap[order[i]] = i;
+        documents.push_back(std::move(_documents[order[i]]));
+    }
+    _documents = std::move(documents);
+
+    _terms.clear();
+    _terms.reserve(_pending.size());
+    for ( auto& entry : _pending )
+        _terms.push_back(entry.first);
+    std::sort(_terms.begin(), _terms.end());
+
+    _offsets.clear();
+    _offsets.reserve(_terms.size() + 1);
+    _postings.clear();
+    for ( auto& term : _terms )
+    {
+        PostingList& list = _pending[term];
+        for ( auto& posting : list )
+            posting.first = remap[posting.first];
+        std::sort(list.begin(), list.end());
+
+        // per document: document delta, occurrence count, position deltas
+        _offsets.push_back(static_cast<uint32_t>(_postings.size()));
+        size_t i = 0;
+        uint32_t lastDoc = 0;
+        while ( i < list.size() )
+        {
+            uint32_t doc = list[i].first;
+            size_t j = i;
+            while ( j < list.size() && list[j].first == doc )
+                j++;
+
+            PutVarint(_postings, doc - lastDoc);
+            PutVarint(_postings, j - i);
+            uint32_t lastPos = 0;
+            for ( size_t k = i; k < j; k++ )
+            {
+                PutVarint(_postings, list[k].second - lastPos);
+                lastPos = list[k].second;
+            }
+
+            lastDoc = doc;
+            i = j;
+        }
+
+        PostingList().swap(list);
+    }
+    _offsets.push_back(static_cast<uint32_t>(_postings.size()));
+
+    _pending.clear();
+    _finished = true;
+}
+size_t SearchIndex::WordCount() const
+{
+    size_t result = 0;
+    for ( auto& doc : _documents )
+        result += doc.words.size();
+    return result;
+}
+
+#if 0
+#pragma mark - Persistence
+#endif
+
+bool SearchIndex::Save(const string& path) const
+{
+    if ( !_finished )
+        return false;
+
+    std::string out(kSearchIndexMagic, sizeof(kSearchIndexMagic));
+    PutVarint(out, kSearchIndexVersion);
+    PutString(out, _identity.stl_str());
+
+    PutVarint(out, _documents.size());
+    for ( auto& doc : _documents )
+    {
+        PutVarint(out, doc.spineIndex);
+        PutString(out, doc.spineCFI);
+        PutVarint(out, doc.runs.size());
+        for ( auto& run : doc.runs )
+            PutString(out, run);
+        PutVarint(out, doc.words.size());
+        for ( auto& word : doc.words )
+        {
+            PutVarint(out, word.run);
+            PutVarint(out, word.start);
+            PutVarint(out, word.end - word.start);
+        }
+    }
+
+    PutVarint(out, _terms.size());
+    for ( auto& term : _terms )
+        PutString(out, term);
+    for ( auto offset : _offsets )
+        PutVarint(out, offset);
+    PutString(out, _postings);
+
+    std::ofstream file(path.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+    if ( !file )
+        return false;
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.close();
+    return !file.fail();
+}
+SearchIndexPtr SearchIndex::Load(const string& path, const string& identity)
+{
+    std::ifstream file(path.c_str(), std::ios::in|std::ios::binary);
+    if ( !file )
+        return nullptr;
+    std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data());
+    const uint8_t* end = p + bytes.size();
+    if ( bytes.size() < sizeof(kSearchIndexMagic) || ::memcmp(p, kSearchIndexMagic, sizeof(kSearchIndexMagic)) != 0 )
+        return nullptr;
+    p += sizeof(kSearchIndexMagic);
+
+    uint64_t version = 0, count = 0, value = 0;
+    std::string str;
+    if ( !GetVarint(p, end, version) || version != kSearchIndexVersion )
+        return nullptr;
+    if ( !GetString(p, end, str) || (!identity.empty() && str != identity.stl_str()) )
+        return nullptr;
+
+    auto result = std::make_shared<SearchIndex>(string(str));
+
+    // every count is checked against the bytes remaining, so a corrupt file can't cause huge allocations
+    if ( !GetVarint(p, end, count) || count > uint64_t(end - p) )
+        return nullptr;
+    result->_documents.resize(static_cast<size_t>(count));
+    for ( auto& doc : result->_documents )
+    {
+        if ( !GetVarint(p, end, value) )
+            return nullptr;
+        doc.spineIndex = static_cast<uint32_t>(value);
+        if ( !GetString(p, end, doc.spineCFI) )
+            return nullptr;
+
+        if ( !GetVarint(p, end, count) || count > uint64_t(end - p) )
+            return nullptr;
+        doc.runs.resize(static_cast<size_t>(count));
+        for ( auto& run : doc.runs )
+        {
+            if ( !GetString(p, end, run) )
+                return nullptr;
+        }
+
+        if ( !GetVarint(p, end, count) || count > uint64_t(end - p) )
+            return nullptr;
+        doc.words.resize(static_cast<size_t>(count));
+        for ( auto& word : doc.words )
+        {
+            uint64_t run = 0, start = 0, length = 0;
+            if ( !GetVarint(p, end, run) || !GetVarint(p, end, start) || !GetVarint(p, end, length) || run >= doc.runs.size() )
+                return nullptr;
+            word.run = static_cast<uint32_t>(run);
+            word.start = static_cast<uint32_t>(start);
+            word.end = static_cast<uint32_t>(start + length);
+        }
+    }
+
+    if ( !GetVarint(p, end, count) || count > uint64_t(end - p) )
+        return nullptr;
+    result->_terms.resize(static_cast<size_t>(count));
+    for ( auto& term : result->_terms )
+    {
+        if ( !GetString(p, end, term) )
+            return nullptr;
+    }
+    result->_offsets.resize(result->_terms.size() + 1);
+    for ( auto& offset : result->_offsets )
+    {
+        if ( !GetVarint(p, end, value) )
+            return nullptr;
+        offset = static_cast<uint32_t>(value);
+    }
+    if ( !GetString(p, end, result->_postings) || p != end )
+        return nullptr;
+    if ( result->_offsets.back() != result->_postings.size() )
+        return nullptr;
+
+    result->_finished = true;
+    return result;
+}
+
+#if 0
+#pragma mark - Searching
+#endif
+
+void SearchIndex::DecodePostings(size_t term, PostingList& out) const
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(_postings.data()) + _offsets[term];
+    const uint8_t* end = reinterpret_cast<const uint8_t*>(_postings.data()) + _offsets[term+1];
+
+    uint64_t doc = 0;
+    while ( p < end )
+    {
+        uint64_t delta = 0, count = 0;
+        if ( !GetVarint(p, end, delta) || !GetVarint(p, end, count) )
+            return;
+        doc += delta;
+        if ( doc >= _documents.size() )
+            return;
+
+        uint64_t pos = 0;
+        for ( uint64_t i = 0; i < count; i++ )
+        {
+            if ( !GetVarint(p, end, delta) )
+                return;
+            pos += delta;
+            if ( pos >= _documents[doc].words.size() )
+                return;
+            out.emplace_back(static_cast<uint32_t>(doc), static_cast<uint32_t>(pos));
+        }
+    }
+}
+SearchIndex::PostingList SearchIndex::PostingsFor(const std::string& word, bool prefix) const
+{
+    PostingList result;
+    auto pos = std::lower_bound(_terms.begin(), _terms.end(), word);
+    if ( !prefix )
+    {
+        if ( pos != _terms.end() && *pos == word )
+            DecodePostings(static_cast<size_t>(pos - _terms.begin()), result);
+        return result;
+    }
+
+    for ( ; pos != _terms.end() && pos->compare(0, word.size(), word) == 0; ++pos )
+        DecodePostings(static_cast<size_t>(pos - _terms.begin()), result);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+SearchIndex::HitList SearchIndex::Search(const string& query, size_t limit) const
+{
+    HitList hits;
+    if ( !_finished )
+        return hits;
+
+    std::string text = query.stl_str();
+    while ( !text.empty() && isspace(static_cast<unsigned char>(text.back())) )
+        text.pop_back();
+    bool prefix = (!text.empty() && text.back() == '*');
+
+    std::vector<string> words = Words(text);
+    if ( words.empty() )
+        return hits;
+
+    PostingList candidates = PostingsFor(words[0].stl_str(), prefix && words.size() == 1);
+    for ( size_t i = 1; i < words.size() && !candidates.empty(); i++ )
+    {
+        PostingList next = PostingsFor(words[i].stl_str(), prefix && i == words.size() - 1);
+        PostingList kept;
+        for ( auto& candidate : candidates )
+        {
+            Posting wanted(candidate.first, candidate.second + static_cast<uint32_t>(i));
+            if ( std::binary_search(next.begin(), next.end(), wanted) )
+                kept.push_back(candidate);
+        }
+        candidates.swap(kept);
+    }
+
+    for ( auto& candidate : candidates )
+    {
+        const Document& doc = _documents[candidate.first];
+        uint32_t last = candidate.second + static_cast<uint32_t>(words.size()) - 1;
+        hits.push_back(Hit{doc.spineIndex, CFIForWords(doc, candidate.second, last)});
+        if ( limit != 0 && hits.size() == limit )
+            break;
+    }
+    return hits;
+}
+
+static std::vector<std::string> SplitSteps(const std::string& path)
+{
+    std::vector<std::string> steps;
+    size_t start = 0;
+    while ( start < path.size() )
+    {
+        size_t next = path.find('/', start + 1);
+        if ( next == std::string::npos )
+            next = path.size();
+        steps.push_back(path.substr(start, next - start));
+        start = next;
+    }
+    return steps;
+}
+
+CFI SearchIndex::CFIForWords(const Document& doc, uint32_t first, uint32_t last) const
+{
+    const WordLocation& from = doc.words[first];
+    const WordLocation& to = doc.words[last];
+    std::vector<std::string> startSteps = SplitSteps(doc.runs[from.run]);
+    std::vector<std::string> endSteps = SplitSteps(doc.runs[to.run]);
+
+    // the start and end paths each keep at least their character data step
+    size_t common = 0;
+    size_t limit = std::min(startSteps.size(), endSteps.size()) - 1;
+    while ( common < limit && startSteps[common] == endSteps[common] )
+        common++;
+
+    std::stringstream ss;
+    ss << "epubcfi(" << doc.spineCFI;
+    for ( size_t i = 0; i < common; i++ )
+        ss << startSteps[i];
+    ss << ",";
+    for ( size_t i = common; i < startSteps.size(); i++ )
+        ss << startSteps[i];
+    ss << ":" << from.start << ",";
+    for ( size_t i = common; i < endSteps.size(); i++ )
+        ss << endSteps[i];
+    ss << ":" << to.end << ")";
+
+    return CFI(string(ss.str()));
+}
+
+EPUB3_END_NAMESPACE
+
+#endif  // EPUB_USE(LIBXML2)
@@ -0,0 +1,231 @@
+//
+//  search_index.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__search_index__
+#define __ePub3__search_index__
+
+#include <ePub3/epub3.h>
+#include <ePub3/cfi.h>
+#include <ePub3/utilities/utfstring.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if EPUB_USE(LIBXML2)
+
+EPUB3_BEGIN_NAMESPACE
+
+class SearchIndex;
+typedef std::shared_ptr<SearchIndex>        SearchIndexPtr;
+typedef std::shared_ptr<const SearchIndex>  ConstSearchIndexPtr;
+
+/**
+ A full-text index of the content documents in a publication's spine.
+
+ The text of each content document is split into words, which are folded with
+ GlossaryIndex::FoldedKey() so that searches ignore case and accents. Ideographic
+ and syllabic scripts (CJK, kana, Hangul) are indexed one character per word, so
+ phrase searches work for them too. The index records, for every word, the
+ documents and word positions at which it occurs, and for every word position the
+ character data step and UTF-16 offsets where it appears, so that each hit can be
+ returned as a ranged CFI without re-reading the document.
+
+ Build() reads the spine documents through the package's filter chain (so
+ encrypted content is indexed correctly) on a pool of threads, each with its own
+ handle on the archive. The index can be saved next to the publication and loaded
+ again later, keyed by the package's unique identifier, which includes its
+ modification date.
+
+ Searches match phrases: every word in the query must appear, consecutively and in
+ order. A query ending in `*` matches any word starting with its last word, which
+ suits type-ahead.
+
+ Words are taken from within single text nodes; a word split by inline markup
+ (such as `<b>W</b>ord`) is indexed as two words.
+ @ingroup epub-model
+ */
+class SearchIndex
+{
+public:
+    ///
+    /// A single occurrence of a query.
+    struct Hit
+    {
+        size_t          spineIndex;     ///< The index of the spine item containing the hit.
+        CFI             cfi;            ///< A ranged CFI spanning the matching text.
+    };
+    typedef std::vector<Hit>    HitList;
+
+    ///
+    /// Controls how an index is built.
+    struct Options
+    {
+        int             threadCount;        ///< Worker threads; zero picks a count based on the number of CPUs.
+        bool            includeNonLinear;   ///< Whether to index non-linear spine items (default is `true`).
+
+        Options() : threadCount(0), includeNonLinear(true) {}
+    };
+
+private:
+                    SearchIndex(const SearchIndex&)         _DELETED_;
+    SearchIndex&    operator=(const SearchIndex&)           _DELETED_;
+
+public:
+    /**
+     Creates an empty index, to which documents are added with AddDocument().
+     @param identity Identifies the indexed content, e.g. the package's UniqueID().
+     */
+    EPUB3_EXPORT    SearchIndex(const string& identity=string());
+    virtual         ~SearchIndex();
+
+    /**
+     Builds an index of a package's spine documents.
+     @param package The package to index.
+     @param options Controls the build.
+     @result A finished index.
+     */
+    EPUB3_EXPORT
+    static SearchIndexPtr   Build(ConstPackagePtr package, const Options& options=Options());
+
+    /**
+     The file in which the index for a package is saved by default: the path of the
+     publication with `.search` appended.
+     */
+    EPUB3_EXPORT
+    static string           DefaultPathFor(ConstPackagePtr package);
+
+    /**
+     Loads an index written by Save().
+     @param path The file to load.
+     @param identity If not empty, the index is only loaded if it was built from
+     content with the same identity.
+     @result The index, or `nullptr` if the file can't be read, is not a valid
+     index, or was built from different content.
+     */
+    EPUB3_EXPORT
+    static SearchIndexPtr   Load(const string& path, const string& identity=string());
+
+    ///
+    /// Writes a finished index to a file.
+    EPUB3_EXPORT
+    bool                    Save(const string& path)                        const;
+
+    /**
+     Adds the text of a content document.
+
+     May be called from several threads at once. Documents may be added in any
+     order; hits are always returned in spine order.
+     @param spineIndex The index of the document's spine item.
+     @param spineCFI The CFI of the spine item, e.g. from Package::CFIForSpineItem(),
+     to which document paths are appended.
+     @param bytes The (decrypted) content of the document.
+     @param length The number of bytes of content.
+     @param isHTML `true` to parse the content as HTML rather than XML.
+     @result `false` if the document couldn't be parsed.
+     @throws std::logic_error if the index has already been finished.
+     */
+    EPUB3_EXPORT
+    bool                    AddDocument(size_t spineIndex, const CFI& spineCFI, const void* bytes, size_t length, bool isHTML=false);
+
+    /**
+     Compacts the words added so far into their final, searchable form.
+     Searches made before this is called find nothing.
+     */
+    EPUB3_EXPORT
+    void                    Finish();
+
+    ///
+    /// Returns every occurrence of a phrase, in reading order.
+    EPUB3_EXPORT
+    HitList                 Search(const string& query, size_t limit=0)      const;
+
+    ///
+    /// The identity given when the index was created.
+    const string&           Identity()                                      const   { return _identity; }
+    ///
+    /// The number of documents indexed.
+    size_t                  DocumentCount()                                 const   { return _documents.size(); }
+    ///
+    /// The number of words indexed.
+    EPUB3_EXPORT
+    size_t                  WordCount()                                     const;
+    ///
+    /// The number of distinct (folded) words indexed.
+    size_t                  TermCount()                                     const   { return _terms.size(); }
+    ///
+    /// The number of bytes used by the word occurrence lists.
+    size_t                  PostingBytes()                                  const   { return _postings.size(); }
+
+    ///
+    /// Splits text into folded words, as done for indexed content and queries.
+    EPUB3_EXPORT
+    static std::vector<string>  Words(const string& text);
+
+protected:
+    ///
+    /// Where a word appears: UTF-16 offsets within a character data step.
+    struct WordLocation
+    {
+        uint32_t        run;            ///< Index of the character data step in Document::runs.
+        uint32_t        start;
+        uint32_t        end;
+    };
+
+    struct Document
+    {
+        uint32_t                    spineIndex;
+        std::string                 spineCFI;       ///< The spine item's CFI, without the `epubcfi()` wrapper.
+        std::vector<std::string>    runs;           ///< Document paths of the character data steps containing words.
+        std::vector<WordLocation>   words;          ///< Indexed by word position.
+    };
+
+    ///
+    /// A word occurrence: the document (by index in _documents) and word position.
+    typedef std::pair<uint32_t, uint32_t>   Posting;
+    typedef std::vector<Posting>            PostingList;
+
+    string                          _identity;
+    std::vector<Document>           _documents;     ///< In spine order, once finished.
+    std::vector<std::string>        _terms;         ///< Sorted.
+    std::vector<uint32_t>           _offsets;       ///< Start of each term's postings in _postings.
+    std::string                     _postings;      ///< Variable-length, delta-encoded postings.
+    bool                            _finished;
+
+    std::mutex                      _lock;          ///< Guards the pending state while building.
+    std::unordered_map<std::string, PostingList>    _pending;
+
+    ///
+    /// Decodes the postings of the term at a given index.
+    void                    DecodePostings(size_t term, PostingList& out)           const;
+    ///
+    /// Returns the postings of a word, or of all words beginning with it.
+    PostingList             PostingsFor(const std::string& word, bool prefix)       const;
+    ///
+    /// Builds the ranged CFI for a run of words.
+    CFI                     CFIForWords(const Document& doc, uint32_t first, uint32_t last)  const;
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif  // EPUB_USE(LIBXML2)
+
+#endif /* defined(__ePub3__search_index__) */
@@ -19,12 +19,206 @@
 //  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "signatures.h"
+#include "xpath_wrangler.h"
 
 EPUB3_BEGIN_NAMESPACE
 
-DigitalSignature::DigitalSignature(shared_ptr<xml::Node> signatureNode)
+static inline XPathWrangler SignatureXPath(shared_ptr<xml::Node> node)
 {
+#if EPUB_COMPILER_SUPPORTS(CXX_INITIALIZER_LISTS)
+    return XPathWrangler(node->Document(), {{"dsig", XMLDSigNamespaceURI}});
+#else
+    XPathWrangler::NamespaceList nsList;
+    nsList["dsig"] = XMLDSigNamespaceURI;
+    return XPathWrangler(node->Document(), nsList);
+#endif
+}
+
+static inline int Base64Value(char ch)
+{
+    if ( ch >= 'A' && ch <= 'Z' )
+        return ch - 'A';
+    if ( ch >= 'a' && ch <= 'z' )
+        return ch - 'a' + 26;
+    if ( ch >= '0' && ch <= '9' )
+        return ch - '0' + 52;
+    if ( ch == '+' )
+        return 62;
+    if ( ch == '/' )
+        return 63;
+    return -1;
+}
+
+static inline int HexValue(char ch)
+{
+    if ( ch >= '0' && ch <= '9' )
+        return ch - '0';
+    if ( ch >= 'a' && ch <= 'f' )
+        return ch - 'a' + 10;
+    if ( ch >= 'A' && ch <= 'F' )
+        return ch - 'A' + 10;
+    return -1;
+}
+
+DigestValue DigestValue::FromBase64(const string& str)
+{
+    bytes_type bytes;
+    bytes.reserve((str.size() * 3) / 4);
+    
+    uint32_t accumulator = 0;
+    int bits = 0;
+    for ( char ch : str.stl_str() )
+    {
+        if ( ch == '=' )
+            break;
+        if ( isspace(static_cast<unsigned char>(ch)) )
+            continue;
+        
+        int value = Base64Value(ch);
+        if ( value < 0 )
+            return DigestValue();
+        
+        accumulator = (accumulator << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if ( bits >= 8 )
+        {
+            bits -= 8;
+            bytes.push_back(static_cast<uint8_t>((accumulator >> bits) & 0xFF));
+        }
+    }
+    
+    return DigestValue(bytes);
+}
+
+bool SignatureReference::ParseXML(shared_ptr<xml::Node> node)
+{
+    XPathWrangler xpath = SignatureXPath(node);
+    
+    _uri = _getProp(node, "URI");
+    
+    auto strings = xpath.Strings("./dsig:DigestMethod/@Algorithm", node);
+    if ( strings.empty() )
+        return false;
+    _digestMethod = strings[0];
+    
+    strings = xpath.Strings("./dsig:DigestValue", node);
+    if ( strings.empty() )
+        return false;
+    _digest = DigestValue::FromBase64(strings[0]);
+    if ( _digest.Empty() )
+        return false;
+    
+    _transforms.clear();
+    for ( auto& algorithm : xpath.Strings("./dsig:Transforms/dsig:Transform/@Algorithm", node) )
+    {
+        _transforms.emplace_back(algorithm);
+    }
+    
+    return true;
+}
+string SignatureReference::ContainerPath() const
+{
+    const std::string& uri = _uri.stl_str();
+    if ( uri.empty() || uri[0] == '#' )
+        return string();
+    
+    // absolute URIs (anything with a scheme) don't refer to container items
+    std::string::size_type colon = uri.find(':');
+    if ( colon != std::string::npos && colon < uri.find('/') )
+        return string();
     
+    std::string::size_type start = uri.find_first_not_of('/');
+    std::string::size_type end = std::min(uri.find_first_of("?#"), uri.size());
+    if ( start == std::string::npos || start >= end )
+        return string();
+    
+    std::string path;
+    path.reserve(end - start);
+    for ( std::string::size_type i = start; i < end; i++ )
+    {
+        if ( uri[i] == '%' && i+2 < uri.size() && HexValue(uri[i+1]) >= 0 && HexValue(uri[i+2]) >= 0 )
+        {
+            path.push_back(static_cast<char>((HexValue(uri[i+1]) << 4) | HexValue(uri[i+2])));
+            i += 2;
+        }
+        else
+        {
+            path.push_back(uri[i]);
+        }
+    }
+    
+    return path;
+}
+
+bool SignedInfo::ParseXML(shared_ptr<xml::Node> node)
+{
+    XPathWrangler xpath = SignatureXPath(node);
+    
+    auto strings = xpath.Strings("./dsig:CanonicalizationMethod/@Algorithm", node);
+    if ( !strings.empty() )
+        _canonicalizationMethod = strings[0];
+    
+    strings = xpath.Strings("./dsig:SignatureMethod/@Algorithm", node);
+    if ( !strings.empty() )
+        _signatureMethod = strings[0];
+    
+    _references.clear();
+    for ( auto refNode : xpath.Nodes("./dsig:Reference", node) )
+    {
+        SignatureReference ref;
+        if ( ref.ParseXML(refNode) )
+            _references.push_back(std::move(ref));
+    }
+    
+    return true;
+}
+
+bool SignatureObject::ParseXML(shared_ptr<xml::Node> node)
+{
+    XPathWrangler xpath = SignatureXPath(node);
+    
+    for ( auto refNode : xpath.Nodes("./dsig:Manifest/dsig:Reference", node) )
+    {
+        SignatureReference ref;
+        if ( ref.ParseXML(refNode) )
+            _references.push_back(std::move(ref));
+    }
+    
+    return true;
+}
+
+DigitalSignature::DigitalSignature(shared_ptr<xml::Node> signatureNode) : _signedInfo(), _keyInfo(), _object()
+{
+    if ( !bool(signatureNode) )
+        return;
+    
+    XPathWrangler xpath = SignatureXPath(signatureNode);
+    
+    auto nodes = xpath.Nodes("./dsig:SignedInfo", signatureNode);
+    if ( !nodes.empty() )
+    {
+        _signedInfo.reset(new class SignedInfo());
+        _signedInfo->ParseXML(nodes[0]);
+    }
+    
+    nodes = xpath.Nodes("./dsig:Object", signatureNode);
+    if ( !nodes.empty() )
+    {
+        _object.reset(new class SignatureObject());
+        for ( auto objNode : nodes )
+        {
+            _object->ParseXML(objNode);
+        }
+    }
+}
+SignatureReferenceList DigitalSignature::AllReferences() const
+{
+    SignatureReferenceList result;
+    if ( bool(_signedInfo) )
+        result.insert(result.end(), _signedInfo->References().begin(), _signedInfo->References().end());
+    if ( bool(_object) )
+        result.insert(result.end(), _object->ManifestReferences().begin(), _object->ManifestReferences().end());
+    return result;
 }
 DigitalSignature& DigitalSignature::operator=(DigitalSignature&& o)
 {
@@ -22,20 +22,194 @@
 #define __ePub3__signatures__
 
 #include <ePub3/epub3.h>
+#include <vector>
 
 EPUB3_BEGIN_NAMESPACE
 
-class SignatureTransform {};
-class SignedInfo {};
-class DigestValue {};
+/**
+ The raw bytes of an XML-DSig `<DigestValue>`.
+ 
+ The XML representation is base64-encoded; this class holds the decoded bytes so
+ they can be compared directly against the output of a hash function.
+ @ingroup epub-model
+ */
+class DigestValue
+{
+public:
+    typedef std::vector<uint8_t>    bytes_type;
+    
+public:
+                    DigestValue() : _bytes() {}
+                    DigestValue(const bytes_type& bytes) : _bytes(bytes) {}
+                    DigestValue(const uint8_t* bytes, size_t len) : _bytes(bytes, bytes+len) {}
+                    DigestValue(const DigestValue& o) : _bytes(o._bytes) {}
+                    DigestValue(DigestValue&& o) : _bytes(std::move(o._bytes)) {}
+    
+    DigestValue&    operator=(const DigestValue& o)     { _bytes = o._bytes; return *this; }
+    DigestValue&    operator=(DigestValue&& o)          { _bytes = std::move(o._bytes); return *this; }
+    
+    /**
+     Decodes a base64 string, as found in XML-DSig documents.
+     
+     Whitespace is ignored. Any other character outside the base64 alphabet results in
+     an empty DigestValue.
+     */
+    EPUB3_EXPORT
+    static DigestValue  FromBase64(const string& str);
+    
+    const bytes_type&   Bytes()                 const   { return _bytes; }
+    size_t              Size()                  const   { return _bytes.size(); }
+    bool                Empty()                 const   { return _bytes.empty(); }
+    
+    bool                operator==(const DigestValue& o)    const   { return _bytes == o._bytes; }
+    bool                operator!=(const DigestValue& o)    const   { return _bytes != o._bytes; }
+    
+protected:
+    bytes_type          _bytes;
+    
+};
+
+/**
+ A single `<Transform>` applied to a referenced resource prior to digesting.
+ @ingroup epub-model
+ */
+class SignatureTransform
+{
+public:
+                        SignatureTransform(const string& algorithm=string()) : _algorithm(algorithm) {}
+    
+    ///
+    /// The transform algorithm URI.
+    const string&       Algorithm()             const   { return _algorithm; }
+    
+protected:
+    string              _algorithm;
+    
+};
+
+/**
+ An XML-DSig `<Reference>` element: a URI identifying a resource, the algorithm
+ used to digest it, and the expected digest.
+ 
+ In an OCF container, reference URIs are relative to the root of the container.
+ @see http://www.w3.org/TR/xmldsig-core1/#sec-Reference
+ @ingroup epub-model
+ */
+class SignatureReference
+{
+public:
+    typedef std::vector<SignatureTransform> TransformList;
+    
+public:
+                        SignatureReference() : _uri(), _digestMethod(), _digest(), _transforms() {}
+    
+    /**
+     Reads the contents of a `<Reference>` element.
+     @param node A `<Reference>` element in the XML-DSig namespace.
+     @result Returns `false` if the element has no `<DigestMethod>` or `<DigestValue>`.
+     */
+    EPUB3_EXPORT
+    bool                ParseXML(shared_ptr<xml::Node> node);
+    
+    ///
+    /// The resource URI, exactly as it appears in the document.
+    const string&       URI()                   const   { return _uri; }
+    void                SetURI(const string& uri)       { _uri = uri; }
+    
+    ///
+    /// The digest algorithm URI.
+    const string&       DigestMethod()          const   { return _digestMethod; }
+    void                SetDigestMethod(const string& alg)  { _digestMethod = alg; }
+    
+    ///
+    /// The expected digest of the resource.
+    const class DigestValue&    Digest()        const   { return _digest; }
+    void                SetDigest(const class DigestValue& d)   { _digest = d; }
+    
+    ///
+    /// Any transforms to apply to the resource before digesting it.
+    const TransformList&    Transforms()        const   { return _transforms; }
+    
+    /**
+     Returns the container-relative path of the referenced resource.
+     @result The path, or an empty string if the URI references something other
+     than an item within the container (e.g. a same-document `#fragment` reference).
+     */
+    EPUB3_EXPORT
+    string              ContainerPath()         const;
+    
+protected:
+    string              _uri;
+    string              _digestMethod;
+    class DigestValue   _digest;
+    TransformList       _transforms;
+    
+};
+
+typedef std::vector<SignatureReference>     SignatureReferenceList;
+
+/**
+ The `<SignedInfo>` element of a signature: the references covered directly by the
+ signature value.
+ @ingroup epub-model
+ */
+class SignedInfo
+{
+public:
+                        SignedInfo() : _canonicalizationMethod(), _signatureMethod(), _references() {}
+    
+    ///
+    /// Reads a `<SignedInfo>` element.
+    EPUB3_EXPORT
+    bool                ParseXML(shared_ptr<xml::Node> node);
+    
+    const string&       CanonicalizationMethod()    const   { return _canonicalizationMethod; }
+    const string&       SignatureMethod()           const   { return _signatureMethod; }
+    
+    const SignatureReferenceList&   References()    const   { return _references; }
+    
+protected:
+    string                  _canonicalizationMethod;
+    string                  _signatureMethod;
+    SignatureReferenceList  _references;
+    
+};
+
 class KeyInfo {};
-class SignatureObject {};
-class SignatureReference {};
+
+/**
+ An `<Object>` element of a signature.
+ 
+ OCF signatures typically list the signed resources in a `<Manifest>` inside an
+ `<Object>`, rather than directly within `<SignedInfo>`; those references are
+ gathered here.
+ @ingroup epub-model
+ */
+class SignatureObject
+{
+public:
+                        SignatureObject() : _references() {}
+    
+    ///
+    /// Reads an `<Object>` element, adding its manifest references to any already present.
+    EPUB3_EXPORT
+    bool                ParseXML(shared_ptr<xml::Node> node);
+    
+    ///
+    /// All references found within `<Manifest>` elements of the object.
+    const SignatureReferenceList&   ManifestReferences()    const   { return _references; }
+    
+protected:
+    SignatureReferenceList  _references;
+    
+};
 
 /**
  Encapsulates details of a digital signature in an EPUB container.
  
- @todo Implement.
+ The signed references are parsed, and may be checked against the container's
+ contents using an IntegrityVerifier.
+ @todo Implement signature value (key) validation.
  @ingroup epub-model
  */
 class DigitalSignature
@@ -88,6 +262,15 @@ public:
     void                        SetSignatureObject(class SignatureObject& __i) { _object.reset(&__i); }
     const class SignatureObject* SignatureObject()                  const   { return _object.get(); }
     
+    /**
+     Returns every resource reference in the signature.
+     
+     This includes the references in `<SignedInfo>` along with those in any
+     `<Manifest>` within the signature's `<Object>`.
+     */
+    EPUB3_EXPORT
+    SignatureReferenceList      AllReferences()                     const;
+    
     ///
     /// Performs validation of the digital signature.
     EPUB3_EXPORT
@@ -20,6 +20,7 @@
 
 #include "spine.h"
 #include "package.h"
+#include "xml_stream_reader.h"
 #include REGEX_INCLUDE
 
 EPUB3_BEGIN_NAMESPACE
@@ -43,19 +44,33 @@ bool SpineItem::ParseXML(shared_ptr<xml::Node> node)
     if ( _getProp(node, "linear").tolower() == "no" )
         _linear = false;
     
-    auto holder = CastPtr<PropertyHolder>();
+    AddPropertiesFromAttribute(_getProp(node, "properties"));
+    return true;
+}
+#if EPUB_USE(LIBXML2)
+bool SpineItem::ParseXML(const XMLStreamReader& reader)
+{
+    SetXMLIdentifier(reader.Attribute("id"));
+    _idref = reader.Attribute("idref");
+    if ( reader.Attribute("linear").tolower() == "no" )
+        _linear = false;
+    
+    AddPropertiesFromAttribute(reader.Attribute("properties"));
+    return true;
+}
+#endif
+void SpineItem::AddPropertiesFromAttribute(const string& properties)
+{
+    if ( properties.empty() )
+        return;
     
-    string properties = _getProp(node, "properties");
-    if ( !properties.empty() )
+    auto holder = CastPtr<PropertyHolder>();
+    for ( auto& property : properties.split(REGEX_NS::regex(",?\\s+")) )
     {
-        for ( auto& property : properties.split(REGEX_NS::regex(",?\\s+")) )
-        {
-            PropertyPtr prop = Property::New(holder);
-            prop->SetPropertyIdentifier(this->PropertyIRIFromString(property));
-            this->AddProperty(prop);
-        }
+        PropertyPtr prop = Property::New(holder);
+        prop->SetPropertyIdentifier(this->PropertyIRIFromString(property));
+        this->AddProperty(prop);
     }
-    return true;
 }
 shared_ptr<ManifestItem> SpineItem::ManifestItem() const
 {
@@ -69,15 +84,25 @@ PageSpread SpineItem::Spread() const
     if ( NumberOfProperties() == 0 )
         return PageSpread::Automatic;
     
+    // Property::SetPropertyIdentifier() splits these into a 'page-spread' identifier
+    //  with the full name as its value
+    static const IRI PageSpreadPropertyIRI("http://idpf.org/epub/vocab/package/#page-spread");
+    
     bool left = false, right = false;
     ForEachProperty([&](PropertyPtr item) {
         // return early if both set
         if ( left && right )
             return;
         
-        if ( !left && item->PropertyIdentifier() == PageSpreadLeftPropertyIRI )
+        const IRI& identifier = item->PropertyIdentifier();
+        if ( identifier == PageSpreadPropertyIRI )
+        {
+            left = left || item->Value() == "page-spread-left";
+            right = right || item->Value() == "page-spread-right";
+        }
+        else if ( !left && identifier == PageSpreadLeftPropertyIRI )
             left = true;
-        else if ( !right && item->PropertyIdentifier() == PageSpreadRightPropertyIRI )
+        else if ( !right && identifier == PageSpreadRightPropertyIRI )
             right = true;
     });
     
@@ -30,6 +30,8 @@
 
 EPUB3_BEGIN_NAMESPACE
 
+class XMLStreamReader;
+
 /**
  The SpineItem class provides access to the spine of a publication.
  
@@ -110,6 +112,12 @@ public:
     
     EPUB3_EXPORT
     bool                ParseXML(shared_ptr<xml::Node> node);
+#if EPUB_USE(LIBXML2)
+    ///
+    /// Reads the item from the `<itemref>` start tag on which a stream reader is positioned.
+    EPUB3_EXPORT
+    bool                ParseXML(const XMLStreamReader& reader);
+#endif
     
     /// @{
     /// @name Metadata
@@ -211,6 +219,10 @@ protected:
     
     EPUB3_EXPORT
     void SetNextItem(const shared_ptr<SpineItem>& next);
+    
+    ///
+    /// Adds a property for each value in an `itemref` element's `properties` attribute.
+    void AddPropertiesFromAttribute(const string& properties);
 };
 
 EPUB3_END_NAMESPACE
@@ -57,6 +57,16 @@ void SwitchPreprocessor::Register()
 {
     FilterManager::Instance()->RegisterFilter("SwitchPreprocessor", SwitchStaticHandling, SwitchFilterFactory);
 }
+string SwitchPreprocessor::CacheIdentity() const
+{
+    string identity("SwitchPreprocessor");
+    for ( auto& ns : _supportedNamespaces )
+    {
+        identity += " ";
+        identity += ns;
+    }
+    return identity;
+}
 void * SwitchPreprocessor::FilterData(FilterContext* context, void *data, size_t len, size_t *outputLen)
 {
     char* input = reinterpret_cast<char*>(data);
@@ -92,6 +92,10 @@ public:
      */
     virtual void * FilterData(FilterContext* context, void *data, size_t len, size_t *outputLen) OVERRIDE;
     
+    ///
+    /// The output depends on the supported namespaces, which are part of the identity.
+    virtual string CacheIdentity() const OVERRIDE;
+    
     ///
     /// Register this filter with the filter manager
     static void Register();
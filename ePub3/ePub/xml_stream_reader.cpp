@@ -0,0 +1,302 @@
+//
+//  xml_stream_reader.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "xml_stream_reader.h"
+#include <atomic>
+#include <cstring>
+
+#if EPUB_USE(LIBXML2)
+
+EPUB3_BEGIN_NAMESPACE
+
+static std::atomic<bool> gStreamingEnabled(true);
+
+// takes ownership of a libxml2 string
+static string _TakeXmlString(xmlChar* ch)
+{
+    if ( ch == nullptr )
+        return string::EmptyString;
+    string result(ch);
+    xmlFree(ch);
+    return result;
+}
+
+XMLStreamReader::XMLStreamReader(unique_ptr<ArchiveReader>&& reader, const string& url, int options)
+    : _reader(nullptr), _input(std::move(reader)), _start(false), _pendingEnd(false), _positioned(false), _failed(false), _depth(-1)
+{
+    if ( !bool(_input) )
+        return;
+
+    _reader = xmlReaderForIO(&XMLStreamReader::ReadCallback, &XMLStreamReader::CloseCallback, this, url.c_str(), nullptr, options);
+    if ( _reader != nullptr )
+        xmlTextReaderSetErrorHandler(_reader, &XMLStreamReader::ErrorCallback, this);
+}
+XMLStreamReader::XMLStreamReader(const void* bytes, size_t length, const string& url, int options)
+    : _reader(nullptr), _input(), _start(false), _pendingEnd(false), _positioned(false), _failed(false), _depth(-1)
+{
+    _reader = xmlReaderForMemory(reinterpret_cast<const char*>(bytes), static_cast<int>(length), url.c_str(), nullptr, options);
+    if ( _reader != nullptr )
+        xmlTextReaderSetErrorHandler(_reader, &XMLStreamReader::ErrorCallback, this);
+}
+XMLStreamReader::~XMLStreamReader()
+{
+    if ( _reader != nullptr )
+        xmlFreeTextReader(_reader);
+}
+bool XMLStreamReader::Enabled()
+{
+    return gStreamingEnabled;
+}
+void XMLStreamReader::SetEnabled(bool enabled)
+{
+    gStreamingEnabled = enabled;
+}
+bool XMLStreamReader::Next()
+{
+    if ( _reader == nullptr || _failed )
+        return false;
+
+    if ( _pendingEnd )
+    {
+        // an empty element, or one we've skipped: the end tag has already been read past
+        _pendingEnd = false;
+        _start = false;
+        return true;
+    }
+
+    for ( ;; )
+    {
+        int ret = 1;
+        if ( _positioned )
+            _positioned = false;
+        else
+            ret = xmlTextReaderRead(_reader);
+
+        if ( ret != 1 )
+        {
+            if ( ret < 0 )
+            {
+                _failed = true;
+                if ( _errorMessage.empty() )
+                    _errorMessage = "XML parser error";
+            }
+            return false;
+        }
+
+        int type = xmlTextReaderNodeType(_reader);
+        if ( type != XML_READER_TYPE_ELEMENT && type != XML_READER_TYPE_END_ELEMENT )
+            continue;
+
+        const xmlChar* ch = xmlTextReaderConstLocalName(_reader);
+        _name = (ch == nullptr ? string::EmptyString : string(ch));
+        ch = xmlTextReaderConstNamespaceUri(_reader);
+        _namespaceURI = (ch == nullptr ? string::EmptyString : string(ch));
+        _depth = xmlTextReaderDepth(_reader);
+        _start = (type == XML_READER_TYPE_ELEMENT);
+        _pendingEnd = (_start && xmlTextReaderIsEmptyElement(_reader) == 1);
+        return true;
+    }
+}
+bool XMLStreamReader::NextChild(int depth)
+{
+    // already at the parent's end tag
+    if ( !_start && _depth <= depth )
+        return false;
+
+    // leave any unread content of the previous child behind
+    if ( _start && _depth > depth )
+        Skip();
+
+    while ( Next() )
+    {
+        if ( _start )
+        {
+            if ( _depth == depth + 1 )
+                return true;
+            Skip();
+        }
+        else if ( _depth <= depth )
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+void XMLStreamReader::Skip()
+{
+    if ( !_start || _reader == nullptr || _failed )
+        return;
+
+    _start = false;
+    if ( _pendingEnd )
+    {
+        _pendingEnd = false;
+        return;
+    }
+
+    // xmlTextReaderNext() moves past the end tag, to the following node
+    int ret = xmlTextReaderNext(_reader);
+    if ( ret < 0 )
+    {
+        _failed = true;
+        if ( _errorMessage.empty() )
+            _errorMessage = "XML parser error";
+        return;
+    }
+
+    _positioned = (ret == 1);
+}
+bool XMLStreamReader::Is(const char* name, const char* nsURI) const
+{
+    if ( _name != name )
+        return false;
+    return nsURI == nullptr || _namespaceURI == nsURI;
+}
+string XMLStreamReader::Attribute(const char* name, const char* nsURI) const
+{
+    if ( !_start )
+        return string::EmptyString;
+
+    xmlNodePtr node = xmlTextReaderCurrentNode(_reader);
+    if ( node == nullptr )
+        return string::EmptyString;
+
+    // the same lookup as xml::Node::AttributeValue()
+    xmlChar* ch = nullptr;
+    if ( nsURI != nullptr && *nsURI != '\0' )
+        ch = xmlGetNsProp(node, BAD_CAST name, BAD_CAST nsURI);
+    if ( ch == nullptr )
+        ch = xmlGetProp(node, BAD_CAST name);
+    return _TakeXmlString(ch);
+}
+string XMLStreamReader::Language() const
+{
+    if ( !_start )
+        return string::EmptyString;
+
+    xmlNodePtr node = xmlTextReaderCurrentNode(_reader);
+    if ( node == nullptr )
+        return string::EmptyString;
+    return _TakeXmlString(xmlNodeGetLang(node));
+}
+string XMLStreamReader::Content()
+{
+    if ( !_start )
+        return string::EmptyString;
+
+    xmlNodePtr node = xmlTextReaderExpand(_reader);
+    if ( node == nullptr )
+    {
+        _failed = true;
+        return string::EmptyString;
+    }
+    return _TakeXmlString(xmlNodeGetContent(node));
+}
+string XMLStreamReader::FirstText()
+{
+    if ( !_start )
+        return string::EmptyString;
+
+    xmlNodePtr node = xmlTextReaderExpand(_reader);
+    if ( node == nullptr )
+    {
+        _failed = true;
+        return string::EmptyString;
+    }
+
+    for ( xmlNodePtr child = node->children; child != nullptr; child = child->next )
+    {
+        if ( child->type == XML_TEXT_NODE || child->type == XML_CDATA_SECTION_NODE )
+            return (child->content == nullptr ? string::EmptyString : string(child->content));
+    }
+    return string::EmptyString;
+}
+shared_ptr<xml::Document> XMLStreamReader::ExpandedDocument()
+{
+    if ( !_start )
+        return nullptr;
+
+    xmlNodePtr node = xmlTextReaderExpand(_reader);
+    if ( node == nullptr )
+    {
+        _failed = true;
+        return nullptr;
+    }
+
+    xmlDocPtr doc = xmlNewDoc(BAD_CAST "1.0");
+    xmlNodePtr root = xmlDocCopyNode(node, doc, 1);
+    if ( root == nullptr )
+    {
+        xmlFreeDoc(doc);
+        return nullptr;
+    }
+    xmlDocSetRootElement(doc, root);
+
+    // carry over the namespaces in scope, even those which aren't used by element
+    // or attribute names (XPath expressions and QName values may refer to them)
+    xmlNsPtr* namespaces = xmlGetNsList(node->doc, node);
+    if ( namespaces != nullptr )
+    {
+        for ( xmlNsPtr* ns = namespaces; *ns != nullptr; ++ns )
+        {
+            if ( xmlSearchNs(doc, root, (*ns)->prefix) == nullptr )
+                xmlNewNs(root, (*ns)->href, (*ns)->prefix);
+        }
+        xmlFree(namespaces);
+    }
+
+    // and the inherited language
+    if ( xmlHasNsProp(node, BAD_CAST "lang", XML_XML_NAMESPACE) == nullptr )
+    {
+        xmlChar* lang = xmlNodeGetLang(node);
+        if ( lang != nullptr )
+        {
+            xmlNodeSetLang(root, lang);
+            xmlFree(lang);
+        }
+    }
+
+    Skip();
+    return xml::Wrapped<xml::Document>(doc);
+}
+int XMLStreamReader::ReadCallback(void* context, char* buffer, int len)
+{
+    XMLStreamReader* self = reinterpret_cast<XMLStreamReader*>(context);
+    ssize_t num = self->_input->read(buffer, static_cast<size_t>(len));
+    return (num < 0 ? -1 : static_cast<int>(num));
+}
+int XMLStreamReader::CloseCallback(void* context)
+{
+    return 0;
+}
+void XMLStreamReader::ErrorCallback(void* arg, const char* msg, xmlParserSeverities severity, xmlTextReaderLocatorPtr locator)
+{
+    // warnings are ignored; errors stop the reader, which then returns -1
+    if ( severity != XML_PARSER_SEVERITY_ERROR )
+        return;
+
+    XMLStreamReader* self = reinterpret_cast<XMLStreamReader*>(arg);
+    if ( self->_errorMessage.empty() && msg != nullptr )
+        self->_errorMessage = _Str(msg, " (line ", xmlTextReaderLocatorLineNumber(locator), ")");
+}
+
+EPUB3_END_NAMESPACE
+
+#endif  // EPUB_USE(LIBXML2)
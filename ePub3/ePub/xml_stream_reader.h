@@ -0,0 +1,226 @@
+//
+//  xml_stream_reader.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__xml_stream_reader__
+#define __ePub3__xml_stream_reader__
+
+#include <ePub3/epub3.h>
+#include <ePub3/archive.h>
+#include <ePub3/utilities/utfstring.h>
+#include <ePub3/xml/document.h>
+#include <memory>
+#include <vector>
+
+#if EPUB_USE(LIBXML2)
+#include <libxml/xmlreader.h>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A forward-only reader delivering the elements of an XML document in a single
+ pass, without building a DOM.
+
+ This is used to load package documents, navigation documents, NCX files and
+ `encryption.xml`, where building a full xml::Document (and then running XPath
+ over it) costs several times the size of the file in memory and dominates the
+ time taken to open a large publication.
+
+ The reader stops on the start and end tag of every element; an empty element
+ (`<a/>`) is reported as a start tag immediately followed by an end tag.
+ Attributes, the language and the text content of an element are available while
+ the reader is on its start tag, and follow the same rules as the corresponding
+ xml::Node methods (_getProp(), xml::Node::Language() and xml::Node::Content()).
+
+ Parts of a document which are best handled by existing DOM-based code (such as
+ `<collection>` elements and glossaries) can be copied out into a small standalone
+ document with ExpandedDocument().
+
+ Unlike the DOM loaders, which use libxml2's recovery mode, the reader stops at
+ the first well-formedness error. Callers should then check Failed() and load the
+ document through the DOM instead. Errors are not printed by the reader, so that
+ they are reported only once, by the DOM parser; likewise, callers hold back the
+ spec errors raised while streaming with a DeferredErrors, and discard them if the
+ DOM pass is to report them again.
+ @ingroup utilities
+ */
+class XMLStreamReader
+{
+private:
+                        XMLStreamReader()                           _DELETED_;
+                        XMLStreamReader(const XMLStreamReader&)     _DELETED_;
+    XMLStreamReader&    operator=(const XMLStreamReader&)           _DELETED_;
+
+public:
+    ///
+    /// The libxml2 parser options used by default; the same as the DOM loaders use.
+    static CONSTEXPR int DefaultOptions = XML_PARSE_RECOVER|XML_PARSE_NOENT|XML_PARSE_DTDATTR;
+
+    /**
+     Creates a reader for a file in an archive.
+     @param reader The archive reader to take the document from. The stream reader
+     takes ownership of it.
+     @param url The path of the document, used in error messages and to resolve
+     relative references.
+     @param options libxml2 parser options.
+     */
+    EPUB3_EXPORT        XMLStreamReader(unique_ptr<ArchiveReader>&& reader, const string& url, int options=DefaultOptions);
+
+    /**
+     Creates a reader for a document in memory.
+     @param bytes The document. This must remain valid for the lifetime of the reader.
+     @param length The number of bytes in the document.
+     @param url The path of the document.
+     @param options libxml2 parser options.
+     */
+    EPUB3_EXPORT        XMLStreamReader(const void* bytes, size_t length, const string& url, int options=DefaultOptions);
+    EPUB3_EXPORT        ~XMLStreamReader();
+
+    /**
+     Whether documents are loaded with stream readers rather than into a DOM.
+
+     This defaults to `true`. Turning it off loads every package, navigation
+     document and `encryption.xml` through the DOM, as before.
+     */
+    EPUB3_EXPORT
+    static bool         Enabled();
+    ///
+    /// Turns streaming loads on or off for all subsequently-opened containers.
+    EPUB3_EXPORT
+    static void         SetEnabled(bool enabled);
+
+    ///
+    /// `true` if the document could be opened for reading.
+    bool                IsOpen()                    const   { return _reader != nullptr; }
+
+    /**
+     Moves to the next start or end tag.
+     @result `false` at the end of the document or if an error occurred.
+     */
+    EPUB3_EXPORT
+    bool                Next();
+
+    /**
+     Moves to the next start tag of a child of the element whose start tag the
+     reader was on at `depth`.
+     @param depth The Depth() of the parent element.
+     @result `false` once the parent's end tag is reached (the reader is then on
+     that end tag, and further calls do nothing), at the end of the document, or if
+     an error occurred.
+     */
+    EPUB3_EXPORT
+    bool                NextChild(int depth);
+
+    /**
+     Skips the content of the current element, moving the reader to its end tag.
+     Does nothing if the reader is already on an end tag.
+     */
+    EPUB3_EXPORT
+    void                Skip();
+
+    ///
+    /// `true` if an error stopped the reader before the end of the document.
+    bool                Failed()                    const   { return _failed; }
+    ///
+    /// The message of the error which stopped the reader, if any.
+    const string&       ErrorMessage()              const   { return _errorMessage; }
+
+    ///
+    /// `true` if the reader is on a start tag, `false` if it is on an end tag.
+    bool                IsStartElement()            const   { return _start; }
+    ///
+    /// The nesting level of the current element; the root element is at depth 0.
+    int                 Depth()                     const   { return _depth; }
+    ///
+    /// The local name of the current element.
+    const string&       Name()                      const   { return _name; }
+    ///
+    /// The namespace URI of the current element.
+    const string&       NamespaceURI()              const   { return _namespaceURI; }
+    ///
+    /// `true` if the reader is on the start or end tag of the given element.
+    bool                Is(const char* name, const char* nsURI=nullptr)     const;
+
+    /**
+     Reads an attribute of the current element, in the same way as _getProp().
+     @param name The local name of the attribute.
+     @param nsURI The namespace of the attribute. If the element has no such
+     attribute in this namespace, any attribute with the given local name is used.
+     @result The attribute's value, or an empty string if it has none or the
+     reader isn't on a start tag.
+     */
+    EPUB3_EXPORT
+    string              Attribute(const char* name, const char* nsURI="")   const;
+
+    ///
+    /// The language of the current element, including any inherited from its ancestors.
+    EPUB3_EXPORT
+    string              Language()                                          const;
+
+    /**
+     Returns the text of the current element and all its descendants.
+
+     The reader stays on the element's start tag, and goes on to read its content
+     as usual; use Skip() to ignore it.
+     */
+    EPUB3_EXPORT
+    string              Content();
+
+    /**
+     Returns the first text node directly inside the current element, which is the
+     value of the XPath `./text()[1]`.
+     */
+    EPUB3_EXPORT
+    string              FirstText();
+
+    /**
+     Copies the current element and its descendants into a new document, as its
+     root, and moves the reader to the element's end tag.
+
+     Namespace declarations and the `xml:lang` in scope are carried over to the new
+     root element.
+     @result The new document, or `nullptr` if the reader isn't on a start tag or
+     an error occurred.
+     */
+    EPUB3_EXPORT
+    shared_ptr<xml::Document>   ExpandedDocument();
+
+protected:
+    xmlTextReaderPtr            _reader;
+    unique_ptr<ArchiveReader>   _input;
+
+    bool                        _start;
+    bool                        _pendingEnd;    ///< The next event is the end tag of the current element, which has already been read past.
+    bool                        _positioned;    ///< The libxml2 reader is already on the next node.
+    bool                        _failed;
+    int                         _depth;
+    string                      _name;
+    string                      _namespaceURI;
+    string                      _errorMessage;
+
+    static int                  ReadCallback(void* context, char* buffer, int len);
+    static int                  CloseCallback(void* context);
+    static void                 ErrorCallback(void* arg, const char* msg, xmlParserSeverities severity, xmlTextReaderLocatorPtr locator);
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif  // EPUB_USE(LIBXML2)
+
+#endif /* defined(__ePub3__xml_stream_reader__) */
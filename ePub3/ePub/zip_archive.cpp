@@ -22,9 +22,14 @@
 #include <libzip/zipint.h>
 #include "byte_stream.h"
 #include "make_unique.h"
+#include "instrumentation.h"
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <vector>
 #if EPUB_OS(UNIX)
 #include <unistd.h>
 #endif
@@ -76,21 +81,22 @@ static string GetTempFilePath(const string& ext)
 #else
     ss << "/tmp/epub3.XXXXXX." << ext;
 #endif
-    string path(ss.str());
+    std::string path(ss.str());
     
-    char *buf = new char[path.length()];
-    std::char_traits<char>::copy(buf, ss.str().c_str(), sizeof(buf));
+    // mkstemp() fills in the template in place, so it needs a writable, terminated copy
+    std::vector<char> buf(path.begin(), path.end());
+    buf.push_back('\0');
 
 #if EPUB_OS(ANDROID)
-    int fd = ::mkstemp(buf);
+    int fd = ::mkstemp(buf.data());
 #else
-    int fd = ::mkstemps(buf, static_cast<int>(ext.size()+1));
+    int fd = ::mkstemps(buf.data(), static_cast<int>(ext.size()+1));
 #endif
     if ( fd == -1 )
         throw std::runtime_error(std::string("mkstemp() failed: ") + strerror(errno));
     
     ::close(fd);
-    return string(buf);
+    return string(buf.data());
 #endif
 }
 
@@ -102,7 +108,13 @@ public:
     virtual ~ZipReader() { if (_file != nullptr) zip_fclose(_file); }
     
     virtual bool operator !() const { return _file == nullptr || _file->bytes_left == 0; }
-	virtual ssize_t read(void* p, size_t len) const { return zip_fread(_file, p, len); }
+	virtual ssize_t read(void* p, size_t len) const
+    {
+        EPUB_MEASURE(measure, ArchiveRead);
+        ssize_t result = zip_fread(_file, p, len);
+        EPUB_MEASURE_BYTES(measure, result > 0 ? result : 0);
+        return result;
+    }
 
 	virtual size_t total_size() const { return _total_size; }
 	virtual size_t position() const { return _total_size - _file->bytes_left; }
@@ -117,10 +129,16 @@ class ZipWriter : public ArchiveWriter
     class DataBlob
     {
     public:
-        DataBlob() : _tmpPath(GetTempFilePath("tmp")), _fs(_tmpPath.c_str(), std::ios::in|std::ios::out|std::ios::binary|std::ios::trunc) {}
-        DataBlob(DataBlob&& o) : _tmpPath(std::move(o._tmpPath)), _fs(_tmpPath.c_str(), std::ios::in|std::ios::out|std::ios::binary|std::ios::trunc) {}
+        DataBlob() : _tmpPath(GetTempFilePath("tmp")), _fs(_tmpPath.c_str(), std::ios::in|std::ios::out|std::ios::binary|std::ios::trunc), _size(0), _readPos(0) {}
+        DataBlob(DataBlob&& o) : _tmpPath(std::move(o._tmpPath)), _fs(std::move(o._fs)), _size(o._size), _readPos(o._readPos) {
+            // the spooled data now belongs to this blob; don't reopen (and truncate) the file
+            o._tmpPath.clear();
+            o._size = o._readPos = 0;
+        }
         ~DataBlob() {
             _fs.close();
+            if ( _tmpPath.empty() )
+                return;
 #if EPUB_OS(WINDOWS)
             ::_unlink(_tmpPath.c_str());
 #else
@@ -130,15 +148,17 @@ class ZipWriter : public ArchiveWriter
         
         void Append(const void * data, size_t len);
         size_t Read(void *buf, size_t len);
+        void Rewind() { _readPos = 0; }
         
-        size_t Size() { return static_cast<size_t>(_fs.tellp()); }
-        size_t Size() const { return const_cast<DataBlob*>(this)->Size(); }
-        size_t Avail() { return Size() - static_cast<size_t>(_fs.tellg()); }
-        size_t Avail() const { return const_cast<DataBlob*>(this)->Avail(); }
+        size_t Size() const { return _size; }
+        size_t Avail() const { return _size - _readPos; }
         
     protected:
         string          _tmpPath;
         std::fstream    _fs;
+        // the get and put positions of a file stream are shared, so track both here
+        size_t          _size;
+        size_t          _readPos;
 
         DataBlob(const DataBlob&) _DELETED_;
     };
@@ -169,7 +189,7 @@ protected:
 ZipArchive::ZipItemInfo::ZipItemInfo(struct zip_stat & info) : ArchiveItemInfo()
 {
     SetPath(info.name);
-    SetIsCompressed(info.comp_method == ZIP_CM_STORE);
+    SetIsCompressed(info.comp_method != ZIP_CM_STORE);
     SetCompressedSize(static_cast<size_t>(info.comp_size));
     SetUncompressedSize(static_cast<size_t>(info.size));
 }
@@ -178,13 +198,16 @@ string ZipArchive::TempFilePath()
 {
     return GetTempFilePath("zip");
 }
-ZipArchive::ZipArchive(const string & path)
+ZipArchive::ZipArchive(const string & path) : _caseInsensitive(false)
 {
+    EPUB_MEASURE(measure, ArchiveOpen);
     int zerr = 0;
     _zip = zip_open(path.c_str(), ZIP_CREATE, &zerr);
     if ( _zip == nullptr )
         throw std::runtime_error(std::string("zip_open() failed: ") + zError(zerr));
     _path = path;
+    
+    BuildNameIndex();
 }
 ZipArchive::~ZipArchive()
 {
@@ -197,6 +220,9 @@ Archive & ZipArchive::operator = (ZipArchive &&o)
         zip_close(_zip);
     _zip = o._zip;
     o._zip = nullptr;
+    _nameIndex = std::move(o._nameIndex);
+    _foldedNameIndex = std::move(o._foldedNameIndex);
+    _caseInsensitive = o._caseInsensitive;
     return dynamic_cast<Archive&>(*this);
 }
 void ZipArchive::EachItem(std::function<void (const ArchiveItemInfo &)> fn) const
@@ -214,22 +240,34 @@ void ZipArchive::EachItem(std::function<void (const ArchiveItemInfo &)> fn) cons
 }
 bool ZipArchive::ContainsItem(const string & path) const
 {
-    return (zip_name_locate(_zip, Sanitized(path).c_str(), 0) >= 0);
+    return (IndexOfItem(path) >= 0);
 }
 bool ZipArchive::DeleteItem(const string & path)
 {
-    int idx = zip_name_locate(_zip, Sanitized(path).c_str(), 0);
-    if ( idx >= 0 )
-        return (zip_delete(_zip, idx) >= 0);
-    return false;
+    int idx = IndexOfItem(path);
+    if ( idx < 0 )
+        return false;
+    
+    RemoveFromNameIndex(idx);
+    if ( zip_delete(_zip, idx) < 0 )
+    {
+        AddToNameIndex(idx);
+        return false;
+    }
+    return true;
 }
 bool ZipArchive::CreateFolder(const string & path)
 {
-    return (zip_add_dir(_zip, Sanitized(path).c_str()) >= 0);
+    int idx = zip_add_dir(_zip, Sanitized(path).c_str());
+    if ( idx < 0 )
+        return false;
+    
+    AddToNameIndex(idx);
+    return true;
 }
 unique_ptr<ByteStream> ZipArchive::ByteStreamAtPath(const string &path) const
 {
-    return make_unique<ZipFileByteStream>(_zip, path);
+    return make_unique<ZipFileByteStream>(_zip, IndexOfItem(path));
 }
 
 #ifdef SUPPORT_ASYNC
@@ -244,7 +282,11 @@ unique_ptr<ArchiveReader> ZipArchive::ReaderAtPath(const string & path) const
     if (_zip == nullptr)
         return nullptr;
     
-    struct zip_file* file = zip_fopen(_zip, Sanitized(path).c_str(), 0);
+    int idx = IndexOfItem(path);
+    if (idx < 0)
+        return nullptr;
+    
+    struct zip_file* file = zip_fopen_index(_zip, idx, 0);
 
     if (file == nullptr)
         return nullptr;
@@ -256,7 +298,7 @@ unique_ptr<ArchiveWriter> ZipArchive::WriterAtPath(const string & path, bool com
     if (_zip == nullptr)
         return nullptr;
     
-    int idx = zip_name_locate(_zip, Sanitized(path).c_str(), (create ? ZIP_CREATE : 0));
+    int idx = IndexOfItem(path);
     if (idx == -1)
         return nullptr;
     
@@ -272,20 +314,141 @@ unique_ptr<ArchiveWriter> ZipArchive::WriterAtPath(const string & path, bool com
 ArchiveItemInfo ZipArchive::InfoAtPath(const string & path) const
 {
     struct zip_stat sbuf;
-    if ( zip_stat(_zip, Sanitized(path).c_str(), 0, &sbuf) < 0 )
+    int idx = IndexOfItem(path);
+    if ( idx < 0 )
+        throw std::runtime_error(std::string("zip_stat("+path.stl_str()+") - No such file"));
+    if ( zip_stat_index(_zip, idx, 0, &sbuf) < 0 )
         throw std::runtime_error(std::string("zip_stat("+path.stl_str()+") - " + zip_strerror(_zip)));
     return ZipItemInfo(sbuf);
 }
+unique_ptr<ByteStream> ZipArchive::ByteStreamAtIndex(int index) const
+{
+    return make_unique<ZipFileByteStream>(_zip, index);
+}
+ArchiveItemInfo ZipArchive::InfoAtIndex(int index) const
+{
+    struct zip_stat sbuf;
+    if ( zip_stat_index(_zip, index, 0, &sbuf) < 0 )
+        throw std::runtime_error(std::string("zip_stat_index() - ") + zip_strerror(_zip));
+    return ZipItemInfo(sbuf);
+}
+bool ZipArchive::FileRangeAtIndex(int index, FileRange& range) const
+{
+    return ZipFileByteStream::StoredFileRange(_zip, index, range);
+}
+int ZipArchive::IndexOfItem(const string & path) const
+{
+    if ( _zip == nullptr )
+        return -1;
+    
+    EPUB_MEASURE(measure, ArchiveLookup);
+    
+    // normalize the requested path once, then a single hash lookup
+    std::string name = Sanitized(path).stl_str();
+    
+    auto pos = _nameIndex.find(name);
+    if ( pos != _nameIndex.end() )
+        return pos->second;
+    
+    if ( _caseInsensitive )
+    {
+        pos = _foldedNameIndex.find(FoldedName(name));
+        if ( pos != _foldedNameIndex.end() )
+            return pos->second;
+    }
+    
+    return -1;
+}
+void ZipArchive::SetCaseInsensitiveLookup(bool caseInsensitive)
+{
+    if ( caseInsensitive == _caseInsensitive )
+        return;
+    
+    _caseInsensitive = caseInsensitive;
+    _foldedNameIndex.clear();
+    
+    if ( _caseInsensitive )
+    {
+        for ( auto& entry : _nameIndex )
+        {
+            // like zip_name_locate(), the first matching entry wins
+            auto inserted = _foldedNameIndex.emplace(FoldedName(entry.first), entry.second);
+            if ( !inserted.second && entry.second < inserted.first->second )
+                inserted.first->second = entry.second;
+        }
+    }
+}
+void ZipArchive::BuildNameIndex()
+{
+    _nameIndex.clear();
+    _foldedNameIndex.clear();
+    if ( _zip == nullptr )
+        return;
+    
+    int n = zip_get_num_files(_zip);
+    if ( n > 0 )
+        _nameIndex.reserve(static_cast<size_t>(n));
+    
+    for ( int i = 0; i < n; i++ )
+    {
+        AddToNameIndex(i);
+    }
+}
+void ZipArchive::AddToNameIndex(int idx)
+{
+    const char* name = zip_get_name(_zip, idx, 0);
+    if ( name == nullptr )
+        return;
+    
+    // emplace() won't replace an existing key, so the first of any duplicates is found, as with zip_name_locate()
+    _nameIndex.emplace(name, idx);
+    if ( _caseInsensitive )
+        _foldedNameIndex.emplace(FoldedName(name), idx);
+}
+void ZipArchive::RemoveFromNameIndex(int idx)
+{
+    const char* name = zip_get_name(_zip, idx, 0);
+    if ( name == nullptr )
+        return;
+    
+    auto pos = _nameIndex.find(name);
+    if ( pos != _nameIndex.end() && pos->second == idx )
+        _nameIndex.erase(pos);
+    
+    pos = _foldedNameIndex.find(FoldedName(name));
+    if ( pos != _foldedNameIndex.end() && pos->second == idx )
+        _foldedNameIndex.erase(pos);
+}
+std::string ZipArchive::FoldedName(const std::string& name)
+{
+    std::string result(name);
+    for ( char& ch : result )
+    {
+        if ( ch >= 'A' && ch <= 'Z' )
+            ch = static_cast<char>(ch - 'A' + 'a');
+    }
+    return result;
+}
 
 void ZipWriter::DataBlob::Append(const void *data, size_t len)
 {
+    _fs.seekp(0, std::ios::end);
     _fs.write(reinterpret_cast<const std::fstream::char_type *>(data), len);
+    if ( _fs )
+        _size += len;
 }
 size_t ZipWriter::DataBlob::Read(void *data, size_t len)
 {
-    if ( _fs.tellg() == std::streamsize(0) )
-        _fs.flush();
-    return static_cast<size_t>(_fs.readsome(reinterpret_cast<std::fstream::char_type *>(data), len));
+    // readsome() only returns what's already buffered, which for a file may be nothing
+    size_t num = std::min(len, Avail());
+    if ( num == 0 )
+        return 0;
+    _fs.clear();
+    _fs.seekg(static_cast<std::streamoff>(_readPos));
+    _fs.read(reinterpret_cast<std::fstream::char_type *>(data), static_cast<std::streamsize>(num));
+    num = static_cast<size_t>(_fs.gcount());
+    _readPos += num;
+    return num;
 }
 
 ZipWriter::ZipWriter(struct zip *zip, const string& path, bool compressed)
@@ -308,6 +471,7 @@ ssize_t ZipWriter::_source_callback(void *state, void *data, size_t len, enum zi
         {
             if ( !(*writer) )
                 return -1;
+            writer->_data.Rewind();
             break;
         }
         case ZIP_SOURCE_CLOSE:
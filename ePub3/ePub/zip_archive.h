@@ -24,6 +24,8 @@
 #include <ePub3/archive.h>
 #include <libzip/zip.h>
 #include <list>
+#include <string>
+#include <unordered_map>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -33,7 +35,13 @@ EPUB3_BEGIN_NAMESPACE
  @note ZIP archives do not contain any access permission information.
  @note The underlying implementation, `libzip`, writes data only when the archive
  is closed. Any data written to a zip file will therefore be kept in temporary
- storage until the archive object is closed.
+ storage until the archive object is closed, and the whole archive is then rewritten. To write
+ large archives, to repackage existing ones, or to update an archive in place, use
+ ZipStreamWriter instead.
+ @note `libzip` locates entries by name with a linear scan of the central
+ directory. To keep lookups fast in archives with many thousands of entries, a
+ hash table of entry names is built when the archive is opened, and entries are
+ then opened by index.
  @see http://www.idpf.org/epub/30/spec/epub30-ocf.html#physical-container-zip
  @ingroup archives
  */
@@ -55,10 +63,10 @@ public:
     ZipArchive(const string & path="");
     ///
     /// move constructos.
-    ZipArchive(ZipArchive &&o) : _zip(o._zip) { o._zip = nullptr; }
+    ZipArchive(ZipArchive &&o) : _zip(o._zip), _nameIndex(std::move(o._nameIndex)), _foldedNameIndex(std::move(o._foldedNameIndex)), _caseInsensitive(o._caseInsensitive) { o._zip = nullptr; }
     ///
     /// Initialize directly from a `libzip` internal structure.
-    explicit ZipArchive(struct zip * aZip) : _zip(aZip) {}
+    explicit ZipArchive(struct zip * aZip) : _zip(aZip), _caseInsensitive(false) { BuildNameIndex(); }
     virtual ~ZipArchive();
     
     ///
@@ -84,11 +92,50 @@ public:
         
     virtual ArchiveItemInfo InfoAtPath(const string & path) const;
     
+    /**
+     Locates an entry in the archive.
+     @param path The path of the entry. Percent-escapes are decoded and any leading
+     `/` is removed, as for all other path-based methods.
+     @result The `libzip` index of the entry, or `-1` if there is no such entry.
+     */
+    EPUB3_EXPORT
+    virtual int     IndexOfItem(const string & path) const OVERRIDE;
+    
+    virtual unique_ptr<ByteStream> ByteStreamAtIndex(int index) const OVERRIDE;
+    virtual ArchiveItemInfo InfoAtIndex(int index) const OVERRIDE;
+    virtual bool    FileRangeAtIndex(int index, FileRange& range) const OVERRIDE;
+    
+    ///
+    /// Whether path lookups ignore the case of ASCII letters (default is `false`).
+    bool            UsesCaseInsensitiveLookup() const { return _caseInsensitive; }
+    ///
+    /// Enables or disables case-insensitive path lookups.
+    EPUB3_EXPORT
+    void            SetCaseInsensitiveLookup(bool caseInsensitive);
+    
 protected:
+    typedef std::unordered_map<std::string, int>    NameIndex;
+    
     struct zip *    _zip;           ///< Pointer to the underlying `libzip` data type.
+    NameIndex       _nameIndex;     ///< Entry indices keyed by entry name.
+    NameIndex       _foldedNameIndex;   ///< Entry indices keyed by lowercased entry name, when case-insensitive.
+    bool            _caseInsensitive;
     
     typedef std::list<zip_source*>  ZipSourceList;
     ZipSourceList   _liveSources;   ///< A list of live zip sources, which must be cleaned up upon closing.
+    
+    ///
+    /// Reads the names of all entries from the central directory.
+    void            BuildNameIndex();
+    ///
+    /// Adds the entry at a given index to the name index.
+    void            AddToNameIndex(int idx);
+    ///
+    /// Removes the entry at a given index from the name index.
+    void            RemoveFromNameIndex(int idx);
+    ///
+    /// Lowercases the ASCII letters in an entry name.
+    static std::string  FoldedName(const std::string& name);
 
 };
 
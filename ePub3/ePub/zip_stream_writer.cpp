@@ -0,0 +1,804 @@
+//
+//  zip_stream_writer.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "zip_stream_writer.h"
+#include <libzip/zip.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <stdexcept>
+#include <cstdio>
+#if EPUB_OS(WINDOWS)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+EPUB3_BEGIN_NAMESPACE
+
+namespace
+{
+    const char*     kMimetypeName       = "mimetype";
+    const size_t    kDictionarySize     = 32*1024;      // the deflate window
+    const uint64_t  kMaxZipValue        = 0xFFFFFFFFull;
+    const size_t    kMaxZipEntries      = 0xFFFF;
+
+    const uint32_t  kLocalHeaderSignature       = 0x04034b50;
+    const uint32_t  kCentralHeaderSignature     = 0x02014b50;
+    const uint32_t  kEndOfDirectorySignature    = 0x06054b50;
+    const uint16_t  kVersionNeeded              = 20;       // 2.0: deflate and folders
+    const uint16_t  kUTF8NameFlag               = 0x0800;
+    const uint32_t  kDirectoryAttribute         = 0x10;     // MS-DOS directory bit
+    const size_t    kCentralHeaderSize          = 46;
+    const size_t    kEndRecordSize              = 22;
+
+    void Put16(std::string& out, uint16_t value)
+    {
+        out.push_back(static_cast<char>(value & 0xFF));
+        out.push_back(static_cast<char>((value >> 8) & 0xFF));
+    }
+    void Put32(std::string& out, uint32_t value)
+    {
+        Put16(out, static_cast<uint16_t>(value & 0xFFFF));
+        Put16(out, static_cast<uint16_t>((value >> 16) & 0xFFFF));
+    }
+
+    uint16_t Get16(const char* p)
+    {
+        const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+        return static_cast<uint16_t>(b[0] | (b[1] << 8));
+    }
+    uint32_t Get32(const char* p)
+    {
+        return static_cast<uint32_t>(Get16(p)) | (static_cast<uint32_t>(Get16(p + 2)) << 16);
+    }
+
+    bool TruncateFile(const std::string& path, uint64_t size)
+    {
+#if EPUB_OS(WINDOWS)
+        int fd = ::_open(path.c_str(), _O_RDWR|_O_BINARY);
+        if ( fd < 0 )
+            return false;
+        bool ok = (::_chsize_s(fd, static_cast<__int64>(size)) == 0);
+        ::_close(fd);
+        return ok;
+#else
+        return ::truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    void DOSDateTime(time_t t, uint16_t& dosTime, uint16_t& dosDate)
+    {
+        struct tm tm;
+#if EPUB_OS(WINDOWS)
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+        if ( tm.tm_year < 80 )
+        {
+            // the earliest date ZIP can represent: 1980-01-01
+            dosTime = 0;
+            dosDate = (1 << 5) | 1;
+            return;
+        }
+
+        dosTime = static_cast<uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec >> 1));
+        dosDate = static_cast<uint16_t>(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    }
+
+    uint16_t NameFlags(const std::string& name)
+    {
+        for ( char ch : name )
+        {
+            if ( static_cast<unsigned char>(ch) >= 0x80 )
+                return kUTF8NameFlag;
+        }
+        return 0;
+    }
+
+    std::string EntryName(const string& path)
+    {
+        std::string name = path.stl_str();
+        size_t start = name.find_first_not_of('/');
+        return (start == std::string::npos ? std::string() : name.substr(start));
+    }
+
+    bool ReadZipEntry(struct zip* zip, int index, int flags, size_t length, std::string& out)
+    {
+        struct zip_file* file = zip_fopen_index(zip, index, flags);
+        if ( file == nullptr )
+            return false;
+
+        out.resize(length);
+        size_t total = 0;
+        while ( total < length )
+        {
+            ssize_t num = zip_fread(file, &out[total], length - total);
+            if ( num <= 0 )
+                break;
+            total += static_cast<size_t>(num);
+        }
+
+        // zip_fclose() reports a CRC mismatch, when one is checked
+        bool ok = (zip_fclose(file) == 0 && total == length);
+        return ok;
+    }
+}
+
+/**
+ Collects an entry's content in memory, and adds it when destroyed.
+ */
+class ZipStreamEntryWriter : public ArchiveWriter
+{
+public:
+    ZipStreamEntryWriter(ZipStreamWriter* owner, const string& path, bool compress)
+        : _owner(owner), _path(path), _compress(compress), _data() {}
+    virtual ~ZipStreamEntryWriter() { _owner->AddEntry(_path, std::move(_data), _compress); }
+
+    virtual bool operator !() const { return _owner->_failed || _owner->_closed; }
+    virtual ssize_t write(const void* p, size_t len)
+        {
+            _data.append(reinterpret_cast<const char*>(p), len);
+            return static_cast<ssize_t>(len);
+        }
+
+	virtual size_t total_size() const { return _data.size(); }
+	virtual size_t position() const { return _data.size(); }
+
+private:
+    ZipStreamWriter*    _owner;
+    string              _path;
+    bool                _compress;
+    std::string         _data;
+};
+
+ZipStreamWriter::ZipStreamWriter(const Options& options)
+    : _options(options), _file(), _pool(), _dosTime(0), _dosDate(0), _offset(0), _failed(false), _closed(false),
+      _updating(false), _path(), _originalSize(0), _oldEndRecord(0), _pendingBytes(0)
+{
+    if ( _options.chunkSize < kDictionarySize )
+        _options.chunkSize = kDictionarySize;
+
+    _pool.reset(new thread_pool(_options.threadCount));
+    DOSDateTime(::time(NULL), _dosTime, _dosDate);
+}
+ZipStreamWriter::ZipStreamWriter(const string& path, const Options& options) : ZipStreamWriter(options)
+{
+    _path = path.stl_str();
+    _file.open(_path.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+    if ( !_file.is_open() )
+    {
+        _closed = true;     // the destructor runs, since the delegated constructor completed
+        throw std::runtime_error(std::string("ZipStreamWriter: can't create '") + _path + "'");
+    }
+}
+unique_ptr<ZipStreamWriter> ZipStreamWriter::OpenForUpdate(const string& path, const Options& options)
+{
+    unique_ptr<ZipStreamWriter> writer(new ZipStreamWriter(options));
+    writer->_closed = true;         // nothing to finish if anything below throws
+    writer->_path = path.stl_str();
+    writer->ReadDirectory(path);
+
+    // read/write, so the existing content isn't truncated
+    writer->_file.open(writer->_path.c_str(), std::ios::in|std::ios::out|std::ios::binary);
+    if ( !writer->_file.is_open() )
+        throw std::runtime_error(std::string("ZipStreamWriter: can't open '") + writer->_path + "' for writing");
+    writer->_file.seekp(static_cast<std::streamoff>(writer->_originalSize), std::ios::beg);
+    if ( !writer->_file )
+        throw std::runtime_error(std::string("ZipStreamWriter: can't seek in '") + writer->_path + "'");
+
+    writer->_offset = writer->_originalSize;
+    writer->_updating = true;
+    writer->_closed = false;
+    return writer;
+}
+ZipStreamWriter::~ZipStreamWriter()
+{
+    if ( !_closed )
+        Close();
+}
+bool ZipStreamWriter::AddEntry(const string& path, const void* data, size_t length, bool compress)
+{
+    return AddEntry(path, std::string(reinterpret_cast<const char*>(data), length), compress);
+}
+bool ZipStreamWriter::AddEntry(const string& path, std::string&& data, bool compress)
+{
+    EntryPtr entry = std::make_shared<Entry>();
+    entry->name = EntryName(path);
+    if ( entry->name == kMimetypeName )
+        compress = false;
+
+    entry->method = static_cast<uint16_t>(compress && !data.empty() ? ZIP_CM_DEFLATE : ZIP_CM_STORE);
+    entry->dosTime = _dosTime;
+    entry->dosDate = _dosDate;
+    entry->crc = 0;
+    entry->size = data.size();
+    entry->precompressed = false;
+    entry->content = std::move(data);
+    entry->remaining = 0;
+    entry->failed = false;
+    return Enqueue(entry);
+}
+bool ZipStreamWriter::RemoveEntry(const string& path)
+{
+    if ( _closed )
+        return false;
+
+    // let any queued entry of the same name reach the directory first
+    while ( WriteNextEntry(true) )
+        continue;
+
+    auto found = _directoryIndex.find(EntryName(path));
+    if ( found == _directoryIndex.end() )
+        return false;
+
+    _directory.erase(_directory.begin() + found->second);
+    _directoryIndex.clear();
+    for ( size_t i = 0; i < _directory.size(); i++ )
+        _directoryIndex[_directory[i].name] = i;
+    return true;
+}
+bool ZipStreamWriter::CreateFolder(const string& path)
+{
+    std::string name = EntryName(path);
+    if ( name.empty() )
+        return false;
+    if ( name.back() != '/' )
+        name.push_back('/');
+    return AddEntry(name, std::string(), false);
+}
+unique_ptr<ArchiveWriter> ZipStreamWriter::WriterForEntry(const string& path, bool compress)
+{
+    if ( _closed || _failed || !CanAdd(EntryName(path)) )
+        return nullptr;
+    return unique_ptr<ArchiveWriter>(new ZipStreamEntryWriter(this, path, compress));
+}
+bool ZipStreamWriter::CopyEntries(const string& archivePath, EntrySelector select, EntryTransform transform)
+{
+    int zerr = 0;
+    struct zip* zip = zip_open(archivePath.c_str(), 0, &zerr);
+    if ( zip == nullptr )
+        return false;
+
+    // the mimetype goes first, whatever its place in the source archive
+    int numEntries = std::max(zip_get_num_files(zip), 0);
+    int mimetypeIndex = zip_name_locate(zip, kMimetypeName, 0);
+    std::vector<int> order;
+    order.reserve(numEntries);
+    if ( mimetypeIndex >= 0 )
+        order.push_back(mimetypeIndex);
+    for ( int i = 0; i < numEntries; i++ )
+    {
+        if ( i != mimetypeIndex )
+            order.push_back(i);
+    }
+
+    bool ok = true;
+    for ( int i : order )
+    {
+        struct zip_stat zinfo;
+        zip_stat_init(&zinfo);
+        if ( zip_stat_index(zip, i, 0, &zinfo) < 0 )
+        {
+            ok = false;
+            break;
+        }
+
+        string name(zinfo.name);
+        bool selected = bool(select) && select(name);
+        bool isMimetype = (i == mimetypeIndex);
+
+        if ( selected || (isMimetype && zinfo.comp_method != ZIP_CM_STORE) )
+        {
+            std::string content;
+            if ( !ReadZipEntry(zip, i, 0, static_cast<size_t>(zinfo.size), content) )
+            {
+                ok = false;
+                break;
+            }
+
+            if ( selected && bool(transform) )
+                transform(name, content);
+
+            ok = AddEntry(name, std::move(content), zinfo.comp_method != ZIP_CM_STORE);
+        }
+        else
+        {
+            // the compressed data is copied as it is
+            EntryPtr entry = std::make_shared<Entry>();
+            entry->name = zinfo.name;
+            entry->method = zinfo.comp_method;
+            DOSDateTime(zinfo.mtime, entry->dosTime, entry->dosDate);
+            entry->crc = zinfo.crc;
+            entry->size = static_cast<uint64_t>(zinfo.size);
+            entry->precompressed = true;
+            entry->remaining = 0;
+            entry->failed = false;
+            if ( !ReadZipEntry(zip, i, ZIP_FL_COMPRESSED, static_cast<size_t>(zinfo.comp_size), entry->content) )
+            {
+                ok = false;
+                break;
+            }
+
+            ok = Enqueue(entry);
+        }
+
+        if ( !ok )
+            break;
+    }
+
+    zip_close(zip);
+    return ok;
+}
+bool ZipStreamWriter::Close()
+{
+    if ( _closed )
+        return !_failed;
+
+    while ( WriteNextEntry(true) )
+        continue;
+    _closed = true;
+
+    if ( _directory.size() > kMaxZipEntries || _offset > kMaxZipValue )
+        _failed = true;
+
+    uint64_t directoryOffset = _offset;
+    std::string record;
+    for ( auto& entry : _directory )
+    {
+        if ( !entry.raw.empty() )
+        {
+            WriteBytes(entry.raw.data(), entry.raw.size());
+            continue;
+        }
+
+        record.clear();
+        Put32(record, kCentralHeaderSignature);
+        Put16(record, kVersionNeeded);              // version made by
+        Put16(record, kVersionNeeded);
+        Put16(record, NameFlags(entry.name));
+        Put16(record, entry.method);
+        Put16(record, entry.dosTime);
+        Put16(record, entry.dosDate);
+        Put32(record, entry.crc);
+        Put32(record, entry.compressedSize);
+        Put32(record, entry.size);
+        Put16(record, static_cast<uint16_t>(entry.name.size()));
+        Put16(record, 0);                           // extra field length
+        Put16(record, 0);                           // comment length
+        Put16(record, 0);                           // disk number
+        Put16(record, 0);                           // internal attributes
+        Put32(record, (!entry.name.empty() && entry.name.back() == '/') ? kDirectoryAttribute : 0);
+        Put32(record, entry.offset);
+        record.append(entry.name);
+        WriteBytes(record.data(), record.size());
+    }
+
+    uint64_t directorySize = _offset - directoryOffset;
+    if ( _offset > kMaxZipValue )
+        _failed = true;
+
+    record.clear();
+    Put32(record, kEndOfDirectorySignature);
+    Put16(record, 0);                               // this disk
+    Put16(record, 0);                               // the directory's disk
+    Put16(record, static_cast<uint16_t>(_directory.size()));
+    Put16(record, static_cast<uint16_t>(_directory.size()));
+    Put32(record, static_cast<uint32_t>(directorySize));
+    Put32(record, static_cast<uint32_t>(directoryOffset));
+    Put16(record, 0);                               // comment length
+    WriteBytes(record.data(), record.size());
+
+    bool superseded = false;
+    if ( _updating && !_failed )
+    {
+        // the new directory is complete: hide the old end record from readers
+        // which search for the last one, or pick between several
+        _file.flush();
+        _file.seekp(static_cast<std::streamoff>(_oldEndRecord), std::ios::beg);
+        record.clear();
+        Put32(record, 0);
+        _file.write(record.data(), static_cast<std::streamsize>(record.size()));
+        if ( _file )
+            superseded = true;
+        else
+            _failed = true;
+    }
+
+    _file.close();
+    if ( _file.fail() )
+        _failed = true;
+
+    // a failed update leaves the original archive as it was
+    if ( _updating && _failed && !superseded )
+        TruncateFile(_path, _originalSize);
+
+    // all the compression jobs are finished by now
+    _pool.reset();
+    return !_failed;
+}
+bool ZipStreamWriter::Repack(const string& sourcePath, const string& destPath, EntrySelector select, EntryTransform transform, const Options& options)
+{
+    try
+    {
+        ZipStreamWriter writer(destPath, options);
+        bool copied = writer.CopyEntries(sourcePath, select, transform);
+        bool closed = writer.Close();
+        return copied && closed;
+    }
+    catch (std::exception&)
+    {
+        return false;
+    }
+}
+bool ZipStreamWriter::Compact(const string& path, const Options& options)
+{
+    std::string tempPath = path.stl_str() + ".compact";
+    if ( !Repack(path, tempPath, nullptr, nullptr, options) )
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+#if EPUB_OS(WINDOWS)
+    // rename() won't replace an existing file here
+    std::remove(path.c_str());
+#endif
+    if ( std::rename(tempPath.c_str(), path.c_str()) != 0 )
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+bool ZipStreamWriter::CanAdd(const std::string& name) const
+{
+    if ( _closed || _failed || name.empty() )
+        return false;
+
+    // OCF requires the mimetype to be the first entry
+    if ( name == kMimetypeName && EntryCount() != 0 )
+        return false;
+
+    return true;
+}
+bool ZipStreamWriter::Enqueue(EntryPtr entry)
+{
+    if ( !CanAdd(entry->name) )
+        return false;
+    if ( entry->size > kMaxZipValue || entry->content.size() > kMaxZipValue || EntryCount() >= kMaxZipEntries )
+        return false;
+
+    _pendingBytes += entry->content.size();
+    _queue.push_back(entry);
+    StartCompression(entry);
+
+    // write whatever is ready, then wait until the backlog fits in memory
+    while ( WriteNextEntry(false) )
+        continue;
+    while ( _pendingBytes > _options.maxPendingBytes && WriteNextEntry(true) )
+        continue;
+
+    return !_failed;
+}
+void ZipStreamWriter::StartCompression(EntryPtr entry)
+{
+    if ( entry->precompressed )
+        return;
+
+    if ( entry->method != ZIP_CM_DEFLATE )
+    {
+        entry->crc = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(entry->content.data()), static_cast<uInt>(entry->content.size())));
+        return;
+    }
+
+    size_t numChunks = (entry->content.size() + _options.chunkSize - 1) / _options.chunkSize;
+    entry->chunks.resize(numChunks);
+    for ( size_t i = 0; i < numChunks; i++ )
+    {
+        Chunk& chunk = entry->chunks[i];
+        chunk.offset = i * _options.chunkSize;
+        chunk.length = std::min(_options.chunkSize, entry->content.size() - chunk.offset);
+        chunk.crc = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        entry->remaining = numChunks;
+    }
+
+    for ( size_t i = 0; i < numChunks; i++ )
+    {
+        _pool->add([this, entry, i]() {
+            CompressChunk(entry.get(), i);
+        });
+    }
+}
+void ZipStreamWriter::CompressChunk(Entry* entry, size_t index)
+{
+    Chunk& chunk = entry->chunks[index];
+    const Bytef* data = reinterpret_cast<const Bytef*>(entry->content.data()) + chunk.offset;
+    bool last = (index == entry->chunks.size() - 1);
+    bool ok = false;
+
+    // an exception escaping a thread_pool job terminates the process
+    try
+    {
+        chunk.crc = static_cast<uint32_t>(crc32(0, data, static_cast<uInt>(chunk.length)));
+
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if ( deflateInit2(&stream, _options.compressionLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK )
+        {
+            // prime the window with the preceding data, so matches can reach back across chunks
+            size_t dictionaryLength = std::min(kDictionarySize, chunk.offset);
+            if ( dictionaryLength > 0 )
+                deflateSetDictionary(&stream, data - dictionaryLength, static_cast<uInt>(dictionaryLength));
+
+            // room for the final empty block of a sync flush, too
+            chunk.output.resize(deflateBound(&stream, static_cast<uLong>(chunk.length)) + 16);
+            stream.next_in = const_cast<Bytef*>(data);
+            stream.avail_in = static_cast<uInt>(chunk.length);
+            stream.next_out = reinterpret_cast<Bytef*>(&chunk.output[0]);
+            stream.avail_out = static_cast<uInt>(chunk.output.size());
+
+            // all but the last chunk end on a byte boundary, without a final block, so they can be joined
+            int flush = (last ? Z_FINISH : Z_SYNC_FLUSH);
+            for ( ;; )
+            {
+                int ret = deflate(&stream, flush);
+                if ( ret == Z_STREAM_ERROR )
+                    break;
+                if ( last ? (ret == Z_STREAM_END) : (stream.avail_in == 0 && stream.avail_out != 0) )
+                {
+                    ok = true;
+                    break;
+                }
+                if ( stream.avail_out != 0 )
+                    break;      // no progress
+
+                size_t produced = static_cast<size_t>(stream.total_out);
+                chunk.output.resize(chunk.output.size() * 2);
+                stream.next_out = reinterpret_cast<Bytef*>(&chunk.output[produced]);
+                stream.avail_out = static_cast<uInt>(chunk.output.size() - produced);
+            }
+
+            chunk.output.resize(static_cast<size_t>(stream.total_out));
+            deflateEnd(&stream);
+        }
+    }
+    catch (...)
+    {
+        ok = false;
+    }
+
+    std::lock_guard<std::mutex> _(_lock);
+    if ( !ok )
+        entry->failed = true;
+    if ( --entry->remaining == 0 )
+        _chunkDone.notify_all();
+}
+bool ZipStreamWriter::WriteNextEntry(bool wait)
+{
+    if ( _queue.empty() )
+        return false;
+
+    EntryPtr entry = _queue.front();
+    {
+        std::unique_lock<std::mutex> lock(_lock);
+        if ( entry->remaining != 0 )
+        {
+            if ( !wait )
+                return false;
+            _chunkDone.wait(lock, [&entry]() { return entry->remaining == 0; });
+        }
+        if ( entry->failed )
+            _failed = true;
+    }
+
+    _queue.pop_front();
+    _pendingBytes -= entry->content.size();
+    WriteEntry(*entry);
+    return true;
+}
+void ZipStreamWriter::WriteEntry(Entry& entry)
+{
+    if ( _failed )
+        return;
+
+    uint64_t compressedSize = entry.content.size();
+    bool useChunks = false;
+    if ( !entry.precompressed && entry.method == ZIP_CM_DEFLATE )
+    {
+        uint64_t deflatedSize = 0;
+        uint32_t crc = 0;
+        for ( auto& chunk : entry.chunks )
+        {
+            deflatedSize += chunk.output.size();
+            crc = static_cast<uint32_t>(crc32_combine(crc, chunk.crc, static_cast<z_off_t>(chunk.length)));
+        }
+        entry.crc = crc;
+
+        if ( deflatedSize < entry.size )
+        {
+            compressedSize = deflatedSize;
+            useChunks = true;
+        }
+        else
+        {
+            // incompressible: store it instead
+            entry.method = ZIP_CM_STORE;
+        }
+    }
+
+    if ( _offset > kMaxZipValue || compressedSize > kMaxZipValue )
+    {
+        _failed = true;
+        return;
+    }
+
+    DirectoryRecord record;
+    record.name = entry.name;
+    record.method = entry.method;
+    record.dosTime = entry.dosTime;
+    record.dosDate = entry.dosDate;
+    record.crc = entry.crc;
+    record.compressedSize = static_cast<uint32_t>(compressedSize);
+    record.size = static_cast<uint32_t>(entry.size);
+    record.offset = static_cast<uint32_t>(_offset);
+
+    std::string header;
+    header.reserve(30 + entry.name.size());
+    Put32(header, kLocalHeaderSignature);
+    Put16(header, kVersionNeeded);
+    Put16(header, NameFlags(entry.name));
+    Put16(header, record.method);
+    Put16(header, record.dosTime);
+    Put16(header, record.dosDate);
+    Put32(header, record.crc);
+    Put32(header, record.compressedSize);
+    Put32(header, record.size);
+    Put16(header, static_cast<uint16_t>(entry.name.size()));
+    Put16(header, 0);                               // extra field length
+    header.append(entry.name);
+    WriteBytes(header.data(), header.size());
+
+    if ( useChunks )
+    {
+        for ( auto& chunk : entry.chunks )
+            WriteBytes(chunk.output.data(), chunk.output.size());
+    }
+    else
+    {
+        WriteBytes(entry.content.data(), entry.content.size());
+    }
+
+    AddToDirectory(std::move(record));
+}
+void ZipStreamWriter::AddToDirectory(DirectoryRecord&& record)
+{
+    auto found = _directoryIndex.find(record.name);
+    if ( found != _directoryIndex.end() )
+    {
+        // a replacement keeps the original's place in the directory
+        _directory[found->second] = std::move(record);
+        return;
+    }
+
+    _directoryIndex[record.name] = _directory.size();
+    _directory.push_back(std::move(record));
+}
+void ZipStreamWriter::ReadDirectory(const string& path)
+{
+    std::ifstream file(path.c_str(), std::ios::in|std::ios::binary);
+    if ( !file.is_open() )
+        throw std::runtime_error(std::string("ZipStreamWriter: can't open '") + path.stl_str() + "'");
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    if ( fileSize < kEndRecordSize )
+        throw std::runtime_error(std::string("ZipStreamWriter: '") + path.stl_str() + "' is not a ZIP archive");
+
+    // the end record is followed only by its comment, of up to 64KB
+    size_t tailSize = static_cast<size_t>(std::min<uint64_t>(fileSize, kEndRecordSize + 0xFFFF));
+    std::string tail(tailSize, '\0');
+    file.seekg(static_cast<std::streamoff>(fileSize - tailSize), std::ios::beg);
+    file.read(&tail[0], static_cast<std::streamsize>(tailSize));
+    if ( !file )
+        throw std::runtime_error(std::string("ZipStreamWriter: can't read '") + path.stl_str() + "'");
+
+    size_t endRecord = std::string::npos;
+    for ( size_t pos = tailSize - kEndRecordSize; ; pos-- )
+    {
+        const char* p = tail.data() + pos;
+        if ( Get32(p) == kEndOfDirectorySignature && pos + kEndRecordSize + Get16(p + 20) == tailSize )
+        {
+            endRecord = pos;
+            break;
+        }
+        if ( pos == 0 )
+            break;
+    }
+    if ( endRecord == std::string::npos )
+        throw std::runtime_error(std::string("ZipStreamWriter: '") + path.stl_str() + "' is not a ZIP archive");
+
+    const char* end = tail.data() + endRecord;
+    uint16_t numEntries = Get16(end + 10);
+    uint32_t directorySize = Get32(end + 12);
+    uint32_t directoryOffset = Get32(end + 16);
+    if ( Get16(end + 4) != 0 || Get16(end + 6) != 0 || Get16(end + 8) != numEntries )
+        throw std::runtime_error(std::string("ZipStreamWriter: '") + path.stl_str() + "' spans multiple disks");
+    if ( numEntries == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF )
+        throw std::runtime_error(std::string("ZipStreamWriter: '") + path.stl_str() + "' uses ZIP64");
+
+    _oldEndRecord = fileSize - tailSize + endRecord;
+    if ( uint64_t(directoryOffset) + directorySize > _oldEndRecord )
+        throw std::runtime_error(std::string("ZipStreamWriter: '") + path.stl_str() + "' has a corrupt directory");
+
+    std::string directory(directorySize, '\0');
+    file.seekg(directoryOffset, std::ios::beg);
+    if ( directorySize != 0 )
+        file.read(&directory[0], directorySize);
+    if ( !file )
+        throw std::runtime_error(std::string("ZipStreamWriter: can't read '") + path.stl_str() + "'");
+
+    size_t pos = 0;
+    for ( uint16_t i = 0; i < numEntries; i++ )
+    {
+        const char* p = directory.data() + pos;
+        if ( pos + kCentralHeaderSize > directory.size() || Get32(p) != kCentralHeaderSignature )
+            throw std::runtime_error(std::string("ZipStreamWriter: '") + path.stl_str() + "' has a corrupt directory");
+
+        size_t recordSize = kCentralHeaderSize + Get16(p + 28) + Get16(p + 30) + Get16(p + 32);
+        if ( pos + recordSize > directory.size() )
+            throw std::runtime_error(std::string("ZipStreamWriter: '") + path.stl_str() + "' has a corrupt directory");
+
+        DirectoryRecord record;
+        record.name.assign(p + kCentralHeaderSize, Get16(p + 28));
+        record.method = Get16(p + 10);
+        record.dosTime = Get16(p + 12);
+        record.dosDate = Get16(p + 14);
+        record.crc = Get32(p + 16);
+        record.compressedSize = Get32(p + 20);
+        record.size = Get32(p + 24);
+        record.offset = Get32(p + 42);
+        record.raw.assign(p, recordSize);
+        AddToDirectory(std::move(record));
+
+        pos += recordSize;
+    }
+
+    _originalSize = fileSize;
+}
+void ZipStreamWriter::WriteBytes(const void* data, size_t length)
+{
+    if ( _failed || length == 0 )
+        return;
+
+    _file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+    if ( !_file )
+        _failed = true;
+    _offset += length;
+}
+
+EPUB3_END_NAMESPACE
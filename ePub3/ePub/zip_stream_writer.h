@@ -0,0 +1,318 @@
+//
+//  zip_stream_writer.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __ePub3__zip_stream_writer__
+#define __ePub3__zip_stream_writer__
+
+#include <ePub3/epub3.h>
+#include <ePub3/archive.h>
+#include <ePub3/utilities/executor.h>
+#include <ePub3/utilities/utfstring.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ Writes a new ZIP archive front to back, without temporary files.
+
+ ZipArchive writes through `libzip`, which spools every written entry to a
+ temporary file and compresses it only when the archive is closed. This class
+ instead writes each entry's local header and data straight to the output file as
+ soon as it is ready, followed by the central directory when the archive is
+ closed.
+
+ Entries are deflated on a thread_pool. Large entries are split into chunks which
+ are deflated in parallel, each primed with the last 32KB of the preceding chunk,
+ and joined into a single deflate stream. Entries are always written in the order
+ they were added; the amount of data waiting to be compressed or written is bounded
+ by Options::maxPendingBytes, beyond which adding an entry blocks.
+
+ As required by OCF, an entry named `mimetype` is always stored uncompressed, and
+ must be the first entry added.
+
+ CopyEntries() and Repack() copy the compressed data of unchanged entries from an
+ existing archive as-is, so only entries which are actually modified are inflated
+ and deflated again.
+
+ OpenForUpdate() modifies an existing archive in place: new and replaced entries
+ are appended after the existing data, followed by a new central directory, so
+ the data of unchanged entries is never read or rewritten. The space taken by
+ replaced and removed entries (and by the old central directory) is reclaimed
+ only by an explicit call to Compact().
+
+ Entries whose deflated form is no smaller than their content (e.g. JPEG images)
+ are stored instead. ZIP64 is not supported: archives with more than 65535
+ entries, or entries or offsets of 4GB or more, can't be written.
+ @ingroup archives
+ */
+class ZipStreamWriter
+{
+public:
+    ///
+    /// Controls how an archive is written.
+    struct Options
+    {
+        int                         threadCount;        ///< Compression threads; thread_pool::Automatic uses one per CPU.
+        Archive::CompressionLevel   compressionLevel;   ///< The zlib compression level.
+        size_t                      chunkSize;          ///< Entries larger than this are deflated in parallel pieces.
+        size_t                      maxPendingBytes;    ///< The most uncompressed data to hold in memory at once.
+
+        Options() : threadCount(thread_pool::Automatic), compressionLevel(Archive::DefaultCompression), chunkSize(1024*1024), maxPendingBytes(64*1024*1024) {}
+    };
+
+    ///
+    /// Chooses the entries to be modified while copying an archive.
+    typedef std::function<bool(const string& path)>                         EntrySelector;
+    ///
+    /// Modifies the (uncompressed) content of a selected entry.
+    typedef std::function<void(const string& path, std::string& content)>   EntryTransform;
+
+private:
+                        ZipStreamWriter()                               _DELETED_;
+                        ZipStreamWriter(const ZipStreamWriter&)         _DELETED_;
+    ZipStreamWriter&    operator=(const ZipStreamWriter&)               _DELETED_;
+
+public:
+    /**
+     Creates a new archive, replacing any existing file.
+     @param path The filesystem path of the archive to create.
+     @param options Controls the compression.
+     @throws std::runtime_error if the file can't be created.
+     */
+    EPUB3_EXPORT        ZipStreamWriter(const string& path, const Options& options=Options());
+
+    /**
+     Opens an existing archive to be updated in place.
+
+     Entries added with the name of an existing entry replace it. Nothing is
+     written over the existing content of the file, except for the signature of
+     the old end of central directory record once the new central directory has
+     been written; until then, the file remains a valid copy of the original
+     archive.
+     @param path The filesystem path of the archive to update.
+     @param options Controls the compression.
+     @throws std::runtime_error if the file can't be opened, isn't a ZIP archive,
+     or uses ZIP64 or multiple disks.
+     */
+    EPUB3_EXPORT
+    static unique_ptr<ZipStreamWriter>  OpenForUpdate(const string& path, const Options& options=Options());
+    ///
+    /// Closes the archive, if Close() hasn't already been called.
+    EPUB3_EXPORT        ~ZipStreamWriter();
+
+    /**
+     Adds an entry from a buffer, which is copied.
+     @param path The path of the entry within the archive.
+     @param data The entry's content.
+     @param length The number of bytes at `data`.
+     @param compress Whether to deflate the content.
+     @result `false` if the entry can't be added (for example if the archive was
+     closed, a write failed, or `mimetype` is not the first entry).
+     */
+    EPUB3_EXPORT
+    bool                AddEntry(const string& path, const void* data, size_t length, bool compress=true);
+    ///
+    /// Adds an entry, taking ownership of its content.
+    EPUB3_EXPORT
+    bool                AddEntry(const string& path, std::string&& data, bool compress=true);
+
+    ///
+    /// Adds a directory entry; a trailing `/` is appended if necessary.
+    EPUB3_EXPORT
+    bool                CreateFolder(const string& path);
+
+    /**
+     Removes an entry from the archive's directory. When updating an archive, the
+     entry's data stays in the file until it is compacted.
+     @result `false` if there is no such entry, or the archive was closed.
+     */
+    EPUB3_EXPORT
+    bool                RemoveEntry(const string& path);
+
+    /**
+     Returns a writer for a new entry. The content is held in memory, and the entry
+     is added to the archive when the writer is destroyed.
+
+     The writer must be destroyed before any other entry is added, and before the
+     archive is closed.
+     */
+    EPUB3_EXPORT
+    unique_ptr<ArchiveWriter>   WriterForEntry(const string& path, bool compress=true);
+
+    /**
+     Copies all the entries of an existing ZIP archive.
+
+     Any `mimetype` entry is copied first, uncompressed.
+     @param archivePath The filesystem path of the archive to copy.
+     @param select Returns `true` for entries to be passed to `transform`. The
+     compressed data of all other entries is copied unchanged.
+     @param transform Modifies the content of the selected entries, which are then
+     deflated again. If `nullptr`, selected entries are simply recompressed.
+     @result `false` if the archive couldn't be read or an entry couldn't be added.
+     */
+    EPUB3_EXPORT
+    bool                CopyEntries(const string& archivePath, EntrySelector select=nullptr, EntryTransform transform=nullptr);
+
+    /**
+     Waits for all entries to be written, then writes the central directory and
+     closes the file.
+     @result `true` if the complete archive was written successfully.
+     */
+    EPUB3_EXPORT
+    bool                Close();
+
+    ///
+    /// The number of entries added, including those already in an updated archive.
+    size_t              EntryCount()                                const   { return _directory.size() + _queue.size(); }
+    ///
+    /// The number of bytes written to the file so far.
+    uint64_t            BytesWritten()                              const   { return _offset; }
+
+    /**
+     Writes a copy of an archive, modifying some of its entries.
+     @see CopyEntries()
+     @result `true` if the new archive was written successfully.
+     */
+    EPUB3_EXPORT
+    static bool         Repack(const string& sourcePath, const string& destPath, EntrySelector select, EntryTransform transform, const Options& options=Options());
+
+    /**
+     Rewrites an archive without the space left behind by in-place updates.
+
+     The archive is copied to a temporary file next to it, without recompressing
+     anything, which then replaces the original.
+     @result `true` if the archive was compacted successfully. On failure, the
+     original archive is left as it was.
+     */
+    EPUB3_EXPORT
+    static bool         Compact(const string& path, const Options& options=Options());
+
+protected:
+    ///
+    /// A piece of an entry, deflated independently.
+    struct Chunk
+    {
+        size_t          offset;         ///< The start of the chunk in the entry's content.
+        size_t          length;
+        uint32_t        crc;            ///< The CRC32 of the chunk's content.
+        std::string     output;         ///< The deflated chunk.
+    };
+
+    ///
+    /// An entry waiting to be written.
+    struct Entry
+    {
+        std::string         name;
+        uint16_t            method;         ///< ZIP_CM_STORE or ZIP_CM_DEFLATE.
+        uint16_t            dosTime;
+        uint16_t            dosDate;
+        uint32_t            crc;
+        uint64_t            size;           ///< Uncompressed size.
+        bool                precompressed;  ///< `content` is already in its final (compressed) form.
+        std::string         content;
+        std::vector<Chunk>  chunks;
+        size_t              remaining;      ///< Chunks still being deflated; guarded by _lock.
+        bool                failed;         ///< A chunk couldn't be deflated; guarded by _lock.
+    };
+    typedef std::shared_ptr<Entry>  EntryPtr;
+
+    ///
+    /// What the central directory needs to know about a written entry.
+    struct DirectoryRecord
+    {
+        std::string         name;
+        uint16_t            method;
+        uint16_t            dosTime;
+        uint16_t            dosDate;
+        uint32_t            crc;
+        uint32_t            compressedSize;
+        uint32_t            size;
+        uint32_t            offset;
+        std::string         raw;            ///< The original record of an entry in an updated archive, written as-is.
+    };
+
+    Options                         _options;
+    std::ofstream                   _file;
+    unique_ptr<thread_pool>         _pool;
+    uint16_t                        _dosTime;       ///< The modification time given to new entries.
+    uint16_t                        _dosDate;
+    uint64_t                        _offset;        ///< The current end of the file.
+    bool                            _failed;
+    bool                            _closed;
+    bool                            _updating;      ///< Updating an existing archive in place.
+    std::string                     _path;
+    uint64_t                        _originalSize;  ///< The size of an updated archive before anything was appended.
+    uint64_t                        _oldEndRecord;  ///< The offset of the end record superseded by an update.
+    size_t                          _pendingBytes;  ///< Content held by queued entries.
+
+    std::mutex                      _lock;          ///< Guards the chunks' progress.
+    std::condition_variable         _chunkDone;
+    std::deque<EntryPtr>            _queue;         ///< Entries waiting to be written, in order.
+    std::vector<DirectoryRecord>    _directory;     ///< Entries already written.
+    std::unordered_map<std::string, size_t> _directoryIndex;    ///< Entry names to their index in _directory.
+
+    ///
+    /// Sets up the compression, without opening a file.
+                        ZipStreamWriter(const Options& options);
+
+    ///
+    /// Queues an entry, writing out whatever is ready.
+    bool                Enqueue(EntryPtr entry);
+    ///
+    /// Schedules the chunks of an entry for compression.
+    void                StartCompression(EntryPtr entry);
+    ///
+    /// Deflates one chunk of an entry.
+    void                CompressChunk(Entry* entry, size_t index);
+    /**
+     Writes the entry at the head of the queue.
+     @param wait Whether to wait for the entry to be compressed.
+     @result `false` if the queue is empty, or its head isn't ready and `wait` is `false`.
+     */
+    bool                WriteNextEntry(bool wait);
+    ///
+    /// Writes a single, finished entry.
+    void                WriteEntry(Entry& entry);
+    ///
+    /// Appends bytes to the file.
+    void                WriteBytes(const void* data, size_t length);
+    ///
+    /// Adds a written entry to the directory, replacing any entry with the same name.
+    void                AddToDirectory(DirectoryRecord&& record);
+    ///
+    /// Loads the central directory of an archive to be updated.
+    void                ReadDirectory(const string& path);
+    ///
+    /// Checks the name of a new entry.
+    bool                CanAdd(const std::string& name)                     const;
+
+    friend class ZipStreamEntryWriter;
+};
+
+EPUB3_END_NAMESPACE
+
+#endif /* defined(__ePub3__zip_stream_writer__) */
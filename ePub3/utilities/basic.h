@@ -227,7 +227,7 @@ static inline std::string _Str(const _A1& a1, const _A2& a2, const _A3& a3,
 
 ///
 /// const xmlChar * xmlString = "this is an xmlChar* string"_xml;
-inline CONSTEXPR const xmlChar* operator "" _xml (char const *s, std::size_t len)
+inline const xmlChar* operator "" _xml (char const *s, std::size_t len)
 {
     return (const xmlChar*)s;
 }
@@ -0,0 +1,240 @@
+//
+//  buffer_pool.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "buffer_pool.h"
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+
+#if EPUB_OS(WINDOWS)
+# include <Windows.h>
+#else
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+#ifdef ENABLE_SYS_CACHE_FLUSH
+#include "CPUCacheUtils.h"
+#endif //ENABLE_SYS_CACHE_FLUSH
+
+EPUB3_BEGIN_NAMESPACE
+
+CONSTEXPR size_t BufferPool::MinimumClassSize;
+CONSTEXPR size_t BufferPool::MaximumClassSize;
+CONSTEXPR size_t BufferPool::DefaultIdleLimit;
+CONSTEXPR size_t BufferPool::NumSizeClasses;
+
+// calling memset through a volatile pointer stops the compiler eliding it before free()
+static void* (* const volatile gSecureMemset)(void*, int, size_t) = &memset;
+
+static size_t PageSize()
+{
+#if EPUB_OS(WINDOWS)
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    static const size_t __pageSize = info.dwPageSize;
+#else
+    static const size_t __pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+    return __pageSize;
+}
+
+// zeroed heap memory covering whole pages of its own, so it can be locked without
+// affecting anything else; the heap (unlike fresh mappings) reuses pages already faulted
+// in, and calloc() knows when they're already zero. The start of the underlying block is
+// kept just below the aligned pages.
+static uint8_t* AllocatePages(size_t size, bool lock)
+{
+    size_t pageSize = PageSize();
+    size = (size + pageSize - 1) & ~(pageSize - 1);
+
+    uint8_t* block = reinterpret_cast<uint8_t*>(::calloc(size + pageSize, sizeof(uint8_t)));
+    if ( block == nullptr )
+        return nullptr;
+
+    uint8_t* bytes = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(block) + pageSize) & ~(pageSize - 1));
+    reinterpret_cast<uint8_t**>(bytes)[-1] = block;
+
+    // best effort: the process's limit may be too small
+#if EPUB_OS(WINDOWS)
+    if ( lock )
+        ::VirtualLock(bytes, size);
+#else
+    if ( lock )
+        ::mlock(bytes, size);
+#endif
+    return bytes;
+}
+static void FreePages(uint8_t* bytes, size_t size, bool unlock)
+{
+    size_t pageSize = PageSize();
+    size = (size + pageSize - 1) & ~(pageSize - 1);
+
+#if EPUB_OS(WINDOWS)
+    if ( unlock )
+        ::VirtualUnlock(bytes, size);
+#else
+    if ( unlock )
+        ::munlock(bytes, size);
+#endif
+    ::free(reinterpret_cast<uint8_t**>(bytes)[-1]);
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& o)
+{
+    if ( this != &o )
+    {
+        Reset();
+        _pool = std::move(o._pool);
+        _bytes = o._bytes;
+        _capacity = o._capacity;
+        o._bytes = nullptr;
+        o._capacity = 0;
+    }
+    return *this;
+}
+void BufferPool::Buffer::Reset()
+{
+    if ( _bytes != nullptr && bool(_pool) )
+        _pool->Recycle(_bytes, _capacity);
+
+    _pool.reset();
+    _bytes = nullptr;
+    _capacity = 0;
+}
+
+BufferPool::BufferPool(size_t idleLimit, bool lockPages) : _lock(), _idleBytes(0), _idleLimit(idleLimit), _hits(0), _misses(0), _lockPages(lockPages), _lockedPages(lockPages)
+{
+}
+BufferPool::~BufferPool()
+{
+    Purge();
+}
+size_t BufferPool::SizeClassFor(size_t size)
+{
+    size_t classSize = MinimumClassSize;
+    for ( size_t i = 0; i < NumSizeClasses; i++, classSize <<= 1 )
+    {
+        if ( size <= classSize )
+            return i;
+    }
+    return NumSizeClasses;
+}
+BufferPool::Buffer BufferPool::Acquire(size_t size)
+{
+    if ( size == 0 )
+        return Buffer();
+
+    size_t sizeClass = SizeClassFor(size);
+    size_t capacity = (sizeClass < NumSizeClasses ? MinimumClassSize << sizeClass : size);
+
+    if ( sizeClass < NumSizeClasses )
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        FreeList& freeList = _freeLists[sizeClass];
+        if ( !freeList.empty() )
+        {
+            uint8_t* bytes = freeList.back();
+            freeList.pop_back();
+            _idleBytes -= capacity;
+            _hits++;
+            return Buffer(shared_from_this(), bytes, capacity);
+        }
+
+        _misses++;
+    }
+
+    bool lock = _lockPages;
+    if ( lock )
+        _lockedPages = true;
+    uint8_t* bytes = AllocatePages(capacity, lock);
+    if ( bytes == nullptr )
+        throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "BufferPool");
+
+    return Buffer(shared_from_this(), bytes, capacity);
+}
+void BufferPool::Recycle(uint8_t* bytes, size_t capacity)
+{
+    SecureErase(bytes, capacity);
+
+    size_t sizeClass = SizeClassFor(capacity);
+    if ( sizeClass < NumSizeClasses )
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if ( _idleBytes + capacity <= _idleLimit )
+        {
+            _freeLists[sizeClass].push_back(bytes);
+            _idleBytes += capacity;
+            return;
+        }
+    }
+
+    FreePages(bytes, capacity, _lockedPages);
+}
+void BufferPool::Purge()
+{
+    std::lock_guard<std::mutex> _(_lock);
+    for ( FreeList& freeList : _freeLists )
+    {
+        size_t capacity = MinimumClassSize << (&freeList - _freeLists);
+        for ( uint8_t* bytes : freeList )
+        {
+            FreePages(bytes, capacity, _lockedPages);
+        }
+        freeList.clear();
+    }
+    _idleBytes = 0;
+}
+BufferPool::Statistics BufferPool::GetStatistics() const
+{
+    std::lock_guard<std::mutex> _(_lock);
+    Statistics stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.idleBytes = _idleBytes;
+    return stats;
+}
+std::shared_ptr<BufferPool> BufferPool::Shared()
+{
+    static std::shared_ptr<BufferPool> __shared = std::make_shared<BufferPool>();
+    return __shared;
+}
+std::shared_ptr<BufferPool> BufferPool::ForCurrentThread()
+{
+#if EPUB_COMPILER_SUPPORTS(CXX_THREAD_LOCAL)
+    // per-thread pools hold fewer idle bytes, since there may be many of them
+    static thread_local std::shared_ptr<BufferPool> __pool = std::make_shared<BufferPool>(DefaultIdleLimit / 4);
+    return __pool;
+#else
+    return Shared();
+#endif
+}
+void BufferPool::SecureErase(void* bytes, size_t len)
+{
+    if ( bytes == nullptr || len == 0 )
+        return;
+
+    gSecureMemset(bytes, 0, len);
+
+#ifdef ENABLE_SYS_CACHE_FLUSH
+    epub_sys_cache_flush(bytes, len);
+#endif //ENABLE_SYS_CACHE_FLUSH
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,204 @@
+//
+//  buffer_pool.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ePub3_buffer_pool_h
+#define ePub3_buffer_pool_h
+
+#include <ePub3/epub3.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ A size-classed pool of byte buffers for decrypted content.
+
+ Filters serving range requests need a scratch buffer for every read, and secure
+ ByteBuffers keep their storage here too. Rather than going to the heap each time,
+ buffers are taken from a pool and returned to it when no longer needed. Requests
+ are rounded up to a power-of-two size class between MinimumClassSize and
+ MaximumClassSize; larger requests bypass the pool entirely.
+
+ Every buffer occupies whole pages of its own, so it's page-aligned and never
+ shares a page with other heap data. Buffers may optionally be locked into
+ physical memory, so they're never written to swap (see SetLocksPages()).
+
+ Since these buffers routinely hold decrypted content, every buffer is securely
+ erased when it is returned to the pool (or freed), before it can be handed out
+ again. That's the only time a buffer is erased.
+
+ Each pool is internally synchronized, so a buffer may be released on a different
+ thread from the one which acquired it. ForCurrentThread() returns a pool private
+ to the calling thread, which avoids any lock contention in the common case.
+ */
+class BufferPool : public std::enable_shared_from_this<BufferPool>
+{
+public:
+    ///
+    /// The smallest size class. Smaller requests are rounded up to this size.
+    static CONSTEXPR size_t MinimumClassSize    = 4 * 1024;
+    ///
+    /// The largest size class. Larger requests are allocated and freed directly.
+    static CONSTEXPR size_t MaximumClassSize    = 4 * 1024 * 1024;
+    ///
+    /// The default limit on the number of idle bytes held by a pool.
+    static CONSTEXPR size_t DefaultIdleLimit    = 8 * 1024 * 1024;
+
+    /**
+     A buffer obtained from a BufferPool.
+
+     The buffer is returned to its pool when this object is destroyed or reset. It
+     holds a strong reference to the pool, so it may safely outlive the thread
+     which acquired it.
+     */
+    class Buffer
+    {
+    private:
+                    Buffer(const Buffer&)                   _DELETED_;
+        Buffer&     operator=(const Buffer&)                _DELETED_;
+
+    public:
+                    Buffer() : _pool(), _bytes(nullptr), _capacity(0) {}
+                    Buffer(Buffer&& o) : _pool(std::move(o._pool)), _bytes(o._bytes), _capacity(o._capacity)
+                        { o._bytes = nullptr; o._capacity = 0; }
+                    ~Buffer()                               { Reset(); }
+
+        Buffer&     operator=(Buffer&& o);
+
+        ///
+        /// The start of the buffer, or `nullptr` if the buffer is empty.
+        uint8_t*    GetBytes()                      const   { return _bytes; }
+        ///
+        /// The usable size of the buffer, which may be larger than requested.
+        size_t      GetCapacity()                   const   { return _capacity; }
+
+        explicit    operator bool()                 const   { return _bytes != nullptr; }
+
+        ///
+        /// Erases the buffer's content and returns it to its pool.
+        void        Reset();
+
+    protected:
+                    Buffer(std::shared_ptr<BufferPool> pool, uint8_t* bytes, size_t capacity)
+                        : _pool(pool), _bytes(bytes), _capacity(capacity) {}
+
+        std::shared_ptr<BufferPool> _pool;
+        uint8_t*                    _bytes;
+        size_t                      _capacity;
+
+        friend class BufferPool;
+    };
+
+    ///
+    /// Usage counts for a pool.
+    struct Statistics
+    {
+        size_t      hits;           ///< Requests satisfied by an idle buffer.
+        size_t      misses;         ///< Requests which required a new allocation.
+        size_t      idleBytes;      ///< Bytes held in idle buffers.
+    };
+
+private:
+                    BufferPool(const BufferPool&)           _DELETED_;
+    BufferPool&     operator=(const BufferPool&)            _DELETED_;
+
+public:
+    /**
+     Creates a new pool.
+     @param idleLimit The maximum number of bytes to keep in idle buffers. Buffers
+     released while the pool is at this limit are freed.
+     */
+    EPUB3_EXPORT    BufferPool(size_t idleLimit = DefaultIdleLimit, bool lockPages = false);
+    virtual         ~BufferPool();
+
+    /**
+     Obtains a buffer of at least the given size.
+
+     The content of the returned buffer is zeroed.
+     @param size The minimum size of the buffer.
+     @result A buffer, or an empty buffer if `size` is zero.
+     @throws std::system_error if memory cannot be allocated.
+     */
+    EPUB3_EXPORT
+    Buffer          Acquire(size_t size);
+
+    ///
+    /// Frees all idle buffers.
+    EPUB3_EXPORT
+    void            Purge();
+
+    /**
+     Sets whether newly allocated buffers are locked into physical memory.
+
+     Locking is best-effort: if the process's limit on locked memory is reached, the
+     buffer is still returned, but may be swapped out like any other memory.
+     */
+    EPUB3_EXPORT
+    void            SetLocksPages(bool value)               { _lockPages = value; }
+    bool            LocksPages()                    const   { return _lockPages; }
+
+    ///
+    /// Returns the pool's current usage counts.
+    EPUB3_EXPORT
+    Statistics      GetStatistics()                 const;
+
+    ///
+    /// The process-wide pool.
+    EPUB3_EXPORT
+    static std::shared_ptr<BufferPool>  Shared();
+
+    ///
+    /// A pool used only by the calling thread, or the shared pool where thread-local storage is unavailable.
+    EPUB3_EXPORT
+    static std::shared_ptr<BufferPool>  ForCurrentThread();
+
+    ///
+    /// Zeroes memory in a manner which will not be optimized away.
+    EPUB3_EXPORT
+    static void     SecureErase(void* bytes, size_t len);
+
+protected:
+    typedef std::vector<uint8_t*>   FreeList;
+
+    static CONSTEXPR size_t         NumSizeClasses  = 11;     // 4KB ... 4MB
+
+    mutable std::mutex  _lock;
+    FreeList            _freeLists[NumSizeClasses];
+    size_t              _idleBytes;
+    size_t              _idleLimit;
+    size_t              _hits;
+    size_t              _misses;
+    std::atomic<bool>   _lockPages;
+    std::atomic<bool>   _lockedPages;   // whether any buffer has been locked, so must be unlocked when freed
+
+    ///
+    /// Returns the size class index for a request, or NumSizeClasses if it's too large to pool.
+    static size_t   SizeClassFor(size_t size);
+
+    ///
+    /// Erases a buffer and either keeps it for reuse or frees it.
+    void            Recycle(uint8_t* bytes, size_t capacity);
+
+};
+
+EPUB3_END_NAMESPACE
+
+#endif
@@ -21,13 +21,11 @@
 #define _EPUB3_BUILDING_BYTE_BUFFER
 
 #include "byte_buffer.h"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <system_error>
 
-#ifdef ENABLE_SYS_CACHE_FLUSH
-#include "CPUCacheUtils.h"
-#endif //ENABLE_SYS_CACHE_FLUSH
-
 #if EPUB_OS(BSD)
 # include <malloc/malloc.h>
 # define GoodSize(size)     malloc_good_size(size)
@@ -44,68 +42,40 @@ EPUB3_BEGIN_NAMESPACE
 
 const prealloc_buf_t prealloc_buf = {};
 
-ByteBuffer::ByteBuffer(size_t bufferSize) : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0)
+ByteBuffer::ByteBuffer(size_t bufferSize) : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0), m_secure(false), m_secureStorage()
 {
-    size_t cap = GoodSize(bufferSize);
-	m_buffer = reinterpret_cast<unsigned char*>(calloc(cap, sizeof(unsigned char)));
-    if ( m_buffer == nullptr )
-        throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
-    
+    m_buffer = Allocate(bufferSize, false, m_secureStorage, m_bufferCapacity);
     m_bufferSize = bufferSize;
-    m_bufferCapacity = cap;
 }
-ByteBuffer::ByteBuffer(size_t bufferSize, prealloc_buf_t) : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0)
+ByteBuffer::ByteBuffer(size_t bufferSize, prealloc_buf_t) : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0), m_secure(false), m_secureStorage()
 {
-    size_t cap = GoodSize(bufferSize);
-	m_buffer = reinterpret_cast<unsigned char*>(calloc(cap, sizeof(unsigned char)));
-    if ( m_buffer == nullptr )
-        throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
-    
-    m_bufferCapacity = cap;
+    m_buffer = Allocate(bufferSize, false, m_secureStorage, m_bufferCapacity);
 }
-ByteBuffer::ByteBuffer(const unsigned char* buffer, size_t bufferSize)
+ByteBuffer::ByteBuffer(const unsigned char* buffer, size_t bufferSize) : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0), m_secure(false), m_secureStorage()
 {
-    size_t cap = GoodSize(bufferSize);
-	m_buffer = reinterpret_cast<unsigned char*>(calloc(cap, sizeof(unsigned char)));
-    if ( m_buffer == nullptr )
-        throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
-    
+    m_buffer = Allocate(bufferSize, false, m_secureStorage, m_bufferCapacity);
     memcpy(m_buffer, buffer, bufferSize);
     m_bufferSize = bufferSize;
-    m_bufferCapacity = cap;
 }
-#if !EPUB_COMPILER_SUPPORTS(CXX_DELEGATING_CONSTRUCTORS)
-ByteBuffer::ByteBuffer(const ByteBuffer& o)
+ByteBuffer::ByteBuffer(const ByteBuffer& o) : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0), m_secure(o.m_secure), m_secureStorage()
 {
-    m_buffer = reinterpret_cast<unsigned char*>(malloc(o.m_bufferCapacity));
-    if ( m_buffer == nullptr )
-        throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
-    
+    // a copy of secure content is just as sensitive
+    m_buffer = Allocate(o.m_bufferSize, m_secure, m_secureStorage, m_bufferCapacity);
     memcpy(m_buffer, o.m_buffer, o.m_bufferSize);
     m_bufferSize = o.m_bufferSize;
-    m_bufferCapacity = o.m_bufferCapacity;
 }
-#endif
 ByteBuffer::~ByteBuffer()
 {
-    
-    if ( m_buffer != nullptr )
-    {
-        if ( m_secure )
-            Clean(m_buffer, m_bufferCapacity);
-        free(m_buffer);
-    }
-    
-    m_buffer = nullptr;
+    Release();
     m_bufferSize = 0;
-    m_bufferCapacity = 0;
 }
 
 ByteBuffer& ByteBuffer::operator=(const ByteBuffer& o)
 {
+    if ( this == &o )
+        return *this;
+    
     EnsureCapacity(o.m_bufferCapacity);
-    if ( m_secure && o.m_bufferSize < m_bufferSize )
-        Clean(m_buffer+o.m_bufferSize, m_bufferSize-o.m_bufferSize);
     ::memcpy(m_buffer, o.m_buffer, o.m_bufferSize);
     
     m_bufferSize = o.m_bufferSize;
@@ -113,17 +83,16 @@ ByteBuffer& ByteBuffer::operator=(const ByteBuffer& o)
 }
 ByteBuffer& ByteBuffer::operator=(ByteBuffer&& o)
 {
-    if ( m_buffer != nullptr )
-    {
-        if ( m_secure )
-            Clean(m_buffer, m_bufferCapacity);
-        ::free(m_buffer);
-    }
+    if ( this == &o )
+        return *this;
+    
+    Release();
     
     m_buffer = o.m_buffer;
     m_bufferSize = o.m_bufferSize;
     m_bufferCapacity = o.m_bufferCapacity;
     m_secure = o.m_secure;
+    m_secureStorage = std::move(o.m_secureStorage);
     
     o.m_buffer = nullptr;
     o.m_bufferSize = o.m_bufferCapacity = 0;
@@ -139,6 +108,37 @@ bool ByteBuffer::operator==(const ByteBuffer& o) const
     return (::memcmp(m_buffer, o.m_buffer, m_bufferSize) == 0);
 }
 
+void ByteBuffer::SetUsesSecureErasure(bool value)
+{
+    if ( value == m_secure )
+        return;
+    
+    if ( m_buffer == nullptr )
+    {
+        m_secure = value;
+        return;
+    }
+    
+    // move the content into the right kind of storage; the old storage is erased either way
+    BufferPool::Buffer storage;
+    size_t capacity = 0;
+    unsigned char* buffer = Allocate(m_bufferCapacity, value, storage, capacity);
+    ::memcpy(buffer, m_buffer, m_bufferSize);
+    
+    if ( !m_secure )
+    {
+        BufferPool::SecureErase(m_buffer, m_bufferCapacity);
+        ::free(m_buffer);
+        m_buffer = nullptr;
+    }
+    Release();
+    
+    m_buffer = buffer;
+    m_bufferCapacity = capacity;
+    m_secure = value;
+    m_secureStorage = std::move(storage);
+}
+
 size_t ByteBuffer::MoveTo(unsigned char *targetBuffer, size_t targetBufferSize)
 {
     if (m_bufferSize == 0)
@@ -154,8 +154,6 @@ size_t ByteBuffer::MoveTo(unsigned char *targetBuffer, size_t targetBufferSize)
         bzero(targetBuffer+m_bufferSize, targetBufferSize-m_bufferSize);
         resultLen = m_bufferSize;
         
-        if ( m_secure )
-            Clean(m_buffer, m_bufferCapacity);
         m_bufferSize = 0;       // allocation & capacity remain until Compact() is called
     }
     else
@@ -173,9 +171,6 @@ size_t ByteBuffer::MoveTo(unsigned char *targetBuffer, size_t targetBufferSize)
         // set the new length
         m_bufferSize = remainderLen;
         
-        if ( m_secure )
-            Clean(m_buffer+m_bufferSize, m_bufferCapacity-m_bufferSize);
-        
         resultLen = targetBufferSize;
         // capacity remains until Compact() is called
     }
@@ -192,6 +187,7 @@ void ByteBuffer::AddBytes(unsigned char *extraBytes, size_t extraBytesSize)
 
 void ByteBuffer::RemoveBytes(size_t numBytesToRemove, size_t pos)
 {
+    // removed bytes stay in memory the buffer owns; secure storage is erased once, on release
 	if (numBytesToRemove >= m_bufferSize && pos == 0)
     {
         m_bufferSize = 0;
@@ -207,23 +203,40 @@ void ByteBuffer::RemoveBytes(size_t numBytesToRemove, size_t pos)
 	}
 
     m_bufferSize = newBufferSize;
-    
-    if ( m_secure )
-        Clean(m_buffer+m_bufferSize, m_bufferCapacity-m_bufferSize);
 }
 
 void ByteBuffer::Compact()
 {
-    if ( m_bufferCapacity > m_bufferSize )
+    if ( m_bufferCapacity <= m_bufferSize )
+        return;
+    
+    if ( m_secure )
     {
-        if ( m_secure )
-            Clean(m_buffer+m_bufferSize, m_bufferCapacity-m_bufferSize);
+        if ( m_bufferSize == 0 )
+        {
+            Release();
+            return;
+        }
+        
+        // only worth moving if it frees a size class or more
+        BufferPool::Buffer storage;
+        size_t capacity = 0;
+        unsigned char* buffer = Allocate(m_bufferSize, true, storage, capacity);
+        if ( capacity >= m_bufferCapacity )
+            return;
         
-        m_buffer = reinterpret_cast<unsigned char*>(realloc(m_buffer, m_bufferSize));
-        if ( m_buffer == nullptr )
-            throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
-        m_bufferCapacity = m_bufferSize;
+        ::memcpy(buffer, m_buffer, m_bufferSize);
+        Release();
+        m_buffer = buffer;
+        m_bufferCapacity = capacity;
+        m_secureStorage = std::move(storage);
+        return;
     }
+    
+    m_buffer = reinterpret_cast<unsigned char*>(realloc(m_buffer, m_bufferSize));
+    if ( m_buffer == nullptr )
+        throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
+    m_bufferCapacity = m_bufferSize;
 }
 
 void ByteBuffer::EnsureCapacity(size_t desired)
@@ -231,24 +244,56 @@ void ByteBuffer::EnsureCapacity(size_t desired)
     if ( m_bufferCapacity >= desired )
         return;
     
+    if ( m_secure )
+    {
+        // grow geometrically, since every move copies the content
+        BufferPool::Buffer storage;
+        size_t capacity = 0;
+        unsigned char* buffer = Allocate(std::max(desired, m_bufferCapacity + m_bufferCapacity/2), true, storage, capacity);
+        if ( m_buffer != nullptr )
+            ::memcpy(buffer, m_buffer, m_bufferSize);
+        
+        Release();
+        m_buffer = buffer;
+        m_bufferCapacity = capacity;
+        m_secureStorage = std::move(storage);
+        return;
+    }
+    
     size_t newCap = GoodSize(desired);
     m_buffer = reinterpret_cast<unsigned char*>(realloc(m_buffer, newCap));
     if ( m_buffer == nullptr )
         throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
     m_bufferCapacity = newCap;
-    
-    // zero trailing data
-    if ( m_secure )
-        Clean(m_buffer+m_bufferSize, m_bufferCapacity-m_bufferSize);
 }
 
-void ByteBuffer::Clean(unsigned char *ptr, size_t len)
+unsigned char* ByteBuffer::Allocate(size_t capacity, bool secure, BufferPool::Buffer& secureStorage, size_t& actualCapacity)
 {
-    bzero(ptr, len);
+    if ( secure )
+    {
+        // pooled memory is always zeroed
+        secureStorage = BufferPool::Shared()->Acquire(std::max(capacity, size_t(1)));
+        actualCapacity = secureStorage.GetCapacity();
+        return secureStorage.GetBytes();
+    }
+    
+    size_t cap = GoodSize(capacity);
+    unsigned char* buffer = reinterpret_cast<unsigned char*>(calloc(cap, sizeof(unsigned char)));
+    if ( buffer == nullptr )
+        throw std::system_error(std::make_error_code(std::errc::not_enough_memory), "ByteBuffer");
+    actualCapacity = cap;
+    return buffer;
+}
 
-#ifdef ENABLE_SYS_CACHE_FLUSH
-    epub_sys_cache_flush(ptr, len);
-#endif //ENABLE_SYS_CACHE_FLUSH
+void ByteBuffer::Release()
+{
+    if ( m_secure )
+        m_secureStorage.Reset();        // erases the storage as it's returned to the pool
+    else if ( m_buffer != nullptr )
+        ::free(m_buffer);
+    
+    m_buffer = nullptr;
+    m_bufferCapacity = 0;
 }
 
 EPUB3_END_NAMESPACE
@@ -22,6 +22,7 @@
 #define ePub3_byte_buffer_h
 
 #include <ePub3/epub3.h>
+#include <ePub3/utilities/buffer_pool.h>
 
 #if EPUB_PLATFORM(WINRT)
 namespace Readium { class BridgedByteBuffer; };
@@ -49,16 +50,13 @@ class ByteBuffer
 {
 public:
     
-    ByteBuffer() : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0) {}
+    ByteBuffer() : m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0), m_secure(false), m_secureStorage() {}
     ByteBuffer(size_t bufferSize);
     ByteBuffer(size_t bufferSize, prealloc_buf_t);
     ByteBuffer(const unsigned char *buffer, size_t bufferSize);   // copy-in
-#if EPUB_COMPILER_SUPPORTS(CXX_DELEGATING_CONSTRUCTORS)
-    ByteBuffer(const ByteBuffer& o) : ByteBuffer(o.m_buffer, o.m_bufferSize) {}
-#else
     ByteBuffer(const ByteBuffer& o);
-#endif
-    ByteBuffer(ByteBuffer &&o) : m_buffer(std::move(o.m_buffer)), m_bufferSize(o.m_bufferSize), m_bufferCapacity(o.m_bufferCapacity) { o.m_bufferSize = o.m_bufferCapacity = 0; }
+    ByteBuffer(ByteBuffer &&o) _NOEXCEPT : m_buffer(o.m_buffer), m_bufferSize(o.m_bufferSize), m_bufferCapacity(o.m_bufferCapacity), m_secure(o.m_secure), m_secureStorage(std::move(o.m_secureStorage))
+        { o.m_buffer = nullptr; o.m_bufferSize = o.m_bufferCapacity = 0; o.m_secure = false; }
     virtual ~ByteBuffer();
     
     ByteBuffer& operator=(const ByteBuffer&);
@@ -68,12 +66,18 @@ public:
     bool operator!=(const ByteBuffer& o) const { return !(*this == o); }
     
     /**
-     Tells the buffer to perform secure erasure by zeroing all unused memory.
+     Tells the buffer to keep its content in secure memory.
      
-     This will also trigger a data cache flush where supported.
-     @param value `true` to perform secure erasure, `false` otherwise.
+     Secure storage comes from the shared BufferPool, and is erased (with a data
+     cache flush where supported) once, when the buffer releases it: on destruction,
+     reassignment, or when it grows or is compacted into a new allocation. Memory
+     which the buffer still owns isn't erased as bytes are removed from it.
+     
+     Any existing content is moved into the new storage, and the old storage erased.
+     Ideally this is called before any sensitive content is added.
+     @param value `true` to use secure storage, `false` otherwise.
      */
-    void SetUsesSecureErasure(bool value=true) { m_secure = value; }
+    void SetUsesSecureErasure(bool value=true);
     bool UsesSecureErasure() const { return m_secure; }
     
     /**
@@ -120,7 +124,11 @@ public:
 private:
     
     void EnsureCapacity(size_t desired);
-    void Clean(unsigned char* ptr, size_t len);
+    
+    // allocates zeroed storage of at least the given capacity, without releasing the current storage
+    unsigned char* Allocate(size_t capacity, bool secure, BufferPool::Buffer& secureStorage, size_t& actualCapacity);
+    // releases the current storage, erasing it first if it's secure; the size is left alone
+    void Release();
     
     // the object is managing this memory, so a raw pointer is acceptable here
     unsigned char* m_buffer;
@@ -128,8 +136,10 @@ private:
     size_t m_bufferSize;
     // actual allocated capacity (may be more)
     size_t m_bufferCapacity;
-    // whether to zero unused bytes
+    // whether the storage is secure memory
     bool m_secure;
+    // owns the storage when it's secure; m_buffer points into it
+    BufferPool::Buffer m_secureStorage;
 #if EPUB_PLATFORM(WINRT)
 	friend class ::Readium::BridgedByteBuffer;
 #endif
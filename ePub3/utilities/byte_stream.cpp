@@ -19,7 +19,9 @@
 //  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "byte_stream.h"
+#include "instrumentation.h"
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <libzip/zip.h>
 #include <libzip/zipint.h>          // for internals of zip_file
@@ -274,7 +276,7 @@ RunLoop::EventSourcePtr AsyncByteStream::AsyncEventSource()
         
         bool hasRead = false, hasWritten = false;
         
-        uint8_t buf[4096];
+        uint8_t buf[16*1024];
         
         shared_ptr<RingBuffer> readBuf = weakReadBuf.lock();
         shared_ptr<RingBuffer> writeBuf = weakWriteBuf.lock();
@@ -282,7 +284,7 @@ RunLoop::EventSourcePtr AsyncByteStream::AsyncEventSource()
         if ( (t & ReadSpaceAvailable) == ReadSpaceAvailable && readBuf )
         {
             std::lock_guard<RingBuffer> _(*readBuf);
-            size_type read = this->read_for_async(buf, readBuf->SpaceAvailable());
+            size_type read = this->read_for_async(buf, std::min(readBuf->SpaceAvailable(), sizeof(buf)));
             if ( read != 0 )
             {
                 readBuf->WriteBytes(buf, read);
@@ -296,7 +298,7 @@ RunLoop::EventSourcePtr AsyncByteStream::AsyncEventSource()
         if ( (t & DataToWrite) == DataToWrite && writeBuf )
         {
             std::lock_guard<RingBuffer> _(*writeBuf);
-            size_type written = writeBuf->ReadBytes(buf, writeBuf->BytesAvailable());
+            size_type written = writeBuf->ReadBytes(buf, std::min(writeBuf->BytesAvailable(), sizeof(buf)));
             written = this->write_for_async(buf, written);
             if ( written != 0 )
             {
@@ -336,7 +338,8 @@ RunLoop::EventSourcePtr AsyncByteStream::EventDispatchSource()
                 _eventSource->Cancel();
             return;
         }
-        if ( _eof )
+        // the end is only reached once everything buffered has been read
+        if ( _eof && BytesAvailable() == 0 )
         {
             if ( bool(_eventHandler) )
                 _eventHandler(AsyncEvent::EndEncountered, this);
@@ -735,15 +738,38 @@ std::shared_ptr<SeekableByteStream> FileByteStream::Clone() const
 
 	return result;
 }
+bool FileByteStream::GetFileRange(FileRange& range) const _NOEXCEPT
+{
+    if ( _file == nullptr )
+        return false;
+    
+#if EPUB_OS(WINDOWS)
+    int fd = _fileno(_file);
+#else
+    int fd = fileno(_file);
+#endif
+    struct stat sb;
+    if ( fd == -1 || ::fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) )
+        return false;
+    
+    range.fd = fd;
+    range.offset = 0;
+    range.length = uint64_t(sb.st_size);
+    return true;
+}
 
 #if 0
 #pragma mark -
 #endif
 
-ZipFileByteStream::ZipFileByteStream(struct zip* archive, const string& path, int flags) : SeekableByteStream(), _file(nullptr), _mode(0)
+ZipFileByteStream::ZipFileByteStream(struct zip* archive, const string& path, int flags) : SeekableByteStream(), _file(nullptr), _mode(std::ios::openmode())
 {
     Open(archive, path, flags);
 }
+ZipFileByteStream::ZipFileByteStream(struct zip* archive, int index, int flags) : SeekableByteStream(), _file(nullptr), _mode(std::ios::openmode())
+{
+    OpenIndex(archive, index, flags);
+}
 ZipFileByteStream::~ZipFileByteStream()
 {
     Close();
@@ -772,6 +798,17 @@ bool ZipFileByteStream::Open(struct zip *archive, const string &path, int flags)
     _file = zip_fopen(archive, Sanitized(path).c_str(), flags);
     return ( _file != nullptr );
 }
+bool ZipFileByteStream::OpenIndex(struct zip *archive, int index, int flags)
+{
+    if ( _file != nullptr )
+        Close();
+    
+    if ( index < 0 )
+        return false;
+    
+    _file = zip_fopen_index(archive, index, flags);
+    return ( _file != nullptr );
+}
 void ZipFileByteStream::Close()
 {
     if ( _file == nullptr )
@@ -787,12 +824,14 @@ ByteStream::size_type ZipFileByteStream::ReadBytes(void *buf, size_type len)
     if ( _file == nullptr )
         return 0;
     
+    EPUB_MEASURE(measure, ArchiveRead);
     ssize_t numRead = zip_fread(_file, buf, len);
     if ( numRead < 0 )
     {
         Close();
         return 0;
     }
+    EPUB_MEASURE_BYTES(measure, numRead);
 
 	_eof = (_file->bytes_left == 0);
     
@@ -848,6 +887,46 @@ std::shared_ptr<SeekableByteStream> ZipFileByteStream::Clone() const
 
 	return result;
 }
+bool ZipFileByteStream::GetFileRange(FileRange& range) const _NOEXCEPT
+{
+    if ( _file == nullptr )
+        return false;
+    return StoredFileRange(_file->za, _file->file_index, range);
+}
+bool ZipFileByteStream::StoredFileRange(struct zip* archive, int index, FileRange& range)
+{
+    if ( archive == nullptr || archive->zp == nullptr )
+        return false;
+    
+    // only the original data will do, not anything replaced or added since opening
+    struct zip_stat st;
+    if ( zip_stat_index(archive, index, ZIP_FL_UNCHANGED, &st) != 0 )
+        return false;
+    if ( st.comp_method != ZIP_CM_STORE || st.encryption_method != ZIP_EM_NONE || st.size != st.comp_size )
+        return false;
+    if ( archive->entry[index].state != ZIP_ST_UNCHANGED )
+        return false;
+    
+#if EPUB_OS(WINDOWS)
+    // there's nothing on Windows to send the range with
+    return false;
+#else
+    // the data follows the local header, whose name and extra field can differ in
+    // length from the central directory's; pread() leaves libzip's file position alone
+    int fd = fileno(archive->zp);
+    off_t header = off_t(archive->cdir->entry[index].offset);
+    unsigned char local[LENTRYSIZE];
+    if ( fd == -1 || ::pread(fd, local, sizeof(local), header) != ssize_t(sizeof(local)) )
+        return false;
+    if ( std::memcmp(local, LOCAL_MAGIC, 4) != 0 )
+        return false;
+    
+    range.fd = fd;
+    range.offset = uint64_t(header) + LENTRYSIZE + (local[26] | (local[27] << 8)) + (local[28] | (local[29] << 8));
+    range.length = st.size;
+    return true;
+#endif
+}
 
 #ifdef SUPPORT_ASYNC
 #if 0
@@ -62,6 +62,25 @@ static string Sanitized(const string& path)
     return path;
 }
 
+/**
+ The location of some stream's bytes within an ordinary file.
+ 
+ This lets a stream's content be sent to a socket or pipe by the kernel, using
+ `sendfile()` or `splice()`, rather than copied through a buffer.
+ 
+ The descriptor belongs to the object which supplied the range, and is valid only
+ while that object is open. Other readers may share it, so transfer the bytes with
+ calls which take an explicit offset, and leave the descriptor's own file position
+ alone; to use it beyond the owner's lifetime, `dup()` it.
+ @ingroup utilities
+ */
+struct FileRange
+{
+    int                     fd;         ///< A descriptor for the file containing the bytes.
+    uint64_t                offset;     ///< The position of the first byte within the file.
+    uint64_t                length;     ///< The number of bytes.
+};
+
     /**
  The abstract base class for all stream and pipe objects used by the Readium SDK.
  
@@ -139,6 +158,17 @@ public:
     /// Returns any error code reported by the underlying system.
     virtual int             Error()                                 const _NOEXCEPT  { return _err; }
     
+    /**
+     Locates the stream's whole content, from its start, within a file.
+     
+     This succeeds only where the stream's bytes are kept verbatim in a file, so
+     that they can be sent from there directly. The default implementation returns
+     `false`.
+     @param range Filled in with the location of the content.
+     @result Returns `true` if the content is available from a file, `false` otherwise.
+     */
+    virtual bool            GetFileRange(FileRange& range)          const _NOEXCEPT  { return false; }
+    
 protected:
     bool                    _eof;   ///< Whether the end of a finite-length data stream has been reached.
     int                     _err;   ///< Any system error which has occurred on this stream.
@@ -547,6 +577,10 @@ public:
 	 */
 	virtual std::shared_ptr<SeekableByteStream> Clone() const OVERRIDE;
     
+    ///
+    /// Returns the whole of the underlying file.
+    virtual bool            GetFileRange(FileRange& range)          const _NOEXCEPT OVERRIDE;
+    
 protected:
     FILE*                   _file;  ///< The underlying system file stream.
 	std::ios::openmode		_mode;	///< The mode used to open the file (used by Clone()).
@@ -569,6 +603,13 @@ public:
      @param zipFlags Flags such as whether to read the raw compressed data.
      */
     EPUB3_EXPORT            ZipFileByteStream(struct zip* archive, const string& pathToOpen, int zipFlags=0);
+    /**
+     Create a new stream to a file within a zip archive, identified by its index.
+     @param archive The Zip arrchive containing the target file.
+     @param index The index of the target file within the archive.
+     @param zipFlags Flags such as whether to read the raw compressed data.
+     */
+    EPUB3_EXPORT            ZipFileByteStream(struct zip* archive, int index, int zipFlags=0);
     virtual                 ~ZipFileByteStream();
     
 private:
@@ -596,6 +637,17 @@ public:
      @result Returns `true` if the file opened successfully, `false` otherwise.
      */
     virtual bool            Open(struct zip* archive, const string& path, int zipFlags=0);
+    /**
+     Opens a file within an archive by its index and attaches the stream.
+     
+     This avoids the linear search of the archive's central directory performed
+     when opening by path.
+     @param archive The Zip arrchive containing the target file.
+     @param index The index of the target file within the archive.
+     @param zipFlags Flags such as whether to read the raw compressed data.
+     @result Returns `true` if the file opened successfully, `false` otherwise.
+     */
+    virtual bool            OpenIndex(struct zip* archive, int index, int zipFlags=0);
     ///
     /// @copydoc ByteStream::Close()
     virtual void            Close();
@@ -631,6 +683,24 @@ public:
 	*/
 	virtual std::shared_ptr<SeekableByteStream> Clone() const OVERRIDE;
     
+    ///
+    /// Succeeds if the target file is stored in the archive without compression.
+    virtual bool            GetFileRange(FileRange& range)          const _NOEXCEPT OVERRIDE;
+    
+    /**
+     Locates an entry's data within a Zip archive file.
+     
+     This finds the entry's local header, which lies at the start of its data in
+     the archive, and so reads from the archive's file.
+     @param archive The Zip archive containing the entry.
+     @param index The index of the entry within the archive.
+     @param range Filled in with the location of the entry's data.
+     @result Returns `true` if the entry is stored without compression or
+     encryption, `false` otherwise.
+     */
+    EPUB3_EXPORT
+    static bool             StoredFileRange(struct zip* archive, int index, FileRange& range);
+    
 protected:
     struct zip_file*        _file;      ///< The underlying Zip file stream.
 	std::ios::openmode		_mode;		///< The mode used to open the file (used by Clone()).
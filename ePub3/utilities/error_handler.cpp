@@ -190,9 +190,25 @@ bool DefaultErrorHandler(const error_details& err)
 
 static ErrorHandlerFn   gErrorHandler = ePub3::DefaultErrorHandler;
 
+#if EPUB_COMPILER_SUPPORTS(CXX_THREAD_LOCAL)
+static thread_local DeferredErrors* gDeferredErrors = nullptr;
+#endif
+
 EPUB3_EXPORT
 ErrorHandlerFn ErrorHandler()
 {
+#if EPUB_COMPILER_SUPPORTS(CXX_THREAD_LOCAL)
+    DeferredErrors* deferred = gDeferredErrors;
+    if ( deferred != nullptr )
+    {
+        return [deferred](const error_details& err) {
+            if ( !err.is_spec_error() )
+                return gErrorHandler(err);
+            deferred->_held.push_back(err.spec_error());
+            return true;
+        };
+    }
+#endif
     return gErrorHandler;
 }
 
@@ -202,4 +218,40 @@ void SetErrorHandler(ErrorHandlerFn fn)
     gErrorHandler = fn;
 }
 
+DeferredErrors::DeferredErrors() : _held(), _enclosing(nullptr), _active(false)
+{
+#if EPUB_COMPILER_SUPPORTS(CXX_THREAD_LOCAL)
+    _enclosing = gDeferredErrors;
+    gDeferredErrors = this;
+    _active = true;
+#endif
+}
+DeferredErrors::~DeferredErrors()
+{
+    Uninstall();
+}
+void DeferredErrors::Uninstall()
+{
+#if EPUB_COMPILER_SUPPORTS(CXX_THREAD_LOCAL)
+    if ( _active && gDeferredErrors == this )
+        gDeferredErrors = _enclosing;
+#endif
+    _active = false;
+}
+void DeferredErrors::Release()
+{
+    Uninstall();
+
+    // any enclosing instance is now the current one, and takes these in turn
+    std::vector<epub_spec_error> held;
+    held.swap(_held);
+    for ( auto& err : held )
+        __DispatchError(err);
+}
+void DeferredErrors::Discard()
+{
+    Uninstall();
+    _held.clear();
+}
+
 EPUB3_END_NAMESPACE
@@ -25,6 +25,7 @@
 #include <array>
 #include <system_error>
 #include <functional>
+#include <vector>
 
 EPUB3_BEGIN_NAMESPACE
 
@@ -503,6 +504,13 @@ public:
 			throw std::logic_error("Attempt to get an EPUBError from a non-epub_spec_error exception");
 	}
 
+	const epub_spec_error& spec_error() const {
+		if (__is_spec_error_)
+			return *__spec_error_;
+		else
+			throw std::logic_error("Attempt to get an epub_spec_error from a non-epub_spec_error exception");
+	}
+
 	_NORETURN_
 	void throw_error() const {
 		if (__is_spec_error_)
@@ -513,6 +521,55 @@ public:
 
 };
 
+/**
+ Holds back the spec errors raised on the current thread while it's in scope.
+
+ A document read through an XMLStreamReader may turn out not to be well-formed
+ part-way through, at which point it's read again through the DOM, which raises
+ every spec error found so far a second time. Creating one of these around the
+ streaming pass keeps its spec errors away from the installed ErrorHandler() until
+ the caller knows whether that pass will stand: Release() then reports them, in
+ order, while Discard() drops them before the DOM pass runs.
+
+ System errors are never held back. Instances nest: errors released from an inner
+ instance are held by the one enclosing it. Where the compiler has no support for
+ `thread_local` nothing is held back, and errors are reported as they're raised.
+ */
+class DeferredErrors
+{
+public:
+    EPUB3_EXPORT            DeferredErrors();
+    EPUB3_EXPORT            ~DeferredErrors();
+
+private:
+                            DeferredErrors(const DeferredErrors&)           _DELETED_;
+    DeferredErrors&         operator=(const DeferredErrors&)                _DELETED_;
+
+public:
+    /**
+     Stops holding errors back, and reports those held so far.
+     @throws epub_spec_error If the error handler asks for a held error to be thrown;
+     any after it are dropped.
+     */
+    EPUB3_EXPORT
+    void                    Release();
+
+    ///
+    /// Stops holding errors back, and drops those held so far.
+    EPUB3_EXPORT
+    void                    Discard();
+
+private:
+    friend ErrorHandlerFn   ErrorHandler();
+
+    std::vector<epub_spec_error>    _held;
+    DeferredErrors*         _enclosing;
+    bool                    _active;
+
+    void                    Uninstall();
+
+};
+
 static inline FORCE_INLINE
 void __DispatchError(const std::system_error& __err)
 {
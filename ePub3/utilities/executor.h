@@ -476,7 +476,7 @@ private:
 public:
     explicit FORCE_INLINE
     thread_executor()
-        : /*__threads_(), */__lock_(), __cleanup_cv_(), __pending_count_(0), __running_count_(0)
+        : /*__threads_(), */__lock_(), __cleanup_cv_(), __pending_count_(0), __running_count_(0), __destruct_(false)
         {}
     
     virtual
@@ -498,7 +498,8 @@ public:
                 __cleanup_cv_.wait(__lk, [this](){return __threads_.empty();});
             }
              */
-            __cleanup_cv_.wait(__lk, [this](){return __running_count_ == 0;});
+            // closures which were accepted but haven't started yet still run
+            __cleanup_cv_.wait(__lk, [this](){return __running_count_ == 0 && __pending_count_ == 0;});
         }
     
     virtual
@@ -539,21 +540,16 @@ private:
             // wait until the thread has been safely installed in the executor's
             // state before running the closure
             std::unique_lock<std::mutex> __lk(__lock_);
-            if (!__destruct_)
-            {
-                __lk.unlock();
-                
-                __running_count_++;
-                __pending_count_--;
-                
-                _run_closure(__c);
-                
-                __running_count_--;
-                
-                __lk.lock();
-            }
+            __running_count_++;
+            __pending_count_--;
+            __lk.unlock();
+            
+            _run_closure(__c);
             
-            if (__running_count_ == 0)
+            // the destructor can't return until this lock is released
+            __lk.lock();
+            __running_count_--;
+            if (__running_count_ == 0 && __pending_count_ == 0)
                 __cleanup_cv_.notify_all();
 //            __reap_thread(std::this_thread::get_id());
         }
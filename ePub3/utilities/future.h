@@ -22,6 +22,7 @@
 #define ePub3_future_h
 
 #include <ePub3/base.h>
+#include <algorithm>
 #include <list>
 #include <string>
 #include <stdexcept>
@@ -30,6 +31,8 @@
 #include <thread>
 #include <memory>
 #include <atomic>
+#include <tuple>
+#include <vector>
 #include <ePub3/utilities/invoke.h>
 #include <ePub3/utilities/executor.h>
 #include <ePub3/utilities/condition_variable_any.h>
@@ -352,6 +355,29 @@ template <class F, class... Args>
   future<typename result_of<F(Args...)>::type>
   async(launch policy, F&& f, Args&&... args);
 
+template <class InputIterator>
+  future<vector<typename iterator_traits<InputIterator>::value_type>>
+  when_all(InputIterator first, InputIterator last);
+
+template <class... Futures>
+  future<tuple<typename decay<Futures>::type...>>
+  when_all(Futures&&... futures);
+
+template <class Sequence>
+struct when_any_result
+{
+    size_t   index;
+    Sequence futures;
+};
+
+template <class InputIterator>
+  future<when_any_result<vector<typename iterator_traits<InputIterator>::value_type>>>
+  when_any(InputIterator first, InputIterator last);
+
+template <class... Futures>
+  future<when_any_result<tuple<typename decay<Futures>::type...>>>
+  when_any(Futures&&... futures);
+
 template <class> class packaged_task; // undefined
 
 template <class R, class... ArgTypes>
@@ -702,6 +728,22 @@ struct __shared_state_base
 {
     typedef std::list<condition_variable_any*>      _WaiterListType;
     typedef std::shared_ptr<__shared_state_base>    _ContinuationPtrType;
+    typedef std::vector<_ContinuationPtrType>       _ContinuationListType;
+    
+    /**
+     The bits of `__status_`.
+     
+     A state starts out waiting, may have a continuation attached, and then
+     becomes ready; the bits are only set with `__mutex_` held, but can be read
+     without it, so a future which is already ready needn't take the lock to
+     say so, to be waited upon, or to have a continuation scheduled.
+     */
+    enum __status_bits : unsigned
+    {
+        __status_waiting_       = 0,
+        __status_continuation_  = 1 << 0,   ///< `__continuation_ptr_` is set.
+        __status_ready_         = 1 << 1,   ///< The value or exception is set.
+    };
     
     std::exception_ptr      __exc_;
     bool                    __done_;
@@ -713,6 +755,8 @@ struct __shared_state_base
     _WaiterListType         __external_waiters_;
     std::function<void()>   __callback_;
     _ContinuationPtrType    __continuation_ptr_;
+    _ContinuationListType   __more_continuations_;  ///< Any beyond the first, from shared_future or when_all()
+    std::atomic<unsigned>   __status_;
     
     static
     std::vector<_ContinuationPtrType>&   __at_thread_exit();
@@ -727,7 +771,8 @@ struct __shared_state_base
           __is_deferred_(false),
           __policy_(launch::none),
           __is_constructed_(false),
-          __continuation_ptr_()
+          __continuation_ptr_(),
+          __status_(__status_waiting_)
         {}
     
     __shared_state_base(const __shared_state_base&) _DELETED_;
@@ -762,30 +807,100 @@ struct __shared_state_base
             __external_waiters_.erase(__it);
         }
     
+    FORCE_INLINE
+    bool is_ready() const
+        {
+            return (__status_.load(std::memory_order_acquire) & __status_ready_) != 0;
+        }
+    
     FORCE_INLINE
     void do_continuation(std::unique_lock<std::mutex>& __lk)
         {
-            if (__continuation_ptr_)
+            if ((__status_.load(std::memory_order_relaxed) & __status_continuation_) == 0)
+                return;
+            
+            _ContinuationPtrType __c = std::move(__continuation_ptr_);
+            _ContinuationListType __more;
+            __more.swap(__more_continuations_);
+            __status_.fetch_and(~unsigned(__status_continuation_), std::memory_order_relaxed);
+            
+            if (__c)
             {
-                __continuation_ptr_->launch_continuation(__lk);
+                __c->launch_continuation(__lk);
+                if (!__lk.owns_lock())
+                    __lk.lock();
+            }
+            for (auto& __m : __more)
+            {
+                __m->launch_continuation(__lk);
                 if (!__lk.owns_lock())
                     __lk.lock();
-                __continuation_ptr_.reset();
             }
         }
     
     FORCE_INLINE
     void set_continuation_ptr(_ContinuationPtrType __c, std::unique_lock<std::mutex>& __lk)
         {
-            __continuation_ptr_ = __c;
+            if (__continuation_ptr_)
+                __more_continuations_.push_back(std::move(__c));
+            else
+                __continuation_ptr_ = std::move(__c);
+            __status_.fetch_or(__status_continuation_, std::memory_order_relaxed);
+            
             if (__done_)
                 do_continuation(__lk);
         }
     
+    ///
+    /// Detaches one continuation, wherever it's held, leaving any others in place.
+    /// `__lk` is the caller's lock, which already holds ours when run from do_continuation().
+    FORCE_INLINE
+    void clear_continuation_ptr(const __shared_state_base* __c, std::unique_lock<std::mutex>& __lk)
+        {
+            std::unique_lock<std::mutex> __own;
+            if (__lk.mutex() != &__mutex_ || !__lk.owns_lock())
+                __own = std::unique_lock<std::mutex>(__mutex_);
+            
+            if (__continuation_ptr_.get() == __c)
+            {
+                __continuation_ptr_.reset();
+            }
+            else
+            {
+                __more_continuations_.erase(std::remove_if(__more_continuations_.begin(), __more_continuations_.end(),
+                                                           [__c](const _ContinuationPtrType& __m) { return __m.get() == __c; }),
+                                            __more_continuations_.end());
+            }
+            
+            if (!__continuation_ptr_ && __more_continuations_.empty())
+                __status_.fetch_and(~unsigned(__status_continuation_), std::memory_order_relaxed);
+        }
+    
+    ///
+    /// Attaches a continuation unless the state is already ready, in which case
+    /// it returns `false` and the caller should go ahead itself. A deferred
+    /// function is run first, as it would otherwise only run when waited upon.
+    FORCE_INLINE
+    bool attach_continuation(const _ContinuationPtrType& __c)
+        {
+            if (is_ready())
+                return false;
+            
+            std::unique_lock<std::mutex> __lk(__mutex_);
+            if (__is_deferred_)
+                wait_internal(__lk, false);
+            if (__done_)
+                return false;
+            
+            set_continuation_ptr(__c, __lk);
+            return true;
+        }
+    
     FORCE_INLINE
     void mark_finished_internal(std::unique_lock<std::mutex>& __lk)
         {
             __done_ = true;
+            __status_.fetch_or(__status_ready_, std::memory_order_release);
             
             __waiters_.notify_all();
             for (auto& __w : __external_waiters_)
@@ -838,8 +953,15 @@ struct __shared_state_base
     FORCE_INLINE
     virtual void wait(bool __rethrow=true)
         {
+            if (is_ready())
+            {
+                if (__rethrow && __exc_)
+                    std::rethrow_exception(__exc_);
+                return;
+            }
+            
             std::unique_lock<std::mutex> __lk(__mutex_);
-            wait_internal(__lk);
+            wait_internal(__lk, __rethrow);
         }
     
     template <class _Clock, class _Duration = typename _Clock::duration>
@@ -892,8 +1014,7 @@ struct __shared_state_base
     FORCE_INLINE
     bool has_value() const
         {
-            std::lock_guard<std::mutex> _(__mutex_);
-            return __done_ && !__exc_;
+            return is_ready() && !__exc_;
         }
     
     FORCE_INLINE
@@ -905,8 +1026,7 @@ struct __shared_state_base
     FORCE_INLINE
     bool has_exception() const
         {
-            std::lock_guard<std::mutex> _(__mutex_);
-            return __done_ && __exc_;
+            return is_ready() && __exc_;
         }
     
     FORCE_INLINE
@@ -930,8 +1050,7 @@ struct __shared_state_base
     FORCE_INLINE
     __future_state::state get_state() const
         {
-            std::lock_guard<std::mutex> _(__mutex_);
-            if (!__done_)
+            if (!is_ready())
                 return __future_state::waiting;
             else
                 return __future_state::ready;
@@ -1968,7 +2087,12 @@ __make_future_deferred_continuation_shared_state(std::unique_lock<std::mutex>& _
 template <class _Fut, class _Rp, class _Fp>
 FORCE_INLINE
 future<_Rp>
-__make_future_executor_continuation_shared_state(std::unique_lock<std::mutex>& __lk, _Fut&& __f, executor* __e, _Fp&& __c);
+__make_future_executor_continuation_shared_state(_Fut&& __f, executor* __e, _Fp&& __c);
+
+template <typename _Seq>
+    struct __when_all_shared_state;
+template <typename _Seq>
+    struct __when_any_shared_state;
 
 template <typename _Fut, typename _Rp>
     struct __future_unwrap_shared_state;
@@ -2241,7 +2365,12 @@ private:
         __make_future_deferred_continuation_shared_state(std::unique_lock<std::mutex>&, _F&&, _Fp&&);
     template <class _F, class _Up, class _Fp>
         friend future<_Up>
-        __make_future_executor_continuation_shared_state(std::unique_lock<std::mutex>&, _F&&, executor*, _Fp&&);
+        __make_future_executor_continuation_shared_state(_F&&, executor*, _Fp&&);
+    
+    template <typename>
+        friend struct __when_all_shared_state;
+    template <typename>
+        friend struct __when_any_shared_state;
     
     template <typename, typename>
         friend struct __future_unwrap_shared_state;
@@ -2455,7 +2584,7 @@ private:
         __make_future_deferred_continuation_shared_state(std::unique_lock<std::mutex>&, _F&&, _Fp&&);
     template <class _F, class _Up, class _Fp>
         friend future<_Up>
-        __make_future_executor_continuation_shared_state(std::unique_lock<std::mutex>&, _F&&, executor*, _Fp&&);
+        __make_future_executor_continuation_shared_state(_F&&, executor*, _Fp&&);
     
     template <typename, typename>
         friend struct __future_unwrap_shared_state;
@@ -3792,7 +3921,7 @@ public:
             try
             {
                 // stop the parent from calling this continuation when its value is set
-                __parent_.__future_->__continuation_ptr_.reset();
+                __parent_.__future_->clear_continuation_ptr(this, __lk);
                 this->mark_finished_with_result_internal(__continuation_(std::move(__parent_)), __lk);
             }
             catch (...)
@@ -3831,7 +3960,7 @@ public:
             try
             {
                 // stop the parent from calling this continuation when its value is set
-                __parent_.__future_->__continuation_ptr_.reset();
+                __parent_.__future_->clear_continuation_ptr(this, __lk);
                 __continuation_(std::move(__parent_));
                 this->mark_finished_with_result_internal(__lk);
             }
@@ -3859,8 +3988,14 @@ public:
     virtual
     void launch_continuation(std::unique_lock<std::mutex>& __lk)
         {
-            assert(__target_ != nullptr);
             __relocker __relock(__lk);
+            schedule();
+        }
+    
+    FORCE_INLINE
+    void schedule()
+        {
+            assert(__target_ != nullptr);
             
             auto self = this->shared_from_this();
             __target_->add([this, self]() {
@@ -3892,9 +4027,15 @@ public:
     
     virtual
     void launch_continuation(std::unique_lock<std::mutex>& __lk)
+        {
+            __relocker __relock(__lk);
+            schedule();
+        }
+    
+    FORCE_INLINE
+    void schedule()
         {
             assert(__target_ != nullptr);
-            __lk.unlock();
             
             auto self = this->shared_from_this();
             __target_->add([this, self]() {
@@ -3931,10 +4072,13 @@ __make_future_async_continuation_shared_state(std::unique_lock<std::mutex>& __lk
 
 template <typename _Fut, typename _Rp, typename _Fp>
 future<_Rp>
-__make_future_executor_continuation_shared_state(std::unique_lock<std::mutex>& __lk, _Fut&& __f, executor* __exec, _Fp&& __c)
+__make_future_executor_continuation_shared_state(_Fut&& __f, executor* __exec, _Fp&& __c)
 {
     std::shared_ptr<__future_executor_continuation_shared_state<_Fut, _Rp, _Fp>> __h(new __future_executor_continuation_shared_state<_Fut, _Rp, _Fp>(std::move(__f), __exec, std::forward<_Fp>(__c)));
-    __h->__parent_.__future_->set_continuation_ptr(__h, __lk);
+    
+    // nothing else can finish a state which is already ready, so it needs no lock
+    if (!__h->__parent_.__future_->attach_continuation(__h))
+        __h->schedule();
     return future<_Rp>(__h);
 }
 
@@ -4001,8 +4145,7 @@ future<_Rp>::then(executor& __exec, _Fp&& __func)
     if (!bool(this->__future_))
         throw future_uninitialized();
     
-    std::unique_lock<std::mutex> __lk(this->__future_->__mutex_);
-    return std::move(__make_future_executor_continuation_shared_state<future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), &__exec, std::forward<_Fp>(__func)));
+    return std::move(__make_future_executor_continuation_shared_state<future<_Rp>, _Fut, _Fp>(std::move(*this), &__exec, std::forward<_Fp>(__func)));
 }
 
 template <typename _Rp>
@@ -4011,22 +4154,22 @@ inline FORCE_INLINE
 future<typename std::result_of<_Fp(shared_future<_Rp>)>::type>
 shared_future<_Rp>::then(launch __policy, _Fp&& __func)
 {
-    typedef typename std::result_of<_Fp(future<_Rp>)>::type _Fut;
+    typedef typename std::result_of<_Fp(shared_future<_Rp>)>::type _Fut;
     if (!bool(this->__future_))
         throw future_uninitialized();
     
     std::unique_lock<std::mutex> __lk(this->__future_->__mutex_);
     if (int(__policy) & int(launch::async))
     {
-        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), std::forward<_Fp>(__func)));
+        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, shared_future<_Rp>(*this), std::forward<_Fp>(__func)));
     }
     else if (int(__policy) & int(launch::deferred))
     {
-        return std::move(__make_future_deferred_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), std::forward<_Fp>(__func)));
+        return std::move(__make_future_deferred_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, shared_future<_Rp>(*this), std::forward<_Fp>(__func)));
     }
     else
     {
-        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), std::forward<_Fp>(__func)));
+        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, shared_future<_Rp>(*this), std::forward<_Fp>(__func)));
     }
 }
 
@@ -4036,22 +4179,22 @@ inline FORCE_INLINE
 future<typename std::result_of<_Fp(shared_future<_Rp>)>::type>
 shared_future<_Rp>::then(_Fp&& __func)
 {
-    typedef typename std::result_of<_Fp(future<_Rp>)>::type _Fut;
+    typedef typename std::result_of<_Fp(shared_future<_Rp>)>::type _Fut;
     if (!bool(this->__future_))
         throw future_uninitialized();
     
     std::unique_lock<std::mutex> __lk(this->__future_->__mutex_);
     if (int(this->launch_policy(__lk)) & int(launch::async))
     {
-        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), std::forward<_Fp>(__func)));
+        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, shared_future<_Rp>(*this), std::forward<_Fp>(__func)));
     }
     else if (int(this->launch_policy(__lk)) & int(launch::deferred))
     {
-        return std::move(__make_future_deferred_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), std::forward<_Fp>(__func)));
+        return std::move(__make_future_deferred_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, shared_future<_Rp>(*this), std::forward<_Fp>(__func)));
     }
     else
     {
-        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), std::forward<_Fp>(__func)));
+        return std::move(__make_future_async_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, shared_future<_Rp>(*this), std::forward<_Fp>(__func)));
     }
 }
 
@@ -4061,12 +4204,267 @@ inline FORCE_INLINE
 future<typename std::result_of<_Fp(shared_future<_Rp>)>::type>
 shared_future<_Rp>::then(executor& __exec, _Fp&& __func)
 {
-    typedef typename std::result_of<_Fp(future<_Rp>)>::type _Fut;
+    typedef typename std::result_of<_Fp(shared_future<_Rp>)>::type _Fut;
     if (!bool(this->__future_))
         throw future_uninitialized();
     
-    std::unique_lock<std::mutex> __lk(this->__future_->__mutex_);
-    return std::move(__make_future_executor_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(__lk, std::move(*this), &__exec, std::forward<_Fp>(__func)));
+    return std::move(__make_future_executor_continuation_shared_state<shared_future<_Rp>, _Fut, _Fp>(shared_future<_Rp>(*this), &__exec, std::forward<_Fp>(__func)));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// when_all, when_any
+
+template <class _Sequence>
+struct when_any_result
+{
+    std::size_t index;      ///< The position of a ready future in `futures`, or `size_t(-1)` if there are none.
+    _Sequence   futures;
+};
+
+/**
+ The shared state of a future returned by when_all().
+ 
+ It's attached as the continuation of each input, counting them down as they
+ become ready; the count starts one higher than the number of inputs, so that
+ the result can't be delivered while continuations are still being attached.
+ */
+template <typename _Seq>
+struct __when_all_shared_state
+    : __shared_state<_Seq>
+{
+    typedef std::vector<__shared_state_base*>   _StateList;
+    
+    _Seq                        __futures_;
+    std::atomic<std::size_t>    __pending_;
+    
+    FORCE_INLINE
+    __when_all_shared_state(_Seq&& __s, std::size_t __count)
+        : __futures_(std::move(__s)), __pending_(__count + 1)
+        {}
+    
+    FORCE_INLINE
+    void arrive()
+        {
+            if (__pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                this->mark_finished_with_result(std::move(__futures_));
+        }
+    
+    virtual
+    void launch_continuation(std::unique_lock<std::mutex>& __lk)
+        {
+            __relocker __relock(__lk);
+            arrive();
+        }
+    
+    static
+    future<_Seq> make(_Seq&& __s, const _StateList& __states)
+        {
+            std::shared_ptr<__when_all_shared_state> __h(new __when_all_shared_state(std::move(__s), __states.size()));
+            for (auto __st : __states)
+            {
+                if (!__st->attach_continuation(__h))
+                    __h->arrive();
+            }
+            __h->arrive();
+            return future<_Seq>(__h);
+        }
+};
+
+/**
+ The shared state of a future returned by when_any().
+ 
+ The first input to become ready delivers the result; as with when_all(), it
+ waits until the continuations have all been attached before doing so.
+ */
+template <typename _Seq>
+struct __when_any_shared_state
+    : __shared_state<when_any_result<_Seq>>
+{
+    typedef std::vector<__shared_state_base*>   _StateList;
+    
+    _Seq                __futures_;
+    _StateList          __states_;
+    std::atomic<bool>   __fired_;
+    std::atomic<int>    __pending_;     ///< Attaching, and the first input to become ready.
+    
+    FORCE_INLINE
+    __when_any_shared_state(_Seq&& __s, const _StateList& __states)
+        : __futures_(std::move(__s)), __states_(__states), __fired_(false), __pending_(__states.empty() ? 1 : 2)
+        {}
+    
+    FORCE_INLINE
+    void arrive()
+        {
+            if (!__fired_.exchange(true, std::memory_order_acq_rel))
+                release();
+        }
+    
+    FORCE_INLINE
+    void release()
+        {
+            if (__pending_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            
+            std::size_t __idx = 0;
+            while (__idx < __states_.size() && !__states_[__idx]->is_ready())
+                ++__idx;
+            if (__idx == __states_.size())
+                __idx = std::size_t(-1);
+            
+            __states_.clear();
+            this->mark_finished_with_result(when_any_result<_Seq>{__idx, std::move(__futures_)});
+        }
+    
+    virtual
+    void launch_continuation(std::unique_lock<std::mutex>& __lk)
+        {
+            __relocker __relock(__lk);
+            arrive();
+        }
+    
+    static
+    future<when_any_result<_Seq>> make(_Seq&& __s, const _StateList& __states)
+        {
+            std::shared_ptr<__when_any_shared_state> __h(new __when_any_shared_state(std::move(__s), __states));
+            for (auto __st : __states)
+            {
+                if (!__st->attach_continuation(__h))
+                {
+                    __h->arrive();
+                    break;
+                }
+            }
+            __h->release();
+            return future<when_any_result<_Seq>>(__h);
+        }
+};
+
+// futures are moved into the result, shared_futures copied
+template <typename _Rp>
+inline FORCE_INLINE
+future<_Rp>&& __when_take(future<_Rp>& __f)
+{
+    return std::move(__f);
+}
+
+template <typename _Rp>
+inline FORCE_INLINE
+const shared_future<_Rp>& __when_take(shared_future<_Rp>& __f)
+{
+    return __f;
+}
+
+template <typename _Fut>
+inline FORCE_INLINE
+__shared_state_base* __when_state(const _Fut& __f)
+{
+    if (!__f.valid())
+        throw future_uninitialized();
+    return __f.__future_.get();
+}
+
+template <typename _Iter>
+inline FORCE_INLINE
+typename std::enable_if
+<
+    !is_future_type<typename std::decay<_Iter>::type>::value,
+    std::vector<typename std::iterator_traits<_Iter>::value_type>
+>::type
+__when_collect(_Iter __b, _Iter __e, std::vector<__shared_state_base*>& __states)
+{
+    std::vector<typename std::iterator_traits<_Iter>::value_type> __futures;
+    for (; __b != __e; ++__b)
+    {
+        __states.push_back(__when_state(*__b));
+        __futures.push_back(__when_take(*__b));
+    }
+    return __futures;
+}
+
+///
+/// Returns a future which becomes ready when every future in the range has;
+/// its value is a vector of the futures, each of which is now ready.
+template <typename _Iter>
+inline FORCE_INLINE
+typename std::enable_if
+<
+    !is_future_type<typename std::decay<_Iter>::type>::value,
+    future<std::vector<typename std::iterator_traits<_Iter>::value_type>>
+>::type
+when_all(_Iter __b, _Iter __e)
+{
+    typedef std::vector<typename std::iterator_traits<_Iter>::value_type> _Seq;
+    std::vector<__shared_state_base*> __states;
+    _Seq __futures = __when_collect(__b, __e, __states);
+    return __when_all_shared_state<_Seq>::make(std::move(__futures), __states);
+}
+
+inline FORCE_INLINE
+future<std::tuple<>>
+when_all()
+{
+    return make_ready_future(std::tuple<>());
+}
+
+///
+/// Returns a future which becomes ready when every one of its arguments has;
+/// its value is a tuple of the futures, each of which is now ready.
+template <typename _F1, typename ..._Fs>
+inline FORCE_INLINE
+typename std::enable_if
+<
+    is_future_type<typename std::decay<_F1>::type>::value,
+    future<std::tuple<typename std::decay<_F1>::type, typename std::decay<_Fs>::type...>>
+>::type
+when_all(_F1&& __f1, _Fs&&... __fs)
+{
+    typedef std::tuple<typename std::decay<_F1>::type, typename std::decay<_Fs>::type...> _Seq;
+    std::vector<__shared_state_base*> __states{ __when_state(__f1), __when_state(__fs)... };
+    _Seq __futures(std::forward<_F1>(__f1), std::forward<_Fs>(__fs)...);
+    return __when_all_shared_state<_Seq>::make(std::move(__futures), __states);
+}
+
+///
+/// Returns a future which becomes ready when any future in the range has; its
+/// value holds the futures and the index of the first one seen to be ready.
+template <typename _Iter>
+inline FORCE_INLINE
+typename std::enable_if
+<
+    !is_future_type<typename std::decay<_Iter>::type>::value,
+    future<when_any_result<std::vector<typename std::iterator_traits<_Iter>::value_type>>>
+>::type
+when_any(_Iter __b, _Iter __e)
+{
+    typedef std::vector<typename std::iterator_traits<_Iter>::value_type> _Seq;
+    std::vector<__shared_state_base*> __states;
+    _Seq __futures = __when_collect(__b, __e, __states);
+    return __when_any_shared_state<_Seq>::make(std::move(__futures), __states);
+}
+
+inline FORCE_INLINE
+future<when_any_result<std::tuple<>>>
+when_any()
+{
+    return make_ready_future(when_any_result<std::tuple<>>{std::size_t(-1), std::tuple<>()});
+}
+
+///
+/// Returns a future which becomes ready when any of its arguments has; its
+/// value holds the futures and the index of the first one seen to be ready.
+template <typename _F1, typename ..._Fs>
+inline FORCE_INLINE
+typename std::enable_if
+<
+    is_future_type<typename std::decay<_F1>::type>::value,
+    future<when_any_result<std::tuple<typename std::decay<_F1>::type, typename std::decay<_Fs>::type...>>>
+>::type
+when_any(_F1&& __f1, _Fs&&... __fs)
+{
+    typedef std::tuple<typename std::decay<_F1>::type, typename std::decay<_Fs>::type...> _Seq;
+    std::vector<__shared_state_base*> __states{ __when_state(__f1), __when_state(__fs)... };
+    _Seq __futures(std::forward<_F1>(__f1), std::forward<_Fs>(__fs)...);
+    return __when_any_shared_state<_Seq>::make(std::move(__futures), __states);
 }
 
 EPUB3_END_NAMESPACE
@@ -0,0 +1,290 @@
+//
+//  instrumentation.cpp
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "instrumentation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+EPUB3_BEGIN_NAMESPACE
+
+std::atomic<bool> Instrumentation::_enabled(false);
+
+namespace
+{
+
+static const char* gMetricNames[size_t(Metric::Count)] = {
+    "archive.open",
+    "archive.lookup",
+    "archive.read",
+    "filter.cache_fill",
+    "filter.filter_data",
+    "container.open",
+    "container.parse_ocf",
+    "container.load_metadata",
+    "container.load_packages",
+    "container.build_filters",
+    "xpath.evaluate",
+    "runloop.timer",
+    "runloop.source",
+};
+
+typedef std::atomic<uint64_t> Counter;
+
+/**
+ One thread's counters.
+ 
+ Only the owning thread writes them, so an update is a relaxed load and store
+ rather than an atomic read-modify-write; other threads may read them at any time.
+ */
+struct ThreadMetrics
+{
+    struct Entry
+    {
+        Counter     count;
+        Counter     totalNanoseconds;
+        Counter     maxNanoseconds;
+        Counter     bytes;
+        Counter     histogram[MetricStatistics::HistogramBuckets];
+    };
+    
+    Entry           entries[size_t(Metric::Count)];
+    
+    ThreadMetrics();
+    ~ThreadMetrics();
+    
+    void AddTo(MetricsSnapshot& snapshot) const;
+    void Clear();
+    
+    static ThreadMetrics& Current();
+};
+
+/**
+ Every live thread's counters, plus the totals of threads which have exited.
+ 
+ It's never destroyed, since threads may exit during static destruction.
+ */
+struct Registry
+{
+    std::mutex                      lock;
+    std::vector<ThreadMetrics*>     threads;
+    MetricsSnapshot                 retired;
+    
+    static Registry& Instance()
+    {
+        static Registry* __registry = new Registry;
+        return *__registry;
+    }
+};
+
+static inline void Add(Counter& counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static inline size_t BucketFor(uint64_t nanoseconds)
+{
+    if ( nanoseconds < 2 )
+        return 0;
+    
+#if EPUB_COMPILER(GCC) || EPUB_COMPILER(CLANG)
+    size_t bucket = 63 - __builtin_clzll(nanoseconds);
+#else
+    size_t bucket = 0;
+    while ( (nanoseconds >>= 1) != 0 )
+        bucket++;
+#endif
+    return std::min(bucket, MetricStatistics::HistogramBuckets - 1);
+}
+
+ThreadMetrics::ThreadMetrics()
+{
+    Clear();
+    
+    Registry& registry = Registry::Instance();
+    std::lock_guard<std::mutex> _(registry.lock);
+    registry.threads.push_back(this);
+}
+
+ThreadMetrics::~ThreadMetrics()
+{
+    Registry& registry = Registry::Instance();
+    std::lock_guard<std::mutex> _(registry.lock);
+    AddTo(registry.retired);
+    registry.threads.erase(std::remove(registry.threads.begin(), registry.threads.end(), this), registry.threads.end());
+}
+
+void ThreadMetrics::AddTo(MetricsSnapshot &snapshot) const
+{
+    for ( size_t i = 0; i < size_t(Metric::Count); i++ )
+    {
+        const Entry& entry = entries[i];
+        MetricStatistics& stats = snapshot[Metric(i)];
+        stats.count += entry.count.load(std::memory_order_relaxed);
+        stats.totalNanoseconds += entry.totalNanoseconds.load(std::memory_order_relaxed);
+        stats.maxNanoseconds = std::max(stats.maxNanoseconds, entry.maxNanoseconds.load(std::memory_order_relaxed));
+        stats.bytes += entry.bytes.load(std::memory_order_relaxed);
+        for ( size_t b = 0; b < MetricStatistics::HistogramBuckets; b++ )
+            stats.histogram[b] += entry.histogram[b].load(std::memory_order_relaxed);
+    }
+}
+
+void ThreadMetrics::Clear()
+{
+    for ( Entry& entry : entries )
+    {
+        entry.count.store(0, std::memory_order_relaxed);
+        entry.totalNanoseconds.store(0, std::memory_order_relaxed);
+        entry.maxNanoseconds.store(0, std::memory_order_relaxed);
+        entry.bytes.store(0, std::memory_order_relaxed);
+        for ( Counter& bucket : entry.histogram )
+            bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+ThreadMetrics& ThreadMetrics::Current()
+{
+#if EPUB_COMPILER_SUPPORTS(CXX_THREAD_LOCAL)
+    static thread_local ThreadMetrics __metrics;
+    return __metrics;
+#else
+    // without thread-local storage all threads share one set, and may lose updates
+    static ThreadMetrics* __metrics = new ThreadMetrics;
+    return *__metrics;
+#endif
+}
+
+}
+
+double MetricStatistics::MeanNanoseconds() const
+{
+    return (count == 0 ? 0.0 : double(totalNanoseconds) / double(count));
+}
+
+uint64_t MetricStatistics::PercentileNanoseconds(double percentile) const
+{
+    if ( count == 0 )
+        return 0;
+    
+    uint64_t rank = uint64_t(std::ceil(double(count) * std::min(std::max(percentile, 0.0), 100.0) / 100.0));
+    rank = std::max(rank, uint64_t(1));
+    
+    uint64_t seen = 0;
+    for ( size_t b = 0; b < HistogramBuckets - 1; b++ )
+    {
+        seen += histogram[b];
+        if ( seen >= rank )
+            return std::min((uint64_t(2) << b) - 1, maxNanoseconds);
+    }
+    return maxNanoseconds;
+}
+
+MetricsSnapshot::MetricsSnapshot()
+{
+    std::memset(_metrics, 0, sizeof(_metrics));
+}
+
+std::string MetricsSnapshot::ToJSON() const
+{
+    std::ostringstream ss;
+    ss << "{";
+    
+    bool first = true;
+    for ( size_t i = 0; i < size_t(Metric::Count); i++ )
+    {
+        const MetricStatistics& stats = _metrics[i];
+        if ( stats.count == 0 )
+            continue;
+        
+        if ( !first )
+            ss << ",";
+        first = false;
+        
+        ss << "\"" << Instrumentation::Name(Metric(i)) << "\":{"
+           << "\"count\":" << stats.count
+           << ",\"total_ns\":" << stats.totalNanoseconds
+           << ",\"mean_ns\":" << uint64_t(stats.MeanNanoseconds())
+           << ",\"p50_ns\":" << stats.PercentileNanoseconds(50)
+           << ",\"p99_ns\":" << stats.PercentileNanoseconds(99)
+           << ",\"max_ns\":" << stats.maxNanoseconds
+           << ",\"bytes\":" << stats.bytes
+           << "}";
+    }
+    
+    ss << "}";
+    return ss.str();
+}
+
+void Instrumentation::SetEnabled(bool enabled)
+{
+    _enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Instrumentation::Record(Metric metric, std::chrono::nanoseconds duration, uint64_t bytes)
+{
+#if EPUB_ENABLE(INSTRUMENTATION)
+    if ( metric >= Metric::Count )
+        return;
+    
+    uint64_t nanoseconds = uint64_t(std::max(duration.count(), decltype(duration.count())(0)));
+    ThreadMetrics::Entry& entry = ThreadMetrics::Current().entries[size_t(metric)];
+    Add(entry.count, 1);
+    Add(entry.totalNanoseconds, nanoseconds);
+    Add(entry.bytes, bytes);
+    Add(entry.histogram[BucketFor(nanoseconds)], 1);
+    if ( nanoseconds > entry.maxNanoseconds.load(std::memory_order_relaxed) )
+        entry.maxNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+#endif
+}
+
+MetricsSnapshot Instrumentation::Snapshot()
+{
+    MetricsSnapshot result;
+    
+    Registry& registry = Registry::Instance();
+    std::lock_guard<std::mutex> _(registry.lock);
+    for ( size_t i = 0; i < size_t(Metric::Count); i++ )
+        result[Metric(i)] = registry.retired[Metric(i)];
+    for ( ThreadMetrics* thread : registry.threads )
+        thread->AddTo(result);
+    
+    return result;
+}
+
+void Instrumentation::Reset()
+{
+    Registry& registry = Registry::Instance();
+    std::lock_guard<std::mutex> _(registry.lock);
+    registry.retired = MetricsSnapshot();
+    for ( ThreadMetrics* thread : registry.threads )
+        thread->Clear();
+}
+
+const char* Instrumentation::Name(Metric metric)
+{
+    if ( metric >= Metric::Count )
+        return "unknown";
+    return gMetricNames[size_t(metric)];
+}
+
+EPUB3_END_NAMESPACE
@@ -0,0 +1,218 @@
+//
+//  instrumentation.h
+//  ePub3
+//
+//  Copyright (c) 2014 Readium Foundation and/or its licensees. All rights reserved.
+//
+//  This program is distributed in the hope that it will be useful, but WITHOUT ANY
+//  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//  Licensed under Gnu Affero General Public License Version 3 (provided, notwithstanding this notice,
+//  Readium Foundation reserves the right to license this material under a different separate license,
+//  and if you have done so, the terms of that separate license control and the following references
+//  to GPL do not apply).
+//
+//  This program is free software: you can redistribute it and/or modify it under the terms of the GNU
+//  Affero General Public License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version. You should have received a copy of the GNU
+//  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef ePub3_instrumentation_h
+#define ePub3_instrumentation_h
+
+#include <ePub3/epub3.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if EPUB_HAVE(SYS_SDT_H)
+# include <sys/sdt.h>
+#endif
+
+EPUB3_BEGIN_NAMESPACE
+
+/**
+ The operations measured by the instrumentation layer.
+ 
+ Each is recorded with its duration and, where it makes sense, the number of bytes
+ it produced.
+ */
+enum class Metric : uint8_t
+{
+    ArchiveOpen,            ///< Opening a ZIP archive and indexing its entries.
+    ArchiveLookup,          ///< Finding an archive entry by path.
+    ArchiveRead,            ///< Reading (and inflating) bytes from an archive entry.
+    FilterCacheFill,        ///< Reading and filtering a whole resource in a FilterChainByteStream.
+    FilterData,             ///< A single call to ContentFilter::FilterData().
+    ContainerOpen,          ///< The whole of Container::Open().
+    ContainerParseOCF,      ///< Reading and parsing `META-INF/container.xml`.
+    ContainerLoadMetadata,  ///< Reading encryption, signature and vendor metadata.
+    ContainerLoadPackages,  ///< Opening the packages named by the rootfiles.
+    ContainerBuildFilters,  ///< Building each package's filter chain.
+    XPathEvaluate,          ///< A single XPath evaluation.
+    RunLoopTimer,           ///< A RunLoop timer callback.
+    RunLoopSource,          ///< A RunLoop event source callback.
+    
+    Count                   ///< Not a metric: the number of metrics.
+};
+
+/**
+ The measurements for one Metric.
+ 
+ Durations are also kept as a histogram with power-of-two buckets: bucket `i`
+ counts operations taking from 2^i up to 2^(i+1) nanoseconds, with the last
+ bucket counting everything longer.
+ */
+struct MetricStatistics
+{
+    ///
+    /// The number of histogram buckets; the last starts at about two seconds.
+    static CONSTEXPR size_t HistogramBuckets = 32;
+    
+    uint64_t    count;                          ///< The number of operations.
+    uint64_t    totalNanoseconds;               ///< Their total duration.
+    uint64_t    maxNanoseconds;                 ///< The longest duration.
+    uint64_t    bytes;                          ///< The total number of bytes produced.
+    uint64_t    histogram[HistogramBuckets];    ///< Counts by duration.
+    
+    ///
+    /// The mean duration, or zero if there were no operations.
+    double      MeanNanoseconds()                           const;
+    
+    /**
+     Estimates a percentile from the histogram.
+     @param percentile A value between 0 and 100.
+     @result The upper bound of the bucket containing the percentile, limited to
+     the longest duration seen.
+     */
+    uint64_t    PercentileNanoseconds(double percentile)    const;
+};
+
+/**
+ A point-in-time copy of every metric, summed over all threads.
+ */
+class MetricsSnapshot
+{
+public:
+    MetricsSnapshot();
+    
+    const MetricStatistics&     operator[](Metric metric)   const   { return _metrics[size_t(metric)]; }
+    MetricStatistics&           operator[](Metric metric)           { return _metrics[size_t(metric)]; }
+    
+    /**
+     Writes the snapshot as a JSON object keyed by metric name, omitting metrics
+     with no operations. Each value holds the count, total, mean, median, 99th
+     percentile and maximum durations in nanoseconds, and the byte count.
+     */
+    EPUB3_EXPORT std::string    ToJSON()                    const;
+    
+private:
+    MetricStatistics            _metrics[size_t(Metric::Count)];
+};
+
+/**
+ Low-overhead instrumentation of the SDK's hot paths.
+ 
+ Instrumented operations always fire the static probes `readium:metric_begin` and
+ `readium:metric_end`, where the platform provides `<sys/sdt.h>`; these take the
+ Metric as their first argument, and the end probe the byte count as its second.
+ They cost a single no-op instruction until a tracer such as bpftrace or
+ SystemTap attaches to them.
+ 
+ When SetEnabled() has been called, operations are also timed and counted. Each
+ thread keeps its own counters, which only it writes, so recording takes no
+ locks; Snapshot() sums them. Counters are kept once a thread exits.
+ 
+ The whole layer is compiled out when `EPUB_ENABLE_INSTRUMENTATION` is defined
+ as zero, leaving snapshots empty.
+ */
+class Instrumentation
+{
+public:
+    ///
+    /// Returns `true` if operations are being counted. Disabled by default.
+    static bool                 Enabled()                   { return _enabled.load(std::memory_order_relaxed); }
+    EPUB3_EXPORT static void    SetEnabled(bool enabled);
+    
+    /**
+     Records one operation on the calling thread.
+     @param metric The operation.
+     @param duration How long it took.
+     @param bytes The number of bytes it produced.
+     */
+    EPUB3_EXPORT static void    Record(Metric metric, std::chrono::nanoseconds duration, uint64_t bytes=0);
+    
+    ///
+    /// Returns the totals for all threads.
+    EPUB3_EXPORT static MetricsSnapshot Snapshot();
+    
+    /**
+     Sets every counter back to zero. Operations in progress on other threads
+     while this runs may be partly counted.
+     */
+    EPUB3_EXPORT static void    Reset();
+    
+    ///
+    /// The metric's name, as used by MetricsSnapshot::ToJSON().
+    EPUB3_EXPORT static const char* Name(Metric metric);
+    
+private:
+    static std::atomic<bool>    _enabled;
+};
+
+/**
+ Measures the operation spanning its lifetime.
+ 
+ Use it through the EPUB_MEASURE() and EPUB_MEASURE_BYTES() macros, which vanish
+ when instrumentation is compiled out.
+ */
+class ScopedMetric
+{
+private:
+                    ScopedMetric(const ScopedMetric&)       _DELETED_;
+    ScopedMetric&   operator=(const ScopedMetric&)          _DELETED_;
+    
+public:
+    typedef std::chrono::steady_clock   Clock;
+    
+    explicit ScopedMetric(Metric metric) : _metric(metric), _bytes(0), _timed(Instrumentation::Enabled())
+    {
+#if EPUB_HAVE(SYS_SDT_H)
+        DTRACE_PROBE1(readium, metric_begin, int(_metric));
+#endif
+        if ( _timed )
+            _start = Clock::now();
+    }
+    ~ScopedMetric()
+    {
+#if EPUB_HAVE(SYS_SDT_H)
+        DTRACE_PROBE2(readium, metric_end, int(_metric), _bytes);
+#endif
+        if ( _timed )
+            Instrumentation::Record(_metric, Clock::now() - _start, _bytes);
+    }
+    
+    ///
+    /// Adds to the number of bytes the operation has produced.
+    void            AddBytes(uint64_t bytes)                { _bytes += bytes; }
+    
+private:
+    Metric              _metric;
+    uint64_t            _bytes;
+    bool                _timed;
+    Clock::time_point   _start;
+};
+
+EPUB3_END_NAMESPACE
+
+#if EPUB_ENABLE(INSTRUMENTATION)
+# define EPUB_MEASURE(var, metric)      ::ePub3::ScopedMetric var(::ePub3::Metric::metric)
+# define EPUB_MEASURE_BYTES(var, n)     var.AddBytes(n)
+#else
+# define EPUB_MEASURE(var, metric)
+# define EPUB_MEASURE_BYTES(var, n)
+#endif
+
+#endif /* ePub3_instrumentation_h */
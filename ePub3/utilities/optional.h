@@ -386,7 +386,7 @@ struct __optional_base
     template <class _Up, class ..._Args,
                 class = typename std::enable_if
                 <
-                    std::is_constructible<_Tp, std::initializer_list<_Tp>>::value,
+                    std::is_constructible<_Tp, std::initializer_list<_Up>, _Args...>::value,
                     bool
                 >::type
              >
@@ -444,7 +444,7 @@ struct __constexpr_optional_base
     template <class _Up, class ..._Args,
                 class = typename std::enable_if
                 <
-                    std::is_constructible<_Tp, std::initializer_list<_Tp>>::value
+                    std::is_constructible<_Tp, std::initializer_list<_Up>, _Args...>::value
                 >::type
              >
     FORCE_INLINE
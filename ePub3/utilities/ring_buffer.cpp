@@ -91,15 +91,15 @@ std::size_t RingBuffer::ReadBytes(uint8_t *buf, std::size_t len)
     std::size_t copied = std::min(len, _numBytes);
     if ( copied != 0 )
     {
-        if ( _readPos < _writePos )
+        if ( _readPos + copied <= _capacity )
         {
-            std::memcpy(buf, &_buffer[_readPos], len);
+            std::memcpy(buf, &_buffer[_readPos], copied);
         }
         else
         {
             std::size_t __t = _capacity - _readPos;
             std::memcpy(buf, &_buffer[_readPos], __t);
-            std::memcpy(&buf[__t], _buffer, len - __t);
+            std::memcpy(&buf[__t], _buffer, copied - __t);
         }
     }
     
@@ -112,20 +112,20 @@ std::size_t RingBuffer::WriteBytes(const uint8_t *buf, std::size_t len)
     {
         if ( _writePos < _readPos )
         {
-            std::memcpy(&_buffer[_writePos], buf, len);
-            _writePos += len;
+            std::memcpy(&_buffer[_writePos], buf, copied);
+            _writePos += copied;
         }
         else
         {
             std::size_t __t = _capacity - _writePos;
-            if ( __t >= len )
+            if ( __t >= copied )
             {
-                std::memcpy(&_buffer[_writePos], buf, len);
-                _writePos += len;
+                std::memcpy(&_buffer[_writePos], buf, copied);
+                _writePos += copied;
             }
             else
             {
-                std::size_t __b = len - __t;
+                std::size_t __b = copied - __t;
                 std::memcpy(&_buffer[_writePos], buf, __t);
                 std::memcpy(_buffer, &buf[__t], __b);
                 _writePos = __b;
@@ -134,7 +134,7 @@ std::size_t RingBuffer::WriteBytes(const uint8_t *buf, std::size_t len)
         
         if ( _writePos == _capacity )
             _writePos = 0;
-        _numBytes += len;
+        _numBytes += copied;
     }
     
     return copied;
@@ -44,6 +44,7 @@ struct ALooper;
 #include <ePub3/utilities/utfstring.h>
 #include <chrono>
 #include <list>
+#include <vector>
 #include <mutex>
 #include <atomic>
 
@@ -195,6 +196,8 @@ public:
 #else
         std::atomic<bool>                   _signalled; ///< Whether the source has been signalled.
         bool                                _cancelled; ///< Whether the source is cancelled.
+        std::mutex                          _runLoopsLock;  ///< Guards the list of RunLoops.
+        std::vector<std::weak_ptr<RunLoop>> _runLoops;  ///< The RunLoops to wake when the source is signalled.
 #endif
         
         EventHandlerFn              _fn;    ///< The function to invoke when the event fires.
@@ -601,10 +604,11 @@ private:
     std::recursive_mutex                _listLock;
     std::mutex                          _conditionLock;
     std::condition_variable             _wakeUp;
+    bool                                _wokenUp;       ///< Set by WakeUp() under _conditionLock, so a wakeup just before waiting isn't lost.
     std::atomic<bool>                   _waiting;
     std::atomic<bool>                   _stop;
     Observer::Activity                  _observerMask;
-    const TimerPtr                      _waitingUntilTimer;
+    TimerPtr                            _waitingUntilTimer;
 #endif
 
 };
@@ -293,7 +293,10 @@ int RunLoop::_ReceiveLoopEvent(int fd, int events, void* data)
             return 0;
         }
         
-        pTimer->_fn(*pTimer);                 ///////// DO CALLOUT
+        {
+            EPUB_MEASURE(measure, RunLoopTimer);
+            pTimer->_fn(*pTimer);             ///////// DO CALLOUT
+        }
         
         if ( !pTimer->Repeats() || pTimer->IsCancelled() )
         {
@@ -318,7 +321,10 @@ int RunLoop::_ReceiveLoopEvent(int fd, int events, void* data)
             return 0;
         }
         
-        pSource->_fn(*pSource);               /////////// DO CALLOUT
+        {
+            EPUB_MEASURE(measure, RunLoopSource);
+            pSource->_fn(*pSource);           /////////// DO CALLOUT
+        }
         
         if ( pSource->IsCancelled() )
         {
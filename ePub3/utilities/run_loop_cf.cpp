@@ -290,6 +290,7 @@ void RunLoop::EventSource::Signal()
 void RunLoop::EventSource::_FireCFSourceEvent(void *info)
 {
     EventSource* p = reinterpret_cast<EventSource*>(info);
+    EPUB_MEASURE(measure, RunLoopSource);
     p->_fn(*p);
 }
 void RunLoop::EventSource::_ScheduleCF(void* info, CFRunLoopRef rl, CFStringRef mode)
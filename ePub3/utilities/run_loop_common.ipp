@@ -19,6 +19,7 @@
 //  Affero General Public License along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "run_loop.h"
+#include "instrumentation.h"
 
 #if EPUB_COMPILER_SUPPORTS(CXX_THREAD_LOCAL)
 
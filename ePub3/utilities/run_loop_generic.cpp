@@ -33,7 +33,7 @@ EPUB3_BEGIN_NAMESPACE
 
 using StackLock = std::lock_guard<std::recursive_mutex>;
 
-RunLoop::RunLoop() : _timers(), _observers(), _sources(), _listLock(), _conditionLock(), _wakeUp(), _waiting(false), _stop(false), _observerMask(0), _waitingUntilTimer(nullptr)
+RunLoop::RunLoop() : _timers(), _observers(), _sources(), _listLock(), _conditionLock(), _wakeUp(), _wokenUp(false), _waiting(false), _stop(false), _observerMask(0), _waitingUntilTimer(nullptr)
 {
 }
 RunLoop::~RunLoop()
@@ -141,6 +141,15 @@ void RunLoop::AddEventSource(EventSourcePtr ev)
         return;
     
     _sources.push_back(ev);
+    
+    {
+        std::lock_guard<std::mutex> _(ev->_runLoopsLock);
+        ev->_runLoops.push_back(shared_from_this());
+    }
+    
+    // it may have been signalled before it was added
+    if ( ev->_signalled )
+        WakeUp();
 }
 bool RunLoop::ContainsEventSource(EventSourcePtr ev) const
 {
@@ -164,6 +173,18 @@ void RunLoop::RemoveEventSource(EventSourcePtr ev)
         }
     }
     
+    {
+        std::lock_guard<std::mutex> _(ev->_runLoopsLock);
+        for ( auto iter = ev->_runLoops.begin(); iter != ev->_runLoops.end(); )
+        {
+            RunLoopPtr runLoop = iter->lock();
+            if ( !bool(runLoop) || runLoop.get() == this )
+                iter = ev->_runLoops.erase(iter);
+            else
+                ++iter;
+        }
+    }
+    
     if ( _waiting && _timers.empty() && _sources.empty() )
     {
         // run out of useful things to wait upon
@@ -183,8 +204,7 @@ void RunLoop::Run()
 void RunLoop::Stop()
 {
     _stop = true;
-    if ( _waiting )
-        WakeUp();
+    WakeUp();
 }
 bool RunLoop::IsWaiting() const
 {
@@ -192,16 +212,15 @@ bool RunLoop::IsWaiting() const
 }
 void RunLoop::WakeUp()
 {
-    if ( _conditionLock.try_lock() )
-    {
-        _wakeUp.notify_all();
-        _conditionLock.unlock();
-    }
+    std::lock_guard<std::mutex> _(_conditionLock);
+    _wokenUp = true;
+    _wakeUp.notify_all();
 }
 RunLoop::ExitReason RunLoop::RunInternal(bool returnAfterSourceHandled, std::chrono::nanoseconds &timeout)
 {
     using namespace std::chrono;
-    system_clock::time_point timeoutTime = system_clock::now() + duration_cast<system_clock::duration>(timeout);
+    // 'forever' is clamped to a year, so the deadline can't overflow the clock and wrap into the past
+    system_clock::time_point timeoutTime = system_clock::now() + duration_cast<system_clock::duration>(std::min<nanoseconds>(timeout, hours(24*365)));
     ExitReason reason(ExitReason::RunTimedOut);
     
     // catch a pending stop
@@ -220,7 +239,7 @@ RunLoop::ExitReason RunLoop::RunInternal(bool returnAfterSourceHandled, std::chr
             break;
         }
         
-        std::vector<Timer*> timersToFire = CollectFiringTimers();
+        shared_vector<Timer> timersToFire = CollectFiringTimers();
         if ( !timersToFire.empty() )
         {
             RunObservers(Observer::ActivityFlags::RunLoopBeforeTimers);
@@ -231,7 +250,10 @@ RunLoop::ExitReason RunLoop::RunInternal(bool returnAfterSourceHandled, std::chr
                 Timer::Clock::time_point date = timer->GetNextFireDate();
                 
                 // fire the callback now
-                timer->_fn(*timer);
+                {
+                    EPUB_MEASURE(measure, RunLoopTimer);
+                    timer->_fn(*timer);
+                }
                 
                 // only reset a repeating timer if the fire date hasn't been changed
                 //  by the callback
@@ -242,12 +264,13 @@ RunLoop::ExitReason RunLoop::RunInternal(bool returnAfterSourceHandled, std::chr
             }
         }
         
-        std::vector<EventSource*> sourcesToFire = CollectFiringSources(returnAfterSourceHandled);
+        shared_vector<EventSource> sourcesToFire = CollectFiringSources(returnAfterSourceHandled);
         if ( !sourcesToFire.empty() )
         {
             RunObservers(Observer::ActivityFlags::RunLoopBeforeSources);
             for ( auto source : sourcesToFire )
             {
+                EPUB_MEASURE(measure, RunLoopSource);
                 source->_fn(*source);
             }
             
@@ -258,6 +281,13 @@ RunLoop::ExitReason RunLoop::RunInternal(bool returnAfterSourceHandled, std::chr
             }
         }
         
+        // a callback may have stopped us, and nothing else will wake us up to notice
+        if ( _stop.exchange(false) )
+        {
+            reason = ExitReason::RunStopped;
+            break;
+        }
+        
         if ( timeout <= nanoseconds(0) )
         {
             reason = ExitReason::RunTimedOut;
@@ -271,7 +301,8 @@ RunLoop::ExitReason RunLoop::RunInternal(bool returnAfterSourceHandled, std::chr
         system_clock::time_point waitUntil = TimeoutOrTimer(timeoutTime);
         
         std::unique_lock<std::mutex> _condLock(_conditionLock);
-        std::cv_status waitStatus = _wakeUp.wait_until(_condLock, waitUntil);
+        bool wokenUp = _wakeUp.wait_until(_condLock, waitUntil, [this]() { return _wokenUp; });
+        _wokenUp = false;
         _condLock.unlock();
         
         _waiting = false;
@@ -280,13 +311,13 @@ RunLoop::ExitReason RunLoop::RunInternal(bool returnAfterSourceHandled, std::chr
         RunObservers(Observer::ActivityFlags::RunLoopAfterWaiting);
         
         // why did we wake up?
-        if ( waitStatus == std::cv_status::timeout )
+        if ( !wokenUp )
         {
             reason = ExitReason::RunTimedOut;
             break;
         }
         
-        if ( _stop )
+        if ( _stop.exchange(false) )
         {
             reason = ExitReason::RunStopped;
             break;
@@ -305,7 +336,7 @@ void RunLoop::RunObservers(Observer::Activity activity)
     if ( (_observerMask & activity) == 0 )
         return;
     
-    std::vector<Observer*> observersToRemove;
+    shared_vector<Observer> observersToRemove;
     for ( auto observer : _observers )
     {
         if ( observer->IsCancelled() )
@@ -326,13 +357,13 @@ void RunLoop::RunObservers(Observer::Activity activity)
         RemoveObserver(observer);
     }
 }
-std::vector<RunLoop::Timer*> RunLoop::CollectFiringTimers()
+shared_vector<RunLoop::Timer> RunLoop::CollectFiringTimers()
 {
     // _listLock MUST ALREADY BE HELD
     auto currentTime = std::chrono::system_clock::now();
-    std::vector<Timer*> result;
+    shared_vector<Timer> result;
     
-    std::vector<Timer*> timersToRemove;
+    shared_vector<Timer> timersToRemove;
     for ( TimerPtr timer : _timers )
     {
         if ( timer->IsCancelled() )
@@ -359,7 +390,7 @@ std::vector<RunLoop::Timer*> RunLoop::CollectFiringTimers()
 shared_vector<RunLoop::EventSource> RunLoop::CollectFiringSources(bool onlyOne)
 {
     // _listLock MUST ALREADY BE HELD
-    shared_vector<EventSourcePtr> result;
+    shared_vector<EventSource> result;
     
     shared_vector<EventSource> cancelledSources;
     for ( EventSourcePtr source : _sources )
@@ -375,7 +406,7 @@ shared_vector<RunLoop::EventSource> RunLoop::CollectFiringSources(bool onlyOne)
         if ( source->_signalled.exchange(false) )
             result.push_back(source);
         
-        if ( onlyOne )
+        if ( onlyOne && !result.empty() )
             break;      // don't unset the signal on any other sources
     }
     
@@ -494,6 +525,20 @@ void RunLoop::EventSource::Cancel()
 void RunLoop::EventSource::Signal()
 {
     _signalled = true;
+    
+    // wake the RunLoops outside our lock, since they take it to unregister us
+    std::vector<RunLoopPtr> runLoops;
+    {
+        std::lock_guard<std::mutex> _(_runLoopsLock);
+        for ( auto& weak : _runLoops )
+        {
+            RunLoopPtr runLoop = weak.lock();
+            if ( bool(runLoop) )
+                runLoops.push_back(runLoop);
+        }
+    }
+    for ( auto& runLoop : runLoops )
+        runLoop->WakeUp();
 }
 
 RunLoop::Timer::Timer(Clock::time_point& fireDate, Clock::duration& interval, TimerFn fn) : _fireDate(fireDate), _interval(interval), _fn(fn)
@@ -339,7 +339,10 @@ void RunLoop::ProcessTimer(TimerPtr timer)
         return;
     }
 
-    timer->_fn(*timer);     // DO CALLOUT
+    {
+        EPUB_MEASURE(measure, RunLoopTimer);
+        timer->_fn(*timer);     // DO CALLOUT
+    }
 
     if ( !timer->Repeats() || timer->IsCancelled() )
     {
@@ -354,7 +357,10 @@ void RunLoop::ProcessEventSource(EventSourcePtr source)
         return;
     }
 
-    source->_fn(*source);       // DO CALLOUT
+    {
+        EPUB_MEASURE(measure, RunLoopSource);
+        source->_fn(*source);       // DO CALLOUT
+    }
 
     if ( source->IsCancelled() )
     {
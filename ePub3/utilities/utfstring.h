@@ -878,8 +878,8 @@ protected:
     size_type to_utf32_size(__base::size_type __b, __base::size_type __e) const _NOEXCEPT;
     static size_type utf32_distance(__base::const_iterator first, __base::const_iterator last) _NOEXCEPT;
     
-    static inline CONSTEXPR __base::const_pointer _bchar(const xmlChar * c) _NOEXCEPT { return (__base::const_pointer)(c); }
-    static inline CONSTEXPR __base::pointer _bchar(xmlChar * c) _NOEXCEPT { return (__base::pointer)(c); }
+    static inline __base::const_pointer _bchar(const xmlChar * c) _NOEXCEPT { return (__base::const_pointer)(c); }
+    static inline __base::pointer _bchar(xmlChar * c) _NOEXCEPT { return (__base::pointer)(c); }
     
 #if UTF_USE_ICU
     // ICU version, since GNU libstdc++ hasn't implemented wstring_convert or codecvt_utf8 yet
@@ -1282,11 +1282,11 @@ public:
 #if EPUB_COMPILER_SUPPORTS(CXX_USER_LITERALS)
 // C++11 lets us define new literal types, so lets have "something"_xc be an xmlChar *, eh?
 // Sadly, we can't define prefix forms. Boo...
-CONSTEXPR inline const xmlChar * operator "" _xc(const char * __s, size_t __n) _NOEXCEPT {
+inline const xmlChar * operator "" _xc(const char * __s, size_t __n) _NOEXCEPT {
     return (const xmlChar *)__s;
 }
 #endif
-static inline CONSTEXPR const xmlChar * _xml(const char * __s) _NOEXCEPT {
+static inline const xmlChar * _xml(const char * __s) _NOEXCEPT {
     return (const xmlChar*)(__s);
 }
 
@@ -1302,7 +1302,7 @@ static inline string xmlString(const std::string & str) {
 static inline std::string asciiString(const xmlChar * s) {
     return std::string(reinterpret_cast<const char *>(s));
 }
-static inline CONSTEXPR const char * ascii(const xmlChar * __x) {
+static inline const char * ascii(const xmlChar * __x) {
     return (const char *)__x;
 }
 
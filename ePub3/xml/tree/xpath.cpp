@@ -21,6 +21,7 @@
 #include "xpath.h"
 #include "node.h"
 #include "document.h"
+#include <ePub3/utilities/instrumentation.h>
 #include <libxml/xpathInternals.h>
 
 EPUB3_XML_BEGIN_NAMESPACE
@@ -241,6 +242,8 @@ bool XPathEvaluator::RegisterVariable(const string &name, void *data, ObjectType
 
 bool XPathEvaluator::Evaluate(std::shared_ptr<const Node> node, ObjectType * resultType)
 {
+    EPUB_MEASURE(measure, XPathEvaluate);
+    
     if ( _lastResult != nullptr )
         xmlXPathFreeObject(_lastResult);
     
@@ -255,6 +258,8 @@ bool XPathEvaluator::Evaluate(std::shared_ptr<const Node> node, ObjectType * res
 }
 bool XPathEvaluator::EvaluateAsBoolean(std::shared_ptr<const Node> node)
 {
+    EPUB_MEASURE(measure, XPathEvaluate);
+    
     if ( _lastResult != nullptr )
         xmlXPathFreeObject(_lastResult);
     